@@ -0,0 +1,829 @@
+// k3 math benchmark
+// times the exported vector, matrix and quaternion functions at every supported simd level
+// and writes the results as json, so runs can be diffed when the math code changes
+//
+// usage: k3bench_math [-o file] [-t min_ms] [-f filter]
+//   -o file    write the json to file instead of stdout
+//   -t min_ms  minimum time spent timing each case, default 10
+//   -f filter  only run cases whose name contains filter
+
+#include "k3.h"
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// operand sets cycled through on consecutive calls, so the compiler can't hoist the work
+static const uint32_t BENCH_POOL = 64;
+// largest vector length and largest matrix row count benchmarked
+static const uint32_t BENCH_MAX_VEC = 4096;
+static const uint32_t BENCH_MAX_ROWS = 64;
+// element count of the batched functions
+static const uint32_t BENCH_BATCH = 256;
+// timing repeats; the fastest one is reported
+static const uint32_t BENCH_REPEATS = 3;
+
+static const uint32_t bench_vec_sizes[] = { 2, 3, 4, 16, 256, BENCH_MAX_VEC };
+static const uint32_t bench_mat_sizes[] = { 2, 3, 4, 8, 16, 32, BENCH_MAX_ROWS };
+
+// floats between consecutive operand sets; a multiple of 16 keeps every set 64 byte aligned
+static const uint32_t BENCH_SLOT = 16 * BENCH_BATCH + 16;
+
+struct benchData {
+    float* a;
+    float* b;
+    float* c;
+    float* d;
+    float* scratch;
+    uint32_t indices[BENCH_MAX_VEC];
+    uint32_t row_indices[BENCH_MAX_VEC];  // k3m_Swizzle source of each element, a rotation of the matrix
+    uint32_t col_indices[BENCH_MAX_VEC];
+    uint32_t size;
+};
+
+typedef void (*bench_fn)(benchData* data, uint32_t iters);
+
+struct benchCase {
+    const char* name;
+    bench_fn run;
+    uint32_t size;
+    uint32_t elements;  // vector components, matrix elements or batch items processed per call
+    bool precision;     // result depends on k3math_SetPrecision, so time both tiers
+};
+
+struct benchResult {
+    std::string name;
+    const char* simd;
+    const char* precision;
+    uint32_t size;
+    bool aligned;
+    uint64_t iters;
+    double ns_per_op;
+    double mops_per_s;
+    double melem_per_s;
+};
+
+// results are summed in here so no call is optimized away
+static volatile float bench_sink = 0.0f;
+
+#define BENCH_SET(p, i) ((p) + ((i) % BENCH_POOL) * BENCH_SLOT)
+
+// ------------------------------------------------------------
+// Vector cases
+
+#define BENCH_VV(fn) \
+static void bench_##fn(benchData* data, uint32_t iters) \
+{ \
+    uint32_t i; \
+    for (i = 0; i < iters; i++) fn(data->size, BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i)); \
+    bench_sink = bench_sink + data->d[0]; \
+}
+
+#define BENCH_SV(fn) \
+static void bench_##fn(benchData* data, uint32_t iters) \
+{ \
+    uint32_t i; \
+    for (i = 0; i < iters; i++) fn(data->size, BENCH_SET(data->d, i), data->a[i % BENCH_POOL], BENCH_SET(data->b, i)); \
+    bench_sink = bench_sink + data->d[0]; \
+}
+
+BENCH_VV(k3v_Add)
+BENCH_VV(k3v_Sub)
+BENCH_VV(k3v_Mul)
+BENCH_VV(k3v_Div)
+BENCH_VV(k3v_Min)
+BENCH_VV(k3v_Max)
+BENCH_VV(k3v_Cross)
+BENCH_VV(k3v_FastAtan2)
+BENCH_SV(k3sv_Add)
+BENCH_SV(k3sv_Sub)
+BENCH_SV(k3sv_Mul)
+BENCH_SV(k3sv_Div)
+
+static void bench_k3v_Negate(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v_Negate(data->size, BENCH_SET(data->d, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v_Swizzle(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v_Swizzle(data->size, BENCH_SET(data->d, i), data->indices);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v_Normalize(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v_Normalize(data->size, BENCH_SET(data->d, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v_Length(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3v_Length(data->size, BENCH_SET(data->a, i));
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3v_Dot(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3v_Dot(data->size, BENCH_SET(data->a, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3v_Equals(benchData* data, uint32_t iters)
+{
+    uint32_t i, count = 0;
+    for (i = 0; i < iters; i++) count += k3v_Equals(data->size, BENCH_SET(data->a, i), BENCH_SET(data->c, i));
+    bench_sink = bench_sink + (float)count;
+}
+
+static void bench_k3v_FastSinCos(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v_FastSinCos(data->size, BENCH_SET(data->c, i), BENCH_SET(data->d, i), BENCH_SET(data->a, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v_FastRsqrt(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v_FastRsqrt(data->size, BENCH_SET(data->d, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3s_FastSin(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3s_FastSin(data->a[i % BENCH_POOL] * 4.0f);
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3s_FastCos(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3s_FastCos(data->a[i % BENCH_POOL] * 4.0f);
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3s_FastSinCos(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sin_x, cos_x, sum = 0.0f;
+    for (i = 0; i < iters; i++) {
+        k3s_FastSinCos(data->a[i % BENCH_POOL] * 4.0f, &sin_x, &cos_x);
+        sum += sin_x + cos_x;
+    }
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3s_FastAtan2(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3s_FastAtan2(data->a[i % BENCH_POOL], data->b[i % BENCH_POOL]);
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3s_FastRsqrt(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3s_FastRsqrt(data->a[i % BENCH_POOL] + 2.0f);
+    bench_sink = bench_sink + sum;
+}
+
+// a holds components in [-1, 1), so the colours cover out of range values as well
+static void bench_k3v3_RGBtoHSV(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v3_RGBtoHSV(BENCH_SET(data->d, i), BENCH_SET(data->a, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v3_HSVtoRGB(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v3_HSVtoRGB(BENCH_SET(data->d, i), BENCH_SET(data->a, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v3_SetTangentBitangent(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) {
+        const float* p = BENCH_SET(data->a, i);
+        const float* u = BENCH_SET(data->b, i);
+        k3v3_SetTangentBitangent(BENCH_SET(data->d, i), BENCH_SET(data->d, i) + 3, p, p + 3, p + 6, u, u + 2, u + 4);
+    }
+    bench_sink = bench_sink + data->d[0];
+}
+
+// ------------------------------------------------------------
+// Matrix cases; size is the row count of a square matrix
+
+static void bench_k3m_Mul(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_Mul(data->size, data->size, data->size, BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_MulScratch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_MulScratch(data->size, data->size, data->size, BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i), data->scratch);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3mv_Mul(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_Mul(data->size, data->size, 1, BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3vm_Mul(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_Mul(1, data->size, data->size, BENCH_SET(data->d, i), BENCH_SET(data->b, i), BENCH_SET(data->a, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_Transpose(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_Transpose(data->size, data->size, BENCH_SET(data->d, i));
+    bench_sink = bench_sink + data->d[1];
+}
+
+static void bench_k3m_Determinant(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3m_Determinant(data->size, BENCH_SET(data->a, i));
+    bench_sink = bench_sink + sum;
+}
+
+static void bench_k3m_DeterminantScratch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3m_DeterminantScratch(data->size, BENCH_SET(data->a, i), data->scratch);
+    bench_sink = bench_sink + sum;
+}
+
+// inverting in place alternates between the matrix and its inverse, both well conditioned
+static void bench_k3m_Inverse(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_Inverse(data->size, BENCH_SET(data->c, i));
+    bench_sink = bench_sink + data->c[0];
+}
+
+static void bench_k3m_InverseScratch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_InverseScratch(data->size, BENCH_SET(data->c, i), data->scratch);
+    bench_sink = bench_sink + data->c[0];
+}
+
+static void bench_k3m_Swizzle(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_Swizzle(data->size, data->size, BENCH_SET(data->d, i), data->row_indices, data->col_indices);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_SetIdentity(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_SetIdentity(data->size, BENCH_SET(data->d, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_SetRotation(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_SetRotation(data->size, BENCH_SET(data->d, i), data->a[i % BENCH_POOL], BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_AxisAlign(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_AxisAlign(data->size, data->size, BENCH_SET(data->d, i), BENCH_SET(data->a, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+// ------------------------------------------------------------
+// 4x4 transform cases
+
+static void bench_k3m4_Mul(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_Mul(BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_InverseTransform(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_InverseTransform(BENCH_SET(data->c, i));
+    bench_sink = bench_sink + data->c[0];
+}
+
+static void bench_k3m4_SetLookAt(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_SetLookAt(BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i), BENCH_SET(data->c, i), false);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_SetPerspectiveFov(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_SetPerspectiveFov(BENCH_SET(data->d, i), 1.0f + data->a[i % BENCH_POOL] * 0.01f, 1.5f, 0.1f, 100.0f, false, true, false);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_SetPerspectiveOffCenter(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) {
+        float x = data->a[i % BENCH_POOL] * 0.01f;
+        k3m4_SetPerspectiveOffCenter(BENCH_SET(data->d, i), x - 0.1f, x + 0.1f, -0.075f, 0.075f, 0.1f, 100.0f, false, true, false);
+    }
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_SetOrthoOffCenter(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) {
+        float x = data->a[i % BENCH_POOL];
+        k3m4_SetOrthoOffCenter(BENCH_SET(data->d, i), x - 10.0f, x + 10.0f, -7.5f, 7.5f, 0.1f, 100.0f, false, true, false);
+    }
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_GetFrustumPlanes(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_GetFrustumPlanes(BENCH_SET(data->d, i), BENCH_SET(data->a, i), true, false);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_SetRotAngleScaleXlat(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_SetRotAngleScaleXlat(BENCH_SET(data->d, i), BENCH_SET(data->a, i), BENCH_SET(data->b, i), BENCH_SET(data->c, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_SetScaleRotAngleXlat(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_SetScaleRotAngleXlat(BENCH_SET(data->d, i), BENCH_SET(data->b, i), BENCH_SET(data->a, i), BENCH_SET(data->c, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_MulArray(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_MulArray(data->size, BENCH_SET(data->d, i), 16, BENCH_SET(data->a, i), 16, BENCH_SET(data->b, i), 16);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3mv4_MulArray(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3mv4_MulArray(data->size, BENCH_SET(data->d, i), 4, BENCH_SET(data->a, i), 0, BENCH_SET(data->b, i), 4);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3mp3_MulArray(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3mp3_MulArray(data->size, BENCH_SET(data->d, i), 3, BENCH_SET(data->a, i), 0, BENCH_SET(data->b, i), 3);
+    bench_sink = bench_sink + data->d[0];
+}
+
+// ------------------------------------------------------------
+// Quaternion cases; the b operand holds unit quaternions
+
+static void bench_k3m_QuatToMat(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_QuatToMat(data->size, BENCH_SET(data->d, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_MatToQuat(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_MatToQuat(4, BENCH_SET(data->d, i), BENCH_SET(data->c, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v4_QuatMul(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_QuatMul(BENCH_SET(data->d, i), BENCH_SET(data->b, i), BENCH_SET(data->b, i + 1));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v4_QuatConjugate(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_QuatConjugate(BENCH_SET(data->d, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v4_SetQuatRotation(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_SetQuatRotation(BENCH_SET(data->d, i), data->a[i % BENCH_POOL], BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v3_GetQuatRotation(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    float angle, sum = 0.0f;
+    for (i = 0; i < iters; i++) sum += k3v3_GetQuatRotation(BENCH_SET(data->d, i), &angle, BENCH_SET(data->b, i));
+    bench_sink = bench_sink + sum + angle;
+}
+
+static void bench_k3v4_SetQuatEuler(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_SetQuatEuler(BENCH_SET(data->d, i), BENCH_SET(data->a, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v3_GetQuatEuler(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v3_GetQuatEuler(BENCH_SET(data->d, i), BENCH_SET(data->b, i));
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v4_QuatNlerpBatch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_QuatNlerpBatch(data->size, BENCH_SET(data->d, i), 4, BENCH_SET(data->b, i), 4, BENCH_SET(data->b, i + 1), 4, 0.25f);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v4_QuatSlerpBatch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_QuatSlerpBatch(data->size, BENCH_SET(data->d, i), 4, BENCH_SET(data->b, i), 4, BENCH_SET(data->b, i + 1), 4, 0.25f);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m_QuatToMatBatch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m_QuatToMatBatch(data->size, 4, BENCH_SET(data->d, i), 16, BENCH_SET(data->b, i), 4);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3v4_QuatToDualQuatBatch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3v4_QuatToDualQuatBatch(data->size, BENCH_SET(data->d, i), 8, BENCH_SET(data->b, i), 4, BENCH_SET(data->a, i), 3);
+    bench_sink = bench_sink + data->d[0];
+}
+
+static void bench_k3m4_DualQuatToMatBatch(benchData* data, uint32_t iters)
+{
+    uint32_t i;
+    for (i = 0; i < iters; i++) k3m4_DualQuatToMatBatch(data->size, BENCH_SET(data->d, i), 16, BENCH_SET(data->b, i), 8);
+    bench_sink = bench_sink + data->d[0];
+}
+
+// ------------------------------------------------------------
+// Case list
+
+static void bench_AddCase(std::vector<benchCase>* cases, const char* name, bench_fn run, uint32_t size, uint32_t elements, bool precision = false)
+{
+    benchCase bc = { name, run, size, elements, precision };
+    cases->push_back(bc);
+}
+
+#define BENCH_VEC(fn, precision) \
+    for (uint32_t s : bench_vec_sizes) bench_AddCase(&cases, #fn, bench_##fn, s, s, precision)
+#define BENCH_MAT(fn, precision) \
+    for (uint32_t s : bench_mat_sizes) bench_AddCase(&cases, #fn, bench_##fn, s, s * s, precision)
+#define BENCH_ONE(fn, size, elements, precision) \
+    bench_AddCase(&cases, #fn, bench_##fn, size, elements, precision)
+
+static std::vector<benchCase> bench_GetCases()
+{
+    std::vector<benchCase> cases;
+    BENCH_VEC(k3v_Negate, false);
+    BENCH_VEC(k3v_Swizzle, false);
+    BENCH_VEC(k3v_Length, false);
+    BENCH_VEC(k3v_Normalize, true);
+    BENCH_VEC(k3v_Add, false);
+    BENCH_VEC(k3v_Sub, false);
+    BENCH_VEC(k3v_Mul, false);
+    BENCH_VEC(k3v_Div, false);
+    BENCH_VEC(k3v_Min, false);
+    BENCH_VEC(k3v_Max, false);
+    BENCH_VEC(k3v_Dot, false);
+    BENCH_VEC(k3v_Equals, false);
+    BENCH_VEC(k3v_FastSinCos, false);
+    BENCH_VEC(k3v_FastAtan2, false);
+    BENCH_VEC(k3v_FastRsqrt, false);
+    BENCH_VEC(k3sv_Add, false);
+    BENCH_VEC(k3sv_Sub, false);
+    BENCH_VEC(k3sv_Mul, false);
+    BENCH_VEC(k3sv_Div, false);
+    BENCH_ONE(k3v_Cross, 3, 3, false);
+    BENCH_ONE(k3v_Cross, 4, 4, false);
+    BENCH_ONE(k3s_FastSin, 1, 1, false);
+    BENCH_ONE(k3s_FastCos, 1, 1, false);
+    BENCH_ONE(k3s_FastSinCos, 1, 1, false);
+    BENCH_ONE(k3s_FastAtan2, 1, 1, false);
+    BENCH_ONE(k3s_FastRsqrt, 1, 1, false);
+    BENCH_ONE(k3v3_RGBtoHSV, 3, 3, false);
+    BENCH_ONE(k3v3_HSVtoRGB, 3, 3, false);
+    BENCH_ONE(k3v3_SetTangentBitangent, 3, 6, false);
+
+    BENCH_MAT(k3m_Mul, false);
+    BENCH_MAT(k3m_MulScratch, false);
+    BENCH_MAT(k3mv_Mul, false);
+    BENCH_MAT(k3vm_Mul, false);
+    BENCH_MAT(k3m_Transpose, false);
+    BENCH_MAT(k3m_Determinant, false);
+    BENCH_MAT(k3m_DeterminantScratch, false);
+    BENCH_MAT(k3m_Inverse, false);
+    BENCH_MAT(k3m_InverseScratch, false);
+    BENCH_MAT(k3m_Swizzle, false);
+    BENCH_MAT(k3m_SetIdentity, false);
+    BENCH_ONE(k3m_SetRotation, 3, 9, true);
+    BENCH_ONE(k3m_SetRotation, 4, 16, true);
+    BENCH_ONE(k3m_AxisAlign, 3, 9, false);
+    BENCH_ONE(k3m_AxisAlign, 4, 16, false);
+
+    BENCH_ONE(k3m4_Mul, 4, 16, false);
+    BENCH_ONE(k3m4_InverseTransform, 4, 16, false);
+    BENCH_ONE(k3m4_SetLookAt, 4, 16, false);
+    BENCH_ONE(k3m4_SetPerspectiveFov, 4, 16, false);
+    BENCH_ONE(k3m4_SetPerspectiveOffCenter, 4, 16, false);
+    BENCH_ONE(k3m4_SetOrthoOffCenter, 4, 16, false);
+    BENCH_ONE(k3m4_GetFrustumPlanes, 4, 16, false);
+    BENCH_ONE(k3m4_SetRotAngleScaleXlat, 4, 16, true);
+    BENCH_ONE(k3m4_SetScaleRotAngleXlat, 4, 16, true);
+    BENCH_ONE(k3m4_MulArray, BENCH_BATCH, BENCH_BATCH, false);
+    BENCH_ONE(k3mv4_MulArray, BENCH_BATCH, BENCH_BATCH, false);
+    BENCH_ONE(k3mp3_MulArray, BENCH_BATCH, BENCH_BATCH, false);
+
+    BENCH_ONE(k3m_QuatToMat, 3, 1, false);
+    BENCH_ONE(k3m_QuatToMat, 4, 1, false);
+    BENCH_ONE(k3m_MatToQuat, 4, 1, false);
+    BENCH_ONE(k3v4_QuatMul, 4, 1, false);
+    BENCH_ONE(k3v4_QuatConjugate, 4, 1, false);
+    BENCH_ONE(k3v4_SetQuatRotation, 4, 1, true);
+    BENCH_ONE(k3v3_GetQuatRotation, 4, 1, false);
+    BENCH_ONE(k3v4_SetQuatEuler, 4, 1, true);
+    BENCH_ONE(k3v3_GetQuatEuler, 4, 1, true);
+    BENCH_ONE(k3v4_QuatNlerpBatch, BENCH_BATCH, BENCH_BATCH, false);
+    BENCH_ONE(k3v4_QuatSlerpBatch, BENCH_BATCH, BENCH_BATCH, false);
+    BENCH_ONE(k3m_QuatToMatBatch, BENCH_BATCH, BENCH_BATCH, false);
+    BENCH_ONE(k3v4_QuatToDualQuatBatch, BENCH_BATCH, BENCH_BATCH, false);
+    BENCH_ONE(k3m4_DualQuatToMatBatch, BENCH_BATCH, BENCH_BATCH, false);
+    return cases;
+}
+
+// ------------------------------------------------------------
+// Operands
+
+static float bench_Random(uint32_t* state)
+{
+    // xorshift; returns [-1, 1)
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (float)(*state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+// a: values in [-1, 1)
+// b: unit quaternions in every group of 4, also usable as nonzero vectors and axes
+// c: packed size x size matrices that stay well conditioned when inverted;
+//    at size 4 a rotation plus translation, which the transform and quaternion cases expect
+// d: destination, starts as a copy of b
+static void bench_FillData(uint32_t size, float* a, float* b, float* c, float* d)
+{
+    uint32_t i, j, r;
+    uint32_t state = 0x1234567;
+    for (i = 0; i < BENCH_POOL; i++) {
+        float* sa = a + i * BENCH_SLOT;
+        float* sb = b + i * BENCH_SLOT;
+        float* sc = c + i * BENCH_SLOT;
+        for (j = 0; j < BENCH_SLOT; j++) sa[j] = bench_Random(&state);
+        for (j = 0; j + 4 <= BENCH_SLOT; j += 4) {
+            sb[j + 0] = bench_Random(&state);
+            sb[j + 1] = bench_Random(&state);
+            sb[j + 2] = bench_Random(&state);
+            sb[j + 3] = bench_Random(&state) + 2.0f;
+            k3v_Normalize(4, sb + j);
+        }
+        for (j = 0; j < BENCH_SLOT; j++) sc[j] = 0.1f * bench_Random(&state);
+        if (size == 4) {
+            k3m_QuatToMat(4, sc, sb);
+            sc[3] = sa[0];
+            sc[7] = sa[1];
+            sc[11] = sa[2];
+        } else if (size <= BENCH_MAX_ROWS) {
+            for (r = 0; r < size; r++) sc[r * size + r] = 2.0f;
+        }
+        memcpy(d + i * BENCH_SLOT, sb, BENCH_SLOT * sizeof(float));
+    }
+}
+
+static void* bench_AlignedAlloc(size_t bytes)
+{
+    void* raw = malloc(bytes + 64 + sizeof(void*));
+    if (raw == NULL) return NULL;
+    uintptr_t p = ((uintptr_t)raw + sizeof(void*) + 63) & ~(uintptr_t)63;
+    ((void**)p)[-1] = raw;
+    return (void*)p;
+}
+
+static void bench_AlignedFree(void* p)
+{
+    if (p) free(((void**)p)[-1]);
+}
+
+// ------------------------------------------------------------
+// Timing
+
+static double bench_Seconds(bench_fn run, benchData* data, uint32_t iters)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    run(data, iters);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// doubles the iteration count until one run takes min_seconds, then keeps the fastest of the repeats
+static void bench_Time(const benchCase* bc, benchData* data, double min_seconds, uint64_t* iters_out, double* seconds_out)
+{
+    uint32_t iters = 1;
+    uint32_t r;
+    double seconds;
+    for (;;) {
+        seconds = bench_Seconds(bc->run, data, iters);
+        if (seconds >= min_seconds || iters >= (1u << 30)) break;
+        iters *= 2;
+    }
+    for (r = 1; r < BENCH_REPEATS; r++) {
+        double t = bench_Seconds(bc->run, data, iters);
+        if (t < seconds) seconds = t;
+    }
+    *iters_out = iters;
+    *seconds_out = seconds;
+}
+
+static const char* bench_SimdName(k3simdLevel level)
+{
+    switch (level) {
+    case k3simdLevel::SSE41: return "SSE41";
+    case k3simdLevel::AVX2: return "AVX2";
+    case k3simdLevel::NEON: return "NEON";
+    default: return "NONE";
+    }
+}
+
+static void bench_WriteJson(FILE* out, const std::vector<benchResult>& results, double min_ms)
+{
+    size_t i;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"k3bench_math\",\n");
+    fprintf(out, "  \"max_simd\": \"%s\",\n", bench_SimdName(k3math_GetMaxSimdLevel()));
+    fprintf(out, "  \"min_time_ms\": %g,\n", min_ms);
+    fprintf(out, "  \"results\": [\n");
+    for (i = 0; i < results.size(); i++) {
+        const benchResult& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"simd\": \"%s\", \"precision\": \"%s\", \"size\": %u, \"aligned\": %s, "
+            "\"iters\": %llu, \"ns_per_op\": %.3f, \"mops_per_s\": %.3f, \"melem_per_s\": %.3f}%s\n",
+            r.name.c_str(), r.simd, r.precision, r.size, (r.aligned) ? "true" : "false",
+            (unsigned long long)r.iters, r.ns_per_op, r.mops_per_s, r.melem_per_s,
+            (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* out_file = NULL;
+    const char* filter = NULL;
+    double min_ms = 10.0;
+    int a;
+    for (a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "-o") && a + 1 < argc) {
+            out_file = argv[++a];
+        } else if (!strcmp(argv[a], "-t") && a + 1 < argc) {
+            min_ms = atof(argv[++a]);
+        } else if (!strcmp(argv[a], "-f") && a + 1 < argc) {
+            filter = argv[++a];
+        } else {
+            fprintf(stderr, "usage: %s [-o file] [-t min_ms] [-f filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t bytes = BENCH_POOL * BENCH_SLOT * sizeof(float) + 64;
+    float* pool[4];
+    uint32_t p;
+    for (p = 0; p < 4; p++) {
+        pool[p] = (float*)bench_AlignedAlloc(bytes);
+        if (pool[p] == NULL) {
+            fprintf(stderr, "k3bench_math: out of memory\n");
+            return 1;
+        }
+    }
+    float* scratch = new float[k3m_GetScratchSize(BENCH_MAX_ROWS)];
+
+    const k3simdLevel levels[] = { k3simdLevel::NONE, k3simdLevel::SSE41, k3simdLevel::AVX2, k3simdLevel::NEON };
+    const k3mathPrecision precisions[] = { k3mathPrecision::EXACT, k3mathPrecision::FAST };
+    k3simdLevel start_level = k3math_GetSimdLevel();
+    std::vector<benchCase> cases = bench_GetCases();
+    std::vector<benchResult> results;
+
+    for (k3simdLevel level : levels) {
+        if (k3math_SetSimdLevel(level) != level) continue;
+        for (const benchCase& bc : cases) {
+            if (filter && !strstr(bc.name, filter)) continue;
+            for (uint32_t offset = 0; offset < 2; offset++) {
+                for (k3mathPrecision precision : precisions) {
+                    if (precision == k3mathPrecision::FAST && !bc.precision) continue;
+                    k3math_SetPrecision(precision);
+                    // unaligned runs shift every operand by one float
+                    benchData data;
+                    data.a = pool[0] + offset;
+                    data.b = pool[1] + offset;
+                    data.c = pool[2] + offset;
+                    data.d = pool[3] + offset;
+                    data.scratch = scratch;
+                    data.size = bc.size;
+                    uint32_t i;
+                    for (i = 0; i < BENCH_MAX_VEC; i++) {
+                        data.indices[i] = (i < bc.size) ? bc.size - 1 - i : i;
+                        // element (r, c) takes (c, size - 1 - r)
+                        data.row_indices[i] = i % bc.size;
+                        data.col_indices[i] = bc.size - 1 - (i / bc.size) % bc.size;
+                    }
+                    bench_FillData(bc.size, data.a, data.b, data.c, data.d);
+
+                    uint64_t iters;
+                    double seconds;
+                    bench_Time(&bc, &data, min_ms * 0.001, &iters, &seconds);
+                    benchResult r;
+                    r.name = bc.name;
+                    r.simd = bench_SimdName(level);
+                    r.precision = (precision == k3mathPrecision::FAST) ? "FAST" : "EXACT";
+                    r.size = bc.size;
+                    r.aligned = (offset == 0);
+                    r.iters = iters;
+                    r.ns_per_op = seconds * 1e9 / (double)iters;
+                    r.mops_per_s = (double)iters / seconds * 1e-6;
+                    r.melem_per_s = r.mops_per_s * bc.elements;
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+    k3math_SetSimdLevel(start_level);
+    k3math_SetPrecision(k3mathPrecision::EXACT);
+
+    FILE* out = stdout;
+    if (out_file) {
+        out = fopen(out_file, "w");
+        if (out == NULL) {
+            fprintf(stderr, "k3bench_math: could not open %s\n", out_file);
+            return 1;
+        }
+    }
+    bench_WriteJson(out, results, min_ms);
+    if (out != stdout) fclose(out);
+
+    delete[] scratch;
+    for (p = 0; p < 4; p++) bench_AlignedFree(pool[p]);
+    return 0;
+}
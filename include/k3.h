@@ -16,10 +16,17 @@
 #include <unistd.h>
 #endif
 
+#if defined(_WIN32)
 #define K3CALLBACK __cdecl
 #ifndef K3DECLSPEC
 #define K3DECLSPEC __declspec( dllimport )
 #endif
+#else
+#define K3CALLBACK
+#ifndef K3DECLSPEC
+#define K3DECLSPEC
+#endif
+#endif
 #define K3API K3DECLSPEC
 
 static const uint32_t K3_MAX_NAME_LENGTH = 64;
@@ -181,7 +188,8 @@ enum class k3objType {
     LLIST,
     LLIST_NODE,
     SAMPLE_DATA,
-    SOUND_FONT
+    SOUND_FONT,
+    IMAGE_BATCH
 };
 
 class k3obj
@@ -239,6 +247,41 @@ private:
     static k3error_handler_ptr _handler;
 };
 
+// ------------------------------------------------------------
+// k3 parallel loops
+// Work that k3 splits across threads goes through a thread pool. The built in pool starts one
+// worker per extra core on first use, and runs loops from any number of threads at once; workers
+// move to the newest loop as they finish each index. An application with its own job system can
+// install it instead.
+
+typedef void (K3CALLBACK* k3parallel_task_ptr)(void* context, uint32_t index);
+
+typedef uint32_t (K3CALLBACK* k3thread_pool_getnumthreads_ptr)(void* pool_data);
+
+// must call task(context, i) exactly once for every i below count, in any order and on any thread,
+// and return only after all of the calls have returned; calls may come from inside a running task
+typedef void (K3CALLBACK* k3thread_pool_run_ptr)(void* pool_data, uint32_t count, k3parallel_task_ptr task, void* context);
+
+struct k3thread_pool_t
+{
+    void* pool_data;
+    k3thread_pool_getnumthreads_ptr GetNumThreads;
+    k3thread_pool_run_ptr Run;
+};
+
+class k3parallel
+{
+public:
+    // passing NULL goes back to the built in pool; the pool must outlive every k3 call made after this
+    static K3API void SetThreadPool(k3thread_pool_t* pool);
+    static K3API k3thread_pool_t* GetThreadPool();
+    static K3API uint32_t GetNumThreads();
+    static K3API void For(uint32_t count, k3parallel_task_ptr task, void* context);
+
+private:
+    static k3thread_pool_t* _pool;
+};
+
 // ------------------------------------------------------------
 // k3 math functions
 const float PI = 3.1415926535898f;
@@ -253,6 +296,47 @@ inline float deg2rad(float x)
     return (PI * x) / 180;
 }
 
+/* simd instruction set used by the vector and matrix functions */
+/* every level returns results bit-identical to NONE, the scalar reference */
+enum class k3simdLevel {
+    NONE,
+    SSE41,
+    AVX2,
+    NEON
+};
+
+/* the best supported level is selected when the library loads */
+/* setting an unsupported level falls back to the closest supported one, which is returned */
+/* not thread safe; change the level only while no other thread is doing math */
+K3API k3simdLevel k3math_GetSimdLevel();
+K3API k3simdLevel k3math_GetMaxSimdLevel();
+K3API k3simdLevel k3math_SetSimdLevel(k3simdLevel level);
+
+/* precision of sin, cos, atan2 and reciprocal square root inside the library */
+/* EXACT uses libm; FAST uses the k3s_Fast approximations below, which are several times quicker */
+/* FAST applies to k3m_SetRotation, k3v4_SetQuatRotation, k3v4_SetQuatEuler, k3v3_GetQuatEuler and k3v_Normalize */
+/* the fixed size k3vec/k3mat templates always stay exact; not thread safe, like the simd level */
+enum class k3mathPrecision {
+    EXACT,
+    FAST
+};
+K3API k3mathPrecision k3math_GetPrecision();
+K3API k3mathPrecision k3math_SetPrecision(k3mathPrecision precision);
+
+/* fast approximations, whatever the precision setting */
+/* sin, cos: max absolute error 2e-7 for |x| <= 8192; accuracy falls off beyond that */
+/* atan2: max absolute error 3e-7 for finite inputs; signed zeros follow libm */
+/* rsqrt: max relative error 5e-6 for positive normal inputs; rsqrt(0) is a large finite value */
+K3API float k3s_FastSin(float x);
+K3API float k3s_FastCos(float x);
+K3API void  k3s_FastSinCos(float x, float* sin_x, float* cos_x);
+K3API float k3s_FastAtan2(float y, float x);
+K3API float k3s_FastRsqrt(float x);
+/* element by element batches of the same, bit-identical to the scalar versions */
+K3API void  k3v_FastSinCos(uint32_t vec_length, float* sin_d, float* cos_d, const float* s);
+K3API float* k3v_FastAtan2(uint32_t vec_length, float* d, const float* s1, const float* s2);
+K3API float* k3v_FastRsqrt(uint32_t vec_length, float* d, const float* s);
+
 /* operations to a single vector */
 K3API float* k3v_Negate(uint32_t vec_length, float* d);
 K3API float* k3v_Swizzle(uint32_t vec_length, float* d, const uint32_t* indices);
@@ -292,16 +376,187 @@ K3API float* k3m4_SetPerspectiveOffCenter(float* d, float left, float right, flo
 K3API float* k3m4_SetPerspectiveFov(float* d, float fovy, float aspect, float znear, float zfar, bool left_handed, bool dx_style, bool reverse_z);
 K3API float* k3m4_SetOrthoOffCenter(float* d, float left, float right, float bottom, float top, float znear, float zfar, bool left_handed, bool dx_style, bool reverse_z);
 K3API float* k3m4_SetLookAt(float* d, const float* eye, const float* at, const float* up_dir, bool left_handed);
+// Extracts the 6 frustum planes of a view projection matrix into d, 24 floats, ordered left, right, bottom, top, near, far
+// Each plane is (a, b, c, d) with a normalized (a, b, c), and points inside have a*x + b*y + c*z + d >= 0
+// dx_style and reverse_z must match the projection; a gl style reverse z projection gets a conservative far plane
+K3API float* k3m4_GetFrustumPlanes(float* d, const float* s, bool dx_style, bool reverse_z);
 K3API float* k3m4_SetRotAngleScaleXlat(float* d, const float* r3, const float* s3, const float* t3);
 K3API float* k3m4_SetScaleRotAngleXlat(float* d, const float* s3, const float* r3, const float* t3);
+// Inverse of an affine transform, through its 3x3 part; a last row other than 0 0 0 1 takes the k3m_Inverse path
 K3API float* k3m4_InverseTransform(float* d);
 
 /* operations on 2 matrices */
 K3API float* k3m_Mul(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2);
 
+/* general size versions that work in caller provided scratch memory, and never touch the heap */
+/* matrices above 4x4 use an LU decomposition; the plain versions do the same on the stack up to 64x64 */
+/* Determinant/Inverse scratch holds k3m_GetScratchSize(rows) floats; singular matrices invert to all zeros */
+/* Mul scratch holds s1_rows * s2_cols floats, and is only used when d overlaps s1 or s2, so it can be NULL otherwise */
+K3API uint32_t k3m_GetScratchSize(uint32_t rows);
+K3API float  k3m_DeterminantScratch(uint32_t rows, const float* s, float* scratch);
+K3API float* k3m_InverseScratch(uint32_t rows, float* d, float* scratch);
+K3API float* k3m_MulScratch(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2, float* scratch);
+
 /* shortcuts to normalize vector */
 K3API float* k3v_Normalize(uint32_t l, float* d);
 
+/* fixed size vector operations; N is a compile time constant, so the loops unroll */
+/* results match the k3v_ and k3sv_ functions of the same name bit for bit */
+template<uint32_t N>
+struct k3vec {
+    static float* Negate(float* d)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = -d[i];
+        return d;
+    }
+    static float* Swizzle(float* d, const uint32_t* indices)
+    {
+        float t[N];
+        for (uint32_t i = 0; i < N; i++) t[i] = d[indices[i]];
+        for (uint32_t i = 0; i < N; i++) d[i] = t[i];
+        return d;
+    }
+    static float* Add(float* d, const float* s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1[i] + s2[i];
+        return d;
+    }
+    static float* Sub(float* d, const float* s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1[i] - s2[i];
+        return d;
+    }
+    static float* Mul(float* d, const float* s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1[i] * s2[i];
+        return d;
+    }
+    static float* Div(float* d, const float* s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1[i] / s2[i];
+        return d;
+    }
+    static float* Min(float* d, const float* s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = (s1[i] < s2[i]) ? s1[i] : s2[i];
+        return d;
+    }
+    static float* Max(float* d, const float* s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = (s1[i] > s2[i]) ? s1[i] : s2[i];
+        return d;
+    }
+    static float* SvAdd(float* d, const float s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1 + s2[i];
+        return d;
+    }
+    static float* SvSub(float* d, const float s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1 - s2[i];
+        return d;
+    }
+    static float* SvMul(float* d, const float s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1 * s2[i];
+        return d;
+    }
+    static float* SvDiv(float* d, const float s1, const float* s2)
+    {
+        for (uint32_t i = 0; i < N; i++) d[i] = s1 / s2[i];
+        return d;
+    }
+    static float* VsAdd(float* d, const float* s1, const float s2) { return SvAdd(d, s2, s1); }
+    static float* VsSub(float* d, const float* s1, const float s2) { return SvAdd(d, -s2, s1); }
+    static float* VsMul(float* d, const float* s1, const float s2) { return SvMul(d, s2, s1); }
+    static float* VsDiv(float* d, const float* s1, const float s2) { return SvMul(d, 1.0f / s2, s1); }
+    static bool Equals(const float* s1, const float* s2)
+    {
+        bool result = true;
+        for (uint32_t i = 0; i < N; i++) if (s1[i] != s2[i]) result = false;
+        return result;
+    }
+    static bool NotEquals(const float* s1, const float* s2) { return !Equals(s1, s2); }
+    static float Dot(const float* s1, const float* s2)
+    {
+        // summed in order from 0, like the library version
+        float result = 0.0f;
+        for (uint32_t i = 0; i < N; i++) result += s1[i] * s2[i];
+        return result;
+    }
+    static float Length(const float* s) { return sqrtf(Dot(s, s)); }
+    static float* Normalize(float* d)
+    {
+        float f = sqrtf(Dot(d, d));
+        f = (f == 0.0f) ? 0.0f : (1.0f / f);
+        return SvMul(d, f, d);
+    }
+    // only defined for N of 2, where the result is the scalar d[0], and 3
+    static float* Cross(float* d, const float* s1, const float* s2)
+    {
+        static_assert(N == 2 || N == 3, "cross product needs 2 or 3 components");
+        if (N == 2) {
+            d[0] = s1[0] * s2[1] - s1[1] * s2[0];
+        } else {
+            float t0 = s1[1] * s2[2] - s1[2] * s2[1];
+            float t1 = s1[2] * s2[0] - s1[0] * s2[2];
+            float t2 = s1[0] * s2[1] - s1[1] * s2[0];
+            d[0] = t0;
+            d[1] = t1;
+            d[2] = t2;
+        }
+        return d;
+    }
+};
+
+/* fixed size R x C row major matrix operations */
+/* elementwise matrix operations are the k3vec<R * C> ones */
+template<uint32_t R, uint32_t C>
+struct k3mat {
+    static float* SetIdentity(float* d)
+    {
+        for (uint32_t r = 0; r < R; r++) {
+            for (uint32_t c = 0; c < C; c++) d[r * C + c] = (r == c) ? 1.0f : 0.0f;
+        }
+        return d;
+    }
+    static float* Transpose(float* d)
+    {
+        float t[R * C];
+        for (uint32_t i = 0; i < R * C; i++) t[i] = d[i];
+        for (uint32_t r = 0; r < R; r++) {
+            for (uint32_t c = 0; c < C; c++) d[c * R + r] = t[r * C + c];
+        }
+        return d;
+    }
+    // d (R x K) = s1 (R x C) * s2 (C x K); d may be s1 or s2
+    template<uint32_t K>
+    static float* Mul(float* d, const float* s1, const float* s2)
+    {
+        float t[R * K];
+        for (uint32_t r = 0; r < R; r++) {
+            for (uint32_t k = 0; k < K; k++) {
+                float sum = 0.0f;
+                for (uint32_t c = 0; c < C; c++) sum += s1[r * C + c] * s2[c * K + k];
+                t[r * K + k] = sum;
+            }
+        }
+        for (uint32_t i = 0; i < R * K; i++) d[i] = t[i];
+        return d;
+    }
+    static float Determinant(const float* s)
+    {
+        static_assert(R == C, "determinant needs a square matrix");
+        switch (R) {
+        case 2: return s[0] * s[3] - s[1] * s[2];
+        case 3: return (s[0] * (s[4] * s[8] - s[5] * s[7]) +
+                        s[1] * (s[5] * s[6] - s[3] * s[8]) +
+                        s[2] * (s[3] * s[7] - s[4] * s[6]));
+        default: return k3m_Determinant(R, s);
+        }
+    }
+};
+
 /* shortcuts for vector to scalar operations */
 inline float* k3vs_Add(uint32_t l, float* d, const float* s1, float s2) { return k3sv_Add((l), (d), (s2), (s1)); }
 inline float* k3vs_Sub(uint32_t l, float* d, const float* s1, float s2) { return k3sv_Add((l), (d), -(s2), (s1)); }
@@ -313,142 +568,142 @@ inline bool k3v_NotEquals(uint32_t l, const float* s1, const float* s2) { return
 
 /* shortcuts for vectors of length 2 through 4  operations */
 /* also shortcuts for 2x2, 3x3, and 4x4 matrices */
-inline float* k3v2_Negate(float* d) { return k3v_Negate(  2, (d) ); }
-inline float* k3v3_Negate(float* d) { return k3v_Negate(  3, (d) ); }
-inline float* k3v4_Negate(float* d) { return k3v_Negate(  4, (d) ); }
-inline float* k3m2_Negate(float* d) { return k3v_Negate(  4, (d) ); }
-inline float* k3m3_Negate(float* d) { return k3v_Negate(  9, (d) ); }
-inline float* k3m4_Negate(float* d) { return k3v_Negate( 16, (d) ); }
-
-inline float* k3v2_Normalize(float* d) { return k3v_Normalize( 2, (d) ); }
-inline float* k3v3_Normalize(float* d) { return k3v_Normalize( 3, (d) ); }
-inline float* k3v4_Normalize(float* d) { return k3v_Normalize( 4, (d) ); }
-
-inline float* k3v2_Swizzle(float* d, const uint32_t* i) { return k3v_Swizzle( 2, (d), (i) ); }
-inline float* k3v3_Swizzle(float* d, const uint32_t* i) { return k3v_Swizzle( 3, (d), (i) ); }
-inline float* k3v4_Swizzle(float* d, const uint32_t* i) { return k3v_Swizzle( 4, (d), (i) ); }
+inline float* k3v2_Negate(float* d) { return k3vec<2>::Negate( (d) ); }
+inline float* k3v3_Negate(float* d) { return k3vec<3>::Negate( (d) ); }
+inline float* k3v4_Negate(float* d) { return k3vec<4>::Negate( (d) ); }
+inline float* k3m2_Negate(float* d) { return k3vec<4>::Negate( (d) ); }
+inline float* k3m3_Negate(float* d) { return k3vec<9>::Negate( (d) ); }
+inline float* k3m4_Negate(float* d) { return k3vec<16>::Negate( (d) ); }
+
+inline float* k3v2_Normalize(float* d) { return k3vec<2>::Normalize( (d) ); }
+inline float* k3v3_Normalize(float* d) { return k3vec<3>::Normalize( (d) ); }
+inline float* k3v4_Normalize(float* d) { return k3vec<4>::Normalize( (d) ); }
+
+inline float* k3v2_Swizzle(float* d, const uint32_t* i) { return k3vec<2>::Swizzle( (d), (i) ); }
+inline float* k3v3_Swizzle(float* d, const uint32_t* i) { return k3vec<3>::Swizzle( (d), (i) ); }
+inline float* k3v4_Swizzle(float* d, const uint32_t* i) { return k3vec<4>::Swizzle( (d), (i) ); }
 inline float* k3m2_Swizzle(float* d, const uint32_t* r, const uint32_t* c) { return k3m_Swizzle( 2, 2, (d), (r), (c) ); }
 inline float* k3m3_Swizzle(float* d, const uint32_t* r, const uint32_t* c) { return k3m_Swizzle( 3, 3, (d), (r), (c) ); }
 inline float* k3m4_Swizzle(float* d, const uint32_t* r, const uint32_t* c) { return k3m_Swizzle( 4, 4, (d), (r), (c) ); }
 
-inline float k3v2_Length(const float* s) { return k3v_Length( 2, (s) ); }
-inline float k3v3_Length(const float* s) { return k3v_Length( 3, (s) ); }
-inline float k3v4_Length(const float* s) { return k3v_Length( 4, (s) ); }
-
-inline float* k3v2_Add(float* d, const float* s1, const float* s2) { return k3v_Add(  2, (d), (s1), (s2) ); }
-inline float* k3v3_Add(float* d, const float* s1, const float* s2) { return k3v_Add(  3, (d), (s1), (s2) ); }
-inline float* k3v4_Add(float* d, const float* s1, const float* s2) { return k3v_Add(  4, (d), (s1), (s2) ); }
-inline float* k3m2_Add(float* d, const float* s1, const float* s2) { return k3v_Add(  4, (d), (s1), (s2) ); }
-inline float* k3m3_Add(float* d, const float* s1, const float* s2) { return k3v_Add(  9, (d), (s1), (s2) ); }
-inline float* k3m4_Add(float* d, const float* s1, const float* s2) { return k3v_Add( 16, (d), (s1), (s2) ); }
-inline float* k3v2_Sub(float* d, const float* s1, const float* s2) { return k3v_Sub(  2, (d), (s1), (s2) ); }
-inline float* k3v3_Sub(float* d, const float* s1, const float* s2) { return k3v_Sub(  3, (d), (s1), (s2) ); }
-inline float* k3v4_Sub(float* d, const float* s1, const float* s2) { return k3v_Sub(  4, (d), (s1), (s2) ); }
-inline float* k3m2_Sub(float* d, const float* s1, const float* s2) { return k3v_Sub(  4, (d), (s1), (s2) ); }
-inline float* k3m3_Sub(float* d, const float* s1, const float* s2) { return k3v_Sub(  9, (d), (s1), (s2) ); }
-inline float* k3m4_Sub(float* d, const float* s1, const float* s2) { return k3v_Sub( 16, (d), (s1), (s2) ); }
-inline float* k3v2_Mul(float* d, const float* s1, const float* s2) { return k3v_Mul(  2, (d), (s1), (s2) ); }
-inline float* k3v3_Mul(float* d, const float* s1, const float* s2) { return k3v_Mul(  3, (d), (s1), (s2) ); }
-inline float* k3v4_Mul(float* d, const float* s1, const float* s2) { return k3v_Mul(  4, (d), (s1), (s2) ); }
-inline float* k3m2_ComponentMul(float* d, const float* s1, const float* s2) { return k3v_Mul(  4, (d), (s1), (s2) ); }
-inline float* k3m3_ComponentMul(float* d, const float* s1, const float* s2) { return k3v_Mul(  9, (d), (s1), (s2) ); }
-inline float* k3m4_ComponentMul(float* d, const float* s1, const float* s2) { return k3v_Mul( 16, (d), (s1), (s2) ); }
-inline float* k3v2_Div(float* d, const float* s1, const float* s2) { return k3v_Div(  2, (d), (s1), (s2) ); }
-inline float* k3v3_Div(float* d, const float* s1, const float* s2) { return k3v_Div(  3, (d), (s1), (s2) ); }
-inline float* k3v4_Div(float* d, const float* s1, const float* s2) { return k3v_Div(  4, (d), (s1), (s2) ); }
-inline float* k3m2_Div(float* d, const float* s1, const float* s2) { return k3v_Div(  4, (d), (s1), (s2) ); }
-inline float* k3m3_Div(float* d, const float* s1, const float* s2) { return k3v_Div(  9, (d), (s1), (s2) ); }
-inline float* k3m4_Div(float* d, const float* s1, const float* s2) { return k3v_Div( 16, (d), (s1), (s2) ); }
-
-inline float* k3sv2_Add(float* d, const float s1, const float* s2) { return k3sv_Add(  2, (d), (s1), (s2) ); }
-inline float* k3sv3_Add(float* d, const float s1, const float* s2) { return k3sv_Add(  3, (d), (s1), (s2) ); }
-inline float* k3sv4_Add(float* d, const float s1, const float* s2) { return k3sv_Add(  4, (d), (s1), (s2) ); }
-inline float* k3sm2_Add(float* d, const float s1, const float* s2) { return k3sv_Add(  4, (d), (s1), (s2) ); }
-inline float* k3sm3_Add(float* d, const float s1, const float* s2) { return k3sv_Add(  9, (d), (s1), (s2) ); }
-inline float* k3sm4_Add(float* d, const float s1, const float* s2) { return k3sv_Add( 16, (d), (s1), (s2) ); }
-inline float* k3sv2_Sub(float* d, const float s1, const float* s2) { return k3sv_Sub(  2, (d), (s1), (s2) ); }
-inline float* k3sv3_Sub(float* d, const float s1, const float* s2) { return k3sv_Sub(  3, (d), (s1), (s2) ); }
-inline float* k3sv4_Sub(float* d, const float s1, const float* s2) { return k3sv_Sub(  4, (d), (s1), (s2) ); }
-inline float* k3sm2_Sub(float* d, const float s1, const float* s2) { return k3sv_Sub(  4, (d), (s1), (s2) ); }
-inline float* k3sm3_Sub(float* d, const float s1, const float* s2) { return k3sv_Sub(  9, (d), (s1), (s2) ); }
-inline float* k3sm4_Sub(float* d, const float s1, const float* s2) { return k3sv_Sub( 16, (d), (s1), (s2) ); }
-inline float* k3sv2_Mul(float* d, const float s1, const float* s2) { return k3sv_Mul(  2, (d), (s1), (s2) ); }
-inline float* k3sv3_Mul(float* d, const float s1, const float* s2) { return k3sv_Mul(  3, (d), (s1), (s2) ); }
-inline float* k3sv4_Mul(float* d, const float s1, const float* s2) { return k3sv_Mul(  4, (d), (s1), (s2) ); }
-inline float* k3sm2_Mul(float* d, const float s1, const float* s2) { return k3sv_Mul(  4, (d), (s1), (s2) ); }
-inline float* k3sm3_Mul(float* d, const float s1, const float* s2) { return k3sv_Mul(  9, (d), (s1), (s2) ); }
-inline float* k3sm4_Mul(float* d, const float s1, const float* s2) { return k3sv_Mul( 16, (d), (s1), (s2) ); }
-inline float* k3sv2_Div(float* d, const float s1, const float* s2) { return k3sv_Div(  2, (d), (s1), (s2) ); }
-inline float* k3sv3_Div(float* d, const float s1, const float* s2) { return k3sv_Div(  3, (d), (s1), (s2) ); }
-inline float* k3sv4_Div(float* d, const float s1, const float* s2) { return k3sv_Div(  4, (d), (s1), (s2) ); }
-inline float* k3sm2_Div(float* d, const float s1, const float* s2) { return k3sv_Div(  4, (d), (s1), (s2) ); }
-inline float* k3sm3_Div(float* d, const float s1, const float* s2) { return k3sv_Div(  9, (d), (s1), (s2) ); }
-inline float* k3sm4_Div(float* d, const float s1, const float* s2) { return k3sv_Div( 16, (d), (s1), (s2) ); }
-
-inline float* k3v2s_Add(float* d, const float* s1, const float s2) { return k3vs_Add(  2, (d), (s1), (s2) ); }
-inline float* k3v3s_Add(float* d, const float* s1, const float s2) { return k3vs_Add(  3, (d), (s1), (s2) ); }
-inline float* k3v4s_Add(float* d, const float* s1, const float s2) { return k3vs_Add(  4, (d), (s1), (s2) ); }
-inline float* k3m2s_Add(float* d, const float* s1, const float s2) { return k3vs_Add(  4, (d), (s1), (s2) ); }
-inline float* k3m3s_Add(float* d, const float* s1, const float s2) { return k3vs_Add(  9, (d), (s1), (s2) ); }
-inline float* k3m4s_Add(float* d, const float* s1, const float s2) { return k3vs_Add( 16, (d), (s1), (s2) ); }
-inline float* k3v2s_Sub(float* d, const float* s1, const float s2) { return k3vs_Sub(  2, (d), (s1), (s2) ); }
-inline float* k3v3s_Sub(float* d, const float* s1, const float s2) { return k3vs_Sub(  3, (d), (s1), (s2) ); }
-inline float* k3v4s_Sub(float* d, const float* s1, const float s2) { return k3vs_Sub(  4, (d), (s1), (s2) ); }
-inline float* k3m2s_Sub(float* d, const float* s1, const float s2) { return k3vs_Sub(  4, (d), (s1), (s2) ); }
-inline float* k3m3s_Sub(float* d, const float* s1, const float s2) { return k3vs_Sub(  9, (d), (s1), (s2) ); }
-inline float* k3m4s_Sub(float* d, const float* s1, const float s2) { return k3vs_Sub( 16, (d), (s1), (s2) ); }
-inline float* k3v2s_Mul(float* d, const float* s1, const float s2) { return k3vs_Mul(  2, (d), (s1), (s2) ); }
-inline float* k3v3s_Mul(float* d, const float* s1, const float s2) { return k3vs_Mul(  3, (d), (s1), (s2) ); }
-inline float* k3v4s_Mul(float* d, const float* s1, const float s2) { return k3vs_Mul(  4, (d), (s1), (s2) ); }
-inline float* k3m2s_Mul(float* d, const float* s1, const float s2) { return k3vs_Mul(  4, (d), (s1), (s2) ); }
-inline float* k3m3s_Mul(float* d, const float* s1, const float s2) { return k3vs_Mul(  9, (d), (s1), (s2) ); }
-inline float* k3m4s_Mul(float* d, const float* s1, const float s2) { return k3vs_Mul( 16, (d), (s1), (s2) ); }
-inline float* k3v2s_Div(float* d, const float* s1, const float s2) { return k3vs_Div(  2, (d), (s1), (s2) ); }
-inline float* k3v3s_Div(float* d, const float* s1, const float s2) { return k3vs_Div(  3, (d), (s1), (s2) ); }
-inline float* k3v4s_Div(float* d, const float* s1, const float s2) { return k3vs_Div(  4, (d), (s1), (s2) ); }
-inline float* k3m2s_Div(float* d, const float* s1, const float s2) { return k3vs_Div(  4, (d), (s1), (s2) ); }
-inline float* k3m3s_Div(float* d, const float* s1, const float s2) { return k3vs_Div(  9, (d), (s1), (s2) ); }
-inline float* k3m4s_Div(float* d, const float* s1, const float s2) { return k3vs_Div( 16, (d), (s1), (s2) ); }
-
-inline float* k3v2_Cross(float* d, const float* s1, const float* s2) { return k3v_Cross( 2, (d), (s1), (s2) ); }
-inline float* k3v3_Cross(float* d, const float* s1, const float* s2) { return k3v_Cross( 3, (d), (s1), (s2) ); }
-
-inline bool k3v2_Equals(const float* s1, const float* s2) { return k3v_Equals(  2, (s1), (s2) ); }
-inline bool k3v3_Equals(const float* s1, const float* s2) { return k3v_Equals(  3, (s1), (s2) ); }
-inline bool k3v4_Equals(const float* s1, const float* s2) { return k3v_Equals(  4, (s1), (s2) ); }
-inline bool k3m2_Equals(const float* s1, const float* s2) { return k3v_Equals(  4, (s1), (s2) ); }
-inline bool k3m3_Equals(const float* s1, const float* s2) { return k3v_Equals(  9, (s1), (s2) ); }
-inline bool k3m4_Equals(const float* s1, const float* s2) { return k3v_Equals( 16, (s1), (s2) ); }
-inline bool k3v2_NotEquals(const float* s1, const float* s2) { return k3v_NotEquals(  2, (s1), (s2) ); }
-inline bool k3v3_NotEquals(const float* s1, const float* s2) { return k3v_NotEquals(  3, (s1), (s2) ); }
-inline bool k3v4_NotEquals(const float* s1, const float* s2) { return k3v_NotEquals(  4, (s1), (s2) ); }
-inline bool k3m2_NotEquals(const float* s1, const float* s2) { return k3v_NotEquals(  4, (s1), (s2) ); }
-inline bool k3m3_NotEquals(const float* s1, const float* s2) { return k3v_NotEquals(  9, (s1), (s2) ); }
-inline bool k3m4_NotEquals(const float* s1, const float* s2) { return k3v_NotEquals( 16, (s1), (s2) ); }
-
-inline float k3v2_Dot(const float* s1, const float* s2) { return k3v_Dot( 2, (s1), (s2) ); }
-inline float k3v3_Dot(const float* s1, const float* s2) { return k3v_Dot( 3, (s1), (s2) ); }
-inline float k3v4_Dot(const float* s1, const float* s2) { return k3v_Dot( 4, (s1), (s2) ); }
-
-inline float* k3v2_Min(float* d, const float* s1, const float* s2) { return k3v_Min( 2, (d), (s1), (s2) ); }
-inline float* k3v3_Min(float* d, const float* s1, const float* s2) { return k3v_Min( 3, (d), (s1), (s2) ); }
-inline float* k3v4_Min(float* d, const float* s1, const float* s2) { return k3v_Min( 4, (d), (s1), (s2) ); }
-inline float* k3v2_Max(float* d, const float* s1, const float* s2) { return k3v_Max( 2, (d), (s1), (s2) ); }
-inline float* k3v3_Max(float* d, const float* s1, const float* s2) { return k3v_Max( 3, (d), (s1), (s2) ); }
-inline float* k3v4_Max(float* d, const float* s1, const float* s2) { return k3v_Max( 4, (d), (s1), (s2) ); }
-
-inline float k3m2_Determinant(const float* s1) { return k3m_Determinant( 2, (s1) ); }
-inline float k3m3_Determinant(const float* s1) { return k3m_Determinant( 3, (s1) ); }
-inline float k3m4_Determinant(const float* s1) { return k3m_Determinant( 4, (s1) ); }
-inline float* k3m2_Transpose(float* d) { return k3m_Transpose( 2, 2, (d) ); }
-inline float* k3m3_Transpose(float* d) { return k3m_Transpose( 3, 3, (d) ); }
+inline float k3v2_Length(const float* s) { return k3vec<2>::Length( (s) ); }
+inline float k3v3_Length(const float* s) { return k3vec<3>::Length( (s) ); }
+inline float k3v4_Length(const float* s) { return k3vec<4>::Length( (s) ); }
+
+inline float* k3v2_Add(float* d, const float* s1, const float* s2) { return k3vec<2>::Add( (d), (s1), (s2) ); }
+inline float* k3v3_Add(float* d, const float* s1, const float* s2) { return k3vec<3>::Add( (d), (s1), (s2) ); }
+inline float* k3v4_Add(float* d, const float* s1, const float* s2) { return k3vec<4>::Add( (d), (s1), (s2) ); }
+inline float* k3m2_Add(float* d, const float* s1, const float* s2) { return k3vec<4>::Add( (d), (s1), (s2) ); }
+inline float* k3m3_Add(float* d, const float* s1, const float* s2) { return k3vec<9>::Add( (d), (s1), (s2) ); }
+inline float* k3m4_Add(float* d, const float* s1, const float* s2) { return k3vec<16>::Add( (d), (s1), (s2) ); }
+inline float* k3v2_Sub(float* d, const float* s1, const float* s2) { return k3vec<2>::Sub( (d), (s1), (s2) ); }
+inline float* k3v3_Sub(float* d, const float* s1, const float* s2) { return k3vec<3>::Sub( (d), (s1), (s2) ); }
+inline float* k3v4_Sub(float* d, const float* s1, const float* s2) { return k3vec<4>::Sub( (d), (s1), (s2) ); }
+inline float* k3m2_Sub(float* d, const float* s1, const float* s2) { return k3vec<4>::Sub( (d), (s1), (s2) ); }
+inline float* k3m3_Sub(float* d, const float* s1, const float* s2) { return k3vec<9>::Sub( (d), (s1), (s2) ); }
+inline float* k3m4_Sub(float* d, const float* s1, const float* s2) { return k3vec<16>::Sub( (d), (s1), (s2) ); }
+inline float* k3v2_Mul(float* d, const float* s1, const float* s2) { return k3vec<2>::Mul( (d), (s1), (s2) ); }
+inline float* k3v3_Mul(float* d, const float* s1, const float* s2) { return k3vec<3>::Mul( (d), (s1), (s2) ); }
+inline float* k3v4_Mul(float* d, const float* s1, const float* s2) { return k3vec<4>::Mul( (d), (s1), (s2) ); }
+inline float* k3m2_ComponentMul(float* d, const float* s1, const float* s2) { return k3vec<4>::Mul( (d), (s1), (s2) ); }
+inline float* k3m3_ComponentMul(float* d, const float* s1, const float* s2) { return k3vec<9>::Mul( (d), (s1), (s2) ); }
+inline float* k3m4_ComponentMul(float* d, const float* s1, const float* s2) { return k3vec<16>::Mul( (d), (s1), (s2) ); }
+inline float* k3v2_Div(float* d, const float* s1, const float* s2) { return k3vec<2>::Div( (d), (s1), (s2) ); }
+inline float* k3v3_Div(float* d, const float* s1, const float* s2) { return k3vec<3>::Div( (d), (s1), (s2) ); }
+inline float* k3v4_Div(float* d, const float* s1, const float* s2) { return k3vec<4>::Div( (d), (s1), (s2) ); }
+inline float* k3m2_Div(float* d, const float* s1, const float* s2) { return k3vec<4>::Div( (d), (s1), (s2) ); }
+inline float* k3m3_Div(float* d, const float* s1, const float* s2) { return k3vec<9>::Div( (d), (s1), (s2) ); }
+inline float* k3m4_Div(float* d, const float* s1, const float* s2) { return k3vec<16>::Div( (d), (s1), (s2) ); }
+
+inline float* k3sv2_Add(float* d, const float s1, const float* s2) { return k3vec<2>::SvAdd( (d), (s1), (s2) ); }
+inline float* k3sv3_Add(float* d, const float s1, const float* s2) { return k3vec<3>::SvAdd( (d), (s1), (s2) ); }
+inline float* k3sv4_Add(float* d, const float s1, const float* s2) { return k3vec<4>::SvAdd( (d), (s1), (s2) ); }
+inline float* k3sm2_Add(float* d, const float s1, const float* s2) { return k3vec<4>::SvAdd( (d), (s1), (s2) ); }
+inline float* k3sm3_Add(float* d, const float s1, const float* s2) { return k3vec<9>::SvAdd( (d), (s1), (s2) ); }
+inline float* k3sm4_Add(float* d, const float s1, const float* s2) { return k3vec<16>::SvAdd( (d), (s1), (s2) ); }
+inline float* k3sv2_Sub(float* d, const float s1, const float* s2) { return k3vec<2>::SvSub( (d), (s1), (s2) ); }
+inline float* k3sv3_Sub(float* d, const float s1, const float* s2) { return k3vec<3>::SvSub( (d), (s1), (s2) ); }
+inline float* k3sv4_Sub(float* d, const float s1, const float* s2) { return k3vec<4>::SvSub( (d), (s1), (s2) ); }
+inline float* k3sm2_Sub(float* d, const float s1, const float* s2) { return k3vec<4>::SvSub( (d), (s1), (s2) ); }
+inline float* k3sm3_Sub(float* d, const float s1, const float* s2) { return k3vec<9>::SvSub( (d), (s1), (s2) ); }
+inline float* k3sm4_Sub(float* d, const float s1, const float* s2) { return k3vec<16>::SvSub( (d), (s1), (s2) ); }
+inline float* k3sv2_Mul(float* d, const float s1, const float* s2) { return k3vec<2>::SvMul( (d), (s1), (s2) ); }
+inline float* k3sv3_Mul(float* d, const float s1, const float* s2) { return k3vec<3>::SvMul( (d), (s1), (s2) ); }
+inline float* k3sv4_Mul(float* d, const float s1, const float* s2) { return k3vec<4>::SvMul( (d), (s1), (s2) ); }
+inline float* k3sm2_Mul(float* d, const float s1, const float* s2) { return k3vec<4>::SvMul( (d), (s1), (s2) ); }
+inline float* k3sm3_Mul(float* d, const float s1, const float* s2) { return k3vec<9>::SvMul( (d), (s1), (s2) ); }
+inline float* k3sm4_Mul(float* d, const float s1, const float* s2) { return k3vec<16>::SvMul( (d), (s1), (s2) ); }
+inline float* k3sv2_Div(float* d, const float s1, const float* s2) { return k3vec<2>::SvDiv( (d), (s1), (s2) ); }
+inline float* k3sv3_Div(float* d, const float s1, const float* s2) { return k3vec<3>::SvDiv( (d), (s1), (s2) ); }
+inline float* k3sv4_Div(float* d, const float s1, const float* s2) { return k3vec<4>::SvDiv( (d), (s1), (s2) ); }
+inline float* k3sm2_Div(float* d, const float s1, const float* s2) { return k3vec<4>::SvDiv( (d), (s1), (s2) ); }
+inline float* k3sm3_Div(float* d, const float s1, const float* s2) { return k3vec<9>::SvDiv( (d), (s1), (s2) ); }
+inline float* k3sm4_Div(float* d, const float s1, const float* s2) { return k3vec<16>::SvDiv( (d), (s1), (s2) ); }
+
+inline float* k3v2s_Add(float* d, const float* s1, const float s2) { return k3vec<2>::VsAdd( (d), (s1), (s2) ); }
+inline float* k3v3s_Add(float* d, const float* s1, const float s2) { return k3vec<3>::VsAdd( (d), (s1), (s2) ); }
+inline float* k3v4s_Add(float* d, const float* s1, const float s2) { return k3vec<4>::VsAdd( (d), (s1), (s2) ); }
+inline float* k3m2s_Add(float* d, const float* s1, const float s2) { return k3vec<4>::VsAdd( (d), (s1), (s2) ); }
+inline float* k3m3s_Add(float* d, const float* s1, const float s2) { return k3vec<9>::VsAdd( (d), (s1), (s2) ); }
+inline float* k3m4s_Add(float* d, const float* s1, const float s2) { return k3vec<16>::VsAdd( (d), (s1), (s2) ); }
+inline float* k3v2s_Sub(float* d, const float* s1, const float s2) { return k3vec<2>::VsSub( (d), (s1), (s2) ); }
+inline float* k3v3s_Sub(float* d, const float* s1, const float s2) { return k3vec<3>::VsSub( (d), (s1), (s2) ); }
+inline float* k3v4s_Sub(float* d, const float* s1, const float s2) { return k3vec<4>::VsSub( (d), (s1), (s2) ); }
+inline float* k3m2s_Sub(float* d, const float* s1, const float s2) { return k3vec<4>::VsSub( (d), (s1), (s2) ); }
+inline float* k3m3s_Sub(float* d, const float* s1, const float s2) { return k3vec<9>::VsSub( (d), (s1), (s2) ); }
+inline float* k3m4s_Sub(float* d, const float* s1, const float s2) { return k3vec<16>::VsSub( (d), (s1), (s2) ); }
+inline float* k3v2s_Mul(float* d, const float* s1, const float s2) { return k3vec<2>::VsMul( (d), (s1), (s2) ); }
+inline float* k3v3s_Mul(float* d, const float* s1, const float s2) { return k3vec<3>::VsMul( (d), (s1), (s2) ); }
+inline float* k3v4s_Mul(float* d, const float* s1, const float s2) { return k3vec<4>::VsMul( (d), (s1), (s2) ); }
+inline float* k3m2s_Mul(float* d, const float* s1, const float s2) { return k3vec<4>::VsMul( (d), (s1), (s2) ); }
+inline float* k3m3s_Mul(float* d, const float* s1, const float s2) { return k3vec<9>::VsMul( (d), (s1), (s2) ); }
+inline float* k3m4s_Mul(float* d, const float* s1, const float s2) { return k3vec<16>::VsMul( (d), (s1), (s2) ); }
+inline float* k3v2s_Div(float* d, const float* s1, const float s2) { return k3vec<2>::VsDiv( (d), (s1), (s2) ); }
+inline float* k3v3s_Div(float* d, const float* s1, const float s2) { return k3vec<3>::VsDiv( (d), (s1), (s2) ); }
+inline float* k3v4s_Div(float* d, const float* s1, const float s2) { return k3vec<4>::VsDiv( (d), (s1), (s2) ); }
+inline float* k3m2s_Div(float* d, const float* s1, const float s2) { return k3vec<4>::VsDiv( (d), (s1), (s2) ); }
+inline float* k3m3s_Div(float* d, const float* s1, const float s2) { return k3vec<9>::VsDiv( (d), (s1), (s2) ); }
+inline float* k3m4s_Div(float* d, const float* s1, const float s2) { return k3vec<16>::VsDiv( (d), (s1), (s2) ); }
+
+inline float* k3v2_Cross(float* d, const float* s1, const float* s2) { return k3vec<2>::Cross( (d), (s1), (s2) ); }
+inline float* k3v3_Cross(float* d, const float* s1, const float* s2) { return k3vec<3>::Cross( (d), (s1), (s2) ); }
+
+inline bool k3v2_Equals(const float* s1, const float* s2) { return k3vec<2>::Equals( (s1), (s2) ); }
+inline bool k3v3_Equals(const float* s1, const float* s2) { return k3vec<3>::Equals( (s1), (s2) ); }
+inline bool k3v4_Equals(const float* s1, const float* s2) { return k3vec<4>::Equals( (s1), (s2) ); }
+inline bool k3m2_Equals(const float* s1, const float* s2) { return k3vec<4>::Equals( (s1), (s2) ); }
+inline bool k3m3_Equals(const float* s1, const float* s2) { return k3vec<9>::Equals( (s1), (s2) ); }
+inline bool k3m4_Equals(const float* s1, const float* s2) { return k3vec<16>::Equals( (s1), (s2) ); }
+inline bool k3v2_NotEquals(const float* s1, const float* s2) { return k3vec<2>::NotEquals( (s1), (s2) ); }
+inline bool k3v3_NotEquals(const float* s1, const float* s2) { return k3vec<3>::NotEquals( (s1), (s2) ); }
+inline bool k3v4_NotEquals(const float* s1, const float* s2) { return k3vec<4>::NotEquals( (s1), (s2) ); }
+inline bool k3m2_NotEquals(const float* s1, const float* s2) { return k3vec<4>::NotEquals( (s1), (s2) ); }
+inline bool k3m3_NotEquals(const float* s1, const float* s2) { return k3vec<9>::NotEquals( (s1), (s2) ); }
+inline bool k3m4_NotEquals(const float* s1, const float* s2) { return k3vec<16>::NotEquals( (s1), (s2) ); }
+
+inline float k3v2_Dot(const float* s1, const float* s2) { return k3vec<2>::Dot( (s1), (s2) ); }
+inline float k3v3_Dot(const float* s1, const float* s2) { return k3vec<3>::Dot( (s1), (s2) ); }
+inline float k3v4_Dot(const float* s1, const float* s2) { return k3vec<4>::Dot( (s1), (s2) ); }
+
+inline float* k3v2_Min(float* d, const float* s1, const float* s2) { return k3vec<2>::Min( (d), (s1), (s2) ); }
+inline float* k3v3_Min(float* d, const float* s1, const float* s2) { return k3vec<3>::Min( (d), (s1), (s2) ); }
+inline float* k3v4_Min(float* d, const float* s1, const float* s2) { return k3vec<4>::Min( (d), (s1), (s2) ); }
+inline float* k3v2_Max(float* d, const float* s1, const float* s2) { return k3vec<2>::Max( (d), (s1), (s2) ); }
+inline float* k3v3_Max(float* d, const float* s1, const float* s2) { return k3vec<3>::Max( (d), (s1), (s2) ); }
+inline float* k3v4_Max(float* d, const float* s1, const float* s2) { return k3vec<4>::Max( (d), (s1), (s2) ); }
+
+inline float k3m2_Determinant(const float* s1) { return k3mat<2, 2>::Determinant( (s1) ); }
+inline float k3m3_Determinant(const float* s1) { return k3mat<3, 3>::Determinant( (s1) ); }
+inline float k3m4_Determinant(const float* s1) { return k3mat<4, 4>::Determinant( (s1) ); }
+inline float* k3m2_Transpose(float* d) { return k3mat<2, 2>::Transpose( (d) ); }
+inline float* k3m3_Transpose(float* d) { return k3mat<3, 3>::Transpose( (d) ); }
 inline float* k3m4_Transpose(float* d) { return k3m_Transpose( 4, 4, (d) ); }
 inline float* k3m2_Inverse(float* d) { return k3m_Inverse( 2, (d) ); }
 inline float* k3m3_Inverse(float* d) { return k3m_Inverse( 3, (d) ); }
 inline float* k3m4_Inverse(float* d) { return k3m_Inverse( 4, (d) ); }
-inline float* k3m2_SetIdentity(float* d) { return k3m_SetIdentity( 2, (d) ); }
-inline float* k3m3_SetIdentity(float* d) { return k3m_SetIdentity( 3, (d) ); }
-inline float* k3m4_SetIdentity(float* d) { return k3m_SetIdentity( 4, (d) ); }
+inline float* k3m2_SetIdentity(float* d) { return k3mat<2, 2>::SetIdentity( (d) ); }
+inline float* k3m3_SetIdentity(float* d) { return k3mat<3, 3>::SetIdentity( (d) ); }
+inline float* k3m4_SetIdentity(float* d) { return k3mat<4, 4>::SetIdentity( (d) ); }
 inline float* k3m2_SetRotation(float* d, float a)                 { return k3m_SetRotation( 2, (d), (a), NULL ); }
 inline float* k3m3_SetRotation(float* d, float a, const float* x) { return k3m_SetRotation( 3, (d), (a), (x)  ); }
 inline float* k3m4_SetRotation(float* d, float a, const float* x) { return k3m_SetRotation( 4, (d), (a), (x)  ); }
@@ -522,19 +777,29 @@ inline float* k3m4_SetGLOrthoRevZRH(float* d, float w, float h, float n, float f
 inline float* k3m4_SetLookAtLH(float* d, const float* e, const float* a, const float* u) { return k3m4_SetLookAt( (d), (e), (a), (u), true  ); }
 inline float* k3m4_SetLookAtRH(float* d, const float* e, const float* a, const float* u) { return k3m4_SetLookAt( (d), (e), (a), (u), false ); }
 
-inline float* k3m2_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 2, 2, 2, (d), (s1), (s2) ); }
-inline float* k3m3_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 3, 3, 3, (d), (s1), (s2) ); }
+inline float* k3m2_Mul(float* d, const float* s1, const float* s2) { return k3mat<2, 2>::Mul<2>( (d), (s1), (s2) ); }
+inline float* k3m3_Mul(float* d, const float* s1, const float* s2) { return k3mat<3, 3>::Mul<3>( (d), (s1), (s2) ); }
 //inline float* k3m4_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 4, 4, 4, (d), (s1), (s2) ); }
 K3API float* k3m4_Mul(float* d, const float* s1, const float* s2);
 
-inline float* k3vm2_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 1, 2, 2, (d), (s1), (s2) ); }
-inline float* k3vm3_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 1, 3, 3, (d), (s1), (s2) ); }
+inline float* k3vm2_Mul(float* d, const float* s1, const float* s2) { return k3mat<1, 2>::Mul<2>( (d), (s1), (s2) ); }
+inline float* k3vm3_Mul(float* d, const float* s1, const float* s2) { return k3mat<1, 3>::Mul<3>( (d), (s1), (s2) ); }
 inline float* k3vm4_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 1, 4, 4, (d), (s1), (s2) ); }
 
-inline float* k3mv2_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 2, 2, 1, (d), (s1), (s2) ); }
-inline float* k3mv3_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 3, 3, 1, (d), (s1), (s2) ); }
+inline float* k3mv2_Mul(float* d, const float* s1, const float* s2) { return k3mat<2, 2>::Mul<1>( (d), (s1), (s2) ); }
+inline float* k3mv3_Mul(float* d, const float* s1, const float* s2) { return k3mat<3, 3>::Mul<1>( (d), (s1), (s2) ); }
 inline float* k3mv4_Mul(float* d, const float* s1, const float* s2) { return k3m_Mul( 4, 4, 1, (d), (s1), (s2) ); }
 
+/* batched 4x4 multiplies of count elements; d[i] = s1[i] * s2[i] */
+/* strides are in floats between consecutive elements; a source stride of 0 reuses the same element for every i */
+/* k3m4_MulArray: s1, s2 and d are 4x4 matrices */
+/* k3mv4_MulArray: s1 is a 4x4 matrix, s2 and d are 4 component vectors */
+/* k3mp3_MulArray: s1 is a 4x4 matrix, s2 and d are 3 component points with an implied w of 1; the w row of s1 is ignored */
+/* d may be the same array as s1 or s2 when their strides match; each element matches the single element k3m4_Mul/k3mv4_Mul result exactly */
+K3API float* k3m4_MulArray(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+K3API float* k3mv4_MulArray(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+K3API float* k3mp3_MulArray(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+
 /* Quaternion converstion functions */
 K3API float* k3m_QuatToMat(uint32_t cols, float* d, const float* s);
 K3API float* k3m_MatToQuat(uint32_t cols, float* d, const float* s);
@@ -545,6 +810,17 @@ K3API float* k3v3_GetQuatEuler(float* d, const float* quat);
 K3API float* k3v4_QuatConjugate(float* d);
 K3API float* k3v4_QuatMul(float* d, const float* s1, const float* s2);
 
+/* batched quaternion operations on count elements; strides are in floats between consecutive elements */
+/* Nlerp/Slerp blend s1[i] toward s2[i] by t along the shortest path; nlerp normalizes the linear blend */
+/* QuatToMatBatch writes a 3x3 or 4x4 (cols) rotation matrix per quaternion, like k3m_QuatToMat */
+/* QuatToDualQuatBatch combines a unit quaternion and a 3 component translation into an 8 float dual quaternion, real part first */
+/* DualQuatToMatBatch converts unit dual quaternions back to 4x4 transforms */
+K3API float* k3v4_QuatNlerpBatch(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t);
+K3API float* k3v4_QuatSlerpBatch(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t);
+K3API float* k3m_QuatToMatBatch(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride);
+K3API float* k3v4_QuatToDualQuatBatch(uint32_t count, float* d, uint32_t d_stride, const float* quat, uint32_t quat_stride, const float* xlat, uint32_t xlat_stride);
+K3API float* k3m4_DualQuatToMatBatch(uint32_t count, float* d, uint32_t d_stride, const float* s, uint32_t s_stride);
+
 inline float* k3m3_QuatToMat(float* d, const float* s) { return k3m_QuatToMat(3, d, s); }
 inline float* k3m4_QuatToMat(float* d, const float* s) { return k3m_QuatToMat(4, d, s); }
 inline float* k3m3_MatToQuat(float* d, const float* s) { return k3m_MatToQuat(3, d, s); }
@@ -623,19 +899,108 @@ enum class k3component {
 
 enum class k3texAddr { WRAP, MIRROR, CLAMP, MIRROR_ONCE };
 
-typedef void (K3CALLBACK* k3image_file_handler_loadheaderinfo_ptr)(FILE* file_handle, uint32_t* width, uint32_t* height,
-    uint32_t* depth, k3fmt* format);
+enum class k3mipFilter { BOX, TRIANGLE, KAISER, LANCZOS };
+
+// How hard the block compressors search for a better encoding
+enum class k3compressQuality { FAST, NORMAL, BEST };
+
+// Encoded bytes a file handler loads from: a FILE*, a block of memory, or a file mapped into memory
+// Positions are relative to the start of the source
+class k3imageSource
+{
+public:
+    K3API k3imageSource(FILE* file_handle);
+    K3API k3imageSource(const void* data, uint32_t size);
+    // Maps the whole file, falling back to reading it through a FILE* when it can't be mapped
+    K3API k3imageSource(const char* file_name);
+    K3API ~k3imageSource();
+    k3imageSource(const k3imageSource&) = delete;
+    k3imageSource& operator=(const k3imageSource&) = delete;
+
+    K3API bool IsValid() const;
+    // Returns the number of bytes read
+    K3API uint32_t Read(void* dest, uint32_t size);
+    // For a source in memory, returns a pointer to the next bytes, trims size to what is left and skips over them;
+    // returns NULL without moving for a FILE*, where the caller has to Read instead
+    K3API const void* Map(uint32_t* size);
+    K3API uint32_t GetPos() const;
+    K3API void SetPos(uint32_t pos);
+    K3API void Skip(uint32_t size);
+    // True once a read has run out of data
+    K3API bool AtEnd() const;
+
+private:
+    FILE* _file_handle;
+    bool _owns_file;
+    const uint8_t* _data;
+    uint32_t _size;
+    uint32_t _pos;
+    bool _mapped;
+    bool _eof;
+};
+
+// Placement of one mip level of one array slice within the image data
+struct k3subresourceDesc {
+    uint32_t offset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t pitch;
+    uint32_t slice_pitch;
+};
 
-typedef void (K3CALLBACK* k3image_file_handler_loaddata_ptr)(FILE* file_handle, uint32_t pitch, uint32_t slice_pitch, void* data);
+// Each load keeps its state in a context owned by the handler, so loads can run on several threads at once
+// LoadHeaderInfo sets the context when it recognizes the file, the rest of the load is passed it back,
+// and EndLoad frees it; a handler with no state may leave it NULL
+typedef void (K3CALLBACK* k3image_file_handler_loadheaderinfo_ptr)(k3imageSource* source, void** context,
+    uint32_t* width, uint32_t* height, uint32_t* depth, k3fmt* format);
+
+typedef void (K3CALLBACK* k3image_file_handler_loaddata_ptr)(k3imageSource* source, void* context,
+    uint32_t pitch, uint32_t slice_pitch, void* data);
 
 typedef void (K3CALLBACK* k3image_file_handler_savedata_ptr)(FILE* file_handle, uint32_t width, uint32_t height,
     uint32_t depth, uint32_t pitch, uint32_t slice_pitch, k3fmt format, const void* data);
 
+// Optional; called after LoadHeaderInfo finds a format. When it reports more than one subresource,
+// LoadData reads all of them, array slice by array slice with each slice's mips in order; every
+// subresource after the first is packed right after the one before it
+typedef void (K3CALLBACK* k3image_file_handler_loadsubresourceinfo_ptr)(k3imageSource* source, void* context,
+    uint32_t* mip_levels, uint32_t* array_size, bool* cubemap);
+
+// Optional; called once for every load LoadHeaderInfo recognized, whether or not LoadData ran
+typedef void (K3CALLBACK* k3image_file_handler_endload_ptr)(void* context);
+
+// Optional; called before LoadData with the size a single subresource image is being reformatted to.
+// A handler that can decode straight to a smaller size may pick one no smaller than that in either
+// direction, and updates width and height to the size LoadData will write
+typedef void (K3CALLBACK* k3image_file_handler_loadscaledsize_ptr)(k3imageSource* source, void* context,
+    uint32_t dest_width, uint32_t dest_height, uint32_t* width, uint32_t* height);
+
+// Optional; like LoadData, but reads only the box of width x height x depth pixels starting at x, y, z
+// in the top level of the first array slice, with the box's first pixel at data. The box is inside the
+// image, and starts on a block for block compressed formats. Loads of a region from a handler without
+// it read the whole file, then copy the box out
+typedef void (K3CALLBACK* k3image_file_handler_loadregion_ptr)(k3imageSource* source, void* context,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data);
+
+// Optional; like SaveData, for an image with more than one subresource. desc holds mip_levels descriptions
+// for each of the array_size slices, array slice by array slice, with offsets into data; a cubemap's
+// array_size counts its faces. Saving such an image through a handler without it keeps only the top level
+// of the first array slice, and reports the rest as lost
+typedef void (K3CALLBACK* k3image_file_handler_savesubresources_ptr)(FILE* file_handle, k3fmt format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap, const k3subresourceDesc* desc, const void* data);
+
 struct k3image_file_handler_t
 {
     k3image_file_handler_loadheaderinfo_ptr LoadHeaderInfo;
     k3image_file_handler_loaddata_ptr LoadData;
     k3image_file_handler_savedata_ptr SaveData;
+    k3image_file_handler_loadsubresourceinfo_ptr LoadSubresourceInfo;
+    k3image_file_handler_endload_ptr EndLoad;
+    k3image_file_handler_loadscaledsize_ptr LoadScaledSize;
+    k3image_file_handler_loadregion_ptr LoadRegion;
+    k3image_file_handler_savesubresources_ptr SaveSubresources;
 };
 
 struct k3DXT1Block {
@@ -654,6 +1019,12 @@ struct k3ATI2NBlock {
     uint64_t greens;
 };
 
+// BC6H and BC7 blocks are a 128 bit stream, starting from bit 0 of lo
+struct k3BPTCBlock {
+    uint64_t lo;
+    uint64_t hi;
+};
+
 class k3imageImpl;
 class k3imageObj;
 typedef k3ptr<k3imageObj> k3image;
@@ -663,6 +1034,11 @@ protected:
     static const uint32_t MAX_FILE_HANDLERS = 8;
     static uint32_t _num_file_handlers;
     static k3image_file_handler_t* _fh[MAX_FILE_HANDLERS];
+    static uint32_t _parallel_threshold;
+    static k3compressQuality _compress_quality;
+    static k3compressQuality _dxt_compress_quality;
+    static uint32_t _file_compress_level;
+    static bool _fast_decode;
     k3imageImpl* _data;
 
     k3imageObj();
@@ -681,6 +1057,33 @@ public:
     static K3API void RemoveImageFileHandler(k3image_file_handler_t* fh);
     static K3API k3image Create();
 
+    // Reformats that write at least this many destination pixels split their block rows across
+    // k3parallel threads; the output is the same as a serial reformat. 0 keeps everything serial
+    static const uint32_t DEFAULT_PARALLEL_THRESHOLD = 256 * 256;
+    static K3API void SetParallelThreshold(uint32_t num_pixels);
+    static K3API uint32_t GetParallelThreshold();
+
+    // Applies to every reformat that encodes BC6H or BC7 blocks; FAST tries a single mode per block,
+    // BEST searches every mode and many partitions. Defaults to NORMAL
+    static K3API void SetCompressQuality(k3compressQuality quality);
+    static K3API k3compressQuality GetCompressQuality();
+
+    // Applies to every reformat that encodes BC1 to BC5 blocks; FAST takes the endpoints from the extreme
+    // pixels, NORMAL fits and refines them, BEST searches the most. Defaults to FAST. BEST runs about 25 times
+    // slower than NORMAL on BC1 to BC3 and lowers the error by less than 1%, so it is rarely worth it
+    static K3API void SetDXTCompressQuality(k3compressQuality quality);
+    static K3API k3compressQuality GetDXTCompressQuality();
+
+    // zlib level for file handlers that deflate what they save, from 0 (store) to 9 (smallest); PNG saves
+    // deflate groups of rows on the k3parallel threads, and the file is the same however many threads ran
+    static const uint32_t DEFAULT_FILE_COMPRESS_LEVEL = 6;
+    static K3API void SetFileCompressLevel(uint32_t level);
+    static K3API uint32_t GetFileCompressLevel();
+
+    // Lets file handlers trade a little accuracy for decode speed; JPEG loads use the fast integer IDCT
+    static K3API void SetFastDecode(bool fast);
+    static K3API bool GetFastDecode();
+
     static K3API void ReformatFromImage(k3image img, k3image src,
         uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
         k3fmt dest_format, const float* transform,
@@ -735,6 +1138,71 @@ public:
         ReformatFromFileHandle((img), (src), (dw), (dh), (dd), (df), (t), (xa), (ya), (za));
     }
 
+    // data holds an encoded image file, such as a texture embedded in a pack file; it is read in place
+    static K3API void ReformatFromEncodedMemory(k3image img, const void* data, uint32_t size,
+        uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+        k3fmt dest_format, const float* transform,
+        k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode);
+
+    static void LoadFromEncodedMemory(k3image img, const void* data, uint32_t size)
+    {
+        ReformatFromEncodedMemory((img), (data), (size), 0, 0, 0, k3fmt::UNKNOWN, NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+    static void ReformatFromEncodedMemory(k3image img, const void* data, uint32_t size, uint32_t dw, uint32_t dh, uint32_t dd, k3fmt df)
+    {
+        ReformatFromEncodedMemory((img), (data), (size), (dw), (dh), (dd), (df), NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+
+    // The file, file handle and encoded memory loads all come through here; files are mapped rather than read
+    static K3API void ReformatFromSource(k3image img, k3imageSource* source,
+        uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+        k3fmt dest_format, const float* transform,
+        k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode);
+
+    static void LoadFromSource(k3image img, k3imageSource* source)
+    {
+        ReformatFromSource((img), (source), 0, 0, 0, k3fmt::UNKNOWN, NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+
+    // Loads only the box of src_width x src_height x src_depth pixels at src_x, src_y, src_z of the file, which is
+    // then treated as the whole source image; a size of 0 reaches to the edge of the image. Only the top level of
+    // the first array slice is read, and for block compressed files the box starts on a block
+    // Handlers that support it read no more of the file than the box needs, and hold no more than a row outside it
+    static K3API void ReformatRegionFromFile(k3image img, const char* file_name,
+        uint32_t src_x, uint32_t src_y, uint32_t src_z, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+        uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+        k3fmt dest_format, const float* transform,
+        k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode);
+
+    static K3API void ReformatRegionFromFileHandle(k3image img, FILE* file_handle,
+        uint32_t src_x, uint32_t src_y, uint32_t src_z, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+        uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+        k3fmt dest_format, const float* transform,
+        k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode);
+
+    static K3API void ReformatRegionFromSource(k3image img, k3imageSource* source,
+        uint32_t src_x, uint32_t src_y, uint32_t src_z, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+        uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+        k3fmt dest_format, const float* transform,
+        k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode);
+
+    static void LoadRegionFromFile(k3image img, const char* src, uint32_t sx, uint32_t sy, uint32_t sz, uint32_t sw, uint32_t sh, uint32_t sd)
+    {
+        ReformatRegionFromFile((img), (src), (sx), (sy), (sz), (sw), (sh), (sd), 0, 0, 0, k3fmt::UNKNOWN, NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+    static void ReformatRegionFromFile(k3image img, const char* src, uint32_t sx, uint32_t sy, uint32_t sz, uint32_t sw, uint32_t sh, uint32_t sd, uint32_t dw, uint32_t dh, uint32_t dd, k3fmt df)
+    {
+        ReformatRegionFromFile((img), (src), (sx), (sy), (sz), (sw), (sh), (sd), (dw), (dh), (dd), (df), NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+    static void LoadRegionFromFileHandle(k3image img, FILE* src, uint32_t sx, uint32_t sy, uint32_t sz, uint32_t sw, uint32_t sh, uint32_t sd)
+    {
+        ReformatRegionFromFileHandle((img), (src), (sx), (sy), (sz), (sw), (sh), (sd), 0, 0, 0, k3fmt::UNKNOWN, NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+    static void LoadRegionFromSource(k3image img, k3imageSource* source, uint32_t sx, uint32_t sy, uint32_t sz, uint32_t sw, uint32_t sh, uint32_t sd)
+    {
+        ReformatRegionFromSource((img), (source), (sx), (sy), (sz), (sw), (sh), (sd), 0, 0, 0, k3fmt::UNKNOWN, NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    }
+
     static K3API void ReformatFromMemory(k3image img, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
         uint32_t src_pitch, uint32_t src_slice_pitch,
         k3fmt src_format, const void* src_data,
@@ -755,15 +1223,32 @@ public:
         ReformatFromMemory((img), (sw), (sh), (sd), (sp), (ssp), (sf), (sdata), (dw), (dh), (dd), (df), (t), (xa), (ya), (za));
     }
 
+    // Number of levels in a full mip chain, including the top level
+    static K3API uint32_t GetNumMipLevels(uint32_t width, uint32_t height, uint32_t depth);
+    // Filters each level from the one above it, in float, with a separable filter; mips[i] gets level i + 1
+    // in the format of src, and is created if NULL. With srgb set, color is filtered in linear space
+    // Returns the number of levels written, which stops early at 1x1x1
+    static K3API uint32_t GenerateMips(k3image src, uint32_t num_levels, k3image* mips, k3mipFilter filter, bool srgb);
+
     virtual ~k3imageObj();
 
-    K3API void SetDimensions(uint32_t width, uint32_t height, uint32_t depth, k3fmt format);
+    // Subresources are stored array slice by array slice, each with its mips from largest to smallest,
+    // the same order as the subresource index of a gfx resource; a cubemap has 6 array slices per cube
+    K3API void SetDimensions(uint32_t width, uint32_t height, uint32_t depth, k3fmt format,
+        uint32_t mip_levels = 1, uint32_t array_size = 1, bool cubemap = false);
     K3API uint32_t GetWidth() const;
     K3API uint32_t GetHeight() const;
     K3API uint32_t GetDepth() const;
     K3API k3fmt GetFormat() const;
     K3API uint32_t GetPitch() const;
     K3API uint32_t GetSlicePitch() const;
+    K3API uint32_t GetMipLevels() const;
+    K3API uint32_t GetArraySize() const;
+    K3API bool IsCubemap() const;
+    K3API uint32_t GetNumSubresources() const;
+    K3API void GetSubresourceDesc(uint32_t mip_level, uint32_t array_slice, k3subresourceDesc* desc) const;
+    // Bytes covered by every subresource
+    K3API uint32_t GetDataSize() const;
 
     K3API void SaveToFile(const char* filename, uint32_t fh_index);
     virtual K3API const void* MapForRead();
@@ -785,13 +1270,17 @@ public:
     static void DecompressATI1NBlock(const uint64_t* src, float* dest, bool clear_others = true);
     static void DecompressATI2NBlock(const k3ATI2NBlock* src, float* dest);
     static float CalcRGBLuminance(const float* src);
-    static float CompressDXT1Pixmap(const float** palette, const float* src, uint32_t* dest);
+    static float CompressDXT1Pixmap(const float** palette, const float* src, uint32_t transparent, uint32_t* dest);
     static float CompressATI1NPixmap(const float** palette, const float* src, uint64_t* dest);
     static void CompressDXT1Block(const float* src, k3DXT1Block* dest, bool allow_alpha = true);
     static void CompressDXT3Block(const float* src, k3DXT3Block* dest);
     static void CompressDXT5Block(const float* src, k3DXT3Block* dest);
     static void CompressATI1NBlock(const float* src, uint64_t* dest);
     static void CompressATI2NBlock(const float* src, k3ATI2NBlock* dest);
+    static void DecompressBC6HBlock(const k3BPTCBlock* src, float* dest);
+    static void DecompressBC7Block(const k3BPTCBlock* src, float* dest);
+    static void CompressBC6HBlock(const float* src, k3BPTCBlock* dest);
+    static void CompressBC7Block(const float* src, k3BPTCBlock* dest);
 
     static void InterpolateUnorm8(uint32_t num_channels, const uint8_t* src0, const uint8_t* src1, uint8_t levels, uint8_t* out);
     static void DecompressDXT1Palette(const k3DXT1Block* src, uint8_t* palette, bool allow_alpha);
@@ -801,13 +1290,19 @@ public:
     static void DecompressATI1NBlock(const uint64_t* src, uint8_t* dest, bool clear_others = true);
     static void DecompressATI2NBlock(const k3ATI2NBlock* src, uint8_t* dest);
     static uint32_t CalcRGBLuminance(const uint8_t* src);
-    static uint32_t CompressDXT1Pixmap(const uint8_t** palette, const uint8_t* src, uint32_t* dest);
+    static uint32_t CompressDXT1Pixmap(const uint8_t** palette, const uint8_t* src, uint32_t transparent, uint32_t* dest);
     static uint32_t CompressATI1NPixmap(const uint8_t** palette, const uint8_t* src, uint64_t* dest);
     static void CompressDXT1Block(const uint8_t* src, k3DXT1Block* dest, bool allow_alpha = true);
     static void CompressDXT3Block(const uint8_t* src, k3DXT3Block* dest);
     static void CompressDXT5Block(const uint8_t* src, k3DXT3Block* dest);
     static void CompressATI1NBlock(const uint8_t* src, uint64_t* dest);
     static void CompressATI2NBlock(const uint8_t* src, k3ATI2NBlock* dest);
+    static void FitDXT1Block(const uint8_t* src, k3DXT1Block* dest, bool allow_alpha, k3compressQuality quality);
+    static void FitATI1NBlock(const uint8_t* src, uint64_t* dest, k3compressQuality quality);
+    static void DecompressBC6HBlock(const k3BPTCBlock* src, uint8_t* dest);
+    static void DecompressBC7Block(const k3BPTCBlock* src, uint8_t* dest);
+    static void CompressBC6HBlock(const uint8_t* src, k3BPTCBlock* dest);
+    static void CompressBC7Block(const uint8_t* src, k3BPTCBlock* dest);
 
     static void ConvertRGB9E5ToFloat32(uint32_t src, float* dest);
     static void ConvertFloat32ToRGB9E5(const float* src, uint32_t* dest);
@@ -865,6 +1360,55 @@ public:
         k3texAddr z_addr_mode = k3texAddr::CLAMP);
 };
 
+// One image of a batch; the image file starts file_pos bytes into the file
+// With no file name, the image is read from size bytes of encoded data, which must outlive the batch
+// With dest set, the image decodes straight into dest, which is what the batch returns for it; dest should
+// hold no image yet, and the caller must not copy or release its references to dest until it is returned
+struct k3imageLoadDesc {
+    const char* file_name;
+    uint32_t file_pos;
+    const void* data;
+    uint32_t size;
+    k3imageObj* dest;
+};
+
+class k3imageBatchImpl;
+class k3imageBatchObj;
+typedef k3ptr<k3imageBatchObj> k3imageBatch;
+// Decodes a list of image files or blobs on the k3parallel threads, in the background of the thread that
+// started it; each image can be taken as soon as it is decoded, while later ones are still decoding.
+// Images that fail to load come back with no data. Releasing the batch waits for decodes in flight.
+// Other k3parallel loops started while a batch runs, including the reformats inside each decode, still
+// spread across the built in pool: each worker finishes the image it is on, then helps the newer loop.
+// An installed pool decides this for itself
+class k3imageBatchObj : public k3obj
+{
+private:
+    k3imageBatchImpl* _data;
+
+public:
+    k3imageBatchObj();
+    virtual ~k3imageBatchObj();
+    k3imageBatchImpl* getImpl();
+    const k3imageBatchImpl* getImpl() const;
+
+    virtual K3API k3objType getObjType() const
+    {
+        return k3objType::IMAGE_BATCH;
+    }
+
+    // file names are copied, so they need not outlive the call
+    static K3API k3imageBatch Create(uint32_t num_images, const k3imageLoadDesc* desc);
+
+    K3API uint32_t GetNumImages() const;
+    K3API bool IsLoaded(uint32_t index);
+    // Waits for the given image
+    K3API k3image WaitForImage(uint32_t index);
+    // Waits for the next image to finish decoding, in completion order, and sets index to its position
+    // in the batch; returns NULL once every image has been returned
+    K3API k3image WaitForNext(uint32_t* index);
+};
+
 // ------------------------------------------------------------
 // k3 key enums
 enum class k3key {
@@ -2001,6 +2545,28 @@ static const uint32_t K3_AXIS_DIR_FLAG_ALL = (K3_AXIS_DIR_FLAG_POS_X | K3_AXIS_D
 // returns the axis flags for s1 which the overlap occurs, or 0 if not overlapping
 uint32_t k3bvh_CheckCollision(k3AABB* s1, k3AABB* s2);
 
+// Structure of arrays form of many AABB's, for testing them in batches
+// Each of the 6 arrays holds one coordinate of every box
+struct k3AABBArray {
+    float* min[3];
+    float* max[3];
+};
+
+// Checks s1 against the first count boxes in s2, with the same rules as k3bvh_CheckCollision
+// hit_mask receives one bit per box, bit (i % 32) of hit_mask[i / 32], and must hold (count + 31) / 32 words
+// if axis_flags is non-null, it receives count entries of the axis flags k3bvh_CheckCollision would return
+// returns the number of overlapping boxes
+uint32_t k3bvh_CheckCollisionBatch(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags);
+
+// Frustum classification results
+static const uint32_t K3_FRUSTUM_OUTSIDE   = 0x0;
+static const uint32_t K3_FRUSTUM_INTERSECT = 0x1;
+static const uint32_t K3_FRUSTUM_INSIDE    = 0x2;
+
+// Classifies count boxes against frustum planes from k3m4_GetFrustumPlanes, writing one K3_FRUSTUM_* per box to d
+// returns the number of boxes that are not outside
+uint32_t k3bvh_ClassifyFrustumBatch(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count);
+
 // Check if AABB's overlap if s1 moves in vec direction; if so, modifies direction vector so there would be no overlap
 // Returns the axis (positive or negative) in which the overlap occurs
 // if slip bounds is non-null, it defines the amount that s1 can move in each axis, in each direction (min or max) and still
@@ -2033,6 +2599,15 @@ struct k3meshPartitions {
     K3API void insertObject(uint32_t obj_index, k3AABB* obj_aabb);
 };
 
+// Closest hit reported by k3meshObj::rayCast
+struct k3rayHit {
+    float t;            // distance along the ray, in units of the direction vector's length
+    float position[3];  // world space hit position
+    float bary[2];      // barycentric weights of the triangle's 2nd and 3rd vertices
+    uint32_t model;     // model that was hit
+    uint32_t prim;      // triangle that was hit, numbered like getStartPrim
+};
+
 enum class k3projType {
     PERSPECTIVE,
     ORTHOGRAPIC
@@ -2143,6 +2718,10 @@ public:
     K3API void setAnimation(uint32_t anim_index, uint32_t time_msec, uint32_t flags);
     K3API void getAABB(k3AABB* aabb, uint32_t model, k3bitTracker bone_exclude_mask);
     K3API void getLightAABB(k3AABB* aabb, uint32_t light);
+    // Finds the closest triangle of any visible model hit by the ray from origin along dir, up to max_t
+    // Builds a triangle bvh per mesh on first use; skinned meshes are tested in their bind pose
+    // returns false, and leaves hit untouched, if nothing is hit
+    K3API bool rayCast(const float* origin, const float* dir, float max_t, k3rayHit* hit);
     K3API void sizePartitions(k3meshPartitions* p, float overlap);
     K3API void createMeshPartitions(k3meshPartitions* p, float overlap);
     K3API void createLightPartitions(k3meshPartitions* p, float overlap);
@@ -0,0 +1,176 @@
+// k3 graphics library
+// thread pool used by the parallel loops
+
+#include "k3internal.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// One loop posted to the pool; indices are claimed from next until it passes count
+struct k3parallelJob
+{
+    uint32_t count;
+    k3parallel_task_ptr task;
+    void* context;
+    std::atomic<uint32_t> next;
+    // workers inside the loop, guarded by the pool mutex; the caller is not counted
+    uint32_t active;
+};
+
+// Workers sleep until a job is posted, then claim indices from its counter until it runs out.
+// Any number of jobs can be open at once, from different threads or from inside a task; the caller
+// always works on its own job, and workers take the newest open job, moving to a newer one as soon
+// as it is posted, so a long job, like an image batch, does not hold up short loops started after it
+class k3threadPoolImpl
+{
+public:
+    k3threadPoolImpl();
+
+    uint32_t getNumThreads();
+    void run(uint32_t count, k3parallel_task_ptr task, void* context);
+
+private:
+    void start();
+    void worker();
+    k3parallelJob* findJob();
+
+    std::once_flag _started;
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _job_posted;
+    std::condition_variable _job_done;
+    std::vector<k3parallelJob*> _jobs;
+    std::atomic<uint64_t> _generation;
+};
+
+k3threadPoolImpl::k3threadPoolImpl() :
+    _generation(0)
+{ }
+
+void k3threadPoolImpl::start()
+{
+    uint32_t num_cores = std::thread::hardware_concurrency();
+    uint32_t i;
+    for (i = 1; i < num_cores; i++) {
+        _workers.push_back(std::thread(&k3threadPoolImpl::worker, this));
+    }
+}
+
+uint32_t k3threadPoolImpl::getNumThreads()
+{
+    std::call_once(_started, &k3threadPoolImpl::start, this);
+    return static_cast<uint32_t>(_workers.size()) + 1;
+}
+
+// The newest job with indices left; call with the mutex held
+k3parallelJob* k3threadPoolImpl::findJob()
+{
+    size_t j;
+    for (j = _jobs.size(); j > 0; j--) {
+        if (_jobs[j - 1]->next < _jobs[j - 1]->count) return _jobs[j - 1];
+    }
+    return NULL;
+}
+
+void k3threadPoolImpl::worker()
+{
+    k3parallelJob* job;
+    uint64_t seen;
+    uint32_t i;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _job_posted.wait(lock, [&] { return (job = findJob()) != NULL; });
+            job->active++;
+            seen = _generation;
+        }
+        for (i = job->next++; i < job->count; i = job->next++) {
+            job->task(job->context, i);
+            if (_generation != seen) break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            job->active--;
+            if (job->active == 0) _job_done.notify_all();
+        }
+    }
+}
+
+void k3threadPoolImpl::run(uint32_t count, k3parallel_task_ptr task, void* context)
+{
+    uint32_t i;
+    if (count > 1 && getNumThreads() > 1) {
+        k3parallelJob job;
+        job.count = count;
+        job.task = task;
+        job.context = context;
+        job.next = 0;
+        job.active = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(&job);
+            _generation++;
+        }
+        _job_posted.notify_all();
+        for (i = job.next++; i < count; i = job.next++) {
+            task(context, i);
+        }
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _job_done.wait(lock, [&] { return job.active == 0; });
+            _jobs.erase(std::find(_jobs.begin(), _jobs.end(), &job));
+        }
+    } else {
+        for (i = 0; i < count; i++) task(context, i);
+    }
+}
+
+// The pool is never destroyed; joining threads from a static destructor can hang
+// when the library is unloaded, and idle workers go away with the process
+static k3threadPoolImpl* k3parallel_GetDefaultPool()
+{
+    static k3threadPoolImpl* pool = new k3threadPoolImpl;
+    return pool;
+}
+
+uint32_t K3CALLBACK k3parallel_DefaultGetNumThreads(void* pool_data)
+{
+    return k3parallel_GetDefaultPool()->getNumThreads();
+}
+
+void K3CALLBACK k3parallel_DefaultRun(void* pool_data, uint32_t count, k3parallel_task_ptr task, void* context)
+{
+    k3parallel_GetDefaultPool()->run(count, task, context);
+}
+
+static k3thread_pool_t k3parallel_default_pool = { NULL, k3parallel_DefaultGetNumThreads, k3parallel_DefaultRun };
+
+k3thread_pool_t* k3parallel::_pool = &k3parallel_default_pool;
+
+K3API void k3parallel::SetThreadPool(k3thread_pool_t* pool)
+{
+    _pool = (pool) ? pool : &k3parallel_default_pool;
+}
+
+K3API k3thread_pool_t* k3parallel::GetThreadPool()
+{
+    return _pool;
+}
+
+K3API uint32_t k3parallel::GetNumThreads()
+{
+    return _pool->GetNumThreads(_pool->pool_data);
+}
+
+K3API void k3parallel::For(uint32_t count, k3parallel_task_ptr task, void* context)
+{
+    if (count == 0) return;
+    if (count == 1) {
+        task(context, 0);
+        return;
+    }
+    _pool->Run(_pool->pool_data, count, task, context);
+}
@@ -590,19 +590,33 @@ K3API void k3cmdBufObj::ClearDepthTarget(k3surf surf, k3depthSelect clear, const
 K3API void k3cmdBufObj::UploadImage(k3uploadImage img, k3resource resource)
 {
     D3D12_TEXTURE_COPY_LOCATION src, dst;
+    k3resourceImpl* resource_impl = resource->getImpl();
+    D3D12_RESOURCE_DESC dx12_desc = resource_impl->_dx12_resource->GetDesc();
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(img->GetFormat());
+    // copy every subresource the image and the resource have in common
+    uint32_t resource_array_size = (dx12_desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? 1 : dx12_desc.DepthOrArraySize;
+    uint32_t num_mips = (img->GetMipLevels() < dx12_desc.MipLevels) ? img->GetMipLevels() : dx12_desc.MipLevels;
+    uint32_t num_slices = (img->GetArraySize() < resource_array_size) ? img->GetArraySize() : resource_array_size;
     src.pResource = img->getUploadImageImpl()->_resource;
     src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-    src.PlacedFootprint.Offset = 0;
     src.PlacedFootprint.Footprint.Format = k3win32Dx12WinImpl::ConvertToDXGIFormat(img->GetFormat(), k3DxgiSurfaceType::COLOR);
-    src.PlacedFootprint.Footprint.Width = img->GetWidth();
-    src.PlacedFootprint.Footprint.Height = img->GetHeight();
-    src.PlacedFootprint.Footprint.Depth = img->GetDepth();
-    src.PlacedFootprint.Footprint.RowPitch = img->GetPitch();
-    k3resourceImpl* resource_impl = resource->getImpl();
     dst.pResource = resource_impl->_dx12_resource;
     dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-    dst.SubresourceIndex = 0;
-    _data->_cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, NULL);
+    k3subresourceDesc sub;
+    uint32_t slice, mip;
+    for (slice = 0; slice < num_slices; slice++) {
+        for (mip = 0; mip < num_mips; mip++) {
+            img->GetSubresourceDesc(mip, slice, &sub);
+            // block compressed footprints cover whole blocks, even for mips smaller than a block
+            src.PlacedFootprint.Offset = sub.offset;
+            src.PlacedFootprint.Footprint.Width = ((sub.width + block_size - 1) / block_size) * block_size;
+            src.PlacedFootprint.Footprint.Height = ((sub.height + block_size - 1) / block_size) * block_size;
+            src.PlacedFootprint.Footprint.Depth = sub.depth;
+            src.PlacedFootprint.Footprint.RowPitch = sub.pitch;
+            dst.SubresourceIndex = mip + slice * dx12_desc.MipLevels;
+            _data->_cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, NULL);
+        }
+    }
 }
 
 K3API void k3cmdBufObj::DownloadImage(k3downloadImage img, k3resource resource)
@@ -1351,6 +1365,7 @@ k3uploadImageObj::k3uploadImageObj()
     _upload_data = new k3uploadImageImpl;
     _data->_pitch_pad = 256;
     _data->_slice_pitch_pad = 256;
+    _data->_subresource_pad = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT;
 }
 
 k3uploadImageObj::~k3uploadImageObj()
@@ -1389,7 +1404,7 @@ K3API void* k3uploadImageObj::MapForWrite()
 {
     HRESULT hr;
     void* ptr = NULL;
-    uint32_t size = _data->_depth * GetSlicePitch();
+    uint32_t size = GetDataSize();
     if (_upload_data->_resource == NULL) _data->_size = 0;
     if (_data->_size < size) {
         if (_upload_data->_resource) _upload_data->_resource->Release();
@@ -1443,7 +1458,7 @@ K3API void k3uploadImageObj::GetDesc(k3resourceDesc* desc)
         desc->height = _data->_height;
         desc->depth = _data->_depth;
         desc->format = _data->_fmt;
-        desc->mip_levels = 1;
+        desc->mip_levels = _data->_mip_levels;
         desc->num_samples = 1;
         desc->mem_pool = NULL;
         desc->mem_offset = 0;
@@ -1564,7 +1579,7 @@ K3API void k3downloadImageObj::GetDesc(k3resourceDesc* desc)
         desc->height = _data->_height;
         desc->depth = _data->_depth;
         desc->format = _data->_fmt;
-        desc->mip_levels = 1;
+        desc->mip_levels = _data->_mip_levels;
         desc->num_samples = 1;
         desc->mem_pool = NULL;
         desc->mem_offset = 0;
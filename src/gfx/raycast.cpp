@@ -0,0 +1,116 @@
+// k3 graphics library
+// cpu ray casting against mesh triangles
+
+#include "k3internal.h"
+
+// ------------------------------------------------------------
+// BVH construction from mesh geometry
+
+static void k3bvh_BuildMesh(const k3meshImpl* data, uint32_t mesh, k3meshBVH* bvh)
+{
+    uint32_t prim_start = data->_mesh_start[mesh];
+    uint32_t prim_end = (mesh == data->_num_meshes - 1) ? data->_num_tris : data->_mesh_start[mesh + 1];
+    const float* verts = data->_geom_data;
+    const uint32_t* indices = NULL;
+    if (data->_ib != NULL) {
+        uint32_t vert_size = (data->_num_bones > 0) ? 19 : 11;
+        indices = (const uint32_t*)(verts + vert_size * data->_num_verts);
+    }
+    k3bvh_Build(bvh, verts, indices, prim_start, prim_end - prim_start);
+}
+
+// Ray against a local box moved into world space by xform, to skip models before inverting their transform
+static bool k3bvh_RayHitsXformedBox(const float* xform, const float* mn, const float* mx, const float* origin, const float* dir, float t_max)
+{
+    uint32_t axis;
+    float center[3], extent[3];
+    float w_center, w_extent, t0, t1, inv_dir;
+    float t_min = 0.0f;
+    for (axis = 0; axis < 3; axis++) {
+        center[axis] = 0.5f * (mn[axis] + mx[axis]);
+        extent[axis] = 0.5f * (mx[axis] - mn[axis]);
+    }
+    for (axis = 0; axis < 3; axis++) {
+        const float* row = xform + 4 * axis;
+        w_center = row[0] * center[0] + row[1] * center[1] + row[2] * center[2] + row[3];
+        w_extent = fabsf(row[0]) * extent[0] + fabsf(row[1]) * extent[1] + fabsf(row[2]) * extent[2];
+        if (dir[axis] == 0.0f) {
+            if (origin[axis] < w_center - w_extent || origin[axis] > w_center + w_extent) return false;
+            continue;
+        }
+        inv_dir = 1.0f / dir[axis];
+        t0 = (w_center - w_extent - origin[axis]) * inv_dir;
+        t1 = (w_center + w_extent - origin[axis]) * inv_dir;
+        if (t0 > t1) {
+            float temp = t0;
+            t0 = t1;
+            t1 = temp;
+        }
+        t_min = (t0 > t_min) ? t0 : t_min;
+        t_max = (t1 < t_max) ? t1 : t_max;
+        if (t_min > t_max) return false;
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// Mesh ray casts
+
+K3API bool k3meshObj::rayCast(const float* origin, const float* dir, float max_t, k3rayHit* hit)
+{
+    uint32_t m, mesh;
+    if (_data->_geom_data == NULL || _data->_num_meshes == 0) return false;
+    // Concurrent first casts wait for one build, and nothing sees the BVH until all of it is there
+    k3meshBVH* mesh_bvh = _data->_bvh.load(std::memory_order_acquire);
+    if (mesh_bvh == NULL) {
+        std::lock_guard<std::mutex> lock(_data->_bvh_lock);
+        mesh_bvh = _data->_bvh.load(std::memory_order_relaxed);
+        if (mesh_bvh == NULL) {
+            mesh_bvh = new k3meshBVH[_data->_num_meshes];
+            for (mesh = 0; mesh < _data->_num_meshes; mesh++) k3bvh_BuildMesh(_data, mesh, mesh_bvh + mesh);
+            _data->_bvh.store(mesh_bvh, std::memory_order_release);
+        }
+    }
+
+    float closest_t = max_t;
+    float bary[2] = { 0.0f, 0.0f };
+    uint32_t prim = 0xffffffff;
+    uint32_t hit_model = 0xffffffff;
+    float inv_xform[16];
+    float world_vec[4];
+    float local_origin[4];
+    float local_dir[4];
+    for (m = 0; m < _data->_num_models; m++) {
+        const k3meshModel* model = _data->_model + m;
+        if (model->visibility <= 0.0f || model->mesh_index >= _data->_num_meshes) continue;
+        const k3meshBVH* bvh = mesh_bvh + model->mesh_index;
+        if (bvh->nodes == NULL) continue;
+        if (!k3bvh_RayHitsXformedBox(model->world_xform, bvh->min, bvh->max, origin, dir, closest_t)) continue;
+
+        // Trace in model space; the direction is not renormalized, so t means the same in both spaces
+        memcpy(inv_xform, model->world_xform, 16 * sizeof(float));
+        k3m4_InverseTransform(inv_xform);
+        world_vec[0] = origin[0];
+        world_vec[1] = origin[1];
+        world_vec[2] = origin[2];
+        world_vec[3] = 1.0f;
+        k3mv4_Mul(local_origin, inv_xform, world_vec);
+        world_vec[0] = dir[0];
+        world_vec[1] = dir[1];
+        world_vec[2] = dir[2];
+        world_vec[3] = 0.0f;
+        k3mv4_Mul(local_dir, inv_xform, world_vec);
+        if (k3bvh_Trace(bvh, local_origin, local_dir, &closest_t, bary, &prim)) hit_model = m;
+    }
+
+    if (hit_model == 0xffffffff) return false;
+    hit->t = closest_t;
+    hit->position[0] = origin[0] + closest_t * dir[0];
+    hit->position[1] = origin[1] + closest_t * dir[1];
+    hit->position[2] = origin[2] + closest_t * dir[2];
+    hit->bary[0] = bary[0];
+    hit->bary[1] = bary[1];
+    hit->model = hit_model;
+    hit->prim = prim;
+    return true;
+}
@@ -3,6 +3,7 @@
 // Date: 10/10/2021
 
 #include "k3internal.h"
+#include "k3simd.h"
 
 // ------------------------------------------------------------
 // k3 bit tracker
@@ -942,6 +943,24 @@ uint32_t k3bvh_CheckCollision(k3AABB* s1, k3AABB* s2)
     return (x_collision && y_collision && z_collision) ? overlap_flags : K3_AXIS_DIR_FLAG_NONE;
 }
 
+uint32_t k3bvh_CheckCollisionBatch(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags)
+{
+    uint32_t w, bits, hits = 0;
+    k3math_funcs.bvh_CheckCollisionBatch(s1, s2, count, hit_mask, axis_flags);
+    for (w = 0; w < (count + 31) / 32; w++) {
+        for (bits = hit_mask[w]; bits; bits &= bits - 1) hits++;
+    }
+    return hits;
+}
+
+uint32_t k3bvh_ClassifyFrustumBatch(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count)
+{
+    uint32_t i, visible = 0;
+    k3math_funcs.bvh_ClassifyFrustumBatch(d, planes, s, count);
+    for (i = 0; i < count; i++) visible += (d[i] != K3_FRUSTUM_OUTSIDE);
+    return visible;
+}
+
 uint32_t k3bvh_CheckDirectedCollision(k3AABB* s1, k3AABB* s2, float* s1_vec, const float* s2_vec, k3AABB* slip_bounds, uint32_t axis_priority, uint32_t axis_mask)
 {
     uint32_t axis;
@@ -1075,6 +1094,7 @@ k3meshImpl::k3meshImpl()
     _empties = NULL;
     _bones = NULL;
     _anim = NULL;
+    _bvh = NULL;
     _ib = NULL;
     _vb = NULL;
     _ab = NULL;
@@ -1150,6 +1170,16 @@ k3meshImpl::~k3meshImpl()
         _num_anims = 0;
         _anim = NULL;
     }
+    k3meshBVH* bvh = _bvh.load();
+    if (bvh) {
+        uint32_t i;
+        for (i = 0; i < _num_meshes; i++) {
+            if (bvh[i].nodes) delete[] bvh[i].nodes;
+            if (bvh[i].packets) delete[] bvh[i].packets;
+        }
+        delete[] bvh;
+        _bvh = NULL;
+    }
 }
 
 k3meshObj::k3meshObj()
@@ -1694,13 +1724,15 @@ K3API void k3meshObj::genBoneMatrices(float* mat, bool gen_inv)
     float* parent_mat = NULL;
     float xlat_mat[16];
     float rot_xlat_mat[16];
+    const uint32_t bone_stride = sizeof(k3bone) / sizeof(float);
+    // Convert all the bone rotations up front, using each output slot as scratch for its rotation matrix
+    if (_data->_num_bones) k3m_QuatToMatBatch(_data->_num_bones, 4, mat, mat_stride, _data->_bones[0].rot_quat, bone_stride);
     for (bone_id = 0; bone_id < _data->_num_bones; bone_id++, cur_mat += mat_stride) {
-        k3m4_QuatToMat(rot_xlat_mat, _data->_bones[bone_id].rot_quat);
         k3m4_SetIdentity(xlat_mat);
         xlat_mat[3] = _data->_bones[bone_id].position[0];
         xlat_mat[7] = _data->_bones[bone_id].position[1];
         xlat_mat[11] = _data->_bones[bone_id].position[2];
-        k3m4_Mul(rot_xlat_mat, xlat_mat, rot_xlat_mat);
+        k3m4_Mul(rot_xlat_mat, xlat_mat, cur_mat);
         k3m4_SetIdentity(xlat_mat);
         xlat_mat[0] = _data->_bones[bone_id].scaling[0];
         xlat_mat[5] = _data->_bones[bone_id].scaling[1];
@@ -1725,12 +1757,15 @@ K3API void k3meshObj::genBoneMatrices(float* mat, bool gen_inv)
  
     }
 
-    cur_mat = mat;
-    for (bone_id = 0; bone_id < _data->_num_bones; bone_id++, cur_mat += mat_stride) {
-        k3m4_Mul(cur_mat, cur_mat, _data->_bones[bone_id].inv_bind_pose);
-        if (gen_inv) {
-            k3m4_Mul(cur_mat + 16, cur_mat + 16, _data->_bones[bone_id].inv_bind_pose);
-            k3m4_InverseTransform(cur_mat + 16);
+    if (_data->_num_bones == 0) return;
+
+    // Apply the inverse bind poses as one batch, reading them straight out of the bone array
+    k3m4_MulArray(_data->_num_bones, mat, mat_stride, mat, mat_stride, _data->_bones[0].inv_bind_pose, bone_stride);
+    if (gen_inv) {
+        k3m4_MulArray(_data->_num_bones, mat + 16, mat_stride, mat + 16, mat_stride, _data->_bones[0].inv_bind_pose, bone_stride);
+        cur_mat = mat + 16;
+        for (bone_id = 0; bone_id < _data->_num_bones; bone_id++, cur_mat += mat_stride) {
+            k3m4_InverseTransform(cur_mat);
         }
     }
 }
@@ -1970,6 +2005,14 @@ K3API void k3meshObj::setAnimation(uint32_t anim_index, uint32_t time_msec, uint
     dest_scale_ptr = model_scaling.sse_data;
     dest_quat_ptr = model_quat.sse_data;
 
+    // When every bone is animated in order, blend all the rotations in one batch straight out of the keyframes
+    bool batched_quats = (_data->_bones && _data->_anim[anim_index].anim_objs == NULL && force_anim && num_anim_objs);
+    if (batched_quats) {
+        k3v4_QuatNlerpBatch(num_anim_objs, _data->_bones[0].rot_quat, sizeof(k3bone) / sizeof(float),
+            bone_data[src0_index].rot_quat, sizeof(k3boneData) / sizeof(float),
+            bone_data[src1_index].rot_quat, sizeof(k3boneData) / sizeof(float), anim_frame_frac);
+    }
+
     for (obj_index = 0; obj_index < num_anim_objs; obj_index++) {
         if (_data->_anim[anim_index].anim_objs) {
             obj_type = _data->_anim[anim_index].anim_objs[obj_index].obj_type;
@@ -1999,16 +2042,10 @@ K3API void k3meshObj::setAnimation(uint32_t anim_index, uint32_t time_msec, uint
             k3sv3_Mul(temp_vec, anim_frame_frac, bone_data[src1_index].scaling);
             k3v3_Add(dest_scale_ptr, dest_scale_ptr, temp_vec);
 
-            k3sv4_Mul(dest_quat_ptr, 1.0f - anim_frame_frac, bone_data[src0_index].rot_quat);
-            k3sv4_Mul(temp_vec, anim_frame_frac, bone_data[src1_index].rot_quat);
-            k3v4_Add(dest_quat_ptr, dest_quat_ptr, temp_vec);
-            k3v4_Normalize(dest_quat_ptr);
+            if (!batched_quats) {
+                k3v4_QuatNlerpBatch(1, dest_quat_ptr, 4, bone_data[src0_index].rot_quat, 4, bone_data[src1_index].rot_quat, 4, anim_frame_frac);
+            }
         } else if (obj_bone_flag & K3_BONE_FLAG_MORPH) {
-            //k3sv3_Mul(temp_vec2, 1.0f - anim_frame_frac, bone_data[src0_index].position);
-            //k3sv3_Mul(temp_vec, anim_frame_frac, bone_data[src1_index].position);
-            //k3v3_Add(dest_pos_ptr, dest_pos_ptr, temp_vec);
-            //k3v3_Add(dest_pos_ptr, dest_pos_ptr, temp_vec2);
-
             k3sv3_Mul(dest_pos_ptr, 1.0f - anim_frame_frac, bone_data[src0_index].position);
             k3sv3_Mul(temp_vec, anim_frame_frac, bone_data[src1_index].position);
             k3v3_Add(dest_pos_ptr, dest_pos_ptr, temp_vec);
@@ -2018,10 +2055,7 @@ K3API void k3meshObj::setAnimation(uint32_t anim_index, uint32_t time_msec, uint
             k3v3_Add(temp_vec, temp_vec2, temp_vec);
             k3v3_Mul(dest_scale_ptr, dest_scale_ptr, temp_vec);
 
-            k3sv4_Mul(temp_vec2, 1.0f - anim_frame_frac, bone_data[src0_index].rot_quat);
-            k3sv4_Mul(temp_vec, anim_frame_frac, bone_data[src1_index].rot_quat);
-            k3v4_Add(temp_vec, temp_vec2, temp_vec);
-            k3v4_Normalize(temp_vec);
+            k3v4_QuatNlerpBatch(1, temp_vec, 4, bone_data[src0_index].rot_quat, 4, bone_data[src1_index].rot_quat, 4, anim_frame_frac);
             k3v4_QuatMul(dest_quat_ptr, dest_quat_ptr, temp_vec);
             k3v4_Normalize(dest_quat_ptr);
         }
@@ -2103,6 +2137,8 @@ K3API void k3meshObj::getAABB(k3AABB* aabb, uint32_t model, k3bitTracker bone_ex
     float xform_vert[4];
     float temp_vec1[4];
     float temp_vec2[4];
+    static const uint32_t AABB_CHUNK_SIZE = 64;
+    float xform_chunk[3 * AABB_CHUNK_SIZE];
     bool include_bone = true;
     for (m = m_start; m < m_end; m++) {
         uint32_t mesh = _data->_model[m].mesh_index;
@@ -2130,6 +2166,24 @@ K3API void k3meshObj::getAABB(k3AABB* aabb, uint32_t model, k3bitTracker bone_ex
                 v_end = (indices[i] > v_end) ? indices[i] : v_end;
             }
         }
+        if (_data->_num_bones == 0) {
+            // No skinning, so positions go through the model transform in batches
+            uint32_t i, chunk_size;
+            for (v = v_start; v < v_end; v += chunk_size) {
+                chunk_size = (v_end - v < AABB_CHUNK_SIZE) ? v_end - v : AABB_CHUNK_SIZE;
+                k3mp3_MulArray(chunk_size, xform_chunk, 3, model_xform, 0, verts, 3);
+                for (i = 0; i < 3 * chunk_size; i += 3) {
+                    aabb->min[0] = (xform_chunk[i + 0] < aabb->min[0]) ? xform_chunk[i + 0] : aabb->min[0];
+                    aabb->min[1] = (xform_chunk[i + 1] < aabb->min[1]) ? xform_chunk[i + 1] : aabb->min[1];
+                    aabb->min[2] = (xform_chunk[i + 2] < aabb->min[2]) ? xform_chunk[i + 2] : aabb->min[2];
+                    aabb->max[0] = (xform_chunk[i + 0] > aabb->max[0]) ? xform_chunk[i + 0] : aabb->max[0];
+                    aabb->max[1] = (xform_chunk[i + 1] > aabb->max[1]) ? xform_chunk[i + 1] : aabb->max[1];
+                    aabb->max[2] = (xform_chunk[i + 2] > aabb->max[2]) ? xform_chunk[i + 2] : aabb->max[2];
+                }
+                verts += 3 * chunk_size;
+            }
+            continue;
+        }
         for (v = v_start; v < v_end; v++) {
             xform_vert[3] = 1.0f;
             if (_data->_num_bones > 0 && skin_f[0] >= 0.1f) {
@@ -2153,7 +2207,7 @@ K3API void k3meshObj::getAABB(k3AABB* aabb, uint32_t model, k3bitTracker bone_ex
                 }
             } else {
                 xform_vert[0] = verts[0];
-                xform_vert[1] = verts[2];
+                xform_vert[1] = verts[1];
                 xform_vert[2] = verts[2];
             }
             k3mv4_Mul(xform_vert, model_xform, xform_vert);
@@ -4633,48 +4687,60 @@ K3API k3mesh k3gfxObj::CreateMesh(k3meshDesc* desc)
 
     mesh_impl->_num_textures = fbx.num_textures;
     if (fbx.num_textures) {
-        static const uint32_t NUM_UP_BUF = 4;
-        uint64_t f = 0;
-        uint32_t v = 0;
-        k3uploadImage up_image[NUM_UP_BUF];
-        k3fence up_image_fence = CreateFence();
-        for (i = 0; i < NUM_UP_BUF; i++) {
+        // Decode every texture in the background, straight into its own upload image, and upload each one
+        // as soon as it is ready; the upload images are held until the GPU is done with all of them
+        k3uploadImage* up_image = new k3uploadImage[fbx.num_textures];
+        k3imageLoadDesc* load_desc = new k3imageLoadDesc[fbx.num_textures];
+        for (i = 0; i < fbx.num_textures; i++) {
+            uint32_t content_start_pos = fbx.texture[i].file_pos;
             up_image[i] = CreateUploadImage();
+            load_desc[i].data = NULL;
+            load_desc[i].size = 0;
+            load_desc[i].dest = up_image[i];
+            if (content_start_pos == ~0x0) {
+                load_desc[i].file_name = fbx.texture[i].filename;
+                load_desc[i].file_pos = 0;
+            } else {
+                load_desc[i].file_name = desc->name;
+                load_desc[i].file_pos = content_start_pos;
+            }
         }
+        k3imageBatch batch = k3imageBatchObj::Create(fbx.num_textures, load_desc);
+        delete[] load_desc;
 
         mesh_impl->_textures = new k3surf[fbx.num_textures];
         k3resourceDesc rdesc;
         k3viewDesc vdesc = { 0 };
         k3resource img_res;
-        for (i = 0; i < fbx.num_textures; i++) {
-            if(f >= NUM_UP_BUF) {
-                while (!up_image_fence->CheckFence(f + 1 - NUM_UP_BUF));
-            }
-
-            uint32_t content_start_pos = fbx.texture[i].file_pos;
-            if (content_start_pos == ~0x0) {
-                k3imageObj::LoadFromFile(up_image[v], fbx.texture[i].filename);
-            } else {
-                fseek(in_file, content_start_pos, SEEK_SET);
-                k3imageObj::LoadFromFileHandle(up_image[v], in_file);
+        k3image img;
+        uint32_t* fallback_data;
+        uint32_t view_index = desc->view_index;
+        desc->view_index += fbx.num_textures;
+        while ((img = batch->WaitForNext(&i)) != NULL) {
+            img = NULL;
+            if (up_image[i]->GetFormat() == k3fmt::UNKNOWN) {
+                // the texture still gets a surface and view, so the mesh can be drawn without it
+                k3error::Handler("Could not load texture", "k3gfxObj::CreateMesh");
+                up_image[i]->SetDimensions(1, 1, 1, k3fmt::RGBA8_UNORM);
+                fallback_data = static_cast<uint32_t*>(up_image[i]->MapForWrite());
+                if (fallback_data) *fallback_data = 0xffffffff;
+                up_image[i]->Unmap();
             }
-            up_image[v]->GetDesc(&rdesc);
-            vdesc.view_index = desc->view_index++;
+            up_image[i]->GetDesc(&rdesc);
+            vdesc.view_index = view_index + i;
             mesh_impl->_textures[i] = CreateSurface(&rdesc, NULL, &vdesc, NULL);
 
             desc->cmd_buf->Reset();
             img_res = mesh_impl->_textures[i]->GetResource();
             desc->cmd_buf->TransitionResource(img_res, k3resourceState::COPY_DEST);
-            desc->cmd_buf->UploadImage(up_image[v], img_res);
+            desc->cmd_buf->UploadImage(up_image[i], img_res);
             desc->cmd_buf->TransitionResource(img_res, k3resourceState::SHADER_RESOURCE);
             desc->cmd_buf->Close();
             SubmitCmdBuf(desc->cmd_buf);
-
-            f = up_image_fence->SetGpuFence(k3gpuQueue::GRAPHICS);
-            v++;
-            if (v >= NUM_UP_BUF) v = 0;
         }
         WaitGpuIdle();
+        batch = NULL;
+        delete[] up_image;
     }
 
     fclose(in_file);
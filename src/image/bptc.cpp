@@ -0,0 +1,1389 @@
+// k3 graphics library
+// BC6H and BC7 block compression
+
+#include "k3internal.h"
+#include "k3simd.h"
+
+// ------------------------------------------------------------
+// Tables shared by BC6H and BC7
+
+// Subset of each pixel in the 2 subset partitions, 1 bit per pixel; BC6H uses the first 32
+static const uint16_t k3bptc_partitions2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+};
+
+// Subset of each pixel in the 3 subset partitions, 2 bits per pixel
+static const uint32_t k3bptc_partitions3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+    0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+    0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+    0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+    0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+    0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+};
+
+// The index of each subset's anchor pixel is stored without its top bit, so it must be in the
+// first half of the palette; subset 0 always anchors at pixel 0
+static const uint8_t k3bptc_anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static const uint8_t k3bptc_anchors3_1[64] = {
+     3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+     3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+     8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+     3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+};
+
+static const uint8_t k3bptc_anchors3_2[64] = {
+    15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+    15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+    15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+    15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+};
+
+// Blend weights out of 64 for 2, 3 and 4 bit indices
+static const uint8_t k3bptc_weights2[4] = { 0, 21, 43, 64 };
+static const uint8_t k3bptc_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t k3bptc_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static const uint8_t* k3bptc_GetWeights(uint32_t index_bits)
+{
+    switch (index_bits) {
+    case 2:  return k3bptc_weights2;
+    case 3:  return k3bptc_weights3;
+    default: return k3bptc_weights4;
+    }
+}
+
+static inline uint32_t k3bptc_GetSubset(uint32_t num_subsets, uint32_t partition, uint32_t pixel)
+{
+    switch (num_subsets) {
+    case 2:  return (k3bptc_partitions2[partition] >> pixel) & 0x1;
+    case 3:  return (k3bptc_partitions3[partition] >> (2 * pixel)) & 0x3;
+    default: return 0;
+    }
+}
+
+static inline uint32_t k3bptc_GetSubsetMask(uint32_t num_subsets, uint32_t partition, uint32_t subset)
+{
+    uint32_t i, mask = 0;
+    for (i = 0; i < 16; i++) {
+        if (k3bptc_GetSubset(num_subsets, partition, i) == subset) mask |= 1 << i;
+    }
+    return mask;
+}
+
+static inline uint32_t k3bptc_GetAnchor(uint32_t num_subsets, uint32_t partition, uint32_t subset)
+{
+    if (subset == 0) return 0;
+    if (num_subsets == 2) return k3bptc_anchors2[partition];
+    return (subset == 1) ? k3bptc_anchors3_1[partition] : k3bptc_anchors3_2[partition];
+}
+
+static inline bool k3bptc_IsAnchor(uint32_t num_subsets, uint32_t partition, uint32_t pixel)
+{
+    return k3bptc_GetAnchor(num_subsets, partition, k3bptc_GetSubset(num_subsets, partition, pixel)) == pixel;
+}
+
+static inline uint32_t k3bptc_Interpolate(uint32_t e0, uint32_t e1, uint32_t weight)
+{
+    return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+// Fields of up to 32 bits, packed from bit 0 of lo up to bit 63 of hi
+class k3bptcBitReader
+{
+public:
+    k3bptcBitReader(const k3BPTCBlock* block) : _lo(block->lo), _hi(block->hi), _pos(0)
+    { }
+
+    uint32_t Read(uint32_t count)
+    {
+        uint64_t bits;
+        if (_pos >= 64) bits = _hi >> (_pos - 64);
+        else if (_pos == 0) bits = _lo;
+        else bits = (_lo >> _pos) | (_hi << (64 - _pos));
+        _pos += count;
+        return static_cast<uint32_t>(bits & ((1ull << count) - 1));
+    }
+
+private:
+    uint64_t _lo;
+    uint64_t _hi;
+    uint32_t _pos;
+};
+
+class k3bptcBitWriter
+{
+public:
+    k3bptcBitWriter(k3BPTCBlock* block) : _block(block), _pos(0)
+    {
+        _block->lo = 0;
+        _block->hi = 0;
+    }
+
+    void Write(uint32_t value, uint32_t count)
+    {
+        uint64_t bits = value & ((1ull << count) - 1);
+        if (_pos >= 64) {
+            _block->hi |= bits << (_pos - 64);
+        } else {
+            _block->lo |= bits << _pos;
+            if (_pos + count > 64) _block->hi |= bits >> (64 - _pos);
+        }
+        _pos += count;
+    }
+
+private:
+    k3BPTCBlock* _block;
+    uint32_t _pos;
+};
+
+// ------------------------------------------------------------
+// Endpoint fitting shared by the encoders
+// Pixels are 16 groups of 4 floats; a fit covers the pixels set in mask, and the num_channels
+// channels starting at first_channel
+
+// Fits a line through the pixels along the principal axis of their covariance; the endpoints span
+// the pixels' projections onto it
+static void k3bptc_FitLine(const float* pixels, uint32_t mask, uint32_t first_channel, uint32_t num_channels,
+    float* ep0, float* ep1)
+{
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float cov[4][4] = { { 0.0f } };
+    float axis[4], next[4], d[4];
+    float count = 0.0f, len, t, t_min = FLT_MAX, t_max = -FLT_MAX;
+    uint32_t i, j, k, iter;
+    const float* p;
+
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        p = pixels + 4 * i + first_channel;
+        for (j = 0; j < num_channels; j++) mean[j] += p[j];
+        count += 1.0f;
+    }
+    if (count == 0.0f) return;
+    for (j = 0; j < num_channels; j++) mean[j] /= count;
+
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        p = pixels + 4 * i + first_channel;
+        for (j = 0; j < num_channels; j++) d[j] = p[j] - mean[j];
+        for (j = 0; j < num_channels; j++) {
+            for (k = 0; k < num_channels; k++) cov[j][k] += d[j] * d[k];
+        }
+    }
+
+    // start from the channel with the most variance
+    k = 0;
+    for (j = 0; j < num_channels; j++) {
+        if (cov[j][j] > cov[k][k]) k = j;
+    }
+    for (j = 0; j < num_channels; j++) axis[j] = cov[k][j];
+    for (iter = 0; iter < 8; iter++) {
+        len = 0.0f;
+        for (j = 0; j < num_channels; j++) {
+            next[j] = 0.0f;
+            for (k = 0; k < num_channels; k++) next[j] += cov[j][k] * axis[k];
+            len += next[j] * next[j];
+        }
+        if (len == 0.0f) break;
+        len = 1.0f / sqrtf(len);
+        for (j = 0; j < num_channels; j++) axis[j] = next[j] * len;
+    }
+
+    len = 0.0f;
+    for (j = 0; j < num_channels; j++) len += axis[j] * axis[j];
+    if (len > 0.0f) {
+        for (i = 0; i < 16; i++) {
+            if (!(mask & (1 << i))) continue;
+            p = pixels + 4 * i + first_channel;
+            t = 0.0f;
+            for (j = 0; j < num_channels; j++) t += (p[j] - mean[j]) * axis[j];
+            if (t < t_min) t_min = t;
+            if (t > t_max) t_max = t;
+        }
+    } else {
+        t_min = 0.0f;
+        t_max = 0.0f;
+    }
+
+    for (j = 0; j < num_channels; j++) {
+        ep0[j] = mean[j] + t_min * axis[j];
+        ep1[j] = mean[j] + t_max * axis[j];
+    }
+}
+
+// Least squares endpoints for the pixels, given the blend weight out of 64 each pixel was assigned
+// Returns false, leaving the endpoints alone, when every pixel has the same weight
+static bool k3bptc_RefitLine(const float* pixels, uint32_t mask, uint32_t first_channel, uint32_t num_channels,
+    const uint8_t* pixel_weights, float* ep0, float* ep1)
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float a, b, det;
+    uint32_t i, j;
+    const float* p;
+
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        p = pixels + 4 * i + first_channel;
+        b = pixel_weights[i] / 64.0f;
+        a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (j = 0; j < num_channels; j++) {
+            ax[j] += a * p[j];
+            bx[j] += b * p[j];
+        }
+    }
+
+    det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+    det = 1.0f / det;
+    for (j = 0; j < num_channels; j++) {
+        ep0[j] = (bb * ax[j] - ab * bx[j]) * det;
+        ep1[j] = (aa * bx[j] - ab * ax[j]) * det;
+    }
+    return true;
+}
+
+// Squared distance of a subset's pixels off their best fit line, from the subset's moments:
+// pixel count, channel sums, then the sums of the channel products in row order
+static float k3bptc_EstimateLineError(const float* moments, uint32_t num_channels)
+{
+    float cov[4][4], axis[4], next[4];
+    float n = moments[0], trace = 0.0f, len, eigen = 0.0f;
+    const float* sums = moments + 1;
+    const float* products = moments + 5;
+    uint32_t j, k, iter;
+
+    if (n == 0.0f) return 0.0f;
+    for (j = 0; j < num_channels; j++) {
+        for (k = j; k < num_channels; k++) {
+            cov[j][k] = *(products++) - sums[j] * sums[k] / n;
+            cov[k][j] = cov[j][k];
+        }
+        products += 4 - num_channels;
+        trace += cov[j][j];
+        axis[j] = 1.0f;
+    }
+    for (iter = 0; iter < 4; iter++) {
+        len = 0.0f;
+        for (j = 0; j < num_channels; j++) {
+            next[j] = 0.0f;
+            for (k = 0; k < num_channels; k++) next[j] += cov[j][k] * axis[k];
+            len += next[j] * next[j];
+        }
+        if (len == 0.0f) return 0.0f;
+        len = 1.0f / sqrtf(len);
+        for (j = 0; j < num_channels; j++) axis[j] = next[j] * len;
+    }
+    for (j = 0; j < num_channels; j++) {
+        for (k = 0; k < num_channels; k++) eigen += axis[j] * cov[j][k] * axis[k];
+    }
+    return (trace > eigen) ? trace - eigen : 0.0f;
+}
+
+// Writes the count partitions whose subsets fit lines best to ranked, best first
+static void k3bptc_RankPartitions(const float* pixels, uint32_t num_channels, uint32_t num_subsets, uint32_t num_partitions,
+    uint32_t count, uint32_t* ranked)
+{
+    static const uint32_t NUM_MOMENTS = 15;
+    float pixel_moments[16][NUM_MOMENTS];
+    float moments[3][NUM_MOMENTS];
+    float errors[64];
+    uint32_t order[64];
+    uint32_t p, s, i, j, k, m;
+    const float* x;
+
+    // the moments of the whole block are summed once per pixel; 4 channels give 10 products
+    for (i = 0; i < 16; i++) {
+        x = pixels + 4 * i;
+        pixel_moments[i][0] = 1.0f;
+        for (j = 0; j < 4; j++) pixel_moments[i][1 + j] = x[j];
+        m = 5;
+        for (j = 0; j < 4; j++) {
+            for (k = j; k < 4; k++) pixel_moments[i][m++] = x[j] * x[k];
+        }
+    }
+
+    for (p = 0; p < num_partitions; p++) {
+        memset(moments, 0, sizeof(moments));
+        for (i = 0; i < 16; i++) {
+            s = k3bptc_GetSubset(num_subsets, p, i);
+            for (m = 0; m < NUM_MOMENTS; m++) moments[s][m] += pixel_moments[i][m];
+        }
+        errors[p] = 0.0f;
+        for (s = 0; s < num_subsets; s++) errors[p] += k3bptc_EstimateLineError(moments[s], num_channels);
+    }
+
+    for (p = 0; p < num_partitions; p++) order[p] = p;
+    for (i = 0; i < count; i++) {
+        for (j = i + 1; j < num_partitions; j++) {
+            if (errors[order[j]] < errors[order[i]]) {
+                p = order[i];
+                order[i] = order[j];
+                order[j] = p;
+            }
+        }
+        ranked[i] = order[i];
+    }
+}
+
+static uint32_t k3bptc_GetIterations(k3compressQuality quality)
+{
+    switch (quality) {
+    case k3compressQuality::FAST:   return 0;
+    case k3compressQuality::NORMAL: return 1;
+    default:                        return 2;
+    }
+}
+
+// ------------------------------------------------------------
+// BC7
+
+struct k3bc7Mode {
+    uint8_t num_subsets;
+    uint8_t partition_bits;
+    uint8_t rotation_bits;
+    uint8_t index_select_bits;
+    uint8_t color_bits;
+    uint8_t alpha_bits;
+    uint8_t endpoint_pbits;   // a p-bit per endpoint
+    uint8_t shared_pbits;     // a p-bit per subset
+    uint8_t index_bits;
+    uint8_t index2_bits;      // modes 4 and 5 have a second set of indices for alpha
+};
+
+static const k3bc7Mode k3bc7_modes[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+};
+
+// A BC7 block with its fields unpacked
+// Endpoints are as stored, without p-bits; with a single set of indices, alpha_index repeats color_index
+struct k3bc7Params {
+    uint32_t mode;
+    uint32_t partition;
+    uint32_t rotation;
+    uint32_t index_select;
+    uint8_t endpoints[3][2][4];
+    uint8_t pbits[3][2];
+    uint8_t color_index[16];
+    uint8_t alpha_index[16];
+};
+
+static void k3bc7_GetIndexBits(const k3bc7Mode* m, uint32_t index_select, uint32_t* color_bits, uint32_t* alpha_bits)
+{
+    if (m->index2_bits == 0) {
+        *color_bits = m->index_bits;
+        *alpha_bits = m->index_bits;
+    } else if (index_select) {
+        *color_bits = m->index2_bits;
+        *alpha_bits = m->index_bits;
+    } else {
+        *color_bits = m->index_bits;
+        *alpha_bits = m->index2_bits;
+    }
+}
+
+// Widens a value to 8 bits by repeating its top bits below it
+static inline uint32_t k3bc7_Unquantize(uint32_t value, uint32_t bits)
+{
+    value <<= 8 - bits;
+    return value | (value >> bits);
+}
+
+static inline uint32_t k3bc7_GetChannelBits(const k3bc7Mode* m, uint32_t channel)
+{
+    return (channel < 3) ? m->color_bits : m->alpha_bits;
+}
+
+static void k3bc7_ExpandEndpoint(const k3bc7Mode* m, const uint8_t* endpoint, uint32_t pbit, uint8_t* rgba)
+{
+    uint32_t has_pbit = (m->endpoint_pbits | m->shared_pbits) ? 1 : 0;
+    uint32_t c, bits;
+    for (c = 0; c < 4; c++) {
+        bits = k3bc7_GetChannelBits(m, c);
+        if (bits == 0) {
+            rgba[c] = 0xff;
+        } else {
+            rgba[c] = static_cast<uint8_t>(k3bc7_Unquantize((endpoint[c] << has_pbit) | (pbit & has_pbit), bits + has_pbit));
+        }
+    }
+}
+
+// Palette of one subset; entry k blends the endpoints by weights[k]
+typedef void (*k3bc7_palette_ptr)(const uint8_t* e0, const uint8_t* e1, const uint8_t* weights, uint32_t num_entries, uint8_t* palette);
+
+static void k3bc7_BuildPaletteScalar(const uint8_t* e0, const uint8_t* e1, const uint8_t* weights, uint32_t num_entries, uint8_t* palette)
+{
+    uint32_t k, c;
+    for (k = 0; k < num_entries; k++) {
+        for (c = 0; c < 4; c++) palette[4 * k + c] = static_cast<uint8_t>(k3bptc_Interpolate(e0[c], e1[c], weights[k]));
+    }
+}
+
+#if defined(K3_SIMD_X86)
+// 2 entries per register, a channel per 16 bit lane; the weighted sums stay below 2^15
+K3_TARGET_SSE41 static void k3bc7_BuildPaletteSSE41(const uint8_t* e0, const uint8_t* e1, const uint8_t* weights, uint32_t num_entries, uint8_t* palette)
+{
+    uint32_t k, e0_bits, e1_bits;
+    memcpy(&e0_bits, e0, sizeof(uint32_t));
+    memcpy(&e1_bits, e1, sizeof(uint32_t));
+    __m128i v_e0 = _mm_cvtepu8_epi16(_mm_set1_epi32(static_cast<int32_t>(e0_bits)));
+    __m128i v_e1 = _mm_cvtepu8_epi16(_mm_set1_epi32(static_cast<int32_t>(e1_bits)));
+    __m128i v_64 = _mm_set1_epi16(64);
+    __m128i v_32 = _mm_set1_epi16(32);
+    __m128i w, sum;
+    for (k = 0; k < num_entries; k += 2) {
+        w = _mm_set_epi16(weights[k + 1], weights[k + 1], weights[k + 1], weights[k + 1], weights[k], weights[k], weights[k], weights[k]);
+        sum = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(v_64, w), v_e0), _mm_mullo_epi16(w, v_e1));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, v_32), 6);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(palette + 4 * k), _mm_packus_epi16(sum, sum));
+    }
+}
+#endif
+
+static k3bc7_palette_ptr k3bc7_GetPaletteFunc()
+{
+#if defined(K3_SIMD_X86)
+    if (k3math_GetSimdLevel() != k3simdLevel::NONE) return k3bc7_BuildPaletteSSE41;
+#endif
+    return k3bc7_BuildPaletteScalar;
+}
+
+static bool k3bc7_Unpack(const k3BPTCBlock* src, k3bc7Params* params)
+{
+    k3bptcBitReader bits(src);
+    uint32_t mode_byte = static_cast<uint32_t>(src->lo & 0xff);
+    uint32_t s, e, c, i, pbit;
+    const k3bc7Mode* m;
+
+    if (mode_byte == 0) return false;
+    for (params->mode = 0; !(mode_byte & (1 << params->mode)); params->mode++);
+    m = &(k3bc7_modes[params->mode]);
+    bits.Read(params->mode + 1);
+    params->partition = bits.Read(m->partition_bits);
+    params->rotation = bits.Read(m->rotation_bits);
+    params->index_select = bits.Read(m->index_select_bits);
+
+    for (c = 0; c < 4; c++) {
+        for (s = 0; s < m->num_subsets; s++) {
+            for (e = 0; e < 2; e++) params->endpoints[s][e][c] = static_cast<uint8_t>(bits.Read(k3bc7_GetChannelBits(m, c)));
+        }
+    }
+    for (s = 0; s < m->num_subsets; s++) {
+        if (m->endpoint_pbits) {
+            params->pbits[s][0] = static_cast<uint8_t>(bits.Read(1));
+            params->pbits[s][1] = static_cast<uint8_t>(bits.Read(1));
+        } else {
+            pbit = (m->shared_pbits) ? bits.Read(1) : 0;
+            params->pbits[s][0] = static_cast<uint8_t>(pbit);
+            params->pbits[s][1] = static_cast<uint8_t>(pbit);
+        }
+    }
+
+    uint8_t* primary = (m->index2_bits && params->index_select) ? params->alpha_index : params->color_index;
+    uint8_t* secondary = (params->index_select) ? params->color_index : params->alpha_index;
+    for (i = 0; i < 16; i++) {
+        primary[i] = static_cast<uint8_t>(bits.Read(m->index_bits - k3bptc_IsAnchor(m->num_subsets, params->partition, i)));
+    }
+    if (m->index2_bits) {
+        for (i = 0; i < 16; i++) secondary[i] = static_cast<uint8_t>(bits.Read(m->index2_bits - (i == 0)));
+    } else {
+        memcpy(params->alpha_index, params->color_index, 16);
+    }
+    return true;
+}
+
+// Moves each anchor index into the first half of the palette by swapping its subset's endpoints
+static void k3bc7_FixAnchors(k3bc7Params* params)
+{
+    const k3bc7Mode* m = &(k3bc7_modes[params->mode]);
+    uint32_t color_bits, alpha_bits, s, i, c, anchor, mask;
+    uint32_t color_channels = (m->index2_bits) ? 3 : 4;
+    uint8_t t;
+
+    k3bc7_GetIndexBits(m, params->index_select, &color_bits, &alpha_bits);
+    for (s = 0; s < m->num_subsets; s++) {
+        anchor = k3bptc_GetAnchor(m->num_subsets, params->partition, s);
+        mask = k3bptc_GetSubsetMask(m->num_subsets, params->partition, s);
+        if (params->color_index[anchor] >> (color_bits - 1)) {
+            for (c = 0; c < color_channels; c++) {
+                t = params->endpoints[s][0][c];
+                params->endpoints[s][0][c] = params->endpoints[s][1][c];
+                params->endpoints[s][1][c] = t;
+            }
+            t = params->pbits[s][0];
+            params->pbits[s][0] = params->pbits[s][1];
+            params->pbits[s][1] = t;
+            for (i = 0; i < 16; i++) {
+                if (mask & (1 << i)) params->color_index[i] = static_cast<uint8_t>(((1 << color_bits) - 1) - params->color_index[i]);
+            }
+        }
+        if (m->index2_bits && (params->alpha_index[anchor] >> (alpha_bits - 1))) {
+            t = params->endpoints[s][0][3];
+            params->endpoints[s][0][3] = params->endpoints[s][1][3];
+            params->endpoints[s][1][3] = t;
+            for (i = 0; i < 16; i++) params->alpha_index[i] = static_cast<uint8_t>(((1 << alpha_bits) - 1) - params->alpha_index[i]);
+        }
+    }
+}
+
+static void k3bc7_Pack(k3bc7Params* params, k3BPTCBlock* dest)
+{
+    const k3bc7Mode* m = &(k3bc7_modes[params->mode]);
+    k3bptcBitWriter bits(dest);
+    uint32_t s, e, c, i;
+
+    k3bc7_FixAnchors(params);
+    bits.Write(1 << params->mode, params->mode + 1);
+    bits.Write(params->partition, m->partition_bits);
+    bits.Write(params->rotation, m->rotation_bits);
+    bits.Write(params->index_select, m->index_select_bits);
+    for (c = 0; c < 4; c++) {
+        for (s = 0; s < m->num_subsets; s++) {
+            for (e = 0; e < 2; e++) bits.Write(params->endpoints[s][e][c], k3bc7_GetChannelBits(m, c));
+        }
+    }
+    for (s = 0; s < m->num_subsets; s++) {
+        if (m->endpoint_pbits) {
+            bits.Write(params->pbits[s][0], 1);
+            bits.Write(params->pbits[s][1], 1);
+        } else if (m->shared_pbits) {
+            bits.Write(params->pbits[s][0], 1);
+        }
+    }
+
+    const uint8_t* primary = (m->index2_bits && params->index_select) ? params->alpha_index : params->color_index;
+    const uint8_t* secondary = (params->index_select) ? params->color_index : params->alpha_index;
+    for (i = 0; i < 16; i++) bits.Write(primary[i], m->index_bits - k3bptc_IsAnchor(m->num_subsets, params->partition, i));
+    if (m->index2_bits) {
+        for (i = 0; i < 16; i++) bits.Write(secondary[i], m->index2_bits - (i == 0));
+    }
+}
+
+// Decodes unpacked fields to pixels
+static void k3bc7_Decode(const k3bc7Params* params, uint8_t* dest)
+{
+    const k3bc7Mode* m = &(k3bc7_modes[params->mode]);
+    k3bc7_palette_ptr build_palette = k3bc7_GetPaletteFunc();
+    uint8_t color_palette[3][64];
+    uint8_t alpha_palette[3][64];
+    uint8_t e0[4], e1[4], t;
+    uint32_t color_bits, alpha_bits, s, i;
+    const uint8_t* alphas;
+
+    k3bc7_GetIndexBits(m, params->index_select, &color_bits, &alpha_bits);
+    for (s = 0; s < m->num_subsets; s++) {
+        k3bc7_ExpandEndpoint(m, params->endpoints[s][0], params->pbits[s][0], e0);
+        k3bc7_ExpandEndpoint(m, params->endpoints[s][1], params->pbits[s][1], e1);
+        build_palette(e0, e1, k3bptc_GetWeights(color_bits), 1 << color_bits, color_palette[s]);
+        if (m->index2_bits) build_palette(e0, e1, k3bptc_GetWeights(alpha_bits), 1 << alpha_bits, alpha_palette[s]);
+    }
+
+    for (i = 0; i < 16; i++) {
+        s = k3bptc_GetSubset(m->num_subsets, params->partition, i);
+        memcpy(dest + 4 * i, color_palette[s] + 4 * params->color_index[i], 4);
+        if (m->index2_bits) {
+            alphas = alpha_palette[s];
+            dest[4 * i + 3] = alphas[4 * params->alpha_index[i] + 3];
+        }
+        if (params->rotation) {
+            t = dest[4 * i + 3];
+            dest[4 * i + 3] = dest[4 * i + params->rotation - 1];
+            dest[4 * i + params->rotation - 1] = t;
+        }
+    }
+}
+
+// Quantizes both endpoints of a subset, picking the p-bits that land closest
+static void k3bc7_QuantizeEndpoints(const k3bc7Mode* m, uint32_t first_channel, uint32_t num_channels,
+    const float* ep0, const float* ep1, uint8_t* q0, uint8_t* q1, uint8_t* pbits)
+{
+    const float* ep[2] = { ep0, ep1 };
+    uint8_t* q[2] = { q0, q1 };
+    uint8_t trial[2][2][4];
+    float err[2][2];
+    float v, scale, d;
+    uint32_t e, p, j, c, bits, max;
+    int32_t iq;
+    uint32_t num_pbits = (m->endpoint_pbits | m->shared_pbits) ? 2 : 1;
+
+    for (e = 0; e < 2; e++) {
+        for (p = 0; p < num_pbits; p++) {
+            err[e][p] = 0.0f;
+            for (j = 0; j < num_channels; j++) {
+                c = first_channel + j;
+                bits = k3bc7_GetChannelBits(m, c);
+                max = (1 << bits) - 1;
+                v = ep[e][j];
+                v = (v < 0.0f) ? 0.0f : (v > 255.0f) ? 255.0f : v;
+                if (num_pbits == 2) {
+                    scale = ((1 << (bits + 1)) - 1) / 255.0f;
+                    iq = static_cast<int32_t>(floorf((v * scale - p) * 0.5f + 0.5f));
+                } else {
+                    scale = max / 255.0f;
+                    iq = static_cast<int32_t>(floorf(v * scale + 0.5f));
+                }
+                iq = (iq < 0) ? 0 : (iq > static_cast<int32_t>(max)) ? max : iq;
+                trial[e][p][c] = static_cast<uint8_t>(iq);
+                if (num_pbits == 2) d = k3bc7_Unquantize((iq << 1) | p, bits + 1) - v;
+                else d = k3bc7_Unquantize(iq, bits) - v;
+                err[e][p] += d * d;
+            }
+        }
+    }
+
+    for (e = 0; e < 2; e++) {
+        if (num_pbits == 1) p = 0;
+        else if (m->shared_pbits) p = (err[0][1] + err[1][1] < err[0][0] + err[1][0]) ? 1 : 0;
+        else p = (err[e][1] < err[e][0]) ? 1 : 0;
+        pbits[e] = static_cast<uint8_t>(p);
+        for (j = 0; j < num_channels; j++) q[e][first_channel + j] = trial[e][p][first_channel + j];
+    }
+}
+
+// Fits the endpoints and indices of one group of channels of one subset; returns the squared error
+static uint32_t k3bc7_FitChannels(const k3bc7Mode* m, const uint8_t* pixels8, const float* pixels, uint32_t mask,
+    uint32_t first_channel, uint32_t num_channels, uint32_t index_bits, uint32_t iterations,
+    uint8_t* q0, uint8_t* q1, uint8_t* pbits, uint8_t* indices)
+{
+    k3bc7_palette_ptr build_palette = k3bc7_GetPaletteFunc();
+    const uint8_t* weights = k3bptc_GetWeights(index_bits);
+    uint32_t num_entries = 1 << index_bits;
+    uint32_t best_err = UINT32_MAX, err, pixel_err, entry_err;
+    uint32_t i, j, k, iter, c;
+    int32_t d;
+    float ep0[4], ep1[4];
+    uint8_t tq0[4] = { 0, 0, 0, 0 }, tq1[4] = { 0, 0, 0, 0 }, tp[2];
+    uint8_t e0[4], e1[4], palette[64];
+    uint8_t tindices[16], pixel_weights[16];
+
+    k3bptc_FitLine(pixels, mask, first_channel, num_channels, ep0, ep1);
+    for (iter = 0; iter <= iterations; iter++) {
+        k3bc7_QuantizeEndpoints(m, first_channel, num_channels, ep0, ep1, tq0, tq1, tp);
+        k3bc7_ExpandEndpoint(m, tq0, tp[0], e0);
+        k3bc7_ExpandEndpoint(m, tq1, tp[1], e1);
+        build_palette(e0, e1, weights, num_entries, palette);
+
+        err = 0;
+        for (i = 0; i < 16; i++) {
+            if (!(mask & (1 << i))) continue;
+            pixel_err = UINT32_MAX;
+            for (k = 0; k < num_entries; k++) {
+                entry_err = 0;
+                for (j = 0; j < num_channels; j++) {
+                    c = first_channel + j;
+                    d = static_cast<int32_t>(palette[4 * k + c]) - pixels8[4 * i + c];
+                    entry_err += d * d;
+                }
+                if (entry_err < pixel_err) {
+                    pixel_err = entry_err;
+                    tindices[i] = static_cast<uint8_t>(k);
+                }
+            }
+            err += pixel_err;
+        }
+
+        if (err < best_err) {
+            best_err = err;
+            for (j = 0; j < num_channels; j++) {
+                q0[first_channel + j] = tq0[first_channel + j];
+                q1[first_channel + j] = tq1[first_channel + j];
+            }
+            pbits[0] = tp[0];
+            pbits[1] = tp[1];
+            for (i = 0; i < 16; i++) {
+                if (mask & (1 << i)) indices[i] = tindices[i];
+            }
+        }
+        if (best_err == 0 || iter == iterations) break;
+
+        for (i = 0; i < 16; i++) pixel_weights[i] = (mask & (1 << i)) ? weights[tindices[i]] : 0;
+        if (!k3bptc_RefitLine(pixels, mask, first_channel, num_channels, pixel_weights, ep0, ep1)) break;
+    }
+    return best_err;
+}
+
+// Encodes the block with one mode, partition and rotation; returns the squared error
+static uint32_t k3bc7_FitMode(const uint8_t* src, uint32_t mode, uint32_t partition, uint32_t rotation, uint32_t index_select,
+    uint32_t iterations, k3bc7Params* params)
+{
+    const k3bc7Mode* m = &(k3bc7_modes[mode]);
+    uint8_t pixels8[64];
+    float pixels[64];
+    uint32_t i, s, mask, color_bits, alpha_bits, err = 0;
+    int32_t d;
+    uint8_t t;
+
+    memcpy(pixels8, src, 64);
+    if (rotation) {
+        for (i = 0; i < 16; i++) {
+            t = pixels8[4 * i + 3];
+            pixels8[4 * i + 3] = pixels8[4 * i + rotation - 1];
+            pixels8[4 * i + rotation - 1] = t;
+        }
+    }
+    for (i = 0; i < 64; i++) pixels[i] = pixels8[i];
+
+    memset(params, 0, sizeof(k3bc7Params));
+    params->mode = mode;
+    params->partition = partition;
+    params->rotation = rotation;
+    params->index_select = index_select;
+    k3bc7_GetIndexBits(m, index_select, &color_bits, &alpha_bits);
+
+    for (s = 0; s < m->num_subsets; s++) {
+        mask = k3bptc_GetSubsetMask(m->num_subsets, partition, s);
+        if (m->index2_bits) {
+            err += k3bc7_FitChannels(m, pixels8, pixels, mask, 0, 3, color_bits, iterations,
+                params->endpoints[s][0], params->endpoints[s][1], params->pbits[s], params->color_index);
+            err += k3bc7_FitChannels(m, pixels8, pixels, mask, 3, 1, alpha_bits, iterations,
+                params->endpoints[s][0], params->endpoints[s][1], params->pbits[s], params->alpha_index);
+        } else {
+            err += k3bc7_FitChannels(m, pixels8, pixels, mask, 0, (m->alpha_bits) ? 4 : 3, color_bits, iterations,
+                params->endpoints[s][0], params->endpoints[s][1], params->pbits[s], params->color_index);
+            if (m->alpha_bits == 0) {
+                // modes without alpha decode it as opaque
+                for (i = 0; i < 16; i++) {
+                    if (!(mask & (1 << i))) continue;
+                    d = 0xff - pixels8[4 * i + 3];
+                    err += d * d;
+                }
+            }
+        }
+    }
+    if (m->index2_bits == 0) memcpy(params->alpha_index, params->color_index, 16);
+    return err;
+}
+
+static void k3bc7_TryMode(const uint8_t* src, uint32_t mode, uint32_t partition, uint32_t rotation, uint32_t index_select,
+    uint32_t iterations, k3bc7Params* best, uint32_t* best_err)
+{
+    k3bc7Params params;
+    uint32_t err;
+    if (*best_err == 0) return;
+    err = k3bc7_FitMode(src, mode, partition, rotation, index_select, iterations, &params);
+    if (err < *best_err) {
+        *best_err = err;
+        *best = params;
+    }
+}
+
+void k3imageObj::DecompressBC7Block(const k3BPTCBlock* src, uint8_t* dest)
+{
+    k3bc7Params params;
+    // reserved modes decode to transparent black
+    if (!k3bc7_Unpack(src, &params)) {
+        memset(dest, 0, 64);
+        return;
+    }
+    k3bc7_Decode(&params, dest);
+}
+
+void k3imageObj::DecompressBC7Block(const k3BPTCBlock* src, float* dest)
+{
+    uint8_t pixels[64];
+    uint32_t i;
+    DecompressBC7Block(src, pixels);
+    for (i = 0; i < 64; i++) dest[i] = pixels[i] / static_cast<float>(0xff);
+}
+
+// FAST fits only mode 6, plus mode 5 for blocks with alpha; NORMAL adds the best few 2 subset
+// partitions; BEST adds the 3 subset modes, rotations, and more partitions
+void k3imageObj::CompressBC7Block(const uint8_t* src, k3BPTCBlock* dest)
+{
+    k3compressQuality quality = _compress_quality;
+    uint32_t iterations = k3bptc_GetIterations(quality);
+    uint32_t num_partitions = (quality == k3compressQuality::BEST) ? 16 : 4;
+    uint32_t ranked[16];
+    uint32_t best_err = UINT32_MAX;
+    uint32_t i, r;
+    k3bc7Params best;
+    float pixels[64];
+    bool opaque = true;
+
+    memset(&best, 0, sizeof(k3bc7Params));
+    for (i = 0; i < 16; i++) {
+        if (src[4 * i + 3] != 0xff) opaque = false;
+    }
+    for (i = 0; i < 64; i++) pixels[i] = src[i];
+
+    k3bc7_TryMode(src, 6, 0, 0, 0, iterations, &best, &best_err);
+    if (!opaque) k3bc7_TryMode(src, 5, 0, 0, 0, iterations, &best, &best_err);
+
+    if (quality != k3compressQuality::FAST) {
+        if (opaque) {
+            k3bptc_RankPartitions(pixels, 3, 2, 64, num_partitions, ranked);
+            for (i = 0; i < num_partitions; i++) {
+                k3bc7_TryMode(src, 1, ranked[i], 0, 0, iterations, &best, &best_err);
+                k3bc7_TryMode(src, 3, ranked[i], 0, 0, iterations, &best, &best_err);
+            }
+        } else {
+            k3bptc_RankPartitions(pixels, 4, 2, 64, num_partitions, ranked);
+            for (i = 0; i < num_partitions; i++) k3bc7_TryMode(src, 7, ranked[i], 0, 0, iterations, &best, &best_err);
+        }
+    }
+
+    if (quality == k3compressQuality::BEST) {
+        if (opaque) {
+            k3bptc_RankPartitions(pixels, 3, 3, 16, num_partitions / 4, ranked);
+            for (i = 0; i < num_partitions / 4; i++) k3bc7_TryMode(src, 0, ranked[i], 0, 0, iterations, &best, &best_err);
+            k3bptc_RankPartitions(pixels, 3, 3, 64, num_partitions / 2, ranked);
+            for (i = 0; i < num_partitions / 2; i++) k3bc7_TryMode(src, 2, ranked[i], 0, 0, iterations, &best, &best_err);
+        }
+        for (r = 0; r < 4; r++) {
+            k3bc7_TryMode(src, 4, 0, r, 0, iterations, &best, &best_err);
+            k3bc7_TryMode(src, 4, 0, r, 1, iterations, &best, &best_err);
+            k3bc7_TryMode(src, 5, 0, r, 0, iterations, &best, &best_err);
+        }
+    }
+
+    k3bc7_Pack(&best, dest);
+}
+
+void k3imageObj::CompressBC7Block(const float* src, k3BPTCBlock* dest)
+{
+    uint8_t pixels[64];
+    uint32_t i;
+    float v;
+    for (i = 0; i < 64; i++) {
+        v = (src[i] < 0.0f) ? 0.0f : (src[i] > 1.0f) ? 1.0f : src[i];
+        pixels[i] = static_cast<uint8_t>(v * 0xff + 0.5);
+    }
+    CompressBC7Block(pixels, dest);
+}
+
+// ------------------------------------------------------------
+// BC6H, unsigned only
+
+// Endpoint values as stored; W and X are the endpoints of region 0, Y and Z those of region 1
+// In transformed modes X, Y and Z are stored as signed offsets from W
+enum k3bc6hValue : uint8_t {
+    K3_BC6H_RW, K3_BC6H_GW, K3_BC6H_BW,
+    K3_BC6H_RX, K3_BC6H_GX, K3_BC6H_BX,
+    K3_BC6H_RY, K3_BC6H_GY, K3_BC6H_BY,
+    K3_BC6H_RZ, K3_BC6H_GZ, K3_BC6H_BZ
+};
+
+// A run of bits of one value, written value[msb:lsb] as in the format spec; the first bit in the
+// stream is bit lsb, and ranges with msb < lsb are stored from the high bit down
+struct k3bc6hField {
+    uint8_t value;
+    uint8_t msb;
+    uint8_t lsb;
+};
+
+#define K3_BC6H_F(V, MSB, LSB) { K3_BC6H_##V, MSB, LSB }
+
+static const k3bc6hField k3bc6h_fields1[] = {
+    K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BY, 4, 4), K3_BC6H_F(BZ, 4, 4), K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0),
+    K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 4, 0), K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 4, 0),
+    K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 4, 0), K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 3, 0),
+    K3_BC6H_F(RY, 4, 0), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 4, 0), K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields2[] = {
+    K3_BC6H_F(GY, 5, 5), K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(GZ, 5, 5), K3_BC6H_F(RW, 6, 0), K3_BC6H_F(BZ, 0, 0),
+    K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 4, 4), K3_BC6H_F(GW, 6, 0), K3_BC6H_F(BY, 5, 5), K3_BC6H_F(BZ, 2, 2),
+    K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BW, 6, 0), K3_BC6H_F(BZ, 3, 3), K3_BC6H_F(BZ, 5, 5), K3_BC6H_F(BZ, 4, 4),
+    K3_BC6H_F(RX, 5, 0), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 5, 0), K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 5, 0),
+    K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 5, 0), K3_BC6H_F(RZ, 5, 0)
+};
+static const k3bc6hField k3bc6h_fields3[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 4, 0), K3_BC6H_F(RW, 10, 10),
+    K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 3, 0), K3_BC6H_F(GW, 10, 10), K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(GZ, 3, 0),
+    K3_BC6H_F(BX, 3, 0), K3_BC6H_F(BW, 10, 10), K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 4, 0),
+    K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 4, 0), K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields4[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 3, 0), K3_BC6H_F(RW, 10, 10),
+    K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 4, 0), K3_BC6H_F(GW, 10, 10), K3_BC6H_F(GZ, 3, 0),
+    K3_BC6H_F(BX, 3, 0), K3_BC6H_F(BW, 10, 10), K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 3, 0),
+    K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 3, 0), K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields5[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 3, 0), K3_BC6H_F(RW, 10, 10),
+    K3_BC6H_F(BY, 4, 4), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 3, 0), K3_BC6H_F(GW, 10, 10), K3_BC6H_F(BZ, 0, 0),
+    K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 4, 0), K3_BC6H_F(BW, 10, 10), K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 3, 0),
+    K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 3, 0), K3_BC6H_F(BZ, 4, 4), K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields6[] = {
+    K3_BC6H_F(RW, 8, 0), K3_BC6H_F(BY, 4, 4), K3_BC6H_F(GW, 8, 0), K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BW, 8, 0),
+    K3_BC6H_F(BZ, 4, 4), K3_BC6H_F(RX, 4, 0), K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 4, 0),
+    K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 4, 0), K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 3, 0),
+    K3_BC6H_F(RY, 4, 0), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 4, 0), K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields7[] = {
+    K3_BC6H_F(RW, 7, 0), K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(BY, 4, 4), K3_BC6H_F(GW, 7, 0), K3_BC6H_F(BZ, 2, 2),
+    K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BW, 7, 0), K3_BC6H_F(BZ, 3, 3), K3_BC6H_F(BZ, 4, 4), K3_BC6H_F(RX, 5, 0),
+    K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 4, 0), K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 4, 0),
+    K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 5, 0), K3_BC6H_F(RZ, 5, 0)
+};
+static const k3bc6hField k3bc6h_fields8[] = {
+    K3_BC6H_F(RW, 7, 0), K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(BY, 4, 4), K3_BC6H_F(GW, 7, 0), K3_BC6H_F(GY, 5, 5),
+    K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BW, 7, 0), K3_BC6H_F(GZ, 5, 5), K3_BC6H_F(BZ, 4, 4), K3_BC6H_F(RX, 4, 0),
+    K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 5, 0), K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 4, 0),
+    K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 4, 0), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 4, 0),
+    K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields9[] = {
+    K3_BC6H_F(RW, 7, 0), K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 4, 4), K3_BC6H_F(GW, 7, 0), K3_BC6H_F(BY, 5, 5),
+    K3_BC6H_F(GY, 4, 4), K3_BC6H_F(BW, 7, 0), K3_BC6H_F(BZ, 5, 5), K3_BC6H_F(BZ, 4, 4), K3_BC6H_F(RX, 4, 0),
+    K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 4, 0), K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(GZ, 3, 0),
+    K3_BC6H_F(BX, 5, 0), K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 4, 0), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(RZ, 4, 0),
+    K3_BC6H_F(BZ, 3, 3)
+};
+static const k3bc6hField k3bc6h_fields10[] = {
+    K3_BC6H_F(RW, 5, 0), K3_BC6H_F(GZ, 4, 4), K3_BC6H_F(BZ, 0, 0), K3_BC6H_F(BZ, 1, 1), K3_BC6H_F(BY, 4, 4),
+    K3_BC6H_F(GW, 5, 0), K3_BC6H_F(GY, 5, 5), K3_BC6H_F(BY, 5, 5), K3_BC6H_F(BZ, 2, 2), K3_BC6H_F(GY, 4, 4),
+    K3_BC6H_F(BW, 5, 0), K3_BC6H_F(GZ, 5, 5), K3_BC6H_F(BZ, 3, 3), K3_BC6H_F(BZ, 5, 5), K3_BC6H_F(BZ, 4, 4),
+    K3_BC6H_F(RX, 5, 0), K3_BC6H_F(GY, 3, 0), K3_BC6H_F(GX, 5, 0), K3_BC6H_F(GZ, 3, 0), K3_BC6H_F(BX, 5, 0),
+    K3_BC6H_F(BY, 3, 0), K3_BC6H_F(RY, 5, 0), K3_BC6H_F(RZ, 5, 0)
+};
+static const k3bc6hField k3bc6h_fields11[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 9, 0), K3_BC6H_F(GX, 9, 0),
+    K3_BC6H_F(BX, 9, 0)
+};
+static const k3bc6hField k3bc6h_fields12[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 8, 0), K3_BC6H_F(RW, 10, 10),
+    K3_BC6H_F(GX, 8, 0), K3_BC6H_F(GW, 10, 10), K3_BC6H_F(BX, 8, 0), K3_BC6H_F(BW, 10, 10)
+};
+static const k3bc6hField k3bc6h_fields13[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 7, 0), K3_BC6H_F(RW, 10, 11),
+    K3_BC6H_F(GX, 7, 0), K3_BC6H_F(GW, 10, 11), K3_BC6H_F(BX, 7, 0), K3_BC6H_F(BW, 10, 11)
+};
+static const k3bc6hField k3bc6h_fields14[] = {
+    K3_BC6H_F(RW, 9, 0), K3_BC6H_F(GW, 9, 0), K3_BC6H_F(BW, 9, 0), K3_BC6H_F(RX, 3, 0), K3_BC6H_F(RW, 10, 15),
+    K3_BC6H_F(GX, 3, 0), K3_BC6H_F(GW, 10, 15), K3_BC6H_F(BX, 3, 0), K3_BC6H_F(BW, 10, 15)
+};
+
+#undef K3_BC6H_F
+
+struct k3bc6hMode {
+    uint8_t mode_bits;
+    uint8_t num_mode_bits;
+    uint8_t num_regions;
+    uint8_t transformed;
+    uint8_t endpoint_bits;
+    uint8_t delta_bits[3];
+    const k3bc6hField* fields;
+    uint32_t num_fields;
+};
+
+#define K3_BC6H_MODE(BITS, NUM_BITS, REGIONS, XFORM, EP, DR, DG, DB, FIELDS) \
+    { BITS, NUM_BITS, REGIONS, XFORM, EP, { DR, DG, DB }, FIELDS, sizeof(FIELDS) / sizeof(FIELDS[0]) }
+
+// Modes 1 through 14 of the format spec
+static const uint32_t K3_BC6H_NUM_MODES = 14;
+static const k3bc6hMode k3bc6h_modes[K3_BC6H_NUM_MODES] = {
+    K3_BC6H_MODE(0x00, 2, 2, 1, 10, 5, 5, 5, k3bc6h_fields1),
+    K3_BC6H_MODE(0x01, 2, 2, 1, 7, 6, 6, 6, k3bc6h_fields2),
+    K3_BC6H_MODE(0x02, 5, 2, 1, 11, 5, 4, 4, k3bc6h_fields3),
+    K3_BC6H_MODE(0x06, 5, 2, 1, 11, 4, 5, 4, k3bc6h_fields4),
+    K3_BC6H_MODE(0x0a, 5, 2, 1, 11, 4, 4, 5, k3bc6h_fields5),
+    K3_BC6H_MODE(0x0e, 5, 2, 1, 9, 5, 5, 5, k3bc6h_fields6),
+    K3_BC6H_MODE(0x12, 5, 2, 1, 8, 6, 5, 5, k3bc6h_fields7),
+    K3_BC6H_MODE(0x16, 5, 2, 1, 8, 5, 6, 5, k3bc6h_fields8),
+    K3_BC6H_MODE(0x1a, 5, 2, 1, 8, 5, 5, 6, k3bc6h_fields9),
+    K3_BC6H_MODE(0x1e, 5, 2, 0, 6, 6, 6, 6, k3bc6h_fields10),
+    K3_BC6H_MODE(0x03, 5, 1, 0, 10, 10, 10, 10, k3bc6h_fields11),
+    K3_BC6H_MODE(0x07, 5, 1, 1, 11, 9, 9, 9, k3bc6h_fields12),
+    K3_BC6H_MODE(0x0b, 5, 1, 1, 12, 8, 8, 8, k3bc6h_fields13),
+    K3_BC6H_MODE(0x0f, 5, 1, 1, 16, 4, 4, 4, k3bc6h_fields14)
+};
+
+#undef K3_BC6H_MODE
+
+// A BC6H block with its fields unpacked; endpoints are absolute, W X Y Z
+struct k3bc6hParams {
+    uint32_t mode;
+    uint32_t partition;
+    int32_t endpoints[4][3];
+    uint8_t index[16];
+};
+
+// Scales a quantized endpoint up to 16 bits; interpolation runs at this precision
+static inline uint32_t k3bc6h_Unquantize(uint32_t value, uint32_t bits)
+{
+    if (bits >= 15) return value;
+    if (value == 0) return 0;
+    if (value == (1u << bits) - 1) return 0xffff;
+    return ((value << 16) + 0x8000) >> bits;
+}
+
+static inline int32_t k3bc6h_SignExtend(uint32_t value, uint32_t bits)
+{
+    return static_cast<int32_t>(value << (32 - bits)) >> (32 - bits);
+}
+
+// Palette of one region as half floats, 4 values per entry with the last unused; entry k blends
+// the unquantized endpoints by weights[k], then scales the result by 31 / 64 into half float range
+typedef void (*k3bc6h_palette_ptr)(const uint32_t* e0, const uint32_t* e1, const uint8_t* weights, uint32_t num_entries, uint16_t* palette);
+
+static void k3bc6h_BuildPaletteScalar(const uint32_t* e0, const uint32_t* e1, const uint8_t* weights, uint32_t num_entries, uint16_t* palette)
+{
+    uint32_t k, c;
+    for (k = 0; k < num_entries; k++) {
+        for (c = 0; c < 3; c++) palette[4 * k + c] = static_cast<uint16_t>((k3bptc_Interpolate(e0[c], e1[c], weights[k]) * 31) >> 6);
+        palette[4 * k + 3] = 0;
+    }
+}
+
+#if defined(K3_SIMD_X86)
+// An entry per register, a channel per 32 bit lane
+K3_TARGET_SSE41 static void k3bc6h_BuildPaletteSSE41(const uint32_t* e0, const uint32_t* e1, const uint8_t* weights, uint32_t num_entries, uint16_t* palette)
+{
+    uint32_t k;
+    __m128i v_e0 = _mm_setr_epi32(e0[0], e0[1], e0[2], 0);
+    __m128i v_e1 = _mm_setr_epi32(e1[0], e1[1], e1[2], 0);
+    __m128i v_64 = _mm_set1_epi32(64);
+    __m128i v_32 = _mm_set1_epi32(32);
+    __m128i v_31 = _mm_set1_epi32(31);
+    __m128i w, sum0, sum1;
+    for (k = 0; k < num_entries; k += 2) {
+        w = _mm_set1_epi32(weights[k]);
+        sum0 = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(v_64, w), v_e0), _mm_mullo_epi32(w, v_e1));
+        sum0 = _mm_srli_epi32(_mm_mullo_epi32(_mm_srli_epi32(_mm_add_epi32(sum0, v_32), 6), v_31), 6);
+        w = _mm_set1_epi32(weights[k + 1]);
+        sum1 = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(v_64, w), v_e0), _mm_mullo_epi32(w, v_e1));
+        sum1 = _mm_srli_epi32(_mm_mullo_epi32(_mm_srli_epi32(_mm_add_epi32(sum1, v_32), 6), v_31), 6);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(palette + 4 * k), _mm_packus_epi32(sum0, sum1));
+    }
+}
+#endif
+
+static k3bc6h_palette_ptr k3bc6h_GetPaletteFunc()
+{
+#if defined(K3_SIMD_X86)
+    if (k3math_GetSimdLevel() != k3simdLevel::NONE) return k3bc6h_BuildPaletteSSE41;
+#endif
+    return k3bc6h_BuildPaletteScalar;
+}
+
+static void k3bc6h_BuildRegionPalette(k3bc6h_palette_ptr build_palette, const k3bc6hMode* m, const int32_t* ep0, const int32_t* ep1,
+    uint16_t* palette)
+{
+    uint32_t e0[3], e1[3], c;
+    uint32_t index_bits = (m->num_regions == 2) ? 3 : 4;
+    for (c = 0; c < 3; c++) {
+        e0[c] = k3bc6h_Unquantize(ep0[c], m->endpoint_bits);
+        e1[c] = k3bc6h_Unquantize(ep1[c], m->endpoint_bits);
+    }
+    build_palette(e0, e1, k3bptc_GetWeights(index_bits), 1 << index_bits, palette);
+}
+
+static bool k3bc6h_Unpack(const k3BPTCBlock* src, k3bc6hParams* params)
+{
+    k3bptcBitReader bits(src);
+    uint32_t values[12] = { 0 };
+    uint32_t mode_bits, f, b, e, c, i, mask, index_bits;
+    const k3bc6hMode* m;
+    const k3bc6hField* field;
+
+    mode_bits = bits.Read(2);
+    if (mode_bits >= 2) mode_bits |= bits.Read(3) << 2;
+    for (params->mode = 0; params->mode < K3_BC6H_NUM_MODES; params->mode++) {
+        if (k3bc6h_modes[params->mode].mode_bits == mode_bits) break;
+    }
+    if (params->mode == K3_BC6H_NUM_MODES) return false;
+    m = &(k3bc6h_modes[params->mode]);
+
+    for (f = 0; f < m->num_fields; f++) {
+        field = &(m->fields[f]);
+        if (field->msb >= field->lsb) {
+            values[field->value] |= bits.Read(field->msb - field->lsb + 1) << field->lsb;
+        } else {
+            for (b = field->lsb; b >= field->msb; b--) values[field->value] |= bits.Read(1) << b;
+        }
+    }
+    params->partition = (m->num_regions == 2) ? bits.Read(5) : 0;
+    index_bits = (m->num_regions == 2) ? 3 : 4;
+    for (i = 0; i < 16; i++) {
+        params->index[i] = static_cast<uint8_t>(bits.Read(index_bits - k3bptc_IsAnchor(m->num_regions, params->partition, i)));
+    }
+
+    mask = (1 << m->endpoint_bits) - 1;
+    for (e = 0; e < 4; e++) {
+        for (c = 0; c < 3; c++) {
+            if (e == 0 || !m->transformed) {
+                params->endpoints[e][c] = values[3 * e + c];
+            } else {
+                params->endpoints[e][c] = (values[c] + k3bc6h_SignExtend(values[3 * e + c], m->delta_bits[c])) & mask;
+            }
+        }
+    }
+    return true;
+}
+
+static void k3bc6h_Pack(const k3bc6hParams* params, k3BPTCBlock* dest)
+{
+    const k3bc6hMode* m = &(k3bc6h_modes[params->mode]);
+    k3bptcBitWriter bits(dest);
+    uint32_t values[12] = { 0 };
+    uint32_t f, b, e, c, i, index_bits;
+    const k3bc6hField* field;
+
+    for (e = 0; e < 2u * m->num_regions; e++) {
+        for (c = 0; c < 3; c++) {
+            if (e == 0 || !m->transformed) values[3 * e + c] = params->endpoints[e][c];
+            else values[3 * e + c] = params->endpoints[e][c] - params->endpoints[0][c];
+        }
+    }
+
+    bits.Write(m->mode_bits, m->num_mode_bits);
+    for (f = 0; f < m->num_fields; f++) {
+        field = &(m->fields[f]);
+        if (field->msb >= field->lsb) {
+            bits.Write(values[field->value] >> field->lsb, field->msb - field->lsb + 1);
+        } else {
+            for (b = field->lsb; b >= field->msb; b--) bits.Write(values[field->value] >> b, 1);
+        }
+    }
+    if (m->num_regions == 2) bits.Write(params->partition, 5);
+    index_bits = (m->num_regions == 2) ? 3 : 4;
+    for (i = 0; i < 16; i++) bits.Write(params->index[i], index_bits - k3bptc_IsAnchor(m->num_regions, params->partition, i));
+}
+
+// Half float bits of a color channel, which BC6H treats as a 15 bit integer
+static uint32_t k3bc6h_ToHalf(float f)
+{
+    if (!(f > 0.0f)) return 0;
+    if (f >= 65504.0f) return 0x7bff;
+    return k3imageObj::ConvertFloat32ToFloat16(f);
+}
+
+// Endpoint that unquantizes closest to the half float value h
+static int32_t k3bc6h_Quantize(float h, uint32_t bits)
+{
+    uint32_t max = (1 << bits) - 1;
+    float u = h * (64.0f / 31.0f);
+    int32_t q;
+    if (u < 0.0f) u = 0.0f;
+    if (u > 65535.0f) u = 65535.0f;
+    if (bits >= 15) return static_cast<int32_t>(u + 0.5f);
+    q = static_cast<int32_t>(u * (max + 1) / 65536.0f);
+    if (q > static_cast<int32_t>(max)) q = max;
+    if (q < static_cast<int32_t>(max) &&
+        fabsf(k3bc6h_Unquantize(q + 1, bits) - u) < fabsf(k3bc6h_Unquantize(q, bits) - u)) q++;
+    return q;
+}
+
+// Encodes the block with one mode and partition; returns the squared error in half float steps,
+// or UINT64_MAX if the endpoints are too far apart for a transformed mode
+static uint64_t k3bc6h_FitMode(const float* pixels, const uint32_t* halfs, uint32_t mode, uint32_t partition,
+    uint32_t iterations, k3bc6hParams* params)
+{
+    const k3bc6hMode* m = &(k3bc6h_modes[mode]);
+    k3bc6h_palette_ptr build_palette = k3bc6h_GetPaletteFunc();
+    uint32_t index_bits = (m->num_regions == 2) ? 3 : 4;
+    uint32_t num_entries = 1 << index_bits;
+    const uint8_t* weights = k3bptc_GetWeights(index_bits);
+    uint64_t err = 0, region_err, best_err, pixel_err, entry_err;
+    uint32_t r, i, k, c, iter, mask, anchor;
+    int32_t d, t, limit;
+    int32_t q[2][3];
+    float ep0[4], ep1[4];
+    uint16_t palette[64];
+    uint8_t tindices[16], pixel_weights[16];
+
+    params->mode = mode;
+    params->partition = partition;
+    memset(params->endpoints, 0, sizeof(params->endpoints));
+    for (r = 0; r < m->num_regions; r++) {
+        mask = k3bptc_GetSubsetMask(m->num_regions, partition, r);
+        k3bptc_FitLine(pixels, mask, 0, 3, ep0, ep1);
+        best_err = UINT64_MAX;
+        for (iter = 0; iter <= iterations; iter++) {
+            for (c = 0; c < 3; c++) {
+                q[0][c] = k3bc6h_Quantize(ep0[c], m->endpoint_bits);
+                q[1][c] = k3bc6h_Quantize(ep1[c], m->endpoint_bits);
+            }
+            k3bc6h_BuildRegionPalette(build_palette, m, q[0], q[1], palette);
+
+            region_err = 0;
+            for (i = 0; i < 16; i++) {
+                if (!(mask & (1 << i))) continue;
+                pixel_err = UINT64_MAX;
+                for (k = 0; k < num_entries; k++) {
+                    entry_err = 0;
+                    for (c = 0; c < 3; c++) {
+                        d = static_cast<int32_t>(palette[4 * k + c]) - static_cast<int32_t>(halfs[4 * i + c]);
+                        entry_err += static_cast<uint64_t>(d * d);
+                    }
+                    if (entry_err < pixel_err) {
+                        pixel_err = entry_err;
+                        tindices[i] = static_cast<uint8_t>(k);
+                    }
+                }
+                region_err += pixel_err;
+            }
+
+            if (region_err < best_err) {
+                best_err = region_err;
+                memcpy(params->endpoints[2 * r], q[0], sizeof(q[0]));
+                memcpy(params->endpoints[2 * r + 1], q[1], sizeof(q[1]));
+                for (i = 0; i < 16; i++) {
+                    if (mask & (1 << i)) params->index[i] = tindices[i];
+                }
+            }
+            if (best_err == 0 || iter == iterations) break;
+
+            for (i = 0; i < 16; i++) pixel_weights[i] = (mask & (1 << i)) ? weights[tindices[i]] : 0;
+            if (!k3bptc_RefitLine(pixels, mask, 0, 3, pixel_weights, ep0, ep1)) break;
+        }
+        err += best_err;
+
+        anchor = k3bptc_GetAnchor(m->num_regions, partition, r);
+        if (params->index[anchor] >> (index_bits - 1)) {
+            for (c = 0; c < 3; c++) {
+                t = params->endpoints[2 * r][c];
+                params->endpoints[2 * r][c] = params->endpoints[2 * r + 1][c];
+                params->endpoints[2 * r + 1][c] = t;
+            }
+            for (i = 0; i < 16; i++) {
+                if (mask & (1 << i)) params->index[i] = static_cast<uint8_t>((num_entries - 1) - params->index[i]);
+            }
+        }
+    }
+
+    if (m->transformed) {
+        for (r = 1; r < 2u * m->num_regions; r++) {
+            for (c = 0; c < 3; c++) {
+                limit = 1 << (m->delta_bits[c] - 1);
+                d = params->endpoints[r][c] - params->endpoints[0][c];
+                if (d < -limit || d >= limit) return UINT64_MAX;
+            }
+        }
+    }
+    return err;
+}
+
+static void k3bc6h_TryMode(const float* pixels, const uint32_t* halfs, uint32_t mode, uint32_t partition,
+    uint32_t iterations, k3bc6hParams* best, uint64_t* best_err)
+{
+    k3bc6hParams params;
+    uint64_t err;
+    if (*best_err == 0) return;
+    err = k3bc6h_FitMode(pixels, halfs, mode, partition, iterations, &params);
+    if (err < *best_err) {
+        *best_err = err;
+        *best = params;
+    }
+}
+
+void k3imageObj::DecompressBC6HBlock(const k3BPTCBlock* src, float* dest)
+{
+    k3bc6hParams params;
+    k3bc6h_palette_ptr build_palette = k3bc6h_GetPaletteFunc();
+    uint16_t palette[2][64];
+    uint32_t r, i, c, s;
+    const k3bc6hMode* m;
+
+    // reserved modes decode to black
+    if (!k3bc6h_Unpack(src, &params)) {
+        for (i = 0; i < 16; i++) {
+            dest[4 * i + 0] = 0.0f;
+            dest[4 * i + 1] = 0.0f;
+            dest[4 * i + 2] = 0.0f;
+            dest[4 * i + 3] = 1.0f;
+        }
+        return;
+    }
+
+    m = &(k3bc6h_modes[params.mode]);
+    for (r = 0; r < m->num_regions; r++) {
+        k3bc6h_BuildRegionPalette(build_palette, m, params.endpoints[2 * r], params.endpoints[2 * r + 1], palette[r]);
+    }
+    for (i = 0; i < 16; i++) {
+        s = k3bptc_GetSubset(m->num_regions, params.partition, i);
+        for (c = 0; c < 3; c++) dest[4 * i + c] = ConvertFloat16ToFloat32(palette[s][4 * params.index[i] + c]);
+        dest[4 * i + 3] = 1.0f;
+    }
+}
+
+void k3imageObj::DecompressBC6HBlock(const k3BPTCBlock* src, uint8_t* dest)
+{
+    float pixels[64];
+    uint32_t i;
+    float v;
+    DecompressBC6HBlock(src, pixels);
+    for (i = 0; i < 64; i++) {
+        v = (pixels[i] > 1.0f) ? 1.0f : pixels[i];
+        dest[i] = static_cast<uint8_t>(v * 0xff + 0.5);
+    }
+}
+
+// FAST fits only the 1 region modes; NORMAL adds 2 region modes 1 and 10 over the best few
+// partitions; BEST tries every 2 region mode over more partitions
+// Colors are fit on their half float bits, which are close to logarithmic
+void k3imageObj::CompressBC6HBlock(const float* src, k3BPTCBlock* dest)
+{
+    k3compressQuality quality = _compress_quality;
+    uint32_t iterations = k3bptc_GetIterations(quality);
+    uint32_t num_partitions = (quality == k3compressQuality::BEST) ? 8 : 4;
+    uint32_t ranked[8];
+    uint32_t halfs[64];
+    float pixels[64];
+    uint64_t best_err = UINT64_MAX;
+    uint32_t i, c, mode;
+    k3bc6hParams best;
+
+    memset(&best, 0, sizeof(k3bc6hParams));
+    for (i = 0; i < 16; i++) {
+        for (c = 0; c < 3; c++) {
+            halfs[4 * i + c] = k3bc6h_ToHalf(src[4 * i + c]);
+            pixels[4 * i + c] = static_cast<float>(halfs[4 * i + c]);
+        }
+        halfs[4 * i + 3] = 0;
+        pixels[4 * i + 3] = 0.0f;
+    }
+
+    // mode 11 always fits, so best is always set
+    for (mode = 10; mode < K3_BC6H_NUM_MODES; mode++) k3bc6h_TryMode(pixels, halfs, mode, 0, iterations, &best, &best_err);
+
+    if (quality != k3compressQuality::FAST) {
+        k3bptc_RankPartitions(pixels, 3, 2, 32, num_partitions, ranked);
+        for (i = 0; i < num_partitions; i++) {
+            if (quality == k3compressQuality::BEST) {
+                for (mode = 0; mode < 10; mode++) k3bc6h_TryMode(pixels, halfs, mode, ranked[i], iterations, &best, &best_err);
+            } else {
+                k3bc6h_TryMode(pixels, halfs, 0, ranked[i], iterations, &best, &best_err);
+                k3bc6h_TryMode(pixels, halfs, 9, ranked[i], iterations, &best, &best_err);
+            }
+        }
+    }
+
+    k3bc6h_Pack(&best, dest);
+}
+
+void k3imageObj::CompressBC6HBlock(const uint8_t* src, k3BPTCBlock* dest)
+{
+    float pixels[64];
+    uint32_t i;
+    for (i = 0; i < 64; i++) pixels[i] = src[i] / static_cast<float>(0xff);
+    CompressBC6HBlock(pixels, dest);
+}
@@ -33,6 +33,8 @@ const uint32_t DDSCAPS2_CUBEMAP_POSITIVEZ = 0x00004000;
 const uint32_t DDSCAPS2_CUBEMAP_NEGATIVEZ = 0x00008000;
 const uint32_t DDSCAPS2_VOLUME = 0x00200000;
 
+const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x00000004;
+
 struct k3dds_format {
     uint32_t format_size;
     uint32_t flags;
@@ -239,14 +241,25 @@ struct k3DDSHeader10 {
     uint32_t misc_flag2;
 };
 
+// State of one load, from LoadHeaderInfo to EndLoad
+struct k3ddsLoad {
+    k3DDSHeader header;
+    k3DDSHeader10 header10;
+    k3fmt format;
+    uint32_t mip_levels;
+    uint32_t array_size;
+    bool cubemap;
+};
+
 // Globals
 k3image_file_handler_t k3DDSHandler = { k3dds_LoadHeaderInfo,
                                         k3dds_LoadData,
-                                        k3dds_SaveData };
-
-k3DDSHeader header;
-k3DDSHeader10 header10;
-k3fmt dds_format;
+                                        k3dds_SaveData,
+                                        k3dds_LoadSubresourceInfo,
+                                        k3dds_EndLoad,
+                                        NULL,
+                                        k3dds_LoadRegion,
+                                        k3dds_SaveSubresources };
 
 // Returns true if the mask has a contiguous set of bits set to 1
 // if true, returns the start and end bit positions
@@ -291,11 +304,14 @@ bool FindMaskRange(const uint32_t mask, int32_t& start, int32_t& length)
     return (cur_mask == 0);
 }
 
-void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
+void K3CALLBACK k3dds_LoadHeaderInfo(k3imageSource* source, void** context,
     uint32_t* width, uint32_t* height, uint32_t* depth, k3fmt* format)
 {
-    uint32_t start_pos = ftell(file_handle);
-    fread(&header, sizeof(k3DDSHeader), 1, file_handle);
+    uint32_t start_pos = source->GetPos();
+    k3ddsLoad* load = new k3ddsLoad;
+    k3DDSHeader& header = load->header;
+    k3DDSHeader10& header10 = load->header10;
+    if (source->Read(&header, sizeof(k3DDSHeader)) != sizeof(k3DDSHeader)) header.id = 0;
 
     //bool caps_exist          = (header.flags & DDSD_CAPS) ? true : false;
     bool height_exist = (header.flags & DDSD_HEIGHT) ? true : false;
@@ -310,7 +326,8 @@ void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
         //!caps_exist || !pixelformat_exist ||
         !width_exist || !height_exist ||
         header.pixel_format.format_size != sizeof(k3dds_format)) {
-        fseek(file_handle, start_pos, SEEK_SET);
+        source->SetPos(start_pos);
+        delete load;
         return;
     }
 
@@ -320,6 +337,9 @@ void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
     bool fourcc_exist = (header.pixel_format.flags & DDPF_FOURCC) ? true : false;
 
     if (!depth_exist) header.depth = 1;
+    load->mip_levels = (header.mipmap_count) ? header.mipmap_count : 1;
+    load->cubemap = (header.caps2 & DDSCAPS2_CUBEMAP) ? true : false;
+    load->array_size = (load->cubemap) ? 6 : 1;
 
     *width = header.width;
     *height = header.height;
@@ -342,7 +362,7 @@ void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
         case FOURCC_RGBA32F: *format = k3fmt::RGBA32_FLOAT; break;
         }
         if (header.pixel_format.fourcc == FOURCC_DX10) {
-            fread(&header10, sizeof(k3DDSHeader10), 1, file_handle);
+            if (source->Read(&header10, sizeof(k3DDSHeader10)) != sizeof(k3DDSHeader10)) header10.dx_format = k3DXFmt::UNKNOWN;
             switch (header10.dx_format) {
             case k3DXFmt::R32G32B32A32_FLOAT:   *format = k3fmt::RGBA32_FLOAT; break;
             case k3DXFmt::R32G32B32_FLOAT:      *format = k3fmt::RGB32_FLOAT; break;
@@ -352,7 +372,6 @@ void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
             case k3DXFmt::D32_FLOAT_S8X24_UINT: *format = k3fmt::D32_FLOAT_S8X24_UINT; break;
             case k3DXFmt::R10G10B10A2_UNORM:    *format = k3fmt::RGB10A2_UNORM; break;
             case k3DXFmt::R8G8B8A8_UNORM:       *format = k3fmt::RGBA8_UNORM; break;
-            case k3DXFmt::R8G8B8A8_UNORM_SRGB:  *format = k3fmt::RGBA8_UNORM; break;
             case k3DXFmt::R16G16_FLOAT:         *format = k3fmt::RG16_FLOAT; break;
             case k3DXFmt::R16G16_UNORM:         *format = k3fmt::RG16_UNORM; break;
             case k3DXFmt::D32_FLOAT:            *format = k3fmt::D32_FLOAT; break;
@@ -378,9 +397,27 @@ void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
             case k3DXFmt::R10G10B10_XR_BIAS_A2_UNORM: *format = k3fmt::RGB10A2_UNORM; break;
             case k3DXFmt::BC6H_UF16:            *format = k3fmt::BC6_UNORM; break;
             case k3DXFmt::BC7_UNORM:            *format = k3fmt::BC7_UNORM; break;
+            // k3fmt has no sRGB formats, so these load as their UNORM counterparts with the encoded
+            // values untouched; the caller has to know to treat them as sRGB, as GenerateMips does with srgb set
+            case k3DXFmt::R8G8B8A8_UNORM_SRGB:  *format = k3fmt::RGBA8_UNORM; break;
+            case k3DXFmt::B8G8R8A8_UNORM_SRGB:  *format = k3fmt::BGRA8_UNORM; break;
+            case k3DXFmt::B8G8R8X8_UNORM_SRGB:  *format = k3fmt::BGRX8_UNORM; break;
+            case k3DXFmt::BC1_UNORM_SRGB:       *format = k3fmt::BC1_UNORM; break;
+            case k3DXFmt::BC2_UNORM_SRGB:       *format = k3fmt::BC2_UNORM; break;
+            case k3DXFmt::BC3_UNORM_SRGB:       *format = k3fmt::BC3_UNORM; break;
+            case k3DXFmt::BC7_UNORM_SRGB:       *format = k3fmt::BC7_UNORM; break;
             default:                            *format = k3fmt::UNKNOWN; break;
             }
-            *depth = header10.array_size;
+            // arrays of 3d textures don't exist, so a volume always has a single array slice
+            if (header10.dx_dim == k3DXResource::TEXTURE3D) {
+                load->cubemap = false;
+                load->array_size = 1;
+            } else {
+                *depth = 1;
+                load->cubemap = (header10.misc_flag & DDS_RESOURCE_MISC_TEXTURECUBE) ? true : false;
+                load->array_size = (header10.array_size) ? header10.array_size : 1;
+                if (load->cubemap) load->array_size *= 6;
+            }
         }
     } else if (rgb_exist || alpha_exist) {
 
@@ -441,42 +478,145 @@ void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
     }
 
     if (*format == k3fmt::UNKNOWN) {
-        fseek(file_handle, start_pos, SEEK_SET);
+        source->SetPos(start_pos);
+        delete load;
         return;
     }
 
-    dds_format = *format;
+    // a mip count past the 1x1x1 level is malformed, so keep only the levels that can exist
+    uint32_t max_mip_levels = k3imageObj::GetNumMipLevels(*width, *height, *depth);
+    if (load->mip_levels > max_mip_levels) load->mip_levels = max_mip_levels;
+
+    load->format = *format;
+    *context = load;
+}
+
+void K3CALLBACK k3dds_LoadSubresourceInfo(k3imageSource* source, void* context, uint32_t* mip_levels, uint32_t* array_size, bool* cubemap)
+{
+    const k3ddsLoad* load = static_cast<const k3ddsLoad*>(context);
+    *mip_levels = load->mip_levels;
+    *array_size = load->array_size;
+    *cubemap = load->cubemap;
 }
 
-void K3CALLBACK k3dds_LoadData(FILE* file_handle, uint32_t pitch, uint32_t slice_pitch, void* data)
+void K3CALLBACK k3dds_LoadData(k3imageSource* source, void* context, uint32_t pitch, uint32_t slice_pitch, void* data)
 {
+    const k3ddsLoad* load = static_cast<const k3ddsLoad*>(context);
     uint8_t* bitmap = static_cast<uint8_t*>(data);
     uint8_t* bitmap_row;
-    uint32_t format_size = k3imageObj::GetFormatSize(dds_format);
-    uint32_t block_size = k3imageObj::GetFormatBlockSize(dds_format);
-    uint32_t row_size = ((header.width + block_size - 1) / block_size) * format_size;
-    //uint32_t image_size = k3imageObj::GetImageSize(header.width, header.height, header.depth, dds_format);
+    uint32_t format_size = k3imageObj::GetFormatSize(load->format);
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(load->format);
+    uint32_t width, height, depth, row_size;
+
+    // The file stores each array slice with its mips, largest first, all tightly packed
+    // Only the first subresource uses the pitches passed in
+    uint32_t array_slice, mip, slice, row;
+    for (array_slice = 0; array_slice < load->array_size; array_slice++) {
+        for (mip = 0; mip < load->mip_levels; mip++) {
+            width = load->header.width >> mip;
+            height = load->header.height >> mip;
+            depth = load->header.depth >> mip;
+            if (width == 0) width = 1;
+            if (height == 0) height = 1;
+            if (depth == 0) depth = 1;
+            row_size = ((width + block_size - 1) / block_size) * format_size;
+            if (array_slice != 0 || mip != 0) {
+                pitch = row_size;
+                slice_pitch = row_size * ((height + block_size - 1) / block_size);
+            }
+            for (slice = 0; slice < depth; slice++) {
+                if (pitch == row_size) {
+                    source->Read(bitmap, row_size * ((height + block_size - 1) / block_size));
+                } else {
+                    bitmap_row = bitmap;
+                    for (row = 0; row < height; row += block_size) {
+                        source->Read(bitmap_row, row_size);
+                        bitmap_row += pitch;
+                    }
+                }
+                bitmap += slice_pitch;
+            }
+        }
+    }
+}
+
+// The top level of the first array slice comes first in the file, so each row of blocks in the
+// region is a seek and a read
+void K3CALLBACK k3dds_LoadRegion(k3imageSource* source, void* context,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data)
+{
+    const k3ddsLoad* load = static_cast<const k3ddsLoad*>(context);
+    uint8_t* bitmap = static_cast<uint8_t*>(data);
+    uint32_t format_size = k3imageObj::GetFormatSize(load->format);
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(load->format);
+    uint32_t file_row_size = ((load->header.width + block_size - 1) / block_size) * format_size;
+    uint32_t file_slice_size = file_row_size * ((load->header.height + block_size - 1) / block_size);
+    uint32_t row_size = ((width + block_size - 1) / block_size) * format_size;
+    uint32_t block_rows = (height + block_size - 1) / block_size;
+    uint32_t start_pos = source->GetPos() + (y / block_size) * file_row_size + (x / block_size) * format_size;
 
     uint32_t slice, row;
-    for (slice = 0; slice < header.depth; slice++) {
-        bitmap_row = bitmap;
-        for (row = 0; row < header.height; row += block_size) {
-            fread(bitmap_row, 1, row_size, file_handle);
-            bitmap_row += pitch;
+    for (slice = 0; slice < depth; slice++) {
+        uint32_t slice_pos = start_pos + (z + slice) * file_slice_size;
+        if (row_size == file_row_size && pitch == row_size) {
+            source->SetPos(slice_pos);
+            source->Read(bitmap + slice * slice_pitch, row_size * block_rows);
+        } else {
+            for (row = 0; row < block_rows; row++) {
+                source->SetPos(slice_pos + row * file_row_size);
+                source->Read(bitmap + slice * slice_pitch + row * pitch, row_size);
+            }
         }
-        bitmap += slice_pitch;
     }
 }
 
-void K3CALLBACK k3dds_SaveData(FILE* file_handle,
-    uint32_t width, uint32_t height, uint32_t depth, 
-    uint32_t pitch, uint32_t slice_pitch, k3fmt format,
-    const void* data)
+void K3CALLBACK k3dds_EndLoad(void* context)
+{
+    delete static_cast<k3ddsLoad*>(context);
+}
+
+// DX10 header format of each format the legacy header is written with, for arrays, which only the
+// DX10 header can hold; the inverse of the mapping in k3dds_LoadHeaderInfo
+static k3DXFmt k3dds_GetDXFormat(k3fmt format)
+{
+    switch (format) {
+    case k3fmt::RGBA8_UNORM:   return k3DXFmt::R8G8B8A8_UNORM;
+    case k3fmt::BGRA8_UNORM:   return k3DXFmt::B8G8R8A8_UNORM;
+    case k3fmt::BGRX8_UNORM:   return k3DXFmt::B8G8R8X8_UNORM;
+    case k3fmt::RGB10A2_UNORM: return k3DXFmt::R10G10B10A2_UNORM;
+    case k3fmt::BGR5A1_UNORM:  return k3DXFmt::B5G5R5A1_UNORM;
+    case k3fmt::RG8_UNORM:     return k3DXFmt::R8G8_UNORM;
+    case k3fmt::RG16_UNORM:    return k3DXFmt::R16G16_UNORM;
+    case k3fmt::R8_UNORM:      return k3DXFmt::R8_UNORM;
+    case k3fmt::A8_UNORM:      return k3DXFmt::A8_UNORM;
+    case k3fmt::R16_UNORM:     return k3DXFmt::R16_UNORM;
+    case k3fmt::RGBA16_FLOAT:  return k3DXFmt::R16G16B16A16_FLOAT;
+    case k3fmt::RGBA32_FLOAT:  return k3DXFmt::R32G32B32A32_FLOAT;
+    case k3fmt::RG16_FLOAT:    return k3DXFmt::R16G16_FLOAT;
+    case k3fmt::RG32_FLOAT:    return k3DXFmt::R32G32_FLOAT;
+    case k3fmt::R16_FLOAT:     return k3DXFmt::R16_FLOAT;
+    case k3fmt::R32_FLOAT:     return k3DXFmt::R32_FLOAT;
+    case k3fmt::BC1_UNORM:     return k3DXFmt::BC1_UNORM;
+    case k3fmt::BC2_UNORM:     return k3DXFmt::BC2_UNORM;
+    case k3fmt::BC3_UNORM:     return k3DXFmt::BC3_UNORM;
+    case k3fmt::BC4_UNORM:     return k3DXFmt::BC4_UNORM;
+    case k3fmt::BC5_UNORM:     return k3DXFmt::BC5_UNORM;
+    default:                   return k3DXFmt::UNKNOWN;
+    }
+}
+
+// Writes the header, then each array slice with its mips, largest first, all tightly packed,
+// which is the layout k3dds_LoadData reads back
+static void k3dds_Save(FILE* file_handle, k3fmt format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap, const k3subresourceDesc* desc, const void* data)
 {
+    uint32_t width = desc[0].width;
+    uint32_t height = desc[0].height;
+    uint32_t depth = desc[0].depth;
     k3DDSHeader wheader = { 0 };
+    k3DDSHeader10 wheader10 = { k3DXFmt::UNKNOWN };
     k3fmt outputformat = k3fmt::UNKNOWN;
-    const uint8_t* bitmap;
-    uint32_t image_size;
 
     // Common DDS header fields
     wheader.id = FOURCC_DDS;
@@ -668,10 +808,52 @@ void K3CALLBACK k3dds_SaveData(FILE* file_handle,
         wheader.pixel_format.flags = DDPF_FOURCC;
         wheader.pixel_format.fourcc = FOURCC_ATI2;
         break;
+
+        // Formats which only exist in the DX10 extension header
+    case k3fmt::BC6_UNORM:
+        outputformat = k3fmt::BC6_UNORM;
+        wheader.pixel_format.flags = DDPF_FOURCC;
+        wheader.pixel_format.fourcc = FOURCC_DX10;
+        wheader10.dx_format = k3DXFmt::BC6H_UF16;
+        break;
+    case k3fmt::BC7_UNORM:
+        outputformat = k3fmt::BC7_UNORM;
+        wheader.pixel_format.flags = DDPF_FOURCC;
+        wheader.pixel_format.fourcc = FOURCC_DX10;
+        wheader10.dx_format = k3DXFmt::BC7_UNORM;
+        break;
     default:
         break;
     }
 
+    if (mip_levels > 1) {
+        wheader.flags |= DDSD_MIPMAPCOUNT;
+        wheader.mipmap_count = mip_levels;
+        wheader.caps1 |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+    if (cubemap) {
+        wheader.caps1 |= DDSCAPS_COMPLEX;
+        wheader.caps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX | DDSCAPS2_CUBEMAP_NEGATIVEX |
+            DDSCAPS2_CUBEMAP_POSITIVEY | DDSCAPS2_CUBEMAP_NEGATIVEY | DDSCAPS2_CUBEMAP_POSITIVEZ | DDSCAPS2_CUBEMAP_NEGATIVEZ;
+    }
+    // The legacy header holds a single texture or a single cube; anything more needs the DX10 header
+    uint32_t header_array_size = (cubemap) ? array_size / 6 : array_size;
+    if (header_array_size > 1 && wheader.pixel_format.fourcc != FOURCC_DX10 && outputformat != k3fmt::UNKNOWN) {
+        wheader10.dx_format = k3dds_GetDXFormat(outputformat);
+        if (wheader10.dx_format == k3DXFmt::UNKNOWN) {
+            k3error::Handler("Format has no DDS array form; only the first array slice was saved", "k3dds_SaveData");
+            array_size = (cubemap) ? 6 : 1;
+            header_array_size = 1;
+        } else {
+            wheader.pixel_format.flags = DDPF_FOURCC;
+            wheader.pixel_format.fourcc = FOURCC_DX10;
+            wheader.pixel_format.rbit_mask = 0;
+            wheader.pixel_format.gbit_mask = 0;
+            wheader.pixel_format.bbit_mask = 0;
+            wheader.pixel_format.abit_mask = 0;
+        }
+    }
+
     if (wheader.pixel_format.flags & DDPF_RGB) {
         uint32_t format_size = k3imageObj::GetFormatSize(outputformat);
         wheader.pixel_format.rgb_bit_count = 8 * format_size;
@@ -684,30 +866,55 @@ void K3CALLBACK k3dds_SaveData(FILE* file_handle,
         return;
     }
 
+    if (wheader.pixel_format.fourcc == FOURCC_DX10) {
+        wheader10.dx_dim = (depth > 1) ? k3DXResource::TEXTURE3D : k3DXResource::TEXTURE2D;
+        wheader10.array_size = header_array_size;
+        wheader10.misc_flag = (cubemap) ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+    }
+
+    fwrite(&wheader, 1, sizeof(k3DDSHeader), file_handle);
+    if (wheader.pixel_format.fourcc == FOURCC_DX10) fwrite(&wheader10, 1, sizeof(k3DDSHeader10), file_handle);
+
+    // compressed formats are laid out in rows of blocks
+    // The top level is the largest subresource, so one buffer holds any of them reformatted
     uint32_t format_size = k3imageObj::GetFormatSize(outputformat);
-    uint32_t dest_pitch = width * format_size;
-    uint32_t dest_slice_pitch = height * dest_pitch;
-    image_size = k3imageObj::GetImageSize(width, height, depth, outputformat);
-
-    bool inplace = (outputformat == format && pitch == dest_pitch && slice_pitch == dest_slice_pitch);
-    if (!inplace) {
-        uint8_t* bm = new uint8_t[image_size];
-        bitmap = bm;
-        if (bitmap == NULL) {
-            k3error::Handler("Out of memory", "k3dds_SaveData");
-            return;
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(outputformat);
+    uint8_t* bitmap = NULL;
+    uint32_t array_slice, mip;
+    for (array_slice = 0; array_slice < array_size; array_slice++) {
+        for (mip = 0; mip < mip_levels; mip++) {
+            const k3subresourceDesc* sub = &(desc[array_slice * mip_levels + mip]);
+            const uint8_t* src = static_cast<const uint8_t*>(data) + sub->offset;
+            uint32_t dest_pitch = ((sub->width + block_size - 1) / block_size) * format_size;
+            uint32_t dest_slice_pitch = ((sub->height + block_size - 1) / block_size) * dest_pitch;
+            uint32_t image_size = k3imageObj::GetImageSize(sub->width, sub->height, sub->depth, outputformat);
+
+            bool inplace = (outputformat == format && sub->pitch == dest_pitch && sub->slice_pitch == dest_slice_pitch);
+            if (!inplace) {
+                if (bitmap == NULL) bitmap = new uint8_t[k3imageObj::GetImageSize(width, height, depth, outputformat)];
+                k3imageObj::ReformatBuffer(sub->width, sub->height, sub->depth, sub->pitch, sub->slice_pitch, format, src,
+                    sub->width, sub->height, sub->depth, dest_pitch, dest_slice_pitch, outputformat, static_cast<void*>(bitmap),
+                    NULL);
+                src = bitmap;
+            }
+            fwrite(src, 1, image_size, file_handle);
         }
-
-        k3imageObj::ReformatBuffer(width, height, depth, pitch, slice_pitch, format, data,
-            width, height, depth, dest_pitch, dest_slice_pitch, outputformat, static_cast<void*>(bm),
-            NULL);
-    } else {
-        bitmap = static_cast<const uint8_t*>(data);
     }
 
-    fwrite(&wheader, 1, sizeof(k3DDSHeader), file_handle);
-    fwrite(bitmap, 1, image_size, file_handle);
+    if (bitmap) delete[] bitmap;
+}
 
-    if (!inplace) delete[] bitmap;
+void K3CALLBACK k3dds_SaveData(FILE* file_handle,
+    uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, k3fmt format,
+    const void* data)
+{
+    k3subresourceDesc desc = { 0, width, height, depth, pitch, slice_pitch };
+    k3dds_Save(file_handle, format, 1, 1, false, &desc, data);
+}
 
+void K3CALLBACK k3dds_SaveSubresources(FILE* file_handle, k3fmt format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap, const k3subresourceDesc* desc, const void* data)
+{
+    k3dds_Save(file_handle, format, mip_levels, array_size, cubemap, desc, data);
 }
@@ -0,0 +1,631 @@
+// k3 graphics library
+// BC1 to BC5 block compression for the NORMAL and BEST qualities; FAST stays in image.cpp
+
+#include "k3internal.h"
+#include "k3simd.h"
+
+// ------------------------------------------------------------
+// Index selection
+// Every kernel takes the first palette entry with the smallest squared distance, so all levels pick the same indices
+
+// Nearest of the first num_colors palette entries to each pixel, over rgb
+// Pixels in the transparent mask take index 3 and add no error; returns the summed squared error
+typedef uint32_t (*k3dxtc_colors_ptr)(const uint8_t* src, const uint8_t* palette, uint32_t num_colors, uint32_t transparent, uint32_t* pixmap);
+
+// Nearest of the 8 palette entries to each of the 16 values, which are spaced 4 bytes apart
+typedef uint32_t (*k3dxtc_alphas_ptr)(const uint8_t* src, const uint8_t* palette, uint64_t* alphamap);
+
+static uint32_t k3dxtc_SelectColorsScalar(const uint8_t* src, const uint8_t* palette, uint32_t num_colors, uint32_t transparent, uint32_t* pixmap)
+{
+    uint32_t i, p, c, sel, cur_err, pix_err, tot_err = 0;
+    int32_t d;
+    *pixmap = 0;
+
+    for (i = 0; i < 16; i++, src += 4) {
+        if (transparent & (1 << i)) {
+            *pixmap |= 0x3 << (2 * i);
+            continue;
+        }
+        pix_err = UINT32_MAX;
+        sel = 0;
+        for (p = 0; p < num_colors; p++) {
+            cur_err = 0;
+            for (c = 0; c < 3; c++) {
+                d = static_cast<int32_t>(src[c]) - static_cast<int32_t>(palette[4 * p + c]);
+                cur_err += d * d;
+            }
+            if (cur_err < pix_err) {
+                sel = p;
+                pix_err = cur_err;
+            }
+        }
+        *pixmap |= sel << (2 * i);
+        tot_err += pix_err;
+    }
+    return tot_err;
+}
+
+static uint32_t k3dxtc_SelectAlphasScalar(const uint8_t* src, const uint8_t* palette, uint64_t* alphamap)
+{
+    uint32_t i, p, sel, cur_err, pix_err, tot_err = 0;
+    int32_t d;
+    *alphamap = 0;
+
+    for (i = 0; i < 16; i++, src += 4) {
+        pix_err = UINT32_MAX;
+        sel = 0;
+        for (p = 0; p < 8; p++) {
+            d = static_cast<int32_t>(*src) - static_cast<int32_t>(palette[p]);
+            cur_err = d * d;
+            if (cur_err < pix_err) {
+                sel = p;
+                pix_err = cur_err;
+            }
+        }
+        *alphamap |= static_cast<uint64_t>(sel) << (3 * i);
+        tot_err += pix_err;
+    }
+    return tot_err;
+}
+
+#if defined(K3_SIMD_X86)
+// 4 pixels per step, a channel per 16 bit lane; madd and hadd sum the squared differences per pixel
+K3_TARGET_SSE41 static uint32_t k3dxtc_SelectColorsSSE41(const uint8_t* src, const uint8_t* palette, uint32_t num_colors, uint32_t transparent, uint32_t* pixmap)
+{
+    const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i lane_bits = _mm_set_epi32(8, 4, 2, 1);
+    __m128i v_src, lo, hi, pal, d_lo, d_hi, dist, less, skip, best, best_index;
+    __m128i total = _mm_setzero_si128();
+    uint32_t g, p, i, pal_bits;
+    uint32_t indices[16];
+
+    for (g = 0; g < 4; g++) {
+        v_src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16 * g));
+        lo = _mm_cvtepu8_epi16(v_src);
+        hi = _mm_cvtepu8_epi16(_mm_srli_si128(v_src, 8));
+        best = _mm_set1_epi32(INT32_MAX);
+        best_index = _mm_setzero_si128();
+        for (p = 0; p < num_colors; p++) {
+            memcpy(&pal_bits, palette + 4 * p, sizeof(uint32_t));
+            pal = _mm_cvtepu8_epi16(_mm_set1_epi32(static_cast<int32_t>(pal_bits)));
+            d_lo = _mm_and_si128(_mm_sub_epi16(lo, pal), rgb_mask);
+            d_hi = _mm_and_si128(_mm_sub_epi16(hi, pal), rgb_mask);
+            dist = _mm_hadd_epi32(_mm_madd_epi16(d_lo, d_lo), _mm_madd_epi16(d_hi, d_hi));
+            less = _mm_cmplt_epi32(dist, best);
+            best = _mm_min_epi32(dist, best);
+            best_index = _mm_blendv_epi8(best_index, _mm_set1_epi32(static_cast<int32_t>(p)), less);
+        }
+        skip = _mm_and_si128(_mm_set1_epi32(static_cast<int32_t>(transparent >> (4 * g))), lane_bits);
+        skip = _mm_cmpeq_epi32(skip, lane_bits);
+        best = _mm_andnot_si128(skip, best);
+        best_index = _mm_blendv_epi8(best_index, _mm_set1_epi32(3), skip);
+        total = _mm_add_epi32(total, best);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + 4 * g), best_index);
+    }
+    total = _mm_hadd_epi32(total, total);
+    total = _mm_hadd_epi32(total, total);
+
+    *pixmap = 0;
+    for (i = 0; i < 16; i++) *pixmap |= indices[i] << (2 * i);
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(total));
+}
+
+// All 16 values in one register; the nearest entry is tracked on the absolute difference, which orders
+// the same as its square. The last load starts at byte 45 so it never reads past the block
+K3_TARGET_SSE41 static uint32_t k3dxtc_SelectAlphasSSE41(const uint8_t* src, const uint8_t* palette, uint64_t* alphamap)
+{
+    const __m128i gather0 = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i gather1 = _mm_setr_epi8(-1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i gather2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1);
+    const __m128i gather3 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 3, 7, 11, 15);
+    const __m128i all_ones = _mm_set1_epi8(-1);
+    __m128i values, pal, diff, less, best, best_index, lo, hi, total;
+    uint32_t p, i;
+    uint8_t indices[16];
+
+    values = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), gather0);
+    values = _mm_or_si128(values, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), gather1));
+    values = _mm_or_si128(values, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), gather2));
+    values = _mm_or_si128(values, _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 45)), gather3));
+
+    best = all_ones;
+    best_index = _mm_setzero_si128();
+    for (p = 0; p < 8; p++) {
+        pal = _mm_set1_epi8(static_cast<char>(palette[p]));
+        diff = _mm_or_si128(_mm_subs_epu8(values, pal), _mm_subs_epu8(pal, values));
+        less = _mm_xor_si128(_mm_cmpeq_epi8(_mm_min_epu8(diff, best), best), all_ones);
+        best = _mm_min_epu8(diff, best);
+        best_index = _mm_blendv_epi8(best_index, _mm_set1_epi8(static_cast<char>(p)), less);
+    }
+
+    lo = _mm_cvtepu8_epi16(best);
+    hi = _mm_cvtepu8_epi16(_mm_srli_si128(best, 8));
+    total = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+    total = _mm_hadd_epi32(total, total);
+    total = _mm_hadd_epi32(total, total);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), best_index);
+    *alphamap = 0;
+    for (i = 0; i < 16; i++) *alphamap |= static_cast<uint64_t>(indices[i]) << (3 * i);
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(total));
+}
+#endif
+
+static k3dxtc_colors_ptr k3dxtc_GetColorsFunc()
+{
+#if defined(K3_SIMD_X86)
+    if (k3math_GetSimdLevel() != k3simdLevel::NONE) return k3dxtc_SelectColorsSSE41;
+#endif
+    return k3dxtc_SelectColorsScalar;
+}
+
+static k3dxtc_alphas_ptr k3dxtc_GetAlphasFunc()
+{
+#if defined(K3_SIMD_X86)
+    if (k3math_GetSimdLevel() != k3simdLevel::NONE) return k3dxtc_SelectAlphasSSE41;
+#endif
+    return k3dxtc_SelectAlphasScalar;
+}
+
+// ------------------------------------------------------------
+// BC1 colors
+// Colors are fit as floats from 0 to 255, and every candidate is scored on the palette the decoder builds
+
+// Position of each index between color0 and color1, in 4 and 3 color mode
+static const float k3dxtc_weights4[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const float k3dxtc_weights3[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+static const uint32_t k3dxtc_color_shift[3] = { 11, 5, 0 };
+static const uint32_t k3dxtc_color_max[3] = { 0x1f, 0x3f, 0x1f };
+
+static uint16_t k3dxtc_QuantizeColor(const float* color)
+{
+    uint32_t c, q, out = 0;
+    float v;
+    for (c = 0; c < 3; c++) {
+        v = color[c] * (k3dxtc_color_max[c] / 255.0f) + 0.5f;
+        q = (v > 0.0f) ? static_cast<uint32_t>(v) : 0;
+        if (q > k3dxtc_color_max[c]) q = k3dxtc_color_max[c];
+        out |= q << k3dxtc_color_shift[c];
+    }
+    return static_cast<uint16_t>(out);
+}
+
+// Scores the endpoints in the mode for num_colors, swapping them into the order that selects it
+// 3 color mode only exists with alpha, and then needs every transparent pixel on index 3
+static bool k3dxtc_TryColors(k3dxtc_colors_ptr select, const uint8_t* src, uint16_t color0, uint16_t color1,
+    uint32_t num_colors, bool allow_alpha, uint32_t transparent, k3DXT1Block* best, uint32_t* best_err)
+{
+    k3DXT1Block block;
+    uint8_t palette[16];
+    uint32_t err;
+    uint16_t t;
+
+    if ((num_colors == 4) == (color0 < color1)) {
+        t = color0;
+        color0 = color1;
+        color1 = t;
+    }
+    block.color0 = color0;
+    block.color1 = color1;
+    k3imageObj::DecompressDXT1Palette(&block, palette, allow_alpha);
+    if (!allow_alpha || color0 > color1) {
+        if (transparent) return false;
+        num_colors = 4;
+    } else {
+        num_colors = 3;
+    }
+    err = select(src, palette, num_colors, transparent, &(block.pixmap));
+    if (err < *best_err) {
+        *best = block;
+        *best_err = err;
+        return true;
+    }
+    return false;
+}
+
+// Principal axis of the colors in mask, by power iteration on their covariance
+// Returns false when the colors are all the same
+static bool k3dxtc_PrincipalAxis(const float* colors, uint32_t mask, float* mean, float* axis)
+{
+    float cov[3][3] = { { 0.0f } };
+    float d[3], next[3], count = 0.0f, len;
+    uint32_t i, j, k, iter;
+
+    mean[0] = 0.0f; mean[1] = 0.0f; mean[2] = 0.0f;
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        for (j = 0; j < 3; j++) mean[j] += colors[3 * i + j];
+        count += 1.0f;
+    }
+    for (j = 0; j < 3; j++) mean[j] /= count;
+
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        for (j = 0; j < 3; j++) d[j] = colors[3 * i + j] - mean[j];
+        for (j = 0; j < 3; j++) {
+            for (k = 0; k < 3; k++) cov[j][k] += d[j] * d[k];
+        }
+    }
+
+    // start from the channel with the most variance
+    k = 0;
+    for (j = 1; j < 3; j++) {
+        if (cov[j][j] > cov[k][k]) k = j;
+    }
+    for (j = 0; j < 3; j++) axis[j] = cov[k][j];
+    for (iter = 0; iter < 8; iter++) {
+        len = 0.0f;
+        for (j = 0; j < 3; j++) {
+            next[j] = cov[j][0] * axis[0] + cov[j][1] * axis[1] + cov[j][2] * axis[2];
+            len += next[j] * next[j];
+        }
+        if (len == 0.0f) return false;
+        len = 1.0f / sqrtf(len);
+        for (j = 0; j < 3; j++) axis[j] = next[j] * len;
+    }
+    return true;
+}
+
+// Least squares endpoints for the weights the pixmap picked; false if they can't be solved for
+static bool k3dxtc_RefitColors(const float* colors, uint32_t mask, uint32_t pixmap, const float* weights, float* ep0, float* ep1)
+{
+    float a = 0.0f, b = 0.0f, c = 0.0f, det, s, t;
+    float x[3] = { 0.0f, 0.0f, 0.0f };
+    float y[3] = { 0.0f, 0.0f, 0.0f };
+    uint32_t i, j;
+
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        t = weights[(pixmap >> (2 * i)) & 0x3];
+        s = 1.0f - t;
+        a += s * s;
+        b += s * t;
+        c += t * t;
+        for (j = 0; j < 3; j++) {
+            x[j] += s * colors[3 * i + j];
+            y[j] += t * colors[3 * i + j];
+        }
+    }
+    det = a * c - b * b;
+    if (det < 1e-6f) return false;
+    det = 1.0f / det;
+    for (j = 0; j < 3; j++) {
+        ep0[j] = (c * x[j] - b * y[j]) * det;
+        ep1[j] = (a * y[j] - b * x[j]) * det;
+    }
+    return true;
+}
+
+// Orders the colors along the axis, then tries every way to split them into runs that each take one
+// palette weight, in order; keeps the least squares endpoints of the split with the smallest residual
+static void k3dxtc_ClusterFit(const float* colors, uint32_t mask, const float* mean, const float* axis,
+    uint32_t num_colors, float* ep0, float* ep1)
+{
+    static const float run_weights4[4] = { 0.0f, 1.0f / 3.0f, 2.0f / 3.0f, 1.0f };
+    static const float run_weights3[4] = { 0.0f, 0.5f, 1.0f, 1.0f };
+    const float* run_weights = (num_colors == 4) ? run_weights4 : run_weights3;
+    float proj[16], sums[17][3], run_sums[4][3];
+    float a, b, c, det, s, t, err, best_err = FLT_MAX;
+    float x[3], y[3], e0[3], e1[3];
+    uint32_t order[16], run_counts[4], bounds[5];
+    uint32_t n = 0, i, j, k, r, ch, tmp;
+
+    for (i = 0; i < 16; i++) {
+        if (!(mask & (1 << i))) continue;
+        proj[n] = 0.0f;
+        for (ch = 0; ch < 3; ch++) proj[n] += (colors[3 * i + ch] - mean[ch]) * axis[ch];
+        order[n] = i;
+        // insertion sort by projection
+        for (j = n; j > 0 && proj[j - 1] > proj[j]; j--) {
+            t = proj[j]; proj[j] = proj[j - 1]; proj[j - 1] = t;
+            tmp = order[j]; order[j] = order[j - 1]; order[j - 1] = tmp;
+        }
+        n++;
+    }
+
+    for (ch = 0; ch < 3; ch++) sums[0][ch] = 0.0f;
+    for (i = 0; i < n; i++) {
+        for (ch = 0; ch < 3; ch++) sums[i + 1][ch] = sums[i][ch] + colors[3 * order[i] + ch];
+    }
+
+    bounds[0] = 0;
+    bounds[4] = n;
+    for (i = 0; i <= n; i++) {
+        for (j = i; j <= n; j++) {
+            for (k = (num_colors == 4) ? j : n; k <= n; k++) {
+                bounds[1] = i; bounds[2] = j; bounds[3] = k;
+                a = 0.0f; b = 0.0f; c = 0.0f;
+                for (ch = 0; ch < 3; ch++) { x[ch] = 0.0f; y[ch] = 0.0f; }
+                for (r = 0; r < 4; r++) {
+                    run_counts[r] = bounds[r + 1] - bounds[r];
+                    if (run_counts[r] == 0) continue;
+                    t = run_weights[r];
+                    s = 1.0f - t;
+                    a += run_counts[r] * s * s;
+                    b += run_counts[r] * s * t;
+                    c += run_counts[r] * t * t;
+                    for (ch = 0; ch < 3; ch++) {
+                        run_sums[r][ch] = sums[bounds[r + 1]][ch] - sums[bounds[r]][ch];
+                        x[ch] += s * run_sums[r][ch];
+                        y[ch] += t * run_sums[r][ch];
+                    }
+                }
+                det = a * c - b * b;
+                if (det < 1e-6f) continue;
+                det = 1.0f / det;
+                // residual, less the sum of the squared colors which is the same for every split
+                err = 0.0f;
+                for (ch = 0; ch < 3; ch++) {
+                    e0[ch] = (c * x[ch] - b * y[ch]) * det;
+                    e1[ch] = (a * y[ch] - b * x[ch]) * det;
+                    err += a * e0[ch] * e0[ch] + 2.0f * b * e0[ch] * e1[ch] + c * e1[ch] * e1[ch];
+                    err -= 2.0f * (e0[ch] * x[ch] + e1[ch] * y[ch]);
+                }
+                if (err < best_err) {
+                    best_err = err;
+                    for (ch = 0; ch < 3; ch++) {
+                        ep0[ch] = e0[ch];
+                        ep1[ch] = e1[ch];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Nudges each channel of each endpoint a level up or down for as long as that lowers the error
+static void k3dxtc_NudgeColors(k3dxtc_colors_ptr select, const uint8_t* src, uint32_t num_colors, bool allow_alpha,
+    uint32_t transparent, k3DXT1Block* best, uint32_t* best_err)
+{
+    uint32_t pass, e, c, field;
+    int32_t dir;
+    uint16_t color[2];
+    bool improved = true;
+
+    for (pass = 0; pass < 8 && improved; pass++) {
+        improved = false;
+        for (e = 0; e < 2; e++) {
+            for (c = 0; c < 3; c++) {
+                for (dir = -1; dir <= 1; dir += 2) {
+                    color[0] = best->color0;
+                    color[1] = best->color1;
+                    field = (color[e] >> k3dxtc_color_shift[c]) & k3dxtc_color_max[c];
+                    if ((dir < 0 && field == 0) || (dir > 0 && field == k3dxtc_color_max[c])) continue;
+                    field += dir;
+                    color[e] &= ~(k3dxtc_color_max[c] << k3dxtc_color_shift[c]);
+                    color[e] |= field << k3dxtc_color_shift[c];
+                    if (k3dxtc_TryColors(select, src, color[0], color[1], num_colors, allow_alpha, transparent, best, best_err)) improved = true;
+                }
+            }
+        }
+    }
+}
+
+// Endpoints from the extent of the colors along their principal axis, refit by least squares; BEST also
+// starts from a cluster fit, refits until the error stops dropping, and then nudges the endpoints
+static void k3dxtc_FitColors(k3dxtc_colors_ptr select, const uint8_t* src, const float* colors, uint32_t num_colors,
+    bool allow_alpha, uint32_t transparent, k3compressQuality quality, k3DXT1Block* best, uint32_t* best_err)
+{
+    const float* weights = (num_colors == 4) ? k3dxtc_weights4 : k3dxtc_weights3;
+    uint32_t mask = ~transparent & 0xffff;
+    uint32_t max_refits = (quality == k3compressQuality::BEST) ? 4 : 1;
+    uint32_t i, c, refit;
+    float mean[3], axis[3], ep0[3], ep1[3], t, t_min = FLT_MAX, t_max = -FLT_MAX;
+    k3DXT1Block fit;
+    uint32_t fit_err = UINT32_MAX;
+
+    if (!k3dxtc_PrincipalAxis(colors, mask, mean, axis)) {
+        k3dxtc_TryColors(select, src, k3dxtc_QuantizeColor(mean), k3dxtc_QuantizeColor(mean), num_colors, allow_alpha, transparent, &fit, &fit_err);
+    } else {
+        for (i = 0; i < 16; i++) {
+            if (!(mask & (1 << i))) continue;
+            t = 0.0f;
+            for (c = 0; c < 3; c++) t += (colors[3 * i + c] - mean[c]) * axis[c];
+            if (t < t_min) t_min = t;
+            if (t > t_max) t_max = t;
+        }
+        for (c = 0; c < 3; c++) {
+            ep0[c] = mean[c] + t_min * axis[c];
+            ep1[c] = mean[c] + t_max * axis[c];
+        }
+        k3dxtc_TryColors(select, src, k3dxtc_QuantizeColor(ep0), k3dxtc_QuantizeColor(ep1), num_colors, allow_alpha, transparent, &fit, &fit_err);
+
+        if (quality == k3compressQuality::BEST) {
+            k3dxtc_ClusterFit(colors, mask, mean, axis, num_colors, ep0, ep1);
+            k3dxtc_TryColors(select, src, k3dxtc_QuantizeColor(ep0), k3dxtc_QuantizeColor(ep1), num_colors, allow_alpha, transparent, &fit, &fit_err);
+        }
+    }
+
+    // the refit solves for the weights of the chosen indices, so it follows any swap TryColors made
+    for (refit = 0; refit < max_refits && fit_err != UINT32_MAX; refit++) {
+        if (!k3dxtc_RefitColors(colors, mask, fit.pixmap, weights, ep0, ep1)) break;
+        if (!k3dxtc_TryColors(select, src, k3dxtc_QuantizeColor(ep0), k3dxtc_QuantizeColor(ep1), num_colors, allow_alpha, transparent, &fit, &fit_err)) break;
+    }
+
+    if (quality == k3compressQuality::BEST && fit_err != UINT32_MAX) {
+        k3dxtc_NudgeColors(select, src, num_colors, allow_alpha, transparent, &fit, &fit_err);
+    }
+
+    if (fit_err < *best_err) {
+        *best = fit;
+        *best_err = fit_err;
+    }
+}
+
+// With alpha allowed, pixels under half alpha are transparent and force 3 color mode; otherwise both
+// modes are tried
+void k3imageObj::FitDXT1Block(const uint8_t* src, k3DXT1Block* dest, bool allow_alpha, k3compressQuality quality)
+{
+    k3dxtc_colors_ptr select = k3dxtc_GetColorsFunc();
+    float colors[48];
+    uint32_t i, c, transparent = 0;
+    uint32_t best_err = UINT32_MAX;
+
+    for (i = 0; i < 16; i++) {
+        for (c = 0; c < 3; c++) colors[3 * i + c] = src[4 * i + c];
+        if (allow_alpha && src[4 * i + 3] < 0x80) transparent |= 1 << i;
+    }
+
+    if (transparent == 0xffff) {
+        dest->color0 = 0;
+        dest->color1 = 0;
+        dest->pixmap = 0xffffffff;
+        return;
+    }
+
+    if (!transparent) k3dxtc_FitColors(select, src, colors, 4, allow_alpha, 0, quality, dest, &best_err);
+    if (allow_alpha) k3dxtc_FitColors(select, src, colors, 3, allow_alpha, transparent, quality, dest, &best_err);
+}
+
+// ------------------------------------------------------------
+// BC4 values, also the alpha of BC3 and both channels of BC5
+
+// The palette DecompressATI1NBlock builds
+static void k3dxtc_AlphaPalette(uint8_t alpha0, uint8_t alpha1, uint8_t* palette)
+{
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    if (alpha0 > alpha1) {
+        k3imageObj::InterpolateUnorm8(1, &(palette[0]), &(palette[1]), 6, &(palette[2]));
+    } else {
+        k3imageObj::InterpolateUnorm8(1, &(palette[0]), &(palette[1]), 4, &(palette[2]));
+        palette[6] = 0x00;
+        palette[7] = 0xff;
+    }
+}
+
+static bool k3dxtc_TryAlphas(k3dxtc_alphas_ptr select, const uint8_t* src, uint8_t alpha0, uint8_t alpha1,
+    uint64_t* best, uint32_t* best_err)
+{
+    uint8_t palette[8];
+    uint64_t alphamap;
+    uint32_t err;
+
+    k3dxtc_AlphaPalette(alpha0, alpha1, palette);
+    err = select(src, palette, &alphamap);
+    if (err < *best_err) {
+        *best = (alphamap << 16) | (static_cast<uint64_t>(alpha1) << 8) | alpha0;
+        *best_err = err;
+        return true;
+    }
+    return false;
+}
+
+static uint8_t k3dxtc_QuantizeAlpha(float alpha)
+{
+    if (alpha <= 0.0f) return 0x00;
+    if (alpha >= 255.0f) return 0xff;
+    return static_cast<uint8_t>(alpha + 0.5f);
+}
+
+// Least squares endpoints for the indices in the block; the fixed 0 and 255 entries are left out
+static bool k3dxtc_RefitAlphas(const uint8_t* src, uint64_t block, uint8_t* alpha0, uint8_t* alpha1)
+{
+    bool six = (block & 0xff) <= ((block >> 8) & 0xff);
+    uint64_t alphamap = block >> 16;
+    float a = 0.0f, b = 0.0f, c = 0.0f, x = 0.0f, y = 0.0f, det, s, t;
+    uint32_t i, index;
+
+    for (i = 0; i < 16; i++) {
+        index = static_cast<uint32_t>((alphamap >> (3 * i)) & 0x7);
+        if (six && index >= 6) continue;
+        if (index < 2) t = static_cast<float>(index);
+        else t = (index - 1) / ((six) ? 5.0f : 7.0f);
+        s = 1.0f - t;
+        a += s * s;
+        b += s * t;
+        c += t * t;
+        x += s * src[4 * i];
+        y += t * src[4 * i];
+    }
+    det = a * c - b * b;
+    if (det < 1e-6f) return false;
+    det = 1.0f / det;
+    *alpha0 = k3dxtc_QuantizeAlpha((c * x - b * y) * det);
+    *alpha1 = k3dxtc_QuantizeAlpha((a * y - b * x) * det);
+    return true;
+}
+
+// Fits both the 8 value mode, alpha0 > alpha1, and the 6 value mode with 0 and 255, each from the range
+// of the values and then refit by least squares; BEST also searches around the range and nudges the result
+void k3imageObj::FitATI1NBlock(const uint8_t* src, uint64_t* dest, k3compressQuality quality)
+{
+    k3dxtc_alphas_ptr select = k3dxtc_GetAlphasFunc();
+    uint32_t max_refits = (quality == k3compressQuality::BEST) ? 4 : 1;
+    uint32_t best_err = UINT32_MAX;
+    uint32_t i, mode, refit, pass;
+    int32_t d0, d1, dir, v0, v1;
+    uint8_t lo = 0xff, hi = 0x00, lo6 = 0xff, hi6 = 0x00, alpha0, alpha1, v;
+    uint64_t fit;
+    uint32_t fit_err;
+    bool improved;
+
+    for (i = 0; i < 16; i++) {
+        v = src[4 * i];
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+        if (v != 0x00 && v != 0xff) {
+            if (v < lo6) lo6 = v;
+            if (v > hi6) hi6 = v;
+        }
+    }
+    if (lo6 > hi6) {
+        lo6 = 0x00;
+        hi6 = 0x00;
+    }
+
+    for (mode = 0; mode < 2; mode++) {
+        fit_err = UINT32_MAX;
+        fit = 0;
+        if (mode == 0) {
+            k3dxtc_TryAlphas(select, src, hi, lo, &fit, &fit_err);
+            if (quality == k3compressQuality::BEST) {
+                for (d0 = -4; d0 <= 4; d0++) {
+                    for (d1 = -4; d1 <= 4; d1++) {
+                        v0 = hi + d0;
+                        v1 = lo + d1;
+                        if (v0 < 0 || v0 > 0xff || v1 < 0 || v1 > 0xff || v0 <= v1) continue;
+                        k3dxtc_TryAlphas(select, src, static_cast<uint8_t>(v0), static_cast<uint8_t>(v1), &fit, &fit_err);
+                    }
+                }
+            }
+        } else {
+            k3dxtc_TryAlphas(select, src, lo6, hi6, &fit, &fit_err);
+        }
+
+        for (refit = 0; refit < max_refits; refit++) {
+            if (!k3dxtc_RefitAlphas(src, fit, &alpha0, &alpha1)) break;
+            // keep the mode the refit was made for
+            if ((mode == 0) == (alpha0 <= alpha1)) {
+                v = alpha0;
+                alpha0 = alpha1;
+                alpha1 = v;
+            }
+            if (mode == 0 && alpha0 == alpha1) break;
+            if (!k3dxtc_TryAlphas(select, src, alpha0, alpha1, &fit, &fit_err)) break;
+        }
+
+        if (fit_err < best_err) {
+            *dest = fit;
+            best_err = fit_err;
+        }
+    }
+
+    if (quality == k3compressQuality::BEST) {
+        improved = true;
+        for (pass = 0; pass < 8 && improved && best_err; pass++) {
+            improved = false;
+            for (i = 0; i < 2; i++) {
+                for (dir = -1; dir <= 1; dir += 2) {
+                    v0 = static_cast<int32_t>(*dest & 0xff);
+                    v1 = static_cast<int32_t>((*dest >> 8) & 0xff);
+                    if (i == 0) v0 += dir;
+                    else v1 += dir;
+                    if (v0 < 0 || v0 > 0xff || v1 < 0 || v1 > 0xff) continue;
+                    if (k3dxtc_TryAlphas(select, src, static_cast<uint8_t>(v0), static_cast<uint8_t>(v1), dest, &best_err)) improved = true;
+                }
+            }
+        }
+    }
+}
@@ -3,6 +3,7 @@
 // Date: 10/10/2021
 
 #include "k3internal.h"
+#include "k3pixel.h"
 #include "ddshandler.h"
 #include "pnghandler.h"
 #include "jpghandler.h"
@@ -41,6 +42,29 @@ K3API k3image k3imageObj::Create()
     return img;
 }
 
+// Reformats every subresource img has from the matching one of src, whose data is src_data
+static void k3image_ReformatSubresources(k3image img, k3image src, const void* src_data, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    const uint8_t* src_bytes = static_cast<const uint8_t*>(src_data);
+    uint8_t* dest_data = static_cast<uint8_t*>(img->MapForWrite());
+    if (dest_data == NULL) return;
+    k3fmt src_format = src->GetFormat();
+    k3fmt dest_format = img->GetFormat();
+    k3subresourceDesc s, d;
+    uint32_t slice, mip;
+    for (slice = 0; slice < img->GetArraySize(); slice++) {
+        for (mip = 0; mip < img->GetMipLevels(); mip++) {
+            src->GetSubresourceDesc(mip, slice, &s);
+            img->GetSubresourceDesc(mip, slice, &d);
+            k3imageObj::ReformatBuffer(s.width, s.height, s.depth, s.pitch, s.slice_pitch, src_format, src_bytes + s.offset,
+                d.width, d.height, d.depth, d.pitch, d.slice_pitch, dest_format, dest_data + d.offset,
+                transform, x_addr_mode, y_addr_mode, z_addr_mode);
+        }
+    }
+    img->Unmap();
+}
+
 K3API void k3imageObj::ReformatFromImage(k3image img, k3image src,
     uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
     k3fmt dest_format, const float* transform,
@@ -54,7 +78,16 @@ K3API void k3imageObj::ReformatFromImage(k3image img, k3image src,
     k3fmt src_format = src->GetFormat();
     const void* src_data = src->MapForRead();
 
-    if (src_data) {
+    if (src_data && src->GetNumSubresources() > 1) {
+        if (dest_width == 0) dest_width = src_width;
+        if (dest_height == 0) dest_height = src_height;
+        if (dest_depth == 0) dest_depth = src_depth;
+        if (dest_format == k3fmt::UNKNOWN) dest_format = src_format;
+        bool keep_mips = (src_width == dest_width && src_height == dest_height && src_depth == dest_depth && transform == NULL);
+        img->SetDimensions(dest_width, dest_height, dest_depth, dest_format,
+            (keep_mips) ? src->GetMipLevels() : 1, src->GetArraySize(), src->IsCubemap());
+        k3image_ReformatSubresources(img, src, src_data, transform, x_addr_mode, y_addr_mode, z_addr_mode);
+    } else if (src_data) {
         k3imageObj::ReformatFromMemory(img, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_format, src_data,
             dest_width, dest_height, dest_depth, dest_format, transform, x_addr_mode, y_addr_mode, z_addr_mode);
     }
@@ -67,12 +100,11 @@ K3API void k3imageObj::ReformatFromFile(k3image img, const char* file_name,
     k3fmt dest_format, const float* transform,
     k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
 {
-    FILE* file_handle;
-    fopen_s(&file_handle,  file_name, "rb");
-    if (file_handle == NULL) {
+    k3imageSource source(file_name);
+    if (!source.IsValid()) {
         k3error::Handler("File not found", "ReformatFromFile");
     } else {
-        ReformatFromFileHandle(img, file_handle, dest_width, dest_height, dest_depth,
+        ReformatFromSource(img, &source, dest_width, dest_height, dest_depth,
             dest_format, transform, x_addr_mode, y_addr_mode, z_addr_mode);
     }
 }
@@ -81,22 +113,129 @@ K3API void k3imageObj::ReformatFromFileHandle(k3image img, FILE* file_handle,
     uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
     k3fmt dest_format, const float* transform,
     k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    k3imageSource source(file_handle);
+    ReformatFromSource(img, &source, dest_width, dest_height, dest_depth,
+        dest_format, transform, x_addr_mode, y_addr_mode, z_addr_mode);
+}
+
+K3API void k3imageObj::ReformatRegionFromFile(k3image img, const char* file_name,
+    uint32_t src_x, uint32_t src_y, uint32_t src_z, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    k3fmt dest_format, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    k3imageSource source(file_name);
+    if (!source.IsValid()) {
+        k3error::Handler("File not found", "ReformatRegionFromFile");
+    } else {
+        ReformatRegionFromSource(img, &source, src_x, src_y, src_z, src_width, src_height, src_depth,
+            dest_width, dest_height, dest_depth, dest_format, transform, x_addr_mode, y_addr_mode, z_addr_mode);
+    }
+}
+
+K3API void k3imageObj::ReformatRegionFromFileHandle(k3image img, FILE* file_handle,
+    uint32_t src_x, uint32_t src_y, uint32_t src_z, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    k3fmt dest_format, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    k3imageSource source(file_handle);
+    ReformatRegionFromSource(img, &source, src_x, src_y, src_z, src_width, src_height, src_depth,
+        dest_width, dest_height, dest_depth, dest_format, transform, x_addr_mode, y_addr_mode, z_addr_mode);
+}
+
+K3API void k3imageObj::ReformatFromEncodedMemory(k3image img, const void* data, uint32_t size,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    k3fmt dest_format, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    k3imageSource source(data, size);
+    ReformatFromSource(img, &source, dest_width, dest_height, dest_depth,
+        dest_format, transform, x_addr_mode, y_addr_mode, z_addr_mode);
+}
+
+static bool k3image_SameLayout(k3image a, k3image b)
+{
+    if (a->GetFormat() != b->GetFormat() || a->GetMipLevels() != b->GetMipLevels() ||
+        a->GetArraySize() != b->GetArraySize()) return false;
+    k3subresourceDesc a_desc, b_desc;
+    uint32_t slice, mip;
+    for (slice = 0; slice < a->GetArraySize(); slice++) {
+        for (mip = 0; mip < a->GetMipLevels(); mip++) {
+            a->GetSubresourceDesc(mip, slice, &a_desc);
+            b->GetSubresourceDesc(mip, slice, &b_desc);
+            if (memcmp(&a_desc, &b_desc, sizeof(k3subresourceDesc))) return false;
+        }
+    }
+    return true;
+}
+
+// Files with more than one subresource are read in the handler's packed layout, straight into img
+// when it has that layout, and then reformatted one subresource at a time
+// Mips are kept when the size is unchanged; otherwise only the top mip of each array slice is reformatted
+static void k3image_LoadSubresources(k3image img, k3image_file_handler_t* fh, k3imageSource* source, void* context,
+    uint32_t src_width, uint32_t src_height, uint32_t src_depth, k3fmt src_format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    k3fmt dest_format, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    bool keep_mips = (src_width == dest_width && src_height == dest_height && src_depth == dest_depth && transform == NULL);
+    k3image packed = k3imageObj::Create();
+    packed->SetDimensions(src_width, src_height, src_depth, src_format, mip_levels, array_size, cubemap);
+    img->SetDimensions(dest_width, dest_height, dest_depth, dest_format, (keep_mips) ? mip_levels : 1, array_size, cubemap);
+
+    if (k3image_SameLayout(img, packed)) {
+        void* data = img->MapForWrite();
+        if (data) {
+            fh->LoadData(source, context, img->GetPitch(), img->GetSlicePitch(), data);
+            img->Unmap();
+        }
+        return;
+    }
+
+    void* packed_data = packed->MapForWrite();
+    fh->LoadData(source, context, packed->GetPitch(), packed->GetSlicePitch(), packed_data);
+    k3image_ReformatSubresources(img, packed, packed_data, transform, x_addr_mode, y_addr_mode, z_addr_mode);
+}
+
+K3API void k3imageObj::ReformatFromSource(k3image img, k3imageSource* source,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    k3fmt dest_format, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
 {
     uint32_t src_width, src_height, src_depth;
     k3fmt src_format = k3fmt::UNKNOWN;
     uint8_t* src_data_byte_ptr = NULL;
     void* src_data;
+    void* context = NULL;
     uint32_t fhi;
 
     for (fhi = 0; fhi < _num_file_handlers; fhi++) {
-        _fh[fhi]->LoadHeaderInfo(file_handle, &src_width, &src_height, &src_depth, &src_format);
+        _fh[fhi]->LoadHeaderInfo(source, &context, &src_width, &src_height, &src_depth, &src_format);
         if (src_format != k3fmt::UNKNOWN) break;
     }
     if (src_format != k3fmt::UNKNOWN) {
+        k3image_file_handler_t* fh = _fh[fhi];
         if (dest_width == 0) dest_width = src_width;
         if (dest_height == 0) dest_height = src_height;
         if (dest_depth == 0) dest_depth = src_depth;
         if (dest_format == k3fmt::UNKNOWN) dest_format = src_format;
+        uint32_t mip_levels = 1;
+        uint32_t array_size = 1;
+        bool cubemap = false;
+        if (fh->LoadSubresourceInfo) fh->LoadSubresourceInfo(source, context, &mip_levels, &array_size, &cubemap);
+        if (mip_levels > 1 || array_size > 1) {
+            k3image_LoadSubresources(img, fh, source, context, src_width, src_height, src_depth, src_format,
+                mip_levels, array_size, cubemap, dest_width, dest_height, dest_depth, dest_format, transform,
+                x_addr_mode, y_addr_mode, z_addr_mode);
+            if (fh->EndLoad) fh->EndLoad(context);
+            return;
+        }
+        if (fh->LoadScaledSize && (dest_width < src_width || dest_height < src_height)) {
+            fh->LoadScaledSize(source, context, dest_width, dest_height, &src_width, &src_height);
+        }
         uint32_t src_format_size = k3imageObj::GetFormatSize(src_format);
         uint32_t dest_format_size = k3imageObj::GetFormatSize(dest_format);
         img->SetDimensions(dest_width, dest_height, dest_depth, dest_format);
@@ -118,7 +257,8 @@ K3API void k3imageObj::ReformatFromFileHandle(k3image img, FILE* file_handle,
             src_data = static_cast<void*>(src_data_byte_ptr);
         } // if( inplace )
 
-        _fh[fhi]->LoadData(file_handle, src_pitch, src_slice_pitch, src_data);
+        fh->LoadData(source, context, src_pitch, src_slice_pitch, src_data);
+        if (fh->EndLoad) fh->EndLoad(context);
 
         if (inplace) {
             if (src_format != dest_format) k3imageObj::ReformatBuffer(src_width, src_height, src_depth,
@@ -138,6 +278,121 @@ K3API void k3imageObj::ReformatFromFileHandle(k3image img, FILE* file_handle,
     } // if (src_format != k3fmt::UNKNOWN)
 }
 
+// For handlers without LoadRegion: reads the whole file in the handler's packed layout, and copies
+// the box out of the top level of the first array slice
+static void k3image_CopyRegionFromFile(k3image_file_handler_t* fh, k3imageSource* source, void* context,
+    uint32_t file_width, uint32_t file_height, uint32_t file_depth, k3fmt format,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data)
+{
+    uint32_t mip_levels = 1;
+    uint32_t array_size = 1;
+    bool cubemap = false;
+    if (fh->LoadSubresourceInfo) fh->LoadSubresourceInfo(source, context, &mip_levels, &array_size, &cubemap);
+    k3image file = k3imageObj::Create();
+    file->SetDimensions(file_width, file_height, file_depth, format, mip_levels, array_size, cubemap);
+    uint8_t* file_data = static_cast<uint8_t*>(file->MapForWrite());
+    uint32_t file_pitch = file->GetPitch();
+    uint32_t file_slice_pitch = file->GetSlicePitch();
+    fh->LoadData(source, context, file_pitch, file_slice_pitch, file_data);
+
+    uint32_t format_size = k3imageObj::GetFormatSize(format);
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(format);
+    uint32_t row_size = ((width + block_size - 1) / block_size) * format_size;
+    uint32_t block_rows = (height + block_size - 1) / block_size;
+    const uint8_t* src = file_data + z * file_slice_pitch + (y / block_size) * file_pitch + (x / block_size) * format_size;
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    uint32_t slice, row;
+    for (slice = 0; slice < depth; slice++) {
+        for (row = 0; row < block_rows; row++) {
+            memcpy(dst + slice * slice_pitch + row * pitch, src + slice * file_slice_pitch + row * file_pitch, row_size);
+        }
+    }
+    file->Unmap();
+}
+
+K3API void k3imageObj::ReformatRegionFromSource(k3image img, k3imageSource* source,
+    uint32_t src_x, uint32_t src_y, uint32_t src_z, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    k3fmt dest_format, const float* transform,
+    k3texAddr x_addr_mode, k3texAddr y_addr_mode, k3texAddr z_addr_mode)
+{
+    uint32_t file_width, file_height, file_depth;
+    k3fmt src_format = k3fmt::UNKNOWN;
+    uint8_t* src_data_byte_ptr = NULL;
+    void* src_data;
+    void* context = NULL;
+    uint32_t fhi;
+
+    for (fhi = 0; fhi < _num_file_handlers; fhi++) {
+        _fh[fhi]->LoadHeaderInfo(source, &context, &file_width, &file_height, &file_depth, &src_format);
+        if (src_format != k3fmt::UNKNOWN) break;
+    }
+    if (src_format == k3fmt::UNKNOWN) return;
+    k3image_file_handler_t* fh = _fh[fhi];
+
+    if (src_width == 0 && src_x < file_width) src_width = file_width - src_x;
+    if (src_height == 0 && src_y < file_height) src_height = file_height - src_y;
+    if (src_depth == 0 && src_z < file_depth) src_depth = file_depth - src_z;
+    uint32_t src_format_size = k3imageObj::GetFormatSize(src_format);
+    uint32_t src_block_size = k3imageObj::GetFormatBlockSize(src_format);
+    if (src_x >= file_width || src_y >= file_height || src_z >= file_depth ||
+        src_width == 0 || src_height == 0 || src_depth == 0 ||
+        src_width > file_width - src_x || src_height > file_height - src_y || src_depth > file_depth - src_z) {
+        k3error::Handler("Region is outside the image", "ReformatRegionFromSource");
+        if (fh->EndLoad) fh->EndLoad(context);
+        return;
+    }
+    if ((src_x % src_block_size) || (src_y % src_block_size)) {
+        k3error::Handler("Region does not start on a block", "ReformatRegionFromSource");
+        if (fh->EndLoad) fh->EndLoad(context);
+        return;
+    }
+
+    if (dest_width == 0) dest_width = src_width;
+    if (dest_height == 0) dest_height = src_height;
+    if (dest_depth == 0) dest_depth = src_depth;
+    if (dest_format == k3fmt::UNKNOWN) dest_format = src_format;
+    img->SetDimensions(dest_width, dest_height, dest_depth, dest_format);
+
+    // The region goes straight into img unless it has to be resized or converted to pixels of another size
+    bool inplace = (src_width == dest_width && src_height == dest_height && src_depth == dest_depth && transform == NULL &&
+        (src_format == dest_format || (src_block_size == 1 && k3imageObj::GetFormatBlockSize(dest_format) == 1 &&
+            src_format_size == k3imageObj::GetFormatSize(dest_format))));
+    uint32_t src_pitch, src_slice_pitch;
+    if (inplace) {
+        src_pitch = img->GetPitch();
+        src_slice_pitch = img->GetSlicePitch();
+        src_data = img->MapForWrite();
+    } else {
+        src_pitch = ((src_width + src_block_size - 1) / src_block_size) * src_format_size;
+        src_slice_pitch = src_pitch * ((src_height + src_block_size - 1) / src_block_size);
+        src_data_byte_ptr = new uint8_t[src_depth * src_slice_pitch];
+        src_data = static_cast<void*>(src_data_byte_ptr);
+    }
+
+    if (fh->LoadRegion) {
+        fh->LoadRegion(source, context, src_x, src_y, src_z, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_data);
+    } else {
+        k3image_CopyRegionFromFile(fh, source, context, file_width, file_height, file_depth, src_format,
+            src_x, src_y, src_z, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_data);
+    }
+    if (fh->EndLoad) fh->EndLoad(context);
+
+    if (inplace) {
+        if (src_format != dest_format) k3imageObj::ReformatBuffer(src_width, src_height, src_depth,
+            src_pitch, src_slice_pitch, src_format, src_data,
+            dest_width, dest_height, dest_depth, src_pitch, src_slice_pitch, dest_format, src_data, transform,
+            x_addr_mode, y_addr_mode, z_addr_mode);
+        img->Unmap();
+    } else {
+        k3imageObj::ReformatFromMemory(img, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_format, src_data,
+            dest_width, dest_height, dest_depth, dest_format, transform,
+            x_addr_mode, y_addr_mode, z_addr_mode);
+        delete[] src_data_byte_ptr;
+    }
+}
+
 K3API void k3imageObj::ReformatFromMemory(k3image img, uint32_t src_width, uint32_t src_height, uint32_t src_depth,
     uint32_t src_pitch, uint32_t src_slice_pitch,
     k3fmt src_format, const void* src_data,
@@ -177,6 +432,8 @@ k3imageObj::k3imageObj()
 {
     _data = new k3imageImpl;
     memset(_data, 0, sizeof(k3imageImpl));
+    _data->_mip_levels = 1;
+    _data->_array_size = 1;
 }
 
 k3imageObj::~k3imageObj()
@@ -189,12 +446,24 @@ k3imageObj::~k3imageObj()
     _data = NULL;
 }
 
-K3API void k3imageObj::SetDimensions(uint32_t width, uint32_t height, uint32_t depth, k3fmt format)
+K3API void k3imageObj::SetDimensions(uint32_t width, uint32_t height, uint32_t depth, k3fmt format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap)
 {
+    uint32_t max_mip_levels = GetNumMipLevels(width, height, depth);
+    if (mip_levels == 0) mip_levels = 1;
+    if (mip_levels > max_mip_levels) mip_levels = max_mip_levels;
+    if (array_size == 0) array_size = 1;
+    if (cubemap && (array_size % 6) != 0) {
+        k3error::Handler("Cubemap array size must be a multiple of 6", "SetDimensions");
+        cubemap = false;
+    }
     _data->_width = width;
     _data->_height = height;
     _data->_depth = depth;
     _data->_fmt = format;
+    _data->_mip_levels = mip_levels;
+    _data->_array_size = array_size;
+    _data->_cubemap = cubemap;
 }
 
 K3API uint32_t k3imageObj::GetWidth() const
@@ -217,32 +486,109 @@ K3API k3fmt k3imageObj::GetFormat() const
     return _data->_fmt;
 }
 
-K3API uint32_t k3imageObj::GetPitch() const
+static uint32_t k3image_AlignUp(uint32_t x, uint32_t pad)
+{
+    if (pad == 0) pad = 1;
+    x += pad - 1;
+    x /= pad;
+    x *= pad;
+    return x;
+}
+
+static uint32_t k3image_CalcPitch(const k3imageImpl* data, uint32_t width)
 {
-    uint32_t pitch_pad = _data->_pitch_pad;
-    if (pitch_pad == 0) pitch_pad = 1;
-    uint32_t format_size = GetFormatSize(_data->_fmt);
-    uint32_t block_size = GetFormatBlockSize(_data->_fmt);
-    uint32_t pitch = (_data->_width + block_size - 1) / block_size;
+    uint32_t format_size = k3imageObj::GetFormatSize(data->_fmt);
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(data->_fmt);
+    uint32_t pitch = (width + block_size - 1) / block_size;
     pitch *= format_size;
-    pitch += pitch_pad - 1;
-    pitch /= pitch_pad;
-    pitch *= pitch_pad;
-    return pitch;
+    return k3image_AlignUp(pitch, data->_pitch_pad);
+}
+
+static uint32_t k3image_CalcSlicePitch(const k3imageImpl* data, uint32_t width, uint32_t height)
+{
+    uint32_t block_size = k3imageObj::GetFormatBlockSize(data->_fmt);
+    uint32_t block_rows = (height + block_size - 1) / block_size;
+    return k3image_AlignUp(k3image_CalcPitch(data, width) * block_rows, data->_slice_pitch_pad);
+}
+
+static uint32_t k3image_MipSize(uint32_t size, uint32_t mip_level)
+{
+    size >>= mip_level;
+    return (size) ? size : 1;
+}
+
+// Bytes from the start of one array slice to the next, including the padding after each mip
+static uint32_t k3image_CalcArrayPitch(const k3imageImpl* data)
+{
+    uint32_t size = 0;
+    uint32_t mip;
+    for (mip = 0; mip < data->_mip_levels; mip++) {
+        size = k3image_AlignUp(size, data->_subresource_pad);
+        size += k3image_MipSize(data->_depth, mip) *
+            k3image_CalcSlicePitch(data, k3image_MipSize(data->_width, mip), k3image_MipSize(data->_height, mip));
+    }
+    return k3image_AlignUp(size, data->_subresource_pad);
+}
+
+K3API uint32_t k3imageObj::GetPitch() const
+{
+    return k3image_CalcPitch(_data, _data->_width);
 }
 
 K3API uint32_t k3imageObj::GetSlicePitch() const
 {
-    uint32_t slice_pitch_pad = _data->_slice_pitch_pad;
-    if (slice_pitch_pad == 0) slice_pitch_pad = 1;
-    uint32_t pitch = GetPitch();
-    uint32_t block_size = GetFormatBlockSize(_data->_fmt);
-    uint32_t height = (_data->_height + block_size - 1) / block_size;
-    uint32_t slice_pitch = pitch * height;
-    slice_pitch += slice_pitch_pad - 1;
-    slice_pitch /= slice_pitch_pad;
-    slice_pitch *= slice_pitch_pad;
-    return slice_pitch;
+    return k3image_CalcSlicePitch(_data, _data->_width, _data->_height);
+}
+
+K3API uint32_t k3imageObj::GetMipLevels() const
+{
+    return _data->_mip_levels;
+}
+
+K3API uint32_t k3imageObj::GetArraySize() const
+{
+    return _data->_array_size;
+}
+
+K3API bool k3imageObj::IsCubemap() const
+{
+    return _data->_cubemap;
+}
+
+K3API uint32_t k3imageObj::GetNumSubresources() const
+{
+    return _data->_mip_levels * _data->_array_size;
+}
+
+K3API void k3imageObj::GetSubresourceDesc(uint32_t mip_level, uint32_t array_slice, k3subresourceDesc* desc) const
+{
+    if (desc == NULL) return;
+    if (mip_level >= _data->_mip_levels || array_slice >= _data->_array_size) {
+        k3error::Handler("Subresource out of range", "GetSubresourceDesc");
+        memset(desc, 0, sizeof(k3subresourceDesc));
+        return;
+    }
+    uint32_t offset = array_slice * k3image_CalcArrayPitch(_data);
+    uint32_t mip;
+    for (mip = 0; mip < mip_level; mip++) {
+        offset += k3image_MipSize(_data->_depth, mip) *
+            k3image_CalcSlicePitch(_data, k3image_MipSize(_data->_width, mip), k3image_MipSize(_data->_height, mip));
+        offset = k3image_AlignUp(offset, _data->_subresource_pad);
+    }
+    desc->offset = offset;
+    desc->width = k3image_MipSize(_data->_width, mip_level);
+    desc->height = k3image_MipSize(_data->_height, mip_level);
+    desc->depth = k3image_MipSize(_data->_depth, mip_level);
+    desc->pitch = k3image_CalcPitch(_data, desc->width);
+    desc->slice_pitch = k3image_CalcSlicePitch(_data, desc->width, desc->height);
+}
+
+K3API uint32_t k3imageObj::GetDataSize() const
+{
+    if (_data->_mip_levels == 1 && _data->_array_size == 1) return _data->_depth * GetSlicePitch();
+    k3subresourceDesc last;
+    GetSubresourceDesc(_data->_mip_levels - 1, _data->_array_size - 1, &last);
+    return last.offset + last.depth * last.slice_pitch;
 }
 
 
@@ -268,9 +614,23 @@ K3API void k3imageObj::SaveToFile(const char* file_name, uint32_t fh_index)
         fclose(file_handle);
         return;
     }
-    uint32_t pitch = GetPitch();
-    uint32_t slice_pitch = GetSlicePitch();
-    fh->SaveData(file_handle, _data->_width, _data->_height, _data->_depth, pitch, slice_pitch, _data->_fmt, data);
+    uint32_t num_subresources = GetNumSubresources();
+    if (num_subresources > 1 && fh->SaveSubresources) {
+        uint32_t mip_levels = GetMipLevels();
+        uint32_t array_size = GetArraySize();
+        k3subresourceDesc* desc = new k3subresourceDesc[num_subresources];
+        uint32_t array_slice, mip;
+        for (array_slice = 0; array_slice < array_size; array_slice++) {
+            for (mip = 0; mip < mip_levels; mip++) GetSubresourceDesc(mip, array_slice, &(desc[array_slice * mip_levels + mip]));
+        }
+        fh->SaveSubresources(file_handle, _data->_fmt, mip_levels, array_size, IsCubemap(), desc, data);
+        delete[] desc;
+    } else {
+        uint32_t pitch = GetPitch();
+        uint32_t slice_pitch = GetSlicePitch();
+        fh->SaveData(file_handle, _data->_width, _data->_height, _data->_depth, pitch, slice_pitch, _data->_fmt, data);
+        if (num_subresources > 1) k3error::Handler("File format holds a single image; only the top level of the first array slice was saved", "SaveToFile");
+    }
     fclose(file_handle);
 }
 
@@ -281,7 +641,7 @@ K3API const void* k3imageObj::MapForRead()
 
 K3API void* k3imageObj::MapForWrite()
 {
-    uint32_t size = _data->_depth * GetSlicePitch();
+    uint32_t size = GetDataSize();
     if (_data->_image_data == NULL) {
         _data->_size = 0;
     }
@@ -419,18 +779,39 @@ float k3imageObj::CalcRGBLuminance(const float* src)
     return src[0] + 2.0f * src[1] + src[2];
 }
 
-float k3imageObj::CompressDXT1Pixmap(const float** palette, const float* src, uint32_t* dest)
+// Clamps and rounds the first num_channels of each pixel in a block, for the unorm8 encoders
+static void k3image_BlockToUnorm8(const float* src, uint32_t num_channels, uint8_t* dest)
+{
+    uint32_t i, c;
+    float v;
+    for (i = 0; i < 16; i++) {
+        for (c = 0; c < num_channels; c++) {
+            v = src[4 * i + c];
+            v = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
+            dest[4 * i + c] = static_cast<uint8_t>(v * 0xff + 0.5f);
+        }
+    }
+}
+
+// Pixels set in transparent take index 3; with any set, the others pick from the first 3 colors
+float k3imageObj::CompressDXT1Pixmap(const float** palette, const float* src, uint32_t transparent, uint32_t* dest)
 {
     uint32_t i, p, c, sel;
+    uint32_t num_colors = (transparent) ? 3 : 4;
     const float* cur_color = src;
     const float* cur_pal;
     float cur_err, pix_err, tot_err = 0.0f;
     *dest = 0;
 
     for (i = 0; i < 16; i++) { // iterate through all pixels in the block
+        if (transparent & (1 << i)) {
+            *dest |= 3 << (2 * i);
+            cur_color += 4;
+            continue;
+        }
         pix_err = FLT_MAX;
         sel = 0;
-        for (p = 0; p < 4; p++) { // iterate through all colors in palette
+        for (p = 0; p < num_colors; p++) { // iterate through all colors in palette
             cur_err = 0.0f;
             cur_pal = palette[p];
             for (c = 0; c < 4; c++) { // iterate through all channels of the color
@@ -492,14 +873,35 @@ void k3imageObj::CompressDXT1Block(const float* src, k3DXT1Block* dest, bool all
     float other_colors[8];
     const float* palette[4];
     uint16_t imin_color, imax_color;
+    uint32_t transparent = 0;
+
+    if (_dxt_compress_quality != k3compressQuality::FAST) {
+        uint8_t pixels[64];
+        k3image_BlockToUnorm8(src, 4, pixels);
+        FitDXT1Block(pixels, dest, allow_alpha, _dxt_compress_quality);
+        return;
+    }
+
+    // With alpha allowed, pixels under half alpha are transparent and force 3 color mode, as in FitDXT1Block
+    if (allow_alpha) {
+        for (i = 0; i < 16; i++) {
+            if (src[4 * i + 3] < 0.5f) transparent |= 1 << i;
+        }
+        if (transparent == 0xffff) {
+            dest->color0 = 0;
+            dest->color1 = 0;
+            dest->pixmap = 0xffffffff;
+            return;
+        }
+    }
 
     for (i = 0; i < 16; i++) {
         cur_luminance = CalcRGBLuminance(cur_color);
-        if (cur_luminance < min_luminance) {
+        if (!(transparent & (1 << i)) && cur_luminance < min_luminance) {
             min_color = cur_color;
             min_luminance = cur_luminance;
         }
-        if (cur_luminance > max_luminance) {
+        if (!(transparent & (1 << i)) && cur_luminance > max_luminance) {
             max_color = cur_color;
             max_luminance = cur_luminance;
         }
@@ -512,29 +914,41 @@ void k3imageObj::CompressDXT1Block(const float* src, k3DXT1Block* dest, bool all
     palette[2] = &(other_colors[0]);
     palette[3] = &(other_colors[4]);
 
-    if ((imin_color > imax_color) || !allow_alpha) {
-        palette[0] = min_color;
-        palette[1] = max_color;
-        InterpolateFloat(4, min_color, max_color, 2, other_colors);
-    } else {
-        palette[0] = min_color;
-        palette[1] = max_color;
-        InterpolateFloat(4, min_color, max_color, 1, other_colors);
+    if (transparent) {
+        // 3 color mode needs color0 <= color1
+        if (imin_color > imax_color) {
+            palette[0] = max_color;
+            palette[1] = min_color;
+            dest->color0 = imax_color;
+            dest->color1 = imin_color;
+        } else {
+            palette[0] = min_color;
+            palette[1] = max_color;
+            dest->color0 = imin_color;
+            dest->color1 = imax_color;
+        }
+        InterpolateFloat(4, palette[0], palette[1], 1, other_colors);
         other_colors[4] = 0.0f; other_colors[5] = 0.0f; other_colors[6] = 0.0f; other_colors[7] = 0.0f;
+        CompressDXT1Pixmap(palette, src, transparent, &(dest->pixmap));
+        return;
     }
-    err0 = CompressDXT1Pixmap(palette, src, &pixmap0);
 
-    if ((imin_color >= imax_color) && allow_alpha) {
-        palette[0] = max_color;
-        palette[1] = min_color;
-        InterpolateFloat(4, min_color, max_color, 1, other_colors);
-        other_colors[4] = 0.0f; other_colors[5] = 0.0f; other_colors[6] = 0.0f; other_colors[7] = 0.0f;
-    } else {
-        palette[0] = max_color;
-        palette[1] = min_color;
-        InterpolateFloat(4, max_color, min_color, 2, other_colors);
+    palette[0] = min_color;
+    palette[1] = max_color;
+    InterpolateFloat(4, min_color, max_color, 2, other_colors);
+    err0 = CompressDXT1Pixmap(palette, src, 0, &pixmap0);
+
+    palette[0] = max_color;
+    palette[1] = min_color;
+    InterpolateFloat(4, max_color, min_color, 2, other_colors);
+    err1 = CompressDXT1Pixmap(palette, src, 0, &pixmap1);
+
+    // with alpha allowed, color0 <= color1 decodes as 3 colors and transparent black, so the larger goes first
+    if (allow_alpha) {
+        if (imin_color == imax_color) pixmap1 = 0;
+        if (imin_color > imax_color) err1 = FLT_MAX;
+        else err0 = FLT_MAX;
     }
-    err1 = CompressDXT1Pixmap(palette, src, &pixmap1);
 
     if (err0 < err1) {
         dest->color0 = imin_color;
@@ -550,12 +964,15 @@ void k3imageObj::CompressDXT1Block(const float* src, k3DXT1Block* dest, bool all
 void k3imageObj::CompressDXT3Block(const float* src, k3DXT3Block* dest)
 {
     uint32_t i;
+    uint64_t alpha_val;
     const float* cur_alpha = src + 3;
-    CompressDXT1Block(src, &(dest->dxt1), true);
+    CompressDXT1Block(src, &(dest->dxt1), false);
 
     dest->alphas = 0;
     for (i = 0; i < 16; i++) {
-        dest->alphas |= static_cast<uint64_t>(*cur_alpha * 0xf) << (4 * i);
+        if (_dxt_compress_quality == k3compressQuality::FAST) alpha_val = static_cast<uint64_t>(*cur_alpha * 0xf);
+        else alpha_val = static_cast<uint64_t>(((*cur_alpha < 0.0f) ? 0.0f : ((*cur_alpha > 1.0f) ? 1.0f : *cur_alpha)) * 0xf + 0.5f);
+        dest->alphas |= alpha_val << (4 * i);
         cur_alpha += 4;
     }
 }
@@ -563,7 +980,7 @@ void k3imageObj::CompressDXT3Block(const float* src, k3DXT3Block* dest)
 void k3imageObj::CompressDXT5Block(const float* src, k3DXT3Block* dest)
 {
     const float* cur_alpha = src + 3;
-    CompressDXT1Block(src, &(dest->dxt1), true);
+    CompressDXT1Block(src, &(dest->dxt1), false);
     CompressATI1NBlock(cur_alpha, &(dest->alphas));
 }
 
@@ -579,6 +996,13 @@ void k3imageObj::CompressATI1NBlock(const float* src, uint64_t* dest)
     uint64_t alphamap0, alphamap1;
     const float* palette[8];
 
+    if (_dxt_compress_quality != k3compressQuality::FAST) {
+        uint8_t pixels[64];
+        k3image_BlockToUnorm8(src, 1, pixels);
+        FitATI1NBlock(pixels, dest, _dxt_compress_quality);
+        return;
+    }
+
     for (i = 0; i < 16; i++) {
         if (*cur_alpha < *min_alpha) min_alpha = cur_alpha;
         if (*cur_alpha > *max_alpha) max_alpha = cur_alpha;
@@ -733,18 +1157,25 @@ uint32_t k3imageObj::CalcRGBLuminance(const uint8_t* src)
     return src[0] + 2 * static_cast<uint32_t>(src[1]) + src[2];
 }
 
-uint32_t k3imageObj::CompressDXT1Pixmap(const uint8_t** palette, const uint8_t* src, uint32_t* dest)
+// Pixels set in transparent take index 3; with any set, the others pick from the first 3 colors
+uint32_t k3imageObj::CompressDXT1Pixmap(const uint8_t** palette, const uint8_t* src, uint32_t transparent, uint32_t* dest)
 {
     uint32_t i, p, sel;
+    uint32_t num_colors = (transparent) ? 3 : 4;
     const uint8_t* cur_color = src;
     const uint8_t* cur_pal;
     uint32_t cur_err, pix_err, tot_err = 0;
     *dest = 0;
 
     for (i = 0; i < 2 * 16; i += 2) { // iterate through all pixels in the block
+        if (transparent & (1 << (i >> 1))) {
+            *dest |= 3 << (i);
+            cur_color += 4;
+            continue;
+        }
         pix_err = 0xffffffff;
         sel = 0;
-        for (p = 0; p < 4; p++) { // iterate through all colors in palette
+        for (p = 0; p < num_colors; p++) { // iterate through all colors in palette
             cur_pal = palette[p];
             cur_err = abs(*(cur_color + 0) - *(cur_pal + 0));
             cur_err += abs(*(cur_color + 1) - *(cur_pal + 1));
@@ -803,14 +1234,33 @@ void k3imageObj::CompressDXT1Block(const uint8_t* src, k3DXT1Block* dest, bool a
     uint8_t other_colors[8];
     const uint8_t* palette[4];
     uint16_t imin_color, imax_color;
+    uint32_t transparent = 0;
+
+    if (_dxt_compress_quality != k3compressQuality::FAST) {
+        FitDXT1Block(src, dest, allow_alpha, _dxt_compress_quality);
+        return;
+    }
+
+    // With alpha allowed, pixels under half alpha are transparent and force 3 color mode, as in FitDXT1Block
+    if (allow_alpha) {
+        for (i = 0; i < 16; i++) {
+            if (src[4 * i + 3] < 0x80) transparent |= 1 << i;
+        }
+        if (transparent == 0xffff) {
+            dest->color0 = 0;
+            dest->color1 = 0;
+            dest->pixmap = 0xffffffff;
+            return;
+        }
+    }
 
     for (i = 0; i < 16; i++) {
         cur_luminance = CalcRGBLuminance(cur_color);
-        if (cur_luminance < min_luminance) {
+        if (!(transparent & (1 << i)) && cur_luminance < min_luminance) {
             min_color = cur_color;
             min_luminance = cur_luminance;
         }
-        if (cur_luminance > max_luminance) {
+        if (!(transparent & (1 << i)) && cur_luminance > max_luminance) {
             max_color = cur_color;
             max_luminance = cur_luminance;
         }
@@ -823,29 +1273,41 @@ void k3imageObj::CompressDXT1Block(const uint8_t* src, k3DXT1Block* dest, bool a
     palette[2] = &(other_colors[0]);
     palette[3] = &(other_colors[4]);
 
-    if ((imin_color > imax_color) || !allow_alpha) {
-        palette[0] = min_color;
-        palette[1] = max_color;
-        InterpolateUnorm8(4, min_color, max_color, 2, other_colors);
-    } else {
-        palette[0] = min_color;
-        palette[1] = max_color;
-        InterpolateUnorm8(4, min_color, max_color, 1, other_colors);
+    if (transparent) {
+        // 3 color mode needs color0 <= color1
+        if (imin_color > imax_color) {
+            palette[0] = max_color;
+            palette[1] = min_color;
+            dest->color0 = imax_color;
+            dest->color1 = imin_color;
+        } else {
+            palette[0] = min_color;
+            palette[1] = max_color;
+            dest->color0 = imin_color;
+            dest->color1 = imax_color;
+        }
+        InterpolateUnorm8(4, palette[0], palette[1], 1, other_colors);
         other_colors[4] = 0; other_colors[5] = 0; other_colors[6] = 0; other_colors[7] = 0;
+        CompressDXT1Pixmap(palette, src, transparent, &(dest->pixmap));
+        return;
     }
-    err0 = CompressDXT1Pixmap(palette, src, &pixmap0);
 
-    if ((imin_color >= imax_color) && allow_alpha) {
-        palette[0] = max_color;
-        palette[1] = min_color;
-        InterpolateUnorm8(4, min_color, max_color, 1, other_colors);
-        other_colors[4] = 0; other_colors[5] = 0; other_colors[6] = 0; other_colors[7] = 0;
-    } else {
-        palette[0] = max_color;
-        palette[1] = min_color;
-        InterpolateUnorm8(4, max_color, min_color, 2, other_colors);
+    palette[0] = min_color;
+    palette[1] = max_color;
+    InterpolateUnorm8(4, min_color, max_color, 2, other_colors);
+    err0 = CompressDXT1Pixmap(palette, src, 0, &pixmap0);
+
+    palette[0] = max_color;
+    palette[1] = min_color;
+    InterpolateUnorm8(4, max_color, min_color, 2, other_colors);
+    err1 = CompressDXT1Pixmap(palette, src, 0, &pixmap1);
+
+    // with alpha allowed, color0 <= color1 decodes as 3 colors and transparent black, so the larger goes first
+    if (allow_alpha) {
+        if (imin_color == imax_color) pixmap1 = 0;
+        if (imin_color > imax_color) err1 = 0xffffffff;
+        else err0 = 0xffffffff;
     }
-    err1 = CompressDXT1Pixmap(palette, src, &pixmap1);
 
     if (err0 < err1) {
         dest->color0 = imin_color;
@@ -861,12 +1323,15 @@ void k3imageObj::CompressDXT1Block(const uint8_t* src, k3DXT1Block* dest, bool a
 void k3imageObj::CompressDXT3Block(const uint8_t* src, k3DXT3Block* dest)
 {
     uint32_t i;
+    uint64_t alpha_val;
     const uint8_t* cur_alpha = src + 3;
-    CompressDXT1Block(src, &(dest->dxt1), true);
+    CompressDXT1Block(src, &(dest->dxt1), false);
 
     dest->alphas = 0;
     for (i = 0; i < 16; i++) {
-        dest->alphas |= static_cast<uint64_t>(*cur_alpha >> 4) << (4 * i);
+        if (_dxt_compress_quality == k3compressQuality::FAST) alpha_val = *cur_alpha >> 4;
+        else alpha_val = (*cur_alpha * 0xf + 0x7f) / 0xff;
+        dest->alphas |= alpha_val << (4 * i);
         cur_alpha += 4;
     }
 }
@@ -874,7 +1339,7 @@ void k3imageObj::CompressDXT3Block(const uint8_t* src, k3DXT3Block* dest)
 void k3imageObj::CompressDXT5Block(const uint8_t* src, k3DXT3Block* dest)
 {
     const uint8_t* cur_alpha = src + 3;
-    CompressDXT1Block(src, &(dest->dxt1), true);
+    CompressDXT1Block(src, &(dest->dxt1), false);
     CompressATI1NBlock(cur_alpha, &(dest->alphas));
 }
 
@@ -890,6 +1355,11 @@ void k3imageObj::CompressATI1NBlock(const uint8_t* src, uint64_t* dest)
     uint64_t alphamap0, alphamap1;
     const uint8_t* palette[8];
 
+    if (_dxt_compress_quality != k3compressQuality::FAST) {
+        FitATI1NBlock(src, dest, _dxt_compress_quality);
+        return;
+    }
+
     for (i = 0; i < 16; i++) {
         if (*cur_alpha < *min_alpha) min_alpha = cur_alpha;
         if (*cur_alpha > *max_alpha) max_alpha = cur_alpha;
@@ -944,7 +1414,9 @@ float k3imageObj::ConvertFloat16ToFloat32(uint16_t f16)
     if (exp == 0) {
         // Denorms
         if (man != 0) {
-            // For non-zero denorm, normalize
+            // For non-zero denorm, normalize; the value is man * 2^-24, so the exponent
+            // starts at that of the smallest normal half, 2^-14
+            exp = 1 + 127 - 15;
             while (!(man & 0x400)) {
                 man = man << 1;
                 exp--;
@@ -957,7 +1429,7 @@ float k3imageObj::ConvertFloat16ToFloat32(uint16_t f16)
         exp = exp + 127 - 15;
     }
     u32out = ((sign << 31) | (exp << 23) | (man << 13));
-    f32out = *reinterpret_cast<float*>(&u32out);
+    memcpy(&f32out, &u32out, sizeof(float));
     return f32out;
 }
 
@@ -1007,20 +1479,22 @@ void k3imageObj::ConvertRGB9E5ToFloat32(uint32_t src, float* dest)
 
     // Combine exponent and mantissa of each component
     // alpha is 1.0
-    uint32_t* d = (uint32_t*)dest;
-    *(d + 0) = r_exp | r_mant;
-    *(d + 1) = g_exp | g_mant;
-    *(d + 2) = b_exp | b_mant;
-    *(d + 3) = 0x3f800000;  // 1.0f
+    uint32_t d[4];
+    d[0] = r_exp | r_mant;
+    d[1] = g_exp | g_mant;
+    d[2] = b_exp | b_mant;
+    d[3] = 0x3f800000;  // 1.0f
+    memcpy(dest, d, sizeof(d));
 }
 
 void k3imageObj::ConvertFloat32ToRGB9E5(const float* src, uint32_t* dest)
 {
     // Extract the 3 source components as 32 bit uint
-    const uint32_t* s = (const uint32_t*)src;
-    uint32_t r_src = *(s + 0);
-    uint32_t g_src = *(s + 1);
-    uint32_t b_src = *(s + 2);
+    uint32_t s[3];
+    memcpy(s, src, sizeof(s));
+    uint32_t r_src = s[0];
+    uint32_t g_src = s[1];
+    uint32_t b_src = s[2];
     // if the sign bit is set, clamp the value to 0
     r_src = (r_src & 0x80000000) ? 0x0 : r_src;
     g_src = (g_src & 0x80000000) ? 0x0 : g_src;
@@ -1065,7 +1539,8 @@ void k3imageObj::ConvertFloat32ToRGB9E5(const float* src, uint32_t* dest)
 uint16_t k3imageObj::ConvertFloat32ToFloat16(float f32)
 {
     uint16_t u16;
-    uint32_t u32 = *reinterpret_cast<uint32_t*>(&f32);
+    uint32_t u32;
+    memcpy(&u32, &f32, sizeof(uint32_t));
     uint32_t sign = (u32 >> 31) & 0x1;
     int32_t exp = ((u32 >> 23) & 0xff) - 127;
     uint32_t man = u32 & 0x7fffff;
@@ -1086,584 +1561,90 @@ uint16_t k3imageObj::ConvertFloat32ToFloat16(float f32)
 
 void k3imageObj::ConvertToFloat4(k3fmt format, const void* src, float* dest)
 {
-    const uint8_t* u8src = static_cast<const uint8_t*>(src);
-    const uint16_t* u16src = static_cast<const uint16_t*>(src);
-    const uint32_t* u32src = static_cast<const uint32_t*>(src);
-    const float* f32src = static_cast<const float*>(src);
     const k3DXT1Block* dxt1src = static_cast<const k3DXT1Block*>(src);
     const k3DXT3Block* dxt3src = static_cast<const k3DXT3Block*>(src);
     const uint64_t* u64src = static_cast<const uint64_t*>(src);
     const k3ATI2NBlock* ati2nsrc = static_cast<const k3ATI2NBlock*>(src);
+    const k3BPTCBlock* bptcsrc = static_cast<const k3BPTCBlock*>(src);
     dest[0] = 0.0; dest[1] = 0.0; dest[2] = 0.0; dest[3] = 1.0;
 
     switch (format) {
-    case k3fmt::RGBA8_UNORM:
-        dest[0] = u8src[0] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
-        dest[2] = u8src[2] / static_cast<float>(0xff);
-        dest[3] = u8src[3] / static_cast<float>(0xff);
-        break;
-    case k3fmt::BGRA8_UNORM:
-        dest[0] = u8src[2] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
-        dest[2] = u8src[0] / static_cast<float>(0xff);
-        dest[3] = u8src[3] / static_cast<float>(0xff);
-        break;
-    case k3fmt::RGBX8_UNORM:
-        dest[0] = u8src[0] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
-        dest[2] = u8src[2] / static_cast<float>(0xff);
-        break;
-    case k3fmt::BGRX8_UNORM:
-        dest[0] = u8src[2] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
-        dest[2] = u8src[0] / static_cast<float>(0xff);
-        break;
-    case k3fmt::RGBA16_UNORM:
-        dest[0] = u16src[0] / static_cast<float>(0xffff);
-        dest[1] = u16src[1] / static_cast<float>(0xffff);
-        dest[2] = u16src[2] / static_cast<float>(0xffff);
-        dest[3] = u16src[3] / static_cast<float>(0xffff);
-        break;
-    case k3fmt::RGBA16_UINT:
-        dest[0] = u16src[0];
-        dest[1] = u16src[1];
-        dest[2] = u16src[2];
-        dest[3] = u16src[3];
+#define K3_PIXEL_CASE(F) case k3fmt::F: k3pixel<k3fmt::F>::ToFloat4(src, dest); break;
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
+        // Compressed formats
+    case k3fmt::BC1_UNORM:
+        DecompressDXT1Block(dxt1src, dest);
         break;
-    case k3fmt::RGBA16_FLOAT:
-        dest[0] = ConvertFloat16ToFloat32(*(u16src + 0));
-        dest[1] = ConvertFloat16ToFloat32(*(u16src + 1));
-        dest[2] = ConvertFloat16ToFloat32(*(u16src + 2));
-        dest[3] = ConvertFloat16ToFloat32(*(u16src + 3));
+    case k3fmt::BC2_UNORM:
+        DecompressDXT3Block(dxt3src, dest);
         break;
-    case k3fmt::RGBA32_UNORM:
-        dest[0] = u32src[0] / static_cast<float>(0xffffffff);
-        dest[1] = u32src[1] / static_cast<float>(0xffffffff);
-        dest[2] = u32src[2] / static_cast<float>(0xffffffff);
-        dest[3] = u32src[3] / static_cast<float>(0xffffffff);
+    case k3fmt::BC3_UNORM:
+        DecompressDXT5Block(dxt3src, dest);
         break;
-    case k3fmt::RGBA32_UINT:
-        dest[0] = static_cast<float>(u32src[0]);
-        dest[1] = static_cast<float>(u32src[1]);
-        dest[2] = static_cast<float>(u32src[2]);
-        dest[3] = static_cast<float>(u32src[3]);
+    case k3fmt::BC4_UNORM:
+        DecompressATI1NBlock(u64src, dest);
         break;
-    case k3fmt::RGBA32_FLOAT:
-        dest[0] = f32src[0];
-        dest[1] = f32src[1];
-        dest[2] = f32src[2];
-        dest[3] = f32src[3];
+    case k3fmt::BC5_UNORM:
+        DecompressATI2NBlock(ati2nsrc, dest);
         break;
-    case k3fmt::RGB10A2_UNORM:
-        dest[0] = ((u32src[0] >> 22) & 0x3ff) / static_cast<float>(0x3ff);
-        dest[1] = ((u32src[0] >> 12) & 0x3ff) / static_cast<float>(0x3ff);
-        dest[2] = ((u32src[0] >> 2) & 0x3ff) / static_cast<float>(0x3ff);
-        dest[3] = ((u32src[0] >> 0) & 0x3) / static_cast<float>(0x3);
+    case k3fmt::BC6_UNORM:
+        DecompressBC6HBlock(bptcsrc, dest);
         break;
-    case k3fmt::BGR5A1_UNORM:
-        dest[0] = ((u16src[0] >> 1) & 0x1f) / static_cast<float>(0x1f);
-        dest[1] = ((u16src[0] >> 6) & 0x1f) / static_cast<float>(0x1f);
-        dest[2] = ((u16src[0] >> 11) & 0x1f) / static_cast<float>(0x1f);
-        dest[3] = ((u16src[0] >> 0) & 0x1) / static_cast<float>(0x1);
+    case k3fmt::BC7_UNORM:
+        DecompressBC7Block(bptcsrc, dest);
         break;
-        // 3 component
-    case k3fmt::RGB8_UNORM:
-        dest[0] = u8src[0] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
-        dest[2] = u8src[2] / static_cast<float>(0xff);
+    default:
         break;
-    case k3fmt::BGR8_UNORM:
-        dest[0] = u8src[2] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
-        dest[2] = u8src[0] / static_cast<float>(0xff);
+    }
+}
+
+void k3imageObj::ConvertFromFloat4(k3fmt format, const float* src, void* dest)
+{
+    switch (format) {
+#define K3_PIXEL_CASE(F) case k3fmt::F: k3pixel<k3fmt::F>::FromFloat4(src, dest); break;
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
+        // Compressed formats
+    case k3fmt::BC1_UNORM:
+        CompressDXT1Block(src, static_cast<k3DXT1Block*>(dest));
         break;
-    case k3fmt::RGB32_UINT:
-        dest[0] = static_cast<float>(u32src[0]);
-        dest[1] = static_cast<float>(u32src[1]);
-        dest[2] = static_cast<float>(u32src[2]);
+    case k3fmt::BC2_UNORM:
+        CompressDXT3Block(src, static_cast<k3DXT3Block*>(dest));
         break;
-    case k3fmt::RGB32_FLOAT:
-        dest[0] = f32src[0];
-        dest[1] = f32src[1];
-        dest[2] = f32src[2];
+    case k3fmt::BC3_UNORM:
+        CompressDXT5Block(src, static_cast<k3DXT3Block*>(dest));
         break;
-    case k3fmt::B5G6R5_UNORM:
-        dest[0] = ((u16src[0] >> 11) & 0x1f) / static_cast<float>(0x1f);
-        dest[1] = ((u16src[0] >> 5) & 0x3f) / static_cast<float>(0x3f);
-        dest[2] = ((u16src[0] >> 0) & 0x1f) / static_cast<float>(0x1f);
+    case k3fmt::BC4_UNORM:
+        CompressATI1NBlock(src, static_cast<uint64_t*>(dest));
         break;
-        // 2 component
-    case k3fmt::RG8_UNORM:
-        dest[0] = u8src[0] / static_cast<float>(0xff);
-        dest[1] = u8src[1] / static_cast<float>(0xff);
+    case k3fmt::BC5_UNORM:
+        CompressATI2NBlock(src, static_cast<k3ATI2NBlock*>(dest));
         break;
-    case k3fmt::RG16_UNORM:
-        dest[0] = u16src[0] / static_cast<float>(0xffff);
-        dest[1] = u16src[1] / static_cast<float>(0xffff);
+    case k3fmt::BC6_UNORM:
+        CompressBC6HBlock(src, static_cast<k3BPTCBlock*>(dest));
         break;
-    case k3fmt::RG16_UINT:
-        dest[0] = u16src[0];
-        dest[1] = u16src[1];
+    case k3fmt::BC7_UNORM:
+        CompressBC7Block(src, static_cast<k3BPTCBlock*>(dest));
         break;
-    case k3fmt::RG16_FLOAT:
-        dest[0] = ConvertFloat16ToFloat32(*(u16src + 0));
-        dest[1] = ConvertFloat16ToFloat32(*(u16src + 1));
-        break;
-    case k3fmt::RG32_UNORM:
-        dest[0] = u32src[0] / static_cast<float>(0xffffffff);
-        dest[1] = u32src[1] / static_cast<float>(0xffffffff);
-        break;
-    case k3fmt::RG32_UINT:
-        dest[0] = static_cast<float>(u32src[0]);
-        dest[1] = static_cast<float>(u32src[1]);
-        break;
-    case k3fmt::RG32_FLOAT:
-        dest[0] = f32src[0];
-        dest[1] = f32src[1];
-        break;
-        // 1 component
-    case k3fmt::R8_UNORM:
-        dest[0] = u8src[0] / static_cast<float>(0xff);
-        break;
-    case k3fmt::A8_UNORM:
-        dest[3] = u8src[0] / static_cast<float>(0xff);
-        break;
-    case k3fmt::R16_UNORM:
-        dest[0] = u16src[0] / static_cast<float>(0xffff);
-        break;
-    case k3fmt::R16_UINT:
-        dest[0] = u16src[0];
-        break;
-    case k3fmt::R16_FLOAT:
-        dest[0] = ConvertFloat16ToFloat32(*(u16src + 0));
-        break;
-    case k3fmt::R32_UNORM:
-        dest[0] = u32src[0] / static_cast<float>(0xffffffff);
-        break;
-    case k3fmt::R32_UINT:
-        dest[0] = static_cast<float>(u32src[0]);
-        break;
-    case k3fmt::R32_FLOAT:
-        dest[0] = f32src[0];
-        break;
-        // Compressed formats
-    case k3fmt::BC1_UNORM:
-        DecompressDXT1Block(dxt1src, dest);
-        break;
-    case k3fmt::BC2_UNORM:
-        DecompressDXT3Block(dxt3src, dest);
-        break;
-    case k3fmt::BC3_UNORM:
-        DecompressDXT5Block(dxt3src, dest);
-        break;
-    case k3fmt::BC4_UNORM:
-        DecompressATI1NBlock(u64src, dest);
-        break;
-    case k3fmt::BC5_UNORM:
-        DecompressATI2NBlock(ati2nsrc, dest);
-        break;
-    case k3fmt::BC6_UNORM:
-    case k3fmt::BC7_UNORM:
-        // TODO: implement these
-        break;
-        // Depth/Stencil formats
-    case k3fmt::D16_UNORM:
-        dest[0] = u16src[0] / static_cast<float>(0xffff);
-        break;
-    case k3fmt::D24X8_UNORM:
-        dest[0] = (u32src[0] & 0xffffff) / static_cast<float>(0xffffff);
-        break;
-    case k3fmt::D24_UNORM_S8_UINT:
-        dest[0] = (u32src[0] & 0xffffff) / static_cast<float>(0xffffff);
-        dest[1] = static_cast<float>((u32src[0] >> 24) & 0xff);
-        break;
-    case k3fmt::D32_FLOAT:
-        dest[0] = f32src[0];
-        break;
-    case k3fmt::D32_FLOAT_S8X24_UINT:
-        dest[0] = f32src[0];
-        dest[1] = static_cast<float>((u32src[1] >> 8) & 0xff);
-        break;
-    case k3fmt::RGB9E5_FLOAT:
-        ConvertRGB9E5ToFloat32(*u32src, dest);
-        break;
-    default:
-        break;
-    }
-}
-
-void k3imageObj::ConvertFromFloat4(k3fmt format, const float* src, void* dest)
-{
-    uint8_t* u8dest = static_cast<uint8_t*>(dest);
-    uint16_t* u16dest = static_cast<uint16_t*>(dest);
-    uint32_t* u32dest = static_cast<uint32_t*>(dest);
-    float* f32dest = static_cast<float*>(dest);
-
-    switch (format) {
-    case k3fmt::RGBA8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        u8dest[2] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
-        u8dest[3] = static_cast<uint8_t>(src[3] * 0xff + 0.5);
-        break;
-    case k3fmt::BGRA8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        u8dest[2] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        u8dest[3] = static_cast<uint8_t>(src[3] * 0xff + 0.5);
-        break;
-    case k3fmt::RGBX8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        u8dest[2] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
-        break;
-    case k3fmt::BGRX8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        u8dest[2] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        break;
-    case k3fmt::RGBA16_UNORM:
-        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
-        u16dest[1] = static_cast<uint16_t>(src[1] * 0xffff + 0.5);
-        u16dest[2] = static_cast<uint16_t>(src[2] * 0xffff + 0.5);
-        u16dest[3] = static_cast<uint16_t>(src[3] * 0xffff + 0.5);
-        break;
-    case k3fmt::RGBA16_UINT:
-        u16dest[0] = static_cast<uint16_t>(src[0]);
-        u16dest[1] = static_cast<uint16_t>(src[1]);
-        u16dest[2] = static_cast<uint16_t>(src[2]);
-        u16dest[3] = static_cast<uint16_t>(src[3]);
-        break;
-    case k3fmt::RGBA16_FLOAT:
-        u16dest[0] = ConvertFloat32ToFloat16(src[0]);
-        u16dest[1] = ConvertFloat32ToFloat16(src[1]);
-        u16dest[2] = ConvertFloat32ToFloat16(src[2]);
-        u16dest[3] = ConvertFloat32ToFloat16(src[3]);
-        break;
-    case k3fmt::RGBA32_UNORM:
-        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffffff + 0.5);
-        u32dest[1] = static_cast<uint32_t>(src[1] * 0xffffffff + 0.5);
-        u32dest[2] = static_cast<uint32_t>(src[2] * 0xffffffff + 0.5);
-        u32dest[3] = static_cast<uint32_t>(src[3] * 0xffffffff + 0.5);
-        break;
-    case k3fmt::RGBA32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0]);
-        u32dest[1] = static_cast<uint32_t>(src[1]);
-        u32dest[2] = static_cast<uint32_t>(src[2]);
-        u32dest[3] = static_cast<uint32_t>(src[3]);
-        break;
-    case k3fmt::RGBA32_FLOAT:
-        f32dest[0] = src[0];
-        f32dest[1] = src[1];
-        f32dest[2] = src[2];
-        f32dest[3] = src[3];
-        break;
-    case k3fmt::RGB10A2_UNORM:
-        u32dest[0] = ((static_cast<uint32_t>(src[0] * 0x3ff + 0.5) << 22) |
-            (static_cast<uint32_t>(src[1] * 0x3ff + 0.5) << 12) |
-            (static_cast<uint32_t>(src[2] * 0x3ff + 0.5) << 2) |
-            (static_cast<uint32_t>(src[3] * 0x3 + 0.5) << 0));
-        break;
-    case k3fmt::BGR5A1_UNORM:
-        u16dest[0] = ((static_cast<uint16_t>(src[0] * 0x1f + 0.5) << 1) |
-            (static_cast<uint16_t>(src[1] * 0x1f + 0.5) << 6) |
-            (static_cast<uint16_t>(src[2] * 0x1f + 0.5) << 11) |
-            (static_cast<uint16_t>(src[3] * 0x1 + 0.5) << 0));
-        break;
-        // 3 component
-    case k3fmt::RGB8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        u8dest[2] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
-        break;
-    case k3fmt::BGR8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        u8dest[2] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        break;
-    case k3fmt::RGB32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0]);
-        u32dest[1] = static_cast<uint32_t>(src[1]);
-        u32dest[2] = static_cast<uint32_t>(src[2]);
-        break;
-    case k3fmt::RGB32_FLOAT:
-        f32dest[0] = src[0];
-        f32dest[1] = src[1];
-        f32dest[2] = src[2];
-        break;
-    case k3fmt::B5G6R5_UNORM:
-        u16dest[0] = ((static_cast<uint16_t>(src[0] * 0x1f + 0.5) << 11) |
-            (static_cast<uint16_t>(src[1] * 0x3f + 0.5) << 5) |
-            (static_cast<uint16_t>(src[2] * 0x1f + 0.5) << 0));
-        break;
-        // 2 component
-    case k3fmt::RG8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
-        break;
-    case k3fmt::RG16_UNORM:
-        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
-        u16dest[1] = static_cast<uint16_t>(src[1] * 0xffff + 0.5);
-        break;
-    case k3fmt::RG16_UINT:
-        u16dest[0] = static_cast<uint16_t>(src[0]);
-        u16dest[1] = static_cast<uint16_t>(src[1]);
-        break;
-    case k3fmt::RG16_FLOAT:
-        u16dest[0] = ConvertFloat32ToFloat16(src[0]);
-        u16dest[1] = ConvertFloat32ToFloat16(src[1]);
-        break;
-    case k3fmt::RG32_UNORM:
-        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffffff + 0.5);
-        u32dest[1] = static_cast<uint32_t>(src[1] * 0xffffffff + 0.5);
-        break;
-    case k3fmt::RG32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0]);
-        u32dest[1] = static_cast<uint32_t>(src[1]);
-        break;
-    case k3fmt::RG32_FLOAT:
-        f32dest[0] = src[0];
-        f32dest[1] = src[1];
-        break;
-        // 1 component
-    case k3fmt::R8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
-        break;
-    case k3fmt::A8_UNORM:
-        u8dest[0] = static_cast<uint8_t>(src[3] * 0xff + 0.5);
-        break;
-    case k3fmt::R16_UNORM:
-        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
-        break;
-    case k3fmt::R16_UINT:
-        u16dest[0] = static_cast<uint16_t>(src[0]);
-        break;
-    case k3fmt::R16_FLOAT:
-        u16dest[0] = ConvertFloat32ToFloat16(src[0]);
-        break;
-    case k3fmt::R32_UNORM:
-        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffffff + 0.5);
-        break;
-    case k3fmt::R32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0]);
-        break;
-    case k3fmt::R32_FLOAT:
-        f32dest[0] = src[0];
-        break;
-        // Compressed formats
-    case k3fmt::BC1_UNORM:
-        CompressDXT1Block(src, static_cast<k3DXT1Block*>(dest));
-        break;
-    case k3fmt::BC2_UNORM:
-        CompressDXT3Block(src, static_cast<k3DXT3Block*>(dest));
-        break;
-    case k3fmt::BC3_UNORM:
-        CompressDXT5Block(src, static_cast<k3DXT3Block*>(dest));
-        break;
-    case k3fmt::BC4_UNORM:
-        CompressATI1NBlock(src, static_cast<uint64_t*>(dest));
-        break;
-    case k3fmt::BC5_UNORM:
-        CompressATI2NBlock(src, static_cast<k3ATI2NBlock*>(dest));
-        break;
-    case k3fmt::BC6_UNORM:
-    case k3fmt::BC7_UNORM:
-        // TODO: implement these
-        break;
-        // Depth/Stencil formats
-    case k3fmt::D16_UNORM:
-        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
-        break;
-    case k3fmt::D24X8_UNORM:
-        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffff + 0.5);
-        break;
-    case k3fmt::D24_UNORM_S8_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffff + 0.5);
-        u32dest[0] |= (static_cast<uint32_t>(src[1]) & 0xff) << 24;
-        break;
-    case k3fmt::D32_FLOAT:
-        f32dest[0] = src[0];
-        break;
-    case k3fmt::D32_FLOAT_S8X24_UINT:
-        f32dest[0] = src[0];
-        u32dest[1] = (static_cast<uint32_t>(src[1]) & 0xff);
-        break;
-    case k3fmt::RGB9E5_FLOAT:
-        ConvertFloat32ToRGB9E5(src, u32dest);
-        break;
-    default:
+    default:
         break;
     }
 }
 
 void k3imageObj::ConvertToUnorm8(k3fmt format, const void* src, uint8_t* dest)
 {
-    const uint8_t* u8src = static_cast<const uint8_t*>(src);
-    const uint16_t* u16src = static_cast<const uint16_t*>(src);
-    const uint32_t* u32src = static_cast<const uint32_t*>(src);
-    const float* f32src = static_cast<const float*>(src);
     const k3DXT1Block* dxt1src = static_cast<const k3DXT1Block*>(src);
     const k3DXT3Block* dxt3src = static_cast<const k3DXT3Block*>(src);
     const uint64_t* u64src = static_cast<const uint64_t*>(src);
     const k3ATI2NBlock* ati2nsrc = static_cast<const k3ATI2NBlock*>(src);
+    const k3BPTCBlock* bptcsrc = static_cast<const k3BPTCBlock*>(src);
     dest[0] = 0; dest[1] = 0; dest[2] = 0; dest[3] = 0xff;
-    float f32dest[4];
-
-    uint8_t alpha_val;
 
     switch (format) {
-    case k3fmt::RGBA8_UNORM:
-        dest[0] = u8src[0];
-        dest[1] = u8src[1];
-        dest[2] = u8src[2];
-        dest[3] = u8src[3];
-        break;
-    case k3fmt::BGRA8_UNORM:
-        dest[0] = u8src[2];
-        dest[1] = u8src[1];
-        dest[2] = u8src[0];
-        dest[3] = u8src[3];
-        break;
-    case k3fmt::RGBX8_UNORM:
-        dest[0] = u8src[0];
-        dest[1] = u8src[1];
-        dest[2] = u8src[2];
-        break;
-    case k3fmt::BGRX8_UNORM:
-        dest[0] = u8src[2];
-        dest[1] = u8src[1];
-        dest[2] = u8src[0];
-        break;
-    case k3fmt::RGBA16_UNORM:
-        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
-        dest[1] = static_cast<uint8_t>(u16src[1] >> 8);
-        dest[2] = static_cast<uint8_t>(u16src[2] >> 8);
-        dest[3] = static_cast<uint8_t>(u16src[3] >> 8);
-        break;
-    case k3fmt::RGBA16_UINT:
-        dest[0] = (u16src[0] != 0) ? 1 : 0;
-        dest[1] = (u16src[1] != 0) ? 1 : 0;
-        dest[2] = (u16src[2] != 0) ? 1 : 0;
-        dest[3] = (u16src[3] != 0) ? 1 : 0;
-        break;
-    case k3fmt::RGBA16_FLOAT:
-        dest[0] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 0)) * 0xff);
-        dest[1] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 1)) * 0xff);
-        dest[2] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 2)) * 0xff);
-        dest[3] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 3)) * 0xff);
-        break;
-    case k3fmt::RGBA32_UNORM:
-        dest[0] = static_cast<uint8_t>(u32src[0] >> 24);
-        dest[1] = static_cast<uint8_t>(u32src[1] >> 24);
-        dest[2] = static_cast<uint8_t>(u32src[2] >> 24);
-        dest[3] = static_cast<uint8_t>(u32src[3] >> 24);
-        break;
-    case k3fmt::RGBA32_UINT:
-        dest[0] = (u32src[0] != 0) ? 1 : 0;
-        dest[1] = (u32src[1] != 0) ? 1 : 0;
-        dest[2] = (u32src[2] != 0) ? 1 : 0;
-        dest[3] = (u32src[3] != 0) ? 1 : 0;
-        break;
-    case k3fmt::RGBA32_FLOAT:
-        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
-        dest[1] = static_cast<uint8_t>(f32src[1] * 0xff);
-        dest[2] = static_cast<uint8_t>(f32src[2] * 0xff);
-        dest[3] = static_cast<uint8_t>(f32src[3] * 0xff);
-        break;
-    case k3fmt::RGB10A2_UNORM:
-        dest[0] = static_cast<uint8_t>((u32src[0] >> 24) & 0xff);
-        dest[1] = static_cast<uint8_t>((u32src[0] >> 14) & 0xff);
-        dest[2] = static_cast<uint8_t>((u32src[0] >> 4) & 0xff);
-        alpha_val = static_cast<uint8_t>((u32src[0] >> 0) & 0x3);
-        dest[3] = (alpha_val << 6) | (alpha_val << 4) | (alpha_val << 2) | alpha_val;
-        break;
-    case k3fmt::BGR5A1_UNORM:
-        dest[0] = ((u16src[0] << 2) & 0xf8) | ((u16src[0] >> 3) & 0x07);
-        dest[1] = ((u16src[0] >> 3) & 0xf8) | ((u16src[0] >> 8) & 0x07);
-        dest[2] = ((u16src[0] >> 8) & 0xf8) | ((u16src[0] >> 13) & 0x07);
-        dest[3] = ((u16src[0] >> 0) & 0x1) ? 0xff : 0x00;
-        break;
-        // 3 component
-    case k3fmt::RGB8_UNORM:
-        dest[0] = u8src[0];
-        dest[1] = u8src[1];
-        dest[2] = u8src[2];
-        break;
-    case k3fmt::BGR8_UNORM:
-        dest[0] = u8src[2];
-        dest[1] = u8src[1];
-        dest[2] = u8src[0];
-        break;
-    case k3fmt::RGB32_UINT:
-        dest[0] = (u32src[0] != 0) ? 1 : 0;
-        dest[1] = (u32src[1] != 0) ? 1 : 0;
-        dest[2] = (u32src[2] != 0) ? 1 : 0;
-        break;
-    case k3fmt::RGB32_FLOAT:
-        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
-        dest[1] = static_cast<uint8_t>(f32src[1] * 0xff);
-        dest[2] = static_cast<uint8_t>(f32src[2] * 0xff);
-        break;
-    case k3fmt::B5G6R5_UNORM:
-        dest[0] = ((u16src[0] >> 8) & 0xf8) | ((u16src[0] >> 13) & 0x07);
-        dest[1] = ((u16src[0] >> 3) & 0xfc) | ((u16src[0] >> 9) & 0x03);
-        dest[2] = ((u16src[0] << 3) & 0xf8) | ((u16src[0] >> 2) & 0x07);
-        break;
-        // 2 component
-    case k3fmt::RG8_UNORM:
-        dest[0] = u8src[0];
-        dest[1] = u8src[1];
-        break;
-    case k3fmt::RG16_UNORM:
-        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
-        dest[1] = static_cast<uint8_t>(u16src[1] >> 8);
-        break;
-    case k3fmt::RG16_UINT:
-        dest[0] = (u16src[0] != 0) ? 1 : 0;
-        dest[1] = (u16src[1] != 0) ? 1 : 0;
-        break;
-    case k3fmt::RG16_FLOAT:
-        dest[0] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 0)) * 0xff);
-        dest[1] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 1)) * 0xff);
-        break;
-    case k3fmt::RG32_UNORM:
-        dest[0] = static_cast<uint8_t>(u32src[0] >> 24);
-        dest[1] = static_cast<uint8_t>(u32src[1] >> 24);
-        break;
-    case k3fmt::RG32_UINT:
-        dest[0] = (u32src[0] != 0) ? 1 : 0;
-        dest[1] = (u32src[1] != 0) ? 1 : 0;
-        break;
-    case k3fmt::RG32_FLOAT:
-        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
-        dest[1] = static_cast<uint8_t>(f32src[1] * 0xff);
-        break;
-        // 1 component
-    case k3fmt::R8_UNORM:
-        dest[0] = u8src[0];
-        break;
-    case k3fmt::A8_UNORM:
-        dest[3] = u8src[0];
-        break;
-    case k3fmt::R16_UNORM:
-        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
-        break;
-    case k3fmt::R16_UINT:
-        dest[0] = (u16src[0] != 0) ? 1 : 0;
-        break;
-    case k3fmt::R16_FLOAT:
-        dest[0] = static_cast<uint8_t>(ConvertFloat16ToFloat32(*(u16src + 0)) * 0xff);
-        break;
-    case k3fmt::R32_UNORM:
-        dest[0] = static_cast<uint8_t>(u32src[0] >> 24);
-        break;
-    case k3fmt::R32_UINT:
-        dest[0] = (u32src[0] != 0) ? 1 : 0;
-        break;
-    case k3fmt::R32_FLOAT:
-        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
-        break;
+#define K3_PIXEL_CASE(F) case k3fmt::F: k3pixel<k3fmt::F>::ToUnorm8(src, dest); break;
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
         // Compressed formats
     case k3fmt::BC1_UNORM:
         DecompressDXT1Block(dxt1src, dest);
@@ -1681,33 +1662,10 @@ void k3imageObj::ConvertToUnorm8(k3fmt format, const void* src, uint8_t* dest)
         DecompressATI2NBlock(ati2nsrc, dest);
         break;
     case k3fmt::BC6_UNORM:
-    case k3fmt::BC7_UNORM:
-        // TODO: implement these
-        break;
-        // Depth/Stencil formats
-    case k3fmt::D16_UNORM:
-        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
-        break;
-    case k3fmt::D24X8_UNORM:
-        dest[0] = static_cast<uint8_t>((u32src[0] & 0xffffff) >> 16);
-        break;
-    case k3fmt::D24_UNORM_S8_UINT:
-        dest[0] = static_cast<uint8_t>((u32src[0] & 0xffffff) >> 16);
-        dest[1] = static_cast<uint8_t>((u32src[0] & 0xff) >> 24);
-        break;
-    case k3fmt::D32_FLOAT:
-        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
-        break;
-    case k3fmt::D32_FLOAT_S8X24_UINT:
-        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
-        dest[1] = static_cast<uint8_t>((u32src[1]) & 0xff);
+        DecompressBC6HBlock(bptcsrc, dest);
         break;
-    case k3fmt::RGB9E5_FLOAT:
-        ConvertRGB9E5ToFloat32(*u32src, f32dest);
-        dest[0] = static_cast<uint8_t>(f32dest[0] * 0xff);
-        dest[1] = static_cast<uint8_t>(f32dest[1] * 0xff);
-        dest[2] = static_cast<uint8_t>(f32dest[2] * 0xff);
-        dest[3] = static_cast<uint8_t>(f32dest[3] * 0xff);
+    case k3fmt::BC7_UNORM:
+        DecompressBC7Block(bptcsrc, dest);
         break;
     default:
         break;
@@ -1716,175 +1674,10 @@ void k3imageObj::ConvertToUnorm8(k3fmt format, const void* src, uint8_t* dest)
 
 void k3imageObj::ConvertFromUnorm8(k3fmt format, const uint8_t* src, void* dest)
 {
-    uint8_t* u8dest = static_cast<uint8_t*>(dest);
-    uint16_t* u16dest = static_cast<uint16_t*>(dest);
-    uint32_t* u32dest = static_cast<uint32_t*>(dest);
-    float* f32dest = static_cast<float*>(dest);
-    float f32src[4];
-
-    uint32_t color32r, color32g, color32b, color32a;
-
     switch (format) {
-    case k3fmt::RGBA8_UNORM:
-        u8dest[0] = src[0];
-        u8dest[1] = src[1];
-        u8dest[2] = src[2];
-        u8dest[3] = src[3];
-        break;
-    case k3fmt::BGRA8_UNORM:
-        u8dest[0] = src[2];
-        u8dest[1] = src[1];
-        u8dest[2] = src[0];
-        u8dest[3] = src[3];
-        break;
-    case k3fmt::RGBX8_UNORM:
-        u8dest[0] = src[0];
-        u8dest[1] = src[1];
-        u8dest[2] = src[2];
-        break;
-    case k3fmt::BGRX8_UNORM:
-        u8dest[0] = src[2];
-        u8dest[1] = src[1];
-        u8dest[2] = src[0];
-        break;
-    case k3fmt::RGBA16_UNORM:
-        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
-        u16dest[1] = (static_cast<uint16_t>(src[1]) << 8) | src[1];
-        u16dest[2] = (static_cast<uint16_t>(src[2]) << 8) | src[2];
-        u16dest[3] = (static_cast<uint16_t>(src[3]) << 8) | src[3];
-        break;
-    case k3fmt::RGBA16_UINT:
-        u16dest[0] = static_cast<uint16_t>(src[0] >> 7);
-        u16dest[1] = static_cast<uint16_t>(src[1] >> 7);
-        u16dest[2] = static_cast<uint16_t>(src[2] >> 7);
-        u16dest[3] = static_cast<uint16_t>(src[3] >> 7);
-        break;
-    case k3fmt::RGBA16_FLOAT:
-        u16dest[0] = ConvertFloat32ToFloat16(src[0] / 255.0f);
-        u16dest[1] = ConvertFloat32ToFloat16(src[1] / 255.0f);
-        u16dest[2] = ConvertFloat32ToFloat16(src[2] / 255.0f);
-        u16dest[3] = ConvertFloat32ToFloat16(src[3] / 255.0f);
-        break;
-    case k3fmt::RGBA32_UNORM:
-        color32r = static_cast<uint32_t>(src[0]);
-        color32g = static_cast<uint32_t>(src[1]);
-        color32b = static_cast<uint32_t>(src[2]);
-        color32a = static_cast<uint32_t>(src[3]);
-        u32dest[0] = (color32r << 24) | (color32r << 16) | (color32r << 8) | color32r;
-        u32dest[1] = (color32g << 24) | (color32g << 16) | (color32g << 8) | color32g;
-        u32dest[2] = (color32b << 24) | (color32b << 16) | (color32b << 8) | color32b;
-        u32dest[3] = (color32a << 24) | (color32a << 16) | (color32a << 8) | color32a;
-        break;
-    case k3fmt::RGBA32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
-        u32dest[1] = static_cast<uint32_t>(src[1] >> 7);
-        u32dest[2] = static_cast<uint32_t>(src[2] >> 7);
-        u32dest[3] = static_cast<uint32_t>(src[3] >> 7);
-        break;
-    case k3fmt::RGBA32_FLOAT:
-        f32dest[0] = src[0] / 255.0f;
-        f32dest[1] = src[1] / 255.0f;
-        f32dest[2] = src[2] / 255.0f;
-        f32dest[3] = src[3] / 255.0f;
-        break;
-    case k3fmt::RGB10A2_UNORM:
-        color32r = src[0]; color32r = (color32r << 2) | (color32r >> 6);
-        color32g = src[1]; color32g = (color32g << 2) | (color32g >> 6);
-        color32b = src[2]; color32b = (color32b << 2) | (color32b >> 6);
-        color32a = src[3] >> 6;
-        u32dest[0] = (color32r << 22) | (color32g << 12) | (color32b << 2) | color32a;
-        break;
-    case k3fmt::BGR5A1_UNORM:
-        color32r = src[0] >> 3;
-        color32g = src[1] >> 3;
-        color32b = src[2] >> 3;
-        color32a = src[3] >> 7;
-        u16dest[0] = static_cast<uint16_t>((color32r << 1) | (color32g << 6) | (color32b << 11) | color32a);
-        break;
-        // 3 component
-    case k3fmt::RGB8_UNORM:
-        u8dest[0] = src[0];
-        u8dest[1] = src[1];
-        u8dest[2] = src[2];
-        break;
-    case k3fmt::BGR8_UNORM:
-        u8dest[0] = src[2];
-        u8dest[1] = src[1];
-        u8dest[2] = src[0];
-        break;
-    case k3fmt::RGB32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
-        u32dest[1] = static_cast<uint32_t>(src[1] >> 7);
-        u32dest[2] = static_cast<uint32_t>(src[2] >> 7);
-        break;
-    case k3fmt::RGB32_FLOAT:
-        f32dest[0] = src[0] / 255.0f;
-        f32dest[1] = src[1] / 255.0f;
-        f32dest[2] = src[2] / 255.0f;
-        break;
-    case k3fmt::B5G6R5_UNORM:
-        color32r = src[0] >> 3;
-        color32g = src[1] >> 2;
-        color32b = src[2] >> 3;
-        u16dest[0] = static_cast<uint16_t>((color32r << 11) | (color32g << 5) | color32b);
-        break;
-        // 2 component
-    case k3fmt::RG8_UNORM:
-        u8dest[0] = src[0];
-        u8dest[1] = src[1];
-        break;
-    case k3fmt::RG16_UNORM:
-        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
-        u16dest[1] = (static_cast<uint16_t>(src[1]) << 8) | src[1];
-        break;
-    case k3fmt::RG16_UINT:
-        u16dest[0] = static_cast<uint16_t>(src[0] >> 7);
-        u16dest[1] = static_cast<uint16_t>(src[1] >> 7);
-        break;
-    case k3fmt::RG16_FLOAT:
-        u16dest[0] = ConvertFloat32ToFloat16(src[0] / 255.0f);
-        u16dest[1] = ConvertFloat32ToFloat16(src[1] / 255.0f);
-        break;
-    case k3fmt::RG32_UNORM:
-        color32r = static_cast<uint32_t>(src[0]);
-        color32g = static_cast<uint32_t>(src[1]);
-        u32dest[0] = (color32r << 24) | (color32r << 16) | (color32r << 8) | color32r;
-        u32dest[1] = (color32g << 24) | (color32g << 16) | (color32g << 8) | color32g;
-        break;
-    case k3fmt::RG32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
-        u32dest[1] = static_cast<uint32_t>(src[1] >> 7);
-        break;
-    case k3fmt::RG32_FLOAT:
-        f32dest[0] = src[0] / 255.0f;
-        f32dest[1] = src[1] / 255.0f;
-        break;
-        // 1 component
-    case k3fmt::R8_UNORM:
-        u8dest[0] = src[0];
-        break;
-    case k3fmt::A8_UNORM:
-        u8dest[0] = src[3];
-        break;
-    case k3fmt::R16_UNORM:
-        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
-        break;
-    case k3fmt::R16_UINT:
-        u16dest[0] = static_cast<uint16_t>(src[0] >> 7);
-        break;
-    case k3fmt::R16_FLOAT:
-        u16dest[0] = ConvertFloat32ToFloat16(src[0] / 255.0f);
-        break;
-    case k3fmt::R32_UNORM:
-        color32r = static_cast<uint32_t>(src[0]);
-        u32dest[0] = (color32r << 24) | (color32r << 16) | (color32r << 8) | color32r;
-        break;
-    case k3fmt::R32_UINT:
-        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
-        break;
-    case k3fmt::R32_FLOAT:
-        f32dest[0] = src[0] / 255.0f;
-        break;
+#define K3_PIXEL_CASE(F) case k3fmt::F: k3pixel<k3fmt::F>::FromUnorm8(src, dest); break;
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
         // Compressed formats
     case k3fmt::BC1_UNORM:
         CompressDXT1Block(src, static_cast<k3DXT1Block*>(dest));
@@ -1902,35 +1695,10 @@ void k3imageObj::ConvertFromUnorm8(k3fmt format, const uint8_t* src, void* dest)
         CompressATI2NBlock(src, static_cast<k3ATI2NBlock*>(dest));
         break;
     case k3fmt::BC6_UNORM:
-    case k3fmt::BC7_UNORM:
-        // TODO: implement these
+        CompressBC6HBlock(src, static_cast<k3BPTCBlock*>(dest));
         break;
-        // Depth/Stencil formats
-    case k3fmt::D16_UNORM:
-        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
-        break;
-    case k3fmt::D24X8_UNORM:
-        color32r = static_cast<uint32_t>(src[0]);
-        u32dest[0] = (color32r << 16) | (color32r << 8) | (color32r);
-        break;
-    case k3fmt::D24_UNORM_S8_UINT:
-        color32r = static_cast<uint32_t>(src[0]);
-        color32g = static_cast<uint32_t>(src[1]);
-        u32dest[0] = (color32r << 16) | (color32r << 8) | (color32r) | (color32g << 24);
-        break;
-    case k3fmt::D32_FLOAT:
-        f32dest[0] = src[0] / 255.0f;
-        break;
-    case k3fmt::D32_FLOAT_S8X24_UINT:
-        f32dest[0] = src[0] / 255.0f;
-        u32dest[1] = (static_cast<uint32_t>(src[1]) & 0xff);
-        break;
-    case k3fmt::RGB9E5_FLOAT:
-        f32src[0] = src[0] / 255.0f;
-        f32src[1] = src[1] / 255.0f;
-        f32src[2] = src[2] / 255.0f;
-        f32src[3] = src[3] / 255.0f;
-        ConvertFloat32ToRGB9E5(f32src, u32dest);
+    case k3fmt::BC7_UNORM:
+        CompressBC7Block(src, static_cast<k3BPTCBlock*>(dest));
         break;
     default:
         break;
@@ -1972,13 +1740,13 @@ uint32_t k3imageObj::GetFormatSize(k3fmt format)
     case k3fmt::D32_FLOAT:
     case k3fmt::D24_UNORM_S8_UINT:
     case k3fmt::RGB9E5_FLOAT:
+    case k3fmt::RGB10A2_UNORM:
         return 4;
 
     case k3fmt::RGB8_UNORM:
     case k3fmt::BGR8_UNORM:
         return 3;
 
-    case k3fmt::RGB10A2_UNORM:
     case k3fmt::BGR5A1_UNORM:
     case k3fmt::B5G6R5_UNORM:
     case k3fmt::RG8_UNORM:
@@ -2001,11 +1769,9 @@ uint32_t k3imageObj::GetFormatSize(k3fmt format)
     case k3fmt::BC4_UNORM:
         return 8;
     case k3fmt::BC5_UNORM:
-        return 16;
     case k3fmt::BC6_UNORM:
     case k3fmt::BC7_UNORM:
-        // TODO: check on these
-        return 0;
+        return 16;
     default:
         return 0;
     }
@@ -2062,7 +1828,6 @@ uint32_t k3imageObj::GetFormatBlockSize(k3fmt format)
     case k3fmt::BC5_UNORM:
     case k3fmt::BC6_UNORM:
     case k3fmt::BC7_UNORM:
-        // TODO: check on these
         return 4;
     default:
         return 0;
@@ -2137,8 +1902,9 @@ uint32_t k3imageObj::GetFormatNumComponents(k3fmt format)
         return 2;
 
     case k3fmt::BC6_UNORM:
+        return 3;
+
     case k3fmt::BC7_UNORM:
-        // TODO: check on these
         return 4;
     default:
         return 0;
@@ -2249,8 +2015,10 @@ uint32_t k3imageObj::GetComponentBits(k3component component, k3fmt format)
             return 0;
 
         case k3fmt::BC6_UNORM:
+            // decodes to half floats
+            if (component == k3component::ALPHA) return 0;
+            return 16;
         case k3fmt::BC7_UNORM:
-            // TODO: check on these
             return 8;
         case k3fmt::RGB9E5_FLOAT:
             if (component == k3component::ALPHA) return 5;  // for exponent
@@ -2346,8 +2114,8 @@ uint32_t k3imageObj::GetMaxComponentBits(k3fmt format)
         return 8;
 
     case k3fmt::BC6_UNORM:
+        return 16;
     case k3fmt::BC7_UNORM:
-        // TODO: check on these
         return 8;
 
     case k3fmt::D24_UNORM_S8_UINT:
@@ -2485,23 +2253,122 @@ void k3imageObj::GetWeights(float start, float end, int32_t& istart, int32_t& ie
     }
 }
 
-void k3imageObj::ReformatBuffer(uint32_t src_width, uint32_t src_height, uint32_t src_depth,
-    uint32_t src_pitch, uint32_t src_slice_pitch,
-    k3fmt src_format, const void* src_data,
-    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
-    uint32_t dest_pitch, uint32_t dest_slice_pitch,
-    k3fmt dest_format, void* dest_data,
-    const float* transform,
-    k3texAddr x_addr_mode,
-    k3texAddr y_addr_mode,
-    k3texAddr z_addr_mode)
+// Everything ReformatBuffer works out once per call; the block row tasks only read it
+struct k3reformatParams {
+    uint32_t src_width, src_height, src_depth;
+    uint32_t src_pitch, src_slice_pitch;
+    k3fmt src_format;
+    const void* src_data;
+    uint32_t src_format_size, src_block_size;
+    uint32_t dest_width, dest_height, dest_depth;
+    uint32_t dest_pitch, dest_slice_pitch;
+    k3fmt dest_format;
+    void* dest_data;
+    uint32_t dest_format_size, dest_block_size;
+    uint32_t dest_block_rows;
+    uint32_t src2dest_width, src2dest_height, src2dest_depth, src2dest_total;
+    // use unorm8 as intermediary during conversion, instead of float32
+    bool use_unorm8;
+    // NULL when the source is an integer multiple of the destination and there's no transform
+    const float* local_xform;
+    k3texAddr x_addr_mode, y_addr_mode, z_addr_mode;
+    // used instead of the per pixel path when the source and destination are the same size
+    k3rowConverter rows;
+    uint32_t row_pixels;
+    // destination block rows per task; for a compressed source without a transform, enough to
+    // cover whole source block rows, which then go through a k3sourceBlockCache
+    uint32_t task_block_rows;
+    uint32_t tasks_per_slice;
+    bool cache_src_blocks;
+};
+
+// Decoded source blocks for the rows a single task reads, so a compressed block is decoded
+// once however many destination pixels sample it
+// Blocks outside those rows, which only wrapped or mirrored addressing can reach, are decoded
+// on every fetch
+class k3sourceBlockCache
+{
+public:
+    k3sourceBlockCache(const k3reformatParams* p, uint32_t z_first, uint32_t z_count, uint32_t block_row_first, uint32_t block_row_count);
+    ~k3sourceBlockCache();
+    // Returns the decoded block holding pixel (x, y, z), as unorm8 or float4 per p->use_unorm8,
+    // and the pixel's index inside it
+    const void* Fetch(int32_t x, int32_t y, int32_t z, uint32_t* block_offset);
+
+private:
+    const k3reformatParams* _p;
+    uint32_t _z_first, _z_count;
+    uint32_t _block_row_first, _block_row_count;
+    uint32_t _block_cols;
+    uint32_t _block_bytes;
+    uint8_t* _blocks;
+    bool* _decoded;
+    float _scratch[16 * 4];
+};
+
+k3sourceBlockCache::k3sourceBlockCache(const k3reformatParams* p, uint32_t z_first, uint32_t z_count, uint32_t block_row_first, uint32_t block_row_count)
+{
+    _p = p;
+    _z_first = z_first;
+    _z_count = z_count;
+    _block_row_first = block_row_first;
+    _block_row_count = block_row_count;
+    _block_cols = (p->src_width + p->src_block_size - 1) / p->src_block_size;
+    _block_bytes = 16 * 4 * ((p->use_unorm8) ? sizeof(uint8_t) : sizeof(float));
+    uint32_t num_blocks = _z_count * _block_row_count * _block_cols;
+    _blocks = new uint8_t[num_blocks * _block_bytes];
+    _decoded = new bool[num_blocks];
+    memset(_decoded, 0, num_blocks * sizeof(bool));
+}
+
+k3sourceBlockCache::~k3sourceBlockCache()
+{
+    delete[] _blocks;
+    delete[] _decoded;
+}
+
+const void* k3sourceBlockCache::Fetch(int32_t x, int32_t y, int32_t z, uint32_t* block_offset)
+{
+    const k3reformatParams* p = _p;
+    if (x < 0 || x >= static_cast<int32_t>(p->src_width)) x = k3imageObj::CalcFinalAddress(x, p->src_width, p->x_addr_mode);
+    if (y < 0 || y >= static_cast<int32_t>(p->src_height)) y = k3imageObj::CalcFinalAddress(y, p->src_height, p->y_addr_mode);
+    if (z < 0 || z >= static_cast<int32_t>(p->src_depth)) z = k3imageObj::CalcFinalAddress(z, p->src_depth, p->z_addr_mode);
+
+    const void* src_block = k3imageObj::GetSamplePointer(x, y, z, p->src_width, p->src_height, p->src_depth, p->src_pitch, p->src_slice_pitch,
+        p->src_format_size, p->src_block_size, p->src_data, p->x_addr_mode, p->y_addr_mode, p->z_addr_mode, block_offset);
+
+    uint32_t block_col = x / p->src_block_size;
+    uint32_t block_row = y / p->src_block_size;
+    void* decoded = _scratch;
+    if (static_cast<uint32_t>(z) - _z_first < _z_count && block_row - _block_row_first < _block_row_count) {
+        uint32_t index = ((z - _z_first) * _block_row_count + (block_row - _block_row_first)) * _block_cols + block_col;
+        decoded = _blocks + index * _block_bytes;
+        if (_decoded[index]) return decoded;
+        _decoded[index] = true;
+    }
+    if (p->use_unorm8) {
+        k3imageObj::ConvertToUnorm8(p->src_format, src_block, static_cast<uint8_t*>(decoded));
+    } else {
+        k3imageObj::ConvertToFloat4(p->src_format, src_block, static_cast<float*>(decoded));
+    }
+    return decoded;
+}
+
+// Converts one row of destination blocks straight from the matching source row
+static void K3CALLBACK k3image_ReformatRow(void* context, uint32_t index)
 {
-    // If any dest parameters are set to 0, set them to the src
-    if (dest_width == 0) dest_width = src_width;
-    if (dest_height == 0) dest_height = src_height;
-    if (dest_depth == 0) dest_depth = src_depth;
-    if (dest_format == k3fmt::UNKNOWN) dest_format = src_format;
+    const k3reformatParams* p = static_cast<const k3reformatParams*>(context);
+    uint32_t udz = index / p->dest_block_rows;
+    uint32_t udy_block = index % p->dest_block_rows;
+    const uint8_t* src_row = static_cast<const uint8_t*>(p->src_data) + p->src_slice_pitch * udz + p->src_pitch * udy_block;
+    uint8_t* dest_row = static_cast<uint8_t*>(p->dest_data) + p->dest_slice_pitch * udz + p->dest_pitch * udy_block;
+    p->rows.Convert(src_row, dest_row, p->row_pixels);
+}
 
+// Fills the row of destination blocks starting at pixel row udy_block of slice udz
+// Without a transform, a compressed source is read through cache
+static void k3image_ReformatBlocks(const k3reformatParams* p, k3sourceBlockCache* cache, uint32_t udz, uint32_t udy_block)
+{
     float f32src[16 * 4];
     float f32dest[16 * 4];
 
@@ -2509,11 +2376,10 @@ void k3imageObj::ReformatBuffer(uint32_t src_width, uint32_t src_height, uint32_
     uint8_t u8dest[16 * 4];
     uint32_t u32dest[4];
 
-    // determine if we can use unorm8 as intermediary during conversion, instead of float32
-    bool use_unorm8 = false;
-
     const void* src_pixel;
     const void* last_src_pixel = NULL;
+    const uint8_t* u8block;
+    const float* f32block;
     void* dest_pixel;
 
     float weights_x[3];
@@ -2522,18 +2388,306 @@ void k3imageObj::ReformatBuffer(uint32_t src_width, uint32_t src_height, uint32_
 
     float wx, wy, wz, pix_weight;
 
-    uint32_t udx_block, udy_block, udx_block_offset, udy_block_offset, dest_block_offset;
-    uint32_t udx, udy, udz;
+    uint32_t udx_block, udx_block_offset, udy_block_offset, dest_block_offset;
+    uint32_t udx, udy;
     uint32_t src_block_offset;
     int32_t isx, isy, isz;
     int32_t isx_start, isy_start, isz_start;
     int32_t isx_end, isy_end, isz_end;
-    //float fsx, fsy, fsz;
-    float fsrc[4], fdest[4];
+    float fdest[4];
     float fsrc_start[4], fsrc_end[4];
+    float fcorner[16];
+    uint32_t corner;
+
+    uint32_t dest_block_size = p->dest_block_size;
+
+    fdest[2] = static_cast<float>(udz);
+    fdest[3] = 1.0f;
+
+    for (udx_block = 0; udx_block < p->dest_width; udx_block += dest_block_size) {
+
+        for (udy_block_offset = 0; udy_block_offset < dest_block_size; udy_block_offset++) {
+            udy = udy_block + udy_block_offset;
+            fdest[1] = static_cast<float>(udy);
+
+            for (udx_block_offset = 0; udx_block_offset < dest_block_size; udx_block_offset++) {
+                dest_block_offset = 4 * (dest_block_size * udy_block_offset + udx_block_offset);
+                udx = udx_block + udx_block_offset;
+                if (p->local_xform == NULL) {
+
+                    if (p->src2dest_total == 1) {
+                        if (cache) {
+                            u8block = static_cast<const uint8_t*>(cache->Fetch(udx, udy, udz, &src_block_offset));
+                            f32block = reinterpret_cast<const float*>(u8block);
+                        } else {
+                            src_pixel = k3imageObj::GetSamplePointer(udx, udy, udz, p->src_width, p->src_height, p->src_depth, p->src_pitch, p->src_slice_pitch, p->src_format_size, p->src_block_size,
+                                p->src_data, p->x_addr_mode, p->y_addr_mode, p->z_addr_mode, &src_block_offset);
+                            if (p->use_unorm8) k3imageObj::ConvertToUnorm8(p->src_format, src_pixel, u8src);
+                            else k3imageObj::ConvertToFloat4(p->src_format, src_pixel, f32src);
+                            u8block = u8src;
+                            f32block = f32src;
+                        }
+                        src_block_offset = src_block_offset * 4;
+                        if (p->use_unorm8) {
+                            u8dest[dest_block_offset + 0] = u8block[src_block_offset + 0];
+                            u8dest[dest_block_offset + 1] = u8block[src_block_offset + 1];
+                            u8dest[dest_block_offset + 2] = u8block[src_block_offset + 2];
+                            u8dest[dest_block_offset + 3] = u8block[src_block_offset + 3];
+                        } else {
+                            f32dest[dest_block_offset + 0] = f32block[src_block_offset + 0];
+                            f32dest[dest_block_offset + 1] = f32block[src_block_offset + 1];
+                            f32dest[dest_block_offset + 2] = f32block[src_block_offset + 2];
+                            f32dest[dest_block_offset + 3] = f32block[src_block_offset + 3];
+                        }
+                    } else {
+
+                        isx_start = p->src2dest_width * udx;
+                        isy_start = p->src2dest_height * udy;
+                        isz_start = p->src2dest_depth * udz;
+
+                        isx_end = isx_start + p->src2dest_width;
+                        isy_end = isy_start + p->src2dest_height;
+                        isz_end = isz_start + p->src2dest_depth;
+
+                        if (p->use_unorm8) {
+                            u32dest[0] = 0;
+                            u32dest[1] = 0;
+                            u32dest[2] = 0;
+                            u32dest[3] = 0;
+                        } else {
+                            f32dest[dest_block_offset + 0] = 0.0f;
+                            f32dest[dest_block_offset + 1] = 0.0f;
+                            f32dest[dest_block_offset + 2] = 0.0f;
+                            f32dest[dest_block_offset + 3] = 0.0f;
+                        }
+
+                        for (isz = isz_start; isz < isz_end; isz++) {
+                            for (isy = isy_start; isy < isy_end; isy++) {
+                                for (isx = isx_start; isx < isx_end; isx++) {
+
+                                    if (cache) {
+                                        u8block = static_cast<const uint8_t*>(cache->Fetch(isx, isy, isz, &src_block_offset));
+                                        f32block = reinterpret_cast<const float*>(u8block);
+                                    } else {
+                                        src_pixel = k3imageObj::GetSamplePointer(isx, isy, isz, p->src_width, p->src_height, p->src_depth, p->src_pitch, p->src_slice_pitch, p->src_format_size, p->src_block_size,
+                                            p->src_data, p->x_addr_mode, p->y_addr_mode, p->z_addr_mode, &src_block_offset);
+                                        if (p->use_unorm8) k3imageObj::ConvertToUnorm8(p->src_format, src_pixel, u8src);
+                                        else k3imageObj::ConvertToFloat4(p->src_format, src_pixel, f32src);
+                                        u8block = u8src;
+                                        f32block = f32src;
+                                    }
+                                    src_block_offset = src_block_offset * 4;
+                                    if (p->use_unorm8) {
+                                        u32dest[0] += u8block[src_block_offset + 0];
+                                        u32dest[1] += u8block[src_block_offset + 1];
+                                        u32dest[2] += u8block[src_block_offset + 2];
+                                        u32dest[3] += u8block[src_block_offset + 3];
+                                    } else {
+                                        f32dest[dest_block_offset + 0] += f32block[src_block_offset + 0];
+                                        f32dest[dest_block_offset + 1] += f32block[src_block_offset + 1];
+                                        f32dest[dest_block_offset + 2] += f32block[src_block_offset + 2];
+                                        f32dest[dest_block_offset + 3] += f32block[src_block_offset + 3];
+                                    }
+                                } // for(isx=isx_start; ...
+                            } // for(isy=isy_start; ...
+                        } // for( isz=isz_start; ...
+                        if (p->use_unorm8) {
+                            u32dest[0] /= p->src2dest_total;
+                            u32dest[1] /= p->src2dest_total;
+                            u32dest[2] /= p->src2dest_total;
+                            u32dest[3] /= p->src2dest_total;
+                            u8dest[dest_block_offset + 0] = static_cast<uint8_t>((u32dest[0] > 0xff) ? 0xff : u32dest[0]);
+                            u8dest[dest_block_offset + 1] = static_cast<uint8_t>((u32dest[1] > 0xff) ? 0xff : u32dest[1]);
+                            u8dest[dest_block_offset + 2] = static_cast<uint8_t>((u32dest[2] > 0xff) ? 0xff : u32dest[2]);
+                            u8dest[dest_block_offset + 3] = static_cast<uint8_t>((u32dest[3] > 0xff) ? 0xff : u32dest[3]);
+                        } else {
+                            f32dest[dest_block_offset + 0] /= p->src2dest_total;
+                            f32dest[dest_block_offset + 1] /= p->src2dest_total;
+                            f32dest[dest_block_offset + 2] /= p->src2dest_total;
+                            f32dest[dest_block_offset + 3] /= p->src2dest_total;
+                        }
+                    } // if( src2dest_total == 1 )
+
+                } else {
+                    fdest[0] = static_cast<float>(udx);
+
+                    // Transform the pixel origin and its +x, +y and +z neighbors in one batch
+                    for (corner = 0; corner < 4; corner++) {
+                        fcorner[4 * corner + 0] = fdest[0];
+                        fcorner[4 * corner + 1] = fdest[1];
+                        fcorner[4 * corner + 2] = fdest[2];
+                        fcorner[4 * corner + 3] = fdest[3];
+                    }
+                    fcorner[4] += 1.0f;
+                    fcorner[9] += 1.0f;
+                    fcorner[14] += 1.0f;
+                    k3mv4_MulArray(4, fcorner, 4, p->local_xform, 0, fcorner, 4);
+
+                    fsrc_start[0] = fcorner[0];
+                    fsrc_start[1] = fcorner[1];
+                    fsrc_start[2] = fcorner[2];
+                    fsrc_start[3] = fcorner[3];
+                    fsrc_end[0] = fcorner[0];
+                    fsrc_end[1] = fcorner[1];
+                    fsrc_end[2] = fcorner[2];
+                    fsrc_end[3] = fcorner[3];
+                    for (corner = 1; corner < 4; corner++) {
+                        k3v4_Min(fsrc_start, fcorner + 4 * corner, fsrc_start);
+                        k3v4_Max(fsrc_end, fcorner + 4 * corner, fsrc_end);
+                    }
+
+                    k3v4s_Div(fsrc_start, fsrc_start, fsrc_start[3]);
+                    k3v4s_Div(fsrc_end, fsrc_end, fsrc_end[3]);
+
+                    k3imageObj::GetWeights(fsrc_start[0], fsrc_end[0], isx_start, isx_end, weights_x);
+                    k3imageObj::GetWeights(fsrc_start[1], fsrc_end[1], isy_start, isy_end, weights_y);
+                    k3imageObj::GetWeights(fsrc_start[2], fsrc_end[2], isz_start, isz_end, weights_z);
+
+                    // Initialize the current pixel
+                    f32dest[dest_block_offset + 0] = 0.0;
+                    f32dest[dest_block_offset + 1] = 0.0;
+                    f32dest[dest_block_offset + 2] = 0.0;
+                    f32dest[dest_block_offset + 3] = 0.0;
+
+                    // Inner loops; loop through all src pixels that are covered by this dest pixel
+                    for (isz = isz_start; isz <= isz_end; isz++) {
+                        wz = (isz == isz_start) ? weights_z[0] : ((isz == isz_end) ? weights_z[2] : weights_z[1]);
+                        for (isy = isy_start; isy <= isy_end; isy++) {
+                            wy = (isy == isy_start) ? weights_y[0] : ((isy == isy_end) ? weights_y[2] : weights_y[1]);
+                            for (isx = isx_start; isx <= isx_end; isx++) {
+                                wx = (isx == isx_start) ? weights_x[0] : ((isx == isx_end) ? weights_x[2] : weights_x[1]);
+
+                                pix_weight = wx * wy * wz;
+                                src_pixel = k3imageObj::GetSamplePointer(isx, isy, isz, p->src_width, p->src_height, p->src_depth, p->src_pitch, p->src_slice_pitch, p->src_format_size, p->src_block_size,
+                                    p->src_data, p->x_addr_mode, p->y_addr_mode, p->z_addr_mode, &src_block_offset);
+                                src_block_offset = src_block_offset * 4;
+
+                                if (src_pixel != last_src_pixel) {
+                                    k3imageObj::ConvertToFloat4(p->src_format, src_pixel, f32src);
+                                    last_src_pixel = src_pixel;
+                                }
+                                f32dest[dest_block_offset + 0] += pix_weight * f32src[src_block_offset + 0];
+                                f32dest[dest_block_offset + 1] += pix_weight * f32src[src_block_offset + 1];
+                                f32dest[dest_block_offset + 2] += pix_weight * f32src[src_block_offset + 2];
+                                f32dest[dest_block_offset + 3] += pix_weight * f32src[src_block_offset + 3];
+                            } // for (isx...
+                        } // for (isy...
+                    } // for (isz...
+
+                } // if( local_xform == NULL ) {
+
+            } // for (udx_block_offset...
+        } // for (udy_block_offset...
+
+        dest_pixel = k3imageObj::GetSamplePointer(udx_block, udy_block, udz, p->dest_width, p->dest_height, p->dest_depth, p->dest_pitch, p->dest_slice_pitch, p->dest_format_size, dest_block_size, p->dest_data);
+        if (p->use_unorm8) {
+            k3imageObj::ConvertFromUnorm8(p->dest_format, u8dest, dest_pixel);
+        } else {
+            k3imageObj::ConvertFromFloat4(p->dest_format, f32dest, dest_pixel);
+        }
+    } // for (udx_block...
+}
+
+// Fills a group of destination block rows; index counts groups through all the slices
+static void K3CALLBACK k3image_ReformatBlockRows(void* context, uint32_t index)
+{
+    const k3reformatParams* p = static_cast<const k3reformatParams*>(context);
+    uint32_t udz = index / p->tasks_per_slice;
+    uint32_t first_row = (index % p->tasks_per_slice) * p->task_block_rows;
+    uint32_t end_row = first_row + p->task_block_rows;
+    if (end_row > p->dest_block_rows) end_row = p->dest_block_rows;
+    uint32_t row;
+
+    if (p->cache_src_blocks) {
+        // source rows this group reads; task_block_rows makes both ends land on source block boundaries
+        uint32_t src_rows_per_block_row = p->dest_block_size * p->src2dest_height;
+        k3sourceBlockCache cache(p, udz * p->src2dest_depth, p->src2dest_depth,
+            first_row * src_rows_per_block_row / p->src_block_size, p->task_block_rows * src_rows_per_block_row / p->src_block_size);
+        for (row = first_row; row < end_row; row++) k3image_ReformatBlocks(p, &cache, udz, row * p->dest_block_size);
+    } else {
+        for (row = first_row; row < end_row; row++) k3image_ReformatBlocks(p, NULL, udz, row * p->dest_block_size);
+    }
+}
+
+uint32_t k3imageObj::_parallel_threshold = k3imageObj::DEFAULT_PARALLEL_THRESHOLD;
+
+K3API void k3imageObj::SetParallelThreshold(uint32_t num_pixels)
+{
+    _parallel_threshold = num_pixels;
+}
+
+K3API uint32_t k3imageObj::GetParallelThreshold()
+{
+    return _parallel_threshold;
+}
+
+k3compressQuality k3imageObj::_compress_quality = k3compressQuality::NORMAL;
+
+K3API void k3imageObj::SetCompressQuality(k3compressQuality quality)
+{
+    _compress_quality = quality;
+}
+
+K3API k3compressQuality k3imageObj::GetCompressQuality()
+{
+    return _compress_quality;
+}
+
+k3compressQuality k3imageObj::_dxt_compress_quality = k3compressQuality::FAST;
+
+K3API void k3imageObj::SetDXTCompressQuality(k3compressQuality quality)
+{
+    _dxt_compress_quality = quality;
+}
+
+K3API k3compressQuality k3imageObj::GetDXTCompressQuality()
+{
+    return _dxt_compress_quality;
+}
+
+uint32_t k3imageObj::_file_compress_level = k3imageObj::DEFAULT_FILE_COMPRESS_LEVEL;
+
+K3API void k3imageObj::SetFileCompressLevel(uint32_t level)
+{
+    _file_compress_level = (level > 9) ? 9 : level;
+}
+
+K3API uint32_t k3imageObj::GetFileCompressLevel()
+{
+    return _file_compress_level;
+}
+
+bool k3imageObj::_fast_decode = false;
+
+K3API void k3imageObj::SetFastDecode(bool fast)
+{
+    _fast_decode = fast;
+}
+
+K3API bool k3imageObj::GetFastDecode()
+{
+    return _fast_decode;
+}
 
+void k3imageObj::ReformatBuffer(uint32_t src_width, uint32_t src_height, uint32_t src_depth,
+    uint32_t src_pitch, uint32_t src_slice_pitch,
+    k3fmt src_format, const void* src_data,
+    uint32_t dest_width, uint32_t dest_height, uint32_t dest_depth,
+    uint32_t dest_pitch, uint32_t dest_slice_pitch,
+    k3fmt dest_format, void* dest_data,
+    const float* transform,
+    k3texAddr x_addr_mode,
+    k3texAddr y_addr_mode,
+    k3texAddr z_addr_mode)
+{
+    // If any dest parameters are set to 0, set them to the src
+    if (dest_width == 0) dest_width = src_width;
+    if (dest_height == 0) dest_height = src_height;
+    if (dest_depth == 0) dest_depth = src_depth;
+    if (dest_format == k3fmt::UNKNOWN) dest_format = src_format;
+
+    uint32_t i;
     float local_xform_static[16];
-    float* local_xform = NULL;
     float dest_to_norm[16] = { 2.0f / dest_width, 0.0f, 0.0f,  -1.0f,
                                    0.0f, 2.0f / dest_height, 0.0f, -1.0f,
                                    0.0f, 0.0f, 2.0f / dest_depth,  -1.0f,
@@ -2543,214 +2697,79 @@ void k3imageObj::ReformatBuffer(uint32_t src_width, uint32_t src_height, uint32_
                                   0.0f, 0.0f, src_depth / 2.0f, src_depth / 2.0f,
                                   0.0f, 0.0f, 0.0f, 1.0f };
 
-    uint32_t dest_format_size = GetFormatSize(dest_format);
-    uint32_t dest_block_size = GetFormatBlockSize(dest_format);
-
-    uint32_t dest_block_width = (dest_width + dest_block_size - 1);
-    uint32_t dest_block_height = (dest_height + dest_block_size - 1);
-
-    uint32_t src2dest_width = 0, src2dest_height = 0, src2dest_depth = 0, src2dest_total = 0;
-    uint32_t src_format_size = GetFormatSize(src_format);
-    uint32_t src_block_size = GetFormatBlockSize(src_format);
+    k3reformatParams p;
+    p.src_width = src_width;
+    p.src_height = src_height;
+    p.src_depth = src_depth;
+    p.src_pitch = src_pitch;
+    p.src_slice_pitch = src_slice_pitch;
+    p.src_format = src_format;
+    p.src_data = src_data;
+    p.src_format_size = GetFormatSize(src_format);
+    p.src_block_size = GetFormatBlockSize(src_format);
+    p.dest_width = dest_width;
+    p.dest_height = dest_height;
+    p.dest_depth = dest_depth;
+    p.dest_pitch = dest_pitch;
+    p.dest_slice_pitch = dest_slice_pitch;
+    p.dest_format = dest_format;
+    p.dest_data = dest_data;
+    p.dest_format_size = GetFormatSize(dest_format);
+    p.dest_block_size = GetFormatBlockSize(dest_format);
+    p.dest_block_rows = (dest_height + p.dest_block_size - 1) / p.dest_block_size;
+    p.src2dest_width = 0;
+    p.src2dest_height = 0;
+    p.src2dest_depth = 0;
+    p.src2dest_total = 0;
+    p.use_unorm8 = false;
+    p.x_addr_mode = x_addr_mode;
+    p.y_addr_mode = y_addr_mode;
+    p.z_addr_mode = z_addr_mode;
+    p.row_pixels = 0;
+    p.task_block_rows = 1;
+    p.cache_src_blocks = false;
+    k3parallel_task_ptr task = k3image_ReformatBlockRows;
 
     if (transform == NULL && (src_width % dest_width == 0) && (src_height % dest_height == 0) && (src_depth % dest_depth == 0)) {
-        local_xform = NULL;
-        src2dest_width = src_width / dest_width;
-        src2dest_height = src_height / dest_height;
-        src2dest_depth = src_depth / dest_depth;
-        src2dest_total = src2dest_width * src2dest_height * src2dest_depth;
-        if (GetMaxComponentBits(src_format) <= 8 || GetMaxComponentBits(dest_format) <= 8) use_unorm8 = true;
+        p.local_xform = NULL;
+        p.src2dest_width = src_width / dest_width;
+        p.src2dest_height = src_height / dest_height;
+        p.src2dest_depth = src_depth / dest_depth;
+        p.src2dest_total = p.src2dest_width * p.src2dest_height * p.src2dest_depth;
+        if (GetMaxComponentBits(src_format) <= 8 || GetMaxComponentBits(dest_format) <= 8) p.use_unorm8 = true;
+        // With nothing to filter, whole rows convert at once; a row of compressed blocks only
+        // when the format is unchanged, which is a plain copy
+        if (p.src2dest_total == 1 && p.src_block_size == p.dest_block_size && p.rows.Select(src_format, dest_format)) {
+            p.row_pixels = (dest_width + p.dest_block_size - 1) / p.dest_block_size;
+            task = k3image_ReformatRow;
+        } else if (p.src_block_size > 1) {
+            // group destination block rows until they read whole source block rows, so
+            // no two tasks decode the same source block
+            p.cache_src_blocks = true;
+            while ((p.task_block_rows * p.dest_block_size * p.src2dest_height) % p.src_block_size) p.task_block_rows++;
+        }
     } else {
-        local_xform = local_xform_static;
+        float* local_xform = local_xform_static;
         if (transform == NULL) {
             k3m4_Mul(local_xform, norm_to_src, dest_to_norm);
         } else {
-            for (isx = 0; isx < 16; isx++) local_xform[isx] = transform[isx];
+            for (i = 0; i < 16; i++) local_xform[i] = transform[i];
             k3m4_Inverse(local_xform);
             k3m4_Mul(local_xform, local_xform, dest_to_norm);
             k3m4_Mul(local_xform, norm_to_src, local_xform);
         }
+        p.local_xform = local_xform;
     }
 
-    fdest[3] = 1.0f;
-    // Outer loops; loop through all pixel in the destination
-    for (udz = 0; udz < dest_depth; udz++) {
-        fdest[2] = static_cast<float>(udz);
-        //fsz = udz * src_to_dest_z;
-        //GetWeights( fsz, src_to_dest_z, isz_start, isz_end, weights_z );
-        for (udy_block = 0; udy_block < dest_block_height; udy_block += dest_block_size) {
-
-            for (udx_block = 0; udx_block < dest_block_width; udx_block += dest_block_size) {
-
-                for (udy_block_offset = 0; udy_block_offset < dest_block_size; udy_block_offset++) {
-                    udy = udy_block + udy_block_offset;
-                    fdest[1] = static_cast<float>(udy);
-                    //fsy = udy * src_to_dest_y;
-                    //GetWeights( fsy, src_to_dest_y, isy_start, isy_end, weights_y );
-
-                    for (udx_block_offset = 0; udx_block_offset < dest_block_size; udx_block_offset++) {
-                        dest_block_offset = 4 * (dest_block_size * udy_block_offset + udx_block_offset);
-                        udx = udx_block + udx_block_offset;
-                        if (local_xform == NULL) {
-
-                            if (src2dest_total == 1) {
-                                src_pixel = GetSamplePointer(udx, udy, udz, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_format_size, src_block_size,
-                                    src_data, x_addr_mode, y_addr_mode, z_addr_mode, &src_block_offset);
-                                src_block_offset = src_block_offset * 4;
-                                if (use_unorm8) {
-                                    ConvertToUnorm8(src_format, src_pixel, u8src);
-                                    u8dest[dest_block_offset + 0] = u8src[src_block_offset + 0];
-                                    u8dest[dest_block_offset + 1] = u8src[src_block_offset + 1];
-                                    u8dest[dest_block_offset + 2] = u8src[src_block_offset + 2];
-                                    u8dest[dest_block_offset + 3] = u8src[src_block_offset + 3];
-                                } else {
-                                    ConvertToFloat4(src_format, src_pixel, f32src);
-                                    f32dest[dest_block_offset + 0] = f32src[src_block_offset + 0];
-                                    f32dest[dest_block_offset + 1] = f32src[src_block_offset + 1];
-                                    f32dest[dest_block_offset + 2] = f32src[src_block_offset + 2];
-                                    f32dest[dest_block_offset + 3] = f32src[src_block_offset + 3];
-                                }
-                            } else {
-
-                                isx_start = src2dest_width * udx;
-                                isy_start = src2dest_height * udy;
-                                isz_start = src2dest_depth * udz;
-
-                                isx_end = isx_start + src2dest_width;
-                                isy_end = isy_start + src2dest_height;
-                                isz_end = isz_start + src2dest_depth;
-
-                                if (use_unorm8) {
-                                    u32dest[0] = 0;
-                                    u32dest[1] = 0;
-                                    u32dest[2] = 0;
-                                    u32dest[3] = 0;
-                                } else {
-                                    f32dest[dest_block_offset + 0] = 0.0f;
-                                    f32dest[dest_block_offset + 1] = 0.0f;
-                                    f32dest[dest_block_offset + 2] = 0.0f;
-                                    f32dest[dest_block_offset + 3] = 0.0f;
-                                }
-
-                                for (isz = isz_start; isz < isz_end; isz++) {
-                                    for (isy = isy_start; isy < isy_end; isy++) {
-                                        for (isx = isx_start; isx < isx_end; isx++) {
-
-                                            src_pixel = GetSamplePointer(isx, isy, isz, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_format_size, src_block_size,
-                                                src_data, x_addr_mode, y_addr_mode, z_addr_mode, &src_block_offset);
-                                            src_block_offset = src_block_offset * 4;
-                                            if (use_unorm8) {
-                                                ConvertToUnorm8(src_format, src_pixel, u8src);
-                                                u32dest[0] += u8src[src_block_offset + 0];
-                                                u32dest[1] += u8src[src_block_offset + 1];
-                                                u32dest[2] += u8src[src_block_offset + 2];
-                                                u32dest[3] += u8src[src_block_offset + 3];
-                                            } else {
-                                                ConvertToFloat4(src_format, src_pixel, f32src);
-                                                f32dest[dest_block_offset + 0] += f32src[src_block_offset + 0];
-                                                f32dest[dest_block_offset + 1] += f32src[src_block_offset + 1];
-                                                f32dest[dest_block_offset + 2] += f32src[src_block_offset + 2];
-                                                f32dest[dest_block_offset + 3] += f32src[src_block_offset + 3];
-                                            }
-                                        } // for(isx=isx_start; ...
-                                    } // for(isy=isy_start; ...
-                                } // for( isz=isz_start; ...
-                                if (use_unorm8) {
-                                    u32dest[0] /= src2dest_total;
-                                    u32dest[1] /= src2dest_total;
-                                    u32dest[2] /= src2dest_total;
-                                    u32dest[3] /= src2dest_total;
-                                    u8dest[dest_block_offset + 0] = static_cast<uint8_t>((u32dest[0] > 0xff) ? 0xff : u32dest[0]);
-                                    u8dest[dest_block_offset + 1] = static_cast<uint8_t>((u32dest[1] > 0xff) ? 0xff : u32dest[1]);
-                                    u8dest[dest_block_offset + 2] = static_cast<uint8_t>((u32dest[2] > 0xff) ? 0xff : u32dest[2]);
-                                    u8dest[dest_block_offset + 3] = static_cast<uint8_t>((u32dest[3] > 0xff) ? 0xff : u32dest[3]);
-                                } else {
-                                    f32dest[dest_block_offset + 0] /= src2dest_total;
-                                    f32dest[dest_block_offset + 1] /= src2dest_total;
-                                    f32dest[dest_block_offset + 2] /= src2dest_total;
-                                    f32dest[dest_block_offset + 3] /= src2dest_total;
-                                }
-                            } // if( src2dest_total == 1 )
-
-                        } else {
-                            fdest[0] = static_cast<float>(udx);
-                            //fsx = udx * src_to_dest_x;
-                            //GetWeights( fsx, src_to_dest_x, isx_start, isx_end, weights_x );
-
-                            k3mv4_Mul(fsrc_start, local_xform, fdest);
-                            fsrc_end[0] = fsrc_start[0];
-                            fsrc_end[1] = fsrc_start[1];
-                            fsrc_end[2] = fsrc_start[2];
-                            fsrc_end[3] = fsrc_start[3];
-
-                            fdest[0] += 1.0f;
-                            k3mv4_Mul(fsrc, local_xform, fdest);
-                            k3v4_Min(fsrc_start, fsrc, fsrc_start);
-                            k3v4_Max(fsrc_end, fsrc, fsrc_end);
-
-                            fdest[0] -= 1.0f; fdest[1] += 1.0f;
-                            k3mv4_Mul(fsrc, local_xform, fdest);
-                            k3v4_Min(fsrc_start, fsrc, fsrc_start);
-                            k3v4_Max(fsrc_end, fsrc, fsrc_end);
-
-                            fdest[1] -= 1.0f; fdest[2] += 1.0f;
-                            k3mv4_Mul(fsrc, local_xform, fdest);
-                            k3v4_Min(fsrc_start, fsrc, fsrc_start);
-                            k3v4_Max(fsrc_end, fsrc, fsrc_end);
-
-                            fdest[2] -= 1.0f;
-                            k3v4s_Div(fsrc_start, fsrc_start, fsrc_start[3]);
-                            k3v4s_Div(fsrc_end, fsrc_end, fsrc_end[3]);
-
-                            GetWeights(fsrc_start[0], fsrc_end[0], isx_start, isx_end, weights_x);
-                            GetWeights(fsrc_start[1], fsrc_end[1], isy_start, isy_end, weights_y);
-                            GetWeights(fsrc_start[2], fsrc_end[2], isz_start, isz_end, weights_z);
-
-                            // Initialize the current pixel
-                            f32dest[dest_block_offset + 0] = 0.0;
-                            f32dest[dest_block_offset + 1] = 0.0;
-                            f32dest[dest_block_offset + 2] = 0.0;
-                            f32dest[dest_block_offset + 3] = 0.0;
-
-                            // Inner loops; loop through all src pixels that are covered by this dest pixel
-                            for (isz = isz_start; isz <= isz_end; isz++) {
-                                wz = (isz == isz_start) ? weights_z[0] : ((isz == isz_end) ? weights_z[2] : weights_z[1]);
-                                for (isy = isy_start; isy <= isy_end; isy++) {
-                                    wy = (isy == isy_start) ? weights_y[0] : ((isy == isy_end) ? weights_y[2] : weights_y[1]);
-                                    for (isx = isx_start; isx <= isx_end; isx++) {
-                                        wx = (isx == isx_start) ? weights_x[0] : ((isx == isx_end) ? weights_x[2] : weights_x[1]);
-
-                                        pix_weight = wx * wy * wz;
-                                        src_pixel = GetSamplePointer(isx, isy, isz, src_width, src_height, src_depth, src_pitch, src_slice_pitch, src_format_size, src_block_size,
-                                            src_data, x_addr_mode, y_addr_mode, z_addr_mode, &src_block_offset);
-                                        src_block_offset = src_block_offset * 4;
-
-                                        if (src_pixel != last_src_pixel) {
-                                            ConvertToFloat4(src_format, src_pixel, f32src);
-                                            last_src_pixel = src_pixel;
-                                        }
-                                        f32dest[dest_block_offset + 0] += pix_weight * f32src[src_block_offset + 0];
-                                        f32dest[dest_block_offset + 1] += pix_weight * f32src[src_block_offset + 1];
-                                        f32dest[dest_block_offset + 2] += pix_weight * f32src[src_block_offset + 2];
-                                        f32dest[dest_block_offset + 3] += pix_weight * f32src[src_block_offset + 3];
-                                    } // for (isx...
-                                } // for (isy...
-                            } // for (isz...
-
-                        } // if( local_xform == NULL ) {
-
-                    } // for (udx_block_offset...
-                } // for (udy_block_offset...
-
-                dest_pixel = GetSamplePointer(udx_block, udy_block, udz, dest_width, dest_height, dest_depth, dest_pitch, dest_slice_pitch, dest_format_size, dest_block_size, dest_data);
-                if (use_unorm8) {
-                    ConvertFromUnorm8(dest_format, u8dest, dest_pixel);
-                } else {
-                    ConvertFromFloat4(dest_format, f32dest, dest_pixel);
-                }
-            } // for (udx_block...
-        } // for (udy_block...
-    } // for (udz
+    // Every task writes only its own destination blocks, so the tasks can run in any order
+    p.tasks_per_slice = (p.dest_block_rows + p.task_block_rows - 1) / p.task_block_rows;
+    uint32_t num_tasks = dest_depth * p.tasks_per_slice;
+    uint64_t num_pixels = static_cast<uint64_t>(dest_width) * dest_height * dest_depth;
+    if (_parallel_threshold && num_pixels >= _parallel_threshold) {
+        k3parallel::For(num_tasks, task, &p);
+    } else {
+        for (i = 0; i < num_tasks; i++) task(&p, i);
+    }
 }
 
 void k3imageObj::SampleBuffer(float x, float y, float z,
@@ -0,0 +1,204 @@
+// k3 graphics library
+// batch image loading on the parallel threads
+
+#include "k3internal.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// A dispatch thread runs one k3parallel loop over the batch, so the thread that created the batch
+// never waits on it; the pool keeps taking other loops while it runs. Each image is handed out once;
+// the batch drops its reference when it does. Images given as destinations sit in _images from the start
+class k3imageBatchImpl
+{
+public:
+    k3imageBatchImpl();
+    ~k3imageBatchImpl();
+
+    uint32_t _num_images;
+    char** _file_name;
+    uint32_t* _file_pos;
+    const void** _blob;
+    uint32_t* _blob_size;
+    k3image* _images;
+    bool* _loaded;
+    bool* _taken;
+    // indices in the order they finished loading; WaitForNext reads from _next_done
+    uint32_t* _done_order;
+    uint32_t _num_done;
+    uint32_t _next_done;
+    std::atomic<bool> _cancel;
+    std::mutex _mutex;
+    std::condition_variable _image_loaded;
+    std::thread _dispatch;
+};
+
+k3imageBatchImpl::k3imageBatchImpl() :
+    _num_images(0), _file_name(NULL), _file_pos(NULL), _blob(NULL), _blob_size(NULL), _images(NULL), _loaded(NULL), _taken(NULL),
+    _done_order(NULL), _num_done(0), _next_done(0), _cancel(false)
+{ }
+
+k3imageBatchImpl::~k3imageBatchImpl()
+{
+    uint32_t i;
+    if (_file_name) {
+        for (i = 0; i < _num_images; i++) delete[] _file_name[i];
+        delete[] _file_name;
+    }
+    if (_file_pos) delete[] _file_pos;
+    if (_blob) delete[] _blob;
+    if (_blob_size) delete[] _blob_size;
+    if (_images) delete[] _images;
+    if (_loaded) delete[] _loaded;
+    if (_taken) delete[] _taken;
+    if (_done_order) delete[] _done_order;
+}
+
+static void K3CALLBACK k3imageBatch_LoadTask(void* context, uint32_t index)
+{
+    k3imageBatchImpl* batch = static_cast<k3imageBatchImpl*>(context);
+    // no one else touches the image until it is loaded, so the slot is read without the lock
+    k3image img = batch->_images[index];
+    if (img == NULL) img = k3imageObj::Create();
+    if (!batch->_cancel && batch->_file_name[index] == NULL) {
+        k3imageObj::LoadFromEncodedMemory(img, batch->_blob[index], batch->_blob_size[index]);
+    } else if (!batch->_cancel) {
+        k3imageSource source(batch->_file_name[index]);
+        if (!source.IsValid()) {
+            k3error::Handler("File not found", "k3imageBatch_LoadTask");
+        } else {
+            source.SetPos(batch->_file_pos[index]);
+            k3imageObj::LoadFromSource(img, &source);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(batch->_mutex);
+    batch->_images[index] = img;
+    // Reference counts are not atomic, so this thread lets go of the image before anyone can take it
+    img = NULL;
+    batch->_loaded[index] = true;
+    batch->_done_order[batch->_num_done] = index;
+    batch->_num_done++;
+    batch->_image_loaded.notify_all();
+}
+
+static void k3imageBatch_Dispatch(k3imageBatchImpl* batch)
+{
+    k3parallel::For(batch->_num_images, k3imageBatch_LoadTask, batch);
+}
+
+k3imageBatchObj::k3imageBatchObj()
+{
+    _data = new k3imageBatchImpl;
+}
+
+k3imageBatchObj::~k3imageBatchObj()
+{
+    if (_data) {
+        _data->_cancel = true;
+        if (_data->_dispatch.joinable()) _data->_dispatch.join();
+        delete _data;
+        _data = NULL;
+    }
+}
+
+k3imageBatchImpl* k3imageBatchObj::getImpl()
+{
+    return _data;
+}
+
+const k3imageBatchImpl* k3imageBatchObj::getImpl() const
+{
+    return _data;
+}
+
+K3API k3imageBatch k3imageBatchObj::Create(uint32_t num_images, const k3imageLoadDesc* desc)
+{
+    k3imageBatch batch = new k3imageBatchObj;
+    k3imageBatchImpl* batch_impl = batch->getImpl();
+    uint32_t i;
+    size_t len;
+
+    if (num_images && desc == NULL) {
+        k3error::Handler("NULL load descriptors", "k3imageBatchObj::Create");
+        return NULL;
+    }
+
+    batch_impl->_num_images = num_images;
+    batch_impl->_file_name = new char* [num_images];
+    batch_impl->_file_pos = new uint32_t[num_images];
+    batch_impl->_blob = new const void* [num_images];
+    batch_impl->_blob_size = new uint32_t[num_images];
+    batch_impl->_images = new k3image[num_images];
+    batch_impl->_loaded = new bool[num_images];
+    batch_impl->_taken = new bool[num_images];
+    batch_impl->_done_order = new uint32_t[num_images];
+    for (i = 0; i < num_images; i++) {
+        batch_impl->_file_name[i] = NULL;
+        if (desc[i].file_name) {
+            len = strlen(desc[i].file_name);
+            batch_impl->_file_name[i] = new char[len + 1];
+            memcpy(batch_impl->_file_name[i], desc[i].file_name, len + 1);
+        }
+        batch_impl->_file_pos[i] = desc[i].file_pos;
+        batch_impl->_blob[i] = desc[i].data;
+        batch_impl->_blob_size[i] = desc[i].size;
+        batch_impl->_images[i] = desc[i].dest;
+        batch_impl->_loaded[i] = false;
+        batch_impl->_taken[i] = false;
+    }
+
+    if (num_images) batch_impl->_dispatch = std::thread(k3imageBatch_Dispatch, batch_impl);
+    return batch;
+}
+
+K3API uint32_t k3imageBatchObj::GetNumImages() const
+{
+    return _data->_num_images;
+}
+
+K3API bool k3imageBatchObj::IsLoaded(uint32_t index)
+{
+    if (index >= _data->_num_images) {
+        k3error::Handler("Illegal image index", "k3imageBatchObj::IsLoaded");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_data->_mutex);
+    return _data->_loaded[index];
+}
+
+K3API k3image k3imageBatchObj::WaitForImage(uint32_t index)
+{
+    if (index >= _data->_num_images) {
+        k3error::Handler("Illegal image index", "k3imageBatchObj::WaitForImage");
+        return NULL;
+    }
+    std::unique_lock<std::mutex> lock(_data->_mutex);
+    _data->_image_loaded.wait(lock, [&] { return _data->_loaded[index]; });
+    k3image img = _data->_images[index];
+    _data->_images[index] = NULL;
+    _data->_taken[index] = true;
+    return img;
+}
+
+K3API k3image k3imageBatchObj::WaitForNext(uint32_t* index)
+{
+    std::unique_lock<std::mutex> lock(_data->_mutex);
+    uint32_t i;
+    for (;;) {
+        while (_data->_next_done < _data->_num_done) {
+            i = _data->_done_order[_data->_next_done];
+            _data->_next_done++;
+            if (!_data->_taken[i]) {
+                k3image img = _data->_images[i];
+                _data->_images[i] = NULL;
+                _data->_taken[i] = true;
+                if (index) *index = i;
+                return img;
+            }
+        }
+        if (_data->_next_done == _data->_num_images) return NULL;
+        _data->_image_loaded.wait(lock, [&] { return _data->_next_done < _data->_num_done; });
+    }
+}
@@ -0,0 +1,143 @@
+// k3 graphics library
+// encoded image sources for the file handlers
+
+#include "k3internal.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Maps a whole file read only; returns NULL for files that are empty, too big, or can't be mapped
+static const uint8_t* k3imageSource_MapFile(const char* file_name, uint32_t* size)
+{
+    const uint8_t* data = NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && file_size.QuadPart <= 0xffffffff) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            // the view keeps the mapping alive
+            CloseHandle(mapping);
+            *size = static_cast<uint32_t>(file_size.QuadPart);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && static_cast<uint64_t>(st.st_size) <= 0xffffffff) {
+        void* view = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            data = static_cast<const uint8_t*>(view);
+            *size = static_cast<uint32_t>(st.st_size);
+        }
+    }
+    close(fd);
+#endif
+    return data;
+}
+
+static void k3imageSource_UnmapFile(const uint8_t* data, uint32_t size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<uint8_t*>(data), size);
+#endif
+}
+
+K3API k3imageSource::k3imageSource(FILE* file_handle) :
+    _file_handle(file_handle), _owns_file(false), _data(NULL), _size(0), _pos(0), _mapped(false), _eof(false)
+{ }
+
+K3API k3imageSource::k3imageSource(const void* data, uint32_t size) :
+    _file_handle(NULL), _owns_file(false), _data(static_cast<const uint8_t*>(data)), _size(size), _pos(0), _mapped(false), _eof(false)
+{ }
+
+K3API k3imageSource::k3imageSource(const char* file_name) :
+    _file_handle(NULL), _owns_file(false), _data(NULL), _size(0), _pos(0), _mapped(false), _eof(false)
+{
+    _data = k3imageSource_MapFile(file_name, &_size);
+    if (_data) {
+        _mapped = true;
+    } else {
+        _size = 0;
+        fopen_s(&_file_handle, file_name, "rb");
+        _owns_file = (_file_handle != NULL);
+    }
+}
+
+K3API k3imageSource::~k3imageSource()
+{
+    if (_mapped) k3imageSource_UnmapFile(_data, _size);
+    if (_owns_file) fclose(_file_handle);
+}
+
+K3API bool k3imageSource::IsValid() const
+{
+    return (_file_handle != NULL || _data != NULL);
+}
+
+K3API uint32_t k3imageSource::Read(void* dest, uint32_t size)
+{
+    if (_file_handle) return static_cast<uint32_t>(fread(dest, 1, size, _file_handle));
+    if (size > _size - _pos) {
+        size = _size - _pos;
+        _eof = true;
+    }
+    if (size) memcpy(dest, _data + _pos, size);
+    _pos += size;
+    return size;
+}
+
+K3API const void* k3imageSource::Map(uint32_t* size)
+{
+    if (_data == NULL) {
+        *size = 0;
+        return NULL;
+    }
+    if (*size > _size - _pos) *size = _size - _pos;
+    const void* ptr = _data + _pos;
+    _pos += *size;
+    return ptr;
+}
+
+K3API uint32_t k3imageSource::GetPos() const
+{
+    if (_file_handle) return ftell(_file_handle);
+    return _pos;
+}
+
+K3API void k3imageSource::SetPos(uint32_t pos)
+{
+    if (_file_handle) {
+        fseek(_file_handle, pos, SEEK_SET);
+    } else {
+        _pos = (pos < _size) ? pos : _size;
+        _eof = false;
+    }
+}
+
+K3API void k3imageSource::Skip(uint32_t size)
+{
+    if (_file_handle) {
+        fseek(_file_handle, size, SEEK_CUR);
+    } else {
+        _pos = (size < _size - _pos) ? _pos + size : _size;
+    }
+}
+
+K3API bool k3imageSource::AtEnd() const
+{
+    if (_file_handle) return (feof(_file_handle) != 0);
+    return _eof;
+}
@@ -0,0 +1,44 @@
+/*
+ * jsimd.h
+ *
+ * This file is not part of the IJG distribution; it was added for the k3
+ * graphics library.
+ *
+ * Hooks for SIMD versions of the decoder's innermost loops.  The IDCT,
+ * upsampling and color conversion managers ask for a routine when they
+ * select their methods; a NULL result keeps the portable C code.  Each
+ * routine produces exactly the samples of the C code it replaces.
+ *
+ * The routines live outside this directory, in src/image/jpgsimd.cpp,
+ * where the CPU feature detection is.
+ */
+
+#ifndef JSIMD_H
+#define JSIMD_H
+
+/* Same signature as the per-component upsample methods in jdsample.c */
+typedef JMETHOD(void, jsimd_upsample_ptr,
+		(j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
+
+/* Same signature as jpeg_color_deconverter's color_convert */
+typedef JMETHOD(void, jsimd_color_convert_ptr,
+		(j_decompress_ptr cinfo, JSAMPIMAGE input_buf,
+		 JDIMENSION input_row, JSAMPARRAY output_buf, int num_rows));
+
+/* Full size 8x8 IDCTs, in place of jpeg_idct_islow and jpeg_idct_ifast */
+EXTERN(inverse_DCT_method_ptr) jsimd_select_idct_islow JPP((void));
+EXTERN(inverse_DCT_method_ptr) jsimd_select_idct_ifast JPP((void));
+
+/* In place of h2v1_fancy_upsample and h2v2_fancy_upsample */
+EXTERN(jsimd_upsample_ptr) jsimd_select_h2v1_fancy_upsample JPP((void));
+EXTERN(jsimd_upsample_ptr) jsimd_select_h2v2_fancy_upsample JPP((void));
+
+/* YCbCr to RGB, in place of ycc_rgb_convert; the RGBA version writes
+ * 4 byte pixels with an opaque alpha, for applications that replace the
+ * color converter to get them.
+ */
+EXTERN(jsimd_color_convert_ptr) jsimd_select_ycc_rgb_convert JPP((void));
+EXTERN(jsimd_color_convert_ptr) jsimd_select_ycc_rgba_convert JPP((void));
+
+#endif /* JSIMD_H */
@@ -4,13 +4,22 @@
 #include "k3internal.h"
 #include "jpghandler.h"
 
+// The internals give access to the color deconverter, which LoadData replaces to write RGBA
+#define JPEG_INTERNALS
 extern "C" {
 #include "jpeg-6b/jpeglib.h"
+#include "jpeg-6b/jerror.h"
+#include "jpeg-6b/jsimd.h"
 }
 
 k3image_file_handler_t k3JPGHandler = { k3jpg_LoadHeaderInfo,
                                         k3jpg_LoadData,
-                                        k3jpg_SaveData };
+                                        k3jpg_SaveData,
+                                        NULL,
+                                        k3jpg_EndLoad,
+                                        k3jpg_LoadScaledSize,
+                                        k3jpg_LoadRegion,
+                                        NULL };
 
 struct k3_error_mgr {
     struct jpeg_error_mgr pub;	// "public" fields
@@ -28,28 +37,187 @@ jpeg_error_exit(j_common_ptr cinfo)
     longjmp(err->setjmp_buffer, 1);
 }
 
-struct jpeg_compress_struct cinfo;
-struct jpeg_decompress_struct dinfo;
-struct k3_error_mgr jerr;
+// Feeds libjpeg from a k3imageSource; a source in memory is handed over whole, so nothing is copied
+const uint32_t K3_JPG_INPUT_BUF_SIZE = 4096;
 
-void K3CALLBACK k3jpg_LoadHeaderInfo(FILE* file_handle,
+struct k3_source_mgr {
+    struct jpeg_source_mgr pub;
+    k3imageSource* source;
+    bool start_of_file;
+    JOCTET buffer[K3_JPG_INPUT_BUF_SIZE];
+};
+
+typedef struct k3_source_mgr* k3_source_ptr;
+
+METHODDEF(void)
+jpeg_init_source(j_decompress_ptr cinfo)
+{
+    k3_source_ptr src = (k3_source_ptr)cinfo->src;
+    src->start_of_file = true;
+}
+
+METHODDEF(boolean)
+jpeg_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    k3_source_ptr src = (k3_source_ptr)cinfo->src;
+    uint32_t size = 0xffffffff;
+    const JOCTET* data = (const JOCTET*)src->source->Map(&size);
+    if (data == NULL) {
+        data = src->buffer;
+        size = src->source->Read(src->buffer, K3_JPG_INPUT_BUF_SIZE);
+    }
+
+    if (size == 0) {
+        if (src->start_of_file) ERREXIT(cinfo, JERR_INPUT_EMPTY);
+        // Insert a fake EOI marker, so a truncated file decodes as much as it has
+        WARNMS(cinfo, JWRN_JPEG_EOF);
+        src->buffer[0] = (JOCTET)0xFF;
+        src->buffer[1] = (JOCTET)JPEG_EOI;
+        data = src->buffer;
+        size = 2;
+    }
+
+    src->pub.next_input_byte = data;
+    src->pub.bytes_in_buffer = size;
+    src->start_of_file = false;
+    return TRUE;
+}
+
+METHODDEF(void)
+jpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    k3_source_ptr src = (k3_source_ptr)cinfo->src;
+    if (num_bytes <= 0) return;
+    if ((size_t)num_bytes > src->pub.bytes_in_buffer) {
+        src->source->Skip(static_cast<uint32_t>(num_bytes - src->pub.bytes_in_buffer));
+        src->pub.bytes_in_buffer = 0;
+    } else {
+        src->pub.next_input_byte += num_bytes;
+        src->pub.bytes_in_buffer -= num_bytes;
+    }
+}
+
+METHODDEF(void)
+jpeg_term_source(j_decompress_ptr cinfo)
+{ }
+
+// State of one load, from LoadHeaderInfo to EndLoad
+struct k3jpgLoad {
+    struct jpeg_decompress_struct dinfo;
+    struct k3_error_mgr jerr;
+    struct k3_source_mgr src;
+};
+
+// 3 component output goes straight to RGBA with an opaque alpha, so the rows never need widening
+// The YCbCr tables are built the same way jdcolor.c builds its own, so the pixels match libjpeg's
+const int K3_JPG_SCALEBITS = 16;
+#define K3_JPG_FIX(x) ((INT32) ((x) * (1L << K3_JPG_SCALEBITS) + 0.5))
+
+struct k3jpgYccTables {
+    int cr_r[MAXJSAMPLE + 1];
+    int cb_b[MAXJSAMPLE + 1];
+    INT32 cr_g[MAXJSAMPLE + 1];
+    INT32 cb_g[MAXJSAMPLE + 1];
+};
+
+static k3jpgYccTables k3jpg_BuildYccTables()
+{
+    k3jpgYccTables tables;
+    const INT32 one_half = (INT32)1 << (K3_JPG_SCALEBITS - 1);
+    INT32 x;
+    int i;
+    SHIFT_TEMPS
+    for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
+        tables.cr_r[i] = (int)RIGHT_SHIFT(K3_JPG_FIX(1.40200) * x + one_half, K3_JPG_SCALEBITS);
+        tables.cb_b[i] = (int)RIGHT_SHIFT(K3_JPG_FIX(1.77200) * x + one_half, K3_JPG_SCALEBITS);
+        tables.cr_g[i] = (-K3_JPG_FIX(0.71414)) * x;
+        // the rounding for green is folded into the Cb table
+        tables.cb_g[i] = (-K3_JPG_FIX(0.34414)) * x + one_half;
+    }
+    return tables;
+}
+
+static const k3jpgYccTables& k3jpg_GetYccTables()
+{
+    static const k3jpgYccTables tables = k3jpg_BuildYccTables();
+    return tables;
+}
+
+METHODDEF(void)
+jpeg_ycc_rgba_convert(j_decompress_ptr cinfo, JSAMPIMAGE input_buf, JDIMENSION input_row,
+    JSAMPARRAY output_buf, int num_rows)
+{
+    const k3jpgYccTables& tables = k3jpg_GetYccTables();
+    JSAMPLE* range_limit = cinfo->sample_range_limit;
+    JDIMENSION col, num_cols = cinfo->output_width;
+    JSAMPROW in0, in1, in2, out;
+    int y, cb, cr;
+    SHIFT_TEMPS
+
+    while (--num_rows >= 0) {
+        in0 = input_buf[0][input_row];
+        in1 = input_buf[1][input_row];
+        in2 = input_buf[2][input_row];
+        input_row++;
+        out = *output_buf++;
+        for (col = 0; col < num_cols; col++) {
+            y = GETJSAMPLE(in0[col]);
+            cb = GETJSAMPLE(in1[col]);
+            cr = GETJSAMPLE(in2[col]);
+            out[0] = range_limit[y + tables.cr_r[cr]];
+            out[1] = range_limit[y + (int)RIGHT_SHIFT(tables.cb_g[cb] + tables.cr_g[cr], K3_JPG_SCALEBITS)];
+            out[2] = range_limit[y + tables.cb_b[cb]];
+            out[3] = (JSAMPLE)MAXJSAMPLE;
+            out += 4;
+        }
+    }
+}
+
+// Used where libjpeg would copy the 3 components unchanged
+METHODDEF(void)
+jpeg_rgb_rgba_convert(j_decompress_ptr cinfo, JSAMPIMAGE input_buf, JDIMENSION input_row,
+    JSAMPARRAY output_buf, int num_rows)
+{
+    JDIMENSION col, num_cols = cinfo->output_width;
+    JSAMPROW in0, in1, in2, out;
+
+    while (--num_rows >= 0) {
+        in0 = input_buf[0][input_row];
+        in1 = input_buf[1][input_row];
+        in2 = input_buf[2][input_row];
+        input_row++;
+        out = *output_buf++;
+        for (col = 0; col < num_cols; col++) {
+            out[0] = in0[col];
+            out[1] = in1[col];
+            out[2] = in2[col];
+            out[3] = (JSAMPLE)MAXJSAMPLE;
+            out += 4;
+        }
+    }
+}
+
+void K3CALLBACK k3jpg_LoadHeaderInfo(k3imageSource* source, void** context,
     uint32_t* width, uint32_t* height, uint32_t* depth, k3fmt* format)
 {
     // Mark the start position of file, in case this isn't a jpg, we must rewind
-    uint32_t start_pos = ftell(file_handle);
+    uint32_t start_pos = source->GetPos();
+    k3jpgLoad* load = new k3jpgLoad;
+    struct jpeg_decompress_struct& dinfo = load->dinfo;
 
     // We set up the normal JPEG error routines, then override error_exit.
-    dinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = jpeg_error_exit;
+    dinfo.err = jpeg_std_error(&load->jerr.pub);
+    load->jerr.pub.error_exit = jpeg_error_exit;
 
     jpeg_create_decompress(&dinfo);
 
     // Establish the setjmp return context for my_error_exit to use.
-    if (setjmp(jerr.setjmp_buffer)) {
+    if (setjmp(load->jerr.setjmp_buffer)) {
         // If we get here, the JPEG code has signaled an error.
         // We need to clean up the JPEG object, close the input file, and return.
         jpeg_destroy_decompress(&dinfo);
-        fseek(file_handle, start_pos, SEEK_SET);
+        delete load;
+        source->SetPos(start_pos);
         *width = 0;
         *height = 0;
         *depth = 0;
@@ -57,9 +225,19 @@ void K3CALLBACK k3jpg_LoadHeaderInfo(FILE* file_handle,
         return;
     }
 
-    jpeg_stdio_src(&dinfo, file_handle);
+    load->src.pub.init_source = jpeg_init_source;
+    load->src.pub.fill_input_buffer = jpeg_fill_input_buffer;
+    load->src.pub.skip_input_data = jpeg_skip_input_data;
+    load->src.pub.resync_to_restart = jpeg_resync_to_restart;
+    load->src.pub.term_source = jpeg_term_source;
+    load->src.pub.bytes_in_buffer = 0;
+    load->src.pub.next_input_byte = NULL;
+    load->src.source = source;
+    dinfo.src = &(load->src.pub);
     jpeg_read_header(&dinfo, TRUE);
-    jpeg_start_decompress(&dinfo);
+    if (k3imageObj::GetFastDecode()) dinfo.dct_method = JDCT_IFAST;
+    // decompression starts in LoadData, once LoadScaledSize has had its chance to pick a scale
+    jpeg_calc_output_dimensions(&dinfo);
 
     *width = dinfo.output_width;
     *height = dinfo.output_height;
@@ -72,53 +250,133 @@ void K3CALLBACK k3jpg_LoadHeaderInfo(FILE* file_handle,
     default: *format = k3fmt::UNKNOWN; break;
     }
 
-
+    if (*format == k3fmt::UNKNOWN) {
+        jpeg_destroy_decompress(&dinfo);
+        delete load;
+        source->SetPos(start_pos);
+        return;
+    }
+    *context = load;
 }
 
-void K3CALLBACK k3jpg_LoadData(FILE* file_handle, uint32_t pitch, uint32_t slice_pitch, void* data)
+// Decodes columns x to x + width of rows y to y + height to data. jpeg-6b can't skip rows, so the ones
+// above the region are decoded to a scratch row; decoding stops after the last row of the region
+static void k3jpg_LoadRows(k3jpgLoad* load, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t pitch, void* data)
 {
+    struct jpeg_decompress_struct& dinfo = load->dinfo;
     JSAMPLE* bitmap = static_cast<JSAMPLE*>(data);
     JSAMPLE** row_ptr;
+    JSAMPLE* scratch = NULL;
     unsigned int i;
 
     if (bitmap) {
+        // 3 component images are written as RGBA
+        uint32_t pixel_size = (dinfo.output_components == 3) ? 4 : dinfo.output_components;
+        bool whole_rows = (x == 0 && width == dinfo.output_width);
+
         // Create the row pointers
-        row_ptr = new JSAMPLE * [dinfo.output_height];
+        row_ptr = new JSAMPLE * [height];
         if (row_ptr == NULL) {
             k3error::Handler("Out of memory", "k3jpg_LoadData");
             return;
         }
+        if (y > 0 || !whole_rows) scratch = new JSAMPLE[dinfo.output_width * pixel_size];
+
+        // Errors in the image data end the load with whatever rows were decoded
+        if (setjmp(load->jerr.setjmp_buffer)) {
+            delete[] row_ptr;
+            if (scratch) delete[] scratch;
+            return;
+        }
+
+        jpeg_start_decompress(&dinfo);
+        if (dinfo.output_components == 3) {
+            // Fancy upsampling keeps libjpeg off its merged upsampler, so every row goes through cconvert
+            if (dinfo.jpeg_color_space == JCS_YCbCr && dinfo.out_color_space == JCS_RGB) {
+                jsimd_color_convert_ptr ycc_rgba_convert = jsimd_select_ycc_rgba_convert();
+                dinfo.cconvert->color_convert = (ycc_rgba_convert) ? ycc_rgba_convert : jpeg_ycc_rgba_convert;
+            } else {
+                dinfo.cconvert->color_convert = jpeg_rgb_rgba_convert;
+            }
+        }
 
         // Get the starting address of each row
-        for (i = 0; i < dinfo.output_height; i++) {
+        for (i = 0; i < height; i++) {
             row_ptr[i] = &(bitmap[i * pitch]);
         }
 
-        // Load the image to the bitmap
-        while (dinfo.output_scanline < dinfo.output_height) {
-            jpeg_read_scanlines(&dinfo, &(row_ptr[dinfo.output_scanline]),
-                dinfo.output_height - dinfo.output_scanline);
+        while (dinfo.output_scanline < y) {
+            jpeg_read_scanlines(&dinfo, &scratch, 1);
         }
 
-        if (dinfo.output_components == 3) {
-            // 3 component RGB needs to get padded out to 4 components, with alpha set to 1
-            int32_t col, row;
-            for (row = 0; row < dinfo.output_height; row++) {
-                JSAMPLE* cur_row = row_ptr[row];
-                for (col = dinfo.output_width - 1; col >= 0; col--) {
-                    cur_row[4 * col + 3] = 0xff;
-                    cur_row[4 * col + 2] = cur_row[3 * col + 2];
-                    cur_row[4 * col + 1] = cur_row[3 * col + 1];
-                    cur_row[4 * col + 0] = cur_row[3 * col + 0];
-                }
+        // Load the image to the bitmap
+        if (whole_rows) {
+            while (dinfo.output_scanline < y + height) {
+                jpeg_read_scanlines(&dinfo, &(row_ptr[dinfo.output_scanline - y]),
+                    y + height - dinfo.output_scanline);
+            }
+        } else {
+            while (dinfo.output_scanline < y + height) {
+                i = dinfo.output_scanline - y;
+                if (jpeg_read_scanlines(&dinfo, &scratch, 1)) memcpy(row_ptr[i], scratch + x * pixel_size, width * pixel_size);
             }
         }
 
-        jpeg_finish_decompress(&dinfo);
+        if (dinfo.output_scanline < dinfo.output_height) jpeg_abort_decompress(&dinfo);
+        else jpeg_finish_decompress(&dinfo);
         delete[] row_ptr;
+        if (scratch) delete[] scratch;
+    }
+}
+
+void K3CALLBACK k3jpg_LoadData(k3imageSource* source, void* context, uint32_t pitch, uint32_t slice_pitch, void* data)
+{
+    k3jpgLoad* load = static_cast<k3jpgLoad*>(context);
+    load->src.source = source;
+    k3jpg_LoadRows(load, 0, 0, load->dinfo.output_width, load->dinfo.output_height, pitch, data);
+}
+
+void K3CALLBACK k3jpg_LoadRegion(k3imageSource* source, void* context,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data)
+{
+    k3jpgLoad* load = static_cast<k3jpgLoad*>(context);
+    load->src.source = source;
+    k3jpg_LoadRows(load, x, y, width, height, pitch, data);
+}
+
+// libjpeg scales by 1/2, 1/4 or 1/8 inside the IDCT, rounding the size up; the smallest of those that
+// still covers the requested size is used, and the reformat after the load makes up the rest
+void K3CALLBACK k3jpg_LoadScaledSize(k3imageSource* source, void* context,
+    uint32_t dest_width, uint32_t dest_height, uint32_t* width, uint32_t* height)
+{
+    k3jpgLoad* load = static_cast<k3jpgLoad*>(context);
+    struct jpeg_decompress_struct& dinfo = load->dinfo;
+    uint32_t denom;
+
+    for (denom = 8; denom > 1; denom /= 2) {
+        if ((dinfo.image_width + denom - 1) / denom >= dest_width &&
+            (dinfo.image_height + denom - 1) / denom >= dest_height) break;
+    }
+    if (denom == 1) return;
+
+    if (setjmp(load->jerr.setjmp_buffer)) {
+        // keep the full size; LoadData computes it again when decompression starts
+        dinfo.scale_denom = 1;
+        return;
     }
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denom;
+    jpeg_calc_output_dimensions(&dinfo);
+    *width = dinfo.output_width;
+    *height = dinfo.output_height;
+}
 
-    jpeg_destroy_decompress(&dinfo);
+void K3CALLBACK k3jpg_EndLoad(void* context)
+{
+    k3jpgLoad* load = static_cast<k3jpgLoad*>(context);
+    jpeg_destroy_decompress(&(load->dinfo));
+    delete load;
 }
 
 void K3CALLBACK k3jpg_SaveData(FILE* file_handle,
@@ -0,0 +1,941 @@
+// k3 graphics library
+// simd inner loops for the bundled jpeg decoder
+
+#include "k3internal.h"
+#include "k3simd.h"
+
+// jpeg-6b picks these up through jsimd.h when it selects its IDCT, upsampling and color conversion methods
+#define JPEG_INTERNALS
+extern "C" {
+#include "jpeg-6b/jpeglib.h"
+#include "jpeg-6b/jdct.h"
+#include "jpeg-6b/jsimd.h"
+}
+
+#if (defined(K3_SIMD_X86) || defined(K3_SIMD_NEON)) && BITS_IN_JSAMPLE == 8
+#define K3_JPG_SIMD
+#endif
+
+#if defined(K3_JPG_SIMD)
+
+// Every kernel matches the C code it replaces sample for sample. The IDCTs work in 32 bit lanes like jidctint.c and
+// jidctfst.c do where INT32 is 32 bits; the only way to tell them apart elsewhere is a corrupt stream whose
+// coefficients overflow 32 bits
+static_assert(sizeof(ISLOW_MULT_TYPE) == 4 && sizeof(IFAST_MULT_TYPE) == 4, "jpeg multiplier tables must hold 32 bit ints");
+
+// ------------------------------------------------------------
+// IDCT
+
+// jidctint.c constants, CONST_BITS = 13
+static const int32_t K3_JPG_ISLOW_CONST_BITS = 13;
+static const int32_t K3_JPG_ISLOW_PASS1_BITS = 2;
+static const int32_t K3_JPG_FIX_0_298631336 = 2446;
+static const int32_t K3_JPG_FIX_0_390180644 = 3196;
+static const int32_t K3_JPG_FIX_0_541196100 = 4433;
+static const int32_t K3_JPG_FIX_0_765366865 = 6270;
+static const int32_t K3_JPG_FIX_0_899976223 = 7373;
+static const int32_t K3_JPG_FIX_1_175875602 = 9633;
+static const int32_t K3_JPG_FIX_1_501321110 = 12299;
+static const int32_t K3_JPG_FIX_1_847759065 = 15137;
+static const int32_t K3_JPG_FIX_1_961570560 = 16069;
+static const int32_t K3_JPG_FIX_2_053119869 = 16819;
+static const int32_t K3_JPG_FIX_2_562915447 = 20995;
+static const int32_t K3_JPG_FIX_3_072711026 = 25172;
+
+// jidctfst.c constants, CONST_BITS = 8; its descales truncate
+static const int32_t K3_JPG_IFAST_CONST_BITS = 8;
+static const int32_t K3_JPG_IFAST_PASS1_BITS = 2;
+static const int32_t K3_JPG_IFAST_FIX_1_082392200 = 277;
+static const int32_t K3_JPG_IFAST_FIX_1_414213562 = 362;
+static const int32_t K3_JPG_IFAST_FIX_1_847759065 = 473;
+static const int32_t K3_JPG_IFAST_FIX_2_613125930 = 669;
+
+// The 1-D passes below are written with k3jpg_Add, Sub, MulC, Shl, Sra and Descale, which each instruction set
+// overloads on its vector of 32 bit lanes
+
+// ifast's MULTIPLY, which drops the low bits without rounding
+#define K3JPG_IFAST_MUL(a, c) k3jpg_Sra<K3_JPG_IFAST_CONST_BITS>(k3jpg_MulC(a, c))
+
+// One 1-D pass of jidctint.c over v[0..7], one column or row per lane, in place and descaled by BITS
+// A macro rather than a function, so it takes on the instruction set of the kernel it's expanded in
+#define K3JPG_IDCT_ISLOW_1D(v, BITS) do {                                                                 \
+        auto z1 = k3jpg_MulC(k3jpg_Add(v[2], v[6]), K3_JPG_FIX_0_541196100);                               \
+        auto tmp2 = k3jpg_Add(z1, k3jpg_MulC(v[6], -K3_JPG_FIX_1_847759065));                              \
+        auto tmp3 = k3jpg_Add(z1, k3jpg_MulC(v[2], K3_JPG_FIX_0_765366865));                               \
+        auto tmp0 = k3jpg_Shl<K3_JPG_ISLOW_CONST_BITS>(k3jpg_Add(v[0], v[4]));                             \
+        auto tmp1 = k3jpg_Shl<K3_JPG_ISLOW_CONST_BITS>(k3jpg_Sub(v[0], v[4]));                             \
+        auto tmp10 = k3jpg_Add(tmp0, tmp3);                                                                \
+        auto tmp13 = k3jpg_Sub(tmp0, tmp3);                                                                \
+        auto tmp11 = k3jpg_Add(tmp1, tmp2);                                                                \
+        auto tmp12 = k3jpg_Sub(tmp1, tmp2);                                                                \
+        tmp0 = v[7];                                                                                       \
+        tmp1 = v[5];                                                                                       \
+        tmp2 = v[3];                                                                                       \
+        tmp3 = v[1];                                                                                       \
+        z1 = k3jpg_Add(tmp0, tmp3);                                                                        \
+        auto z2 = k3jpg_Add(tmp1, tmp2);                                                                   \
+        auto z3 = k3jpg_Add(tmp0, tmp2);                                                                   \
+        auto z4 = k3jpg_Add(tmp1, tmp3);                                                                   \
+        auto z5 = k3jpg_MulC(k3jpg_Add(z3, z4), K3_JPG_FIX_1_175875602);                                   \
+        tmp0 = k3jpg_MulC(tmp0, K3_JPG_FIX_0_298631336);                                                   \
+        tmp1 = k3jpg_MulC(tmp1, K3_JPG_FIX_2_053119869);                                                   \
+        tmp2 = k3jpg_MulC(tmp2, K3_JPG_FIX_3_072711026);                                                   \
+        tmp3 = k3jpg_MulC(tmp3, K3_JPG_FIX_1_501321110);                                                   \
+        z1 = k3jpg_MulC(z1, -K3_JPG_FIX_0_899976223);                                                      \
+        z2 = k3jpg_MulC(z2, -K3_JPG_FIX_2_562915447);                                                      \
+        z3 = k3jpg_Add(k3jpg_MulC(z3, -K3_JPG_FIX_1_961570560), z5);                                       \
+        z4 = k3jpg_Add(k3jpg_MulC(z4, -K3_JPG_FIX_0_390180644), z5);                                       \
+        tmp0 = k3jpg_Add(tmp0, k3jpg_Add(z1, z3));                                                         \
+        tmp1 = k3jpg_Add(tmp1, k3jpg_Add(z2, z4));                                                         \
+        tmp2 = k3jpg_Add(tmp2, k3jpg_Add(z2, z3));                                                         \
+        tmp3 = k3jpg_Add(tmp3, k3jpg_Add(z1, z4));                                                         \
+        v[0] = k3jpg_Descale<BITS>(k3jpg_Add(tmp10, tmp3));                                                \
+        v[7] = k3jpg_Descale<BITS>(k3jpg_Sub(tmp10, tmp3));                                                \
+        v[1] = k3jpg_Descale<BITS>(k3jpg_Add(tmp11, tmp2));                                                \
+        v[6] = k3jpg_Descale<BITS>(k3jpg_Sub(tmp11, tmp2));                                                \
+        v[2] = k3jpg_Descale<BITS>(k3jpg_Add(tmp12, tmp1));                                                \
+        v[5] = k3jpg_Descale<BITS>(k3jpg_Sub(tmp12, tmp1));                                                \
+        v[3] = k3jpg_Descale<BITS>(k3jpg_Add(tmp13, tmp0));                                                \
+        v[4] = k3jpg_Descale<BITS>(k3jpg_Sub(tmp13, tmp0));                                                \
+    } while (0)
+
+// One 1-D pass of jidctfst.c over v[0..7], in place; jidctfst.c leaves the descale to the very end
+#define K3JPG_IDCT_IFAST_1D(v) do {                                                                       \
+        auto tmp10 = k3jpg_Add(v[0], v[4]);                                                                \
+        auto tmp11 = k3jpg_Sub(v[0], v[4]);                                                                \
+        auto tmp13 = k3jpg_Add(v[2], v[6]);                                                                \
+        auto tmp12 = k3jpg_Sub(K3JPG_IFAST_MUL(k3jpg_Sub(v[2], v[6]), K3_JPG_IFAST_FIX_1_414213562), tmp13); \
+        auto tmp0 = k3jpg_Add(tmp10, tmp13);                                                               \
+        auto tmp3 = k3jpg_Sub(tmp10, tmp13);                                                               \
+        auto tmp1 = k3jpg_Add(tmp11, tmp12);                                                               \
+        auto tmp2 = k3jpg_Sub(tmp11, tmp12);                                                               \
+        auto z13 = k3jpg_Add(v[5], v[3]);                                                                  \
+        auto z10 = k3jpg_Sub(v[5], v[3]);                                                                  \
+        auto z11 = k3jpg_Add(v[1], v[7]);                                                                  \
+        auto z12 = k3jpg_Sub(v[1], v[7]);                                                                  \
+        auto tmp7 = k3jpg_Add(z11, z13);                                                                   \
+        tmp11 = K3JPG_IFAST_MUL(k3jpg_Sub(z11, z13), K3_JPG_IFAST_FIX_1_414213562);                        \
+        auto z5 = K3JPG_IFAST_MUL(k3jpg_Add(z10, z12), K3_JPG_IFAST_FIX_1_847759065);                      \
+        tmp10 = k3jpg_Sub(K3JPG_IFAST_MUL(z12, K3_JPG_IFAST_FIX_1_082392200), z5);                         \
+        tmp12 = k3jpg_Add(K3JPG_IFAST_MUL(z10, -K3_JPG_IFAST_FIX_2_613125930), z5);                        \
+        auto tmp6 = k3jpg_Sub(tmp12, tmp7);                                                                \
+        auto tmp5 = k3jpg_Sub(tmp11, tmp6);                                                                \
+        auto tmp4 = k3jpg_Add(tmp10, tmp5);                                                                \
+        v[0] = k3jpg_Add(tmp0, tmp7);                                                                      \
+        v[7] = k3jpg_Sub(tmp0, tmp7);                                                                      \
+        v[1] = k3jpg_Add(tmp1, tmp6);                                                                      \
+        v[6] = k3jpg_Sub(tmp1, tmp6);                                                                      \
+        v[2] = k3jpg_Add(tmp2, tmp5);                                                                      \
+        v[5] = k3jpg_Sub(tmp2, tmp5);                                                                      \
+        v[4] = k3jpg_Add(tmp3, tmp4);                                                                      \
+        v[3] = k3jpg_Sub(tmp3, tmp4);                                                                      \
+    } while (0)
+
+// ------------------------------------------------------------
+// Fancy upsampling
+// The simd loops cover the columns away from the edges, where each output needs its neighbors on both sides
+
+typedef JDIMENSION(*k3jpg_h2v1_columns_ptr)(JSAMPROW in, JSAMPROW out, JDIMENSION col, JDIMENSION end);
+typedef JDIMENSION(*k3jpg_h2v2_columns_ptr)(JSAMPROW in0, JSAMPROW in1, JSAMPROW out, JDIMENSION col, JDIMENSION end);
+
+// 3/4 of the nearer pixel plus 1/4 of the further one, for the inner columns [col, end) of h2v1_fancy_upsample
+static void k3jpg_H2V1Columns(JSAMPROW in, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    int invalue;
+    for (; col < end; col++) {
+        invalue = GETJSAMPLE(in[col]) * 3;
+        out[2 * col] = (JSAMPLE)((invalue + GETJSAMPLE(in[col - 1]) + 1) >> 2);
+        out[2 * col + 1] = (JSAMPLE)((invalue + GETJSAMPLE(in[col + 1]) + 2) >> 2);
+    }
+}
+
+// The same weights in both directions, for the inner columns [col, end) of h2v2_fancy_upsample
+// in0 is the nearer input row and in1 the further one
+static void k3jpg_H2V2Columns(JSAMPROW in0, JSAMPROW in1, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    int thiscolsum;
+    for (; col < end; col++) {
+        thiscolsum = GETJSAMPLE(in0[col]) * 3 + GETJSAMPLE(in1[col]);
+        out[2 * col] = (JSAMPLE)((thiscolsum * 3 + GETJSAMPLE(in0[col - 1]) * 3 + GETJSAMPLE(in1[col - 1]) + 8) >> 4);
+        out[2 * col + 1] = (JSAMPLE)((thiscolsum * 3 + GETJSAMPLE(in0[col + 1]) * 3 + GETJSAMPLE(in1[col + 1]) + 7) >> 4);
+    }
+}
+
+// h2v1_fancy_upsample with the inner columns handed to COLUMNS; jdsample.c only uses it for widths over 2
+template<k3jpg_h2v1_columns_ptr COLUMNS>
+static void k3jpg_H2V1FancyUpsample(j_decompress_ptr cinfo, jpeg_component_info* compptr,
+    JSAMPARRAY input_data, JSAMPARRAY* output_data_ptr)
+{
+    JSAMPARRAY output_data = *output_data_ptr;
+    JDIMENSION last = compptr->downsampled_width - 1;
+    JDIMENSION col;
+    JSAMPROW in, out;
+    int inrow;
+
+    for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
+        in = input_data[inrow];
+        out = output_data[inrow];
+        out[0] = in[0];
+        out[1] = (JSAMPLE)((GETJSAMPLE(in[0]) * 3 + GETJSAMPLE(in[1]) + 2) >> 2);
+        col = COLUMNS(in, out, 1, last);
+        k3jpg_H2V1Columns(in, out, col, last);
+        out[2 * last] = (JSAMPLE)((GETJSAMPLE(in[last]) * 3 + GETJSAMPLE(in[last - 1]) + 1) >> 2);
+        out[2 * last + 1] = in[last];
+    }
+}
+
+// h2v2_fancy_upsample with the inner columns handed to COLUMNS
+template<k3jpg_h2v2_columns_ptr COLUMNS>
+static void k3jpg_H2V2FancyUpsample(j_decompress_ptr cinfo, jpeg_component_info* compptr,
+    JSAMPARRAY input_data, JSAMPARRAY* output_data_ptr)
+{
+    JSAMPARRAY output_data = *output_data_ptr;
+    JDIMENSION last = compptr->downsampled_width - 1;
+    JDIMENSION col;
+    JSAMPROW in0, in1, out;
+    int inrow, outrow, v;
+    int firstcolsum, secondcolsum, lastcolsum, prevcolsum;
+
+    inrow = outrow = 0;
+    while (outrow < cinfo->max_v_samp_factor) {
+        for (v = 0; v < 2; v++) {
+            // the further row is the one above for the first output row, and the one below for the second
+            in0 = input_data[inrow];
+            in1 = (v == 0) ? input_data[inrow - 1] : input_data[inrow + 1];
+            out = output_data[outrow++];
+
+            firstcolsum = GETJSAMPLE(in0[0]) * 3 + GETJSAMPLE(in1[0]);
+            secondcolsum = GETJSAMPLE(in0[1]) * 3 + GETJSAMPLE(in1[1]);
+            out[0] = (JSAMPLE)((firstcolsum * 4 + 8) >> 4);
+            out[1] = (JSAMPLE)((firstcolsum * 3 + secondcolsum + 7) >> 4);
+            col = COLUMNS(in0, in1, out, 1, last);
+            k3jpg_H2V2Columns(in0, in1, out, col, last);
+            lastcolsum = GETJSAMPLE(in0[last]) * 3 + GETJSAMPLE(in1[last]);
+            prevcolsum = GETJSAMPLE(in0[last - 1]) * 3 + GETJSAMPLE(in1[last - 1]);
+            out[2 * last] = (JSAMPLE)((lastcolsum * 3 + prevcolsum + 8) >> 4);
+            out[2 * last + 1] = (JSAMPLE)((lastcolsum * 4 + 7) >> 4);
+        }
+        inrow++;
+    }
+}
+
+// ------------------------------------------------------------
+// YCbCr to RGB
+// jdcolor.c rounds FIX(c) * x + 1/2 to 16 bits through tables; the kernels compute the same sums directly
+
+static const int32_t K3_JPG_SCALEBITS = 16;
+static const int32_t K3_JPG_ONE_HALF = 1 << (K3_JPG_SCALEBITS - 1);
+static const int32_t K3_JPG_FIX_1_40200 = 91881;    // R = Y + 1.40200 * Cr
+static const int32_t K3_JPG_FIX_0_34414 = 22554;    // G = Y - 0.34414 * Cb - 0.71414 * Cr
+static const int32_t K3_JPG_FIX_0_71414 = 46802;
+static const int32_t K3_JPG_FIX_1_77200 = 116130;   // B = Y + 1.77200 * Cb
+
+static inline JSAMPLE k3jpg_Clamp(int x)
+{
+    return (JSAMPLE)((x < 0) ? 0 : (x > MAXJSAMPLE) ? MAXJSAMPLE : x);
+}
+
+// The pixels from col on, one at a time
+template<uint32_t PIXEL_SIZE>
+static void k3jpg_YccColumns(JSAMPROW in0, JSAMPROW in1, JSAMPROW in2, JSAMPROW out, JDIMENSION col, JDIMENSION num_cols)
+{
+    int y, cb, cr;
+    for (out += PIXEL_SIZE * col; col < num_cols; col++, out += PIXEL_SIZE) {
+        y = GETJSAMPLE(in0[col]);
+        cb = GETJSAMPLE(in1[col]) - CENTERJSAMPLE;
+        cr = GETJSAMPLE(in2[col]) - CENTERJSAMPLE;
+        out[0] = k3jpg_Clamp(y + ((K3_JPG_FIX_1_40200 * cr + K3_JPG_ONE_HALF) >> K3_JPG_SCALEBITS));
+        out[1] = k3jpg_Clamp(y + ((-K3_JPG_FIX_0_34414 * cb - K3_JPG_FIX_0_71414 * cr + K3_JPG_ONE_HALF) >> K3_JPG_SCALEBITS));
+        out[2] = k3jpg_Clamp(y + ((K3_JPG_FIX_1_77200 * cb + K3_JPG_ONE_HALF) >> K3_JPG_SCALEBITS));
+        if (PIXEL_SIZE == 4) out[3] = (JSAMPLE)MAXJSAMPLE;
+    }
+}
+
+// ycc_rgb_convert with the rows handed to COLUMNS
+template<uint32_t PIXEL_SIZE, JDIMENSION(*COLUMNS)(JSAMPROW, JSAMPROW, JSAMPROW, JSAMPROW, JDIMENSION)>
+static void k3jpg_YccConvert(j_decompress_ptr cinfo, JSAMPIMAGE input_buf, JDIMENSION input_row,
+    JSAMPARRAY output_buf, int num_rows)
+{
+    JDIMENSION col, num_cols = cinfo->output_width;
+    JSAMPROW in0, in1, in2, out;
+
+    while (--num_rows >= 0) {
+        in0 = input_buf[0][input_row];
+        in1 = input_buf[1][input_row];
+        in2 = input_buf[2][input_row];
+        input_row++;
+        out = *output_buf++;
+        col = COLUMNS(in0, in1, in2, out, num_cols);
+        k3jpg_YccColumns<PIXEL_SIZE>(in0, in1, in2, out, col, num_cols);
+    }
+}
+
+#if defined(K3_SIMD_X86)
+// ------------------------------------------------------------
+// x86 kernels
+
+// 32 bit lane operations for the IDCT passes
+K3_TARGET_SSE41 static inline __m128i k3jpg_Add(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+K3_TARGET_SSE41 static inline __m128i k3jpg_Sub(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+K3_TARGET_SSE41 static inline __m128i k3jpg_MulC(__m128i a, int32_t c) { return _mm_mullo_epi32(a, _mm_set1_epi32(c)); }
+template<int N>
+K3_TARGET_SSE41 static inline __m128i k3jpg_Shl(__m128i a) { return _mm_slli_epi32(a, N); }
+template<int N>
+K3_TARGET_SSE41 static inline __m128i k3jpg_Sra(__m128i a) { return _mm_srai_epi32(a, N); }
+template<int N>
+K3_TARGET_SSE41 static inline __m128i k3jpg_Descale(__m128i a) { return _mm_srai_epi32(_mm_add_epi32(a, _mm_set1_epi32(1 << (N - 1))), N); }
+
+// range_limit[x & RANGE_MASK] from the IDCTs: the low 10 bits as a signed value, recentered and clamped;
+// the clamp happens when the samples are packed to bytes
+K3_TARGET_SSE41 static inline __m128i k3jpg_RangeLimit(__m128i x)
+{
+    return _mm_add_epi32(_mm_srai_epi32(_mm_slli_epi32(x, 22), 22), _mm_set1_epi32(CENTERJSAMPLE));
+}
+
+K3_TARGET_SSE41 static inline void k3jpg_Transpose4x4(__m128i* v)
+{
+    __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+    __m128i t1 = _mm_unpackhi_epi32(v[0], v[1]);
+    __m128i t2 = _mm_unpacklo_epi32(v[2], v[3]);
+    __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+    v[0] = _mm_unpacklo_epi64(t0, t2);
+    v[1] = _mm_unpackhi_epi64(t0, t2);
+    v[2] = _mm_unpacklo_epi64(t1, t3);
+    v[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+// Loads and dequantizes a block, as 4 column halves: lo gets columns 0-3, hi columns 4-7, one vector per row
+// Returns a lane mask of the columns with no AC terms
+K3_TARGET_SSE41 static inline void k3jpg_LoadBlockSSE41(JCOEFPTR coef_block, const int32_t* quant, __m128i* lo, __m128i* hi,
+    __m128i* dc_only_lo, __m128i* dc_only_hi)
+{
+    __m128i ac = _mm_setzero_si128();
+    uint32_t i;
+    for (i = 0; i < DCTSIZE; i++) {
+        __m128i coef = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coef_block + DCTSIZE * i));
+        if (i) ac = _mm_or_si128(ac, coef);
+        lo[i] = _mm_mullo_epi32(_mm_cvtepi16_epi32(coef), _mm_loadu_si128(reinterpret_cast<const __m128i*>(quant + DCTSIZE * i)));
+        hi[i] = _mm_mullo_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(coef, 8)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(quant + DCTSIZE * i + 4)));
+    }
+    ac = _mm_cmpeq_epi16(ac, _mm_setzero_si128());
+    *dc_only_lo = _mm_cvtepi16_epi32(ac);
+    *dc_only_hi = _mm_cvtepi16_epi32(_mm_srli_si128(ac, 8));
+}
+
+// Turns the columns of the first pass into rows for the second: a gets rows 0-3 and b rows 4-7, one vector per column
+K3_TARGET_SSE41 static inline void k3jpg_TransposeHalvesSSE41(__m128i* lo, __m128i* hi, __m128i* a, __m128i* b)
+{
+    k3jpg_Transpose4x4(lo);
+    k3jpg_Transpose4x4(lo + 4);
+    k3jpg_Transpose4x4(hi);
+    k3jpg_Transpose4x4(hi + 4);
+    memcpy(a, lo, 4 * sizeof(__m128i));
+    memcpy(a + 4, hi, 4 * sizeof(__m128i));
+    memcpy(b, lo + 4, 4 * sizeof(__m128i));
+    memcpy(b + 4, hi + 4, 4 * sizeof(__m128i));
+}
+
+// Lane mask of the rows, held one per lane, whose AC terms are all 0
+K3_TARGET_SSE41 static inline __m128i k3jpg_RowsDcOnly(const __m128i* v)
+{
+    __m128i ac = _mm_or_si128(_mm_or_si128(_mm_or_si128(v[1], v[2]), _mm_or_si128(v[3], v[4])), _mm_or_si128(_mm_or_si128(v[5], v[6]), v[7]));
+    return _mm_cmpeq_epi32(ac, _mm_setzero_si128());
+}
+
+// Writes 4 rows of output, held one column per vector, with the range limit applied
+K3_TARGET_SSE41 static inline void k3jpg_StoreRowsSSE41(__m128i* v, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+    uint32_t i;
+    for (i = 0; i < DCTSIZE; i++) v[i] = k3jpg_RangeLimit(v[i]);
+    k3jpg_Transpose4x4(v);
+    k3jpg_Transpose4x4(v + 4);
+    __m128i r01 = _mm_packus_epi16(_mm_packs_epi32(v[0], v[4]), _mm_packs_epi32(v[1], v[5]));
+    __m128i r23 = _mm_packus_epi16(_mm_packs_epi32(v[2], v[6]), _mm_packs_epi32(v[3], v[7]));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(output_buf[0] + output_col), r01);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(output_buf[1] + output_col), _mm_unpackhi_epi64(r01, r01));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(output_buf[2] + output_col), r23);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(output_buf[3] + output_col), _mm_unpackhi_epi64(r23, r23));
+}
+
+// jidctint.c skips the 1-D pass for columns and rows with no AC terms; the result is the same unless the DC term
+// is big enough to overflow, so the simd versions blend the shortcut in to match it there too
+K3_TARGET_SSE41 static void k3jpg_IdctIslowSSE41(j_decompress_ptr cinfo, jpeg_component_info* compptr,
+    JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+    __m128i lo[DCTSIZE], hi[DCTSIZE], a[DCTSIZE], b[DCTSIZE];
+    __m128i dc_only_lo, dc_only_hi, dc_lo, dc_hi, dc_only_a, dc_only_b, dc_a, dc_b;
+    uint32_t i;
+
+    k3jpg_LoadBlockSSE41(coef_block, static_cast<const int32_t*>(compptr->dct_table), lo, hi, &dc_only_lo, &dc_only_hi);
+    dc_lo = k3jpg_Shl<K3_JPG_ISLOW_PASS1_BITS>(lo[0]);
+    dc_hi = k3jpg_Shl<K3_JPG_ISLOW_PASS1_BITS>(hi[0]);
+    K3JPG_IDCT_ISLOW_1D(lo, K3_JPG_ISLOW_CONST_BITS - K3_JPG_ISLOW_PASS1_BITS);
+    K3JPG_IDCT_ISLOW_1D(hi, K3_JPG_ISLOW_CONST_BITS - K3_JPG_ISLOW_PASS1_BITS);
+    for (i = 0; i < DCTSIZE; i++) {
+        lo[i] = _mm_blendv_epi8(lo[i], dc_lo, dc_only_lo);
+        hi[i] = _mm_blendv_epi8(hi[i], dc_hi, dc_only_hi);
+    }
+
+    k3jpg_TransposeHalvesSSE41(lo, hi, a, b);
+    dc_only_a = k3jpg_RowsDcOnly(a);
+    dc_only_b = k3jpg_RowsDcOnly(b);
+    dc_a = k3jpg_Descale<K3_JPG_ISLOW_PASS1_BITS + 3>(a[0]);
+    dc_b = k3jpg_Descale<K3_JPG_ISLOW_PASS1_BITS + 3>(b[0]);
+    K3JPG_IDCT_ISLOW_1D(a, K3_JPG_ISLOW_CONST_BITS + K3_JPG_ISLOW_PASS1_BITS + 3);
+    K3JPG_IDCT_ISLOW_1D(b, K3_JPG_ISLOW_CONST_BITS + K3_JPG_ISLOW_PASS1_BITS + 3);
+    for (i = 0; i < DCTSIZE; i++) {
+        a[i] = _mm_blendv_epi8(a[i], dc_a, dc_only_a);
+        b[i] = _mm_blendv_epi8(b[i], dc_b, dc_only_b);
+    }
+
+    k3jpg_StoreRowsSSE41(a, output_buf, output_col);
+    k3jpg_StoreRowsSSE41(b, output_buf + 4, output_col);
+}
+
+// jidctfst.c's shortcuts for empty columns and rows give exactly what the full pass would, so these don't need them
+K3_TARGET_SSE41 static void k3jpg_IdctIfastSSE41(j_decompress_ptr cinfo, jpeg_component_info* compptr,
+    JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+    __m128i lo[DCTSIZE], hi[DCTSIZE], a[DCTSIZE], b[DCTSIZE];
+    __m128i dc_only_lo, dc_only_hi;
+    uint32_t i;
+
+    k3jpg_LoadBlockSSE41(coef_block, static_cast<const int32_t*>(compptr->dct_table), lo, hi, &dc_only_lo, &dc_only_hi);
+    K3JPG_IDCT_IFAST_1D(lo);
+    K3JPG_IDCT_IFAST_1D(hi);
+    k3jpg_TransposeHalvesSSE41(lo, hi, a, b);
+    K3JPG_IDCT_IFAST_1D(a);
+    K3JPG_IDCT_IFAST_1D(b);
+    for (i = 0; i < DCTSIZE; i++) {
+        a[i] = k3jpg_Sra<K3_JPG_IFAST_PASS1_BITS + 3>(a[i]);
+        b[i] = k3jpg_Sra<K3_JPG_IFAST_PASS1_BITS + 3>(b[i]);
+    }
+    k3jpg_StoreRowsSSE41(a, output_buf, output_col);
+    k3jpg_StoreRowsSSE41(b, output_buf + 4, output_col);
+}
+
+// The even and odd outputs go out as the low and high bytes of each 16 bit lane, which interleaves them
+K3_TARGET_SSE41 static inline JDIMENSION k3jpg_H2V1ColumnsSSE41(JSAMPROW in, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+    for (; col + 8 <= end; col += 8) {
+        __m128i left = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + col - 1)));
+        __m128i center = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + col)));
+        __m128i right = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + col + 1)));
+        __m128i center3 = _mm_add_epi16(center, _mm_add_epi16(center, center));
+        __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(center3, left), one), 2);
+        __m128i odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(center3, right), two), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * col), _mm_or_si128(even, _mm_slli_epi16(odd, 8)));
+    }
+    return col;
+}
+
+K3_TARGET_AVX2 static JDIMENSION k3jpg_H2V1ColumnsAVX2(JSAMPROW in, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    for (; col + 16 <= end; col += 16) {
+        __m256i left = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col - 1)));
+        __m256i center = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col)));
+        __m256i right = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + col + 1)));
+        __m256i center3 = _mm256_add_epi16(center, _mm256_add_epi16(center, center));
+        __m256i even = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(center3, left), one), 2);
+        __m256i odd = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(center3, right), two), 2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * col), _mm256_or_si256(even, _mm256_slli_epi16(odd, 8)));
+    }
+    return k3jpg_H2V1ColumnsSSE41(in, out, col, end);
+}
+
+K3_TARGET_SSE41 static inline JDIMENSION k3jpg_H2V2ColumnsSSE41(JSAMPROW in0, JSAMPROW in1, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    const __m128i seven = _mm_set1_epi16(7);
+    const __m128i eight = _mm_set1_epi16(8);
+    for (; col + 8 <= end; col += 8) {
+        __m128i left = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in0 + col - 1)));
+        __m128i center = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in0 + col)));
+        __m128i right = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in0 + col + 1)));
+        left = _mm_add_epi16(_mm_add_epi16(left, _mm_add_epi16(left, left)),
+            _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in1 + col - 1))));
+        center = _mm_add_epi16(_mm_add_epi16(center, _mm_add_epi16(center, center)),
+            _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in1 + col))));
+        right = _mm_add_epi16(_mm_add_epi16(right, _mm_add_epi16(right, right)),
+            _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in1 + col + 1))));
+        __m128i center3 = _mm_add_epi16(center, _mm_add_epi16(center, center));
+        __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(center3, left), eight), 4);
+        __m128i odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(center3, right), seven), 4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * col), _mm_or_si128(even, _mm_slli_epi16(odd, 8)));
+    }
+    return col;
+}
+
+K3_TARGET_AVX2 static JDIMENSION k3jpg_H2V2ColumnsAVX2(JSAMPROW in0, JSAMPROW in1, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    const __m256i seven = _mm256_set1_epi16(7);
+    const __m256i eight = _mm256_set1_epi16(8);
+    for (; col + 16 <= end; col += 16) {
+        __m256i left = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in0 + col - 1)));
+        __m256i center = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in0 + col)));
+        __m256i right = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in0 + col + 1)));
+        left = _mm256_add_epi16(_mm256_add_epi16(left, _mm256_add_epi16(left, left)),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in1 + col - 1))));
+        center = _mm256_add_epi16(_mm256_add_epi16(center, _mm256_add_epi16(center, center)),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in1 + col))));
+        right = _mm256_add_epi16(_mm256_add_epi16(right, _mm256_add_epi16(right, right)),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in1 + col + 1))));
+        __m256i center3 = _mm256_add_epi16(center, _mm256_add_epi16(center, center));
+        __m256i even = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(center3, left), eight), 4);
+        __m256i odd = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(center3, right), seven), 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * col), _mm256_or_si256(even, _mm256_slli_epi16(odd, 8)));
+    }
+    return k3jpg_H2V2ColumnsSSE41(in0, in1, out, col, end);
+}
+
+// SSE has no 32 bit multiply of 16 bit lanes, so each constant is split into a multiple of 65536, which passes
+// through the shift exactly, and a 16 bit remainder the multiply-adds can take
+// 1.402 = 1 + 26345 / 65536, 1.772 = 2 - 14942 / 65536, -0.71414 = -1 + 18734 / 65536
+static const int16_t K3_JPG_CR_R_REM = 26345;
+static const int16_t K3_JPG_CB_B_REM = -14942;
+static const int16_t K3_JPG_CR_G_REM = 18734;
+
+// (x * c + 1/2) >> 16 for the 16 bit lanes of x, through 32 bit multiply-adds with the rounding paired with a 2
+K3_TARGET_SSE41 static inline __m128i k3jpg_MulRound(__m128i x, int16_t c)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i coef = _mm_setr_epi16(c, K3_JPG_ONE_HALF / 2, c, K3_JPG_ONE_HALF / 2, c, K3_JPG_ONE_HALF / 2, c, K3_JPG_ONE_HALF / 2);
+    __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(x, two), coef), K3_JPG_SCALEBITS);
+    __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(x, two), coef), K3_JPG_SCALEBITS);
+    return _mm_packs_epi32(lo, hi);
+}
+
+K3_TARGET_AVX2 static inline __m256i k3jpg_MulRound(__m256i x, int16_t c)
+{
+    const __m256i two = _mm256_set1_epi16(2);
+    const __m256i coef = _mm256_set1_epi32((K3_JPG_ONE_HALF / 2) << 16 | static_cast<uint16_t>(c));
+    __m256i lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(x, two), coef), K3_JPG_SCALEBITS);
+    __m256i hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(x, two), coef), K3_JPG_SCALEBITS);
+    return _mm256_packs_epi32(lo, hi);
+}
+
+// -0.34414 * Cb - 0.71414 * Cr + 1/2, >> 16, less the -Cr that goes with the remainder
+K3_TARGET_SSE41 static inline __m128i k3jpg_GreenTerm(__m128i cb, __m128i cr)
+{
+    const __m128i coef = _mm_setr_epi16(-K3_JPG_FIX_0_34414, K3_JPG_CR_G_REM, -K3_JPG_FIX_0_34414, K3_JPG_CR_G_REM,
+        -K3_JPG_FIX_0_34414, K3_JPG_CR_G_REM, -K3_JPG_FIX_0_34414, K3_JPG_CR_G_REM);
+    const __m128i one_half = _mm_set1_epi32(K3_JPG_ONE_HALF);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), coef);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), coef);
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, one_half), K3_JPG_SCALEBITS);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, one_half), K3_JPG_SCALEBITS);
+    return _mm_packs_epi32(lo, hi);
+}
+
+K3_TARGET_AVX2 static inline __m256i k3jpg_GreenTerm(__m256i cb, __m256i cr)
+{
+    const __m256i coef = _mm256_set1_epi32(static_cast<int32_t>(K3_JPG_CR_G_REM) << 16 | static_cast<uint16_t>(-K3_JPG_FIX_0_34414));
+    const __m256i one_half = _mm256_set1_epi32(K3_JPG_ONE_HALF);
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(cb, cr), coef);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(cb, cr), coef);
+    lo = _mm256_srai_epi32(_mm256_add_epi32(lo, one_half), K3_JPG_SCALEBITS);
+    hi = _mm256_srai_epi32(_mm256_add_epi32(hi, one_half), K3_JPG_SCALEBITS);
+    return _mm256_packs_epi32(lo, hi);
+}
+
+// Writes 4 RGBA pixels, dropping the alpha for 3 byte pixels
+template<uint32_t PIXEL_SIZE>
+K3_TARGET_SSE41 static inline void k3jpg_StorePixelsSSE41(JSAMPROW out, __m128i rgba)
+{
+    if (PIXEL_SIZE == 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), rgba);
+    } else {
+        __m128i rgb = _mm_shuffle_epi8(rgba, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+        int32_t tail = _mm_extract_epi32(rgb, 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), rgb);
+        memcpy(out + 8, &tail, sizeof(int32_t));
+    }
+}
+
+template<uint32_t PIXEL_SIZE>
+K3_TARGET_SSE41 static JDIMENSION k3jpg_YccColumnsSSE41(JSAMPROW in0, JSAMPROW in1, JSAMPROW in2, JSAMPROW out, JDIMENSION num_cols)
+{
+    const __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+    const __m128i alpha = _mm_set1_epi16(MAXJSAMPLE);
+    JDIMENSION col;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+        __m128i y = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in0 + col)));
+        __m128i cb = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in1 + col))), center);
+        __m128i cr = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in2 + col))), center);
+        __m128i r = _mm_add_epi16(_mm_add_epi16(y, cr), k3jpg_MulRound(cr, K3_JPG_CR_R_REM));
+        __m128i g = _mm_add_epi16(_mm_sub_epi16(y, cr), k3jpg_GreenTerm(cb, cr));
+        __m128i b = _mm_add_epi16(_mm_add_epi16(y, _mm_add_epi16(cb, cb)), k3jpg_MulRound(cb, K3_JPG_CB_B_REM));
+        // the saturating packs are the range limit
+        __m128i rb = _mm_packus_epi16(r, b);
+        __m128i ga = _mm_packus_epi16(g, alpha);
+        __m128i rg = _mm_unpacklo_epi8(rb, ga);
+        __m128i ba = _mm_unpackhi_epi8(rb, ga);
+        k3jpg_StorePixelsSSE41<PIXEL_SIZE>(out + PIXEL_SIZE * col, _mm_unpacklo_epi16(rg, ba));
+        k3jpg_StorePixelsSSE41<PIXEL_SIZE>(out + PIXEL_SIZE * (col + 4), _mm_unpackhi_epi16(rg, ba));
+    }
+    return col;
+}
+
+template<uint32_t PIXEL_SIZE>
+K3_TARGET_AVX2 static JDIMENSION k3jpg_YccColumnsAVX2(JSAMPROW in0, JSAMPROW in1, JSAMPROW in2, JSAMPROW out, JDIMENSION num_cols)
+{
+    const __m256i center = _mm256_set1_epi16(CENTERJSAMPLE);
+    const __m256i alpha = _mm256_set1_epi16(MAXJSAMPLE);
+    JDIMENSION col;
+    for (col = 0; col + 16 <= num_cols; col += 16) {
+        __m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in0 + col)));
+        __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in1 + col))), center);
+        __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in2 + col))), center);
+        __m256i r = _mm256_add_epi16(_mm256_add_epi16(y, cr), k3jpg_MulRound(cr, K3_JPG_CR_R_REM));
+        __m256i g = _mm256_add_epi16(_mm256_sub_epi16(y, cr), k3jpg_GreenTerm(cb, cr));
+        __m256i b = _mm256_add_epi16(_mm256_add_epi16(y, _mm256_add_epi16(cb, cb)), k3jpg_MulRound(cb, K3_JPG_CB_B_REM));
+        __m256i rb = _mm256_packus_epi16(r, b);
+        __m256i ga = _mm256_packus_epi16(g, alpha);
+        __m256i rg = _mm256_unpacklo_epi8(rb, ga);
+        __m256i ba = _mm256_unpackhi_epi8(rb, ga);
+        // each 128 bit lane holds its own 8 pixels, so pixels 0-3 and 8-11 come out of one unpack
+        __m256i rgba_lo = _mm256_unpacklo_epi16(rg, ba);
+        __m256i rgba_hi = _mm256_unpackhi_epi16(rg, ba);
+        __m256i rgba0 = _mm256_permute2x128_si256(rgba_lo, rgba_hi, 0x20);
+        __m256i rgba1 = _mm256_permute2x128_si256(rgba_lo, rgba_hi, 0x31);
+        if (PIXEL_SIZE == 4) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * col), rgba0);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * col + 32), rgba1);
+        } else {
+            k3jpg_StorePixelsSSE41<PIXEL_SIZE>(out + PIXEL_SIZE * col, _mm256_castsi256_si128(rgba0));
+            k3jpg_StorePixelsSSE41<PIXEL_SIZE>(out + PIXEL_SIZE * (col + 4), _mm256_extracti128_si256(rgba0, 1));
+            k3jpg_StorePixelsSSE41<PIXEL_SIZE>(out + PIXEL_SIZE * (col + 8), _mm256_castsi256_si128(rgba1));
+            k3jpg_StorePixelsSSE41<PIXEL_SIZE>(out + PIXEL_SIZE * (col + 12), _mm256_extracti128_si256(rgba1, 1));
+        }
+    }
+    return col;
+}
+
+#elif defined(K3_SIMD_NEON)
+// ------------------------------------------------------------
+// NEON kernels
+
+// 32 bit lane operations for the IDCT passes
+static inline int32x4_t k3jpg_Add(int32x4_t a, int32x4_t b) { return vaddq_s32(a, b); }
+static inline int32x4_t k3jpg_Sub(int32x4_t a, int32x4_t b) { return vsubq_s32(a, b); }
+static inline int32x4_t k3jpg_MulC(int32x4_t a, int32_t c) { return vmulq_n_s32(a, c); }
+template<int N>
+static inline int32x4_t k3jpg_Shl(int32x4_t a) { return vshlq_n_s32(a, N); }
+template<int N>
+static inline int32x4_t k3jpg_Sra(int32x4_t a) { return vshrq_n_s32(a, N); }
+// not vrshrq, whose sum doesn't wrap the way the C code's does
+template<int N>
+static inline int32x4_t k3jpg_Descale(int32x4_t a) { return vshrq_n_s32(vaddq_s32(a, vdupq_n_s32(1 << (N - 1))), N); }
+
+// range_limit[x & RANGE_MASK] from the IDCTs, as in the x86 version; the clamp happens in the narrowing to bytes
+static inline int32x4_t k3jpg_RangeLimit(int32x4_t x)
+{
+    return vaddq_s32(vshrq_n_s32(vshlq_n_s32(x, 22), 22), vdupq_n_s32(CENTERJSAMPLE));
+}
+
+static inline void k3jpg_Transpose4x4(int32x4_t* v)
+{
+    int32x4x2_t t01 = vtrnq_s32(v[0], v[1]);
+    int32x4x2_t t23 = vtrnq_s32(v[2], v[3]);
+    v[0] = vcombine_s32(vget_low_s32(t01.val[0]), vget_low_s32(t23.val[0]));
+    v[1] = vcombine_s32(vget_low_s32(t01.val[1]), vget_low_s32(t23.val[1]));
+    v[2] = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0]));
+    v[3] = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1]));
+}
+
+// Loads and dequantizes a block, as 4 column halves: lo gets columns 0-3, hi columns 4-7, one vector per row
+// Returns a lane mask of the columns with no AC terms
+static inline void k3jpg_LoadBlockNEON(JCOEFPTR coef_block, const int32_t* quant, int32x4_t* lo, int32x4_t* hi,
+    uint32x4_t* dc_only_lo, uint32x4_t* dc_only_hi)
+{
+    int16x8_t ac = vdupq_n_s16(0);
+    uint32_t i;
+    for (i = 0; i < DCTSIZE; i++) {
+        int16x8_t coef = vld1q_s16(coef_block + DCTSIZE * i);
+        if (i) ac = vorrq_s16(ac, coef);
+        lo[i] = vmulq_s32(vmovl_s16(vget_low_s16(coef)), vld1q_s32(quant + DCTSIZE * i));
+        hi[i] = vmulq_s32(vmovl_s16(vget_high_s16(coef)), vld1q_s32(quant + DCTSIZE * i + 4));
+    }
+    int16x8_t empty = vreinterpretq_s16_u16(vceqq_s16(ac, vdupq_n_s16(0)));
+    *dc_only_lo = vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(empty)));
+    *dc_only_hi = vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(empty)));
+}
+
+// Turns the columns of the first pass into rows for the second: a gets rows 0-3 and b rows 4-7, one vector per column
+static inline void k3jpg_TransposeHalvesNEON(int32x4_t* lo, int32x4_t* hi, int32x4_t* a, int32x4_t* b)
+{
+    uint32_t i;
+    k3jpg_Transpose4x4(lo);
+    k3jpg_Transpose4x4(lo + 4);
+    k3jpg_Transpose4x4(hi);
+    k3jpg_Transpose4x4(hi + 4);
+    for (i = 0; i < 4; i++) {
+        a[i] = lo[i];
+        a[i + 4] = hi[i];
+        b[i] = lo[i + 4];
+        b[i + 4] = hi[i + 4];
+    }
+}
+
+// Lane mask of the rows, held one per lane, whose AC terms are all 0
+static inline uint32x4_t k3jpg_RowsDcOnly(const int32x4_t* v)
+{
+    int32x4_t ac = vorrq_s32(vorrq_s32(vorrq_s32(v[1], v[2]), vorrq_s32(v[3], v[4])), vorrq_s32(vorrq_s32(v[5], v[6]), v[7]));
+    return vceqq_s32(ac, vdupq_n_s32(0));
+}
+
+// Writes 4 rows of output, held one column per vector, with the range limit applied
+static inline void k3jpg_StoreRowsNEON(int32x4_t* v, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+    uint32_t i;
+    for (i = 0; i < DCTSIZE; i++) v[i] = k3jpg_RangeLimit(v[i]);
+    k3jpg_Transpose4x4(v);
+    k3jpg_Transpose4x4(v + 4);
+    for (i = 0; i < 4; i++) {
+        vst1_u8(output_buf[i] + output_col, vqmovun_s16(vcombine_s16(vqmovn_s32(v[i]), vqmovn_s32(v[i + 4]))));
+    }
+}
+
+// The same blend of jidctint.c's shortcuts as the x86 version
+static void k3jpg_IdctIslowNEON(j_decompress_ptr cinfo, jpeg_component_info* compptr,
+    JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+    int32x4_t lo[DCTSIZE], hi[DCTSIZE], a[DCTSIZE], b[DCTSIZE];
+    int32x4_t dc_lo, dc_hi, dc_a, dc_b;
+    uint32x4_t dc_only_lo, dc_only_hi, dc_only_a, dc_only_b;
+    uint32_t i;
+
+    k3jpg_LoadBlockNEON(coef_block, static_cast<const int32_t*>(compptr->dct_table), lo, hi, &dc_only_lo, &dc_only_hi);
+    dc_lo = k3jpg_Shl<K3_JPG_ISLOW_PASS1_BITS>(lo[0]);
+    dc_hi = k3jpg_Shl<K3_JPG_ISLOW_PASS1_BITS>(hi[0]);
+    K3JPG_IDCT_ISLOW_1D(lo, K3_JPG_ISLOW_CONST_BITS - K3_JPG_ISLOW_PASS1_BITS);
+    K3JPG_IDCT_ISLOW_1D(hi, K3_JPG_ISLOW_CONST_BITS - K3_JPG_ISLOW_PASS1_BITS);
+    for (i = 0; i < DCTSIZE; i++) {
+        lo[i] = vbslq_s32(dc_only_lo, dc_lo, lo[i]);
+        hi[i] = vbslq_s32(dc_only_hi, dc_hi, hi[i]);
+    }
+
+    k3jpg_TransposeHalvesNEON(lo, hi, a, b);
+    dc_only_a = k3jpg_RowsDcOnly(a);
+    dc_only_b = k3jpg_RowsDcOnly(b);
+    dc_a = k3jpg_Descale<K3_JPG_ISLOW_PASS1_BITS + 3>(a[0]);
+    dc_b = k3jpg_Descale<K3_JPG_ISLOW_PASS1_BITS + 3>(b[0]);
+    K3JPG_IDCT_ISLOW_1D(a, K3_JPG_ISLOW_CONST_BITS + K3_JPG_ISLOW_PASS1_BITS + 3);
+    K3JPG_IDCT_ISLOW_1D(b, K3_JPG_ISLOW_CONST_BITS + K3_JPG_ISLOW_PASS1_BITS + 3);
+    for (i = 0; i < DCTSIZE; i++) {
+        a[i] = vbslq_s32(dc_only_a, dc_a, a[i]);
+        b[i] = vbslq_s32(dc_only_b, dc_b, b[i]);
+    }
+
+    k3jpg_StoreRowsNEON(a, output_buf, output_col);
+    k3jpg_StoreRowsNEON(b, output_buf + 4, output_col);
+}
+
+static void k3jpg_IdctIfastNEON(j_decompress_ptr cinfo, jpeg_component_info* compptr,
+    JCOEFPTR coef_block, JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+    int32x4_t lo[DCTSIZE], hi[DCTSIZE], a[DCTSIZE], b[DCTSIZE];
+    uint32x4_t dc_only_lo, dc_only_hi;
+    uint32_t i;
+
+    k3jpg_LoadBlockNEON(coef_block, static_cast<const int32_t*>(compptr->dct_table), lo, hi, &dc_only_lo, &dc_only_hi);
+    K3JPG_IDCT_IFAST_1D(lo);
+    K3JPG_IDCT_IFAST_1D(hi);
+    k3jpg_TransposeHalvesNEON(lo, hi, a, b);
+    K3JPG_IDCT_IFAST_1D(a);
+    K3JPG_IDCT_IFAST_1D(b);
+    for (i = 0; i < DCTSIZE; i++) {
+        a[i] = k3jpg_Sra<K3_JPG_IFAST_PASS1_BITS + 3>(a[i]);
+        b[i] = k3jpg_Sra<K3_JPG_IFAST_PASS1_BITS + 3>(b[i]);
+    }
+    k3jpg_StoreRowsNEON(a, output_buf, output_col);
+    k3jpg_StoreRowsNEON(b, output_buf + 4, output_col);
+}
+
+// vst2 interleaves the even and odd outputs
+static JDIMENSION k3jpg_H2V1ColumnsNEON(JSAMPROW in, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    const uint8x8_t three = vdup_n_u8(3);
+    const uint16x8_t one = vdupq_n_u16(1);
+    const uint16x8_t two = vdupq_n_u16(2);
+    uint8x8x2_t pair;
+    for (; col + 8 <= end; col += 8) {
+        uint8x8_t center = vld1_u8(in + col);
+        uint16x8_t even = vmlal_u8(vmovl_u8(vld1_u8(in + col - 1)), center, three);
+        uint16x8_t odd = vmlal_u8(vmovl_u8(vld1_u8(in + col + 1)), center, three);
+        pair.val[0] = vshrn_n_u16(vaddq_u16(even, one), 2);
+        pair.val[1] = vshrn_n_u16(vaddq_u16(odd, two), 2);
+        vst2_u8(out + 2 * col, pair);
+    }
+    return col;
+}
+
+static JDIMENSION k3jpg_H2V2ColumnsNEON(JSAMPROW in0, JSAMPROW in1, JSAMPROW out, JDIMENSION col, JDIMENSION end)
+{
+    const uint8x8_t three = vdup_n_u8(3);
+    const uint16x8_t seven = vdupq_n_u16(7);
+    const uint16x8_t eight = vdupq_n_u16(8);
+    uint8x8x2_t pair;
+    for (; col + 8 <= end; col += 8) {
+        uint16x8_t left = vmlal_u8(vmovl_u8(vld1_u8(in1 + col - 1)), vld1_u8(in0 + col - 1), three);
+        uint16x8_t center = vmlal_u8(vmovl_u8(vld1_u8(in1 + col)), vld1_u8(in0 + col), three);
+        uint16x8_t right = vmlal_u8(vmovl_u8(vld1_u8(in1 + col + 1)), vld1_u8(in0 + col + 1), three);
+        uint16x8_t center3 = vmulq_n_u16(center, 3);
+        pair.val[0] = vshrn_n_u16(vaddq_u16(vaddq_u16(center3, left), eight), 4);
+        pair.val[1] = vshrn_n_u16(vaddq_u16(vaddq_u16(center3, right), seven), 4);
+        vst2_u8(out + 2 * col, pair);
+    }
+    return col;
+}
+
+// NEON multiplies 32 bit lanes by a constant directly, so the FIX values go in whole
+// (x * c + 1/2) >> 16 for the 16 bit lanes of x
+static inline int16x8_t k3jpg_MulRound(int16x8_t x, int32_t c)
+{
+    const int32x4_t one_half = vdupq_n_s32(K3_JPG_ONE_HALF);
+    int32x4_t lo = vmlaq_n_s32(one_half, vmovl_s16(vget_low_s16(x)), c);
+    int32x4_t hi = vmlaq_n_s32(one_half, vmovl_s16(vget_high_s16(x)), c);
+    return vcombine_s16(vshrn_n_s32(lo, K3_JPG_SCALEBITS), vshrn_n_s32(hi, K3_JPG_SCALEBITS));
+}
+
+// -0.34414 * Cb - 0.71414 * Cr + 1/2, >> 16
+static inline int16x8_t k3jpg_GreenTerm(int16x8_t cb, int16x8_t cr)
+{
+    const int32x4_t one_half = vdupq_n_s32(K3_JPG_ONE_HALF);
+    int32x4_t lo = vmlaq_n_s32(vmlaq_n_s32(one_half, vmovl_s16(vget_low_s16(cb)), -K3_JPG_FIX_0_34414),
+        vmovl_s16(vget_low_s16(cr)), -K3_JPG_FIX_0_71414);
+    int32x4_t hi = vmlaq_n_s32(vmlaq_n_s32(one_half, vmovl_s16(vget_high_s16(cb)), -K3_JPG_FIX_0_34414),
+        vmovl_s16(vget_high_s16(cr)), -K3_JPG_FIX_0_71414);
+    return vcombine_s16(vshrn_n_s32(lo, K3_JPG_SCALEBITS), vshrn_n_s32(hi, K3_JPG_SCALEBITS));
+}
+
+template<uint32_t PIXEL_SIZE>
+static JDIMENSION k3jpg_YccColumnsNEON(JSAMPROW in0, JSAMPROW in1, JSAMPROW in2, JSAMPROW out, JDIMENSION num_cols)
+{
+    const int16x8_t center = vdupq_n_s16(CENTERJSAMPLE);
+    JDIMENSION col;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+        int16x8_t y = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in0 + col)));
+        int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in1 + col))), center);
+        int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in2 + col))), center);
+        // the saturating narrows are the range limit
+        uint8x8_t r = vqmovun_s16(vaddq_s16(y, k3jpg_MulRound(cr, K3_JPG_FIX_1_40200)));
+        uint8x8_t g = vqmovun_s16(vaddq_s16(y, k3jpg_GreenTerm(cb, cr)));
+        uint8x8_t b = vqmovun_s16(vaddq_s16(y, k3jpg_MulRound(cb, K3_JPG_FIX_1_77200)));
+        if (PIXEL_SIZE == 4) {
+            uint8x8x4_t rgba = { { r, g, b, vdup_n_u8(MAXJSAMPLE) } };
+            vst4_u8(out + 4 * col, rgba);
+        } else {
+            uint8x8x3_t rgb = { { r, g, b } };
+            vst3_u8(out + 3 * col, rgb);
+        }
+    }
+    return col;
+}
+
+#endif
+
+#endif
+
+// ------------------------------------------------------------
+// Method selection, called by jpeg-6b as it sets up each decompression
+
+GLOBAL(inverse_DCT_method_ptr) jsimd_select_idct_islow(void)
+{
+#if defined(K3_JPG_SIMD)
+    switch (k3math_GetSimdLevel()) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2:
+    case k3simdLevel::SSE41: return k3jpg_IdctIslowSSE41;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return k3jpg_IdctIslowNEON;
+#endif
+    default: break;
+    }
+#endif
+    return NULL;
+}
+
+GLOBAL(inverse_DCT_method_ptr) jsimd_select_idct_ifast(void)
+{
+#if defined(K3_JPG_SIMD)
+    switch (k3math_GetSimdLevel()) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2:
+    case k3simdLevel::SSE41: return k3jpg_IdctIfastSSE41;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return k3jpg_IdctIfastNEON;
+#endif
+    default: break;
+    }
+#endif
+    return NULL;
+}
+
+GLOBAL(jsimd_upsample_ptr) jsimd_select_h2v1_fancy_upsample(void)
+{
+#if defined(K3_JPG_SIMD)
+    switch (k3math_GetSimdLevel()) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2: return k3jpg_H2V1FancyUpsample<k3jpg_H2V1ColumnsAVX2>;
+    case k3simdLevel::SSE41: return k3jpg_H2V1FancyUpsample<k3jpg_H2V1ColumnsSSE41>;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return k3jpg_H2V1FancyUpsample<k3jpg_H2V1ColumnsNEON>;
+#endif
+    default: break;
+    }
+#endif
+    return NULL;
+}
+
+GLOBAL(jsimd_upsample_ptr) jsimd_select_h2v2_fancy_upsample(void)
+{
+#if defined(K3_JPG_SIMD)
+    switch (k3math_GetSimdLevel()) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2: return k3jpg_H2V2FancyUpsample<k3jpg_H2V2ColumnsAVX2>;
+    case k3simdLevel::SSE41: return k3jpg_H2V2FancyUpsample<k3jpg_H2V2ColumnsSSE41>;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return k3jpg_H2V2FancyUpsample<k3jpg_H2V2ColumnsNEON>;
+#endif
+    default: break;
+    }
+#endif
+    return NULL;
+}
+
+GLOBAL(jsimd_color_convert_ptr) jsimd_select_ycc_rgb_convert(void)
+{
+#if defined(K3_JPG_SIMD) && RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2 && RGB_PIXELSIZE == 3
+    switch (k3math_GetSimdLevel()) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2: return k3jpg_YccConvert<3, k3jpg_YccColumnsAVX2<3> >;
+    case k3simdLevel::SSE41: return k3jpg_YccConvert<3, k3jpg_YccColumnsSSE41<3> >;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return k3jpg_YccConvert<3, k3jpg_YccColumnsNEON<3> >;
+#endif
+    default: break;
+    }
+#endif
+    return NULL;
+}
+
+GLOBAL(jsimd_color_convert_ptr) jsimd_select_ycc_rgba_convert(void)
+{
+#if defined(K3_JPG_SIMD)
+    switch (k3math_GetSimdLevel()) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2: return k3jpg_YccConvert<4, k3jpg_YccColumnsAVX2<4> >;
+    case k3simdLevel::SSE41: return k3jpg_YccConvert<4, k3jpg_YccColumnsSSE41<4> >;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return k3jpg_YccConvert<4, k3jpg_YccColumnsNEON<4> >;
+#endif
+    default: break;
+    }
+#endif
+    return NULL;
+}
@@ -0,0 +1,467 @@
+// k3 graphics library
+// mip chain generation with separable downsampling filters
+
+#include "k3internal.h"
+#include "k3simd.h"
+
+// ------------------------------------------------------------
+// Filter kernels
+// x is in destination pixels; each kernel is 0 beyond its support
+
+static const double K3_MIP_PI = 3.14159265358979323846;
+static const double K3_MIP_KAISER_ALPHA = 4.0;
+
+static double k3mip_Sinc(double x)
+{
+    if (x == 0.0) return 1.0;
+    x *= K3_MIP_PI;
+    return sin(x) / x;
+}
+
+// Zeroth order modified Bessel function of the first kind, from its power series
+static double k3mip_Bessel0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    double quarter_x2 = 0.25 * x * x;
+    uint32_t k;
+    for (k = 1; term > sum * 1e-16; k++) {
+        term *= quarter_x2 / (static_cast<double>(k) * k);
+        sum += term;
+    }
+    return sum;
+}
+
+static double k3mip_GetSupport(k3mipFilter filter)
+{
+    switch (filter) {
+    case k3mipFilter::BOX:      return 0.5;
+    case k3mipFilter::TRIANGLE: return 1.0;
+    case k3mipFilter::KAISER:   return 3.0;
+    case k3mipFilter::LANCZOS:  return 3.0;
+    }
+    return 0.5;
+}
+
+static double k3mip_Evaluate(k3mipFilter filter, double x)
+{
+    double support = k3mip_GetSupport(filter);
+    double ax = fabs(x);
+    double r;
+    switch (filter) {
+    case k3mipFilter::BOX:
+        // half open, so a source pixel on the boundary of two destination pixels only lands in one
+        return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+    case k3mipFilter::TRIANGLE:
+        return (ax < 1.0) ? 1.0 - ax : 0.0;
+    case k3mipFilter::KAISER:
+        if (ax >= support) return 0.0;
+        r = ax / support;
+        return k3mip_Sinc(x) * k3mip_Bessel0(K3_MIP_KAISER_ALPHA * sqrt(1.0 - r * r)) / k3mip_Bessel0(K3_MIP_KAISER_ALPHA);
+    case k3mipFilter::LANCZOS:
+        if (ax >= support) return 0.0;
+        return k3mip_Sinc(x) * k3mip_Sinc(x / support);
+    }
+    return 0.0;
+}
+
+// Source pixels and normalized weights for every destination pixel along one axis
+// The taps of destination pixel i are start[i] up to start[i + 1]; source pixels past the
+// edges are clamped, so the edge pixel may show up more than once
+struct k3mipTaps {
+    uint32_t* start;
+    uint32_t* index;
+    float* weight;
+
+    k3mipTaps(uint32_t src_length, uint32_t dest_length, k3mipFilter filter);
+    ~k3mipTaps();
+};
+
+k3mipTaps::k3mipTaps(uint32_t src_length, uint32_t dest_length, k3mipFilter filter)
+{
+    double scale = static_cast<double>(src_length) / dest_length;
+    double support = k3mip_GetSupport(filter) * scale;
+    uint32_t max_taps = static_cast<uint32_t>(ceil(2.0 * support)) + 2;
+    double* w = new double[max_taps];
+    uint32_t i, k, num_taps;
+    int32_t j, j_first, j_last;
+    double center, sum;
+
+    start = new uint32_t[dest_length + 1];
+    index = new uint32_t[dest_length * max_taps];
+    weight = new float[dest_length * max_taps];
+
+    start[0] = 0;
+    for (i = 0; i < dest_length; i++) {
+        // pixel centers sit at n + 0.5, in both source and destination
+        center = (i + 0.5) * scale;
+        j_first = static_cast<int32_t>(floor(center - support));
+        j_last = static_cast<int32_t>(ceil(center + support));
+        num_taps = 0;
+        sum = 0.0;
+        for (j = j_first; j < j_last && num_taps < max_taps; j++) {
+            double wj = k3mip_Evaluate(filter, (j + 0.5 - center) / scale);
+            if (wj == 0.0) continue;
+            index[start[i] + num_taps] = static_cast<uint32_t>(k3imageObj::CalcFinalAddress(j, src_length, k3texAddr::CLAMP));
+            w[num_taps] = wj;
+            sum += wj;
+            num_taps++;
+        }
+        for (k = 0; k < num_taps; k++) {
+            weight[start[i] + k] = static_cast<float>(w[k] / sum);
+        }
+        start[i + 1] = start[i] + num_taps;
+    }
+    delete[] w;
+}
+
+k3mipTaps::~k3mipTaps()
+{
+    delete[] start;
+    delete[] index;
+    delete[] weight;
+}
+
+// ------------------------------------------------------------
+// Filter passes
+// Every image is rgba32 float; a pass filters one axis, and each output is summed
+// over its taps in order, starting from 0, so the simd kernels match the scalar ones bit for bit
+
+// Filters along x; src has src_length pixels and dest has dest_length pixels
+typedef void (*k3mip_row_ptr)(const float* src, float* dest, uint32_t dest_length, const k3mipTaps* taps);
+
+// Filters along y or z; src points at the first of the lines named by index, each line_floats apart,
+// and num_floats are written to dest
+typedef void (*k3mip_column_ptr)(const float* src, float* dest, uint32_t line_floats, uint32_t num_floats,
+    const uint32_t* index, const float* weight, uint32_t num_taps);
+
+static void k3mip_FilterRowScalar(const float* src, float* dest, uint32_t dest_length, const k3mipTaps* taps)
+{
+    uint32_t i, k;
+    for (i = 0; i < dest_length; i++) {
+        float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+        for (k = taps->start[i]; k < taps->start[i + 1]; k++) {
+            const float* s = src + 4 * taps->index[k];
+            float w = taps->weight[k];
+            r = r + w * s[0];
+            g = g + w * s[1];
+            b = b + w * s[2];
+            a = a + w * s[3];
+        }
+        dest[0] = r; dest[1] = g; dest[2] = b; dest[3] = a;
+        dest += 4;
+    }
+}
+
+static void k3mip_FilterColumnScalar(const float* src, float* dest, uint32_t line_floats, uint32_t num_floats,
+    const uint32_t* index, const float* weight, uint32_t num_taps)
+{
+    uint32_t f, k;
+    for (f = 0; f < num_floats; f++) {
+        float acc = 0.0f;
+        for (k = 0; k < num_taps; k++) {
+            acc = acc + weight[k] * src[static_cast<size_t>(index[k]) * line_floats + f];
+        }
+        dest[f] = acc;
+    }
+}
+
+#if defined(K3_SIMD_X86)
+// One pixel per vector; the number of taps varies per pixel, so 2 pixels per avx vector doesn't pay
+K3_TARGET_SSE41 static void k3mip_FilterRowSSE41(const float* src, float* dest, uint32_t dest_length, const k3mipTaps* taps)
+{
+    uint32_t i, k;
+    for (i = 0; i < dest_length; i++) {
+        __m128 acc = _mm_setzero_ps();
+        for (k = taps->start[i]; k < taps->start[i + 1]; k++) {
+            __m128 s = _mm_loadu_ps(src + 4 * taps->index[k]);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps->weight[k]), s));
+        }
+        _mm_storeu_ps(dest, acc);
+        dest += 4;
+    }
+}
+
+K3_TARGET_SSE41 static void k3mip_FilterColumnSSE41(const float* src, float* dest, uint32_t line_floats, uint32_t num_floats,
+    const uint32_t* index, const float* weight, uint32_t num_taps)
+{
+    uint32_t f, k;
+    // lines are whole rgba pixels, so num_floats is always a multiple of 4
+    for (f = 0; f < num_floats; f += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (k = 0; k < num_taps; k++) {
+            __m128 s = _mm_loadu_ps(src + static_cast<size_t>(index[k]) * line_floats + f);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), s));
+        }
+        _mm_storeu_ps(dest + f, acc);
+    }
+}
+
+K3_TARGET_AVX2 static void k3mip_FilterColumnAVX2(const float* src, float* dest, uint32_t line_floats, uint32_t num_floats,
+    const uint32_t* index, const float* weight, uint32_t num_taps)
+{
+    uint32_t f, k;
+    for (f = 0; f + 8 <= num_floats; f += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (k = 0; k < num_taps; k++) {
+            __m256 s = _mm256_loadu_ps(src + static_cast<size_t>(index[k]) * line_floats + f);
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weight[k]), s));
+        }
+        _mm256_storeu_ps(dest + f, acc);
+    }
+    for (; f < num_floats; f += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (k = 0; k < num_taps; k++) {
+            __m128 s = _mm_loadu_ps(src + static_cast<size_t>(index[k]) * line_floats + f);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), s));
+        }
+        _mm_storeu_ps(dest + f, acc);
+    }
+}
+#endif
+
+// Column passes are split into chunks of a line, so a depth pass over big slices still spreads across threads
+static const uint32_t K3_MIP_CHUNK_FLOATS = 4096;
+
+struct k3mipPassParams {
+    const float* src;
+    float* dest;
+    const k3mipTaps* taps;
+    // lines along the filtered axis, before and after
+    uint32_t src_length, dest_length;
+    // floats from one line to the next; 4 for a row pass
+    uint32_t line_floats;
+    // independent runs of lines; rows of the image for a row pass, slices for a y pass, 1 for a z pass
+    uint32_t num_outer;
+    uint32_t chunks_per_line;
+    k3mip_row_ptr row;
+    k3mip_column_ptr column;
+};
+
+static void K3CALLBACK k3mip_FilterRowTask(void* context, uint32_t index)
+{
+    const k3mipPassParams* p = static_cast<const k3mipPassParams*>(context);
+    const float* src = p->src + static_cast<size_t>(index) * p->src_length * 4;
+    float* dest = p->dest + static_cast<size_t>(index) * p->dest_length * 4;
+    p->row(src, dest, p->dest_length, p->taps);
+}
+
+static void K3CALLBACK k3mip_FilterColumnTask(void* context, uint32_t index)
+{
+    const k3mipPassParams* p = static_cast<const k3mipPassParams*>(context);
+    uint32_t chunk = index % p->chunks_per_line;
+    uint32_t line = index / p->chunks_per_line;
+    uint32_t i = line % p->dest_length;
+    uint32_t outer = line / p->dest_length;
+    uint32_t first_float = chunk * K3_MIP_CHUNK_FLOATS;
+    uint32_t num_floats = p->line_floats - first_float;
+    if (num_floats > K3_MIP_CHUNK_FLOATS) num_floats = K3_MIP_CHUNK_FLOATS;
+    const float* src = p->src + static_cast<size_t>(outer) * p->src_length * p->line_floats + first_float;
+    float* dest = p->dest + (static_cast<size_t>(outer) * p->dest_length + i) * p->line_floats + first_float;
+    uint32_t t = p->taps->start[i];
+    p->column(src, dest, p->line_floats, num_floats, p->taps->index + t, p->taps->weight + t, p->taps->start[i + 1] - t);
+}
+
+// ------------------------------------------------------------
+// sRGB transfer functions, applied to red, green and blue only
+
+static float k3mip_SrgbToLinear(float c)
+{
+    return (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float k3mip_LinearToSrgb(float c)
+{
+    return (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static const uint32_t K3_MIP_SRGB_TASK_PIXELS = 4096;
+
+struct k3mipSrgbParams {
+    const float* src;
+    float* dest;
+    size_t num_pixels;
+    bool to_linear;
+};
+
+static void K3CALLBACK k3mip_SrgbTask(void* context, uint32_t index)
+{
+    const k3mipSrgbParams* p = static_cast<const k3mipSrgbParams*>(context);
+    size_t first = static_cast<size_t>(index) * K3_MIP_SRGB_TASK_PIXELS;
+    size_t last = first + K3_MIP_SRGB_TASK_PIXELS;
+    if (last > p->num_pixels) last = p->num_pixels;
+    const float* s = p->src + 4 * first;
+    float* d = p->dest + 4 * first;
+    size_t i;
+    for (i = first; i < last; i++) {
+        if (p->to_linear) {
+            d[0] = k3mip_SrgbToLinear(s[0]);
+            d[1] = k3mip_SrgbToLinear(s[1]);
+            d[2] = k3mip_SrgbToLinear(s[2]);
+        } else {
+            d[0] = k3mip_LinearToSrgb(s[0]);
+            d[1] = k3mip_LinearToSrgb(s[1]);
+            d[2] = k3mip_LinearToSrgb(s[2]);
+        }
+        d[3] = s[3];
+        s += 4;
+        d += 4;
+    }
+}
+
+static void k3mip_Run(uint32_t num_tasks, k3parallel_task_ptr task, void* context, bool parallel)
+{
+    uint32_t i;
+    if (parallel) {
+        k3parallel::For(num_tasks, task, context);
+    } else {
+        for (i = 0; i < num_tasks; i++) task(context, i);
+    }
+}
+
+static void k3mip_ConvertSrgb(const float* src, float* dest, size_t num_pixels, bool to_linear, bool parallel)
+{
+    k3mipSrgbParams p = { src, dest, num_pixels, to_linear };
+    uint32_t num_tasks = static_cast<uint32_t>((num_pixels + K3_MIP_SRGB_TASK_PIXELS - 1) / K3_MIP_SRGB_TASK_PIXELS);
+    k3mip_Run(num_tasks, k3mip_SrgbTask, &p, parallel);
+}
+
+// ------------------------------------------------------------
+// k3imageObj mip generation
+
+K3API uint32_t k3imageObj::GetNumMipLevels(uint32_t width, uint32_t height, uint32_t depth)
+{
+    uint32_t levels = 1;
+    while (width > 1 || height > 1 || depth > 1) {
+        width = (width > 1) ? width >> 1 : 1;
+        height = (height > 1) ? height >> 1 : 1;
+        depth = (depth > 1) ? depth >> 1 : 1;
+        levels++;
+    }
+    return levels;
+}
+
+K3API uint32_t k3imageObj::GenerateMips(k3image src, uint32_t num_levels, k3image* mips, k3mipFilter filter, bool srgb)
+{
+    uint32_t width = src->GetWidth();
+    uint32_t height = src->GetHeight();
+    uint32_t depth = src->GetDepth();
+    k3fmt format = src->GetFormat();
+    if (width == 0 || height == 0 || depth == 0 || format == k3fmt::UNKNOWN) {
+        k3error::Handler("Source image is empty", "GenerateMips");
+        return 0;
+    }
+    uint32_t max_levels = GetNumMipLevels(width, height, depth) - 1;
+    if (num_levels > max_levels) num_levels = max_levels;
+    if (num_levels == 0) return 0;
+    if (mips == NULL) {
+        k3error::Handler("No mip array", "GenerateMips");
+        return 0;
+    }
+    const void* src_data = src->MapForRead();
+    if (src_data == NULL) {
+        src->Unmap();
+        k3error::Handler("Could not map image for read", "GenerateMips");
+        return 0;
+    }
+
+    k3mip_row_ptr row = k3mip_FilterRowScalar;
+    k3mip_column_ptr column = k3mip_FilterColumnScalar;
+#if defined(K3_SIMD_X86)
+    k3simdLevel simd_level = k3math_GetSimdLevel();
+    if (simd_level == k3simdLevel::SSE41 || simd_level == k3simdLevel::AVX2) {
+        row = k3mip_FilterRowSSE41;
+        column = (simd_level == k3simdLevel::AVX2) ? k3mip_FilterColumnAVX2 : k3mip_FilterColumnSSE41;
+    }
+#endif
+
+    // Each level is filtered x, then y, then z, ping-ponging between 2 buffers the size of the top level
+    size_t num_pixels = static_cast<size_t>(width) * height * depth;
+    float* cur = new float[4 * num_pixels];
+    float* other = new float[4 * num_pixels];
+    float* swap;
+    // the linear to sRGB copy of a level; each level is at most half the top one
+    float* encoded = (srgb) ? new float[2 * num_pixels] : NULL;
+
+    ReformatBuffer(width, height, depth, src->GetPitch(), src->GetSlicePitch(), format, src_data,
+        width, height, depth, 16 * width, 16 * width * height, k3fmt::RGBA32_FLOAT, cur,
+        NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+    // every level is filtered from the float copy, so the source is done with here
+    src->Unmap();
+    if (srgb) k3mip_ConvertSrgb(cur, cur, num_pixels, true, _parallel_threshold && num_pixels >= _parallel_threshold);
+
+    k3mipPassParams p;
+    p.row = row;
+    p.column = column;
+    uint32_t level;
+    for (level = 0; level < num_levels; level++) {
+        uint32_t dest_width = (width > 1) ? width >> 1 : 1;
+        uint32_t dest_height = (height > 1) ? height >> 1 : 1;
+        uint32_t dest_depth = (depth > 1) ? depth >> 1 : 1;
+        num_pixels = static_cast<size_t>(width) * height * depth;
+        bool parallel = (_parallel_threshold && num_pixels >= _parallel_threshold);
+
+        if (dest_width != width) {
+            k3mipTaps taps(width, dest_width, filter);
+            p.src = cur;
+            p.dest = other;
+            p.taps = &taps;
+            p.src_length = width;
+            p.dest_length = dest_width;
+            p.line_floats = 4;
+            p.num_outer = height * depth;
+            k3mip_Run(p.num_outer, k3mip_FilterRowTask, &p, parallel);
+            swap = cur; cur = other; other = swap;
+        }
+        if (dest_height != height) {
+            k3mipTaps taps(height, dest_height, filter);
+            p.src = cur;
+            p.dest = other;
+            p.taps = &taps;
+            p.src_length = height;
+            p.dest_length = dest_height;
+            p.line_floats = 4 * dest_width;
+            p.num_outer = depth;
+            p.chunks_per_line = (p.line_floats + K3_MIP_CHUNK_FLOATS - 1) / K3_MIP_CHUNK_FLOATS;
+            k3mip_Run(p.num_outer * p.dest_length * p.chunks_per_line, k3mip_FilterColumnTask, &p, parallel);
+            swap = cur; cur = other; other = swap;
+        }
+        if (dest_depth != depth) {
+            k3mipTaps taps(depth, dest_depth, filter);
+            p.src = cur;
+            p.dest = other;
+            p.taps = &taps;
+            p.src_length = depth;
+            p.dest_length = dest_depth;
+            p.line_floats = 4 * dest_width * dest_height;
+            p.num_outer = 1;
+            p.chunks_per_line = (p.line_floats + K3_MIP_CHUNK_FLOATS - 1) / K3_MIP_CHUNK_FLOATS;
+            k3mip_Run(p.num_outer * p.dest_length * p.chunks_per_line, k3mip_FilterColumnTask, &p, parallel);
+            swap = cur; cur = other; other = swap;
+        }
+
+        width = dest_width;
+        height = dest_height;
+        depth = dest_depth;
+        num_pixels = static_cast<size_t>(width) * height * depth;
+        const float* level_data = cur;
+        if (srgb) {
+            k3mip_ConvertSrgb(cur, encoded, num_pixels, false, _parallel_threshold && num_pixels >= _parallel_threshold);
+            level_data = encoded;
+        }
+
+        if (mips[level] == NULL) mips[level] = Create();
+        k3image mip = mips[level];
+        mip->SetDimensions(width, height, depth, format);
+        void* mip_data = mip->MapForWrite();
+        ReformatBuffer(width, height, depth, 16 * width, 16 * width * height, k3fmt::RGBA32_FLOAT, level_data,
+            width, height, depth, mip->GetPitch(), mip->GetSlicePitch(), format, mip_data,
+            NULL, k3texAddr::CLAMP, k3texAddr::CLAMP, k3texAddr::CLAMP);
+        mip->Unmap();
+    }
+
+    delete[] cur;
+    delete[] other;
+    if (encoded) delete[] encoded;
+    return num_levels;
+}
@@ -2,7 +2,10 @@
 // functions to load and save PNG files
 
 #include "k3internal.h"
+#include "k3simd.h"
+#include "k3pixel.h"
 #include "pnghandler.h"
+#include <algorithm>
 
 // PNG constants and structures
 // in network order, will be "\211PNG\r\n \n"
@@ -89,18 +92,28 @@ struct png_palette_entry_t {
     uint8_t b;
 };
 
+// State of one load, from LoadHeaderInfo to EndLoad
+struct k3pngLoad {
+    png_ihdr_t header;
+    k3fmt format;
+};
+
 k3image_file_handler_t k3PNGHandler = { k3png_LoadHeaderInfo,
                                         k3png_LoadData,
-                                        k3png_SaveData };
-
-png_ihdr_t header;
-k3fmt img_format;
+                                        k3png_SaveData,
+                                        NULL,
+                                        k3png_EndLoad,
+                                        NULL,
+                                        k3png_LoadRegion,
+                                        NULL };
 
-void K3CALLBACK k3png_LoadHeaderInfo(FILE* file_handle,
+void K3CALLBACK k3png_LoadHeaderInfo(k3imageSource* source, void** context,
     uint32_t* width, uint32_t* height, uint32_t* depth, k3fmt* format)
 {
-    uint32_t start_pos = ftell(file_handle);
-    fread(&header, sizeof(png_ihdr_t), 1, file_handle);
+    uint32_t start_pos = source->GetPos();
+    png_ihdr_t header;
+    k3fmt img_format;
+    if (source->Read(&header, sizeof(png_ihdr_t)) != sizeof(png_ihdr_t)) header.sig = 0;
     png_ihdr_endian_swap(&header);
 
     // Do error checking on the header
@@ -114,7 +127,7 @@ void K3CALLBACK k3png_LoadHeaderInfo(FILE* file_handle,
         !(header.interlace_method == PNG_INTERLACE_NONE ||
             header.interlace_method == PNG_INTERLACE_ADAM7)  // 0 or 1 are only legal interlace methods
         ) {
-        fseek(file_handle, start_pos, SEEK_SET);
+        source->SetPos(start_pos);
         return;
     }
 
@@ -139,6 +152,12 @@ void K3CALLBACK k3png_LoadHeaderInfo(FILE* file_handle,
         img_format = k3fmt::UNKNOWN;
     }
     *format = img_format;
+    if (img_format != k3fmt::UNKNOWN) {
+        k3pngLoad* load = new k3pngLoad;
+        load->header = header;
+        load->format = img_format;
+        *context = load;
+    }
 }
 
 uint8_t k3png_paeth(uint8_t a, uint8_t b, uint8_t c)
@@ -155,45 +174,423 @@ uint8_t k3png_paeth(uint8_t a, uint8_t b, uint8_t c)
     return (pc < pa) ? c : a;
 }
 
-void k3png_defilter_scanline(uint8_t* dst, uint8_t* prev_dst, uint32_t pix_pitch, uint32_t row_pitch, uint8_t filter_type)
+// Rows come out of these with the filter undone in place; prev is the row above, already
+// defiltered, or NULL for the first row of the image or of an interlace pass
+typedef void (*k3png_defilter_ptr)(uint8_t* row, const uint8_t* prev, uint32_t pix_pitch, uint32_t row_pitch, uint8_t filter_type);
+
+static void k3png_DefilterScalar(uint8_t* row, const uint8_t* prev, uint32_t pix_pitch, uint32_t row_pitch, uint8_t filter_type)
 {
     uint32_t col;
-    uint8_t prev_col, prev_row, prev_row_col;
+    uint32_t first = (pix_pitch < row_pitch) ? pix_pitch : row_pitch;
     switch (filter_type) {
     case PNG_FILTER_SUB:
         for (col = pix_pitch; col < row_pitch; col++) {
-            *(dst + col) += *(dst + col - pix_pitch);
+            row[col] += row[col - pix_pitch];
         }
         break;
     case PNG_FILTER_UP:
+        if (prev == NULL) break;
         for (col = 0; col < row_pitch; col++) {
-            *(dst + col) += *(prev_dst + col);
+            row[col] += prev[col];
         }
         break;
     case PNG_FILTER_AVG:
-        for (col = 0; col < row_pitch; col++) {
-            prev_col = *(dst + col - pix_pitch);
-            prev_row = *(prev_dst + col);
-            *(dst + col) += (prev_row + prev_col) >> 1;
+        if (prev == NULL) {
+            for (col = pix_pitch; col < row_pitch; col++) {
+                row[col] += row[col - pix_pitch] >> 1;
+            }
+        } else {
+            for (col = 0; col < first; col++) {
+                row[col] += prev[col] >> 1;
+            }
+            for (; col < row_pitch; col++) {
+                row[col] += (row[col - pix_pitch] + prev[col]) >> 1;
+            }
         }
         break;
     case PNG_FILTER_PAETH:
-        for (col = 0; col < row_pitch; col++) {
-            prev_col = *(dst + col - pix_pitch);
-            prev_row = *(prev_dst + col);
-            prev_row_col = *(prev_dst + col - pix_pitch);
-            *(dst + col) += k3png_paeth(prev_col, prev_row, prev_row_col);
+        // with nothing above, paeth always predicts the left pixel, the same as sub
+        if (prev == NULL) {
+            for (col = pix_pitch; col < row_pitch; col++) {
+                row[col] += row[col - pix_pitch];
+            }
+        } else {
+            for (col = 0; col < first; col++) {
+                row[col] += prev[col];
+            }
+            for (; col < row_pitch; col++) {
+                row[col] += k3png_paeth(row[col - pix_pitch], prev[col], prev[col - pix_pitch]);
+            }
         }
         break;
     }
 }
 
-void K3CALLBACK k3png_LoadData(FILE* file_handle, uint32_t pitch, uint32_t slice_pitch, void* data)
+#if defined(K3_SIMD_X86)
+
+// Sub, avg and paeth depend on the pixel to the left, so these take one whole pixel per step;
+// pixels of 3 and 6 bytes load 4 and 8 bytes, except at the end of the row, where they go
+// through a copy so nothing is read past it
+template<uint32_t BPP>
+K3_TARGET_SSE41 static inline __m128i k3png_LoadPixel(const uint8_t* p, const uint8_t* end)
+{
+    int32_t v32;
+    if (BPP == 8 || (BPP == 6 && p + 8 <= end)) return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    if (BPP == 4 || (BPP == 3 && p + 4 <= end)) {
+        memcpy(&v32, p, 4);
+        return _mm_cvtsi32_si128(v32);
+    }
+    uint64_t v = 0;
+    memcpy(&v, p, BPP);
+    return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&v));
+}
+
+template<uint32_t BPP>
+K3_TARGET_SSE41 static inline void k3png_StorePixel(uint8_t* p, __m128i v)
+{
+    uint64_t u;
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(&u), v);
+    memcpy(p, &u, BPP);
+}
+
+template<uint32_t BPP>
+K3_TARGET_SSE41 static void k3png_DefilterSubSSE41(uint8_t* row, uint32_t row_pitch)
+{
+    __m128i a = _mm_setzero_si128();
+    uint32_t col;
+    for (col = 0; col < row_pitch; col += BPP) {
+        a = _mm_add_epi8(a, k3png_LoadPixel<BPP>(row + col, row + row_pitch));
+        k3png_StorePixel<BPP>(row + col, a);
+    }
+}
+
+template<uint32_t BPP>
+K3_TARGET_SSE41 static void k3png_DefilterAvgSSE41(uint8_t* row, const uint8_t* prev, uint32_t row_pitch)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a = _mm_setzero_si128();
+    __m128i b;
+    uint32_t col;
+    for (col = 0; col < row_pitch; col += BPP) {
+        b = k3png_LoadPixel<BPP>(prev + col, prev + row_pitch);
+        // pavgb rounds up, so take back the carry when the sum is odd
+        __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        a = _mm_add_epi8(k3png_LoadPixel<BPP>(row + col, row + row_pitch), avg);
+        k3png_StorePixel<BPP>(row + col, a);
+    }
+}
+
+template<uint32_t BPP>
+K3_TARGET_SSE41 static void k3png_DefilterPaethSSE41(uint8_t* row, const uint8_t* prev, uint32_t row_pitch)
+{
+    // a, b and c are left, above and above left, widened to 16 bits
+    __m128i a = _mm_setzero_si128();
+    __m128i c = _mm_setzero_si128();
+    __m128i b, pa, pb, pc, min_bc, pred, x;
+    uint32_t col;
+    for (col = 0; col < row_pitch; col += BPP) {
+        b = _mm_cvtepu8_epi16(k3png_LoadPixel<BPP>(prev + col, prev + row_pitch));
+        pa = _mm_sub_epi16(b, c);
+        pb = _mm_sub_epi16(a, c);
+        pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+        pa = _mm_abs_epi16(pa);
+        pb = _mm_abs_epi16(pb);
+        // ties go to a, then b, as in the scalar predictor
+        min_bc = _mm_min_epi16(pb, pc);
+        pred = _mm_blendv_epi8(c, b, _mm_cmpeq_epi16(min_bc, pb));
+        pred = _mm_blendv_epi8(pred, a, _mm_cmpeq_epi16(_mm_min_epi16(pa, min_bc), pa));
+        x = _mm_add_epi8(k3png_LoadPixel<BPP>(row + col, row + row_pitch), _mm_packus_epi16(pred, pred));
+        k3png_StorePixel<BPP>(row + col, x);
+        a = _mm_cvtepu8_epi16(x);
+        c = b;
+    }
+}
+
+K3_TARGET_SSE41 static void k3png_DefilterUpSSE41(uint8_t* row, const uint8_t* prev, uint32_t row_pitch)
+{
+    uint32_t col;
+    for (col = 0; col + 16 <= row_pitch; col += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + col));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + col));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + col), _mm_add_epi8(x, b));
+    }
+    for (; col < row_pitch; col++) {
+        row[col] += prev[col];
+    }
+}
+
+template<uint32_t BPP>
+K3_TARGET_SSE41 static bool k3png_DefilterPixelsSSE41(uint8_t* row, const uint8_t* prev, uint32_t row_pitch, uint8_t filter_type)
+{
+    switch (filter_type) {
+    case PNG_FILTER_SUB:
+        k3png_DefilterSubSSE41<BPP>(row, row_pitch);
+        return true;
+    case PNG_FILTER_AVG:
+        if (prev == NULL) return false;
+        k3png_DefilterAvgSSE41<BPP>(row, prev, row_pitch);
+        return true;
+    case PNG_FILTER_PAETH:
+        if (prev == NULL) k3png_DefilterSubSSE41<BPP>(row, row_pitch);
+        else k3png_DefilterPaethSSE41<BPP>(row, prev, row_pitch);
+        return true;
+    }
+    return false;
+}
+
+// Pixels of 1 and 2 bytes, and the first row of an avg filtered pass, stay on the scalar path
+K3_TARGET_SSE41 static void k3png_DefilterSSE41(uint8_t* row, const uint8_t* prev, uint32_t pix_pitch, uint32_t row_pitch, uint8_t filter_type)
+{
+    bool done = false;
+    if (filter_type == PNG_FILTER_NONE) return;
+    if (filter_type == PNG_FILTER_UP) {
+        if (prev) k3png_DefilterUpSSE41(row, prev, row_pitch);
+        return;
+    }
+    switch (pix_pitch) {
+    case 3: done = k3png_DefilterPixelsSSE41<3>(row, prev, row_pitch, filter_type); break;
+    case 4: done = k3png_DefilterPixelsSSE41<4>(row, prev, row_pitch, filter_type); break;
+    case 6: done = k3png_DefilterPixelsSSE41<6>(row, prev, row_pitch, filter_type); break;
+    case 8: done = k3png_DefilterPixelsSSE41<8>(row, prev, row_pitch, filter_type); break;
+    }
+    if (!done) k3png_DefilterScalar(row, prev, pix_pitch, row_pitch, filter_type);
+}
+#elif defined(K3_SIMD_NEON)
+
+// The same one pixel steps as the x86 version, in the low lanes of a 64 bit vector
+template<uint32_t BPP>
+static inline uint8x8_t k3png_LoadPixel(const uint8_t* p, const uint8_t* end)
+{
+    uint32_t v32;
+    if (BPP == 8 || (BPP == 6 && p + 8 <= end)) return vld1_u8(p);
+    if (BPP == 4 || (BPP == 3 && p + 4 <= end)) {
+        memcpy(&v32, p, 4);
+        return vcreate_u8(v32);
+    }
+    uint64_t v = 0;
+    memcpy(&v, p, BPP);
+    return vcreate_u8(v);
+}
+
+template<uint32_t BPP>
+static inline void k3png_StorePixel(uint8_t* p, uint8x8_t v)
+{
+    uint64_t u = vget_lane_u64(vreinterpret_u64_u8(v), 0);
+    memcpy(p, &u, BPP);
+}
+
+template<uint32_t BPP>
+static void k3png_DefilterSubNEON(uint8_t* row, uint32_t row_pitch)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    uint32_t col;
+    for (col = 0; col < row_pitch; col += BPP) {
+        a = vadd_u8(a, k3png_LoadPixel<BPP>(row + col, row + row_pitch));
+        k3png_StorePixel<BPP>(row + col, a);
+    }
+}
+
+template<uint32_t BPP>
+static void k3png_DefilterAvgNEON(uint8_t* row, const uint8_t* prev, uint32_t row_pitch)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    uint32_t col;
+    for (col = 0; col < row_pitch; col += BPP) {
+        // the halving add truncates like the scalar >> 1
+        uint8x8_t avg = vhadd_u8(a, k3png_LoadPixel<BPP>(prev + col, prev + row_pitch));
+        a = vadd_u8(k3png_LoadPixel<BPP>(row + col, row + row_pitch), avg);
+        k3png_StorePixel<BPP>(row + col, a);
+    }
+}
+
+template<uint32_t BPP>
+static void k3png_DefilterPaethNEON(uint8_t* row, const uint8_t* prev, uint32_t row_pitch)
+{
+    // a, b and c are left, above and above left, widened to 16 bits
+    int16x8_t a = vdupq_n_s16(0);
+    int16x8_t c = vdupq_n_s16(0);
+    int16x8_t b, pa, pb, pc, min_bc, pred;
+    uint8x8_t x;
+    uint32_t col;
+    for (col = 0; col < row_pitch; col += BPP) {
+        b = vreinterpretq_s16_u16(vmovl_u8(k3png_LoadPixel<BPP>(prev + col, prev + row_pitch)));
+        pa = vsubq_s16(b, c);
+        pb = vsubq_s16(a, c);
+        pc = vabsq_s16(vaddq_s16(pa, pb));
+        pa = vabsq_s16(pa);
+        pb = vabsq_s16(pb);
+        // ties go to a, then b, as in the scalar predictor
+        min_bc = vminq_s16(pb, pc);
+        pred = vbslq_s16(vceqq_s16(min_bc, pb), b, c);
+        pred = vbslq_s16(vceqq_s16(vminq_s16(pa, min_bc), pa), a, pred);
+        x = vadd_u8(k3png_LoadPixel<BPP>(row + col, row + row_pitch), vmovn_u16(vreinterpretq_u16_s16(pred)));
+        k3png_StorePixel<BPP>(row + col, x);
+        a = vreinterpretq_s16_u16(vmovl_u8(x));
+        c = b;
+    }
+}
+
+static void k3png_DefilterUpNEON(uint8_t* row, const uint8_t* prev, uint32_t row_pitch)
+{
+    uint32_t col;
+    for (col = 0; col + 16 <= row_pitch; col += 16) {
+        vst1q_u8(row + col, vaddq_u8(vld1q_u8(row + col), vld1q_u8(prev + col)));
+    }
+    for (; col < row_pitch; col++) {
+        row[col] += prev[col];
+    }
+}
+
+template<uint32_t BPP>
+static bool k3png_DefilterPixelsNEON(uint8_t* row, const uint8_t* prev, uint32_t row_pitch, uint8_t filter_type)
+{
+    switch (filter_type) {
+    case PNG_FILTER_SUB:
+        k3png_DefilterSubNEON<BPP>(row, row_pitch);
+        return true;
+    case PNG_FILTER_AVG:
+        if (prev == NULL) return false;
+        k3png_DefilterAvgNEON<BPP>(row, prev, row_pitch);
+        return true;
+    case PNG_FILTER_PAETH:
+        if (prev == NULL) k3png_DefilterSubNEON<BPP>(row, row_pitch);
+        else k3png_DefilterPaethNEON<BPP>(row, prev, row_pitch);
+        return true;
+    }
+    return false;
+}
+
+// The same split with the scalar path as the x86 version
+static void k3png_DefilterNEON(uint8_t* row, const uint8_t* prev, uint32_t pix_pitch, uint32_t row_pitch, uint8_t filter_type)
+{
+    bool done = false;
+    if (filter_type == PNG_FILTER_NONE) return;
+    if (filter_type == PNG_FILTER_UP) {
+        if (prev) k3png_DefilterUpNEON(row, prev, row_pitch);
+        return;
+    }
+    switch (pix_pitch) {
+    case 3: done = k3png_DefilterPixelsNEON<3>(row, prev, row_pitch, filter_type); break;
+    case 4: done = k3png_DefilterPixelsNEON<4>(row, prev, row_pitch, filter_type); break;
+    case 6: done = k3png_DefilterPixelsNEON<6>(row, prev, row_pitch, filter_type); break;
+    case 8: done = k3png_DefilterPixelsNEON<8>(row, prev, row_pitch, filter_type); break;
+    }
+    if (!done) k3png_DefilterScalar(row, prev, pix_pitch, row_pitch, filter_type);
+}
+#endif
+
+static k3png_defilter_ptr k3png_GetDefilterFunc()
 {
+#if defined(K3_SIMD_X86)
+    if (k3math_GetSimdLevel() != k3simdLevel::NONE) return k3png_DefilterSSE41;
+#elif defined(K3_SIMD_NEON)
+    if (k3math_GetSimdLevel() != k3simdLevel::NONE) return k3png_DefilterNEON;
+#endif
+    return k3png_DefilterScalar;
+}
+
+// Byte swaps 16 bit samples; src and dst may be the same row
+static void k3png_SwapCopy16(const uint8_t* src, uint8_t* dst, uint32_t num_bytes)
+{
+    uint32_t i;
+    uint8_t t;
+    for (i = 0; i + 1 < num_bytes; i += 2) {
+        t = src[i];
+        dst[i] = src[i + 1];
+        dst[i + 1] = t;
+    }
+}
+
+// How a defiltered png row turns into pixels of the image format
+struct k3pngUnpack {
+    uint8_t bit_depth;
+    bool palette;
+    bool swap16;
+    uint32_t pix_pitch;
+    uint32_t dst_pix_pitch;
+    const png_palette_entry_t* entries;
+    k3rowConverter rgb8;
+};
+
+// Unpacks num_pixels pixels, starting from pixel first of the row
+static void k3png_UnpackRow(const k3pngUnpack* u, const uint8_t* src, uint32_t first, uint8_t* dst, uint32_t num_pixels)
+{
+    uint32_t x, v;
+    if (!u->palette && u->bit_depth >= 8) src += first * u->pix_pitch;
+    if (u->palette || u->bit_depth < 8) {
+        // the leftmost pixel is in the high bits; gray widens by repeating its bits
+        uint32_t mask = (1 << u->bit_depth) - 1;
+        uint32_t gray_scale = 255 / mask;
+        uint32_t bit = first * u->bit_depth;
+        for (x = 0; x < num_pixels; x++) {
+            v = (src[bit >> 3] >> (8 - u->bit_depth - (bit & 7))) & mask;
+            bit += u->bit_depth;
+            if (u->palette) {
+                dst[0] = u->entries[v].r;
+                dst[1] = u->entries[v].g;
+                dst[2] = u->entries[v].b;
+                dst[3] = 0xff;
+                dst += 4;
+            } else {
+                *dst = static_cast<uint8_t>(v * gray_scale);
+                dst++;
+            }
+        }
+    } else if (u->pix_pitch == u->dst_pix_pitch) {
+        if (u->swap16) k3png_SwapCopy16(src, dst, num_pixels * u->pix_pitch);
+        else memcpy(dst, src, num_pixels * u->pix_pitch);
+    } else if (u->bit_depth == 8) {
+        u->rgb8.Convert(src, dst, num_pixels);
+    } else {
+        // 16 bit rgb gains an opaque alpha
+        uint32_t s16 = (u->swap16) ? 1 : 0;
+        for (x = 0; x < num_pixels; x++) {
+            for (v = 0; v < 6; v++) {
+                dst[v] = src[v ^ s16];
+            }
+            dst[6] = 0xff;
+            dst[7] = 0xff;
+            src += 6;
+            dst += 8;
+        }
+    }
+}
+
+template<uint32_t SIZE>
+static void k3png_ScatterPixels(const uint8_t* src, uint8_t* dst, uint32_t num_pixels, uint32_t dst_step)
+{
+    uint32_t x;
+    for (x = 0; x < num_pixels; x++) {
+        memcpy(dst, src, SIZE);
+        src += SIZE;
+        dst += dst_step;
+    }
+}
+
+// Places the pixels of an interlace pass row at their columns in the image row
+static void k3png_ScatterRow(const uint8_t* src, uint8_t* dst, uint32_t num_pixels, uint32_t pix_size, uint32_t dst_step)
+{
+    switch (pix_size) {
+    case 1: k3png_ScatterPixels<1>(src, dst, num_pixels, dst_step); break;
+    case 2: k3png_ScatterPixels<2>(src, dst, num_pixels, dst_step); break;
+    case 4: k3png_ScatterPixels<4>(src, dst, num_pixels, dst_step); break;
+    case 8: k3png_ScatterPixels<8>(src, dst, num_pixels, dst_step); break;
+    }
+}
+
+// compressed data read at a time from sources that can't be mapped
+const uint32_t PNG_READ_SIZE = 16 * 1024;
+
+// Writes columns x to x + width of rows y to y + height to data. Every row above the region still has to
+// be inflated and defiltered, but inflating stops once the rows below it are all that is left
+static void k3png_LoadRows(k3imageSource* source, void* context, uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+    uint32_t pitch, void* data)
+{
+    const png_ihdr_t& header = static_cast<const k3pngLoad*>(context)->header;
+    k3fmt img_format = static_cast<const k3pngLoad*>(context)->format;
     png_chunk_t chunk;
-    bool palette_found = false;
     png_palette_entry_t palette[256] = { 0 };
-    uint32_t i, p, b, length, crc;
+    uint32_t i, length, crc;
     z_stream zs = { 0 };
     // stride and offset for each plane in x and y directions
     // represented in this grid for png spec
@@ -216,211 +613,651 @@ void K3CALLBACK k3png_LoadData(FILE* file_handle, uint32_t pitch, uint32_t slice
     uint32_t pix_per_row[8];
     uint32_t src_pitch[8];
     uint32_t src_height[8];
-    uint32_t src_size[8];
-    // pitch for scanline buffer
-    // prepend 1 pixel pad to handle the first pixel's prior neightbor
-    uint32_t scanline_pitch = ((header.bit_depth * header.width) + 64) / 8;
+    // the pixels of each row that are in the region, and the column of the first one in it
+    uint32_t first_pix[8];
+    uint32_t num_pix[8];
+    uint32_t first_col[8];
+
+    // for color data, there are either 3 components (RGB) or 4 (RGBA)
+    // Grayscale can have 1 or 2; palette indices are 1
+    uint32_t num_comp = (header.color_type & PNG_COLOR_TYPE_COLOR_FLAG) ? 3 : 1;
+    if (header.color_type & PNG_COLOR_TYPE_ALPHA_FLAG) num_comp++;
+    if (header.color_type & PNG_COLOR_TYPE_PALETTE_FLAG) num_comp = 1;
+    uint32_t pix_bits = header.bit_depth * num_comp;
 
     for (i = 0; i < 8; i++) {
         pix_per_row[i] = ((header.width + stride_x[i] - 1 - offset_x[i]) / stride_x[i]);
-        src_pitch[i] = ((header.bit_depth * pix_per_row[i]) + 7) / 8;
+        src_pitch[i] = ((pix_bits * pix_per_row[i]) + 7) / 8;
         src_height[i] = ((header.height + stride_y[i] - 1 - offset_y[i]) / stride_y[i]);
+        first_pix[i] = (x > offset_x[i]) ? (x - offset_x[i] + stride_x[i] - 1) / stride_x[i] : 0;
+        length = (x + width > offset_x[i]) ? (x + width - offset_x[i] + stride_x[i] - 1) / stride_x[i] : 0;
+        num_pix[i] = (length > first_pix[i]) ? length - first_pix[i] : 0;
+        first_col[i] = offset_x[i] + first_pix[i] * stride_x[i] - x;
     }
 
+    // filters work on whole bytes, so pixels under 8 bits count as 1
+    uint32_t pix_pitch = (pix_bits + 7) / 8;
     uint32_t dst_pix_pitch = k3imageObj::GetFormatSize(img_format);
-    uint32_t pix_pitch = header.bit_depth;
 
-    // for color data, there are either 3 components (RGB) or 4 (RGBA)
-    // Grayscale can have 1 or 2
-    uint32_t num_comp = (header.color_type & PNG_COLOR_TYPE_COLOR_FLAG) ? 3 : 1;
-    if (header.color_type & PNG_COLOR_TYPE_ALPHA_FLAG) num_comp++;
-
-    if (!(header.color_type & PNG_COLOR_TYPE_PALETTE_FLAG)) {
-        scanline_pitch *= num_comp;
-        pix_pitch *= num_comp;
-        for (i = 0; i < 8; i++) {
-            src_pitch[i] *= num_comp;
-        }
-    }
-
-    // round up to nearest byte
-    pix_pitch = (pix_pitch + 7) / 8;
-    for (i = 0; i < 8; i++) {
-        src_size[i] = (src_pitch[i] + 1) * src_height[i];  // add 1 byte for filter mode
-    }
+    k3pngUnpack unpack;
+    unpack.bit_depth = header.bit_depth;
+    unpack.palette = ((header.color_type & PNG_COLOR_TYPE_PALETTE_FLAG) != 0);
+#ifdef K3_BIG_ENDIAN
+    unpack.swap16 = false;
+#else
+    unpack.swap16 = (header.bit_depth == 16);
+#endif
+    unpack.pix_pitch = pix_pitch;
+    unpack.dst_pix_pitch = dst_pix_pitch;
+    unpack.entries = palette;
+    if (header.bit_depth == 8 && num_comp == 3) unpack.rgb8.Select(k3fmt::RGB8_UNORM, k3fmt::RGBA8_UNORM);
 
-    uint32_t dst_size = pitch * header.height;
-    uint32_t read_size = src_size[0];
-    if (header.interlace_method == PNG_INTERLACE_ADAM7) {
-        // interlaced mode
-        read_size = 0;
+    uint32_t plane = (header.interlace_method == PNG_INTERLACE_ADAM7) ? 1 : 0;
+    // once the last pass is past the region, the rest of the data can be left alone
+    uint32_t last_plane = 0;
+    if (plane) {
         for (i = 1; i < 8; i++) {
-            read_size += src_size[i];
+            if (pix_per_row[i] && src_height[i]) last_plane = i;
         }
     }
+    // Rows already laid out like the image inflate straight into it; 16 bit rows are
+    // swapped once the row below has been defiltered against them
+    bool direct = (plane == 0 && !unpack.palette && header.bit_depth >= 8 && pix_pitch == dst_pix_pitch &&
+        x == 0 && y == 0 && width == header.width);
+    k3png_defilter_ptr defilter = k3png_GetDefilterFunc();
 
-    uint8_t* src_buffer = new uint8_t[3 * scanline_pitch];
-    uint8_t* src0 = (uint8_t*)src_buffer;
-    uint8_t* src1 = src0 + scanline_pitch;
-    uint8_t* raw_read = src1 + scanline_pitch;
-    uint32_t bytes_remaining;
-
-    // clear the scanline to 0
-    memset(src_buffer, 0, 2 * scanline_pitch);
+    // everything else inflates into a pair of scanlines, plus a row of unpacked pixels for the
+    // interlace passes to scatter from
+    uint8_t* src_buffer = NULL;
+    uint8_t* raw_read = NULL;
+    uint8_t* unpack_row = NULL;
+    uint8_t* row_data = static_cast<uint8_t*>(data);
+    uint8_t* prev_data = NULL;
+    if (!direct) {
+        src_buffer = new uint8_t[2 * src_pitch[0] + ((plane) ? header.width * dst_pix_pitch : 0)];
+        row_data = src_buffer;
+        prev_data = src_buffer + src_pitch[0];
+        unpack_row = prev_data + src_pitch[0];
+    }
 
     uint32_t row = 0;
-    uint32_t plane = (header.interlace_method == PNG_INTERLACE_ADAM7) ? 1 : 0;
-    uint8_t* cur_dst = (uint8_t*)data;
+    uint32_t bytes_remaining;
+    uint8_t* cur_dst = static_cast<uint8_t*>(data);
+    uint8_t filter_type = PNG_FILTER_NONE;
+    bool in_row = false;
     bool done = false;
+    bool img_done = false;
+    bool stopped = false;
     zs.zalloc = Z_NULL;
     zs.zfree = Z_NULL;
     zs.opaque = Z_NULL;
     inflateInit(&zs);
-    zs.avail_out = src_pitch[plane] + 1;
-    zs.next_out = src1 + 7;
-    bool img_done = false;
-#ifdef K3_BIG_ENDIAN
-    uint32_t endian_swap = 0;
-#else
-    uint32_t endian_swap = (header.bit_depth == 16) ? 0x1 : 0x0;
-#endif
+    // each row inflates in two steps: its filter byte, then its data
+    zs.next_out = &filter_type;
+    zs.avail_out = 1;
     while (!done) {
-        fread(&chunk, sizeof(png_chunk_t), 1, file_handle);
+        source->Read(&chunk, sizeof(png_chunk_t));
         png_chunk_endian_swap(&chunk);
         switch (chunk.type) {
         case PNG_CHUNK_PLTE:
             length = chunk.length / 3;
             if (length > 256) length = 256;
-            fread(palette, sizeof(png_palette_entry_t), length, file_handle);
+            source->Read(palette, sizeof(png_palette_entry_t) * length);
             length = chunk.length - 3 * length;
-            if (length) fseek(file_handle, length, SEEK_CUR);
-            palette_found = true;
+            if (length) source->Skip(length);
             break;
         case PNG_CHUNK_IDAT:
             // read and decompress data
-            if (zs.avail_out) {
+            if (!img_done) {
                 bytes_remaining = chunk.length;
                 while (bytes_remaining) {
-                    zs.avail_in = (bytes_remaining > scanline_pitch) ? scanline_pitch : bytes_remaining;
-                    zs.next_in = raw_read;
-                    fread(raw_read, 1, zs.avail_in, file_handle);
+                    // inflate straight from the source when it is in memory, otherwise a block at a time
+                    zs.avail_in = bytes_remaining;
+                    zs.next_in = (Bytef*)source->Map(&zs.avail_in);
+                    if (zs.next_in == NULL) {
+                        if (raw_read == NULL) raw_read = new uint8_t[PNG_READ_SIZE];
+                        zs.avail_in = (bytes_remaining > PNG_READ_SIZE) ? PNG_READ_SIZE : bytes_remaining;
+                        zs.next_in = raw_read;
+                        zs.avail_in = source->Read(raw_read, zs.avail_in);
+                    }
                     // TODO: at this point, should compute running CRC
+                    if (zs.avail_in == 0) break;
                     bytes_remaining -= zs.avail_in;
-                    while (zs.avail_in) {
+                    for (;;) {
                         int err = inflate(&zs, Z_NO_FLUSH);
+                        // inflate can hold back output after taking all of its input, so a
+                        // filled buffer always gets another call
+                        bool filled = (zs.avail_out == 0);
 
-                        if (zs.avail_out == 0 && !img_done) {
+                        if (filled && !img_done && !in_row) {
+                            in_row = true;
+                            zs.next_out = row_data;
+                            zs.avail_out = src_pitch[plane];
+                        } else if (filled && !img_done) {
                             // We're done reading scanline, so start processing it
-                            uint8_t filter_type = *(src1 + 7);
-                            *(src1 + 7) = 0;
-                            k3png_defilter_scanline(src1 + 8, src0 + 8, pix_pitch, src_pitch[plane], filter_type);
-                            if (plane || (header.bit_depth < 8) || (header.color_type & PNG_COLOR_TYPE_PALETTE_FLAG)) {
-                                // Take the slow path if we have interlaced image, sub-byte bit depth or palette
-                                if (plane < 8) {
-                                    uint32_t pix_per_byte = (header.bit_depth < 8) ? 8 / header.bit_depth : 1;
-                                    uint8_t mask = (1 << header.bit_depth) - 1;
-                                    p = 0;
-                                    b = 0;
-                                    uint32_t pix_left = pix_per_row[plane];
-                                    uint32_t subbyte, end_subbyte;
-                                    uint8_t src, d, j;
-                                    for (i = 0; i < src_pitch[plane]; i++) {
-                                        src = *(src1 + 8 + (i ^ endian_swap));
-                                        end_subbyte = (pix_left < pix_per_byte) ? pix_left : pix_per_byte;
-                                        for (subbyte = 0; subbyte < end_subbyte; subbyte++) {
-                                            d = (src >> ((pix_per_byte - 1 - subbyte) * header.bit_depth)) & mask;
-                                            if (header.color_type & PNG_COLOR_TYPE_PALETTE_FLAG) {
-                                                for (j = 0; j < dst_pix_pitch; j++) {
-                                                    *(cur_dst + p + b + (dst_pix_pitch * stride_x[plane] * subbyte) + j) = (j < 3) ? *((&(palette[d].r)) + j) : 0xff;
-                                                }
-                                            } else {
-                                                d |= (header.bit_depth < 8) ? (d << 4) : 0;
-                                                d |= (header.bit_depth < 4) ? (d << 2) : 0;
-                                                d |= (header.bit_depth < 2) ? (d << 1) : 0;
-                                                *(cur_dst + p + b + (dst_pix_pitch * stride_x[plane] * subbyte)) = d;
-                                            }
-                                            if(pix_pitch == 1) pix_left--;
-                                        }
-                                        b++;
-                                        if (b >= pix_pitch) {
-                                            if (pix_pitch > 1) pix_left--;
-                                            b = 0;
-                                            p += dst_pix_pitch * stride_x[plane] * pix_per_byte;
-                                        }
-                                    }
-                                    cur_dst += pitch * stride_y[plane];
-                                }
+                            defilter(row_data, (row) ? prev_data : NULL, pix_pitch, src_pitch[plane], filter_type);
+                            if (direct) {
+                                if (unpack.swap16 && row) k3png_SwapCopy16(prev_data, prev_data, src_pitch[0]);
+                                prev_data = row_data;
+                                cur_dst += pitch;
+                                row_data = cur_dst;
                             } else {
-                                if (pix_pitch == dst_pix_pitch) {
-                                    if (endian_swap) {
-                                        // for 16bpc, can't just do a memcpy...need to do endian swap
-                                        for (i = 0; i < src_pitch[0]; i++) {
-                                            *(cur_dst + i) = *(src1 + 8 + (i ^ 0x1));
-                                        }
+                                // rows and columns outside the region go no further than the defilter
+                                uint32_t img_row = offset_y[plane] + row * stride_y[plane];
+                                if (img_row >= y && img_row < y + height && num_pix[plane]) {
+                                    cur_dst = static_cast<uint8_t*>(data) + (img_row - y) * pitch;
+                                    if (plane == 0) {
+                                        k3png_UnpackRow(&unpack, row_data, x, cur_dst, width);
                                     } else {
-                                        memcpy(cur_dst, src1 + 8, src_pitch[0]);
-                                    }
-                                } else {
-                                    b = 0;
-                                    p = 0;
-                                    for (i = 0; i < pitch; i++) {
-                                        *(cur_dst + i) = (b < pix_pitch) ? *(src1 + 8 + (p ^ endian_swap)) : 0xff;
-                                        if (b < pix_pitch) p++;
-                                        b++;
-                                        if (b >= dst_pix_pitch) b = 0;
+                                        k3png_UnpackRow(&unpack, row_data, first_pix[plane], unpack_row, num_pix[plane]);
+                                        k3png_ScatterRow(unpack_row, cur_dst + first_col[plane] * dst_pix_pitch, num_pix[plane],
+                                            dst_pix_pitch, dst_pix_pitch * stride_x[plane]);
                                     }
                                 }
-                                cur_dst += pitch;
+                                uint8_t* temp = prev_data;
+                                prev_data = row_data;
+                                row_data = temp;
                             }
-                            uint8_t* temp = src0;
-                            src0 = src1;
-                            src1 = temp;
                             row++;
-                            zs.next_out = src1 + 7;
-                            if (row < src_height[plane]) {
-                                zs.avail_out = src_pitch[plane] + 1;
-                            } else if (plane > 0) {
+                            if (row >= src_height[plane]) {
                                 row = 0;
-                                do {
-                                    plane++;
-                                } while (plane < 8 && (pix_per_row[plane] == 0 || src_height[plane] == 0));
-                                // reset cur_dst, but offset it by row for the last plane
-                                cur_dst = (uint8_t*)data + offset_x[plane] * dst_pix_pitch + offset_y[plane] * pitch;
-                                if (plane < 8) {
-                                    zs.avail_out = src_pitch[plane] + 1;
-                                } else {
-                                    img_done = true;
+                                if (plane > 0) {
+                                    do {
+                                        plane++;
+                                    } while (plane < 8 && (pix_per_row[plane] == 0 || src_height[plane] == 0));
                                 }
-                            } else {
+                                if (plane == 0 || plane == 8) img_done = true;
+                            } else if (plane == last_plane && offset_y[plane] + row * stride_y[plane] >= y + height) {
                                 img_done = true;
+                                stopped = true;
+                            }
+                            if (img_done && direct && unpack.swap16) k3png_SwapCopy16(prev_data, prev_data, src_pitch[0]);
+                            in_row = false;
+                            if (!img_done) {
+                                zs.next_out = &filter_type;
+                                zs.avail_out = 1;
                             }
                         }
+                        // the stream ended, is corrupt, or has more data than the image needs
+                        if (stopped || err != Z_OK || (zs.avail_in == 0 && !filled)) break;
                     }
+                    if (stopped) break;
                 }
             } else {
                 // this shouldn't be...we have more data than expected for the image
-                fseek(file_handle, chunk.length, SEEK_CUR);
+                source->Skip(chunk.length);
             }
             break;
         case PNG_CHUNK_IEND:
             done = true;
             break;
         default:
-            fseek(file_handle, chunk.length, SEEK_CUR);
+            source->Skip(chunk.length);
             break;
         }
-        fread(&crc, sizeof(crc), 1, file_handle);
+        if (stopped) break;
+        source->Read(&crc, sizeof(crc));
         // TODO: compute and check CRC
-        if (feof(file_handle)) done = true;
+        if (source->AtEnd()) done = true;
+    }
+
+    inflateEnd(&zs);
+    if (src_buffer) delete[] src_buffer;
+    if (raw_read) delete[] raw_read;
+}
+
+void K3CALLBACK k3png_LoadData(k3imageSource* source, void* context, uint32_t pitch, uint32_t slice_pitch, void* data)
+{
+    const png_ihdr_t& header = static_cast<const k3pngLoad*>(context)->header;
+    k3png_LoadRows(source, context, 0, 0, header.width, header.height, pitch, data);
+}
+
+void K3CALLBACK k3png_LoadRegion(k3imageSource* source, void* context,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data)
+{
+    k3png_LoadRows(source, context, x, y, width, height, pitch, data);
+}
+
+void K3CALLBACK k3png_EndLoad(void* context)
+{
+    delete static_cast<k3pngLoad*>(context);
+}
+
+// ------------------------------------------------------------
+// PNG encoder
+
+// Rows are filtered and deflated in groups of about this many bytes, one group per task; each group after
+// the first is primed with the 32KB of filtered rows before it, so little is lost against a single stream
+const uint32_t PNG_DEFLATE_GROUP_SIZE = 256 * 1024;
+const uint32_t PNG_DEFLATE_WINDOW = 32 * 1024;
+// room for the zlib header, the flush marker and the adler32 trailer on top of deflateBound
+const uint32_t PNG_DEFLATE_SLACK = 64;
+
+struct k3pngSave {
+    const uint8_t* data;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+    // source rows hold 1, 2 or 4 channels of 1 or 2 bytes each
+    uint32_t src_channels;
+    uint32_t src_bytes;
+    uint8_t bit_depth;
+    uint8_t color_type;
+    uint32_t out_channels;
+    uint32_t row_bytes;
+    uint32_t filter_bpp;
+    bool adaptive;
+    int level;
+    // sorted 0x00bbggrr colors
+    uint32_t num_palette;
+    uint32_t palette[256];
+    uint32_t rows_per_group;
+    uint32_t num_groups;
+    uint8_t* filtered;
+    uint8_t** group_out;
+    uint32_t* group_out_size;
+    uint32_t* group_adler;
+};
+
+static bool k3png_IsOpaque(const k3pngSave* s)
+{
+    uint32_t x, y;
+    for (y = 0; y < s->height; y++) {
+        const uint8_t* src = s->data + y * s->pitch;
+        if (s->src_bytes == 1) {
+            for (x = 0; x < s->width; x++) {
+                if (src[4 * x + 3] != 0xff) return false;
+            }
+        } else {
+            const uint16_t* src16 = reinterpret_cast<const uint16_t*>(src);
+            for (x = 0; x < s->width; x++) {
+                if (src16[4 * x + 3] != 0xffff) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Collects the colors of opaque 8 bit color; returns false once there are more than a palette holds
+static bool k3png_BuildPalette(k3pngSave* s)
+{
+    // open addressed, with 0 marking an empty slot
+    static const uint32_t TABLE_SIZE = 1024;
+    uint32_t table[TABLE_SIZE] = { 0 };
+    uint32_t x, y, color, slot;
+    s->num_palette = 0;
+    for (y = 0; y < s->height; y++) {
+        const uint8_t* src = s->data + y * s->pitch;
+        for (x = 0; x < s->width; x++) {
+            color = src[4 * x] | (src[4 * x + 1] << 8) | (src[4 * x + 2] << 16) | 0x01000000;
+            slot = (color * 2654435761u) >> 22;
+            while (table[slot] && table[slot] != color) slot = (slot + 1) & (TABLE_SIZE - 1);
+            if (table[slot] == 0) {
+                if (s->num_palette == 256) return false;
+                table[slot] = color;
+                s->palette[s->num_palette] = color & 0xffffff;
+                s->num_palette++;
+            }
+        }
+    }
+    std::sort(s->palette, s->palette + s->num_palette);
+    return true;
+}
+
+// Smallest gray depth that keeps every 8 bit value, as the loader widens by repeating the bits
+static uint8_t k3png_GrayBitDepth(const k3pngSave* s)
+{
+    uint8_t bit_depth = 1;
+    uint32_t x, y, v;
+    for (y = 0; y < s->height; y++) {
+        const uint8_t* src = s->data + y * s->pitch;
+        for (x = 0; x < s->width; x++) {
+            v = src[x];
+            if (v % 17) return 8;
+            if (v % 85) bit_depth = 4;
+            else if ((v % 255) && bit_depth < 2) bit_depth = 2;
+        }
+    }
+    return bit_depth;
+}
+
+static uint32_t k3png_PaletteIndex(const k3pngSave* s, uint32_t color)
+{
+    uint32_t lo = 0, hi = s->num_palette - 1, mid;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (s->palette[mid] < color) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Converts one source row to png layout: 16 bit channels go big endian, opaque color loses its alpha,
+// and palette indices and gray below 8 bits are packed with the leftmost pixel in the high bits
+static void k3png_PackRow(const k3pngSave* s, uint32_t row, uint8_t* dst)
+{
+    const uint8_t* src = s->data + row * s->pitch;
+    uint32_t x, c, v;
+    if (s->bit_depth < 8 || s->color_type == PNG_COLOR_TYPE_PALETTE_RGB) {
+        uint32_t per_byte = 8 / s->bit_depth;
+        uint32_t gray_scale = 255 / ((1 << s->bit_depth) - 1);
+        memset(dst, 0, s->row_bytes);
+        for (x = 0; x < s->width; x++) {
+            if (s->color_type == PNG_COLOR_TYPE_PALETTE_RGB) {
+                v = k3png_PaletteIndex(s, src[4 * x] | (src[4 * x + 1] << 8) | (src[4 * x + 2] << 16));
+            } else {
+                v = src[x] / gray_scale;
+            }
+            dst[x / per_byte] |= v << ((per_byte - 1 - (x % per_byte)) * s->bit_depth);
+        }
+    } else if (s->src_bytes == 1) {
+        for (x = 0; x < s->width; x++) {
+            for (c = 0; c < s->out_channels; c++) {
+                *dst = src[x * s->src_channels + c];
+                dst++;
+            }
+        }
+    } else {
+        const uint16_t* src16 = reinterpret_cast<const uint16_t*>(src);
+        for (x = 0; x < s->width; x++) {
+            for (c = 0; c < s->out_channels; c++) {
+                v = src16[x * s->src_channels + c];
+                dst[0] = static_cast<uint8_t>(v >> 8);
+                dst[1] = static_cast<uint8_t>(v);
+                dst += 2;
+            }
+        }
+    }
+}
+
+void k3png_filter_scanline(uint8_t* dst, const uint8_t* cur, const uint8_t* prev, uint32_t bpp, uint32_t row_bytes, uint8_t filter_type)
+{
+    uint32_t col;
+    uint32_t first = (bpp < row_bytes) ? bpp : row_bytes;
+    switch (filter_type) {
+    case PNG_FILTER_NONE:
+        memcpy(dst, cur, row_bytes);
+        break;
+    case PNG_FILTER_SUB:
+        for (col = 0; col < first; col++) dst[col] = cur[col];
+        for (; col < row_bytes; col++) dst[col] = cur[col] - cur[col - bpp];
+        break;
+    case PNG_FILTER_UP:
+        for (col = 0; col < row_bytes; col++) dst[col] = cur[col] - prev[col];
+        break;
+    case PNG_FILTER_AVG:
+        for (col = 0; col < first; col++) dst[col] = cur[col] - (prev[col] >> 1);
+        for (; col < row_bytes; col++) dst[col] = cur[col] - ((cur[col - bpp] + prev[col]) >> 1);
+        break;
+    case PNG_FILTER_PAETH:
+        for (col = 0; col < first; col++) dst[col] = cur[col] - prev[col];
+        for (; col < row_bytes; col++) dst[col] = cur[col] - k3png_paeth(cur[col - bpp], prev[col], prev[col - bpp]);
+        break;
     }
+}
+
+// Sum of the filtered bytes taken as signed; the usual guess at which filter deflates best
+static uint32_t k3png_filter_cost(const uint8_t* filtered, uint32_t row_bytes)
+{
+    uint32_t col, cost = 0;
+    for (col = 0; col < row_bytes; col++) {
+        cost += (filtered[col] < 128) ? filtered[col] : 256 - filtered[col];
+    }
+    return cost;
+}
 
-    delete[] src_buffer;
+static void K3CALLBACK k3png_FilterGroup(void* context, uint32_t index)
+{
+    const k3pngSave* s = static_cast<const k3pngSave*>(context);
+    uint32_t row_bytes = s->row_bytes;
+    uint32_t row = index * s->rows_per_group;
+    uint32_t end_row = (s->height - row < s->rows_per_group) ? s->height : row + s->rows_per_group;
+    uint8_t* buffer = new uint8_t[7 * row_bytes];
+    uint8_t* prev = buffer;
+    uint8_t* cur = buffer + row_bytes;
+    uint8_t* candidates = buffer + 2 * row_bytes;
+    uint8_t* dst = s->filtered + static_cast<size_t>(row) * (row_bytes + 1);
+    uint32_t cost, best_cost;
+    uint8_t filter_type, best;
+
+    if (row) k3png_PackRow(s, row - 1, prev);
+    else memset(prev, 0, row_bytes);
+
+    for (; row < end_row; row++) {
+        k3png_PackRow(s, row, cur);
+        best = PNG_FILTER_NONE;
+        if (s->adaptive) {
+            best_cost = 0xffffffff;
+            for (filter_type = PNG_FILTER_NONE; filter_type <= PNG_FILTER_PAETH; filter_type++) {
+                k3png_filter_scanline(candidates + filter_type * row_bytes, cur, prev, s->filter_bpp, row_bytes, filter_type);
+                cost = k3png_filter_cost(candidates + filter_type * row_bytes, row_bytes);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best = filter_type;
+                }
+            }
+            memcpy(dst + 1, candidates + best * row_bytes, row_bytes);
+        } else {
+            memcpy(dst + 1, cur, row_bytes);
+        }
+        dst[0] = best;
+        dst += row_bytes + 1;
+        uint8_t* temp = prev;
+        prev = cur;
+        cur = temp;
+    }
+    delete[] buffer;
 }
 
+// Each group is a raw deflate run ending on a byte boundary, so the groups join into one zlib stream;
+// the first leaves room for the zlib header and the last for the adler32 trailer
+static void K3CALLBACK k3png_DeflateGroup(void* context, uint32_t index)
+{
+    k3pngSave* s = static_cast<k3pngSave*>(context);
+    size_t stride = s->row_bytes + 1;
+    size_t start = index * s->rows_per_group * stride;
+    size_t end = (index == s->num_groups - 1) ? s->height * stride : start + s->rows_per_group * stride;
+    uint32_t size = static_cast<uint32_t>(end - start);
+    const uint8_t* in = s->filtered + start;
+    bool last = (index == s->num_groups - 1);
+    uint32_t header = (index == 0) ? 2 : 0;
+    uint32_t trailer = (last) ? 4 : 0;
+    z_stream zs = { 0 };
+
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    deflateInit2(&zs, s->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    if (start) {
+        uint32_t dict_size = (start < PNG_DEFLATE_WINDOW) ? static_cast<uint32_t>(start) : PNG_DEFLATE_WINDOW;
+        deflateSetDictionary(&zs, in - dict_size, dict_size);
+    }
+    uint32_t out_size = static_cast<uint32_t>(deflateBound(&zs, size)) + PNG_DEFLATE_SLACK;
+    uint8_t* out = new uint8_t[out_size];
+    zs.next_in = const_cast<Bytef*>(in);
+    zs.avail_in = size;
+    zs.next_out = out + header;
+    zs.avail_out = out_size - header - trailer;
+    int err = deflate(&zs, (last) ? Z_FINISH : Z_SYNC_FLUSH);
+    s->group_out[index] = out;
+    s->group_out_size[index] = (zs.avail_in == 0 && err != Z_STREAM_ERROR) ? header + static_cast<uint32_t>(zs.total_out) : 0;
+    deflateEnd(&zs);
+    s->group_adler[index] = static_cast<uint32_t>(adler32(adler32(0L, Z_NULL, 0), in, size));
+}
+
+static void k3png_WriteChunk(FILE* file_handle, uint32_t type, const uint8_t* data, uint32_t length)
+{
+    uint32_t be_length = k3_endian_swap32(length);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(&type), 4);
+    if (length) crc = crc32(crc, data, length);
+    uint32_t be_crc = k3_endian_swap32(static_cast<uint32_t>(crc));
+    fwrite(&be_length, 4, 1, file_handle);
+    fwrite(&type, 4, 1, file_handle);
+    if (length) fwrite(data, 1, length, file_handle);
+    fwrite(&be_crc, 4, 1, file_handle);
+}
+
+// A png holds one 2D image, so a volume saves its first slice
 void K3CALLBACK k3png_SaveData(FILE* file_handle,
     uint32_t width, uint32_t height, uint32_t depth,
     uint32_t pitch, uint32_t slice_pitch, k3fmt format,
     const void* data)
 {
+    k3pngSave s = { 0 };
+    uint8_t* converted = NULL;
+    bool opaque = false;
+    uint32_t i;
+
+    s.data = static_cast<const uint8_t*>(data);
+    s.pitch = pitch;
+    s.width = width;
+    s.height = height;
+    s.bit_depth = 8;
+    switch (format) {
+    case k3fmt::R8_UNORM:
+    case k3fmt::A8_UNORM:
+        s.src_channels = 1;
+        s.src_bytes = 1;
+        break;
+    case k3fmt::R16_UNORM:
+        s.src_channels = 1;
+        s.src_bytes = 2;
+        break;
+    case k3fmt::RG8_UNORM:
+        s.src_channels = 2;
+        s.src_bytes = 1;
+        break;
+    case k3fmt::RG16_UNORM:
+        s.src_channels = 2;
+        s.src_bytes = 2;
+        break;
+    case k3fmt::RGBX8_UNORM:
+        opaque = true;
+    case k3fmt::RGBA8_UNORM:
+        s.src_channels = 4;
+        s.src_bytes = 1;
+        break;
+    case k3fmt::RGBA16_UNORM:
+        s.src_channels = 4;
+        s.src_bytes = 2;
+        break;
+    default:
+        // everything else is saved as RGBA, with 16 bits when the format has more than 8 to keep
+        s.src_channels = 4;
+        s.src_bytes = (k3imageObj::GetMaxComponentBits(format) > 8) ? 2 : 1;
+        s.pitch = width * 4 * s.src_bytes;
+        converted = new uint8_t[static_cast<size_t>(s.pitch) * height];
+        k3imageObj::ReformatBuffer(width, height, 1, pitch, slice_pitch, format, data,
+            width, height, 1, s.pitch, s.pitch * height, (s.src_bytes == 2) ? k3fmt::RGBA16_UNORM : k3fmt::RGBA8_UNORM, converted);
+        s.data = converted;
+        break;
+    }
+
+    // Pick the smallest layout the loader reads back to the same pixels
+    switch (s.src_channels) {
+    case 1:
+        s.color_type = PNG_COLOR_TYPE_GRAYSCALE;
+        s.out_channels = 1;
+        if (s.src_bytes == 1) s.bit_depth = k3png_GrayBitDepth(&s);
+        break;
+    case 2:
+        s.color_type = PNG_COLOR_TYPE_GRAYSCALE_ALPHA;
+        s.out_channels = 2;
+        break;
+    default:
+        if (!opaque) opaque = k3png_IsOpaque(&s);
+        s.color_type = (opaque) ? PNG_COLOR_TYPE_COLOR_RGB : PNG_COLOR_TYPE_COLOR_RGBA;
+        s.out_channels = (opaque) ? 3 : 4;
+        if (opaque && s.src_bytes == 1 && k3png_BuildPalette(&s)) {
+            s.color_type = PNG_COLOR_TYPE_PALETTE_RGB;
+            s.out_channels = 1;
+            s.bit_depth = (s.num_palette <= 2) ? 1 : (s.num_palette <= 4) ? 2 : (s.num_palette <= 16) ? 4 : 8;
+        }
+        break;
+    }
+    if (s.src_bytes == 2) s.bit_depth = 16;
+
+    s.row_bytes = (width * s.out_channels * s.bit_depth + 7) / 8;
+    s.filter_bpp = (s.out_channels * s.bit_depth + 7) / 8;
+    s.level = static_cast<int>(k3imageObj::GetFileCompressLevel());
+    // filters rarely help palette and packed gray, and there is nothing to gain when storing
+    s.adaptive = (s.level > 0 && s.bit_depth >= 8 && s.color_type != PNG_COLOR_TYPE_PALETTE_RGB);
+    s.rows_per_group = PNG_DEFLATE_GROUP_SIZE / (s.row_bytes + 1);
+    if (s.rows_per_group == 0) s.rows_per_group = 1;
+    s.num_groups = (height + s.rows_per_group - 1) / s.rows_per_group;
+    s.filtered = new uint8_t[static_cast<size_t>(s.row_bytes + 1) * height];
+    s.group_out = new uint8_t* [s.num_groups];
+    s.group_out_size = new uint32_t[s.num_groups];
+    s.group_adler = new uint32_t[s.num_groups];
+
+    uint32_t threshold = k3imageObj::GetParallelThreshold();
+    if (threshold && width * height >= threshold) {
+        k3parallel::For(s.num_groups, k3png_FilterGroup, &s);
+        k3parallel::For(s.num_groups, k3png_DeflateGroup, &s);
+    } else {
+        for (i = 0; i < s.num_groups; i++) k3png_FilterGroup(&s, i);
+        for (i = 0; i < s.num_groups; i++) k3png_DeflateGroup(&s, i);
+    }
+
+    bool failed = false;
+    uint32_t adler = s.group_adler[0];
+    uint32_t group_size = s.rows_per_group * (s.row_bytes + 1);
+    for (i = 0; i < s.num_groups; i++) {
+        if (s.group_out_size[i] == 0) failed = true;
+        if (i) adler = static_cast<uint32_t>(adler32_combine(adler, s.group_adler[i],
+            (i == s.num_groups - 1) ? (height - i * s.rows_per_group) * (s.row_bytes + 1) : group_size));
+    }
+
+    if (failed) {
+        k3error::Handler("Could not compress image", "k3png_SaveData");
+    } else {
+        // zlib header for a 32KB window, with the level hint zlib itself would write
+        uint32_t zlib_header = 0x7800 | (((s.level < 2) ? 0 : (s.level < 6) ? 1 : (s.level == 6) ? 2 : 3) << 6);
+        zlib_header += 31 - (zlib_header % 31);
+        s.group_out[0][0] = static_cast<uint8_t>(zlib_header >> 8);
+        s.group_out[0][1] = static_cast<uint8_t>(zlib_header);
+        uint8_t* trailer = s.group_out[s.num_groups - 1] + s.group_out_size[s.num_groups - 1];
+        trailer[0] = static_cast<uint8_t>(adler >> 24);
+        trailer[1] = static_cast<uint8_t>(adler >> 16);
+        trailer[2] = static_cast<uint8_t>(adler >> 8);
+        trailer[3] = static_cast<uint8_t>(adler);
+        s.group_out_size[s.num_groups - 1] += 4;
+
+        uint8_t ihdr[13];
+        uint32_t be_width = k3_endian_swap32(width);
+        uint32_t be_height = k3_endian_swap32(height);
+        memcpy(ihdr, &be_width, 4);
+        memcpy(ihdr + 4, &be_height, 4);
+        ihdr[8] = s.bit_depth;
+        ihdr[9] = s.color_type;
+        ihdr[10] = 0;  // deflate
+        ihdr[11] = 0;  // adaptive filtering
+        ihdr[12] = PNG_INTERLACE_NONE;
+
+        uint64_t sig = PNG_SIGNATURE;
+        fwrite(&sig, sizeof(uint64_t), 1, file_handle);
+        k3png_WriteChunk(file_handle, PNG_CHUNK_IHDR, ihdr, sizeof(ihdr));
+        if (s.color_type == PNG_COLOR_TYPE_PALETTE_RGB) {
+            uint8_t plte[3 * 256];
+            for (i = 0; i < s.num_palette; i++) {
+                plte[3 * i + 0] = static_cast<uint8_t>(s.palette[i]);
+                plte[3 * i + 1] = static_cast<uint8_t>(s.palette[i] >> 8);
+                plte[3 * i + 2] = static_cast<uint8_t>(s.palette[i] >> 16);
+            }
+            k3png_WriteChunk(file_handle, PNG_CHUNK_PLTE, plte, 3 * s.num_palette);
+        }
+        for (i = 0; i < s.num_groups; i++) {
+            k3png_WriteChunk(file_handle, PNG_CHUNK_IDAT, s.group_out[i], s.group_out_size[i]);
+        }
+        k3png_WriteChunk(file_handle, PNG_CHUNK_IEND, NULL, 0);
+    }
 
+    for (i = 0; i < s.num_groups; i++) delete[] s.group_out[i];
+    delete[] s.group_out;
+    delete[] s.group_out_size;
+    delete[] s.group_adler;
+    delete[] s.filtered;
+    if (converted) delete[] converted;
 }
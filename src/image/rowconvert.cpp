@@ -0,0 +1,310 @@
+// k3 graphics library
+// row at a time pixel format conversion
+
+#include "k3internal.h"
+#include "k3simd.h"
+#include "k3pixel.h"
+
+// Generic kernels, instantiated once per format
+// The decoders fill in the same defaults as ConvertToUnorm8 and ConvertToFloat4
+template<k3fmt F>
+static void k3row_ToUnorm8(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    uint32_t i;
+    for (i = 0; i < num_pixels; i++) {
+        d[0] = 0; d[1] = 0; d[2] = 0; d[3] = 0xff;
+        k3pixel<F>::ToUnorm8(s, d);
+        s += k3pixel<F>::SIZE;
+        d += 4;
+    }
+}
+
+template<k3fmt F>
+static void k3row_FromUnorm8(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    uint32_t i;
+    for (i = 0; i < num_pixels; i++) {
+        k3pixel<F>::FromUnorm8(s, d);
+        s += 4;
+        d += k3pixel<F>::SIZE;
+    }
+}
+
+template<k3fmt F>
+static void k3row_ToFloat4(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    float* d = static_cast<float*>(dest);
+    uint32_t i;
+    for (i = 0; i < num_pixels; i++) {
+        d[0] = 0.0f; d[1] = 0.0f; d[2] = 0.0f; d[3] = 1.0f;
+        k3pixel<F>::ToFloat4(s, d);
+        s += k3pixel<F>::SIZE;
+        d += 4;
+    }
+}
+
+template<k3fmt F>
+static void k3row_FromFloat4(const void* src, void* dest, uint32_t num_pixels)
+{
+    const float* s = static_cast<const float*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    uint32_t i;
+    for (i = 0; i < num_pixels; i++) {
+        k3pixel<F>::FromFloat4(s, d);
+        s += 4;
+        d += k3pixel<F>::SIZE;
+    }
+}
+
+static k3rowConverter::row_ptr k3row_GetDecoder(k3fmt format, bool use_unorm8)
+{
+    switch (format) {
+#define K3_PIXEL_CASE(F) case k3fmt::F: return (use_unorm8) ? k3row_ToUnorm8<k3fmt::F> : k3row_ToFloat4<k3fmt::F>;
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
+    default:
+        return NULL;
+    }
+}
+
+static k3rowConverter::row_ptr k3row_GetEncoder(k3fmt format, bool use_unorm8)
+{
+    switch (format) {
+#define K3_PIXEL_CASE(F) case k3fmt::F: return (use_unorm8) ? k3row_FromUnorm8<k3fmt::F> : k3row_FromFloat4<k3fmt::F>;
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
+    default:
+        return NULL;
+    }
+}
+
+// Scalar reference for a single pair; the simd kernels use it for the pixels left over
+// after their last full vector
+template<k3fmt S, k3fmt D, bool USE_UNORM8>
+static void k3row_Convert(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    uint8_t u8[4];
+    float f32[4];
+    uint32_t i;
+    for (i = 0; i < num_pixels; i++) {
+        if (USE_UNORM8) {
+            u8[0] = 0; u8[1] = 0; u8[2] = 0; u8[3] = 0xff;
+            k3pixel<S>::ToUnorm8(s, u8);
+            k3pixel<D>::FromUnorm8(u8, d);
+        } else {
+            f32[0] = 0.0f; f32[1] = 0.0f; f32[2] = 0.0f; f32[3] = 1.0f;
+            k3pixel<S>::ToFloat4(s, f32);
+            k3pixel<D>::FromFloat4(f32, d);
+        }
+        s += k3pixel<S>::SIZE;
+        d += k3pixel<D>::SIZE;
+    }
+}
+
+#if defined(K3_SIMD_X86)
+
+// RGBA8 <-> BGRA8; swapping red and blue is its own inverse
+K3_TARGET_SSE41 static void k3row_SwapRB8SSE41(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    uint32_t i;
+    for (i = 0; i + 4 <= num_pixels; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 4 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * i), _mm_shuffle_epi8(v, shuf));
+    }
+    k3row_Convert<k3fmt::RGBA8_UNORM, k3fmt::BGRA8_UNORM, true>(s + 4 * i, d + 4 * i, num_pixels - i);
+}
+
+K3_TARGET_AVX2 static void k3row_SwapRB8AVX2(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    uint32_t i;
+    for (i = 0; i + 8 <= num_pixels; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 4 * i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d + 4 * i), _mm256_shuffle_epi8(v, shuf));
+    }
+    k3row_Convert<k3fmt::RGBA8_UNORM, k3fmt::BGRA8_UNORM, true>(s + 4 * i, d + 4 * i, num_pixels - i);
+}
+
+K3_TARGET_SSE41 static void k3row_RGB8ToRGBA8SSE41(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int32_t>(0xff000000));
+    uint32_t i;
+    // each load reads 16 bytes for 4 pixels, so stop while 2 pixels remain past the last full vector
+    for (i = 0; i + 6 <= num_pixels; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 3 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * i), _mm_or_si128(_mm_shuffle_epi8(v, shuf), alpha));
+    }
+    k3row_Convert<k3fmt::RGB8_UNORM, k3fmt::RGBA8_UNORM, true>(s + 3 * i, d + 4 * i, num_pixels - i);
+}
+
+K3_TARGET_SSE41 static void k3row_R8ToRGBA8SSE41(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int32_t>(0xff000000));
+    uint32_t i;
+    for (i = 0; i + 16 <= num_pixels; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * i), _mm_or_si128(_mm_cvtepu8_epi32(v), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * i + 16), _mm_or_si128(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4)), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * i + 32), _mm_or_si128(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8)), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * i + 48), _mm_or_si128(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12)), alpha));
+    }
+    k3row_Convert<k3fmt::R8_UNORM, k3fmt::RGBA8_UNORM, true>(s + i, d + 4 * i, num_pixels - i);
+}
+
+// Same truncating conversion as ConvertFloat32ToFloat16, on 4 floats; the halves land in the low 16 bits of each lane
+K3_TARGET_SSE41 static inline __m128i k3sse_Float32ToFloat16(__m128 f)
+{
+    __m128i u = _mm_castps_si128(f);
+    __m128i sign = _mm_srli_epi32(_mm_and_si128(u, _mm_set1_epi32(static_cast<int32_t>(0x80000000))), 16);
+    __m128i exp = _mm_and_si128(_mm_srli_epi32(u, 23), _mm_set1_epi32(0xff));
+    __m128i man = _mm_srli_epi32(_mm_and_si128(u, _mm_set1_epi32(0x7fffff)), 13);
+    __m128i h = _mm_or_si128(_mm_slli_epi32(_mm_sub_epi32(exp, _mm_set1_epi32(127 - 15)), 10), man);
+    h = _mm_blendv_epi8(h, _mm_set1_epi32(0x1f << 10), _mm_cmpgt_epi32(exp, _mm_set1_epi32(127 + 15)));
+    h = _mm_andnot_si128(_mm_cmplt_epi32(exp, _mm_set1_epi32(127 - 14)), h);
+    return _mm_or_si128(h, sign);
+}
+
+// Same conversion as ConvertFloat16ToFloat32, on 4 halves held in the low 16 bits of each lane
+K3_TARGET_SSE41 static inline __m128 k3sse_Float16ToFloat32(__m128i h)
+{
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i exp = _mm_and_si128(_mm_srli_epi32(h, 10), _mm_set1_epi32(0x1f));
+    __m128i man = _mm_and_si128(h, _mm_set1_epi32(0x3ff));
+    __m128i man32 = _mm_slli_epi32(man, 13);
+    __m128i f = _mm_or_si128(_mm_slli_epi32(_mm_add_epi32(exp, _mm_set1_epi32(127 - 15)), 23), man32);
+    f = _mm_blendv_epi8(f, _mm_or_si128(_mm_set1_epi32(0xff << 23), man32), _mm_cmpeq_epi32(exp, _mm_set1_epi32(0x1f)));
+    // denorms are exactly man * 2^-24
+    __m128 denorm = _mm_mul_ps(_mm_cvtepi32_ps(man), _mm_set1_ps(1.0f / (1 << 24)));
+    f = _mm_blendv_epi8(f, _mm_castps_si128(denorm), _mm_cmpeq_epi32(exp, _mm_setzero_si128()));
+    return _mm_castsi128_ps(_mm_or_si128(f, sign));
+}
+
+K3_TARGET_SSE41 static void k3row_RGBA8ToRGBA16FSSE41(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    uint32_t i;
+    for (i = 0; i + 2 <= num_pixels; i += 2) {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + 4 * i));
+        __m128i h0 = k3sse_Float32ToFloat16(_mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), scale));
+        __m128i h1 = k3sse_Float32ToFloat16(_mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d + 8 * i), _mm_packus_epi32(h0, h1));
+    }
+    k3row_Convert<k3fmt::RGBA8_UNORM, k3fmt::RGBA16_FLOAT, true>(s + 4 * i, d + 8 * i, num_pixels - i);
+}
+
+K3_TARGET_SSE41 static void k3row_RGBA16FToRGBA32FSSE41(const void* src, void* dest, uint32_t num_pixels)
+{
+    const uint8_t* s = static_cast<const uint8_t*>(src);
+    uint8_t* d = static_cast<uint8_t*>(dest);
+    uint32_t i;
+    for (i = 0; i + 2 <= num_pixels; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 8 * i));
+        _mm_storeu_ps(reinterpret_cast<float*>(d + 16 * i), k3sse_Float16ToFloat32(_mm_cvtepu16_epi32(v)));
+        _mm_storeu_ps(reinterpret_cast<float*>(d + 16 * i + 16), k3sse_Float16ToFloat32(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8))));
+    }
+    k3row_Convert<k3fmt::RGBA16_FLOAT, k3fmt::RGBA32_FLOAT, false>(s + 8 * i, d + 16 * i, num_pixels - i);
+}
+
+#endif
+
+// Pairs with hand written kernels; the level's best kernel is picked, falling back to a lower level,
+// and then to the generic path
+struct k3rowPairKernel {
+    k3fmt src_format;
+    k3fmt dest_format;
+    k3rowConverter::row_ptr sse41;
+    k3rowConverter::row_ptr avx2;
+};
+
+#if defined(K3_SIMD_X86)
+static const k3rowPairKernel k3row_pair_kernels[] = {
+    { k3fmt::RGBA8_UNORM, k3fmt::BGRA8_UNORM, k3row_SwapRB8SSE41, k3row_SwapRB8AVX2 },
+    { k3fmt::BGRA8_UNORM, k3fmt::RGBA8_UNORM, k3row_SwapRB8SSE41, k3row_SwapRB8AVX2 },
+    { k3fmt::RGB8_UNORM, k3fmt::RGBA8_UNORM, k3row_RGB8ToRGBA8SSE41, NULL },
+    { k3fmt::R8_UNORM, k3fmt::RGBA8_UNORM, k3row_R8ToRGBA8SSE41, NULL },
+    { k3fmt::RGBA8_UNORM, k3fmt::RGBA16_FLOAT, k3row_RGBA8ToRGBA16FSSE41, NULL },
+    { k3fmt::RGBA16_FLOAT, k3fmt::RGBA32_FLOAT, k3row_RGBA16FToRGBA32FSSE41, NULL }
+};
+static const uint32_t K3_ROW_NUM_PAIR_KERNELS = sizeof(k3row_pair_kernels) / sizeof(k3rowPairKernel);
+#endif
+
+k3rowConverter::k3rowConverter() :
+    _copy_size(0), _pair(NULL), _decode(NULL), _encode(NULL), _src_size(0), _dest_size(0), _use_unorm8(false)
+{ }
+
+bool k3rowConverter::Select(k3fmt src_format, k3fmt dest_format)
+{
+    _copy_size = 0;
+    _pair = NULL;
+    _decode = NULL;
+    _encode = NULL;
+
+    if (src_format == dest_format) {
+        _copy_size = k3imageObj::GetFormatSize(src_format);
+        return (_copy_size != 0);
+    }
+
+    _use_unorm8 = (k3imageObj::GetMaxComponentBits(src_format) <= 8 || k3imageObj::GetMaxComponentBits(dest_format) <= 8);
+    _decode = k3row_GetDecoder(src_format, _use_unorm8);
+    _encode = k3row_GetEncoder(dest_format, _use_unorm8);
+    if (_decode == NULL || _encode == NULL) return false;
+    _src_size = k3imageObj::GetFormatSize(src_format);
+    _dest_size = k3imageObj::GetFormatSize(dest_format);
+
+#if defined(K3_SIMD_X86)
+    k3simdLevel level = k3math_GetSimdLevel();
+    uint32_t i;
+    for (i = 0; i < K3_ROW_NUM_PAIR_KERNELS; i++) {
+        const k3rowPairKernel* k = &(k3row_pair_kernels[i]);
+        if (k->src_format == src_format && k->dest_format == dest_format) {
+            if (level == k3simdLevel::AVX2 && k->avx2) _pair = k->avx2;
+            else if (level == k3simdLevel::AVX2 || level == k3simdLevel::SSE41) _pair = k->sse41;
+            break;
+        }
+    }
+#endif
+    return true;
+}
+
+void k3rowConverter::Convert(const void* src, void* dest, uint32_t num_pixels) const
+{
+    if (_copy_size) {
+        if (src != dest) memcpy(dest, src, num_pixels * _copy_size);
+    } else if (_pair) {
+        _pair(src, dest, num_pixels);
+    } else {
+        const uint8_t* s = static_cast<const uint8_t*>(src);
+        uint8_t* d = static_cast<uint8_t*>(dest);
+        // sized for the float intermediate; the unorm8 one uses the first quarter
+        float chunk[4 * CHUNK_PIXELS];
+        uint32_t n;
+        while (num_pixels) {
+            n = (num_pixels < CHUNK_PIXELS) ? num_pixels : CHUNK_PIXELS;
+            _decode(s, chunk, n);
+            _encode(chunk, d, n);
+            s += n * _src_size;
+            d += n * _dest_size;
+            num_pixels -= n;
+        }
+    }
+}
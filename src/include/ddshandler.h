@@ -4,12 +4,23 @@
 
 extern k3image_file_handler_t k3DDSHandler;
 
-void K3CALLBACK k3dds_LoadHeaderInfo(FILE* file_handle,
+void K3CALLBACK k3dds_LoadHeaderInfo(k3imageSource* source, void** context,
     uint32_t* width, uint32_t* height, uint32_t* depth, k3fmt* format);
 
-void K3CALLBACK k3dds_LoadData(FILE* file_handle, uint32_t pitch, uint32_t slice_pitch, void* data);
+void K3CALLBACK k3dds_LoadData(k3imageSource* source, void* context, uint32_t pitch, uint32_t slice_pitch, void* data);
+
+void K3CALLBACK k3dds_LoadSubresourceInfo(k3imageSource* source, void* context, uint32_t* mip_levels, uint32_t* array_size, bool* cubemap);
+
+void K3CALLBACK k3dds_LoadRegion(k3imageSource* source, void* context,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data);
+
+void K3CALLBACK k3dds_EndLoad(void* context);
 
 void K3CALLBACK k3dds_SaveData(FILE* file_handle,
     uint32_t width, uint32_t height, uint32_t depth, 
     uint32_t pitch, uint32_t slice_pitch, k3fmt format,
     const void* data);
+
+void K3CALLBACK k3dds_SaveSubresources(FILE* file_handle, k3fmt format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap, const k3subresourceDesc* desc, const void* data);
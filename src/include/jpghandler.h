@@ -4,10 +4,19 @@
 
 extern k3image_file_handler_t k3JPGHandler;
 
-void K3CALLBACK k3jpg_LoadHeaderInfo(FILE* file_handle,
+void K3CALLBACK k3jpg_LoadHeaderInfo(k3imageSource* source, void** context,
     uint32_t* width, uint32_t* height, uint32_t* depth, k3fmt* format);
 
-void K3CALLBACK k3jpg_LoadData(FILE* file_handle, uint32_t pitch, uint32_t slice_pitch, void* data);
+void K3CALLBACK k3jpg_LoadData(k3imageSource* source, void* context, uint32_t pitch, uint32_t slice_pitch, void* data);
+
+void K3CALLBACK k3jpg_EndLoad(void* context);
+
+void K3CALLBACK k3jpg_LoadScaledSize(k3imageSource* source, void* context,
+    uint32_t dest_width, uint32_t dest_height, uint32_t* width, uint32_t* height);
+
+void K3CALLBACK k3jpg_LoadRegion(k3imageSource* source, void* context,
+    uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth,
+    uint32_t pitch, uint32_t slice_pitch, void* data);
 
 void K3CALLBACK k3jpg_SaveData(FILE* file_handle,
     uint32_t width, uint32_t height, uint32_t depth,
@@ -0,0 +1,39 @@
+// k3 graphics library
+// 4 wide triangle bvh used for cpu ray casts
+#pragma once
+
+#include "k3.h"
+
+// Child boxes are stored as structure of arrays, so a node tests all 4 against a ray at once
+static const uint32_t K3_BVH_LEAF = 0x80000000;  // child is an index into the triangle packets, instead of a node
+struct k3bvh4Node {
+    float min[3][4];
+    float max[3][4];
+    uint32_t child[4];  // unused children have a box of +inf on both ends, which no ray with a finite t can reach
+};
+
+// Leaf of up to 4 triangles, stored as first vertex and its 2 edges; unused lanes have zero edges
+struct k3bvhTri4 {
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+    uint32_t prim[4];
+};
+
+struct k3meshBVH {
+    float min[3];
+    float max[3];
+    uint32_t num_nodes;
+    uint32_t num_packets;
+    k3bvh4Node* nodes;
+    k3bvhTri4* packets;
+};
+
+// Builds bvh over triangles prim_start to prim_start + num_prims - 1; verts holds 3 floats per vertex
+// Corner k of triangle p is vertex indices[3 * p + k], or vertex 3 * p + k when indices is NULL
+// The caller frees nodes and packets with delete[]; both stay NULL when there are no triangles
+void k3bvh_Build(k3meshBVH* bvh, const float* verts, const uint32_t* indices, uint32_t prim_start, uint32_t num_prims);
+
+// Closest hit in one bvh; t, bary and prim are only written for a hit closer than the incoming t
+// Triangles are hit from either side; dir need not be normalized, and t is in units of dir
+bool k3bvh_Trace(const k3meshBVH* bvh, const float* origin, const float* dir, float* t, float* bary, uint32_t* prim);
@@ -2,22 +2,42 @@
 // internal header file
 #pragma once
 
+// static builds (k3math) define K3DECLSPEC empty on the command line
+#ifndef K3DECLSPEC
 #ifdef _WIN32
 #define K3DECLSPEC __declspec( dllexport )
 #else
 #define K3DECLSPEC 
 #endif
+#endif
 
 #include "k3.h"
 
+#include <mutex>
+#include <atomic>
+
+#ifndef _WIN32
+#include <stdio.h>
+#include <errno.h>
+// fopen_s is only in the microsoft crt
+static inline int fopen_s(FILE** file_handle, const char* file_name, const char* mode)
+{
+    *file_handle = fopen(file_name, mode);
+    return (*file_handle == NULL) ? errno : 0;
+}
+#endif
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
 #include "fbx.h"
 #include "dsp.h"
+#include "k3bvh.h"
 #include "../flac/foxen-flac.h"
 
 const uint32_t K3_MATH_STATIC_ARRAY_SIZE = 16;
+// largest square matrix the general size math functions handle on the stack, without heap allocation
+const uint32_t K3_MATH_STACK_ROWS = 64;
 
 class k3imageImpl
 {
@@ -29,6 +49,11 @@ public:
     uint32_t _size;
     uint32_t _pitch_pad;
     uint32_t _slice_pitch_pad;
+    // alignment of every subresource after the first
+    uint32_t _subresource_pad;
+    uint32_t _mip_levels;
+    uint32_t _array_size;
+    bool _cubemap;
     void* _image_data;
 };
 
@@ -298,6 +323,9 @@ public:
     k3emptyModel* _empties;
     k3bone* _bones;
     k3anim* _anim;
+    // per mesh, built by the first ray cast; published only once every mesh is built
+    std::atomic<k3meshBVH*> _bvh;
+    std::mutex _bvh_lock;
     k3buffer _ib;
     k3buffer _vb;  // vertex buffer; cotains only positions
     k3buffer _ab;  // attribute buffer; contains normals, tangents and uv
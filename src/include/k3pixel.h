@@ -0,0 +1,1261 @@
+// k3 graphics library
+// per pixel format conversions, and row converters built from them
+#pragma once
+
+// Every uncompressed format; each has a k3pixel specialization below
+#define K3_PIXEL_FORMATS(X) \
+    X(RGBA8_UNORM) X(BGRA8_UNORM) \
+    X(RGBX8_UNORM) X(BGRX8_UNORM) \
+    X(RGBA16_UNORM) X(RGBA16_FLOAT) \
+    X(RGBA32_UNORM) X(RGBA32_FLOAT) \
+    X(RGB10A2_UNORM) X(BGR5A1_UNORM) \
+    X(RGBA32_UINT) X(RGBA16_UINT) \
+    X(RGB8_UNORM) X(BGR8_UNORM) \
+    X(RGB32_FLOAT) X(B5G6R5_UNORM) \
+    X(RGB32_UINT) X(RG8_UNORM) \
+    X(RG16_UNORM) X(RG16_FLOAT) \
+    X(RG32_UNORM) X(RG32_FLOAT) \
+    X(RG32_UINT) X(RG16_UINT) \
+    X(R8_UNORM) X(A8_UNORM) \
+    X(R16_UNORM) X(R16_FLOAT) \
+    X(R32_UNORM) X(R32_FLOAT) \
+    X(R32_UINT) X(R16_UINT) \
+    X(D16_UNORM) X(D24X8_UNORM) \
+    X(D24_UNORM_S8_UINT) X(D32_FLOAT) \
+    X(D32_FLOAT_S8X24_UINT) X(RGB9E5_FLOAT)
+
+// Conversions for a single pixel of format F
+// SIZE is the pixel size in bytes, and matches k3imageObj::GetFormatSize
+// ToFloat4 and ToUnorm8 only write the channels the format has, so the caller sets the defaults
+// for missing channels first; FromFloat4 and FromUnorm8 only write the bits the format defines
+template<k3fmt F> struct k3pixel;
+
+template<> struct k3pixel<k3fmt::RGBA8_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+        dest[2] = u8src[2] / static_cast<float>(0xff);
+        dest[3] = u8src[3] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+        u8dest[2] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
+        u8dest[3] = static_cast<uint8_t>(src[3] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0];
+        dest[1] = u8src[1];
+        dest[2] = u8src[2];
+        dest[3] = u8src[3];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[0];
+        u8dest[1] = src[1];
+        u8dest[2] = src[2];
+        u8dest[3] = src[3];
+    }
+};
+
+template<> struct k3pixel<k3fmt::BGRA8_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[2] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+        dest[2] = u8src[0] / static_cast<float>(0xff);
+        dest[3] = u8src[3] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+        u8dest[2] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+        u8dest[3] = static_cast<uint8_t>(src[3] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[2];
+        dest[1] = u8src[1];
+        dest[2] = u8src[0];
+        dest[3] = u8src[3];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[2];
+        u8dest[1] = src[1];
+        u8dest[2] = src[0];
+        u8dest[3] = src[3];
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBX8_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+        dest[2] = u8src[2] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+        u8dest[2] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0];
+        dest[1] = u8src[1];
+        dest[2] = u8src[2];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[0];
+        u8dest[1] = src[1];
+        u8dest[2] = src[2];
+    }
+};
+
+template<> struct k3pixel<k3fmt::BGRX8_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[2] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+        dest[2] = u8src[0] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+        u8dest[2] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[2];
+        dest[1] = u8src[1];
+        dest[2] = u8src[0];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[2];
+        u8dest[1] = src[1];
+        u8dest[2] = src[0];
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBA16_UNORM>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0] / static_cast<float>(0xffff);
+        dest[1] = u16src[1] / static_cast<float>(0xffff);
+        dest[2] = u16src[2] / static_cast<float>(0xffff);
+        dest[3] = u16src[3] / static_cast<float>(0xffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
+        u16dest[1] = static_cast<uint16_t>(src[1] * 0xffff + 0.5);
+        u16dest[2] = static_cast<uint16_t>(src[2] * 0xffff + 0.5);
+        u16dest[3] = static_cast<uint16_t>(src[3] * 0xffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
+        dest[1] = static_cast<uint8_t>(u16src[1] >> 8);
+        dest[2] = static_cast<uint8_t>(u16src[2] >> 8);
+        dest[3] = static_cast<uint8_t>(u16src[3] >> 8);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
+        u16dest[1] = (static_cast<uint16_t>(src[1]) << 8) | src[1];
+        u16dest[2] = (static_cast<uint16_t>(src[2]) << 8) | src[2];
+        u16dest[3] = (static_cast<uint16_t>(src[3]) << 8) | src[3];
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBA16_FLOAT>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 0));
+        dest[1] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 1));
+        dest[2] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 2));
+        dest[3] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 3));
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = k3imageObj::ConvertFloat32ToFloat16(src[0]);
+        u16dest[1] = k3imageObj::ConvertFloat32ToFloat16(src[1]);
+        u16dest[2] = k3imageObj::ConvertFloat32ToFloat16(src[2]);
+        u16dest[3] = k3imageObj::ConvertFloat32ToFloat16(src[3]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 0)) * 0xff);
+        dest[1] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 1)) * 0xff);
+        dest[2] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 2)) * 0xff);
+        dest[3] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 3)) * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = k3imageObj::ConvertFloat32ToFloat16(src[0] / 255.0f);
+        u16dest[1] = k3imageObj::ConvertFloat32ToFloat16(src[1] / 255.0f);
+        u16dest[2] = k3imageObj::ConvertFloat32ToFloat16(src[2] / 255.0f);
+        u16dest[3] = k3imageObj::ConvertFloat32ToFloat16(src[3] / 255.0f);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBA32_UNORM>
+{
+    static const uint32_t SIZE = 16;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = u32src[0] / static_cast<float>(0xffffffff);
+        dest[1] = u32src[1] / static_cast<float>(0xffffffff);
+        dest[2] = u32src[2] / static_cast<float>(0xffffffff);
+        dest[3] = u32src[3] / static_cast<float>(0xffffffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffffff + 0.5);
+        u32dest[1] = static_cast<uint32_t>(src[1] * 0xffffffff + 0.5);
+        u32dest[2] = static_cast<uint32_t>(src[2] * 0xffffffff + 0.5);
+        u32dest[3] = static_cast<uint32_t>(src[3] * 0xffffffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<uint8_t>(u32src[0] >> 24);
+        dest[1] = static_cast<uint8_t>(u32src[1] >> 24);
+        dest[2] = static_cast<uint8_t>(u32src[2] >> 24);
+        dest[3] = static_cast<uint8_t>(u32src[3] >> 24);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        uint32_t color32r, color32g, color32b, color32a;
+        color32r = static_cast<uint32_t>(src[0]);
+        color32g = static_cast<uint32_t>(src[1]);
+        color32b = static_cast<uint32_t>(src[2]);
+        color32a = static_cast<uint32_t>(src[3]);
+        u32dest[0] = (color32r << 24) | (color32r << 16) | (color32r << 8) | color32r;
+        u32dest[1] = (color32g << 24) | (color32g << 16) | (color32g << 8) | color32g;
+        u32dest[2] = (color32b << 24) | (color32b << 16) | (color32b << 8) | color32b;
+        u32dest[3] = (color32a << 24) | (color32a << 16) | (color32a << 8) | color32a;
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBA32_FLOAT>
+{
+    static const uint32_t SIZE = 16;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = f32src[0];
+        dest[1] = f32src[1];
+        dest[2] = f32src[2];
+        dest[3] = f32src[3];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0];
+        f32dest[1] = src[1];
+        f32dest[2] = src[2];
+        f32dest[3] = src[3];
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
+        dest[1] = static_cast<uint8_t>(f32src[1] * 0xff);
+        dest[2] = static_cast<uint8_t>(f32src[2] * 0xff);
+        dest[3] = static_cast<uint8_t>(f32src[3] * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0] / 255.0f;
+        f32dest[1] = src[1] / 255.0f;
+        f32dest[2] = src[2] / 255.0f;
+        f32dest[3] = src[3] / 255.0f;
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGB10A2_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = ((u32src[0] >> 22) & 0x3ff) / static_cast<float>(0x3ff);
+        dest[1] = ((u32src[0] >> 12) & 0x3ff) / static_cast<float>(0x3ff);
+        dest[2] = ((u32src[0] >> 2) & 0x3ff) / static_cast<float>(0x3ff);
+        dest[3] = ((u32src[0] >> 0) & 0x3) / static_cast<float>(0x3);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = ((static_cast<uint32_t>(src[0] * 0x3ff + 0.5) << 22) |
+            (static_cast<uint32_t>(src[1] * 0x3ff + 0.5) << 12) |
+            (static_cast<uint32_t>(src[2] * 0x3ff + 0.5) << 2) |
+            (static_cast<uint32_t>(src[3] * 0x3 + 0.5) << 0));
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        uint8_t alpha_val;
+        dest[0] = static_cast<uint8_t>((u32src[0] >> 24) & 0xff);
+        dest[1] = static_cast<uint8_t>((u32src[0] >> 14) & 0xff);
+        dest[2] = static_cast<uint8_t>((u32src[0] >> 4) & 0xff);
+        alpha_val = static_cast<uint8_t>((u32src[0] >> 0) & 0x3);
+        dest[3] = (alpha_val << 6) | (alpha_val << 4) | (alpha_val << 2) | alpha_val;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        uint32_t color32r, color32g, color32b, color32a;
+        color32r = src[0]; color32r = (color32r << 2) | (color32r >> 6);
+        color32g = src[1]; color32g = (color32g << 2) | (color32g >> 6);
+        color32b = src[2]; color32b = (color32b << 2) | (color32b >> 6);
+        color32a = src[3] >> 6;
+        u32dest[0] = (color32r << 22) | (color32g << 12) | (color32b << 2) | color32a;
+    }
+};
+
+template<> struct k3pixel<k3fmt::BGR5A1_UNORM>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = ((u16src[0] >> 1) & 0x1f) / static_cast<float>(0x1f);
+        dest[1] = ((u16src[0] >> 6) & 0x1f) / static_cast<float>(0x1f);
+        dest[2] = ((u16src[0] >> 11) & 0x1f) / static_cast<float>(0x1f);
+        dest[3] = ((u16src[0] >> 0) & 0x1) / static_cast<float>(0x1);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = ((static_cast<uint16_t>(src[0] * 0x1f + 0.5) << 1) |
+            (static_cast<uint16_t>(src[1] * 0x1f + 0.5) << 6) |
+            (static_cast<uint16_t>(src[2] * 0x1f + 0.5) << 11) |
+            (static_cast<uint16_t>(src[3] * 0x1 + 0.5) << 0));
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = ((u16src[0] << 2) & 0xf8) | ((u16src[0] >> 3) & 0x07);
+        dest[1] = ((u16src[0] >> 3) & 0xf8) | ((u16src[0] >> 8) & 0x07);
+        dest[2] = ((u16src[0] >> 8) & 0xf8) | ((u16src[0] >> 13) & 0x07);
+        dest[3] = ((u16src[0] >> 0) & 0x1) ? 0xff : 0x00;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        uint32_t color32r, color32g, color32b, color32a;
+        color32r = src[0] >> 3;
+        color32g = src[1] >> 3;
+        color32b = src[2] >> 3;
+        color32a = src[3] >> 7;
+        u16dest[0] = static_cast<uint16_t>((color32r << 1) | (color32g << 6) | (color32b << 11) | color32a);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBA32_UINT>
+{
+    static const uint32_t SIZE = 16;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<float>(u32src[0]);
+        dest[1] = static_cast<float>(u32src[1]);
+        dest[2] = static_cast<float>(u32src[2]);
+        dest[3] = static_cast<float>(u32src[3]);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0]);
+        u32dest[1] = static_cast<uint32_t>(src[1]);
+        u32dest[2] = static_cast<uint32_t>(src[2]);
+        u32dest[3] = static_cast<uint32_t>(src[3]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = (u32src[0] != 0) ? 1 : 0;
+        dest[1] = (u32src[1] != 0) ? 1 : 0;
+        dest[2] = (u32src[2] != 0) ? 1 : 0;
+        dest[3] = (u32src[3] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
+        u32dest[1] = static_cast<uint32_t>(src[1] >> 7);
+        u32dest[2] = static_cast<uint32_t>(src[2] >> 7);
+        u32dest[3] = static_cast<uint32_t>(src[3] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGBA16_UINT>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0];
+        dest[1] = u16src[1];
+        dest[2] = u16src[2];
+        dest[3] = u16src[3];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0]);
+        u16dest[1] = static_cast<uint16_t>(src[1]);
+        u16dest[2] = static_cast<uint16_t>(src[2]);
+        u16dest[3] = static_cast<uint16_t>(src[3]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = (u16src[0] != 0) ? 1 : 0;
+        dest[1] = (u16src[1] != 0) ? 1 : 0;
+        dest[2] = (u16src[2] != 0) ? 1 : 0;
+        dest[3] = (u16src[3] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] >> 7);
+        u16dest[1] = static_cast<uint16_t>(src[1] >> 7);
+        u16dest[2] = static_cast<uint16_t>(src[2] >> 7);
+        u16dest[3] = static_cast<uint16_t>(src[3] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGB8_UNORM>
+{
+    static const uint32_t SIZE = 3;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+        dest[2] = u8src[2] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+        u8dest[2] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0];
+        dest[1] = u8src[1];
+        dest[2] = u8src[2];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[0];
+        u8dest[1] = src[1];
+        u8dest[2] = src[2];
+    }
+};
+
+template<> struct k3pixel<k3fmt::BGR8_UNORM>
+{
+    static const uint32_t SIZE = 3;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[2] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+        dest[2] = u8src[0] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[2] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+        u8dest[2] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[2];
+        dest[1] = u8src[1];
+        dest[2] = u8src[0];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[2];
+        u8dest[1] = src[1];
+        u8dest[2] = src[0];
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGB32_FLOAT>
+{
+    static const uint32_t SIZE = 12;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = f32src[0];
+        dest[1] = f32src[1];
+        dest[2] = f32src[2];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0];
+        f32dest[1] = src[1];
+        f32dest[2] = src[2];
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
+        dest[1] = static_cast<uint8_t>(f32src[1] * 0xff);
+        dest[2] = static_cast<uint8_t>(f32src[2] * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0] / 255.0f;
+        f32dest[1] = src[1] / 255.0f;
+        f32dest[2] = src[2] / 255.0f;
+    }
+};
+
+template<> struct k3pixel<k3fmt::B5G6R5_UNORM>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = ((u16src[0] >> 11) & 0x1f) / static_cast<float>(0x1f);
+        dest[1] = ((u16src[0] >> 5) & 0x3f) / static_cast<float>(0x3f);
+        dest[2] = ((u16src[0] >> 0) & 0x1f) / static_cast<float>(0x1f);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = ((static_cast<uint16_t>(src[0] * 0x1f + 0.5) << 11) |
+            (static_cast<uint16_t>(src[1] * 0x3f + 0.5) << 5) |
+            (static_cast<uint16_t>(src[2] * 0x1f + 0.5) << 0));
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = ((u16src[0] >> 8) & 0xf8) | ((u16src[0] >> 13) & 0x07);
+        dest[1] = ((u16src[0] >> 3) & 0xfc) | ((u16src[0] >> 9) & 0x03);
+        dest[2] = ((u16src[0] << 3) & 0xf8) | ((u16src[0] >> 2) & 0x07);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        uint32_t color32r, color32g, color32b;
+        color32r = src[0] >> 3;
+        color32g = src[1] >> 2;
+        color32b = src[2] >> 3;
+        u16dest[0] = static_cast<uint16_t>((color32r << 11) | (color32g << 5) | color32b);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGB32_UINT>
+{
+    static const uint32_t SIZE = 12;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<float>(u32src[0]);
+        dest[1] = static_cast<float>(u32src[1]);
+        dest[2] = static_cast<float>(u32src[2]);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0]);
+        u32dest[1] = static_cast<uint32_t>(src[1]);
+        u32dest[2] = static_cast<uint32_t>(src[2]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = (u32src[0] != 0) ? 1 : 0;
+        dest[1] = (u32src[1] != 0) ? 1 : 0;
+        dest[2] = (u32src[2] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
+        u32dest[1] = static_cast<uint32_t>(src[1] >> 7);
+        u32dest[2] = static_cast<uint32_t>(src[2] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG8_UNORM>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0] / static_cast<float>(0xff);
+        dest[1] = u8src[1] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+        u8dest[1] = static_cast<uint8_t>(src[1] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0];
+        dest[1] = u8src[1];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[0];
+        u8dest[1] = src[1];
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG16_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0] / static_cast<float>(0xffff);
+        dest[1] = u16src[1] / static_cast<float>(0xffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
+        u16dest[1] = static_cast<uint16_t>(src[1] * 0xffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
+        dest[1] = static_cast<uint8_t>(u16src[1] >> 8);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
+        u16dest[1] = (static_cast<uint16_t>(src[1]) << 8) | src[1];
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG16_FLOAT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 0));
+        dest[1] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 1));
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = k3imageObj::ConvertFloat32ToFloat16(src[0]);
+        u16dest[1] = k3imageObj::ConvertFloat32ToFloat16(src[1]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 0)) * 0xff);
+        dest[1] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 1)) * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = k3imageObj::ConvertFloat32ToFloat16(src[0] / 255.0f);
+        u16dest[1] = k3imageObj::ConvertFloat32ToFloat16(src[1] / 255.0f);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG32_UNORM>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = u32src[0] / static_cast<float>(0xffffffff);
+        dest[1] = u32src[1] / static_cast<float>(0xffffffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffffff + 0.5);
+        u32dest[1] = static_cast<uint32_t>(src[1] * 0xffffffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<uint8_t>(u32src[0] >> 24);
+        dest[1] = static_cast<uint8_t>(u32src[1] >> 24);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        uint32_t color32r, color32g;
+        color32r = static_cast<uint32_t>(src[0]);
+        color32g = static_cast<uint32_t>(src[1]);
+        u32dest[0] = (color32r << 24) | (color32r << 16) | (color32r << 8) | color32r;
+        u32dest[1] = (color32g << 24) | (color32g << 16) | (color32g << 8) | color32g;
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG32_FLOAT>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = f32src[0];
+        dest[1] = f32src[1];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0];
+        f32dest[1] = src[1];
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
+        dest[1] = static_cast<uint8_t>(f32src[1] * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0] / 255.0f;
+        f32dest[1] = src[1] / 255.0f;
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG32_UINT>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<float>(u32src[0]);
+        dest[1] = static_cast<float>(u32src[1]);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0]);
+        u32dest[1] = static_cast<uint32_t>(src[1]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = (u32src[0] != 0) ? 1 : 0;
+        dest[1] = (u32src[1] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
+        u32dest[1] = static_cast<uint32_t>(src[1] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RG16_UINT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0];
+        dest[1] = u16src[1];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0]);
+        u16dest[1] = static_cast<uint16_t>(src[1]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = (u16src[0] != 0) ? 1 : 0;
+        dest[1] = (u16src[1] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] >> 7);
+        u16dest[1] = static_cast<uint16_t>(src[1] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::R8_UNORM>
+{
+    static const uint32_t SIZE = 1;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[0] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[0] = u8src[0];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[0];
+    }
+};
+
+template<> struct k3pixel<k3fmt::A8_UNORM>
+{
+    static const uint32_t SIZE = 1;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[3] = u8src[0] / static_cast<float>(0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = static_cast<uint8_t>(src[3] * 0xff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint8_t* u8src = static_cast<const uint8_t*>(src);
+        dest[3] = u8src[0];
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint8_t* u8dest = static_cast<uint8_t*>(dest);
+        u8dest[0] = src[3];
+    }
+};
+
+template<> struct k3pixel<k3fmt::R16_UNORM>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0] / static_cast<float>(0xffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
+    }
+};
+
+template<> struct k3pixel<k3fmt::R16_FLOAT>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = k3imageObj::ConvertFloat16ToFloat32(*(u16src + 0));
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = k3imageObj::ConvertFloat32ToFloat16(src[0]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(k3imageObj::ConvertFloat16ToFloat32(*(u16src + 0)) * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = k3imageObj::ConvertFloat32ToFloat16(src[0] / 255.0f);
+    }
+};
+
+template<> struct k3pixel<k3fmt::R32_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = u32src[0] / static_cast<float>(0xffffffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<uint8_t>(u32src[0] >> 24);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        uint32_t color32r;
+        color32r = static_cast<uint32_t>(src[0]);
+        u32dest[0] = (color32r << 24) | (color32r << 16) | (color32r << 8) | color32r;
+    }
+};
+
+template<> struct k3pixel<k3fmt::R32_FLOAT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = f32src[0];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0];
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0] / 255.0f;
+    }
+};
+
+template<> struct k3pixel<k3fmt::R32_UINT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<float>(u32src[0]);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = (u32src[0] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::R16_UINT>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0]);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = (u16src[0] != 0) ? 1 : 0;
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] >> 7);
+    }
+};
+
+template<> struct k3pixel<k3fmt::D16_UNORM>
+{
+    static const uint32_t SIZE = 2;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = u16src[0] / static_cast<float>(0xffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = static_cast<uint16_t>(src[0] * 0xffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint16_t* u16src = static_cast<const uint16_t*>(src);
+        dest[0] = static_cast<uint8_t>(u16src[0] >> 8);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint16_t* u16dest = static_cast<uint16_t*>(dest);
+        u16dest[0] = (static_cast<uint16_t>(src[0]) << 8) | src[0];
+    }
+};
+
+template<> struct k3pixel<k3fmt::D24X8_UNORM>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = (u32src[0] & 0xffffff) / static_cast<float>(0xffffff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffff + 0.5);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<uint8_t>((u32src[0] & 0xffffff) >> 16);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        uint32_t color32r;
+        color32r = static_cast<uint32_t>(src[0]);
+        u32dest[0] = (color32r << 16) | (color32r << 8) | (color32r);
+    }
+};
+
+template<> struct k3pixel<k3fmt::D24_UNORM_S8_UINT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = (u32src[0] & 0xffffff) / static_cast<float>(0xffffff);
+        dest[1] = static_cast<float>((u32src[0] >> 24) & 0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        u32dest[0] = static_cast<uint32_t>(src[0] * 0xffffff + 0.5);
+        u32dest[0] |= (static_cast<uint32_t>(src[1]) & 0xff) << 24;
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        dest[0] = static_cast<uint8_t>((u32src[0] & 0xffffff) >> 16);
+        dest[1] = static_cast<uint8_t>((u32src[0] & 0xff) >> 24);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        uint32_t color32r, color32g;
+        color32r = static_cast<uint32_t>(src[0]);
+        color32g = static_cast<uint32_t>(src[1]);
+        u32dest[0] = (color32r << 16) | (color32r << 8) | (color32r) | (color32g << 24);
+    }
+};
+
+template<> struct k3pixel<k3fmt::D32_FLOAT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = f32src[0];
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0];
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0] / 255.0f;
+    }
+};
+
+template<> struct k3pixel<k3fmt::D32_FLOAT_S8X24_UINT>
+{
+    static const uint32_t SIZE = 8;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = f32src[0];
+        dest[1] = static_cast<float>((u32src[1] >> 8) & 0xff);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0];
+        u32dest[1] = (static_cast<uint32_t>(src[1]) & 0xff);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        const float* f32src = static_cast<const float*>(src);
+        dest[0] = static_cast<uint8_t>(f32src[0] * 0xff);
+        dest[1] = static_cast<uint8_t>((u32src[1]) & 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        float* f32dest = static_cast<float*>(dest);
+        f32dest[0] = src[0] / 255.0f;
+        u32dest[1] = (static_cast<uint32_t>(src[1]) & 0xff);
+    }
+};
+
+template<> struct k3pixel<k3fmt::RGB9E5_FLOAT>
+{
+    static const uint32_t SIZE = 4;
+    static inline void ToFloat4(const void* src, float* dest)
+    {
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        k3imageObj::ConvertRGB9E5ToFloat32(*u32src, dest);
+    }
+    static inline void FromFloat4(const float* src, void* dest)
+    {
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        k3imageObj::ConvertFloat32ToRGB9E5(src, u32dest);
+    }
+    static inline void ToUnorm8(const void* src, uint8_t* dest)
+    {
+        float f32dest[4];
+        const uint32_t* u32src = static_cast<const uint32_t*>(src);
+        k3imageObj::ConvertRGB9E5ToFloat32(*u32src, f32dest);
+        dest[0] = static_cast<uint8_t>(f32dest[0] * 0xff);
+        dest[1] = static_cast<uint8_t>(f32dest[1] * 0xff);
+        dest[2] = static_cast<uint8_t>(f32dest[2] * 0xff);
+        dest[3] = static_cast<uint8_t>(f32dest[3] * 0xff);
+    }
+    static inline void FromUnorm8(const uint8_t* src, void* dest)
+    {
+        float f32src[4];
+        uint32_t* u32dest = static_cast<uint32_t*>(dest);
+        f32src[0] = src[0] / 255.0f;
+        f32src[1] = src[1] / 255.0f;
+        f32src[2] = src[2] / 255.0f;
+        f32src[3] = src[3] / 255.0f;
+        k3imageObj::ConvertFloat32ToRGB9E5(f32src, u32dest);
+    }
+};
+
+// Converts rows of pixels between two uncompressed formats, with the same results as converting
+// each pixel through ConvertToUnorm8/ConvertFromUnorm8 or ConvertToFloat4/ConvertFromFloat4,
+// using the same choice of intermediate as ReformatBuffer
+// The kernel is chosen once by Select; common pairs have simd kernels, and the rest decode a run
+// of pixels to the intermediate and encode it again
+// Identical formats, compressed ones included, are copied with memcpy; for compressed formats num_pixels counts blocks
+// A copy keeps bits that the per pixel conversion drops: the X byte of RGBX8 and BGRX8, which the encoders
+// never write, and RGB9E5 values, which a decode and encode would round to the canonical exponent
+// Source and destination may be the same row when both formats have the same size
+class k3rowConverter
+{
+public:
+    typedef void (*row_ptr)(const void* src, void* dest, uint32_t num_pixels);
+
+    k3rowConverter();
+    // Returns false if the formats differ and either one is compressed or unknown
+    bool Select(k3fmt src_format, k3fmt dest_format);
+    void Convert(const void* src, void* dest, uint32_t num_pixels) const;
+
+private:
+    // pixels decoded per pass of the generic path
+    static const uint32_t CHUNK_PIXELS = 64;
+
+    uint32_t _copy_size;
+    row_ptr _pair;
+    row_ptr _decode;
+    row_ptr _encode;
+    uint32_t _src_size;
+    uint32_t _dest_size;
+    bool _use_unorm8;
+};
@@ -0,0 +1,261 @@
+// k3 graphics library
+// simd instruction set selection and math dispatch table
+#pragma once
+
+// Pick the simd family for the target architecture
+// Define K3_NO_SIMD to build only the scalar paths
+#if !defined(K3_NO_SIMD)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define K3_SIMD_X86
+#elif defined(_M_ARM64) || defined(__aarch64__)
+// only aarch64; armv7 neon flushes denormals and has no divide, so it can't match scalar results
+#define K3_SIMD_NEON
+#endif
+#endif
+
+#if defined(K3_SIMD_X86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+#elif defined(K3_SIMD_NEON)
+#include <arm_neon.h>
+#endif
+
+// MSVC lets any function use any instruction set; gcc and clang need the target
+// enabled per function, so the rest of the library stays on the baseline isa
+#if defined(_MSC_VER) && !defined(__clang__)
+#define K3_TARGET_SSE41
+#define K3_TARGET_AVX2
+#else
+#define K3_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define K3_TARGET_AVX2  __attribute__((target("avx2")))
+#endif
+
+// Highest level supported by both the cpu and the os
+k3simdLevel k3simd_DetectLevel();
+
+// Table of math kernels for the active simd level
+// Every entry must return results bit-identical to its scalar reference below
+struct k3mathFuncs {
+    k3simdLevel level;
+    float* (*v_Negate)(uint32_t vec_length, float* d);
+    float* (*v_Add)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_Sub)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_Mul)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_Div)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_Cross)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    bool (*v_Equals)(uint32_t vec_length, const float* s1, const float* s2);
+    float (*v_Dot)(uint32_t vec_length, const float* s1, const float* s2);
+    float* (*v_Min)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_Max)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_Normalize)(uint32_t vec_length, float* d);
+    float* (*sv_Add)(uint32_t vec_length, float* d, const float s1, const float* s2);
+    float* (*sv_Sub)(uint32_t vec_length, float* d, const float s1, const float* s2);
+    float* (*sv_Mul)(uint32_t vec_length, float* d, const float s1, const float* s2);
+    float* (*sv_Div)(uint32_t vec_length, float* d, const float s1, const float* s2);
+    float* (*m4_Transpose)(float* d);
+    float* (*m4_Inverse)(float* d);
+    float* (*m4_InverseTransform)(float* d);
+    float* (*m4_Mul)(float* d, const float* s1, const float* s2);
+    float* (*mv4_Mul)(float* d, const float* s1, const float* s2);
+    float* (*vm4_Mul)(float* d, const float* s1, const float* s2);
+    float* (*m4_MulArray)(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+    float* (*mv4_MulArray)(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+    float* (*mp3_MulArray)(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+    float* (*quat_NlerpBatch)(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t);
+    float* (*quat_SlerpBatch)(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t);
+    float* (*quat_ToMatBatch)(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride);
+    float* (*quat_ToDualQuatBatch)(uint32_t count, float* d, uint32_t d_stride, const float* quat, uint32_t quat_stride, const float* xlat, uint32_t xlat_stride);
+    float* (*dualQuat_ToMatBatch)(uint32_t count, float* d, uint32_t d_stride, const float* s, uint32_t s_stride);
+    void (*bvh_CheckCollisionBatch)(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags);
+    void (*bvh_ClassifyFrustumBatch)(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count);
+    void (*v_FastSinCos)(uint32_t vec_length, float* sin_d, float* cos_d, const float* s);
+    float* (*v_FastAtan2)(uint32_t vec_length, float* d, const float* s1, const float* s2);
+    float* (*v_FastRsqrt)(uint32_t vec_length, float* d, const float* s);
+};
+
+extern k3mathFuncs k3math_funcs;
+
+// Scalar reference implementations, in math.cpp
+float* k3v_NegateScalar(uint32_t vec_length, float* d);
+float* k3v_AddScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_SubScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_MulScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_DivScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_CrossScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+bool k3v_EqualsScalar(uint32_t vec_length, const float* s1, const float* s2);
+float k3v_DotScalar(uint32_t vec_length, const float* s1, const float* s2);
+float* k3v_MinScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_MaxScalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_NormalizeScalar(uint32_t vec_length, float* d);
+float* k3sv_AddScalar(uint32_t vec_length, float* d, const float s1, const float* s2);
+float* k3sv_SubScalar(uint32_t vec_length, float* d, const float s1, const float* s2);
+float* k3sv_MulScalar(uint32_t vec_length, float* d, const float s1, const float* s2);
+float* k3sv_DivScalar(uint32_t vec_length, float* d, const float s1, const float* s2);
+float* k3m_TransposeScalar(uint32_t rows, uint32_t cols, float* d);
+float* k3m_InverseScalar(uint32_t rows, float* d);
+float* k3m_MulScalar(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2);
+float* k3m4_TransposeScalar(float* d);
+float* k3m4_InverseScalar(float* d);
+float* k3m4_InverseTransformScalar(float* d);
+float* k3m4_MulScalar(float* d, const float* s1, const float* s2);
+float* k3mv4_MulScalar(float* d, const float* s1, const float* s2);
+float* k3vm4_MulScalar(float* d, const float* s1, const float* s2);
+float* k3m4_MulArrayScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+float* k3mv4_MulArrayScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+float* k3mp3_MulArrayScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride);
+float* k3v4_QuatNlerpBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t);
+float* k3v4_QuatSlerpBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t);
+float* k3m_QuatToMatBatchScalar(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride);
+float* k3v4_QuatToDualQuatBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* quat, uint32_t quat_stride, const float* xlat, uint32_t xlat_stride);
+float* k3m4_DualQuatToMatBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* s, uint32_t s_stride);
+void k3v_FastSinCosScalar(uint32_t vec_length, float* sin_d, float* cos_d, const float* s);
+float* k3v_FastAtan2Scalar(uint32_t vec_length, float* d, const float* s1, const float* s2);
+float* k3v_FastRsqrtScalar(uint32_t vec_length, float* d, const float* s);
+
+// Scalar reference for the bvh kernels, in math.cpp
+void k3bvh_CheckCollisionBatchScalar(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags);
+void k3bvh_ClassifyFrustumBatchScalar(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count);
+
+// Collision test of s1 against box i of s2, matching k3bvh_CheckCollision
+// Sets box i in the hit mask, starting a new mask word on every multiple of 32; used for the tails of the simd kernels
+static inline void k3bvh_CheckCollisionLane(const k3AABB* s1, const k3AABBArray* s2, uint32_t i, uint32_t* hit_mask, uint32_t* axis_flags)
+{
+    bool x_collision = (s1->max[0] >= s2->min[0][i]) && (s2->max[0][i] >= s1->min[0]);
+    bool y_collision = (s1->max[1] >= s2->min[1][i]) && (s2->max[1][i] >= s1->min[1]);
+    bool z_collision = (s1->max[2] >= s2->min[2][i]) && (s2->max[2][i] >= s1->min[2]);
+    bool hit = x_collision && y_collision && z_collision;
+    if ((i & 0x1f) == 0) hit_mask[i >> 5] = 0;
+    hit_mask[i >> 5] |= ((uint32_t)hit) << (i & 0x1f);
+    if (axis_flags) {
+        uint32_t overlap_flags;
+        overlap_flags = (s2->max[0][i] >= s1->max[0]) << K3_AXIS_DIR_POS_X;
+        overlap_flags |= (s2->max[1][i] >= s1->max[1]) << K3_AXIS_DIR_POS_Y;
+        overlap_flags |= (s2->max[2][i] >= s1->max[2]) << K3_AXIS_DIR_POS_Z;
+        overlap_flags |= (s2->min[0][i] <= s1->min[0]) << K3_AXIS_DIR_NEG_X;
+        overlap_flags |= (s2->min[1][i] <= s1->min[1]) << K3_AXIS_DIR_NEG_Y;
+        overlap_flags |= (s2->min[2][i] <= s1->min[2]) << K3_AXIS_DIR_NEG_Z;
+        overlap_flags = (overlap_flags) ? overlap_flags : K3_AXIS_DIR_FLAG_ALL;
+        axis_flags[i] = (hit) ? overlap_flags : K3_AXIS_DIR_FLAG_NONE;
+    }
+}
+
+// Frustum class of one box; per plane, the corner furthest along the normal decides outside,
+// and the nearest corner decides intersecting
+// Distances are summed x, y, z, then the plane offset, in the order the simd kernels use
+static inline uint32_t k3bvh_ClassifyFrustumLane(const float* planes, const k3AABB* s)
+{
+    uint32_t p, axis;
+    uint32_t result = K3_FRUSTUM_INSIDE;
+    float far_pt[3], near_pt[3];
+    for (p = 0; p < 6; p++, planes += 4) {
+        for (axis = 0; axis < 3; axis++) {
+            far_pt[axis] = (planes[axis] >= 0.0f) ? s->max[axis] : s->min[axis];
+            near_pt[axis] = (planes[axis] >= 0.0f) ? s->min[axis] : s->max[axis];
+        }
+        if (planes[0] * far_pt[0] + planes[1] * far_pt[1] + planes[2] * far_pt[2] + planes[3] < 0.0f) return K3_FRUSTUM_OUTSIDE;
+        if (planes[0] * near_pt[0] + planes[1] * near_pt[1] + planes[2] * near_pt[2] + planes[3] < 0.0f) result = K3_FRUSTUM_INTERSECT;
+    }
+    return result;
+}
+
+// Slerp blend weights for s1 and s2 given their dot product, flipped to take the shortest path
+// Nearly parallel quaternions fall back to a linear blend, signalled by returning true, which must then be normalized
+// Shared by every simd level so the transcendental parts are computed identically
+static inline bool k3quat_SlerpWeights(float dot, float t, float* w1, float* w2)
+{
+    float sign = 1.0f;
+    if (dot < 0.0f) {
+        dot = -dot;
+        sign = -1.0f;
+    }
+    if (dot > 0.9995f) {
+        *w1 = 1.0f - t;
+        *w2 = sign * t;
+        return true;
+    }
+    float theta = acosf(dot);
+    float inv_sin = 1.0f / sinf(theta);
+    *w1 = sinf((1.0f - t) * theta) * inv_sin;
+    *w2 = sign * sinf(t * theta) * inv_sin;
+    return false;
+}
+
+// ------------------------------------------------------------
+// Fast transcendental approximations
+// The simd kernels repeat these operations in the same order, so every level gets the same bits
+
+// pi / 2 in 3 parts for the range reduction; the first 2 have few enough bits that k * part is exact
+static const float K3_FAST_2_OVER_PI = 0.636619772367581f;
+static const float K3_FAST_PIO2_1 = 1.5703125f;
+static const float K3_FAST_PIO2_2 = 4.837512969970703125e-4f;
+static const float K3_FAST_PIO2_3 = 7.54978995489188216e-8f;
+// minimax polynomials for sin and cos on [-pi/4, pi/4] (cephes)
+static const float K3_FAST_SIN_C1 = -1.6666654611e-1f;
+static const float K3_FAST_SIN_C2 = 8.3321608736e-3f;
+static const float K3_FAST_SIN_C3 = -1.9515295891e-4f;
+static const float K3_FAST_COS_C1 = 4.166664568298827e-2f;
+static const float K3_FAST_COS_C2 = -1.388731625493765e-3f;
+static const float K3_FAST_COS_C3 = 2.443315711809948e-5f;
+// atan on [-tan(pi/8), tan(pi/8)] (cephes)
+static const float K3_FAST_TAN_PI_8 = 0.414213562373095f;
+static const float K3_FAST_ATAN_C1 = -3.33329491539e-1f;
+static const float K3_FAST_ATAN_C2 = 1.99777106478e-1f;
+static const float K3_FAST_ATAN_C3 = -1.38776856032e-1f;
+static const float K3_FAST_ATAN_C4 = 8.05374449538e-2f;
+static const float K3_FAST_PI = 3.14159265358979f;
+static const float K3_FAST_PIO2 = 1.57079632679490f;
+static const float K3_FAST_PIO4 = 0.785398163397448f;
+// initial guess for 1 / sqrt(x) from the float bits
+static const uint32_t K3_FAST_RSQRT_MAGIC = 0x5f375a86;
+
+// Reduces x to r in [-pi/4, pi/4] plus a quadrant, then picks and negates the polynomials by quadrant
+static inline void k3fast_SinCos(float x, float* sin_x, float* cos_x)
+{
+    float k = floorf(x * K3_FAST_2_OVER_PI + 0.5f);
+    float r = ((x - k * K3_FAST_PIO2_1) - k * K3_FAST_PIO2_2) - k * K3_FAST_PIO2_3;
+    float z = r * r;
+    float sin_r = ((K3_FAST_SIN_C3 * z + K3_FAST_SIN_C2) * z + K3_FAST_SIN_C1) * z * r + r;
+    float cos_r = ((K3_FAST_COS_C3 * z + K3_FAST_COS_C2) * z + K3_FAST_COS_C1) * z * z - 0.5f * z + 1.0f;
+    int32_t q = (int32_t)k;
+    float s = (q & 1) ? cos_r : sin_r;
+    float c = (q & 1) ? sin_r : cos_r;
+    *sin_x = (q & 2) ? -s : s;
+    *cos_x = ((q + 1) & 2) ? -c : c;
+}
+
+// Works on min / max of |y| and |x|, reduced once more around tan(pi/8), then unfolds the octant
+static inline float k3fast_Atan2(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    bool swap = (ay > ax);
+    float hi = (swap) ? ay : ax;
+    float lo = (swap) ? ax : ay;
+    float a = (hi == 0.0f) ? 0.0f : lo / hi;
+    bool shift = (a > K3_FAST_TAN_PI_8);
+    float t = (shift) ? (a - 1.0f) / (a + 1.0f) : a;
+    float z = t * t;
+    float r = (((K3_FAST_ATAN_C4 * z + K3_FAST_ATAN_C3) * z + K3_FAST_ATAN_C2) * z + K3_FAST_ATAN_C1) * z * t + t;
+    r = (shift) ? r + K3_FAST_PIO4 : r;
+    r = (swap) ? K3_FAST_PIO2 - r : r;
+    r = (signbit(x)) ? K3_FAST_PI - r : r;
+    return copysignf(r, y);
+}
+
+// Bit trick guess refined by 2 Newton steps
+static inline float k3fast_Rsqrt(float x)
+{
+    uint32_t bits;
+    float y;
+    float half_x = 0.5f * x;
+    memcpy(&bits, &x, sizeof(float));
+    bits = K3_FAST_RSQRT_MAGIC - (bits >> 1);
+    memcpy(&y, &bits, sizeof(float));
+    y = y * (1.5f - half_x * y * y);
+    y = y * (1.5f - half_x * y * y);
+    return y;
+}
@@ -0,0 +1,412 @@
+// k3 graphics library
+// 4 wide triangle bvh build and traversal for cpu ray casts
+
+#include "k3bvh.h"
+#include "k3simd.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+// sse2 is baseline on x64, and on x86 when the compiler targets it, so no runtime dispatch is needed
+#if defined(K3_SIMD_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define K3_BVH_SSE
+#endif
+
+static const uint32_t K3_BVH_LEAF_SIZE = 4;
+static const uint32_t K3_BVH_NUM_BINS = 16;
+// Past this many splits, ranges are simply halved, which bounds the tree depth and so the traversal stack
+static const uint32_t K3_BVH_MAX_SAH_DEPTH = 32;
+static const uint32_t K3_BVH_STACK_SIZE = 256;
+
+struct k3bvhBuildTri {
+    float min[3];
+    float max[3];
+    float centroid[3];
+    float v[3][3];
+    uint32_t prim;
+};
+
+struct k3bvhStackEntry {
+    uint32_t child;
+    float t;
+};
+
+// ------------------------------------------------------------
+// BVH construction
+
+static float k3bvh_HalfArea(const float* mn, const float* mx)
+{
+    float dx = mx[0] - mn[0];
+    float dy = mx[1] - mn[1];
+    float dz = mx[2] - mn[2];
+    return dx * dy + dy * dz + dz * dx;
+}
+
+static void k3bvh_GrowBounds(float* mn, float* mx, const float* s_min, const float* s_max)
+{
+    uint32_t axis;
+    for (axis = 0; axis < 3; axis++) {
+        mn[axis] = (s_min[axis] < mn[axis]) ? s_min[axis] : mn[axis];
+        mx[axis] = (s_max[axis] > mx[axis]) ? s_max[axis] : mx[axis];
+    }
+}
+
+static void k3bvh_RangeBounds(const k3bvhBuildTri* tris, uint32_t start, uint32_t end, float* mn, float* mx)
+{
+    uint32_t i;
+    mn[0] = mn[1] = mn[2] = INFINITY;
+    mx[0] = mx[1] = mx[2] = -INFINITY;
+    for (i = start; i < end; i++) k3bvh_GrowBounds(mn, mx, tris[i].min, tris[i].max);
+}
+
+static inline uint32_t k3bvh_Bin(const k3bvhBuildTri* tri, uint32_t axis, float c_min, float scale)
+{
+    uint32_t bin = (uint32_t)((tri->centroid[axis] - c_min) * scale);
+    return (bin < K3_BVH_NUM_BINS) ? bin : K3_BVH_NUM_BINS - 1;
+}
+
+// Splits tris [start, end) in two along the longest centroid axis, using a binned surface area heuristic
+// returns the first triangle of the second half, which is always strictly between start and end
+static uint32_t k3bvh_Split(k3bvhBuildTri* tris, uint32_t start, uint32_t end, uint32_t depth)
+{
+    uint32_t i, j, b, axis = 0;
+    float c_min[3] = { INFINITY, INFINITY, INFINITY };
+    float c_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (i = start; i < end; i++) k3bvh_GrowBounds(c_min, c_max, tris[i].centroid, tris[i].centroid);
+    if (c_max[1] - c_min[1] > c_max[axis] - c_min[axis]) axis = 1;
+    if (c_max[2] - c_min[2] > c_max[axis] - c_min[axis]) axis = 2;
+    float extent = c_max[axis] - c_min[axis];
+    if (depth >= K3_BVH_MAX_SAH_DEPTH || !(extent > 0.0f)) return (start + end) / 2;
+
+    float scale = K3_BVH_NUM_BINS / extent;
+    uint32_t bin_count[K3_BVH_NUM_BINS] = {};
+    float bin_min[K3_BVH_NUM_BINS][3], bin_max[K3_BVH_NUM_BINS][3];
+    for (b = 0; b < K3_BVH_NUM_BINS; b++) {
+        bin_min[b][0] = bin_min[b][1] = bin_min[b][2] = INFINITY;
+        bin_max[b][0] = bin_max[b][1] = bin_max[b][2] = -INFINITY;
+    }
+    for (i = start; i < end; i++) {
+        b = k3bvh_Bin(tris + i, axis, c_min[axis], scale);
+        bin_count[b]++;
+        k3bvh_GrowBounds(bin_min[b], bin_max[b], tris[i].min, tris[i].max);
+    }
+
+    // Sweep from the right to get the cost of every right hand side, then from the left to pick the split
+    float right_area[K3_BVH_NUM_BINS];
+    uint32_t right_count[K3_BVH_NUM_BINS];
+    float mn[3] = { INFINITY, INFINITY, INFINITY };
+    float mx[3] = { -INFINITY, -INFINITY, -INFINITY };
+    uint32_t count = 0;
+    for (b = K3_BVH_NUM_BINS - 1; b > 0; b--) {
+        k3bvh_GrowBounds(mn, mx, bin_min[b], bin_max[b]);
+        count += bin_count[b];
+        right_area[b] = (count) ? k3bvh_HalfArea(mn, mx) : 0.0f;
+        right_count[b] = count;
+    }
+    mn[0] = mn[1] = mn[2] = INFINITY;
+    mx[0] = mx[1] = mx[2] = -INFINITY;
+    count = 0;
+    uint32_t best_bin = 0;
+    float best_cost = INFINITY, cost;
+    for (b = 0; b < K3_BVH_NUM_BINS - 1; b++) {
+        k3bvh_GrowBounds(mn, mx, bin_min[b], bin_max[b]);
+        count += bin_count[b];
+        if (count == 0 || right_count[b + 1] == 0) continue;
+        cost = k3bvh_HalfArea(mn, mx) * count + right_area[b + 1] * right_count[b + 1];
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_bin = b;
+        }
+    }
+
+    i = start;
+    j = end;
+    while (i < j) {
+        if (k3bvh_Bin(tris + i, axis, c_min[axis], scale) <= best_bin) {
+            i++;
+        } else {
+            j--;
+            k3bvhBuildTri temp = tris[i];
+            tris[i] = tris[j];
+            tris[j] = temp;
+        }
+    }
+    return (i == start || i == end) ? (start + end) / 2 : i;
+}
+
+static uint32_t k3bvh_MakeLeaf(k3meshBVH* bvh, const k3bvhBuildTri* tris, uint32_t start, uint32_t end)
+{
+    uint32_t lane, axis;
+    uint32_t p = bvh->num_packets++;
+    k3bvhTri4* packet = bvh->packets + p;
+    memset(packet, 0, sizeof(k3bvhTri4));
+    for (lane = 0; lane < 4; lane++) {
+        if (start + lane < end) {
+            const k3bvhBuildTri* tri = tris + start + lane;
+            for (axis = 0; axis < 3; axis++) {
+                packet->v0[axis][lane] = tri->v[0][axis];
+                packet->e1[axis][lane] = tri->v[1][axis] - tri->v[0][axis];
+                packet->e2[axis][lane] = tri->v[2][axis] - tri->v[0][axis];
+            }
+            packet->prim[lane] = tri->prim;
+        } else {
+            packet->prim[lane] = ~0x0;
+        }
+    }
+    return K3_BVH_LEAF | p;
+}
+
+// Splits the range in two, then each half in two again, giving the node up to 4 children
+static uint32_t k3bvh_BuildNode(k3meshBVH* bvh, k3bvhBuildTri* tris, uint32_t start, uint32_t end, uint32_t depth)
+{
+    uint32_t n = bvh->num_nodes++;
+    uint32_t bounds[5];
+    uint32_t num_children = 0;
+    uint32_t mid, c, axis, child;
+    float mn[3], mx[3];
+    bounds[0] = start;
+    if (end - start > K3_BVH_LEAF_SIZE) {
+        mid = k3bvh_Split(tris, start, end, depth);
+        if (mid - start > K3_BVH_LEAF_SIZE) bounds[++num_children] = k3bvh_Split(tris, start, mid, depth + 1);
+        bounds[++num_children] = mid;
+        if (end - mid > K3_BVH_LEAF_SIZE) bounds[++num_children] = k3bvh_Split(tris, mid, end, depth + 1);
+    }
+    bounds[++num_children] = end;
+
+    for (c = 0; c < 4; c++) {
+        if (c < num_children) {
+            k3bvh_RangeBounds(tris, bounds[c], bounds[c + 1], mn, mx);
+            if (bounds[c + 1] - bounds[c] <= K3_BVH_LEAF_SIZE) {
+                child = k3bvh_MakeLeaf(bvh, tris, bounds[c], bounds[c + 1]);
+            } else {
+                child = k3bvh_BuildNode(bvh, tris, bounds[c], bounds[c + 1], depth + 2);
+            }
+        } else {
+            mn[0] = mn[1] = mn[2] = INFINITY;
+            mx[0] = mx[1] = mx[2] = INFINITY;
+            child = 0;
+        }
+        for (axis = 0; axis < 3; axis++) {
+            bvh->nodes[n].min[axis][c] = mn[axis];
+            bvh->nodes[n].max[axis][c] = mx[axis];
+        }
+        bvh->nodes[n].child[c] = child;
+    }
+    return n;
+}
+
+void k3bvh_Build(k3meshBVH* bvh, const float* verts, const uint32_t* indices, uint32_t prim_start, uint32_t num_prims)
+{
+    uint32_t i, k, axis, v_index;
+
+    bvh->num_nodes = 0;
+    bvh->num_packets = 0;
+    bvh->nodes = NULL;
+    bvh->packets = NULL;
+    bvh->min[0] = bvh->min[1] = bvh->min[2] = INFINITY;
+    bvh->max[0] = bvh->max[1] = bvh->max[2] = -INFINITY;
+    if (num_prims == 0) return;
+
+    k3bvhBuildTri* tris = new k3bvhBuildTri[num_prims];
+    for (i = 0; i < num_prims; i++) {
+        tris[i].prim = prim_start + i;
+        for (k = 0; k < 3; k++) {
+            v_index = 3 * (prim_start + i) + k;
+            if (indices) v_index = indices[v_index];
+            for (axis = 0; axis < 3; axis++) tris[i].v[k][axis] = verts[3 * v_index + axis];
+        }
+        for (axis = 0; axis < 3; axis++) {
+            tris[i].min[axis] = tris[i].v[0][axis];
+            tris[i].max[axis] = tris[i].v[0][axis];
+        }
+        k3bvh_GrowBounds(tris[i].min, tris[i].max, tris[i].v[1], tris[i].v[1]);
+        k3bvh_GrowBounds(tris[i].min, tris[i].max, tris[i].v[2], tris[i].v[2]);
+        for (axis = 0; axis < 3; axis++) tris[i].centroid[axis] = 0.5f * (tris[i].min[axis] + tris[i].max[axis]);
+    }
+
+    // every inner node but the root has at least 2 children, and every leaf at least 1 triangle
+    bvh->nodes = new k3bvh4Node[num_prims + 1];
+    bvh->packets = new k3bvhTri4[num_prims];
+    k3bvh_BuildNode(bvh, tris, 0, num_prims, 0);
+    k3bvh_RangeBounds(tris, 0, num_prims, bvh->min, bvh->max);
+    delete[] tris;
+}
+
+// ------------------------------------------------------------
+// BVH traversal
+// Nodes test the ray against their 4 child boxes together, and leaves test their 4 triangles together
+// Triangles use the Moller-Trumbore test, and are hit from either side
+
+#ifdef K3_BVH_SSE
+static inline uint32_t k3bvh_IntersectNode(const k3bvh4Node* node, const __m128* origin, const __m128* inv_dir, float t_max, float* t_near)
+{
+    uint32_t axis;
+    __m128 t0, t1;
+    __m128 t_min = _mm_setzero_ps();
+    __m128 t_far = _mm_set1_ps(t_max);
+    for (axis = 0; axis < 3; axis++) {
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min[axis]), origin[axis]), inv_dir[axis]);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max[axis]), origin[axis]), inv_dir[axis]);
+        t_min = _mm_max_ps(t_min, _mm_min_ps(t0, t1));
+        t_far = _mm_min_ps(t_far, _mm_max_ps(t0, t1));
+    }
+    _mm_storeu_ps(t_near, t_min);
+    return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(t_min, t_far));
+}
+
+static inline bool k3bvh_IntersectPacket(const k3bvhTri4* packet, const __m128* origin, const __m128* dir, float* t, float* bary, uint32_t* prim)
+{
+    __m128 e1x = _mm_loadu_ps(packet->e1[0]), e1y = _mm_loadu_ps(packet->e1[1]), e1z = _mm_loadu_ps(packet->e1[2]);
+    __m128 e2x = _mm_loadu_ps(packet->e2[0]), e2y = _mm_loadu_ps(packet->e2[1]), e2z = _mm_loadu_ps(packet->e2[2]);
+    __m128 zero = _mm_setzero_ps();
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dir[1], e2z), _mm_mul_ps(dir[2], e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dir[2], e2x), _mm_mul_ps(dir[0], e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dir[0], e2y), _mm_mul_ps(dir[1], e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    __m128 tx = _mm_sub_ps(origin[0], _mm_loadu_ps(packet->v0[0]));
+    __m128 ty = _mm_sub_ps(origin[1], _mm_loadu_ps(packet->v0[1]));
+    __m128 tz = _mm_sub_ps(origin[2], _mm_loadu_ps(packet->v0[2]));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], qx), _mm_mul_ps(dir[1], qy)), _mm_mul_ps(dir[2], qz)), inv_det);
+    __m128 dist = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+    __m128 valid = _mm_cmpneq_ps(det, zero);
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(dist, zero));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(dist, _mm_set1_ps(*t)));
+    uint32_t mask = (uint32_t)_mm_movemask_ps(valid);
+    if (mask == 0) return false;
+
+    float lane_t[4], lane_u[4], lane_v[4];
+    uint32_t lane, best = 0;
+    _mm_storeu_ps(lane_t, dist);
+    _mm_storeu_ps(lane_u, u);
+    _mm_storeu_ps(lane_v, v);
+    for (lane = 0; lane < 4; lane++) {
+        if ((mask & (1 << lane)) && (!(mask & (1 << best)) || lane_t[lane] < lane_t[best])) best = lane;
+    }
+    *t = lane_t[best];
+    bary[0] = lane_u[best];
+    bary[1] = lane_v[best];
+    *prim = packet->prim[best];
+    return true;
+}
+#else
+static inline uint32_t k3bvh_IntersectNode(const k3bvh4Node* node, const float* origin, const float* inv_dir, float t_max, float* t_near)
+{
+    uint32_t axis, c, mask = 0;
+    float t0, t1, t_min, t_far;
+    for (c = 0; c < 4; c++) {
+        t_min = 0.0f;
+        t_far = t_max;
+        for (axis = 0; axis < 3; axis++) {
+            t0 = (node->min[axis][c] - origin[axis]) * inv_dir[axis];
+            t1 = (node->max[axis][c] - origin[axis]) * inv_dir[axis];
+            if (t0 > t1) {
+                float temp = t0;
+                t0 = t1;
+                t1 = temp;
+            }
+            t_min = (t0 > t_min) ? t0 : t_min;
+            t_far = (t1 < t_far) ? t1 : t_far;
+        }
+        t_near[c] = t_min;
+        mask |= (uint32_t)(t_min <= t_far) << c;
+    }
+    return mask;
+}
+
+static inline bool k3bvh_IntersectPacket(const k3bvhTri4* packet, const float* origin, const float* dir, float* t, float* bary, uint32_t* prim)
+{
+    uint32_t lane;
+    bool hit = false;
+    float p[3], q[3], s[3], e1[3], e2[3];
+    float det, inv_det, u, v, dist;
+    for (lane = 0; lane < 4; lane++) {
+        e1[0] = packet->e1[0][lane];
+        e1[1] = packet->e1[1][lane];
+        e1[2] = packet->e1[2][lane];
+        e2[0] = packet->e2[0][lane];
+        e2[1] = packet->e2[1][lane];
+        e2[2] = packet->e2[2][lane];
+        k3v3_Cross(p, dir, e2);
+        det = k3v3_Dot(e1, p);
+        if (det == 0.0f) continue;
+        inv_det = 1.0f / det;
+        s[0] = origin[0] - packet->v0[0][lane];
+        s[1] = origin[1] - packet->v0[1][lane];
+        s[2] = origin[2] - packet->v0[2][lane];
+        u = k3v3_Dot(s, p) * inv_det;
+        if (u < 0.0f || u > 1.0f) continue;
+        k3v3_Cross(q, s, e1);
+        v = k3v3_Dot(dir, q) * inv_det;
+        if (v < 0.0f || u + v > 1.0f) continue;
+        dist = k3v3_Dot(e2, q) * inv_det;
+        if (dist < 0.0f || dist >= *t) continue;
+        *t = dist;
+        bary[0] = u;
+        bary[1] = v;
+        *prim = packet->prim[lane];
+        hit = true;
+    }
+    return hit;
+}
+#endif
+
+bool k3bvh_Trace(const k3meshBVH* bvh, const float* origin, const float* dir, float* t, float* bary, uint32_t* prim)
+{
+    uint32_t axis, c, i, mask, num_hits;
+    uint32_t order[4];
+    float t_near[4];
+    float inv_dir[3];
+    k3bvhStackEntry stack[K3_BVH_STACK_SIZE];
+    uint32_t sp = 0;
+    bool hit = false;
+    for (axis = 0; axis < 3; axis++) inv_dir[axis] = 1.0f / dir[axis];
+#ifdef K3_BVH_SSE
+    __m128 ray_origin[3], ray_dir[3], ray_inv_dir[3];
+    for (axis = 0; axis < 3; axis++) {
+        ray_origin[axis] = _mm_set1_ps(origin[axis]);
+        ray_dir[axis] = _mm_set1_ps(dir[axis]);
+        ray_inv_dir[axis] = _mm_set1_ps(inv_dir[axis]);
+    }
+#else
+    const float* ray_origin = origin;
+    const float* ray_dir = dir;
+    const float* ray_inv_dir = inv_dir;
+#endif
+
+    stack[sp].child = 0;
+    stack[sp].t = 0.0f;
+    sp++;
+    while (sp) {
+        sp--;
+        if (stack[sp].t > *t) continue;
+        if (stack[sp].child & K3_BVH_LEAF) {
+            hit |= k3bvh_IntersectPacket(bvh->packets + (stack[sp].child & ~K3_BVH_LEAF), ray_origin, ray_dir, t, bary, prim);
+            continue;
+        }
+        const k3bvh4Node* node = bvh->nodes + stack[sp].child;
+        // an unbounded t would let rays reach the +inf boxes of unused children, which lead back to the root
+        mask = k3bvh_IntersectNode(node, ray_origin, ray_inv_dir, (*t < FLT_MAX) ? *t : FLT_MAX, t_near);
+        // Push the farthest child first, so the nearest is popped next
+        num_hits = 0;
+        for (c = 0; c < 4; c++) {
+            if (!(mask & (1 << c))) continue;
+            for (i = num_hits; i > 0 && t_near[order[i - 1]] < t_near[c]; i--) order[i] = order[i - 1];
+            order[i] = c;
+            num_hits++;
+        }
+        for (i = 0; i < num_hits; i++) {
+            stack[sp].child = node->child[order[i]];
+            stack[sp].t = t_near[order[i]];
+            sp++;
+        }
+    }
+    return hit;
+}
@@ -2,9 +2,24 @@
 // math fucntions
 
 #include "k3internal.h"
+#include "k3simd.h"
+
+// selected by k3math_SetPrecision
+static k3mathPrecision k3math_precision = k3mathPrecision::EXACT;
+
+// sin and cos at the selected precision
+static inline void k3math_SinCos(float x, float* sin_x, float* cos_x)
+{
+    if (k3math_precision == k3mathPrecision::FAST) {
+        k3fast_SinCos(x, sin_x, cos_x);
+    } else {
+        *sin_x = sinf(x);
+        *cos_x = cosf(x);
+    }
+}
 
 /* operations to a single vector */
-K3API float* k3v_Negate(uint32_t vec_length, float* d)
+float* k3v_NegateScalar(uint32_t vec_length, float* d)
 {
     uint32_t i;
     for (i = 0; i < vec_length; i++) d[i] = -d[i];
@@ -42,7 +57,7 @@ K3API float  k3v_Length(uint32_t vec_length, const float* s)
 }
 
 /* operations of two vectors of the same length */
-K3API float* k3v_Add(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_AddScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -50,7 +65,7 @@ K3API float* k3v_Add(uint32_t vec_length, float* d, const float* s1, const float
     return d;
 }
 
-K3API float* k3v_Sub(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_SubScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -58,7 +73,7 @@ K3API float* k3v_Sub(uint32_t vec_length, float* d, const float* s1, const float
     return d;
 }
 
-K3API float* k3v_Mul(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_MulScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -66,7 +81,7 @@ K3API float* k3v_Mul(uint32_t vec_length, float* d, const float* s1, const float
     return d;
 }
 
-K3API float* k3v_Div(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_DivScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -74,7 +89,7 @@ K3API float* k3v_Div(uint32_t vec_length, float* d, const float* s1, const float
     return d;
 }
 
-K3API float* k3v_Cross(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_CrossScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     switch (vec_length) {
     case 2:
@@ -99,7 +114,7 @@ K3API float* k3v_Cross(uint32_t vec_length, float* d, const float* s1, const flo
     return d;
 }
 
-K3API bool k3v_Equals(uint32_t vec_length, const float* s1, const float* s2)
+bool k3v_EqualsScalar(uint32_t vec_length, const float* s1, const float* s2)
 {
     uint32_t i;
     bool result = true;
@@ -107,7 +122,7 @@ K3API bool k3v_Equals(uint32_t vec_length, const float* s1, const float* s2)
     return result;
 }
 
-K3API float k3v_Dot(uint32_t vec_length, const float* s1, const float* s2)
+float k3v_DotScalar(uint32_t vec_length, const float* s1, const float* s2)
 {
     uint32_t i;
     float result = 0.0f;
@@ -115,7 +130,7 @@ K3API float k3v_Dot(uint32_t vec_length, const float* s1, const float* s2)
     return result;
 }
 
-K3API float* k3v_Min(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_MinScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -123,7 +138,7 @@ K3API float* k3v_Min(uint32_t vec_length, float* d, const float* s1, const float
     return d;
 }
 
-K3API float* k3v_Max(uint32_t vec_length, float* d, const float* s1, const float* s2)
+float* k3v_MaxScalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -221,7 +236,7 @@ K3API void k3v3_SetTangentBitangent(float* t, float* b, const float* p0, const f
 }
 
 /* operations where s1 is scalar and s2 is a vector */
-K3API float* k3sv_Add(uint32_t vec_length, float* d, const float s1, const float* s2)
+float* k3sv_AddScalar(uint32_t vec_length, float* d, const float s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -229,7 +244,7 @@ K3API float* k3sv_Add(uint32_t vec_length, float* d, const float s1, const float
     return d;
 }
 
-K3API float* k3sv_Sub(uint32_t vec_length, float* d, const float s1, const float* s2)
+float* k3sv_SubScalar(uint32_t vec_length, float* d, const float s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -237,7 +252,7 @@ K3API float* k3sv_Sub(uint32_t vec_length, float* d, const float s1, const float
     return d;
 }
 
-K3API float* k3sv_Mul(uint32_t vec_length, float* d, const float s1, const float* s2)
+float* k3sv_MulScalar(uint32_t vec_length, float* d, const float s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -245,7 +260,7 @@ K3API float* k3sv_Mul(uint32_t vec_length, float* d, const float s1, const float
     return d;
 }
 
-K3API float* k3sv_Div(uint32_t vec_length, float* d, const float s1, const float* s2)
+float* k3sv_DivScalar(uint32_t vec_length, float* d, const float s1, const float* s2)
 {
     uint32_t i;
     float* dp = d;
@@ -254,25 +269,74 @@ K3API float* k3sv_Div(uint32_t vec_length, float* d, const float s1, const float
 }
 
 /* operations on a single matrix */
-float* k3m_Shrink(uint32_t rows, uint32_t cols, float* d, const float* s, uint32_t remove_row, uint32_t remove_col)
+
+// LU decomposition with partial pivoting, used for anything larger than 4x4
+// lu is factored in place: L (unit diagonal) below the diagonal, U on and above it
+// Rows are swapped as they are pivoted; pivot[i] records, as a float, which source row ended up in row i
+// Returns the sign of the row permutation, or 0 if the matrix is singular
+static float k3m_LUDecompose(uint32_t rows, float* lu, float* pivot)
 {
-    uint32_t srow, scol, drow, dcol;
-    float* dptr = d;
+    uint32_t r, c, k, p;
+    float sign = 1.0f;
+    float max_val, val, f, inv;
+    float* row_r;
+    const float* row_k;
+
+    for (r = 0; r < rows; r++) pivot[r] = static_cast<float>(r);
+
+    for (k = 0; k < rows; k++) {
+        // pick the largest remaining entry of column k as the pivot
+        p = k;
+        max_val = fabsf(lu[k * rows + k]);
+        for (r = k + 1; r < rows; r++) {
+            val = fabsf(lu[r * rows + k]);
+            if (val > max_val) {
+                max_val = val;
+                p = r;
+            }
+        }
+        if (max_val == 0.0f) return 0.0f;
+        if (p != k) {
+            for (c = 0; c < rows; c++) {
+                f = lu[k * rows + c];
+                lu[k * rows + c] = lu[p * rows + c];
+                lu[p * rows + c] = f;
+            }
+            f = pivot[k];
+            pivot[k] = pivot[p];
+            pivot[p] = f;
+            sign = -sign;
+        }
 
-    srow = (remove_row + 1);
-    scol = (remove_col + 1);
-    for (drow = 0; drow < rows - 1; drow++) {
-        if (srow >= rows) srow = 0;
-        for (dcol = 0; dcol < cols - 1; dcol++) {
-            if (scol >= cols) scol = 0;
-            *dptr = s[(srow * cols) + scol];
-            dptr++;
-            scol++;
+        row_k = lu + k * rows;
+        inv = 1.0f / row_k[k];
+        for (r = k + 1; r < rows; r++) {
+            row_r = lu + r * rows;
+            f = row_r[k] * inv;
+            row_r[k] = f;
+            for (c = k + 1; c < rows; c++) row_r[c] -= f * row_k[c];
         }
-        srow++;
     }
+    return sign;
+}
 
-    return d;
+K3API uint32_t k3m_GetScratchSize(uint32_t rows)
+{
+    // LU factors, one column of the solve, and the pivot rows
+    return rows * rows + 2 * rows;
+}
+
+K3API float k3m_DeterminantScratch(uint32_t rows, const float* s, float* scratch)
+{
+    if (rows >= 2 && rows <= 4) return k3m_Determinant(rows, s);
+
+    uint32_t i;
+    float* lu = scratch;
+    float* pivot = scratch + rows * rows + rows;
+    memcpy(lu, s, rows * rows * sizeof(float));
+    float result = k3m_LUDecompose(rows, lu, pivot);
+    for (i = 0; i < rows && result != 0.0f; i++) result *= lu[i * rows + i];
+    return result;
 }
 
 K3API float  k3m_Determinant(uint32_t rows, const float* s)
@@ -284,33 +348,32 @@ K3API float  k3m_Determinant(uint32_t rows, const float* s)
                     s[2] * (s[3] * s[7] - s[4] * s[6]));
     case 4: return (s[0] * (s[5] * (s[10] * s[15] - s[11] * s[14]) +
                             s[6] * (s[11] * s[13] - s[9] * s[15]) +
-                            s[7] * (s[9] * s[14] - s[10] * s[13])) +
+                            s[7] * (s[9] * s[14] - s[10] * s[13])) -
                     s[1] * (s[6] * (s[11] * s[12] - s[8] * s[15]) +
                             s[7] * (s[8] * s[14] - s[10] * s[12]) +
                             s[4] * (s[10] * s[15] - s[11] * s[14])) +
                     s[2] * (s[7] * (s[8] * s[13] - s[9] * s[12]) +
                             s[4] * (s[9] * s[15] - s[11] * s[13]) +
-                            s[5] * (s[11] * s[12] - s[8] * s[15])) +
+                            s[5] * (s[11] * s[12] - s[8] * s[15])) -
                     s[3] * (s[4] * (s[9] * s[14] - s[10] * s[13]) +
                             s[5] * (s[10] * s[12] - s[8] * s[14]) +
                             s[6] * (s[8] * s[13] - s[9] * s[12])));
     default: {
-        float* temp_mat = new float[(rows - 1) * (rows - 1)];
-        float result = 0.0;
-        uint32_t i;
-        for (i = 0; i < rows; i++) {
-            if (s[i] != 0.0f) {
-                k3m_Shrink(rows, rows, temp_mat, s, 0, i);
-                result += s[i] * k3m_Determinant(rows - 1, temp_mat);
-            }
+        float result;
+        if (rows <= K3_MATH_STACK_ROWS) {
+            float scratch[K3_MATH_STACK_ROWS * K3_MATH_STACK_ROWS + 2 * K3_MATH_STACK_ROWS];
+            result = k3m_DeterminantScratch(rows, s, scratch);
+        } else {
+            float* scratch = new float[k3m_GetScratchSize(rows)];
+            result = k3m_DeterminantScratch(rows, s, scratch);
+            delete[] scratch;
         }
-        delete[] temp_mat;
         return result;
     }
     }
 }
 
-K3API float* k3m_Transpose(uint32_t rows, uint32_t cols, float* d)
+float* k3m_TransposeScalar(uint32_t rows, uint32_t cols, float* d)
 {
     uint32_t r, c;
     if (rows == cols) {
@@ -323,19 +386,20 @@ K3API float* k3m_Transpose(uint32_t rows, uint32_t cols, float* d)
             }
         }
     } else {
-        float* temp_matrix = new float[rows * cols];
+        float static_copy[K3_MATH_STACK_ROWS * K3_MATH_STACK_ROWS];
+        float* temp_matrix = (rows * cols > K3_MATH_STACK_ROWS * K3_MATH_STACK_ROWS) ? new float[rows * cols] : static_copy;
         for (r = 0; r < rows; r++) {
             for (c = 0; c < cols; c++) {
                 temp_matrix[c * rows + r] = d[r * cols + c];
             }
         }
         memcpy(d, temp_matrix, rows * cols * sizeof(float));
-        delete[] temp_matrix;
+        if (temp_matrix != static_copy) delete[] temp_matrix;
     }
     return d;
 }
 
-K3API float* k3m_Inverse(uint32_t rows, float* d)
+float* k3m_InverseScalar(uint32_t rows, float* d)
 {
     switch (rows) {
     case 2:
@@ -343,14 +407,14 @@ K3API float* k3m_Inverse(uint32_t rows, float* d)
         float copy[4];
         copy[0] = d[0]; copy[1] = d[1]; copy[2] = d[2]; copy[3] = d[3];
         d[0] = copy[3];
-        d[1] = -copy[2];
-        d[2] = -copy[1];
+        d[1] = -copy[1];
+        d[2] = -copy[2];
         d[3] = copy[0];
         float det = k3m_Determinant(2, d);
         if (det != 0) {
             det = 1.0f / det;
         }
-        k3sv_Mul(4, d, det, d);
+        k3sv_MulScalar(4, d, det, d);
         return d;
     }
     break;
@@ -369,12 +433,12 @@ K3API float* k3m_Inverse(uint32_t rows, float* d)
         copy[7] = d[2] * d[3] - d[0] * d[5];
         copy[8] = d[0] * d[4] - d[1] * d[3];
 
-        float det = k3v_Dot(3, d, copy);
+        float det = k3v_DotScalar(3, d, copy);
         if (det != 0) {
             det = 1.0f / det;
         }
-        k3m_Transpose(3, 3, copy);
-        k3sv_Mul(9, d, det, copy);
+        k3m_TransposeScalar(3, 3, copy);
+        k3sv_MulScalar(9, d, det, copy);
     }
     break;
     case 4:
@@ -455,21 +519,63 @@ K3API float* k3m_Inverse(uint32_t rows, float* d)
         d[15] -= tmp[8] * copy[9] + tmp[11] * copy[10] + tmp[5] * copy[8];
 
         // calculate determinant
-        det = k3v_Dot(4, copy, d);
+        det = k3v_DotScalar(4, copy, d);
         if (det != 0) {
             det = 1 / det;
         }
-        k3sv_Mul(16, d, det, d);
+        k3sv_MulScalar(16, d, det, d);
     }
     break;
     default:
     {
+        if (rows <= K3_MATH_STACK_ROWS) {
+            float scratch[K3_MATH_STACK_ROWS * K3_MATH_STACK_ROWS + 2 * K3_MATH_STACK_ROWS];
+            k3m_InverseScratch(rows, d, scratch);
+        } else {
+            float* scratch = new float[k3m_GetScratchSize(rows)];
+            k3m_InverseScratch(rows, d, scratch);
+            delete[] scratch;
+        }
     }
     }
 
     return d;
 }
 
+K3API float* k3m_InverseScratch(uint32_t rows, float* d, float* scratch)
+{
+    if (rows >= 2 && rows <= 4) return k3m_Inverse(rows, d);
+
+    uint32_t r, c, k;
+    float* lu = scratch;
+    float* col = scratch + rows * rows;
+    float* pivot = col + rows;
+    float sum;
+
+    memcpy(lu, d, rows * rows * sizeof(float));
+    if (k3m_LUDecompose(rows, lu, pivot) == 0.0f) {
+        // singular; zero the result, like the 2x2 through 4x4 versions do
+        memset(d, 0, rows * rows * sizeof(float));
+        return d;
+    }
+
+    // solve L U x = P e_c for each column c of the identity
+    for (c = 0; c < rows; c++) {
+        for (r = 0; r < rows; r++) {
+            sum = (static_cast<uint32_t>(pivot[r]) == c) ? 1.0f : 0.0f;
+            for (k = 0; k < r; k++) sum -= lu[r * rows + k] * col[k];
+            col[r] = sum;
+        }
+        for (r = rows; r-- > 0; ) {
+            sum = col[r];
+            for (k = r + 1; k < rows; k++) sum -= lu[r * rows + k] * col[k];
+            col[r] = sum / lu[r * rows + r];
+        }
+        for (r = 0; r < rows; r++) d[r * rows + c] = col[r];
+    }
+    return d;
+}
+
 K3API float* k3m_Swizzle(uint32_t rows, uint32_t cols, float* d, const uint32_t* row_indices, const uint32_t* col_indices)
 {
     uint32_t i, len = rows * cols;
@@ -487,7 +593,7 @@ K3API float* k3m_Swizzle(uint32_t rows, uint32_t cols, float* d, const uint32_t*
     }
 
     if (temp_copy != static_copy) {
-        memcpy(d, temp_copy, len);
+        memcpy(d, temp_copy, len * sizeof(float));
         delete[] temp_copy;
     } else {
         for (i = 0; i < len; i++) d[i] = temp_copy[i];
@@ -513,8 +619,8 @@ K3API float* k3m_SetIdentity(uint32_t rows, float* d)
 
 K3API float* k3m_SetRotation(uint32_t rows, float* d, float angle, const float* axis)
 {
-    float cos_ang = cosf(angle);
-    float sin_ang = sinf(angle);
+    float cos_ang, sin_ang;
+    k3math_SinCos(angle, &sin_ang, &cos_ang);
 
     switch (rows) {
     case 2:
@@ -792,6 +898,36 @@ K3API float* k3m4_SetLookAt(float* d, const float* eye, const float* at, const f
     return d;
 }
 
+K3API float* k3m4_GetFrustumPlanes(float* d, const float* s, bool dx_style, bool reverse_z)
+{
+    // with column vectors, clip = s * p, so each clip bound is a combination of rows of s
+    const float* x_row = s;
+    const float* y_row = s + 4;
+    const float* z_row = s + 8;
+    const float* w_row = s + 12;
+    float* z_low = d + ((reverse_z) ? 20 : 16);
+    float* z_high = d + ((reverse_z) ? 16 : 20);
+    float len;
+    uint32_t p;
+    k3v4_Add(d + 0, w_row, x_row);
+    k3v4_Sub(d + 4, w_row, x_row);
+    k3v4_Add(d + 8, w_row, y_row);
+    k3v4_Sub(d + 12, w_row, y_row);
+    // z ranges from 0 to w for dx style, otherwise -w to w; reverse z puts the near plane at the top
+    if (dx_style) {
+        memcpy(z_low, z_row, 4 * sizeof(float));
+    } else {
+        k3v4_Add(z_low, w_row, z_row);
+    }
+    k3v4_Sub(z_high, w_row, z_row);
+    for (p = 0; p < 6; p++) {
+        // an infinite far plane comes out with no normal, and stays unnormalized
+        len = k3v3_Length(d + 4 * p);
+        if (len > 0.0f) k3sv4_Mul(d + 4 * p, 1.0f / len, d + 4 * p);
+    }
+    return d;
+}
+
 K3API float* k3m4_SetRotAngleScaleXlat(float* d, const float* r3, const float* s3, const float* t3)
 {
     float mat[16];
@@ -843,196 +979,410 @@ K3API float* k3m4_SetScaleRotAngleXlat(float* d, const float* s3, const float* r
 }
 
 /* operations on 2 matrices */
-K3API float* k3m_Mul(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2)
+
+// d = s1 * s2, where d must not overlap either source
+// Walks s2 a row at a time in blocks, so the inner loop is contiguous and the active block of s2 stays in cache
+// Each output is still 0 + s1[r][0] * s2[0][c] + s1[r][1] * s2[1][c] + ..., in the same order as k3v_Dot
+static void k3m_MulBlocked(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2)
 {
-    float static_copy1[K3_MATH_STATIC_ARRAY_SIZE];
-    float static_copy2[K3_MATH_STATIC_ARRAY_SIZE];
-    const float* s1ptr;
-    float* s2ptr;
-    float* dptr;
-    uint32_t s1size = s1_rows * s2_rows;
-    uint32_t s2size = s2_rows * s2_cols;
-    uint32_t r, c;
-    const float* v1;
-    float* v2;
-
-    // if s1 == d, then make a copy of s1
-    if (s1 == d) {
-        float* s1temp;
-        if (s1size > K3_MATH_STATIC_ARRAY_SIZE) {
-            s1temp = new float[s1size];
-            memcpy(s1temp, s1, s1size);
-        } else {
-            s1temp = static_copy1;
-            for (r = 0; r < s1size; r++) s1temp[r] = s1[r];
+    const uint32_t BLOCK_SIZE = 32;
+    uint32_t r, c, k, cb, kb, c_end, k_end;
+    float a;
+    float* drow;
+    const float* arow;
+    const float* brow;
+
+    for (r = 0; r < s1_rows * s2_cols; r++) d[r] = 0.0f;
+
+    for (cb = 0; cb < s2_cols; cb += BLOCK_SIZE) {
+        c_end = (cb + BLOCK_SIZE < s2_cols) ? cb + BLOCK_SIZE : s2_cols;
+        for (kb = 0; kb < s2_rows; kb += BLOCK_SIZE) {
+            k_end = (kb + BLOCK_SIZE < s2_rows) ? kb + BLOCK_SIZE : s2_rows;
+            for (r = 0; r < s1_rows; r++) {
+                drow = d + r * s2_cols;
+                arow = s1 + r * s2_rows;
+                for (k = kb; k < k_end; k++) {
+                    a = arow[k];
+                    brow = s2 + k * s2_cols;
+                    for (c = cb; c < c_end; c++) drow[c] += a * brow[c];
+                }
+            }
         }
-        s1ptr = s1temp;
+    }
+}
+
+static bool k3m_Overlaps(const float* a, uint32_t a_size, const float* b, uint32_t b_size)
+{
+    return (a < b + b_size) && (b < a + a_size);
+}
+
+K3API float* k3m_MulScratch(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2, float* scratch)
+{
+    uint32_t dsize = s1_rows * s2_cols;
+    if (!k3m_Overlaps(d, dsize, s1, s1_rows * s2_rows) && !k3m_Overlaps(d, dsize, s2, s2_rows * s2_cols)) {
+        k3m_MulBlocked(s1_rows, s2_rows, s2_cols, d, s1, s2);
+    } else if (scratch != NULL) {
+        k3m_MulBlocked(s1_rows, s2_rows, s2_cols, scratch, s1, s2);
+        memcpy(d, scratch, dsize * sizeof(float));
     } else {
-        s1ptr = s1;
+        k3m_MulScalar(s1_rows, s2_rows, s2_cols, d, s1, s2);
     }
+    return d;
+}
 
-    // Make a tranposed copy of s2
-    if (s2size > K3_MATH_STATIC_ARRAY_SIZE) {
-        s2ptr = new float[s2size];
+float* k3m_MulScalar(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2)
+{
+    uint32_t dsize = s1_rows * s2_cols;
+    if (!k3m_Overlaps(d, dsize, s1, s1_rows * s2_rows) && !k3m_Overlaps(d, dsize, s2, s2_rows * s2_cols)) {
+        k3m_MulBlocked(s1_rows, s2_rows, s2_cols, d, s1, s2);
+    } else if (dsize <= K3_MATH_STATIC_ARRAY_SIZE) {
+        float static_copy[K3_MATH_STATIC_ARRAY_SIZE];
+        k3m_MulBlocked(s1_rows, s2_rows, s2_cols, static_copy, s1, s2);
+        memcpy(d, static_copy, dsize * sizeof(float));
+    } else if (dsize <= K3_MATH_STACK_ROWS * K3_MATH_STACK_ROWS) {
+        float stack_copy[K3_MATH_STACK_ROWS * K3_MATH_STACK_ROWS];
+        k3m_MulBlocked(s1_rows, s2_rows, s2_cols, stack_copy, s1, s2);
+        memcpy(d, stack_copy, dsize * sizeof(float));
     } else {
-        s2ptr = static_copy2;
+        float* temp = new float[dsize];
+        k3m_MulBlocked(s1_rows, s2_rows, s2_cols, temp, s1, s2);
+        memcpy(d, temp, dsize * sizeof(float));
+        delete[] temp;
     }
-    memcpy(s2ptr, s2, s2size * sizeof(float));
-    k3m_Transpose(s2_rows, s2_cols, s2ptr);
-
-    // Loop through every row of s1, and coumn of s2,
-    // and take the dot product of the row/column pair, and assign to it the
-    // (rth, cth) entry of the destination matrix
-    dptr = d;
-    for (r = 0, v1 = s1ptr; r < s1_rows; r++, v1 += s2_rows) {
-        for (c = 0, v2 = s2ptr; c < s2_cols; c++, v2 += s2_rows) {
-            *dptr = k3v_Dot(s2_rows, v1, v2);
-            dptr++;
-        }
+    return d;
+}
+
+/* 4x4 shortcuts of the scalar reference */
+float* k3m4_TransposeScalar(float* d)
+{
+    return k3m_TransposeScalar(4, 4, d);
+}
+
+float* k3m4_InverseScalar(float* d)
+{
+    return k3m_InverseScalar(4, d);
+}
+
+// Affine inverse: the 3x3 part inverts through its adjugate, whose columns are the cross products
+// of its rows, and the translation becomes -inverse * translation
+// A last row other than 0 0 0 1, or a singular 3x3 part, goes through the general inverse
+float* k3m4_InverseTransformScalar(float* d)
+{
+    float c[3][3];
+    float det, inv_det;
+    float t[3] = { d[3], d[7], d[11] };
+    uint32_t i, j;
+
+    if (d[12] != 0.0f || d[13] != 0.0f || d[14] != 0.0f || d[15] != 1.0f) return k3m4_InverseScalar(d);
+
+    for (j = 0; j < 3; j++) {
+        const float* a = d + 4 * ((j + 1) % 3);
+        const float* b = d + 4 * ((j + 2) % 3);
+        c[j][0] = a[1] * b[2] - a[2] * b[1];
+        c[j][1] = a[2] * b[0] - a[0] * b[2];
+        c[j][2] = a[0] * b[1] - a[1] * b[0];
+    }
+    det = 0.0f;
+    det += d[0] * c[0][0];
+    det += d[1] * c[0][1];
+    det += d[2] * c[0][2];
+    if (det == 0.0f) return k3m4_InverseScalar(d);
+    inv_det = 1.0f / det;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++) d[4 * i + j] = c[j][i] * inv_det;
+        d[4 * i + 3] = 0.0f - ((d[4 * i + 0] * t[0] + d[4 * i + 1] * t[1]) + d[4 * i + 2] * t[2]);
     }
+    return d;
+}
 
-    // Free any memory that was allocated
-    if ((s1ptr != s1) && (s1ptr != static_copy1)) delete[] s1ptr;
-    if (s2ptr != static_copy2) delete[] s2ptr;
+float* k3m4_MulScalar(float* d, const float* s1, const float* s2)
+{
+    return k3m_MulScalar(4, 4, 4, d, s1, s2);
+}
+
+float* k3mv4_MulScalar(float* d, const float* s1, const float* s2)
+{
+    return k3m_MulScalar(4, 4, 1, d, s1, s2);
+}
 
+float* k3vm4_MulScalar(float* d, const float* s1, const float* s2)
+{
+    return k3m_MulScalar(1, 4, 4, d, s1, s2);
+}
+
+float* k3m4_MulArrayScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) k3m4_MulScalar(dp, s1, s2);
     return d;
 }
 
-#ifdef _WIN32
-#include <intrin.h>
-K3API float* k3m4_Mul(float* d, const float* s1, const float* s2)
+float* k3mv4_MulArrayScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
 {
-    uint64_t s1_addr = (uint64_t)s1;
-    uint64_t s2_addr = (uint64_t)s2;
-    if ((s1_addr & 0xf) || (s2_addr & 0xf)) {
-        return k3m_Mul(4, 4, 4, (d), (s1), (s2));
-    }
-    __m128 row1 = _mm_load_ps(&s2[0]);
-    __m128 row2 = _mm_load_ps(&s2[4]);
-    __m128 row3 = _mm_load_ps(&s2[8]);
-    __m128 row4 = _mm_load_ps(&s2[12]);
     uint32_t i;
-    for (i = 0; i < 4; i++) {
-        __m128 brod1 = _mm_set1_ps(s1[4 * i + 0]);
-        __m128 brod2 = _mm_set1_ps(s1[4 * i + 1]);
-        __m128 brod3 = _mm_set1_ps(s1[4 * i + 2]);
-        __m128 brod4 = _mm_set1_ps(s1[4 * i + 3]);
-        __m128 row = _mm_add_ps(
-            _mm_add_ps(
-                _mm_mul_ps(brod1, row1),
-                _mm_mul_ps(brod2, row2)),
-            _mm_add_ps(
-                _mm_mul_ps(brod3, row3),
-                _mm_mul_ps(brod4, row4)));
-        _mm_store_ps(&d[4 * i], row);
-    }
+    float* dp = d;
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) k3mv4_MulScalar(dp, s1, s2);
     return d;
 }
 
-#define MakeShuffleMask(x, y, z, w)  ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+float* k3mp3_MulArrayScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    float v[4], r[4];
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) {
+        v[0] = s2[0];
+        v[1] = s2[1];
+        v[2] = s2[2];
+        v[3] = 1.0f;
+        k3mv4_MulScalar(r, s1, v);
+        dp[0] = r[0];
+        dp[1] = r[1];
+        dp[2] = r[2];
+    }
+    return d;
+}
 
-#define VecSwizzleMask(vec, mask)    _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(vec), mask))
-#define VecSwizzle(vec, x, y, z, w) VecSwizzleMask(vec, MakeShuffleMask(x, y, z, w))
-#define VecSwizzle1(vec, x)         VecSwizzleMask(vec, MakeShuffleMask(x, x, x, x))
-#define VecSwizzle_0022(vec)        _mm_moveldup_ps(vec)
-#define VecSwizzle_1133(vec)        _mm_movehdup_ps(vec)
-#define VecShuffle(vec1, vec2, x, y, z, w)  _mm_shuffle_ps(vec1, vec2, MakeShuffleMask(x, y, z, w))
-#define VecShuffle_0101(vec1, vec2) _mm_movelh_ps(vec1, vec2)
-#define VecShuffle_2323(vec1, vec2) _mm_movehl_ps(vec2, vec1)
+float* k3v_NormalizeScalar(uint32_t l, float* d)
+{
+    float f = sqrtf(k3v_DotScalar(l, d, d));
+    f = (f == 0.0f) ? 0.0f : (1.0f / f);
+    return k3sv_MulScalar(l, d, f, d);
+}
 
-#define SMALL_FLOAT     (1.0e-8f)
+// ------------------------------------------------------------
+// Fast transcendental batches, scalar reference
+void k3v_FastSinCosScalar(uint32_t vec_length, float* sin_d, float* cos_d, const float* s)
+{
+    uint32_t i;
+    for (i = 0; i < vec_length; i++) k3fast_SinCos(s[i], sin_d + i, cos_d + i);
+}
 
-K3API float* k3m4_InverseTransform(float* d)
+float* k3v_FastAtan2Scalar(uint32_t vec_length, float* d, const float* s1, const float* s2)
 {
-    __m128* m = (__m128*)d;
-    __m128 t0 = VecShuffle_0101(m[0], m[1]);
-    __m128 t1 = VecShuffle_2323(m[0], m[1]);
-    m[0] = VecShuffle(t0, m[2], 0, 2, 0, 3);
-    m[1] = VecShuffle(t0, m[2], 1, 3, 1, 3);
-    m[2] = VecShuffle(t1, m[2], 0, 2, 2, 3);
-
-    __m128 size_sqr = _mm_mul_ps(m[0], m[0]);
-    size_sqr = _mm_add_ps(size_sqr, _mm_mul_ps(m[1], m[1]));
-    size_sqr = _mm_add_ps(size_sqr, _mm_mul_ps(m[2], m[2]));
-
-    __m128 one = _mm_set_ps1(1.0f);
-    __m128 r_size_sqr = _mm_blendv_ps(
-        _mm_div_ps(one, size_sqr),
-        one,
-        _mm_cmplt_ps(size_sqr, _mm_set_ps1(SMALL_FLOAT))
-    );
-
-    m[0] = _mm_mul_ps(m[0], r_size_sqr);
-    m[1] = _mm_mul_ps(m[1], r_size_sqr);
-    m[2] = _mm_mul_ps(m[2], r_size_sqr);
-
-    __m128 last_row = m[3];
-    m[3] = _mm_mul_ps(m[0], VecSwizzle1(last_row, 0));
-    m[3] = _mm_add_ps(m[3], _mm_mul_ps(m[1], VecSwizzle1(last_row, 1)));
-    m[3] = _mm_add_ps(m[3], _mm_mul_ps(m[2], VecSwizzle1(last_row, 2)));
-    m[3] = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), m[3]);
+    uint32_t i;
+    for (i = 0; i < vec_length; i++) d[i] = k3fast_Atan2(s1[i], s2[i]);
+    return d;
+}
 
+float* k3v_FastRsqrtScalar(uint32_t vec_length, float* d, const float* s)
+{
+    uint32_t i;
+    for (i = 0; i < vec_length; i++) d[i] = k3fast_Rsqrt(s[i]);
     return d;
 }
 
-#define K3_NORMALIZE_DP_MASK(l) (~(0xf0 << l) & 0xff)
-#define K3_NORMALIZE_WR_MASK(l) (~(0xf << l) & 0xf)
-K3API float* k3v_Normalize(uint32_t l, float* d) {
-    if ((((uint32_t)d) & 0xf) == 0) {
-        // if 16B aligned, use SSE code
-        float norm_array[4];
-        static const __m128 near_zero = _mm_set1_ps(SMALL_FLOAT);
-        __m128* v = (__m128*)d;
-        static const int dp_mask2 = K3_NORMALIZE_DP_MASK(2);
-        static const int dp_mask3 = K3_NORMALIZE_DP_MASK(3);
-        static const int dp_mask4 = K3_NORMALIZE_DP_MASK(4);
-        static const int wr_mask2 = K3_NORMALIZE_WR_MASK(2);
-        static const int wr_mask3 = K3_NORMALIZE_WR_MASK(3);
-        static const int wr_mask4 = K3_NORMALIZE_WR_MASK(4);
-
-        __m128 dp;
-        switch (l) {
-        case 2: dp = _mm_dp_ps(*v, *v, dp_mask2); break;
-        case 3: dp = _mm_dp_ps(*v, *v, dp_mask3); break;
-        case 4: dp = _mm_dp_ps(*v, *v, dp_mask4); break;
-        }
+K3API k3mathPrecision k3math_GetPrecision()
+{
+    return k3math_precision;
+}
 
-        __m128 cmp = _mm_cmpgt_ps(dp, near_zero);
-        dp = _mm_rsqrt_ps(dp);
-        __m128* norm = (__m128*)norm_array;
-        *norm = _mm_mul_ps(*v, _mm_and_ps(dp, cmp));
-        switch (l) {
-        case 4: d[3] = norm_array[3];
-        case 3: d[2] = norm_array[2];
-        default: d[1] = norm_array[1];
-            d[0] = norm_array[0];
-        }
-        return d;
-    } else {
-        float f = k3v_Length((l), (d));
-        f = (f == 0.0f) ? 0.0f : (1.0f / f);
-        return k3sv_Mul((l), (d), f, (d));
+K3API k3mathPrecision k3math_SetPrecision(k3mathPrecision precision)
+{
+    k3math_precision = precision;
+    return k3math_precision;
+}
+
+K3API float k3s_FastSin(float x)
+{
+    float sin_x, cos_x;
+    k3fast_SinCos(x, &sin_x, &cos_x);
+    return sin_x;
+}
+
+K3API float k3s_FastCos(float x)
+{
+    float sin_x, cos_x;
+    k3fast_SinCos(x, &sin_x, &cos_x);
+    return cos_x;
+}
+
+K3API void k3s_FastSinCos(float x, float* sin_x, float* cos_x)
+{
+    k3fast_SinCos(x, sin_x, cos_x);
+}
+
+K3API float k3s_FastAtan2(float y, float x)
+{
+    return k3fast_Atan2(y, x);
+}
+
+K3API float k3s_FastRsqrt(float x)
+{
+    return k3fast_Rsqrt(x);
+}
+
+// ------------------------------------------------------------
+// Exported entry points
+// These forward to the kernels of the simd level picked at startup (see simd.cpp)
+K3API float* k3v_Negate(uint32_t vec_length, float* d)
+{
+    return k3math_funcs.v_Negate(vec_length, d);
+}
+
+K3API float* k3v_Add(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Add(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_Sub(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Sub(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_Mul(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Mul(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_Div(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Div(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_Cross(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Cross(vec_length, d, s1, s2);
+}
+
+K3API bool k3v_Equals(uint32_t vec_length, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Equals(vec_length, s1, s2);
+}
+
+K3API float k3v_Dot(uint32_t vec_length, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Dot(vec_length, s1, s2);
+}
+
+K3API float* k3v_Min(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Min(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_Max(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_Max(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_Normalize(uint32_t l, float* d)
+{
+    if (k3math_precision == k3mathPrecision::FAST) {
+        float f = k3math_funcs.v_Dot(l, d, d);
+        f = (f == 0.0f) ? 0.0f : k3fast_Rsqrt(f);
+        return k3math_funcs.sv_Mul(l, d, f, d);
+    }
+    return k3math_funcs.v_Normalize(l, d);
+}
+
+K3API float* k3sv_Add(uint32_t vec_length, float* d, const float s1, const float* s2)
+{
+    return k3math_funcs.sv_Add(vec_length, d, s1, s2);
+}
+
+K3API float* k3sv_Sub(uint32_t vec_length, float* d, const float s1, const float* s2)
+{
+    return k3math_funcs.sv_Sub(vec_length, d, s1, s2);
+}
+
+K3API float* k3sv_Mul(uint32_t vec_length, float* d, const float s1, const float* s2)
+{
+    return k3math_funcs.sv_Mul(vec_length, d, s1, s2);
+}
+
+K3API float* k3sv_Div(uint32_t vec_length, float* d, const float s1, const float* s2)
+{
+    return k3math_funcs.sv_Div(vec_length, d, s1, s2);
+}
+
+K3API float* k3m_Transpose(uint32_t rows, uint32_t cols, float* d)
+{
+    if (rows == 4 && cols == 4) return k3math_funcs.m4_Transpose(d);
+    return k3m_TransposeScalar(rows, cols, d);
+}
+
+K3API float* k3m_Inverse(uint32_t rows, float* d)
+{
+    if (rows == 4) return k3math_funcs.m4_Inverse(d);
+    return k3m_InverseScalar(rows, d);
+}
+
+K3API float* k3m_Mul(uint32_t s1_rows, uint32_t s2_rows, uint32_t s2_cols, float* d, const float* s1, const float* s2)
+{
+    if (s2_rows == 4) {
+        if (s1_rows == 4 && s2_cols == 4) return k3math_funcs.m4_Mul(d, s1, s2);
+        if (s1_rows == 4 && s2_cols == 1) return k3math_funcs.mv4_Mul(d, s1, s2);
+        if (s1_rows == 1 && s2_cols == 4) return k3math_funcs.vm4_Mul(d, s1, s2);
     }
+    return k3m_MulScalar(s1_rows, s2_rows, s2_cols, d, s1, s2);
 }
 
-#else
 K3API float* k3m4_Mul(float* d, const float* s1, const float* s2)
 {
-    return k3m_Mul(4, 4, 4, (d), (s1), (s2));
+    return k3math_funcs.m4_Mul(d, s1, s2);
 }
 
 K3API float* k3m4_InverseTransform(float* d)
 {
-    return k3m_Inverse(4, (d));
+    return k3math_funcs.m4_InverseTransform(d);
 }
 
-K3API float* k3v_Normalize(uint32_t l, float* d) {
-    float f = k3v_Length((l), (d));
-    f = (f == 0.0f) ? 0.0f : (1.0f / f);
-    return k3sv_Mul((l), (d), f, (d));
+K3API float* k3m4_MulArray(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    return k3math_funcs.m4_MulArray(count, d, d_stride, s1, s1_stride, s2, s2_stride);
+}
+
+K3API float* k3mv4_MulArray(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    return k3math_funcs.mv4_MulArray(count, d, d_stride, s1, s1_stride, s2, s2_stride);
 }
 
-#endif
+K3API float* k3mp3_MulArray(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    return k3math_funcs.mp3_MulArray(count, d, d_stride, s1, s1_stride, s2, s2_stride);
+}
+
+K3API float* k3v4_QuatNlerpBatch(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    return k3math_funcs.quat_NlerpBatch(count, d, d_stride, s1, s1_stride, s2, s2_stride, t);
+}
+
+K3API float* k3v4_QuatSlerpBatch(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    return k3math_funcs.quat_SlerpBatch(count, d, d_stride, s1, s1_stride, s2, s2_stride, t);
+}
+
+K3API void k3v_FastSinCos(uint32_t vec_length, float* sin_d, float* cos_d, const float* s)
+{
+    k3math_funcs.v_FastSinCos(vec_length, sin_d, cos_d, s);
+}
+
+K3API float* k3v_FastAtan2(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    return k3math_funcs.v_FastAtan2(vec_length, d, s1, s2);
+}
+
+K3API float* k3v_FastRsqrt(uint32_t vec_length, float* d, const float* s)
+{
+    return k3math_funcs.v_FastRsqrt(vec_length, d, s);
+}
+
+K3API float* k3m_QuatToMatBatch(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    return k3math_funcs.quat_ToMatBatch(count, cols, d, d_stride, s, s_stride);
+}
+
+K3API float* k3v4_QuatToDualQuatBatch(uint32_t count, float* d, uint32_t d_stride, const float* quat, uint32_t quat_stride, const float* xlat, uint32_t xlat_stride)
+{
+    return k3math_funcs.quat_ToDualQuatBatch(count, d, d_stride, quat, quat_stride, xlat, xlat_stride);
+}
+
+K3API float* k3m4_DualQuatToMatBatch(uint32_t count, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    return k3math_funcs.dualQuat_ToMatBatch(count, d, d_stride, s, s_stride);
+}
 
 K3API float* k3m_QuatToMat(uint32_t cols, float* d, const float* s)
 {
@@ -1099,8 +1449,8 @@ K3API float* k3m_MatToQuat(uint32_t cols, float* d, const float* s)
 
 K3API float* k3v4_SetQuatRotation(float* d, float angle, const float* axis)
 {
-    float cos_ang2 = cosf(angle / 2.0f);
-    float sin_ang2 = sinf(angle / 2.0f);
+    float cos_ang2, sin_ang2;
+    k3math_SinCos(angle / 2.0f, &sin_ang2, &cos_ang2);
     d[0] = axis[0] * sin_ang2;
     d[1] = axis[1] * sin_ang2;
     d[2] = axis[2] * sin_ang2;
@@ -1121,12 +1471,10 @@ K3API float k3v3_GetQuatRotation(float* axis, float* angle, const float* quat)
 
 K3API float* k3v4_SetQuatEuler(float* d, const float* angles)
 {
-    float sin_x2 = sinf(angles[0] / 2.0f);
-    float cos_x2 = cosf(angles[0] / 2.0f);
-    float sin_y2 = sinf(angles[1] / 2.0f);
-    float cos_y2 = cosf(angles[1] / 2.0f);
-    float sin_z2 = sinf(angles[2] / 2.0f);
-    float cos_z2 = cosf(angles[2] / 2.0f);
+    float sin_x2, cos_x2, sin_y2, cos_y2, sin_z2, cos_z2;
+    k3math_SinCos(angles[0] / 2.0f, &sin_x2, &cos_x2);
+    k3math_SinCos(angles[1] / 2.0f, &sin_y2, &cos_y2);
+    k3math_SinCos(angles[2] / 2.0f, &sin_z2, &cos_z2);
     d[0] = sin_x2 * cos_y2 * cos_z2 - cos_x2 * sin_y2 * sin_z2;
     d[1] = cos_x2 * sin_y2 * cos_z2 + sin_x2 * cos_y2 * sin_z2;
     d[2] = cos_x2 * cos_y2 * sin_z2 - sin_x2 * sin_y2 * cos_y2;
@@ -1147,9 +1495,14 @@ K3API float* k3v3_GetQuatEuler(float* d, const float* quat)
     t3 = 2.0f * (quat[3] * quat[2] + quat[0] * quat[1]);
     t4 = 1.0f - 2.0f * (quat[1] * quat[1] + quat[2] * quat[2]);
 
-    d[0] = atan2f(t0, t1);
+    if (k3math_precision == k3mathPrecision::FAST) {
+        d[0] = k3fast_Atan2(t0, t1);
+        d[2] = k3fast_Atan2(t3, t4);
+    } else {
+        d[0] = atan2f(t0, t1);
+        d[2] = atan2f(t3, t4);
+    }
     d[1] = asinf(t2);
-    d[2] = atan2f(t3, t4);
 
     return d;
 }
@@ -1179,6 +1532,100 @@ K3API float* k3v4_QuatMul(float* d, const float* s1, const float* s2)
     return d;
 }
 
+/* batched quaternion scalar references */
+float* k3v4_QuatNlerpBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    uint32_t i, k;
+    float* dp = d;
+    float q[4];
+    float w1 = 1.0f - t;
+    float w2;
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) {
+        w2 = (k3v_DotScalar(4, s1, s2) < 0.0f) ? -t : t;
+        for (k = 0; k < 4; k++) q[k] = w1 * s1[k] + w2 * s2[k];
+        k3v_NormalizeScalar(4, q);
+        for (k = 0; k < 4; k++) dp[k] = q[k];
+    }
+    return d;
+}
+
+float* k3v4_QuatSlerpBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    uint32_t i, k;
+    float* dp = d;
+    float q[4];
+    float w1, w2;
+    bool linear;
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) {
+        linear = k3quat_SlerpWeights(k3v_DotScalar(4, s1, s2), t, &w1, &w2);
+        for (k = 0; k < 4; k++) q[k] = w1 * s1[k] + w2 * s2[k];
+        if (linear) k3v_NormalizeScalar(4, q);
+        for (k = 0; k < 4; k++) dp[k] = q[k];
+    }
+    return d;
+}
+
+float* k3m_QuatToMatBatchScalar(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    for (i = 0; i < count; i++, dp += d_stride, s += s_stride) k3m_QuatToMat(cols, dp, s);
+    return d;
+}
+
+// The dual part is half of the translation (as a pure quaternion) times the rotation
+float* k3v4_QuatToDualQuatBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* quat, uint32_t quat_stride, const float* xlat, uint32_t xlat_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    float q[4];
+    for (i = 0; i < count; i++, dp += d_stride, quat += quat_stride, xlat += xlat_stride) {
+        q[0] = quat[0];
+        q[1] = quat[1];
+        q[2] = quat[2];
+        q[3] = quat[3];
+        dp[4] = 0.5f * (xlat[0] * q[3] + xlat[1] * q[2] - xlat[2] * q[1]);
+        dp[5] = 0.5f * (xlat[1] * q[3] + xlat[2] * q[0] - xlat[0] * q[2]);
+        dp[6] = 0.5f * (xlat[2] * q[3] + xlat[0] * q[1] - xlat[1] * q[0]);
+        dp[7] = -0.5f * (xlat[0] * q[0] + xlat[1] * q[1] + xlat[2] * q[2]);
+        dp[0] = q[0];
+        dp[1] = q[1];
+        dp[2] = q[2];
+        dp[3] = q[3];
+    }
+    return d;
+}
+
+// The translation is twice the dual part times the conjugate of the real part
+float* k3m4_DualQuatToMatBatchScalar(uint32_t count, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    float t[3];
+    for (i = 0; i < count; i++, dp += d_stride, s += s_stride) {
+        t[0] = 2.0f * (s[4] * s[3] - s[7] * s[0] + s[6] * s[1] - s[5] * s[2]);
+        t[1] = 2.0f * (s[5] * s[3] - s[7] * s[1] + s[4] * s[2] - s[6] * s[0]);
+        t[2] = 2.0f * (s[6] * s[3] - s[7] * s[2] + s[5] * s[0] - s[4] * s[1]);
+        k3m_QuatToMat(4, dp, s);
+        dp[3] = t[0];
+        dp[7] = t[1];
+        dp[11] = t[2];
+    }
+    return d;
+}
+
+void k3bvh_CheckCollisionBatchScalar(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++) k3bvh_CheckCollisionLane(s1, s2, i, hit_mask, axis_flags);
+}
+
+void k3bvh_ClassifyFrustumBatchScalar(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++) d[i] = k3bvh_ClassifyFrustumLane(planes, s + i);
+}
+
 K3API float* k3v3_RGBtoHSV(float* d, const float* s)
 {
     bool r_gt_g = (s[0] > s[1]);
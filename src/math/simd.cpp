@@ -0,0 +1,1731 @@
+// k3 graphics library
+// simd math kernels and runtime cpu dispatch
+//
+// Every kernel here must produce the exact bits of its scalar reference in math.cpp.
+// That rules out fused multiply-add, reciprocal estimates and reordered sums:
+// products are done in parallel, but dot products still accumulate lane by lane,
+// starting from 0.0f, in index order like the scalar loop does.
+
+#include "k3internal.h"
+#include "k3simd.h"
+
+// ------------------------------------------------------------
+// dispatch table, starts on the scalar reference until the cpu is probed
+static const k3mathFuncs k3math_scalar_funcs = {
+    k3simdLevel::NONE,
+    k3v_NegateScalar,
+    k3v_AddScalar,
+    k3v_SubScalar,
+    k3v_MulScalar,
+    k3v_DivScalar,
+    k3v_CrossScalar,
+    k3v_EqualsScalar,
+    k3v_DotScalar,
+    k3v_MinScalar,
+    k3v_MaxScalar,
+    k3v_NormalizeScalar,
+    k3sv_AddScalar,
+    k3sv_SubScalar,
+    k3sv_MulScalar,
+    k3sv_DivScalar,
+    k3m4_TransposeScalar,
+    k3m4_InverseScalar,
+    k3m4_InverseTransformScalar,
+    k3m4_MulScalar,
+    k3mv4_MulScalar,
+    k3vm4_MulScalar,
+    k3m4_MulArrayScalar,
+    k3mv4_MulArrayScalar,
+    k3mp3_MulArrayScalar,
+    k3v4_QuatNlerpBatchScalar,
+    k3v4_QuatSlerpBatchScalar,
+    k3m_QuatToMatBatchScalar,
+    k3v4_QuatToDualQuatBatchScalar,
+    k3m4_DualQuatToMatBatchScalar,
+    k3bvh_CheckCollisionBatchScalar,
+    k3bvh_ClassifyFrustumBatchScalar,
+    k3v_FastSinCosScalar,
+    k3v_FastAtan2Scalar,
+    k3v_FastRsqrtScalar
+};
+
+k3mathFuncs k3math_funcs = k3math_scalar_funcs;
+
+#if defined(K3_SIMD_X86)
+// ------------------------------------------------------------
+// SSE4.1 kernels
+
+#define K3_SSE_SWIZZLE(v, x, y, z, w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE((w), (z), (y), (x)))
+
+// Load/store the first n (1 to 4) floats without touching memory past them
+// the 2 float moves go through the unaligned 64 bit integer forms, as s and d are only 4 byte aligned
+K3_TARGET_SSE41 static inline __m128 k3sse_LoadPartial(const float* s, uint32_t n)
+{
+    switch (n) {
+    case 1: return _mm_load_ss(s);
+    case 2: return _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)s));
+    case 3: return _mm_movelh_ps(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)s)), _mm_load_ss(s + 2));
+    default: return _mm_loadu_ps(s);
+    }
+}
+
+K3_TARGET_SSE41 static inline void k3sse_StorePartial(float* d, __m128 v, uint32_t n)
+{
+    switch (n) {
+    case 1: _mm_store_ss(d, v); break;
+    case 2: _mm_storel_epi64((__m128i*)d, _mm_castps_si128(v)); break;
+    case 3:
+        _mm_storel_epi64((__m128i*)d, _mm_castps_si128(v));
+        _mm_store_ss(d + 2, _mm_movehl_ps(v, v));
+        break;
+    default: _mm_storeu_ps(d, v); break;
+    }
+}
+
+// Adds the first n lanes of p to acc, one at a time in lane order
+K3_TARGET_SSE41 static inline float k3sse_AccumulateLanes(float acc, __m128 p, uint32_t n)
+{
+    float lanes[4];
+    uint32_t i;
+    _mm_storeu_ps(lanes, p);
+    for (i = 0; i < n; i++) acc += lanes[i];
+    return acc;
+}
+
+#define K3_SSE_VV_OP(name, op) \
+K3_TARGET_SSE41 static float* name(uint32_t vec_length, float* d, const float* s1, const float* s2) \
+{ \
+    uint32_t i; \
+    for (i = 0; i + 4 <= vec_length; i += 4) { \
+        _mm_storeu_ps(d + i, op(_mm_loadu_ps(s1 + i), _mm_loadu_ps(s2 + i))); \
+    } \
+    if (i < vec_length) { \
+        uint32_t n = vec_length - i; \
+        k3sse_StorePartial(d + i, op(k3sse_LoadPartial(s1 + i, n), k3sse_LoadPartial(s2 + i, n)), n); \
+    } \
+    return d; \
+}
+
+#define K3_SSE_SV_OP(name, op) \
+K3_TARGET_SSE41 static float* name(uint32_t vec_length, float* d, const float s1, const float* s2) \
+{ \
+    uint32_t i; \
+    __m128 s = _mm_set1_ps(s1); \
+    for (i = 0; i + 4 <= vec_length; i += 4) { \
+        _mm_storeu_ps(d + i, op(s, _mm_loadu_ps(s2 + i))); \
+    } \
+    if (i < vec_length) { \
+        uint32_t n = vec_length - i; \
+        k3sse_StorePartial(d + i, op(s, k3sse_LoadPartial(s2 + i, n)), n); \
+    } \
+    return d; \
+}
+
+// minps/maxps return the second operand on ties and NaNs, which is exactly (a < b) ? a : b
+K3_SSE_VV_OP(k3v_AddSSE41, _mm_add_ps)
+K3_SSE_VV_OP(k3v_SubSSE41, _mm_sub_ps)
+K3_SSE_VV_OP(k3v_MulSSE41, _mm_mul_ps)
+K3_SSE_VV_OP(k3v_DivSSE41, _mm_div_ps)
+K3_SSE_VV_OP(k3v_MinSSE41, _mm_min_ps)
+K3_SSE_VV_OP(k3v_MaxSSE41, _mm_max_ps)
+K3_SSE_SV_OP(k3sv_AddSSE41, _mm_add_ps)
+K3_SSE_SV_OP(k3sv_SubSSE41, _mm_sub_ps)
+K3_SSE_SV_OP(k3sv_MulSSE41, _mm_mul_ps)
+K3_SSE_SV_OP(k3sv_DivSSE41, _mm_div_ps)
+
+K3_TARGET_SSE41 static float* k3v_NegateSSE41(uint32_t vec_length, float* d)
+{
+    uint32_t i;
+    __m128 sign = _mm_set1_ps(-0.0f);
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        _mm_storeu_ps(d + i, _mm_xor_ps(_mm_loadu_ps(d + i), sign));
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        k3sse_StorePartial(d + i, _mm_xor_ps(k3sse_LoadPartial(d + i, n), sign), n);
+    }
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3v_CrossSSE41(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    if (vec_length != 3) return k3v_CrossScalar(vec_length, d, s1, s2);
+    __m128 a = k3sse_LoadPartial(s1, 3);
+    __m128 b = k3sse_LoadPartial(s2, 3);
+    __m128 r = _mm_sub_ps(_mm_mul_ps(K3_SSE_SWIZZLE(a, 1, 2, 0, 3), K3_SSE_SWIZZLE(b, 2, 0, 1, 3)),
+                          _mm_mul_ps(K3_SSE_SWIZZLE(a, 2, 0, 1, 3), K3_SSE_SWIZZLE(b, 1, 2, 0, 3)));
+    k3sse_StorePartial(d, r, 3);
+    return d;
+}
+
+K3_TARGET_SSE41 static bool k3v_EqualsSSE41(uint32_t vec_length, const float* s1, const float* s2)
+{
+    uint32_t i;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        if (_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(s1 + i), _mm_loadu_ps(s2 + i)))) return false;
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        // unused lanes load as 0.0f on both sides, so they always compare equal
+        if (_mm_movemask_ps(_mm_cmpneq_ps(k3sse_LoadPartial(s1 + i, n), k3sse_LoadPartial(s2 + i, n)))) return false;
+    }
+    return true;
+}
+
+K3_TARGET_SSE41 static float k3v_DotSSE41(uint32_t vec_length, const float* s1, const float* s2)
+{
+    uint32_t i;
+    float result = 0.0f;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        result = k3sse_AccumulateLanes(result, _mm_mul_ps(_mm_loadu_ps(s1 + i), _mm_loadu_ps(s2 + i)), 4);
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        result = k3sse_AccumulateLanes(result, _mm_mul_ps(k3sse_LoadPartial(s1 + i, n), k3sse_LoadPartial(s2 + i, n)), n);
+    }
+    return result;
+}
+
+K3_TARGET_SSE41 static float* k3v_NormalizeSSE41(uint32_t l, float* d)
+{
+    float f = sqrtf(k3v_DotSSE41(l, d, d));
+    f = (f == 0.0f) ? 0.0f : (1.0f / f);
+    return k3sv_MulSSE41(l, d, f, d);
+}
+
+K3_TARGET_SSE41 static float* k3m4_TransposeSSE41(float* d)
+{
+    __m128 r0 = _mm_loadu_ps(d + 0);
+    __m128 r1 = _mm_loadu_ps(d + 4);
+    __m128 r2 = _mm_loadu_ps(d + 8);
+    __m128 r3 = _mm_loadu_ps(d + 12);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(d + 0, r0);
+    _mm_storeu_ps(d + 4, r1);
+    _mm_storeu_ps(d + 8, r2);
+    _mm_storeu_ps(d + 12, r3);
+    return d;
+}
+
+// Same cofactor expansion as k3m_InverseScalar, 4 outputs per vector
+// Each lane of a term picks the same tmp/copy pair the scalar code uses for that element,
+// so the products and the order of the adds are identical
+K3_TARGET_SSE41 static float* k3m4_InverseSSE41(float* d)
+{
+    // rows of the transposed copy
+    __m128 c0 = _mm_loadu_ps(d + 0);
+    __m128 c1 = _mm_loadu_ps(d + 4);
+    __m128 c2 = _mm_loadu_ps(d + 8);
+    __m128 c3 = _mm_loadu_ps(d + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    // cofactor pairs of rows 2 and 3 (first 8 elements)
+    __m128 p1 = _mm_mul_ps(K3_SSE_SWIZZLE(c2, 2, 3, 1, 2), K3_SSE_SWIZZLE(c3, 3, 2, 3, 1));
+    __m128 p2 = _mm_mul_ps(K3_SSE_SWIZZLE(c2, 3, 0, 3, 0), K3_SSE_SWIZZLE(c3, 1, 3, 0, 2));
+    __m128 p3 = _mm_mul_ps(K3_SSE_SWIZZLE(c2, 1, 2, 0, 1), K3_SSE_SWIZZLE(c3, 2, 0, 1, 0));
+    __m128 q1 = _mm_mul_ps(K3_SSE_SWIZZLE(c2, 3, 2, 3, 1), K3_SSE_SWIZZLE(c3, 2, 3, 1, 2));
+    __m128 q2 = _mm_mul_ps(K3_SSE_SWIZZLE(c2, 1, 3, 0, 2), K3_SSE_SWIZZLE(c3, 3, 0, 3, 0));
+    __m128 q3 = _mm_mul_ps(K3_SSE_SWIZZLE(c2, 2, 0, 1, 0), K3_SSE_SWIZZLE(c3, 1, 2, 0, 1));
+
+    __m128 e1 = K3_SSE_SWIZZLE(c1, 1, 0, 0, 0);
+    __m128 e2 = K3_SSE_SWIZZLE(c1, 2, 2, 1, 1);
+    __m128 e3 = K3_SSE_SWIZZLE(c1, 3, 3, 3, 2);
+    __m128 r0 = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(p1, e1), _mm_mul_ps(p2, e2)), _mm_mul_ps(p3, e3)),
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(q1, e1), _mm_mul_ps(q2, e2)), _mm_mul_ps(q3, e3)));
+    e1 = K3_SSE_SWIZZLE(c0, 1, 0, 0, 0);
+    e2 = K3_SSE_SWIZZLE(c0, 2, 2, 1, 1);
+    e3 = K3_SSE_SWIZZLE(c0, 3, 3, 3, 2);
+    __m128 r1 = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(q1, e1), _mm_mul_ps(q2, e2)), _mm_mul_ps(q3, e3)),
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(p1, e1), _mm_mul_ps(p2, e2)), _mm_mul_ps(p3, e3)));
+
+    // cofactor pairs of rows 0 and 1 (second 8 elements)
+    p1 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 2, 3, 1, 2), K3_SSE_SWIZZLE(c1, 3, 2, 3, 1));
+    p2 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 3, 0, 3, 0), K3_SSE_SWIZZLE(c1, 1, 3, 0, 2));
+    p3 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 1, 2, 0, 1), K3_SSE_SWIZZLE(c1, 2, 0, 1, 0));
+    q1 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 3, 2, 3, 1), K3_SSE_SWIZZLE(c1, 2, 3, 1, 2));
+    q2 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 1, 3, 0, 2), K3_SSE_SWIZZLE(c1, 3, 0, 3, 0));
+    q3 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 2, 0, 1, 0), K3_SSE_SWIZZLE(c1, 1, 2, 0, 1));
+
+    e1 = K3_SSE_SWIZZLE(c3, 1, 0, 0, 0);
+    e2 = K3_SSE_SWIZZLE(c3, 2, 2, 1, 1);
+    e3 = K3_SSE_SWIZZLE(c3, 3, 3, 3, 2);
+    __m128 r2 = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(p1, e1), _mm_mul_ps(p2, e2)), _mm_mul_ps(p3, e3)),
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(q1, e1), _mm_mul_ps(q2, e2)), _mm_mul_ps(q3, e3)));
+
+    // the last 4 elements group their terms differently in the scalar code
+    __m128 t1 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 1, 0, 0, 0), K3_SSE_SWIZZLE(c1, 3, 2, 3, 1));
+    __m128 t2 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 2, 2, 1, 1), K3_SSE_SWIZZLE(c1, 1, 3, 0, 2));
+    __m128 t3 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 3, 3, 3, 2), K3_SSE_SWIZZLE(c1, 2, 0, 1, 0));
+    __m128 u1 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 1, 0, 0, 0), K3_SSE_SWIZZLE(c1, 2, 3, 1, 2));
+    __m128 u2 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 2, 2, 1, 1), K3_SSE_SWIZZLE(c1, 3, 0, 3, 0));
+    __m128 u3 = _mm_mul_ps(K3_SSE_SWIZZLE(c0, 3, 3, 3, 2), K3_SSE_SWIZZLE(c1, 1, 2, 0, 1));
+    __m128 r3 = _mm_sub_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(t1, K3_SSE_SWIZZLE(c2, 2, 3, 1, 2)),
+                              _mm_mul_ps(t2, K3_SSE_SWIZZLE(c2, 3, 0, 3, 0))),
+                   _mm_mul_ps(t3, K3_SSE_SWIZZLE(c2, 1, 2, 0, 1))),
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(u1, K3_SSE_SWIZZLE(c2, 3, 2, 3, 1)),
+                              _mm_mul_ps(u2, K3_SSE_SWIZZLE(c2, 1, 3, 0, 2))),
+                   _mm_mul_ps(u3, K3_SSE_SWIZZLE(c2, 2, 0, 1, 0))));
+
+    // determinant
+    float det = k3sse_AccumulateLanes(0.0f, _mm_mul_ps(c0, r0), 4);
+    if (det != 0) {
+        det = 1 / det;
+    }
+    __m128 s = _mm_set1_ps(det);
+    _mm_storeu_ps(d + 0, _mm_mul_ps(s, r0));
+    _mm_storeu_ps(d + 4, _mm_mul_ps(s, r1));
+    _mm_storeu_ps(d + 8, _mm_mul_ps(s, r2));
+    _mm_storeu_ps(d + 12, _mm_mul_ps(s, r3));
+    return d;
+}
+
+// Same steps as k3m4_InverseTransformScalar; lane j of c0..c2 is component j of the adjugate columns,
+// so after scaling, lane j of the translation sum is row j of the inverse dotted with the translation
+K3_TARGET_SSE41 static float* k3m4_InverseTransformSSE41(float* d)
+{
+    if (d[12] != 0.0f || d[13] != 0.0f || d[14] != 0.0f || d[15] != 1.0f) return k3m4_InverseSSE41(d);
+
+    __m128 r0 = _mm_loadu_ps(d + 0);
+    __m128 r1 = _mm_loadu_ps(d + 4);
+    __m128 r2 = _mm_loadu_ps(d + 8);
+    __m128 c0 = _mm_sub_ps(_mm_mul_ps(K3_SSE_SWIZZLE(r1, 1, 2, 0, 3), K3_SSE_SWIZZLE(r2, 2, 0, 1, 3)),
+        _mm_mul_ps(K3_SSE_SWIZZLE(r1, 2, 0, 1, 3), K3_SSE_SWIZZLE(r2, 1, 2, 0, 3)));
+    __m128 c1 = _mm_sub_ps(_mm_mul_ps(K3_SSE_SWIZZLE(r2, 1, 2, 0, 3), K3_SSE_SWIZZLE(r0, 2, 0, 1, 3)),
+        _mm_mul_ps(K3_SSE_SWIZZLE(r2, 2, 0, 1, 3), K3_SSE_SWIZZLE(r0, 1, 2, 0, 3)));
+    __m128 c2 = _mm_sub_ps(_mm_mul_ps(K3_SSE_SWIZZLE(r0, 1, 2, 0, 3), K3_SSE_SWIZZLE(r1, 2, 0, 1, 3)),
+        _mm_mul_ps(K3_SSE_SWIZZLE(r0, 2, 0, 1, 3), K3_SSE_SWIZZLE(r1, 1, 2, 0, 3)));
+
+    float det = k3sse_AccumulateLanes(0.0f, _mm_mul_ps(r0, c0), 3);
+    if (det == 0.0f) return k3m4_InverseSSE41(d);
+    __m128 s = _mm_set1_ps(1.0f / det);
+    c0 = _mm_mul_ps(c0, s);
+    c1 = _mm_mul_ps(c1, s);
+    c2 = _mm_mul_ps(c2, s);
+
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(d[3])), _mm_mul_ps(c1, _mm_set1_ps(d[7]))),
+        _mm_mul_ps(c2, _mm_set1_ps(d[11])));
+    t = _mm_sub_ps(_mm_setzero_ps(), t);
+    // the last row is already 0 0 0 1
+    _MM_TRANSPOSE4_PS(c0, c1, c2, t);
+    _mm_storeu_ps(d + 0, c0);
+    _mm_storeu_ps(d + 4, c1);
+    _mm_storeu_ps(d + 8, c2);
+    return d;
+}
+
+// Each output row is s1[i][0] * s2[0] + ... + s1[i][3] * s2[3], summed in the scalar order;
+// the leading add of 0.0f keeps the sign of zero results the same as the scalar dot product
+K3_TARGET_SSE41 static inline void k3sse_MulRows(float* d, const float* s1, __m128 b0, __m128 b1, __m128 b2, __m128 b3)
+{
+    __m128 zero = _mm_setzero_ps();
+    uint32_t i;
+    for (i = 0; i < 4; i++) {
+        __m128 row = _mm_add_ps(zero, _mm_mul_ps(_mm_set1_ps(s1[4 * i + 0]), b0));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(s1[4 * i + 1]), b1));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(s1[4 * i + 2]), b2));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(s1[4 * i + 3]), b3));
+        _mm_storeu_ps(d + 4 * i, row);
+    }
+}
+
+// Matrix times column vector, with the matrix already transposed into columns c0..c3
+K3_TARGET_SSE41 static inline __m128 k3sse_MulColumns(__m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v)
+{
+    __m128 r = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(c0, K3_SSE_SWIZZLE(v, 0, 0, 0, 0)));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, K3_SSE_SWIZZLE(v, 1, 1, 1, 1)));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, K3_SSE_SWIZZLE(v, 2, 2, 2, 2)));
+    r = _mm_add_ps(r, _mm_mul_ps(c3, K3_SSE_SWIZZLE(v, 3, 3, 3, 3)));
+    return r;
+}
+
+// Loads a 3 component point with w set to 1
+K3_TARGET_SSE41 static inline __m128 k3sse_LoadPoint(const float* s)
+{
+    return _mm_blend_ps(k3sse_LoadPartial(s, 3), _mm_set1_ps(1.0f), 0x8);
+}
+
+K3_TARGET_SSE41 static float* k3m4_MulSSE41(float* d, const float* s1, const float* s2)
+{
+    k3sse_MulRows(d, s1, _mm_loadu_ps(s2 + 0), _mm_loadu_ps(s2 + 4), _mm_loadu_ps(s2 + 8), _mm_loadu_ps(s2 + 12));
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3mv4_MulSSE41(float* d, const float* s1, const float* s2)
+{
+    __m128 m0 = _mm_loadu_ps(s1 + 0);
+    __m128 m1 = _mm_loadu_ps(s1 + 4);
+    __m128 m2 = _mm_loadu_ps(s1 + 8);
+    __m128 m3 = _mm_loadu_ps(s1 + 12);
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    _mm_storeu_ps(d, k3sse_MulColumns(m0, m1, m2, m3, _mm_loadu_ps(s2)));
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3vm4_MulSSE41(float* d, const float* s1, const float* s2)
+{
+    __m128 v = _mm_loadu_ps(s1);
+    __m128 r = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(K3_SSE_SWIZZLE(v, 0, 0, 0, 0), _mm_loadu_ps(s2 + 0)));
+    r = _mm_add_ps(r, _mm_mul_ps(K3_SSE_SWIZZLE(v, 1, 1, 1, 1), _mm_loadu_ps(s2 + 4)));
+    r = _mm_add_ps(r, _mm_mul_ps(K3_SSE_SWIZZLE(v, 2, 2, 2, 2), _mm_loadu_ps(s2 + 8)));
+    r = _mm_add_ps(r, _mm_mul_ps(K3_SSE_SWIZZLE(v, 3, 3, 3, 3), _mm_loadu_ps(s2 + 12)));
+    _mm_storeu_ps(d, r);
+    return d;
+}
+
+// Batched forms; a shared (stride 0) matrix is loaded once and kept in registers
+K3_TARGET_SSE41 static float* k3m4_MulArraySSE41(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    if (s2_stride == 0) {
+        __m128 b0 = _mm_loadu_ps(s2 + 0);
+        __m128 b1 = _mm_loadu_ps(s2 + 4);
+        __m128 b2 = _mm_loadu_ps(s2 + 8);
+        __m128 b3 = _mm_loadu_ps(s2 + 12);
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride) k3sse_MulRows(dp, s1, b0, b1, b2, b3);
+    } else {
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) k3m4_MulSSE41(dp, s1, s2);
+    }
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3mv4_MulArraySSE41(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    if (s1_stride == 0) {
+        __m128 m0 = _mm_loadu_ps(s1 + 0);
+        __m128 m1 = _mm_loadu_ps(s1 + 4);
+        __m128 m2 = _mm_loadu_ps(s1 + 8);
+        __m128 m3 = _mm_loadu_ps(s1 + 12);
+        _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+        for (i = 0; i < count; i++, dp += d_stride, s2 += s2_stride) {
+            _mm_storeu_ps(dp, k3sse_MulColumns(m0, m1, m2, m3, _mm_loadu_ps(s2)));
+        }
+    } else {
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) k3mv4_MulSSE41(dp, s1, s2);
+    }
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3mp3_MulArraySSE41(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    if (count == 0) return d;
+    __m128 m0 = _mm_loadu_ps(s1 + 0);
+    __m128 m1 = _mm_loadu_ps(s1 + 4);
+    __m128 m2 = _mm_loadu_ps(s1 + 8);
+    __m128 m3 = _mm_loadu_ps(s1 + 12);
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) {
+        if (i != 0 && s1_stride) {
+            m0 = _mm_loadu_ps(s1 + 0);
+            m1 = _mm_loadu_ps(s1 + 4);
+            m2 = _mm_loadu_ps(s1 + 8);
+            m3 = _mm_loadu_ps(s1 + 12);
+            _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+        }
+        k3sse_StorePartial(dp, k3sse_MulColumns(m0, m1, m2, m3, k3sse_LoadPoint(s2)), 3);
+    }
+    return d;
+}
+
+// ------------------------------------------------------------
+// Batched quaternion kernels
+// Four quaternions are transposed into x, y, z and w registers, so each lane runs the scalar
+// reference arithmetic for one quaternion; leftovers go through the scalar reference
+
+K3_TARGET_SSE41 static inline void k3sse_LoadQuats(const float* s, uint32_t stride, __m128* x, __m128* y, __m128* z, __m128* w)
+{
+    __m128 q0 = _mm_loadu_ps(s);
+    __m128 q1 = _mm_loadu_ps(s + stride);
+    __m128 q2 = _mm_loadu_ps(s + 2 * stride);
+    __m128 q3 = _mm_loadu_ps(s + 3 * stride);
+    _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+    *x = q0;
+    *y = q1;
+    *z = q2;
+    *w = q3;
+}
+
+K3_TARGET_SSE41 static inline void k3sse_StoreQuats(float* d, uint32_t stride, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(d, x);
+    _mm_storeu_ps(d + stride, y);
+    _mm_storeu_ps(d + 2 * stride, z);
+    _mm_storeu_ps(d + 3 * stride, w);
+}
+
+K3_TARGET_SSE41 static inline __m128 k3sse_Dot4(__m128 x1, __m128 y1, __m128 z1, __m128 w1, __m128 x2, __m128 y2, __m128 z2, __m128 w2)
+{
+    __m128 dot = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(x1, x2));
+    dot = _mm_add_ps(dot, _mm_mul_ps(y1, y2));
+    dot = _mm_add_ps(dot, _mm_mul_ps(z1, z2));
+    dot = _mm_add_ps(dot, _mm_mul_ps(w1, w2));
+    return dot;
+}
+
+// Same steps as k3v_Normalize: f = 1 / sqrt(dot), or 0 for a zero length
+K3_TARGET_SSE41 static inline void k3sse_Normalize4(__m128* x, __m128* y, __m128* z, __m128* w)
+{
+    __m128 f = _mm_sqrt_ps(k3sse_Dot4(*x, *y, *z, *w, *x, *y, *z, *w));
+    f = _mm_andnot_ps(_mm_cmpeq_ps(f, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), f));
+    *x = _mm_mul_ps(f, *x);
+    *y = _mm_mul_ps(f, *y);
+    *z = _mm_mul_ps(f, *z);
+    *w = _mm_mul_ps(f, *w);
+}
+
+K3_TARGET_SSE41 static float* k3v4_QuatNlerpBatchSSE41(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    uint32_t i;
+    float* dp = d;
+    __m128 w1 = _mm_set1_ps(1.0f - t);
+    __m128 pos_t = _mm_set1_ps(t);
+    __m128 neg_t = _mm_set1_ps(-t);
+    __m128 x1, y1, z1, q1, x2, y2, z2, q2, w2;
+    for (i = 0; i + 4 <= count; i += 4, dp += 4 * d_stride, s1 += 4 * s1_stride, s2 += 4 * s2_stride) {
+        k3sse_LoadQuats(s1, s1_stride, &x1, &y1, &z1, &q1);
+        k3sse_LoadQuats(s2, s2_stride, &x2, &y2, &z2, &q2);
+        w2 = _mm_blendv_ps(pos_t, neg_t, _mm_cmplt_ps(k3sse_Dot4(x1, y1, z1, q1, x2, y2, z2, q2), _mm_setzero_ps()));
+        x1 = _mm_add_ps(_mm_mul_ps(w1, x1), _mm_mul_ps(w2, x2));
+        y1 = _mm_add_ps(_mm_mul_ps(w1, y1), _mm_mul_ps(w2, y2));
+        z1 = _mm_add_ps(_mm_mul_ps(w1, z1), _mm_mul_ps(w2, z2));
+        q1 = _mm_add_ps(_mm_mul_ps(w1, q1), _mm_mul_ps(w2, q2));
+        k3sse_Normalize4(&x1, &y1, &z1, &q1);
+        k3sse_StoreQuats(dp, d_stride, x1, y1, z1, q1);
+    }
+    k3v4_QuatNlerpBatchScalar(count - i, dp, d_stride, s1, s1_stride, s2, s2_stride, t);
+    return d;
+}
+
+// The weights come from the shared scalar k3quat_SlerpWeights per lane; the blend itself is vectorized
+K3_TARGET_SSE41 static float* k3v4_QuatSlerpBatchSSE41(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    uint32_t i, lane;
+    float* dp = d;
+    float dot[4], w1[4], w2[4], linear[4];
+    __m128 x1, y1, z1, q1, x2, y2, z2, q2, a, b, nx, ny, nz, nq, mask;
+    for (i = 0; i + 4 <= count; i += 4, dp += 4 * d_stride, s1 += 4 * s1_stride, s2 += 4 * s2_stride) {
+        k3sse_LoadQuats(s1, s1_stride, &x1, &y1, &z1, &q1);
+        k3sse_LoadQuats(s2, s2_stride, &x2, &y2, &z2, &q2);
+        _mm_storeu_ps(dot, k3sse_Dot4(x1, y1, z1, q1, x2, y2, z2, q2));
+        for (lane = 0; lane < 4; lane++) {
+            linear[lane] = k3quat_SlerpWeights(dot[lane], t, w1 + lane, w2 + lane) ? 1.0f : 0.0f;
+        }
+        a = _mm_loadu_ps(w1);
+        b = _mm_loadu_ps(w2);
+        x1 = _mm_add_ps(_mm_mul_ps(a, x1), _mm_mul_ps(b, x2));
+        y1 = _mm_add_ps(_mm_mul_ps(a, y1), _mm_mul_ps(b, y2));
+        z1 = _mm_add_ps(_mm_mul_ps(a, z1), _mm_mul_ps(b, z2));
+        q1 = _mm_add_ps(_mm_mul_ps(a, q1), _mm_mul_ps(b, q2));
+        mask = _mm_cmpneq_ps(_mm_loadu_ps(linear), _mm_setzero_ps());
+        if (_mm_movemask_ps(mask)) {
+            nx = x1;
+            ny = y1;
+            nz = z1;
+            nq = q1;
+            k3sse_Normalize4(&nx, &ny, &nz, &nq);
+            x1 = _mm_blendv_ps(x1, nx, mask);
+            y1 = _mm_blendv_ps(y1, ny, mask);
+            z1 = _mm_blendv_ps(z1, nz, mask);
+            q1 = _mm_blendv_ps(q1, nq, mask);
+        }
+        k3sse_StoreQuats(dp, d_stride, x1, y1, z1, q1);
+    }
+    k3v4_QuatSlerpBatchScalar(count - i, dp, d_stride, s1, s1_stride, s2, s2_stride, t);
+    return d;
+}
+
+// Rotation matrix entries in the same operation order as k3m_QuatToMat; m is row major 3x3
+K3_TARGET_SSE41 static inline void k3sse_QuatToRows(__m128 x, __m128 y, __m128 z, __m128 w, __m128* m)
+{
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z), ww = _mm_mul_ps(w, w);
+    __m128 x2 = _mm_mul_ps(two, x), y2 = _mm_mul_ps(two, y), w2 = _mm_mul_ps(two, w);
+    m[0] = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(ww, xx), yy), zz);
+    m[1] = _mm_sub_ps(_mm_mul_ps(x2, y), _mm_mul_ps(w2, z));
+    m[2] = _mm_add_ps(_mm_mul_ps(x2, z), _mm_mul_ps(w2, y));
+    m[3] = _mm_add_ps(_mm_mul_ps(x2, y), _mm_mul_ps(w2, z));
+    m[4] = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(ww, xx), yy), zz);
+    m[5] = _mm_sub_ps(_mm_mul_ps(y2, z), _mm_mul_ps(w2, x));
+    m[6] = _mm_sub_ps(_mm_mul_ps(x2, z), _mm_mul_ps(w2, y));
+    m[7] = _mm_add_ps(_mm_mul_ps(y2, z), _mm_mul_ps(w2, x));
+    m[8] = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(ww, xx), yy), zz);
+}
+
+// Writes the 3 rotation rows (plus column 3 from c3 for 4x4) of 4 matrices, then the constant last row
+K3_TARGET_SSE41 static inline void k3sse_StoreMatRows(float* d, uint32_t d_stride, uint32_t cols, const __m128* m, __m128 c0, __m128 c1, __m128 c2)
+{
+    __m128 rows[3][4];
+    uint32_t r, j;
+    __m128 last = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+    rows[0][0] = m[0]; rows[0][1] = m[1]; rows[0][2] = m[2]; rows[0][3] = c0;
+    rows[1][0] = m[3]; rows[1][1] = m[4]; rows[1][2] = m[5]; rows[1][3] = c1;
+    rows[2][0] = m[6]; rows[2][1] = m[7]; rows[2][2] = m[8]; rows[2][3] = c2;
+    for (r = 0; r < 3; r++) {
+        _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+        for (j = 0; j < 4; j++) {
+            if (cols == 3) k3sse_StorePartial(d + j * d_stride + 3 * r, rows[r][j], 3);
+            else _mm_storeu_ps(d + j * d_stride + 4 * r, rows[r][j]);
+        }
+    }
+    if (cols != 3) {
+        for (j = 0; j < 4; j++) _mm_storeu_ps(d + j * d_stride + 12, last);
+    }
+}
+
+K3_TARGET_SSE41 static float* k3m_QuatToMatBatchSSE41(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    __m128 x, y, z, w, m[9];
+    __m128 zero = _mm_setzero_ps();
+    if (cols != 3 && cols != 4) return k3m_QuatToMatBatchScalar(count, cols, d, d_stride, s, s_stride);
+    for (i = 0; i + 4 <= count; i += 4, dp += 4 * d_stride, s += 4 * s_stride) {
+        k3sse_LoadQuats(s, s_stride, &x, &y, &z, &w);
+        k3sse_QuatToRows(x, y, z, w, m);
+        k3sse_StoreMatRows(dp, d_stride, cols, m, zero, zero, zero);
+    }
+    k3m_QuatToMatBatchScalar(count - i, cols, dp, d_stride, s, s_stride);
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3v4_QuatToDualQuatBatchSSE41(uint32_t count, float* d, uint32_t d_stride, const float* quat, uint32_t quat_stride, const float* xlat, uint32_t xlat_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    __m128 x, y, z, w, tx, ty, tz, tw, dx, dy, dz, dw;
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 neg_half = _mm_set1_ps(-0.5f);
+    for (i = 0; i + 4 <= count; i += 4, dp += 4 * d_stride, quat += 4 * quat_stride, xlat += 4 * xlat_stride) {
+        k3sse_LoadQuats(quat, quat_stride, &x, &y, &z, &w);
+        tx = k3sse_LoadPartial(xlat, 3);
+        ty = k3sse_LoadPartial(xlat + xlat_stride, 3);
+        tz = k3sse_LoadPartial(xlat + 2 * xlat_stride, 3);
+        tw = k3sse_LoadPartial(xlat + 3 * xlat_stride, 3);
+        _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+        dx = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(tx, w), _mm_mul_ps(ty, z)), _mm_mul_ps(tz, y)));
+        dy = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ty, w), _mm_mul_ps(tz, x)), _mm_mul_ps(tx, z)));
+        dz = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(tz, w), _mm_mul_ps(tx, y)), _mm_mul_ps(ty, x)));
+        dw = _mm_mul_ps(neg_half, _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, x), _mm_mul_ps(ty, y)), _mm_mul_ps(tz, z)));
+        k3sse_StoreQuats(dp, d_stride, x, y, z, w);
+        k3sse_StoreQuats(dp + 4, d_stride, dx, dy, dz, dw);
+    }
+    k3v4_QuatToDualQuatBatchScalar(count - i, dp, d_stride, quat, quat_stride, xlat, xlat_stride);
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3m4_DualQuatToMatBatchSSE41(uint32_t count, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    __m128 x, y, z, w, dx, dy, dz, dw, tx, ty, tz, m[9];
+    __m128 two = _mm_set1_ps(2.0f);
+    for (i = 0; i + 4 <= count; i += 4, dp += 4 * d_stride, s += 4 * s_stride) {
+        k3sse_LoadQuats(s, s_stride, &x, &y, &z, &w);
+        k3sse_LoadQuats(s + 4, s_stride, &dx, &dy, &dz, &dw);
+        tx = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(dx, w), _mm_mul_ps(dw, x)), _mm_mul_ps(dz, y)), _mm_mul_ps(dy, z)));
+        ty = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(dy, w), _mm_mul_ps(dw, y)), _mm_mul_ps(dx, z)), _mm_mul_ps(dz, x)));
+        tz = _mm_mul_ps(two, _mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(dz, w), _mm_mul_ps(dw, z)), _mm_mul_ps(dy, x)), _mm_mul_ps(dx, y)));
+        k3sse_QuatToRows(x, y, z, w, m);
+        k3sse_StoreMatRows(dp, d_stride, 4, m, tx, ty, tz);
+    }
+    k3m4_DualQuatToMatBatchScalar(count - i, dp, d_stride, s, s_stride);
+    return d;
+}
+
+// ------------------------------------------------------------
+// Batched AABB overlap
+// b holds s1 broadcast as min x, y, z, then max x, y, z; tests boxes i to i + 3 of s2 and returns their hit bits
+
+K3_TARGET_SSE41 static inline uint32_t k3sse_CheckCollision4(const __m128* b, const k3AABBArray* s2, uint32_t i, uint32_t* axis_flags)
+{
+    uint32_t axis;
+    __m128 hit = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    __m128 mn[3], mx[3];
+    for (axis = 0; axis < 3; axis++) {
+        mn[axis] = _mm_loadu_ps(s2->min[axis] + i);
+        mx[axis] = _mm_loadu_ps(s2->max[axis] + i);
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(b[3 + axis], mn[axis]), _mm_cmpge_ps(mx[axis], b[axis])));
+    }
+    if (axis_flags) {
+        __m128i f = _mm_setzero_si128();
+        for (axis = 0; axis < 3; axis++) {
+            f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(_mm_cmpge_ps(mx[axis], b[3 + axis])), _mm_set1_epi32(K3_AXIS_DIR_FLAG_POS_X << axis)));
+            f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(_mm_cmple_ps(mn[axis], b[axis])), _mm_set1_epi32(K3_AXIS_DIR_FLAG_NEG_X << axis)));
+        }
+        f = _mm_or_si128(f, _mm_and_si128(_mm_cmpeq_epi32(f, _mm_setzero_si128()), _mm_set1_epi32(K3_AXIS_DIR_FLAG_ALL)));
+        _mm_storeu_si128((__m128i*)(axis_flags + i), _mm_and_si128(f, _mm_castps_si128(hit)));
+    }
+    return (uint32_t)_mm_movemask_ps(hit);
+}
+
+K3_TARGET_SSE41 static void k3bvh_CheckCollisionBatchSSE41(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags)
+{
+    uint32_t i, axis, hits;
+    __m128 b[6];
+    for (axis = 0; axis < 3; axis++) {
+        b[axis] = _mm_set1_ps(s1->min[axis]);
+        b[3 + axis] = _mm_set1_ps(s1->max[axis]);
+    }
+    // 8 boxes per step keeps the mask words filled a byte at a time
+    for (i = 0; i + 8 <= count; i += 8) {
+        hits = k3sse_CheckCollision4(b, s2, i, axis_flags);
+        hits |= k3sse_CheckCollision4(b, s2, i + 4, axis_flags) << 4;
+        if ((i & 0x1f) == 0) hit_mask[i >> 5] = 0;
+        hit_mask[i >> 5] |= hits << (i & 0x1f);
+    }
+    for (; i < count; i++) k3bvh_CheckCollisionLane(s1, s2, i, hit_mask, axis_flags);
+}
+
+// ------------------------------------------------------------
+// Frustum classification
+// Boxes are transposed to x, y and z registers of mins and maxes; a plane's normal signs are the same
+// for every lane, so picking the far and near corners is a register choice rather than a blend
+
+K3_TARGET_SSE41 static inline void k3sse_LoadAABBs(const k3AABB* s, __m128* mn, __m128* mx)
+{
+    __m128 r0 = k3sse_LoadPartial(s[0].min, 3), r1 = k3sse_LoadPartial(s[1].min, 3);
+    __m128 r2 = k3sse_LoadPartial(s[2].min, 3), r3 = k3sse_LoadPartial(s[3].min, 3);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    mn[0] = r0; mn[1] = r1; mn[2] = r2;
+    r0 = k3sse_LoadPartial(s[0].max, 3); r1 = k3sse_LoadPartial(s[1].max, 3);
+    r2 = k3sse_LoadPartial(s[2].max, 3); r3 = k3sse_LoadPartial(s[3].max, 3);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    mx[0] = r0; mx[1] = r1; mx[2] = r2;
+}
+
+K3_TARGET_SSE41 static void k3bvh_ClassifyFrustumBatchSSE41(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count)
+{
+    uint32_t i, p, axis;
+    __m128 mn[3], mx[3], far_pt[3], near_pt[3], outside, intersect, dist;
+    __m128 zero = _mm_setzero_ps();
+    __m128i inside = _mm_set1_epi32(K3_FRUSTUM_INSIDE);
+    __m128i one = _mm_set1_epi32(K3_FRUSTUM_INSIDE - K3_FRUSTUM_INTERSECT);
+    for (i = 0; i + 4 <= count; i += 4) {
+        k3sse_LoadAABBs(s + i, mn, mx);
+        outside = zero;
+        intersect = zero;
+        for (p = 0; p < 6; p++) {
+            const float* plane = planes + 4 * p;
+            for (axis = 0; axis < 3; axis++) {
+                far_pt[axis] = (plane[axis] >= 0.0f) ? mx[axis] : mn[axis];
+                near_pt[axis] = (plane[axis] >= 0.0f) ? mn[axis] : mx[axis];
+            }
+            dist = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), far_pt[0]), _mm_mul_ps(_mm_set1_ps(plane[1]), far_pt[1]));
+            dist = _mm_add_ps(_mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane[2]), far_pt[2])), _mm_set1_ps(plane[3]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+            if (_mm_movemask_ps(outside) == 0xf) break;
+            dist = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), near_pt[0]), _mm_mul_ps(_mm_set1_ps(plane[1]), near_pt[1]));
+            dist = _mm_add_ps(_mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(plane[2]), near_pt[2])), _mm_set1_ps(plane[3]));
+            intersect = _mm_or_ps(intersect, _mm_cmplt_ps(dist, zero));
+        }
+        __m128i r = _mm_sub_epi32(inside, _mm_and_si128(_mm_castps_si128(intersect), one));
+        _mm_storeu_si128((__m128i*)(d + i), _mm_andnot_si128(_mm_castps_si128(outside), r));
+    }
+    for (; i < count; i++) d[i] = k3bvh_ClassifyFrustumLane(planes, s + i);
+}
+
+// ------------------------------------------------------------
+// Fast transcendental approximations, same steps as k3fast_SinCos, k3fast_Atan2 and k3fast_Rsqrt
+
+K3_TARGET_SSE41 static inline void k3sse_FastSinCos(__m128 x, __m128* sin_x, __m128* cos_x)
+{
+    __m128 k = _mm_floor_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(K3_FAST_2_OVER_PI)), _mm_set1_ps(0.5f)));
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(K3_FAST_PIO2_1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(K3_FAST_PIO2_2)));
+    r = _mm_sub_ps(r, _mm_mul_ps(k, _mm_set1_ps(K3_FAST_PIO2_3)));
+    __m128 z = _mm_mul_ps(r, r);
+    __m128 sin_r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(K3_FAST_SIN_C3), z), _mm_set1_ps(K3_FAST_SIN_C2));
+    sin_r = _mm_add_ps(_mm_mul_ps(sin_r, z), _mm_set1_ps(K3_FAST_SIN_C1));
+    sin_r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sin_r, z), r), r);
+    __m128 cos_r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(K3_FAST_COS_C3), z), _mm_set1_ps(K3_FAST_COS_C2));
+    cos_r = _mm_add_ps(_mm_mul_ps(cos_r, z), _mm_set1_ps(K3_FAST_COS_C1));
+    cos_r = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cos_r, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    cos_r = _mm_add_ps(cos_r, _mm_set1_ps(1.0f));
+    // odd quadrants swap sin and cos; bit 1 of the quadrant, moved to the sign bit, negates
+    __m128i q = _mm_cvttps_epi32(k);
+    __m128i one = _mm_set1_epi32(1);
+    __m128i two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    __m128 s = _mm_blendv_ps(sin_r, cos_r, swap);
+    __m128 c = _mm_blendv_ps(cos_r, sin_r, swap);
+    *sin_x = _mm_xor_ps(s, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30)));
+    *cos_x = _mm_xor_ps(c, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30)));
+}
+
+K3_TARGET_SSE41 static void k3v_FastSinCosSSE41(uint32_t vec_length, float* sin_d, float* cos_d, const float* s)
+{
+    uint32_t i;
+    __m128 sin_x, cos_x;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        k3sse_FastSinCos(_mm_loadu_ps(s + i), &sin_x, &cos_x);
+        _mm_storeu_ps(sin_d + i, sin_x);
+        _mm_storeu_ps(cos_d + i, cos_x);
+    }
+    for (; i < vec_length; i++) k3fast_SinCos(s[i], sin_d + i, cos_d + i);
+}
+
+K3_TARGET_SSE41 static inline __m128 k3sse_FastAtan2(__m128 y, __m128 x)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(sign, x);
+    __m128 ay = _mm_andnot_ps(sign, y);
+    __m128 swap = _mm_cmpgt_ps(ay, ax);
+    __m128 hi = _mm_blendv_ps(ax, ay, swap);
+    __m128 lo = _mm_blendv_ps(ay, ax, swap);
+    __m128 a = _mm_andnot_ps(_mm_cmpeq_ps(hi, zero), _mm_div_ps(lo, hi));
+    __m128 shift = _mm_cmpgt_ps(a, _mm_set1_ps(K3_FAST_TAN_PI_8));
+    __m128 t = _mm_blendv_ps(a, _mm_div_ps(_mm_sub_ps(a, one), _mm_add_ps(a, one)), shift);
+    __m128 z = _mm_mul_ps(t, t);
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(K3_FAST_ATAN_C4), z), _mm_set1_ps(K3_FAST_ATAN_C3));
+    r = _mm_add_ps(_mm_mul_ps(r, z), _mm_set1_ps(K3_FAST_ATAN_C2));
+    r = _mm_add_ps(_mm_mul_ps(r, z), _mm_set1_ps(K3_FAST_ATAN_C1));
+    r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, z), t), t);
+    r = _mm_blendv_ps(r, _mm_add_ps(r, _mm_set1_ps(K3_FAST_PIO4)), shift);
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(K3_FAST_PIO2), r), swap);
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(K3_FAST_PI), r), x);
+    return _mm_or_ps(r, _mm_and_ps(y, sign));
+}
+
+K3_TARGET_SSE41 static float* k3v_FastAtan2SSE41(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    uint32_t i;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        _mm_storeu_ps(d + i, k3sse_FastAtan2(_mm_loadu_ps(s1 + i), _mm_loadu_ps(s2 + i)));
+    }
+    for (; i < vec_length; i++) d[i] = k3fast_Atan2(s1[i], s2[i]);
+    return d;
+}
+
+K3_TARGET_SSE41 static float* k3v_FastRsqrtSSE41(uint32_t vec_length, float* d, const float* s)
+{
+    uint32_t i;
+    __m128 x, y, half_x;
+    __m128 three_halves = _mm_set1_ps(1.5f);
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        x = _mm_loadu_ps(s + i);
+        half_x = _mm_mul_ps(_mm_set1_ps(0.5f), x);
+        y = _mm_castsi128_ps(_mm_sub_epi32(_mm_set1_epi32(K3_FAST_RSQRT_MAGIC), _mm_srli_epi32(_mm_castps_si128(x), 1)));
+        y = _mm_mul_ps(y, _mm_sub_ps(three_halves, _mm_mul_ps(_mm_mul_ps(half_x, y), y)));
+        y = _mm_mul_ps(y, _mm_sub_ps(three_halves, _mm_mul_ps(_mm_mul_ps(half_x, y), y)));
+        _mm_storeu_ps(d + i, y);
+    }
+    for (; i < vec_length; i++) d[i] = k3fast_Rsqrt(s[i]);
+    return d;
+}
+
+static const k3mathFuncs k3math_sse41_funcs = {
+    k3simdLevel::SSE41,
+    k3v_NegateSSE41,
+    k3v_AddSSE41,
+    k3v_SubSSE41,
+    k3v_MulSSE41,
+    k3v_DivSSE41,
+    k3v_CrossSSE41,
+    k3v_EqualsSSE41,
+    k3v_DotSSE41,
+    k3v_MinSSE41,
+    k3v_MaxSSE41,
+    k3v_NormalizeSSE41,
+    k3sv_AddSSE41,
+    k3sv_SubSSE41,
+    k3sv_MulSSE41,
+    k3sv_DivSSE41,
+    k3m4_TransposeSSE41,
+    k3m4_InverseSSE41,
+    k3m4_InverseTransformSSE41,
+    k3m4_MulSSE41,
+    k3mv4_MulSSE41,
+    k3vm4_MulSSE41,
+    k3m4_MulArraySSE41,
+    k3mv4_MulArraySSE41,
+    k3mp3_MulArraySSE41,
+    k3v4_QuatNlerpBatchSSE41,
+    k3v4_QuatSlerpBatchSSE41,
+    k3m_QuatToMatBatchSSE41,
+    k3v4_QuatToDualQuatBatchSSE41,
+    k3m4_DualQuatToMatBatchSSE41,
+    k3bvh_CheckCollisionBatchSSE41,
+    k3bvh_ClassifyFrustumBatchSSE41,
+    k3v_FastSinCosSSE41,
+    k3v_FastAtan2SSE41,
+    k3v_FastRsqrtSSE41
+};
+
+// ------------------------------------------------------------
+// AVX2 kernels
+// 8 lanes for the long vector loops; remainders and the 4 wide work reuse the SSE4.1 kernels
+
+#define K3_AVX_VV_OP(name, op, tail) \
+K3_TARGET_AVX2 static float* name(uint32_t vec_length, float* d, const float* s1, const float* s2) \
+{ \
+    uint32_t i; \
+    for (i = 0; i + 8 <= vec_length; i += 8) { \
+        _mm256_storeu_ps(d + i, op(_mm256_loadu_ps(s1 + i), _mm256_loadu_ps(s2 + i))); \
+    } \
+    if (i < vec_length) tail(vec_length - i, d + i, s1 + i, s2 + i); \
+    return d; \
+}
+
+#define K3_AVX_SV_OP(name, op, tail) \
+K3_TARGET_AVX2 static float* name(uint32_t vec_length, float* d, const float s1, const float* s2) \
+{ \
+    uint32_t i; \
+    __m256 s = _mm256_set1_ps(s1); \
+    for (i = 0; i + 8 <= vec_length; i += 8) { \
+        _mm256_storeu_ps(d + i, op(s, _mm256_loadu_ps(s2 + i))); \
+    } \
+    if (i < vec_length) tail(vec_length - i, d + i, s1, s2 + i); \
+    return d; \
+}
+
+K3_AVX_VV_OP(k3v_AddAVX2, _mm256_add_ps, k3v_AddSSE41)
+K3_AVX_VV_OP(k3v_SubAVX2, _mm256_sub_ps, k3v_SubSSE41)
+K3_AVX_VV_OP(k3v_MulAVX2, _mm256_mul_ps, k3v_MulSSE41)
+K3_AVX_VV_OP(k3v_DivAVX2, _mm256_div_ps, k3v_DivSSE41)
+K3_AVX_VV_OP(k3v_MinAVX2, _mm256_min_ps, k3v_MinSSE41)
+K3_AVX_VV_OP(k3v_MaxAVX2, _mm256_max_ps, k3v_MaxSSE41)
+K3_AVX_SV_OP(k3sv_AddAVX2, _mm256_add_ps, k3sv_AddSSE41)
+K3_AVX_SV_OP(k3sv_SubAVX2, _mm256_sub_ps, k3sv_SubSSE41)
+K3_AVX_SV_OP(k3sv_MulAVX2, _mm256_mul_ps, k3sv_MulSSE41)
+K3_AVX_SV_OP(k3sv_DivAVX2, _mm256_div_ps, k3sv_DivSSE41)
+
+K3_TARGET_AVX2 static float* k3v_NegateAVX2(uint32_t vec_length, float* d)
+{
+    uint32_t i;
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    for (i = 0; i + 8 <= vec_length; i += 8) {
+        _mm256_storeu_ps(d + i, _mm256_xor_ps(_mm256_loadu_ps(d + i), sign));
+    }
+    if (i < vec_length) k3v_NegateSSE41(vec_length - i, d + i);
+    return d;
+}
+
+K3_TARGET_AVX2 static bool k3v_EqualsAVX2(uint32_t vec_length, const float* s1, const float* s2)
+{
+    uint32_t i;
+    for (i = 0; i + 8 <= vec_length; i += 8) {
+        if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(s1 + i), _mm256_loadu_ps(s2 + i), _CMP_NEQ_UQ))) return false;
+    }
+    return (i < vec_length) ? k3v_EqualsSSE41(vec_length - i, s1 + i, s2 + i) : true;
+}
+
+K3_TARGET_AVX2 static float k3v_DotAVX2(uint32_t vec_length, const float* s1, const float* s2)
+{
+    uint32_t i, j;
+    float lanes[8];
+    float result = 0.0f;
+    for (i = 0; i + 8 <= vec_length; i += 8) {
+        _mm256_storeu_ps(lanes, _mm256_mul_ps(_mm256_loadu_ps(s1 + i), _mm256_loadu_ps(s2 + i)));
+        for (j = 0; j < 8; j++) result += lanes[j];
+    }
+    for (; i + 4 <= vec_length; i += 4) {
+        result = k3sse_AccumulateLanes(result, _mm_mul_ps(_mm_loadu_ps(s1 + i), _mm_loadu_ps(s2 + i)), 4);
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        result = k3sse_AccumulateLanes(result, _mm_mul_ps(k3sse_LoadPartial(s1 + i, n), k3sse_LoadPartial(s2 + i, n)), n);
+    }
+    return result;
+}
+
+K3_TARGET_AVX2 static float* k3v_NormalizeAVX2(uint32_t l, float* d)
+{
+    float f = sqrtf(k3v_DotAVX2(l, d, d));
+    f = (f == 0.0f) ? 0.0f : (1.0f / f);
+    return k3sv_MulAVX2(l, d, f, d);
+}
+
+// Two output rows per iteration; the low half holds row i, the high half row i + 1
+K3_TARGET_AVX2 static inline void k3avx_MulRows(float* d, const float* s1, __m256 b0, __m256 b1, __m256 b2, __m256 b3)
+{
+    __m256 zero = _mm256_setzero_ps();
+    // read all of s1 before writing, since d may alias it
+    __m256 a01 = _mm256_loadu_ps(s1 + 0);
+    __m256 a23 = _mm256_loadu_ps(s1 + 8);
+    __m256 r01, r23;
+
+    r01 = _mm256_add_ps(zero, _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0x55), b1));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0xaa), b2));
+    r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_permute_ps(a01, 0xff), b3));
+    r23 = _mm256_add_ps(zero, _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0x55), b1));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0xaa), b2));
+    r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_permute_ps(a23, 0xff), b3));
+    _mm256_storeu_ps(d + 0, r01);
+    _mm256_storeu_ps(d + 8, r23);
+}
+
+K3_TARGET_AVX2 static float* k3m4_MulAVX2(float* d, const float* s1, const float* s2)
+{
+    k3avx_MulRows(d, s1,
+        _mm256_broadcast_ps((const __m128*)(s2 + 0)),
+        _mm256_broadcast_ps((const __m128*)(s2 + 4)),
+        _mm256_broadcast_ps((const __m128*)(s2 + 8)),
+        _mm256_broadcast_ps((const __m128*)(s2 + 12)));
+    return d;
+}
+
+K3_TARGET_AVX2 static float* k3m4_MulArrayAVX2(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    if (s2_stride == 0) {
+        __m256 b0 = _mm256_broadcast_ps((const __m128*)(s2 + 0));
+        __m256 b1 = _mm256_broadcast_ps((const __m128*)(s2 + 4));
+        __m256 b2 = _mm256_broadcast_ps((const __m128*)(s2 + 8));
+        __m256 b3 = _mm256_broadcast_ps((const __m128*)(s2 + 12));
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride) k3avx_MulRows(dp, s1, b0, b1, b2, b3);
+    } else {
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) k3m4_MulAVX2(dp, s1, s2);
+    }
+    return d;
+}
+
+// Shared matrix times two vectors per iteration, one in each 128 bit half; the columns are
+// duplicated into both halves and each vector component is broadcast within its own half
+K3_TARGET_AVX2 static inline __m256 k3avx_MulColumns(__m256 c0, __m256 c1, __m256 c2, __m256 c3, __m256 v)
+{
+    __m256 r = _mm256_add_ps(_mm256_setzero_ps(), _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c2, _mm256_permute_ps(v, 0xaa)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xff)));
+    return r;
+}
+
+K3_TARGET_AVX2 static inline __m256 k3avx_Pair(__m128 lo, __m128 hi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+K3_TARGET_AVX2 static float* k3mv4_MulArrayAVX2(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    if (s1_stride != 0) return k3mv4_MulArraySSE41(count, d, d_stride, s1, s1_stride, s2, s2_stride);
+
+    uint32_t i;
+    float* dp = d;
+    __m128 m0 = _mm_loadu_ps(s1 + 0);
+    __m128 m1 = _mm_loadu_ps(s1 + 4);
+    __m128 m2 = _mm_loadu_ps(s1 + 8);
+    __m128 m3 = _mm_loadu_ps(s1 + 12);
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    __m256 c0 = k3avx_Pair(m0, m0);
+    __m256 c1 = k3avx_Pair(m1, m1);
+    __m256 c2 = k3avx_Pair(m2, m2);
+    __m256 c3 = k3avx_Pair(m3, m3);
+    for (i = 0; i + 2 <= count; i += 2, dp += 2 * d_stride, s2 += 2 * s2_stride) {
+        __m256 r = k3avx_MulColumns(c0, c1, c2, c3, k3avx_Pair(_mm_loadu_ps(s2), _mm_loadu_ps(s2 + s2_stride)));
+        _mm_storeu_ps(dp, _mm256_castps256_ps128(r));
+        _mm_storeu_ps(dp + d_stride, _mm256_extractf128_ps(r, 1));
+    }
+    if (i < count) _mm_storeu_ps(dp, k3sse_MulColumns(m0, m1, m2, m3, _mm_loadu_ps(s2)));
+    return d;
+}
+
+K3_TARGET_AVX2 static float* k3mp3_MulArrayAVX2(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    if (s1_stride != 0) return k3mp3_MulArraySSE41(count, d, d_stride, s1, s1_stride, s2, s2_stride);
+
+    uint32_t i;
+    float* dp = d;
+    __m128 m0 = _mm_loadu_ps(s1 + 0);
+    __m128 m1 = _mm_loadu_ps(s1 + 4);
+    __m128 m2 = _mm_loadu_ps(s1 + 8);
+    __m128 m3 = _mm_loadu_ps(s1 + 12);
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    __m256 c0 = k3avx_Pair(m0, m0);
+    __m256 c1 = k3avx_Pair(m1, m1);
+    __m256 c2 = k3avx_Pair(m2, m2);
+    __m256 c3 = k3avx_Pair(m3, m3);
+    for (i = 0; i + 2 <= count; i += 2, dp += 2 * d_stride, s2 += 2 * s2_stride) {
+        __m256 r = k3avx_MulColumns(c0, c1, c2, c3, k3avx_Pair(k3sse_LoadPoint(s2), k3sse_LoadPoint(s2 + s2_stride)));
+        k3sse_StorePartial(dp, _mm256_castps256_ps128(r), 3);
+        k3sse_StorePartial(dp + d_stride, _mm256_extractf128_ps(r, 1), 3);
+    }
+    if (i < count) k3sse_StorePartial(dp, k3sse_MulColumns(m0, m1, m2, m3, k3sse_LoadPoint(s2)), 3);
+    return d;
+}
+
+// Two sse transposes of 4 quaternions each, paired into 8 lanes
+K3_TARGET_AVX2 static inline void k3avx_LoadQuats(const float* s, uint32_t stride, __m256* x, __m256* y, __m256* z, __m256* w)
+{
+    __m128 x0, y0, z0, w0, x1, y1, z1, w1;
+    k3sse_LoadQuats(s, stride, &x0, &y0, &z0, &w0);
+    k3sse_LoadQuats(s + 4 * stride, stride, &x1, &y1, &z1, &w1);
+    *x = k3avx_Pair(x0, x1);
+    *y = k3avx_Pair(y0, y1);
+    *z = k3avx_Pair(z0, z1);
+    *w = k3avx_Pair(w0, w1);
+}
+
+K3_TARGET_AVX2 static inline void k3avx_StoreQuats(float* d, uint32_t stride, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+    k3sse_StoreQuats(d, stride, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+    k3sse_StoreQuats(d + 4 * stride, stride, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+}
+
+K3_TARGET_AVX2 static inline __m256 k3avx_Dot4(__m256 x1, __m256 y1, __m256 z1, __m256 w1, __m256 x2, __m256 y2, __m256 z2, __m256 w2)
+{
+    __m256 dot = _mm256_add_ps(_mm256_setzero_ps(), _mm256_mul_ps(x1, x2));
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(y1, y2));
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(z1, z2));
+    dot = _mm256_add_ps(dot, _mm256_mul_ps(w1, w2));
+    return dot;
+}
+
+K3_TARGET_AVX2 static float* k3v4_QuatNlerpBatchAVX2(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride, float t)
+{
+    uint32_t i;
+    float* dp = d;
+    __m256 zero = _mm256_setzero_ps();
+    __m256 w1 = _mm256_set1_ps(1.0f - t);
+    __m256 pos_t = _mm256_set1_ps(t);
+    __m256 neg_t = _mm256_set1_ps(-t);
+    __m256 x1, y1, z1, q1, x2, y2, z2, q2, w2, f;
+    for (i = 0; i + 8 <= count; i += 8, dp += 8 * d_stride, s1 += 8 * s1_stride, s2 += 8 * s2_stride) {
+        k3avx_LoadQuats(s1, s1_stride, &x1, &y1, &z1, &q1);
+        k3avx_LoadQuats(s2, s2_stride, &x2, &y2, &z2, &q2);
+        w2 = _mm256_blendv_ps(pos_t, neg_t, _mm256_cmp_ps(k3avx_Dot4(x1, y1, z1, q1, x2, y2, z2, q2), zero, _CMP_LT_OQ));
+        x1 = _mm256_add_ps(_mm256_mul_ps(w1, x1), _mm256_mul_ps(w2, x2));
+        y1 = _mm256_add_ps(_mm256_mul_ps(w1, y1), _mm256_mul_ps(w2, y2));
+        z1 = _mm256_add_ps(_mm256_mul_ps(w1, z1), _mm256_mul_ps(w2, z2));
+        q1 = _mm256_add_ps(_mm256_mul_ps(w1, q1), _mm256_mul_ps(w2, q2));
+        f = _mm256_sqrt_ps(k3avx_Dot4(x1, y1, z1, q1, x1, y1, z1, q1));
+        f = _mm256_andnot_ps(_mm256_cmp_ps(f, zero, _CMP_EQ_OQ), _mm256_div_ps(_mm256_set1_ps(1.0f), f));
+        k3avx_StoreQuats(dp, d_stride, _mm256_mul_ps(f, x1), _mm256_mul_ps(f, y1), _mm256_mul_ps(f, z1), _mm256_mul_ps(f, q1));
+    }
+    k3v4_QuatNlerpBatchSSE41(count - i, dp, d_stride, s1, s1_stride, s2, s2_stride, t);
+    return d;
+}
+
+K3_TARGET_AVX2 static float* k3m_QuatToMatBatchAVX2(uint32_t count, uint32_t cols, float* d, uint32_t d_stride, const float* s, uint32_t s_stride)
+{
+    uint32_t i, r, j;
+    float* dp = d;
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 x, y, z, w, xx, yy, zz, ww, x2, y2, w2, e[9];
+    __m128 m[2][9];
+    if (cols != 3 && cols != 4) return k3m_QuatToMatBatchScalar(count, cols, d, d_stride, s, s_stride);
+    for (i = 0; i + 8 <= count; i += 8, dp += 8 * d_stride, s += 8 * s_stride) {
+        k3avx_LoadQuats(s, s_stride, &x, &y, &z, &w);
+        xx = _mm256_mul_ps(x, x);
+        yy = _mm256_mul_ps(y, y);
+        zz = _mm256_mul_ps(z, z);
+        ww = _mm256_mul_ps(w, w);
+        x2 = _mm256_mul_ps(two, x);
+        y2 = _mm256_mul_ps(two, y);
+        w2 = _mm256_mul_ps(two, w);
+        e[0] = _mm256_sub_ps(_mm256_sub_ps(_mm256_add_ps(ww, xx), yy), zz);
+        e[1] = _mm256_sub_ps(_mm256_mul_ps(x2, y), _mm256_mul_ps(w2, z));
+        e[2] = _mm256_add_ps(_mm256_mul_ps(x2, z), _mm256_mul_ps(w2, y));
+        e[3] = _mm256_add_ps(_mm256_mul_ps(x2, y), _mm256_mul_ps(w2, z));
+        e[4] = _mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(ww, xx), yy), zz);
+        e[5] = _mm256_sub_ps(_mm256_mul_ps(y2, z), _mm256_mul_ps(w2, x));
+        e[6] = _mm256_sub_ps(_mm256_mul_ps(x2, z), _mm256_mul_ps(w2, y));
+        e[7] = _mm256_add_ps(_mm256_mul_ps(y2, z), _mm256_mul_ps(w2, x));
+        e[8] = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(ww, xx), yy), zz);
+        for (j = 0; j < 9; j++) {
+            m[0][j] = _mm256_castps256_ps128(e[j]);
+            m[1][j] = _mm256_extractf128_ps(e[j], 1);
+        }
+        for (r = 0; r < 2; r++) {
+            k3sse_StoreMatRows(dp + 4 * r * d_stride, d_stride, cols, m[r], _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps());
+        }
+    }
+    k3m_QuatToMatBatchSSE41(count - i, cols, dp, d_stride, s, s_stride);
+    return d;
+}
+
+K3_TARGET_AVX2 static void k3bvh_CheckCollisionBatchAVX2(const k3AABB* s1, const k3AABBArray* s2, uint32_t count, uint32_t* hit_mask, uint32_t* axis_flags)
+{
+    uint32_t i, axis;
+    __m256 b[6], mn[3], mx[3], hit;
+    __m256i f;
+    for (axis = 0; axis < 3; axis++) {
+        b[axis] = _mm256_set1_ps(s1->min[axis]);
+        b[3 + axis] = _mm256_set1_ps(s1->max[axis]);
+    }
+    for (i = 0; i + 8 <= count; i += 8) {
+        hit = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (axis = 0; axis < 3; axis++) {
+            mn[axis] = _mm256_loadu_ps(s2->min[axis] + i);
+            mx[axis] = _mm256_loadu_ps(s2->max[axis] + i);
+            hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(b[3 + axis], mn[axis], _CMP_GE_OQ), _mm256_cmp_ps(mx[axis], b[axis], _CMP_GE_OQ)));
+        }
+        if (axis_flags) {
+            f = _mm256_setzero_si256();
+            for (axis = 0; axis < 3; axis++) {
+                f = _mm256_or_si256(f, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(mx[axis], b[3 + axis], _CMP_GE_OQ)), _mm256_set1_epi32(K3_AXIS_DIR_FLAG_POS_X << axis)));
+                f = _mm256_or_si256(f, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(mn[axis], b[axis], _CMP_LE_OQ)), _mm256_set1_epi32(K3_AXIS_DIR_FLAG_NEG_X << axis)));
+            }
+            f = _mm256_or_si256(f, _mm256_and_si256(_mm256_cmpeq_epi32(f, _mm256_setzero_si256()), _mm256_set1_epi32(K3_AXIS_DIR_FLAG_ALL)));
+            _mm256_storeu_si256((__m256i*)(axis_flags + i), _mm256_and_si256(f, _mm256_castps_si256(hit)));
+        }
+        if ((i & 0x1f) == 0) hit_mask[i >> 5] = 0;
+        hit_mask[i >> 5] |= ((uint32_t)_mm256_movemask_ps(hit)) << (i & 0x1f);
+    }
+    for (; i < count; i++) k3bvh_CheckCollisionLane(s1, s2, i, hit_mask, axis_flags);
+}
+
+K3_TARGET_AVX2 static void k3bvh_ClassifyFrustumBatchAVX2(uint32_t* d, const float* planes, const k3AABB* s, uint32_t count)
+{
+    uint32_t i, p, axis;
+    __m128 mn_lo[3], mx_lo[3], mn_hi[3], mx_hi[3];
+    __m256 mn[3], mx[3], far_pt[3], near_pt[3], outside, intersect, dist;
+    __m256 zero = _mm256_setzero_ps();
+    __m256i inside = _mm256_set1_epi32(K3_FRUSTUM_INSIDE);
+    __m256i one = _mm256_set1_epi32(K3_FRUSTUM_INSIDE - K3_FRUSTUM_INTERSECT);
+    for (i = 0; i + 8 <= count; i += 8) {
+        k3sse_LoadAABBs(s + i, mn_lo, mx_lo);
+        k3sse_LoadAABBs(s + i + 4, mn_hi, mx_hi);
+        for (axis = 0; axis < 3; axis++) {
+            mn[axis] = k3avx_Pair(mn_lo[axis], mn_hi[axis]);
+            mx[axis] = k3avx_Pair(mx_lo[axis], mx_hi[axis]);
+        }
+        outside = zero;
+        intersect = zero;
+        for (p = 0; p < 6; p++) {
+            const float* plane = planes + 4 * p;
+            for (axis = 0; axis < 3; axis++) {
+                far_pt[axis] = (plane[axis] >= 0.0f) ? mx[axis] : mn[axis];
+                near_pt[axis] = (plane[axis] >= 0.0f) ? mn[axis] : mx[axis];
+            }
+            dist = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), far_pt[0]), _mm256_mul_ps(_mm256_set1_ps(plane[1]), far_pt[1]));
+            dist = _mm256_add_ps(_mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane[2]), far_pt[2])), _mm256_set1_ps(plane[3]));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+            if (_mm256_movemask_ps(outside) == 0xff) break;
+            dist = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), near_pt[0]), _mm256_mul_ps(_mm256_set1_ps(plane[1]), near_pt[1]));
+            dist = _mm256_add_ps(_mm256_add_ps(dist, _mm256_mul_ps(_mm256_set1_ps(plane[2]), near_pt[2])), _mm256_set1_ps(plane[3]));
+            intersect = _mm256_or_ps(intersect, _mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+        }
+        __m256i r = _mm256_sub_epi32(inside, _mm256_and_si256(_mm256_castps_si256(intersect), one));
+        _mm256_storeu_si256((__m256i*)(d + i), _mm256_andnot_si256(_mm256_castps_si256(outside), r));
+    }
+    k3bvh_ClassifyFrustumBatchSSE41(d + i, planes, s + i, count - i);
+}
+
+K3_TARGET_AVX2 static void k3v_FastSinCosAVX2(uint32_t vec_length, float* sin_d, float* cos_d, const float* s)
+{
+    uint32_t i;
+    __m256 x, k, r, z, sin_r, cos_r, swap, sin_x, cos_x;
+    __m256i q;
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i two = _mm256_set1_epi32(2);
+    for (i = 0; i + 8 <= vec_length; i += 8) {
+        x = _mm256_loadu_ps(s + i);
+        k = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(K3_FAST_2_OVER_PI)), _mm256_set1_ps(0.5f)));
+        r = _mm256_sub_ps(x, _mm256_mul_ps(k, _mm256_set1_ps(K3_FAST_PIO2_1)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(K3_FAST_PIO2_2)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(K3_FAST_PIO2_3)));
+        z = _mm256_mul_ps(r, r);
+        sin_r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(K3_FAST_SIN_C3), z), _mm256_set1_ps(K3_FAST_SIN_C2));
+        sin_r = _mm256_add_ps(_mm256_mul_ps(sin_r, z), _mm256_set1_ps(K3_FAST_SIN_C1));
+        sin_r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sin_r, z), r), r);
+        cos_r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(K3_FAST_COS_C3), z), _mm256_set1_ps(K3_FAST_COS_C2));
+        cos_r = _mm256_add_ps(_mm256_mul_ps(cos_r, z), _mm256_set1_ps(K3_FAST_COS_C1));
+        cos_r = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cos_r, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+        cos_r = _mm256_add_ps(cos_r, _mm256_set1_ps(1.0f));
+        q = _mm256_cvttps_epi32(k);
+        swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+        sin_x = _mm256_blendv_ps(sin_r, cos_r, swap);
+        cos_x = _mm256_blendv_ps(cos_r, sin_r, swap);
+        sin_x = _mm256_xor_ps(sin_x, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30)));
+        cos_x = _mm256_xor_ps(cos_x, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30)));
+        _mm256_storeu_ps(sin_d + i, sin_x);
+        _mm256_storeu_ps(cos_d + i, cos_x);
+    }
+    k3v_FastSinCosSSE41(vec_length - i, sin_d + i, cos_d + i, s + i);
+}
+
+K3_TARGET_AVX2 static float* k3v_FastAtan2AVX2(uint32_t vec_length, float* d, const float* s1, const float* s2)
+{
+    uint32_t i;
+    __m256 x, y, ax, ay, swap, hi, lo, a, shift, t, z, r;
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    for (i = 0; i + 8 <= vec_length; i += 8) {
+        y = _mm256_loadu_ps(s1 + i);
+        x = _mm256_loadu_ps(s2 + i);
+        ax = _mm256_andnot_ps(sign, x);
+        ay = _mm256_andnot_ps(sign, y);
+        swap = _mm256_cmp_ps(ay, ax, _CMP_GT_OQ);
+        hi = _mm256_blendv_ps(ax, ay, swap);
+        lo = _mm256_blendv_ps(ay, ax, swap);
+        a = _mm256_andnot_ps(_mm256_cmp_ps(hi, zero, _CMP_EQ_OQ), _mm256_div_ps(lo, hi));
+        shift = _mm256_cmp_ps(a, _mm256_set1_ps(K3_FAST_TAN_PI_8), _CMP_GT_OQ);
+        t = _mm256_blendv_ps(a, _mm256_div_ps(_mm256_sub_ps(a, one), _mm256_add_ps(a, one)), shift);
+        z = _mm256_mul_ps(t, t);
+        r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(K3_FAST_ATAN_C4), z), _mm256_set1_ps(K3_FAST_ATAN_C3));
+        r = _mm256_add_ps(_mm256_mul_ps(r, z), _mm256_set1_ps(K3_FAST_ATAN_C2));
+        r = _mm256_add_ps(_mm256_mul_ps(r, z), _mm256_set1_ps(K3_FAST_ATAN_C1));
+        r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(r, z), t), t);
+        r = _mm256_blendv_ps(r, _mm256_add_ps(r, _mm256_set1_ps(K3_FAST_PIO4)), shift);
+        r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(K3_FAST_PIO2), r), swap);
+        r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(K3_FAST_PI), r), x);
+        r = _mm256_or_ps(r, _mm256_and_ps(y, sign));
+        _mm256_storeu_ps(d + i, r);
+    }
+    k3v_FastAtan2SSE41(vec_length - i, d + i, s1 + i, s2 + i);
+    return d;
+}
+
+K3_TARGET_AVX2 static float* k3v_FastRsqrtAVX2(uint32_t vec_length, float* d, const float* s)
+{
+    uint32_t i;
+    __m256 x, y, half_x;
+    __m256 three_halves = _mm256_set1_ps(1.5f);
+    for (i = 0; i + 8 <= vec_length; i += 8) {
+        x = _mm256_loadu_ps(s + i);
+        half_x = _mm256_mul_ps(_mm256_set1_ps(0.5f), x);
+        y = _mm256_castsi256_ps(_mm256_sub_epi32(_mm256_set1_epi32(K3_FAST_RSQRT_MAGIC), _mm256_srli_epi32(_mm256_castps_si256(x), 1)));
+        y = _mm256_mul_ps(y, _mm256_sub_ps(three_halves, _mm256_mul_ps(_mm256_mul_ps(half_x, y), y)));
+        y = _mm256_mul_ps(y, _mm256_sub_ps(three_halves, _mm256_mul_ps(_mm256_mul_ps(half_x, y), y)));
+        _mm256_storeu_ps(d + i, y);
+    }
+    k3v_FastRsqrtSSE41(vec_length - i, d + i, s + i);
+    return d;
+}
+
+static const k3mathFuncs k3math_avx2_funcs = {
+    k3simdLevel::AVX2,
+    k3v_NegateAVX2,
+    k3v_AddAVX2,
+    k3v_SubAVX2,
+    k3v_MulAVX2,
+    k3v_DivAVX2,
+    k3v_CrossSSE41,
+    k3v_EqualsAVX2,
+    k3v_DotAVX2,
+    k3v_MinAVX2,
+    k3v_MaxAVX2,
+    k3v_NormalizeAVX2,
+    k3sv_AddAVX2,
+    k3sv_SubAVX2,
+    k3sv_MulAVX2,
+    k3sv_DivAVX2,
+    k3m4_TransposeSSE41,
+    k3m4_InverseSSE41,
+    k3m4_InverseTransformSSE41,
+    k3m4_MulAVX2,
+    k3mv4_MulSSE41,
+    k3vm4_MulSSE41,
+    k3m4_MulArrayAVX2,
+    k3mv4_MulArrayAVX2,
+    k3mp3_MulArrayAVX2,
+    k3v4_QuatNlerpBatchAVX2,
+    k3v4_QuatSlerpBatchSSE41,
+    k3m_QuatToMatBatchAVX2,
+    k3v4_QuatToDualQuatBatchSSE41,
+    k3m4_DualQuatToMatBatchSSE41,
+    k3bvh_CheckCollisionBatchAVX2,
+    k3bvh_ClassifyFrustumBatchAVX2,
+    k3v_FastSinCosAVX2,
+    k3v_FastAtan2AVX2,
+    k3v_FastRsqrtAVX2
+};
+
+// ------------------------------------------------------------
+// cpu detection
+static void k3simd_Cpuid(int32_t* info, uint32_t leaf, uint32_t subleaf)
+{
+#ifdef _MSC_VER
+    __cpuidex(info, leaf, subleaf);
+#else
+    uint32_t a, b, c, d;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    info[0] = a;
+    info[1] = b;
+    info[2] = c;
+    info[3] = d;
+#endif
+}
+
+static uint64_t k3simd_Xgetbv()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+k3simdLevel k3simd_DetectLevel()
+{
+    int32_t info[4];
+    k3simd_Cpuid(info, 0, 0);
+    uint32_t max_leaf = info[0];
+    k3simd_Cpuid(info, 1, 0);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!sse41) return k3simdLevel::NONE;
+    // AVX needs the os to save the ymm registers (xcr0 bits 1 and 2)
+    if (osxsave && avx && max_leaf >= 7 && (k3simd_Xgetbv() & 0x6) == 0x6) {
+        k3simd_Cpuid(info, 7, 0);
+        if (info[1] & (1 << 5)) return k3simdLevel::AVX2;
+    }
+    return k3simdLevel::SSE41;
+}
+
+#elif defined(K3_SIMD_NEON)
+// ------------------------------------------------------------
+// NEON kernels (aarch64)
+
+// Load/store the first n (1 to 4) floats without touching memory past them
+static inline float32x4_t k3neon_LoadPartial(const float* s, uint32_t n)
+{
+    float32x4_t v = vdupq_n_f32(0.0f);
+    switch (n) {
+    case 3: v = vld1q_lane_f32(s + 2, v, 2);
+    case 2: v = vld1q_lane_f32(s + 1, v, 1);
+    case 1: v = vld1q_lane_f32(s + 0, v, 0); break;
+    default: v = vld1q_f32(s); break;
+    }
+    return v;
+}
+
+static inline void k3neon_StorePartial(float* d, float32x4_t v, uint32_t n)
+{
+    switch (n) {
+    case 3: vst1q_lane_f32(d + 2, v, 2);
+    case 2: vst1q_lane_f32(d + 1, v, 1);
+    case 1: vst1q_lane_f32(d + 0, v, 0); break;
+    default: vst1q_f32(d, v); break;
+    }
+}
+
+static inline float k3neon_AccumulateLanes(float acc, float32x4_t p, uint32_t n)
+{
+    float lanes[4];
+    uint32_t i;
+    vst1q_f32(lanes, p);
+    for (i = 0; i < n; i++) acc += lanes[i];
+    return acc;
+}
+
+// fmin/fmax differ from the scalar compare on signed zeros and NaNs, so select on the compare instead
+static inline float32x4_t k3neon_Min(float32x4_t a, float32x4_t b)
+{
+    return vbslq_f32(vcltq_f32(a, b), a, b);
+}
+
+static inline float32x4_t k3neon_Max(float32x4_t a, float32x4_t b)
+{
+    return vbslq_f32(vcgtq_f32(a, b), a, b);
+}
+
+#define K3_NEON_VV_OP(name, op) \
+static float* name(uint32_t vec_length, float* d, const float* s1, const float* s2) \
+{ \
+    uint32_t i; \
+    for (i = 0; i + 4 <= vec_length; i += 4) { \
+        vst1q_f32(d + i, op(vld1q_f32(s1 + i), vld1q_f32(s2 + i))); \
+    } \
+    if (i < vec_length) { \
+        uint32_t n = vec_length - i; \
+        k3neon_StorePartial(d + i, op(k3neon_LoadPartial(s1 + i, n), k3neon_LoadPartial(s2 + i, n)), n); \
+    } \
+    return d; \
+}
+
+#define K3_NEON_SV_OP(name, op) \
+static float* name(uint32_t vec_length, float* d, const float s1, const float* s2) \
+{ \
+    uint32_t i; \
+    float32x4_t s = vdupq_n_f32(s1); \
+    for (i = 0; i + 4 <= vec_length; i += 4) { \
+        vst1q_f32(d + i, op(s, vld1q_f32(s2 + i))); \
+    } \
+    if (i < vec_length) { \
+        uint32_t n = vec_length - i; \
+        k3neon_StorePartial(d + i, op(s, k3neon_LoadPartial(s2 + i, n)), n); \
+    } \
+    return d; \
+}
+
+K3_NEON_VV_OP(k3v_AddNEON, vaddq_f32)
+K3_NEON_VV_OP(k3v_SubNEON, vsubq_f32)
+K3_NEON_VV_OP(k3v_MulNEON, vmulq_f32)
+K3_NEON_VV_OP(k3v_DivNEON, vdivq_f32)
+K3_NEON_VV_OP(k3v_MinNEON, k3neon_Min)
+K3_NEON_VV_OP(k3v_MaxNEON, k3neon_Max)
+K3_NEON_SV_OP(k3sv_AddNEON, vaddq_f32)
+K3_NEON_SV_OP(k3sv_SubNEON, vsubq_f32)
+K3_NEON_SV_OP(k3sv_MulNEON, vmulq_f32)
+K3_NEON_SV_OP(k3sv_DivNEON, vdivq_f32)
+
+static float* k3v_NegateNEON(uint32_t vec_length, float* d)
+{
+    uint32_t i;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        vst1q_f32(d + i, vnegq_f32(vld1q_f32(d + i)));
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        k3neon_StorePartial(d + i, vnegq_f32(k3neon_LoadPartial(d + i, n)), n);
+    }
+    return d;
+}
+
+static bool k3v_EqualsNEON(uint32_t vec_length, const float* s1, const float* s2)
+{
+    uint32_t i;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        if (vminvq_u32(vceqq_f32(vld1q_f32(s1 + i), vld1q_f32(s2 + i))) == 0) return false;
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        // unused lanes load as 0.0f on both sides, so they always compare equal
+        if (vminvq_u32(vceqq_f32(k3neon_LoadPartial(s1 + i, n), k3neon_LoadPartial(s2 + i, n))) == 0) return false;
+    }
+    return true;
+}
+
+static float k3v_DotNEON(uint32_t vec_length, const float* s1, const float* s2)
+{
+    uint32_t i;
+    float result = 0.0f;
+    for (i = 0; i + 4 <= vec_length; i += 4) {
+        result = k3neon_AccumulateLanes(result, vmulq_f32(vld1q_f32(s1 + i), vld1q_f32(s2 + i)), 4);
+    }
+    if (i < vec_length) {
+        uint32_t n = vec_length - i;
+        result = k3neon_AccumulateLanes(result, vmulq_f32(k3neon_LoadPartial(s1 + i, n), k3neon_LoadPartial(s2 + i, n)), n);
+    }
+    return result;
+}
+
+static float* k3v_NormalizeNEON(uint32_t l, float* d)
+{
+    float f = sqrtf(k3v_DotNEON(l, d, d));
+    f = (f == 0.0f) ? 0.0f : (1.0f / f);
+    return k3sv_MulNEON(l, d, f, d);
+}
+
+static float* k3m4_TransposeNEON(float* d)
+{
+    // the de-interleaving load hands back the columns
+    float32x4x4_t c = vld4q_f32(d);
+    vst1q_f32(d + 0, c.val[0]);
+    vst1q_f32(d + 4, c.val[1]);
+    vst1q_f32(d + 8, c.val[2]);
+    vst1q_f32(d + 12, c.val[3]);
+    return d;
+}
+
+static inline void k3neon_MulRows(float* d, const float* s1, float32x4_t b0, float32x4_t b1, float32x4_t b2, float32x4_t b3)
+{
+    float32x4_t zero = vdupq_n_f32(0.0f);
+    uint32_t i;
+    for (i = 0; i < 4; i++) {
+        float32x4_t a = vld1q_f32(s1 + 4 * i);
+        float32x4_t row = vaddq_f32(zero, vmulq_laneq_f32(b0, a, 0));
+        row = vaddq_f32(row, vmulq_laneq_f32(b1, a, 1));
+        row = vaddq_f32(row, vmulq_laneq_f32(b2, a, 2));
+        row = vaddq_f32(row, vmulq_laneq_f32(b3, a, 3));
+        vst1q_f32(d + 4 * i, row);
+    }
+}
+
+static inline float32x4_t k3neon_MulColumns(float32x4x4_t m, float32x4_t v)
+{
+    float32x4_t r = vaddq_f32(vdupq_n_f32(0.0f), vmulq_laneq_f32(m.val[0], v, 0));
+    r = vaddq_f32(r, vmulq_laneq_f32(m.val[1], v, 1));
+    r = vaddq_f32(r, vmulq_laneq_f32(m.val[2], v, 2));
+    r = vaddq_f32(r, vmulq_laneq_f32(m.val[3], v, 3));
+    return r;
+}
+
+static float* k3m4_MulNEON(float* d, const float* s1, const float* s2)
+{
+    k3neon_MulRows(d, s1, vld1q_f32(s2 + 0), vld1q_f32(s2 + 4), vld1q_f32(s2 + 8), vld1q_f32(s2 + 12));
+    return d;
+}
+
+static float* k3mv4_MulNEON(float* d, const float* s1, const float* s2)
+{
+    vst1q_f32(d, k3neon_MulColumns(vld4q_f32(s1), vld1q_f32(s2)));
+    return d;
+}
+
+static float* k3vm4_MulNEON(float* d, const float* s1, const float* s2)
+{
+    float32x4_t v = vld1q_f32(s1);
+    float32x4_t r = vaddq_f32(vdupq_n_f32(0.0f), vmulq_laneq_f32(vld1q_f32(s2 + 0), v, 0));
+    r = vaddq_f32(r, vmulq_laneq_f32(vld1q_f32(s2 + 4), v, 1));
+    r = vaddq_f32(r, vmulq_laneq_f32(vld1q_f32(s2 + 8), v, 2));
+    r = vaddq_f32(r, vmulq_laneq_f32(vld1q_f32(s2 + 12), v, 3));
+    vst1q_f32(d, r);
+    return d;
+}
+
+static float* k3m4_MulArrayNEON(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    if (s2_stride == 0) {
+        float32x4_t b0 = vld1q_f32(s2 + 0);
+        float32x4_t b1 = vld1q_f32(s2 + 4);
+        float32x4_t b2 = vld1q_f32(s2 + 8);
+        float32x4_t b3 = vld1q_f32(s2 + 12);
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride) k3neon_MulRows(dp, s1, b0, b1, b2, b3);
+    } else {
+        for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) k3m4_MulNEON(dp, s1, s2);
+    }
+    return d;
+}
+
+static float* k3mv4_MulArrayNEON(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    float32x4x4_t m = vld4q_f32(s1);
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) {
+        if (i && s1_stride) m = vld4q_f32(s1);
+        vst1q_f32(dp, k3neon_MulColumns(m, vld1q_f32(s2)));
+    }
+    return d;
+}
+
+static float* k3mp3_MulArrayNEON(uint32_t count, float* d, uint32_t d_stride, const float* s1, uint32_t s1_stride, const float* s2, uint32_t s2_stride)
+{
+    uint32_t i;
+    float* dp = d;
+    float32x4x4_t m = vld4q_f32(s1);
+    for (i = 0; i < count; i++, dp += d_stride, s1 += s1_stride, s2 += s2_stride) {
+        if (i && s1_stride) m = vld4q_f32(s1);
+        float32x4_t v = vsetq_lane_f32(1.0f, k3neon_LoadPartial(s2, 3), 3);
+        k3neon_StorePartial(dp, k3neon_MulColumns(m, v), 3);
+    }
+    return d;
+}
+
+// cross product, the 4x4 and affine inverses and the quaternion batches are swizzle heavy and stay on the scalar reference
+// the aabb batches need a movemask, which neon lacks, so they stay scalar as well
+// the fast transcendental tier has not been ported yet and runs on the scalar reference
+static const k3mathFuncs k3math_neon_funcs = {
+    k3simdLevel::NEON,
+    k3v_NegateNEON,
+    k3v_AddNEON,
+    k3v_SubNEON,
+    k3v_MulNEON,
+    k3v_DivNEON,
+    k3v_CrossScalar,
+    k3v_EqualsNEON,
+    k3v_DotNEON,
+    k3v_MinNEON,
+    k3v_MaxNEON,
+    k3v_NormalizeNEON,
+    k3sv_AddNEON,
+    k3sv_SubNEON,
+    k3sv_MulNEON,
+    k3sv_DivNEON,
+    k3m4_TransposeNEON,
+    k3m4_InverseScalar,
+    k3m4_InverseTransformScalar,
+    k3m4_MulNEON,
+    k3mv4_MulNEON,
+    k3vm4_MulNEON,
+    k3m4_MulArrayNEON,
+    k3mv4_MulArrayNEON,
+    k3mp3_MulArrayNEON,
+    k3v4_QuatNlerpBatchScalar,
+    k3v4_QuatSlerpBatchScalar,
+    k3m_QuatToMatBatchScalar,
+    k3v4_QuatToDualQuatBatchScalar,
+    k3m4_DualQuatToMatBatchScalar,
+    k3bvh_CheckCollisionBatchScalar,
+    k3bvh_ClassifyFrustumBatchScalar,
+    k3v_FastSinCosScalar,
+    k3v_FastAtan2Scalar,
+    k3v_FastRsqrtScalar
+};
+
+k3simdLevel k3simd_DetectLevel()
+{
+    // Advanced SIMD is mandatory on aarch64
+    return k3simdLevel::NEON;
+}
+
+#else
+
+k3simdLevel k3simd_DetectLevel()
+{
+    return k3simdLevel::NONE;
+}
+
+#endif
+
+// ------------------------------------------------------------
+// level selection
+static k3simdLevel k3math_max_level = k3simdLevel::NONE;
+
+static const k3mathFuncs* k3math_GetFuncs(k3simdLevel level)
+{
+    switch (level) {
+#if defined(K3_SIMD_X86)
+    case k3simdLevel::AVX2: return &k3math_avx2_funcs;
+    case k3simdLevel::SSE41: return &k3math_sse41_funcs;
+#elif defined(K3_SIMD_NEON)
+    case k3simdLevel::NEON: return &k3math_neon_funcs;
+#endif
+    default: return &k3math_scalar_funcs;
+    }
+}
+
+static bool k3math_IsSupported(k3simdLevel level)
+{
+    switch (level) {
+    case k3simdLevel::NONE: return true;
+    case k3simdLevel::SSE41: return (k3math_max_level == k3simdLevel::SSE41 || k3math_max_level == k3simdLevel::AVX2);
+    case k3simdLevel::AVX2: return (k3math_max_level == k3simdLevel::AVX2);
+    case k3simdLevel::NEON: return (k3math_max_level == k3simdLevel::NEON);
+    }
+    return false;
+}
+
+K3API k3simdLevel k3math_GetSimdLevel()
+{
+    return k3math_funcs.level;
+}
+
+K3API k3simdLevel k3math_GetMaxSimdLevel()
+{
+    return k3math_max_level;
+}
+
+K3API k3simdLevel k3math_SetSimdLevel(k3simdLevel level)
+{
+    if (!k3math_IsSupported(level)) {
+        // step down to the closest supported level
+        switch (level) {
+        case k3simdLevel::AVX2: level = k3math_IsSupported(k3simdLevel::SSE41) ? k3simdLevel::SSE41 : k3simdLevel::NONE; break;
+        default: level = k3math_max_level; break;
+        }
+    }
+    k3math_funcs = *k3math_GetFuncs(level);
+    return k3math_funcs.level;
+}
+
+// Probe the cpu when the library is loaded
+static struct k3mathInit {
+    k3mathInit()
+    {
+        k3math_max_level = k3simd_DetectLevel();
+        k3math_SetSimdLevel(k3math_max_level);
+    }
+} k3math_init;
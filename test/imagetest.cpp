@@ -0,0 +1,1765 @@
+// k3 graphics test
+// image file handler checks that need no window or gpu; exits with 1 if any check fails
+
+#include "k3.h"
+#include "ddshandler.h"
+#include "pnghandler.h"
+#include "jpghandler.h"
+#include "k3pixel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+extern "C" {
+#include "jpeg-6b/jpeglib.h"
+}
+
+static uint32_t num_checks = 0;
+static uint32_t num_fails = 0;
+static bool error_seen = false;
+
+static void K3CALLBACK ErrorHandler(const char* error_msg, const char* title)
+{
+    printf("  error from %s: %s\n", title, error_msg);
+    error_seen = true;
+}
+
+static void Check(bool ok, const char* what, const char* detail)
+{
+    num_checks++;
+    if (!ok || error_seen) {
+        printf("FAIL %s: %s\n", what, detail);
+        num_fails++;
+    }
+    error_seen = false;
+}
+
+static uint32_t Random(uint32_t* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+// Gradients with noise over them, so every row filter gets picked somewhere; with few_values the pixels
+// are limited to a handful of colors, which the PNG saver turns into a palette or packed gray
+static std::vector<uint8_t> MakePixels(uint32_t width, uint32_t height, uint32_t pixel_size, bool few_values, uint32_t seed)
+{
+    std::vector<uint8_t> pixels(width * height * pixel_size);
+    uint32_t x, y, i;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            uint8_t* p = &pixels[(y * width + x) * pixel_size];
+            for (i = 0; i < pixel_size; i++) {
+                if (few_values) p[i] = static_cast<uint8_t>(17 * (((x / 5 + y / 3 + i) * 7) % 4));
+                else if ((x / 8 + y / 8) % 3 == 0) p[i] = static_cast<uint8_t>(Random(&seed));
+                else p[i] = static_cast<uint8_t>(x * 3 + y * 5 + i * 40);
+            }
+        }
+    }
+    return pixels;
+}
+
+static std::vector<uint8_t> ReadFile(const char* file_name)
+{
+    std::vector<uint8_t> data;
+    FILE* file_handle = fopen(file_name, "rb");
+    if (file_handle == NULL) return data;
+    fseek(file_handle, 0, SEEK_END);
+    data.resize(ftell(file_handle));
+    fseek(file_handle, 0, SEEK_SET);
+    if (fread(data.data(), 1, data.size(), file_handle) != data.size()) data.clear();
+    fclose(file_handle);
+    return data;
+}
+
+// Compares a against b after converting b to a's format, row by row
+static bool SameImage(k3image a, k3image b)
+{
+    if (a->GetWidth() != b->GetWidth() || a->GetHeight() != b->GetHeight() || a->GetDepth() != b->GetDepth()) return false;
+    k3image conv = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(conv, b, 0, 0, 0, a->GetFormat());
+    uint32_t row_size = a->GetWidth() * k3imageObj::GetFormatSize(a->GetFormat());
+    const uint8_t* pa = static_cast<const uint8_t*>(a->MapForRead());
+    const uint8_t* pb = static_cast<const uint8_t*>(conv->MapForRead());
+    bool same = (pa != NULL && pb != NULL);
+    uint32_t y;
+    for (y = 0; same && y < a->GetHeight(); y++) {
+        same = (memcmp(pa + y * a->GetPitch(), pb + y * conv->GetPitch(), row_size) == 0);
+    }
+    a->Unmap();
+    conv->Unmap();
+    return same;
+}
+
+// ------------------------------------------------------------
+// PNG round trip
+
+// Reports 8 threads but runs the tasks backwards on the calling thread, so a save that depends on
+// how its row groups are scheduled comes out different from one on the built in pool
+static uint32_t K3CALLBACK ReversePoolGetNumThreads(void* pool_data)
+{
+    return 8;
+}
+
+static void K3CALLBACK ReversePoolRun(void* pool_data, uint32_t count, k3parallel_task_ptr task, void* context)
+{
+    uint32_t i;
+    for (i = count; i > 0; i--) task(context, i - 1);
+}
+
+static void TestPNGRoundTrip()
+{
+    struct {
+        k3fmt format;
+        uint32_t pixel_size;
+        const char* name;
+    } formats[] = {
+        { k3fmt::R8_UNORM, 1, "R8" },
+        { k3fmt::R16_UNORM, 2, "R16" },
+        { k3fmt::RG8_UNORM, 2, "RG8" },
+        { k3fmt::RG16_UNORM, 4, "RG16" },
+        { k3fmt::RGBA8_UNORM, 4, "RGBA8" },
+        { k3fmt::RGBA16_UNORM, 8, "RGBA16" },
+        { k3fmt::BGRA8_UNORM, 4, "BGRA8" },
+    };
+    const uint32_t levels[] = { 0, 1, 6, 9 };
+    const uint32_t sizes[][2] = { { 1, 1 }, { 7, 3 }, { 67, 45 }, { 300, 211 }, { 1000, 300 } };
+    k3thread_pool_t reverse_pool = { NULL, ReversePoolGetNumThreads, ReversePoolRun };
+    char detail[128];
+    uint32_t f, l, s, few;
+
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (few = 0; few < 2; few++) {
+                uint32_t width = sizes[s][0], height = sizes[s][1];
+                std::vector<uint8_t> pixels = MakePixels(width, height, formats[f].pixel_size, few != 0, f * 16 + s);
+                k3image src = k3imageObj::Create();
+                k3imageObj::LoadFromMemory(src, width, height, 1, width * formats[f].pixel_size, width * height * formats[f].pixel_size,
+                    formats[f].format, pixels.data());
+                for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                    snprintf(detail, sizeof(detail), "%s %ux%u%s level %u", formats[f].name, width, height, few ? " few colors" : "", levels[l]);
+                    k3imageObj::SetFileCompressLevel(levels[l]);
+                    src->SaveToFile("imagetest.png", k3imageObj::FILE_HANDLER_PNG);
+                    std::vector<uint8_t> file = ReadFile("imagetest.png");
+                    k3image loaded = k3imageObj::Create();
+                    k3imageObj::LoadFromFile(loaded, "imagetest.png");
+                    Check(SameImage(src, loaded), "png round trip", detail);
+
+                    k3parallel::SetThreadPool(&reverse_pool);
+                    src->SaveToFile("imagetest.png", k3imageObj::FILE_HANDLER_PNG);
+                    k3parallel::SetThreadPool(NULL);
+                    Check(!file.empty() && ReadFile("imagetest.png") == file, "png save independent of threads", detail);
+                }
+            }
+        }
+    }
+    k3imageObj::SetFileCompressLevel(k3imageObj::DEFAULT_FILE_COMPRESS_LEVEL);
+    remove("imagetest.png");
+}
+
+// ------------------------------------------------------------
+// PNG decoder corpus
+// Files of every color type and bit depth, with and without interlacing, each row under a random filter
+// and the image data split over several IDAT chunks, decoded at every simd level against the pixels they hold
+
+static void PutBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    uint8_t b[4] = { static_cast<uint8_t>(v >> 24), static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v) };
+    out.insert(out.end(), b, b + 4);
+}
+
+static void PutChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, uint32_t size)
+{
+    PutBE32(png, size);
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    if (size) png.insert(png.end(), data, data + size);
+    PutBE32(png, crc32(0, &png[start], size + 4));
+}
+
+static uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+// Appends the rows of one pass, each under a random filter; prev starts as the row of zeros a pass begins with
+static void FilterRows(const std::vector<std::vector<uint8_t> >& rows, uint32_t bpp, uint32_t* seed, std::vector<uint8_t>& out)
+{
+    std::vector<uint8_t> prev(rows.empty() ? 0 : rows[0].size(), 0);
+    uint32_t r, i;
+    for (r = 0; r < rows.size(); r++) {
+        const std::vector<uint8_t>& row = rows[r];
+        uint8_t filter = Random(seed) % 5;
+        out.push_back(filter);
+        for (i = 0; i < row.size(); i++) {
+            uint8_t a = (i >= bpp) ? row[i - bpp] : 0;
+            uint8_t b = prev[i];
+            uint8_t c = (i >= bpp) ? prev[i - bpp] : 0;
+            uint8_t pred[5] = { 0, a, b, static_cast<uint8_t>((a + b) >> 1), Paeth(a, b, c) };
+            out.push_back(static_cast<uint8_t>(row[i] - pred[filter]));
+        }
+        prev = row;
+    }
+}
+
+// Writes a PNG of random or smooth samples, and fills expected with the image the loader should produce:
+// R8 or R16 for gray, RG8 or RG16 for gray and alpha, and RGBA8 or RGBA16 for everything else
+static std::vector<uint8_t> MakePNG(uint32_t width, uint32_t height, uint8_t color_type, uint8_t bit_depth, bool interlace,
+    uint32_t* seed, k3image expected)
+{
+    static const uint32_t adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+    static const uint32_t whole[1][4] = { { 0, 0, 1, 1 } };
+    const uint32_t channels = (color_type == 2) ? 3 : (color_type == 4) ? 2 : (color_type == 6) ? 4 : 1;
+    const uint32_t max_value = (1u << bit_depth) - 1;
+    const bool smooth = ((width * height) % 2) != 0;
+    uint32_t x, y, c, p, i;
+
+    std::vector<uint8_t> palette;
+    if (color_type == 3) {
+        for (i = 0; i < 3u << bit_depth; i++) palette.push_back(static_cast<uint8_t>(Random(seed)));
+    }
+    std::vector<uint16_t> samples(width * height * channels);
+    for (i = 0; i < samples.size(); i++) {
+        x = (i / channels) % width;
+        y = (i / channels) / width;
+        c = i % channels;
+        if (smooth) samples[i] = ((x * 7 + y * 3 + c * 50) * ((bit_depth == 16) ? 257 : 1)) & max_value;
+        else samples[i] = Random(seed) & max_value;
+    }
+
+    std::vector<uint8_t> raw;
+    const uint32_t(*passes)[4] = interlace ? adam7 : whole;
+    uint32_t num_passes = interlace ? 7 : 1;
+    uint32_t bpp = (channels * bit_depth + 7) / 8;
+    for (p = 0; p < num_passes; p++) {
+        std::vector<std::vector<uint8_t> > rows;
+        for (y = passes[p][1]; y < height; y += passes[p][3]) {
+            std::vector<uint8_t> row;
+            uint32_t bit = 0;
+            for (x = passes[p][0]; x < width; x += passes[p][2]) {
+                for (c = 0; c < channels; c++) {
+                    uint16_t v = samples[(y * width + x) * channels + c];
+                    if (bit_depth == 16) {
+                        row.push_back(static_cast<uint8_t>(v >> 8));
+                        row.push_back(static_cast<uint8_t>(v));
+                    } else if (bit_depth == 8) {
+                        row.push_back(static_cast<uint8_t>(v));
+                    } else {
+                        if (bit % 8 == 0) row.push_back(0);
+                        row.back() |= v << (8 - bit_depth - bit % 8);
+                        bit += bit_depth;
+                    }
+                }
+            }
+            if (!row.empty()) rows.push_back(row);
+        }
+        FilterRows(rows, bpp, seed, raw);
+    }
+
+    const int levels[] = { 0, 1, 6, 9 };
+    uLongf packed_size = compressBound(static_cast<uLong>(raw.size()));
+    std::vector<uint8_t> packed(packed_size);
+    compress2(packed.data(), &packed_size, raw.data(), static_cast<uLong>(raw.size()), levels[Random(seed) % 4]);
+
+    std::vector<uint8_t> png;
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    png.insert(png.end(), signature, signature + 8);
+    std::vector<uint8_t> header;
+    PutBE32(header, width);
+    PutBE32(header, height);
+    const uint8_t header_tail[5] = { bit_depth, color_type, 0, 0, static_cast<uint8_t>(interlace ? 1 : 0) };
+    header.insert(header.end(), header_tail, header_tail + 5);
+    PutChunk(png, "IHDR", header.data(), static_cast<uint32_t>(header.size()));
+    if (color_type == 3) PutChunk(png, "PLTE", palette.data(), static_cast<uint32_t>(palette.size()));
+    const uint8_t text[3] = { 'k', 0, 'v' };
+    PutChunk(png, "tEXt", text, 3);
+    const uint32_t splits[] = { 1, 3, 1000 };
+    uint32_t idat_size = static_cast<uint32_t>(packed_size) / splits[Random(seed) % 3];
+    if (idat_size == 0) idat_size = 1;
+    for (i = 0; i < packed_size; i += idat_size) {
+        PutChunk(png, "IDAT", packed.data() + i, (packed_size - i < idat_size) ? static_cast<uint32_t>(packed_size - i) : idat_size);
+    }
+    PutChunk(png, "IEND", NULL, 0);
+
+    k3fmt format;
+    uint32_t out_channels = (color_type == 0) ? 1 : (color_type == 4) ? 2 : 4;
+    if (bit_depth == 16) format = (out_channels == 1) ? k3fmt::R16_UNORM : (out_channels == 2) ? k3fmt::RG16_UNORM : k3fmt::RGBA16_UNORM;
+    else format = (out_channels == 1) ? k3fmt::R8_UNORM : (out_channels == 2) ? k3fmt::RG8_UNORM : k3fmt::RGBA8_UNORM;
+    std::vector<uint16_t> pixels;
+    for (i = 0; i < width * height; i++) {
+        const uint16_t* s = &samples[i * channels];
+        if (color_type == 3) {
+            for (c = 0; c < 3; c++) pixels.push_back(palette[3 * s[0] + c]);
+            pixels.push_back(255);
+        } else if (color_type == 0 && bit_depth < 8) {
+            pixels.push_back(static_cast<uint16_t>(s[0] * (255 / max_value)));
+        } else {
+            for (c = 0; c < channels; c++) pixels.push_back(s[c]);
+            if (color_type == 2) pixels.push_back(static_cast<uint16_t>(max_value));
+        }
+    }
+    if (bit_depth == 16) {
+        k3imageObj::LoadFromMemory(expected, width, height, 1, width * out_channels * 2, width * height * out_channels * 2, format, pixels.data());
+    } else {
+        std::vector<uint8_t> bytes(pixels.begin(), pixels.end());
+        k3imageObj::LoadFromMemory(expected, width, height, 1, width * out_channels, width * height * out_channels, format, bytes.data());
+    }
+    return png;
+}
+
+static void TestPNGDecode()
+{
+    struct {
+        uint8_t color_type;
+        uint8_t bit_depths[5];
+    } types[] = {
+        { 0, { 1, 2, 4, 8, 16 } },
+        { 2, { 8, 16 } },
+        { 3, { 1, 2, 4, 8 } },
+        { 4, { 8, 16 } },
+        { 6, { 8, 16 } },
+    };
+    const uint32_t sizes[][2] = { { 1, 1 }, { 3, 2 }, { 9, 11 }, { 33, 17 }, { 130, 67 } };
+    const k3simdLevel levels[] = { k3simdLevel::NONE, k3math_GetMaxSimdLevel() };
+    const k3simdLevel start_level = k3math_GetSimdLevel();
+    uint32_t seed = 7;
+    char detail[128];
+    uint32_t t, b, interlace, s, l;
+
+    for (t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (b = 0; b < 5 && types[t].bit_depths[b]; b++) {
+            for (interlace = 0; interlace < 2; interlace++) {
+                for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                    k3image expected = k3imageObj::Create();
+                    std::vector<uint8_t> png = MakePNG(sizes[s][0], sizes[s][1], types[t].color_type, types[t].bit_depths[b], interlace != 0,
+                        &seed, expected);
+                    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                        snprintf(detail, sizeof(detail), "color type %u, %u bits%s, %ux%u, simd level %u", types[t].color_type,
+                            types[t].bit_depths[b], interlace ? ", interlaced" : "", sizes[s][0], sizes[s][1], static_cast<uint32_t>(levels[l]));
+                        k3math_SetSimdLevel(levels[l]);
+                        k3image loaded = k3imageObj::Create();
+                        k3imageObj::LoadFromEncodedMemory(loaded, png.data(), static_cast<uint32_t>(png.size()));
+                        Check(SameImage(expected, loaded), "png decode", detail);
+                    }
+                }
+            }
+        }
+    }
+    k3math_SetSimdLevel(start_level);
+}
+
+// ------------------------------------------------------------
+// Region loads
+// Each box is checked against the same box cut from a full load, first through the handlers' own region
+// readers and then through the fallback that loads the whole file
+
+static bool WriteFile(const char* file_name, const std::vector<uint8_t>& data)
+{
+    FILE* file_handle = fopen(file_name, "wb");
+    if (file_handle == NULL) return false;
+    bool ok = (fwrite(data.data(), 1, data.size(), file_handle) == data.size());
+    fclose(file_handle);
+    return ok;
+}
+
+// There is no JPEG saver, so the test files come straight from the bundled encoder
+static void WriteJPG(const char* file_name, uint32_t width, uint32_t height, bool subsample)
+{
+    FILE* file_handle = fopen(file_name, "wb");
+    if (file_handle == NULL) return;
+    std::vector<uint8_t> pixels = MakePixels(width, height, 3, false, width);
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, file_handle);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    if (!subsample) cinfo.comp_info[0].h_samp_factor = cinfo.comp_info[0].v_samp_factor = 1;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < height) {
+        JSAMPROW row = &pixels[cinfo.next_scanline * width * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    fclose(file_handle);
+}
+
+static void SaveDDS(const char* file_name, k3image src, uint32_t width, uint32_t height, k3fmt format)
+{
+    k3image img = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(img, src, width, height, 1, format);
+    img->SaveToFile(file_name, k3imageObj::FILE_HANDLER_DDS);
+}
+
+// Checks that region holds the box of full at x, y, z, in whole blocks for block compressed formats
+static bool SameBox(k3image full, k3image region, uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth)
+{
+    if (region->GetWidth() != width || region->GetHeight() != height || region->GetDepth() != depth) return false;
+    if (region->GetFormat() != full->GetFormat()) return false;
+    uint32_t block = k3imageObj::GetFormatBlockSize(full->GetFormat());
+    uint32_t block_bytes = k3imageObj::GetFormatSize(full->GetFormat());
+    uint32_t row_size = ((width + block - 1) / block) * block_bytes;
+    const uint8_t* pf = static_cast<const uint8_t*>(full->MapForRead());
+    const uint8_t* pr = static_cast<const uint8_t*>(region->MapForRead());
+    bool same = (pf != NULL && pr != NULL);
+    uint32_t slice, row;
+    for (slice = 0; same && slice < depth; slice++) {
+        for (row = 0; same && row < (height + block - 1) / block; row++) {
+            const uint8_t* a = pf + (z + slice) * full->GetSlicePitch() + (y / block + row) * full->GetPitch() + (x / block) * block_bytes;
+            const uint8_t* b = pr + slice * region->GetSlicePitch() + row * region->GetPitch();
+            same = (memcmp(a, b, row_size) == 0);
+        }
+    }
+    full->Unmap();
+    region->Unmap();
+    return same;
+}
+
+static void TestRegionsOfFile(const char* file_name, uint32_t* seed)
+{
+    k3image full = k3imageObj::Create();
+    k3imageObj::LoadFromFile(full, file_name);
+    uint32_t full_width = full->GetWidth(), full_height = full->GetHeight(), full_depth = full->GetDepth();
+    Check(full_width != 0, "region test file", file_name);
+    if (full_width == 0) return;
+    uint32_t block = k3imageObj::GetFormatBlockSize(full->GetFormat());
+    uint32_t pixel_size = k3imageObj::GetFormatSize(full->GetFormat());
+    char detail[160];
+    uint32_t i;
+
+    for (i = 0; i < 10; i++) {
+        uint32_t x = Random(seed) % full_width, y = Random(seed) % full_height, z = Random(seed) % full_depth;
+        if (i == 0) x = y = z = 0;
+        x -= x % block;
+        y -= y % block;
+        uint32_t width = 1 + Random(seed) % (full_width - x);
+        uint32_t height = 1 + Random(seed) % (full_height - y);
+        uint32_t depth = 1 + Random(seed) % (full_depth - z);
+        // whole rows, and a size of 0 reaching to the edges
+        if (i == 1) { x = 0; width = full_width; y = 0; }
+        if (i == 2) { x = 0; width = full_width; }
+        if (i == 3) width = height = depth = 0;
+        uint32_t box_width = width ? width : full_width - x;
+        uint32_t box_height = height ? height : full_height - y;
+        uint32_t box_depth = depth ? depth : full_depth - z;
+        snprintf(detail, sizeof(detail), "%s box %u %u %u %u %u %u", file_name, x, y, z, width, height, depth);
+
+        k3image region = k3imageObj::Create();
+        k3imageObj::LoadRegionFromFile(region, file_name, x, y, z, width, height, depth);
+        Check(SameBox(full, region, x, y, z, box_width, box_height, box_depth), "region from file", detail);
+
+        FILE* file_handle = fopen(file_name, "rb");
+        k3image region_fh = k3imageObj::Create();
+        k3imageObj::LoadRegionFromFileHandle(region_fh, file_handle, x, y, z, width, height, depth);
+        if (file_handle) fclose(file_handle);
+        Check(SameBox(full, region_fh, x, y, z, box_width, box_height, box_depth), "region from file handle", detail);
+
+        // a region resized and converted on the way in matches the same reformat of the box
+        if (block == 1 && i < 6) {
+            k3image reformatted = k3imageObj::Create();
+            k3imageObj::ReformatRegionFromFile(reformatted, file_name, x, y, z, width, height, depth,
+                box_width * 2 + 1, box_height + 3, box_depth, k3fmt::RGBA32_FLOAT);
+            const uint8_t* pf = static_cast<const uint8_t*>(full->MapForRead());
+            k3image expected = k3imageObj::Create();
+            k3imageObj::ReformatFromMemory(expected, box_width, box_height, box_depth, full->GetPitch(), full->GetSlicePitch(), full->GetFormat(),
+                pf + z * full->GetSlicePitch() + y * full->GetPitch() + x * pixel_size,
+                box_width * 2 + 1, box_height + 3, box_depth, k3fmt::RGBA32_FLOAT);
+            full->Unmap();
+            Check(SameImage(expected, reformatted), "reformatted region", detail);
+        }
+    }
+}
+
+static void TestRegions()
+{
+    const char* file_names[] = { "imagetest_rgba8.png", "imagetest_gray4.png", "imagetest_adam7.png",
+        "imagetest_rgba8.dds", "imagetest_rgb8.dds", "imagetest_bc1.dds", "imagetest_bc7.dds", "imagetest_volume.dds", "imagetest_r16f.dds",
+        "imagetest_420.jpg", "imagetest_444.jpg" };
+    const uint32_t num_files = sizeof(file_names) / sizeof(file_names[0]);
+    k3image_file_handler_t* handlers[] = { &k3DDSHandler, &k3PNGHandler, &k3JPGHandler };
+    const uint32_t num_handlers = sizeof(handlers) / sizeof(handlers[0]);
+    k3image_file_handler_t saved[num_handlers];
+    uint32_t seed = 11;
+    uint32_t f, h, pass;
+
+    std::vector<uint8_t> pixels = MakePixels(203, 157, 4, false, 1);
+    k3image src = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(src, 203, 157, 1, 203 * 4, 203 * 157 * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    src->SaveToFile(file_names[0], k3imageObj::FILE_HANDLER_PNG);
+    k3image expected = k3imageObj::Create();
+    WriteFile(file_names[1], MakePNG(130, 67, 0, 4, false, &seed, expected));
+    WriteFile(file_names[2], MakePNG(130, 67, 6, 8, true, &seed, expected));
+    SaveDDS(file_names[3], src, 0, 0, k3fmt::RGBA8_UNORM);
+    SaveDDS(file_names[4], src, 61, 45, k3fmt::RGB8_UNORM);
+    SaveDDS(file_names[5], src, 0, 0, k3fmt::BC1_UNORM);
+    SaveDDS(file_names[6], src, 37, 23, k3fmt::BC7_UNORM);
+    std::vector<uint8_t> volume = MakePixels(33, 17 * 9, 4, false, 2);
+    k3image vol = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(vol, 33, 17, 9, 33 * 4, 33 * 17 * 4, k3fmt::RGBA8_UNORM, volume.data());
+    vol->SaveToFile(file_names[7], k3imageObj::FILE_HANDLER_DDS);
+    k3imageObj::LoadFromMemory(vol, 33, 17, 9, 33 * 4, 33 * 17 * 4, k3fmt::R16_FLOAT, volume.data());
+    vol->SaveToFile(file_names[8], k3imageObj::FILE_HANDLER_DDS);
+    WriteJPG(file_names[9], 203, 157, true);
+    WriteJPG(file_names[10], 203, 157, false);
+
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            for (h = 0; h < num_handlers; h++) {
+                saved[h] = *handlers[h];
+                handlers[h]->LoadRegion = NULL;
+            }
+        }
+        for (f = 0; f < num_files; f++) TestRegionsOfFile(file_names[f], &seed);
+    }
+    for (h = 0; h < num_handlers; h++) *handlers[h] = saved[h];
+    for (f = 0; f < num_files; f++) remove(file_names[f]);
+}
+
+// ------------------------------------------------------------
+// BC1 to BC5 compression
+// FAST output is pinned by a crc of the blocks, from unorm8 and float sources alike, so a change to it
+// shows up here and not in someone's textures; each higher quality level has to do at least as well
+
+static uint32_t BlockCRC(k3image img)
+{
+    uint32_t block = k3imageObj::GetFormatBlockSize(img->GetFormat());
+    uint32_t row_size = ((img->GetWidth() + block - 1) / block) * k3imageObj::GetFormatSize(img->GetFormat());
+    const uint8_t* p = static_cast<const uint8_t*>(img->MapForRead());
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint32_t row;
+    for (row = 0; p != NULL && row < (img->GetHeight() + block - 1) / block; row++) {
+        crc = crc32(crc, p + row * img->GetPitch(), row_size);
+    }
+    img->Unmap();
+    return static_cast<uint32_t>(crc);
+}
+
+// Root mean square error over the first num_channels channels, after decoding img back to RGBA8
+static double RMSError(k3image img, const std::vector<uint8_t>& pixels, uint32_t num_channels)
+{
+    k3image decoded = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(decoded, img, 0, 0, 0, k3fmt::RGBA8_UNORM);
+    uint32_t width = img->GetWidth(), height = img->GetHeight();
+    const uint8_t* p = static_cast<const uint8_t*>(decoded->MapForRead());
+    double sum = 0.0;
+    uint32_t x, y, c;
+    for (y = 0; p != NULL && y < height; y++) {
+        for (x = 0; x < width; x++) {
+            for (c = 0; c < num_channels; c++) {
+                double diff = static_cast<double>(p[y * decoded->GetPitch() + 4 * x + c]) - pixels[4 * (y * width + x) + c];
+                sum += diff * diff;
+            }
+        }
+    }
+    decoded->Unmap();
+    return sqrt(sum / (width * height * num_channels));
+}
+
+static void TestDXTCompress()
+{
+    struct {
+        k3fmt format;
+        uint32_t num_channels;
+        const char* name;
+        uint32_t fast_crc;
+    } formats[] = {
+        { k3fmt::BC1_UNORM, 4, "BC1", 0xb90c76d8 },
+        { k3fmt::BC2_UNORM, 4, "BC2", 0x7c1c7b34 },
+        { k3fmt::BC3_UNORM, 4, "BC3", 0x52ec23b4 },
+        { k3fmt::BC4_UNORM, 1, "BC4", 0xd418584e },
+        { k3fmt::BC5_UNORM, 2, "BC5", 0x98283231 },
+    };
+    const uint32_t width = 70, height = 45;
+    std::vector<uint8_t> pixels = MakePixels(width, height, 4, false, 3);
+    k3image src = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(src, width, height, 1, width * 4, width * height * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    k3image src_float = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(src_float, src, 0, 0, 0, k3fmt::RGBA32_FLOAT);
+    k3compressQuality saved_quality = k3imageObj::GetDXTCompressQuality();
+    char detail[128];
+    uint32_t f, q;
+
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        double err[3];
+        for (q = 0; q < 3; q++) {
+            k3imageObj::SetDXTCompressQuality(static_cast<k3compressQuality>(q));
+            k3image img = k3imageObj::Create();
+            k3imageObj::ReformatFromImage(img, src, 0, 0, 0, formats[f].format);
+            err[q] = RMSError(img, pixels, formats[f].num_channels);
+            if (q == 0) {
+                uint32_t crc = BlockCRC(img);
+                snprintf(detail, sizeof(detail), "%s crc %08x, expected %08x", formats[f].name, crc, formats[f].fast_crc);
+                Check(crc == formats[f].fast_crc, "FAST block compression", detail);
+                k3image img_float = k3imageObj::Create();
+                k3imageObj::ReformatFromImage(img_float, src_float, 0, 0, 0, formats[f].format);
+                Check(BlockCRC(img_float) == formats[f].fast_crc, "FAST block compression from float", formats[f].name);
+            }
+        }
+        snprintf(detail, sizeof(detail), "%s error %.3f %.3f %.3f", formats[f].name, err[0], err[1], err[2]);
+        Check(err[1] <= err[0] && err[2] <= err[1], "quality levels", detail);
+    }
+    k3imageObj::SetDXTCompressQuality(saved_quality);
+}
+
+// ------------------------------------------------------------
+// Row converters
+// Every pair of uncompressed formats converted a row at a time, at every simd level, against
+// converting each pixel through the same intermediate as ReformatBuffer
+
+static void TestRowConverters()
+{
+    const k3fmt formats[] = {
+#define K3_PIXEL_CASE(F) k3fmt::F,
+        K3_PIXEL_FORMATS(K3_PIXEL_CASE)
+#undef K3_PIXEL_CASE
+    };
+    const uint32_t num_formats = sizeof(formats) / sizeof(formats[0]);
+    const k3simdLevel levels[] = { k3simdLevel::NONE, k3simdLevel::SSE41, k3simdLevel::AVX2, k3simdLevel::NEON };
+    // short rows run only the tail of the simd kernels, and the longest crosses the generic path's chunks
+    const uint32_t lengths[] = { 1, 3, 8, 17, 64, 131 };
+    const uint32_t max_pixels = 131;
+    const uint32_t max_size = 16;
+    k3simdLevel max_level = k3math_GetSimdLevel();
+    std::vector<uint8_t> src(max_pixels * max_size);
+    std::vector<uint8_t> expected(max_pixels * max_size + max_size);
+    std::vector<uint8_t> converted(max_pixels * max_size + max_size);
+    uint32_t seed = 23;
+    uint32_t l, s, d, n, i;
+    char detail[128];
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        if (k3math_SetSimdLevel(levels[l]) != levels[l]) continue;
+        for (s = 0; s < num_formats; s++) {
+            k3fmt src_format = formats[s];
+            uint32_t src_size = k3imageObj::GetFormatSize(src_format);
+            // encode random colors so that every source is a valid pixel of its format
+            memset(src.data(), 0, src.size());
+            for (i = 0; i < max_pixels; i++) {
+                float color[4];
+                uint32_t c;
+                for (c = 0; c < 4; c++) color[c] = (i % 5 == 0) ? static_cast<float>(c & 1) : (Random(&seed) & 0xffff) / 65535.0f;
+                k3imageObj::ConvertFromFloat4(src_format, color, &src[i * src_size]);
+            }
+            for (d = 0; d < num_formats; d++) {
+                k3fmt dest_format = formats[d];
+                uint32_t dest_size = k3imageObj::GetFormatSize(dest_format);
+                bool use_unorm8 = (k3imageObj::GetMaxComponentBits(src_format) <= 8 || k3imageObj::GetMaxComponentBits(dest_format) <= 8);
+                k3rowConverter rows;
+                bool selected = rows.Select(src_format, dest_format);
+                snprintf(detail, sizeof(detail), "level %u, format %u to %u", l, s, d);
+                Check(selected, "row converter select", detail);
+                if (!selected) continue;
+                bool same = true;
+                for (n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++) {
+                    uint32_t num_pixels = lengths[n];
+                    // the encoders leave unused bytes alone, so both buffers start out the same
+                    memset(expected.data(), 0x5a, expected.size());
+                    memset(converted.data(), 0x5a, converted.size());
+                    if (src_format == dest_format) {
+                        memcpy(expected.data(), src.data(), num_pixels * src_size);
+                    } else {
+                        for (i = 0; i < num_pixels; i++) {
+                            if (use_unorm8) {
+                                uint8_t unorm8[4];
+                                k3imageObj::ConvertToUnorm8(src_format, &src[i * src_size], unorm8);
+                                k3imageObj::ConvertFromUnorm8(dest_format, unorm8, &expected[i * dest_size]);
+                            } else {
+                                float float4[4];
+                                k3imageObj::ConvertToFloat4(src_format, &src[i * src_size], float4);
+                                k3imageObj::ConvertFromFloat4(dest_format, float4, &expected[i * dest_size]);
+                            }
+                        }
+                    }
+                    rows.Convert(src.data(), converted.data(), num_pixels);
+                    // nothing is written past the last pixel
+                    same = same && (memcmp(expected.data(), converted.data(), num_pixels * dest_size + max_size) == 0);
+                    if (src_size == dest_size) {
+                        std::vector<uint8_t> row(src.begin(), src.begin() + num_pixels * src_size);
+                        // bytes the encoder skips keep the source's value when converting in place
+                        std::vector<uint8_t> in_place_expected(row);
+                        for (i = 0; i < num_pixels && src_format != dest_format; i++) {
+                            uint8_t* p = &in_place_expected[i * dest_size];
+                            if (use_unorm8) {
+                                uint8_t unorm8[4];
+                                k3imageObj::ConvertToUnorm8(src_format, p, unorm8);
+                                k3imageObj::ConvertFromUnorm8(dest_format, unorm8, p);
+                            } else {
+                                float float4[4];
+                                k3imageObj::ConvertToFloat4(src_format, p, float4);
+                                k3imageObj::ConvertFromFloat4(dest_format, float4, p);
+                            }
+                        }
+                        rows.Convert(row.data(), row.data(), num_pixels);
+                        same = same && (row == in_place_expected);
+                    }
+                }
+                Check(same, "row converter matches per pixel conversion", detail);
+            }
+        }
+    }
+    k3math_SetSimdLevel(max_level);
+}
+
+// ------------------------------------------------------------
+// Parallel reformats
+// The same reformat run serially, across the built in pool and across a pool that runs its tasks
+// backwards has to write the same bytes, for every kind of task the reformat splits into
+
+// Compares the block rows of every slice of a and b, which must have the same size and format
+static bool SameBlocks(k3image a, k3image b)
+{
+    if (a->GetWidth() != b->GetWidth() || a->GetHeight() != b->GetHeight() || a->GetDepth() != b->GetDepth() ||
+        a->GetFormat() != b->GetFormat()) {
+        return false;
+    }
+    uint32_t block = k3imageObj::GetFormatBlockSize(a->GetFormat());
+    uint32_t row_size = ((a->GetWidth() + block - 1) / block) * k3imageObj::GetFormatSize(a->GetFormat());
+    uint32_t block_rows = (a->GetHeight() + block - 1) / block;
+    const uint8_t* pa = static_cast<const uint8_t*>(a->MapForRead());
+    const uint8_t* pb = static_cast<const uint8_t*>(b->MapForRead());
+    bool same = (pa != NULL && pb != NULL);
+    uint32_t z, row;
+    for (z = 0; same && z < a->GetDepth(); z++) {
+        for (row = 0; same && row < block_rows; row++) {
+            same = (memcmp(pa + z * a->GetSlicePitch() + row * a->GetPitch(), pb + z * b->GetSlicePitch() + row * b->GetPitch(), row_size) == 0);
+        }
+    }
+    a->Unmap();
+    b->Unmap();
+    return same;
+}
+
+static void TestParallelReformat()
+{
+    const uint32_t width = 70, height = 45, depth = 3;
+    std::vector<uint8_t> pixels = MakePixels(width, height * depth, 4, false, 11);
+    k3image src = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(src, width, height, 1, width * 4, width * height * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    k3image volume = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(volume, width, height, depth, width * 4, width * height * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    k3image src_bc1 = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(src_bc1, src, 0, 0, 0, k3fmt::BC1_UNORM);
+    k3image src_bc3 = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(src_bc3, src, 0, 0, 0, k3fmt::BC3_UNORM);
+    const float rotate[16] = {
+        0.8f, -0.6f, 0.0f, 0.1f,
+        0.6f, 0.8f, 0.0f, -0.05f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    // destination sizes that are not multiples of 4 leave partial blocks on the right and bottom
+    struct {
+        k3image src;
+        uint32_t width, height, depth;
+        k3fmt format;
+        const float* transform;
+        const char* name;
+    } cases[] = {
+        { src, 0, 0, 0, k3fmt::BGRA8_UNORM, NULL, "RGBA8 to BGRA8, whole rows" },
+        { src, 35, 15, 1, k3fmt::RGBA8_UNORM, NULL, "RGBA8 box filtered down 2x3" },
+        { src, 33, 29, 1, k3fmt::RGBA16_UNORM, NULL, "RGBA8 resampled to RGBA16" },
+        { src, 70, 45, 1, k3fmt::RGBA8_UNORM, rotate, "RGBA8 rotated" },
+        { volume, 35, 15, 3, k3fmt::RGBA32_FLOAT, NULL, "RGBA8 volume to float" },
+        { src, 0, 0, 0, k3fmt::BC1_UNORM, NULL, "BC1 encode 70x45" },
+        { src, 35, 15, 1, k3fmt::BC3_UNORM, NULL, "BC3 encode 35x15" },
+        { src, 33, 29, 1, k3fmt::BC4_UNORM, NULL, "BC4 encode 33x29" },
+        { src, 0, 0, 0, k3fmt::BC7_UNORM, NULL, "BC7 encode 70x45" },
+        { src_bc1, 0, 0, 0, k3fmt::RGBA8_UNORM, NULL, "BC1 decode" },
+        { src_bc3, 35, 15, 1, k3fmt::RGBA8_UNORM, NULL, "BC3 decode down 2x3" },
+        { src_bc3, 0, 0, 0, k3fmt::BC3_UNORM, NULL, "BC3 copy" },
+        { src_bc1, 35, 15, 1, k3fmt::BC1_UNORM, NULL, "BC1 down 2x3 to BC1" },
+    };
+    k3thread_pool_t reverse_pool = { NULL, ReversePoolGetNumThreads, ReversePoolRun };
+    uint32_t saved_threshold = k3imageObj::GetParallelThreshold();
+    uint32_t c;
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        k3image serial = k3imageObj::Create();
+        k3image parallel = k3imageObj::Create();
+        k3image reversed = k3imageObj::Create();
+        k3image never = k3imageObj::Create();
+        // 0 keeps the reformat serial, 1 splits any reformat, and the largest threshold is never reached
+        k3imageObj::SetParallelThreshold(0);
+        k3imageObj::TransformFromImage(serial, cases[c].src, cases[c].width, cases[c].height, cases[c].depth, cases[c].format,
+            cases[c].transform, k3texAddr::CLAMP, k3texAddr::WRAP, k3texAddr::CLAMP);
+        k3imageObj::SetParallelThreshold(1);
+        k3imageObj::TransformFromImage(parallel, cases[c].src, cases[c].width, cases[c].height, cases[c].depth, cases[c].format,
+            cases[c].transform, k3texAddr::CLAMP, k3texAddr::WRAP, k3texAddr::CLAMP);
+        k3parallel::SetThreadPool(&reverse_pool);
+        k3imageObj::TransformFromImage(reversed, cases[c].src, cases[c].width, cases[c].height, cases[c].depth, cases[c].format,
+            cases[c].transform, k3texAddr::CLAMP, k3texAddr::WRAP, k3texAddr::CLAMP);
+        k3parallel::SetThreadPool(NULL);
+        k3imageObj::SetParallelThreshold(0xffffffff);
+        k3imageObj::TransformFromImage(never, cases[c].src, cases[c].width, cases[c].height, cases[c].depth, cases[c].format,
+            cases[c].transform, k3texAddr::CLAMP, k3texAddr::WRAP, k3texAddr::CLAMP);
+
+        Check(SameBlocks(serial, parallel), "parallel reformat", cases[c].name);
+        Check(SameBlocks(serial, reversed), "parallel reformat with tasks run backwards", cases[c].name);
+        Check(SameBlocks(serial, never), "reformat under an unreachable threshold", cases[c].name);
+    }
+    k3imageObj::SetParallelThreshold(saved_threshold);
+}
+
+// ------------------------------------------------------------
+// Compressed sources
+// BC1 and BC3 decoded at 1:1 and box filtered down at integer ratios, which read the source through
+// k3sourceBlockCache, against the same reformat of a source decoded a block at a time beforehand,
+// and within two steps of the transform path, under every address mode
+
+// Decodes every block of a compressed image into an RGBA8 image of the same size
+static k3image DecodeBlocks(k3image src)
+{
+    uint32_t width = src->GetWidth(), height = src->GetHeight();
+    uint32_t format_size = k3imageObj::GetFormatSize(src->GetFormat());
+    std::vector<uint8_t> pixels(width * height * 4);
+    const uint8_t* blocks = static_cast<const uint8_t*>(src->MapForRead());
+    uint32_t bx, by, x, y;
+    for (by = 0; by < height; by += 4) {
+        for (bx = 0; bx < width; bx += 4) {
+            uint8_t block[16 * 4];
+            k3imageObj::ConvertToUnorm8(src->GetFormat(), blocks + (by / 4) * src->GetPitch() + (bx / 4) * format_size, block);
+            for (y = by; y < by + 4 && y < height; y++) {
+                for (x = bx; x < bx + 4 && x < width; x++) memcpy(&pixels[(y * width + x) * 4], &block[((y - by) * 4 + x - bx) * 4], 4);
+            }
+        }
+    }
+    src->Unmap();
+    k3image decoded = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(decoded, width, height, 1, width * 4, width * height * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    return decoded;
+}
+
+// Largest difference between any two bytes of a pair of RGBA8 images of the same size
+static uint32_t MaxDifference(k3image a, k3image b)
+{
+    const uint8_t* pa = static_cast<const uint8_t*>(a->MapForRead());
+    const uint8_t* pb = static_cast<const uint8_t*>(b->MapForRead());
+    uint32_t max_diff = 0;
+    uint32_t x, y;
+    for (y = 0; y < a->GetHeight(); y++) {
+        for (x = 0; x < a->GetWidth() * 4; x++) {
+            int32_t diff = pa[y * a->GetPitch() + x] - pb[y * b->GetPitch() + x];
+            if (static_cast<uint32_t>(abs(diff)) > max_diff) max_diff = abs(diff);
+        }
+    }
+    a->Unmap();
+    b->Unmap();
+    return max_diff;
+}
+
+static void TestBlockCache()
+{
+    const uint32_t width = 70, height = 45;
+    const float identity[16] = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+    const k3fmt formats[] = { k3fmt::BC1_UNORM, k3fmt::BC3_UNORM };
+    // 5 rows to a destination row makes a task read 20 rows, so several tasks share none of their blocks
+    const uint32_t sizes[][2] = { { 70, 45 }, { 35, 15 }, { 14, 9 }, { 7, 5 } };
+    const k3texAddr modes[] = { k3texAddr::WRAP, k3texAddr::MIRROR, k3texAddr::CLAMP, k3texAddr::MIRROR_ONCE };
+    std::vector<uint8_t> pixels = MakePixels(width, height, 4, false, 31);
+    k3image src = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(src, width, height, 1, width * 4, width * height * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    uint32_t f, s, m;
+    char detail[96];
+
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        k3image compressed = k3imageObj::Create();
+        k3imageObj::ReformatFromImage(compressed, src, 0, 0, 0, formats[f]);
+        k3image decoded = DecodeBlocks(compressed);
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                k3image cached = k3imageObj::Create();
+                k3image expected = k3imageObj::Create();
+                k3image transformed = k3imageObj::Create();
+                k3imageObj::TransformFromImage(cached, compressed, sizes[s][0], sizes[s][1], 1, k3fmt::RGBA8_UNORM,
+                    NULL, modes[m], modes[m], modes[m]);
+                k3imageObj::TransformFromImage(expected, decoded, sizes[s][0], sizes[s][1], 1, k3fmt::RGBA8_UNORM,
+                    NULL, modes[m], modes[m], modes[m]);
+                k3imageObj::TransformFromImage(transformed, compressed, sizes[s][0], sizes[s][1], 1, k3fmt::RGBA8_UNORM,
+                    identity, modes[m], modes[m], modes[m]);
+                snprintf(detail, sizeof(detail), "BC%u to %ux%u, address mode %u", (f == 0) ? 1 : 3, sizes[s][0], sizes[s][1], m);
+                Check(SameBlocks(cached, expected), "compressed source matches the decoded source", detail);
+                // the transform path decodes the interpolated BC colors to float and rounds its average,
+                // where the box filter works on the unorm8 decode and truncates, so each can cost a step
+                Check(MaxDifference(cached, transformed) <= 2, "compressed source matches the transform path", detail);
+            }
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Mip generation
+// The chain has GetNumMipLevels - 1 levels of the expected sizes, the box filter averages a gradient
+// exactly, and with srgb set only the color is filtered in linear space, never the alpha
+
+// An RGBA32_FLOAT image whose red and green count pixels along x and y, with blue on z and alpha at 1
+static k3image MakeGradient(uint32_t width, uint32_t height, uint32_t depth)
+{
+    std::vector<float> pixels(4 * width * height * depth);
+    uint32_t x, y, z;
+    for (z = 0; z < depth; z++) {
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                float* p = &pixels[4 * ((z * height + y) * width + x)];
+                p[0] = static_cast<float>(x);
+                p[1] = static_cast<float>(y);
+                p[2] = static_cast<float>(z);
+                p[3] = 1.0f;
+            }
+        }
+    }
+    k3image img = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(img, width, height, depth, 16 * width, 16 * width * height, k3fmt::RGBA32_FLOAT, pixels.data());
+    return img;
+}
+
+static void TestGenerateMips()
+{
+    const uint32_t sizes[][3] = { { 1, 1, 1 }, { 2, 1, 1 }, { 7, 3, 1 }, { 64, 64, 1 }, { 100, 37, 1 }, { 1, 300, 1 }, { 9, 4, 5 }, { 16, 16, 16 } };
+    const k3mipFilter filters[] = { k3mipFilter::BOX, k3mipFilter::TRIANGLE, k3mipFilter::KAISER, k3mipFilter::LANCZOS };
+    const k3simdLevel levels[] = { k3simdLevel::NONE, k3simdLevel::SSE41, k3simdLevel::AVX2, k3simdLevel::NEON };
+    k3simdLevel max_level = k3math_GetSimdLevel();
+    k3image mips[16];
+    uint32_t s, f, i, l, x, y, z;
+    char detail[96];
+
+    // chain length and level sizes, for every filter
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t width = sizes[s][0], height = sizes[s][1], depth = sizes[s][2];
+        uint32_t largest = (width > height) ? width : height;
+        if (depth > largest) largest = depth;
+        uint32_t expected_levels = 1;
+        while ((largest >> expected_levels) != 0) expected_levels++;
+        snprintf(detail, sizeof(detail), "%ux%ux%u", width, height, depth);
+        Check(k3imageObj::GetNumMipLevels(width, height, depth) == expected_levels, "mip level count", detail);
+        k3image src = MakeGradient(width, height, depth);
+        for (f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+            for (i = 0; i < 16; i++) mips[i] = NULL;
+            uint32_t written = k3imageObj::GenerateMips(src, 16, mips, filters[f], false);
+            Check(written == expected_levels - 1, "mips written for a full chain", detail);
+            bool sizes_ok = true;
+            for (i = 0; i < written; i++) {
+                uint32_t w = width >> (i + 1), h = height >> (i + 1), d = depth >> (i + 1);
+                sizes_ok = sizes_ok && mips[i] != NULL && mips[i]->GetFormat() == k3fmt::RGBA32_FLOAT &&
+                    mips[i]->GetWidth() == ((w) ? w : 1) && mips[i]->GetHeight() == ((h) ? h : 1) && mips[i]->GetDepth() == ((d) ? d : 1);
+            }
+            Check(sizes_ok, "mip level sizes", detail);
+            Check(written == 0 || (mips[written - 1]->GetWidth() == 1 && mips[written - 1]->GetHeight() == 1 && mips[written - 1]->GetDepth() == 1),
+                "mip chain ends at 1x1x1", detail);
+        }
+        // fewer levels than the chain holds stop where asked
+        if (expected_levels > 2) {
+            for (i = 0; i < 16; i++) mips[i] = NULL;
+            Check(k3imageObj::GenerateMips(src, 1, mips, k3mipFilter::BOX, false) == 1 && mips[1] == NULL, "partial mip chain", detail);
+        }
+    }
+
+    // each box filtered pixel is the average of the 2x2x2 pixels under it, which on a gradient is
+    // the mean of the coordinates, and every simd level gets the same bits
+    k3image gradient = MakeGradient(32, 16, 4);
+    std::vector<float> first_level;
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        if (k3math_SetSimdLevel(levels[l]) != levels[l]) continue;
+        for (i = 0; i < 16; i++) mips[i] = NULL;
+        uint32_t written = k3imageObj::GenerateMips(gradient, 16, mips, k3mipFilter::BOX, false);
+        bool values_ok = (written == 5);
+        for (i = 0; values_ok && i < written; i++) {
+            // level i + 1 averages 2^(i + 1) pixels along each axis that is still longer than 1
+            k3image mip = mips[i];
+            const uint8_t* data = static_cast<const uint8_t*>(mip->MapForRead());
+            for (z = 0; z < mip->GetDepth(); z++) {
+                for (y = 0; y < mip->GetHeight(); y++) {
+                    for (x = 0; x < mip->GetWidth(); x++) {
+                        const float* p = reinterpret_cast<const float*>(data + z * mip->GetSlicePitch() + y * mip->GetPitch()) + 4 * x;
+                        float span_x = 32.0f / mip->GetWidth(), span_y = 16.0f / mip->GetHeight(), span_z = 4.0f / mip->GetDepth();
+                        values_ok = values_ok && p[0] == x * span_x + (span_x - 1.0f) / 2.0f && p[1] == y * span_y + (span_y - 1.0f) / 2.0f &&
+                            p[2] == z * span_z + (span_z - 1.0f) / 2.0f && p[3] == 1.0f;
+                    }
+                }
+            }
+            if (i == 0 && first_level.empty()) {
+                first_level.assign(reinterpret_cast<const float*>(data), reinterpret_cast<const float*>(data + mip->GetDataSize()));
+            } else if (i == 0) {
+                values_ok = values_ok && memcmp(first_level.data(), data, first_level.size() * sizeof(float)) == 0;
+            }
+            mip->Unmap();
+        }
+        snprintf(detail, sizeof(detail), "simd level %u", l);
+        Check(values_ok, "box filtered gradient", detail);
+    }
+    k3math_SetSimdLevel(max_level);
+
+    // black and white columns, transparent and opaque: srgb moves the color to the linear midpoint,
+    // while the alpha is averaged as it is either way
+    const float stripes[4 * 4] = {
+        0.0f, 0.0f, 0.0f, 0.0f,  1.0f, 1.0f, 1.0f, 1.0f,
+        0.0f, 0.0f, 0.0f, 0.0f,  1.0f, 1.0f, 1.0f, 1.0f
+    };
+    k3image stripe_img = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(stripe_img, 2, 2, 1, 32, 64, k3fmt::RGBA32_FLOAT, stripes);
+    k3image linear_mip = NULL;
+    k3image srgb_mip = NULL;
+    k3imageObj::GenerateMips(stripe_img, 1, &linear_mip, k3mipFilter::BOX, false);
+    k3imageObj::GenerateMips(stripe_img, 1, &srgb_mip, k3mipFilter::BOX, true);
+    const float* linear_px = static_cast<const float*>(linear_mip->MapForRead());
+    const float* srgb_px = static_cast<const float*>(srgb_mip->MapForRead());
+    float srgb_half = 1.055f * powf(0.5f, 1.0f / 2.4f) - 0.055f;
+    Check(linear_px[0] == 0.5f && linear_px[1] == 0.5f && linear_px[2] == 0.5f, "linear mip color", "float stripes");
+    Check(fabsf(srgb_px[0] - srgb_half) < 1e-5f && fabsf(srgb_px[1] - srgb_half) < 1e-5f && fabsf(srgb_px[2] - srgb_half) < 1e-5f,
+        "srgb mip color", "float stripes");
+    Check(linear_px[3] == 0.5f && srgb_px[3] == 0.5f, "mip alpha unaffected by srgb", "float stripes");
+    linear_mip->Unmap();
+    srgb_mip->Unmap();
+
+    // the same through RGBA8, where the result lands within a step of the float one
+    k3image stripe8 = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(stripe8, stripe_img, 0, 0, 0, k3fmt::RGBA8_UNORM);
+    linear_mip = NULL;
+    srgb_mip = NULL;
+    k3imageObj::GenerateMips(stripe8, 1, &linear_mip, k3mipFilter::BOX, false);
+    k3imageObj::GenerateMips(stripe8, 1, &srgb_mip, k3mipFilter::BOX, true);
+    const uint8_t* linear8 = static_cast<const uint8_t*>(linear_mip->MapForRead());
+    const uint8_t* srgb8 = static_cast<const uint8_t*>(srgb_mip->MapForRead());
+    Check(abs(linear8[0] - 128) <= 1 && abs(srgb8[0] - static_cast<int32_t>(srgb_half * 255.0f + 0.5f)) <= 1, "RGBA8 mip color", "stripes");
+    Check(abs(linear8[3] - 128) <= 1 && srgb8[3] == linear8[3], "RGBA8 mip alpha unaffected by srgb", "stripes");
+    linear_mip->Unmap();
+    srgb_mip->Unmap();
+}
+
+// ------------------------------------------------------------
+// DDS subresources
+// Images with mips, array slices, cubes and volumes saved to DDS load back with the same layout and
+// bytes; formats the legacy header can't hold as an array, and files that only hold one image,
+// report what was left out
+
+// Compares every subresource of a and b, in whole block rows
+static bool SameSubresources(k3image a, k3image b)
+{
+    if (a->GetMipLevels() != b->GetMipLevels() || a->GetArraySize() != b->GetArraySize() || a->IsCubemap() != b->IsCubemap() ||
+        a->GetWidth() != b->GetWidth() || a->GetHeight() != b->GetHeight() || a->GetDepth() != b->GetDepth() || a->GetFormat() != b->GetFormat()) {
+        return false;
+    }
+    uint32_t format_size = k3imageObj::GetFormatSize(a->GetFormat());
+    uint32_t block = k3imageObj::GetFormatBlockSize(a->GetFormat());
+    const uint8_t* pa = static_cast<const uint8_t*>(a->MapForRead());
+    const uint8_t* pb = static_cast<const uint8_t*>(b->MapForRead());
+    bool same = (pa != NULL && pb != NULL);
+    uint32_t array_slice, mip, z, row;
+    for (array_slice = 0; same && array_slice < a->GetArraySize(); array_slice++) {
+        for (mip = 0; same && mip < a->GetMipLevels(); mip++) {
+            k3subresourceDesc da, db;
+            a->GetSubresourceDesc(mip, array_slice, &da);
+            b->GetSubresourceDesc(mip, array_slice, &db);
+            uint32_t row_size = ((da.width + block - 1) / block) * format_size;
+            for (z = 0; same && z < da.depth; z++) {
+                for (row = 0; same && row < (da.height + block - 1) / block; row++) {
+                    same = (memcmp(pa + da.offset + z * da.slice_pitch + row * da.pitch, pb + db.offset + z * db.slice_pitch + row * db.pitch, row_size) == 0);
+                }
+            }
+        }
+    }
+    a->Unmap();
+    b->Unmap();
+    return same;
+}
+
+static k3image MakeSubresources(uint32_t width, uint32_t height, uint32_t depth, k3fmt format,
+    uint32_t mip_levels, uint32_t array_size, bool cubemap, uint32_t* seed)
+{
+    k3image img = k3imageObj::Create();
+    img->SetDimensions(width, height, depth, format, mip_levels, array_size, cubemap);
+    uint8_t* data = static_cast<uint8_t*>(img->MapForWrite());
+    uint32_t size = img->GetDataSize();
+    uint32_t i;
+    // random halves of float formats are still finite
+    bool is_float = (format == k3fmt::RGBA16_FLOAT || format == k3fmt::RGBA32_FLOAT);
+    for (i = 0; i < size; i++) data[i] = static_cast<uint8_t>(Random(seed)) & ((is_float && (i & 1)) ? 0x3f : 0xff);
+    img->Unmap();
+    return img;
+}
+
+static void TestDDSSubresources()
+{
+    struct {
+        uint32_t width, height, depth;
+        k3fmt format;
+        uint32_t mip_levels, array_size;
+        bool cubemap;
+        const char* name;
+    } cases[] = {
+        { 20, 12, 1, k3fmt::RGBA8_UNORM, 5, 1, false, "RGBA8 with a full mip chain" },
+        { 32, 16, 1, k3fmt::BC1_UNORM, 6, 3, false, "BC1 array of 3 with mips" },
+        { 13, 7, 1, k3fmt::BGRA8_UNORM, 1, 4, false, "BGRA8 array of 4" },
+        { 16, 16, 1, k3fmt::BGRA8_UNORM, 5, 6, true, "BGRA8 cubemap with mips" },
+        { 8, 8, 1, k3fmt::BC3_UNORM, 4, 12, true, "BC3 array of 2 cubes with mips" },
+        { 8, 4, 4, k3fmt::RGBA16_FLOAT, 4, 1, false, "RGBA16F volume with mips" },
+        { 16, 8, 1, k3fmt::BC7_UNORM, 3, 2, false, "BC7 array of 2 with mips" },
+        { 4, 4, 1, k3fmt::R8_UNORM, 3, 6, true, "R8 cubemap with mips" },
+    };
+    uint32_t seed = 41;
+    uint32_t c;
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        k3image img = MakeSubresources(cases[c].width, cases[c].height, cases[c].depth, cases[c].format,
+            cases[c].mip_levels, cases[c].array_size, cases[c].cubemap, &seed);
+        img->SaveToFile("imagetest.dds", k3imageObj::FILE_HANDLER_DDS);
+        k3image loaded = k3imageObj::Create();
+        k3imageObj::LoadFromFile(loaded, "imagetest.dds");
+        Check(SameSubresources(img, loaded), "dds subresources round trip", cases[c].name);
+        // the same bytes arrive through memory as through the file
+        std::vector<uint8_t> file = ReadFile("imagetest.dds");
+        k3image from_memory = k3imageObj::Create();
+        k3imageObj::LoadFromEncodedMemory(from_memory, file.data(), static_cast<uint32_t>(file.size()));
+        Check(SameSubresources(img, from_memory), "dds subresources from memory", cases[c].name);
+    }
+
+    // sRGB files load as their UNORM counterparts with the same bytes; the DX10 header's format
+    // follows the 128 byte legacy header
+    const uint32_t dx_formats[][2] = { { 98, 99 }, { 28, 29 }, { 71, 72 } };
+    const k3fmt srgb_formats[] = { k3fmt::BC7_UNORM, k3fmt::RGBA8_UNORM, k3fmt::BC1_UNORM };
+    const char* srgb_names[] = { "BC7_UNORM_SRGB", "R8G8B8A8_UNORM_SRGB", "BC1_UNORM_SRGB" };
+    for (c = 0; c < sizeof(srgb_formats) / sizeof(srgb_formats[0]); c++) {
+        k3image img = MakeSubresources(16, 8, 1, srgb_formats[c], 1, 2, false, &seed);
+        img->SaveToFile("imagetest.dds", k3imageObj::FILE_HANDLER_DDS);
+        std::vector<uint8_t> file = ReadFile("imagetest.dds");
+        bool unorm = (file.size() > 132 && file[128] == dx_formats[c][0]);
+        if (unorm) file[128] = static_cast<uint8_t>(dx_formats[c][1]);
+        k3image from_memory = k3imageObj::Create();
+        k3imageObj::LoadFromEncodedMemory(from_memory, file.data(), static_cast<uint32_t>(file.size()));
+        Check(unorm && SameSubresources(img, from_memory), "dds sRGB format loads as UNORM", srgb_names[c]);
+    }
+
+    // RGBX8 has no DX10 header format, so an array of it keeps only its first slice, mips included
+    k3image rgbx = MakeSubresources(8, 8, 1, k3fmt::RGBX8_UNORM, 4, 3, false, &seed);
+    rgbx->SaveToFile("imagetest.dds", k3imageObj::FILE_HANDLER_DDS);
+    bool reported = error_seen;
+    error_seen = false;
+    Check(reported, "dds array without a DX10 format reports the lost slices", "RGBX8 array of 3");
+    k3image first_slice = k3imageObj::Create();
+    first_slice->SetDimensions(8, 8, 1, k3fmt::RGBX8_UNORM, 4, 1, false);
+    memcpy(first_slice->MapForWrite(), rgbx->MapForRead(), first_slice->GetDataSize());
+    first_slice->Unmap();
+    rgbx->Unmap();
+    k3image loaded = k3imageObj::Create();
+    k3imageObj::LoadFromFile(loaded, "imagetest.dds");
+    Check(SameSubresources(first_slice, loaded), "dds array without a DX10 format keeps the first slice", "RGBX8 array of 3");
+
+    // a PNG holds a single image
+    k3image mipped = MakeSubresources(8, 8, 1, k3fmt::RGBA8_UNORM, 4, 1, false, &seed);
+    mipped->SaveToFile("imagetest.png", k3imageObj::FILE_HANDLER_PNG);
+    reported = error_seen;
+    error_seen = false;
+    Check(reported, "saving mips to a single image file reports the lost levels", "png");
+}
+
+// ------------------------------------------------------------
+// BC6H and BC7
+// Blocks packed here field by field from the format spec decode to the colors worked out from the
+// same spec: every BC7 mode, with rotations and index selection, and the BC6H modes whose fields
+// run in order; every other BC6H mode decodes a block of zero fields to black, as do the reserved
+// modes. Encoding then decoding holds a PSNR floor at each quality level
+
+// Packs fields into a 128 bit block, from bit 0 of the first byte
+struct BlockWriter {
+    uint8_t bytes[16];
+    uint32_t pos;
+
+    BlockWriter() : pos(0) { memset(bytes, 0, sizeof(bytes)); }
+    void Put(uint32_t value, uint32_t num_bits)
+    {
+        uint32_t b;
+        for (b = 0; b < num_bits; b++, pos++) {
+            if ((value >> b) & 1) bytes[pos / 8] |= static_cast<uint8_t>(1 << (pos % 8));
+        }
+    }
+    k3BPTCBlock Block() const
+    {
+        k3BPTCBlock block;
+        memcpy(&block, bytes, sizeof(block));
+        return block;
+    }
+};
+
+static const uint8_t bptc_weights[5][16] = {
+    { 0 }, { 0 },
+    { 0, 21, 43, 64 },
+    { 0, 9, 18, 27, 37, 46, 55, 64 },
+    { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 }
+};
+
+static uint32_t BPTCBlend(uint32_t e0, uint32_t e1, uint32_t index_bits, uint32_t index)
+{
+    uint32_t w = bptc_weights[index_bits][index];
+    return ((64 - w) * e0 + w * e1 + 32) >> 6;
+}
+
+// Partition 0 of the 1, 2 and 3 subset tables: columns 0-1 and 2-3 split for 2 subsets, with the
+// bottom left taking the third subset; the anchors of the later subsets are pixels 15, and 3 and 15
+static uint32_t BPTCSubset(uint32_t num_subsets, uint32_t pixel)
+{
+    uint32_t x = pixel % 4, y = pixel / 4;
+    if (num_subsets == 1) return 0;
+    if (num_subsets == 2) return (x < 2) ? 0 : 1;
+    if (y == 3 || (y == 2 && x > 0 && x < 3)) return 2;
+    return (x < 2) ? 0 : 1;
+}
+
+static bool BPTCIsAnchor(uint32_t num_subsets, uint32_t pixel)
+{
+    return pixel == 0 || (num_subsets > 1 && pixel == 15) || (num_subsets == 3 && pixel == 3);
+}
+
+static float HalfToFloat(uint32_t h)
+{
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0) return ldexpf(static_cast<float>(mantissa), -24);
+    return ldexpf(static_cast<float>(mantissa | 0x400), static_cast<int32_t>(exponent) - 25);
+}
+
+static void TestBC7KnownBlocks(uint32_t* seed)
+{
+    // subsets, partition bits, rotation bits, index select bits, color bits, alpha bits,
+    // endpoint p-bits, shared p-bits, index bits, second index bits
+    const uint32_t modes[8][10] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+    };
+    uint32_t mode, rotation, index_select, trial;
+    char detail[96];
+
+    for (mode = 0; mode < 8; mode++) {
+        const uint32_t* m = modes[mode];
+        uint32_t num_subsets = m[0], color_bits = m[4], alpha_bits = m[5];
+        uint32_t num_rotations = 1u << m[2], num_selects = 1u << m[3];
+        for (rotation = 0; rotation < num_rotations; rotation++) {
+            for (index_select = 0; index_select < num_selects; index_select++) {
+                bool same = true;
+                for (trial = 0; trial < 4; trial++) {
+                    uint32_t endpoints[3][2][4];
+                    uint32_t pbits[3][2];
+                    uint32_t index[16], index2[16];
+                    uint32_t s, e, c, i;
+                    BlockWriter w;
+                    w.Put(1u << mode, mode + 1);
+                    w.Put(0, m[1]);
+                    w.Put(rotation, m[2]);
+                    w.Put(index_select, m[3]);
+                    for (c = 0; c < 4; c++) {
+                        uint32_t bits = (c < 3) ? color_bits : alpha_bits;
+                        for (s = 0; s < num_subsets; s++) {
+                            for (e = 0; e < 2; e++) {
+                                endpoints[s][e][c] = Random(seed) & ((1u << bits) - 1);
+                                w.Put(endpoints[s][e][c], bits);
+                            }
+                        }
+                    }
+                    for (s = 0; s < num_subsets; s++) {
+                        for (e = 0; e < 2; e++) {
+                            if (m[6]) pbits[s][e] = Random(seed) & 1;
+                            else if (m[7]) pbits[s][e] = (e == 0) ? Random(seed) & 1 : pbits[s][0];
+                            else pbits[s][e] = 0;
+                            if (m[6] || (m[7] && e == 0)) w.Put(pbits[s][e], 1);
+                        }
+                    }
+                    for (i = 0; i < 16; i++) {
+                        uint32_t bits = m[8] - (BPTCIsAnchor(num_subsets, i) ? 1 : 0);
+                        index[i] = Random(seed) & ((1u << bits) - 1);
+                        w.Put(index[i], bits);
+                    }
+                    for (i = 0; i < 16 && m[9]; i++) {
+                        uint32_t bits = m[9] - ((i == 0) ? 1 : 0);
+                        index2[i] = Random(seed) & ((1u << bits) - 1);
+                        w.Put(index2[i], bits);
+                    }
+                    k3BPTCBlock block = w.Block();
+                    uint8_t decoded[64];
+                    k3imageObj::ConvertToUnorm8(k3fmt::BC7_UNORM, &block, decoded);
+
+                    for (i = 0; i < 16; i++) {
+                        uint32_t rgba[4];
+                        s = BPTCSubset(num_subsets, i);
+                        // the color and alpha index sets swap with index select
+                        uint32_t color_index = index[i], color_index_bits = m[8];
+                        uint32_t alpha_index = (m[9]) ? index2[i] : index[i], alpha_index_bits = (m[9]) ? m[9] : m[8];
+                        if (index_select) {
+                            color_index = index2[i];
+                            color_index_bits = m[9];
+                            alpha_index = index[i];
+                            alpha_index_bits = m[8];
+                        }
+                        for (c = 0; c < 4; c++) {
+                            uint32_t ends[2];
+                            uint32_t bits = (c < 3) ? color_bits : alpha_bits;
+                            for (e = 0; e < 2; e++) {
+                                uint32_t v = endpoints[s][e][c];
+                                uint32_t b = bits;
+                                if (m[6] || m[7]) {
+                                    v = (v << 1) | pbits[s][e];
+                                    b++;
+                                }
+                                // widen to 8 bits by repeating the top bits
+                                ends[e] = (b == 0) ? 0xff : ((v << (8 - b)) | (v >> (2 * b - 8)));
+                            }
+                            if (c < 3) rgba[c] = BPTCBlend(ends[0], ends[1], color_index_bits, color_index);
+                            else rgba[c] = (alpha_bits == 0) ? 0xff : BPTCBlend(ends[0], ends[1], alpha_index_bits, alpha_index);
+                        }
+                        // rotation swaps alpha with red, green or blue after decoding
+                        if (rotation) {
+                            uint32_t t = rgba[3];
+                            rgba[3] = rgba[rotation - 1];
+                            rgba[rotation - 1] = t;
+                        }
+                        for (c = 0; c < 4; c++) same = same && decoded[4 * i + c] == rgba[c];
+                    }
+                }
+                snprintf(detail, sizeof(detail), "mode %u, rotation %u, index select %u", mode, rotation, index_select);
+                Check(same, "BC7 known block", detail);
+            }
+        }
+    }
+
+    // a mode byte of 0 is reserved, and decodes to transparent black
+    k3BPTCBlock reserved = { 0, 0 };
+    uint8_t decoded[64];
+    uint32_t i;
+    bool black = true;
+    k3imageObj::ConvertToUnorm8(k3fmt::BC7_UNORM, &reserved, decoded);
+    for (i = 0; i < 64; i++) black = black && decoded[i] == 0;
+    Check(black, "BC7 known block", "reserved mode");
+}
+
+static void TestBC6HKnownBlocks(uint32_t* seed)
+{
+    // mode bits, endpoint bits, delta bits (0 when untransformed), and the BC6H modes 11, 12 and 14,
+    // whose W, then X fields run in order but for the top bits of W
+    struct {
+        uint32_t mode_bits, endpoint_bits, delta_bits;
+        const char* name;
+    } single[] = {
+        { 0x03, 10, 0, "mode 11" },
+        { 0x07, 11, 9, "mode 12" },
+        { 0x0f, 16, 4, "mode 14" },
+    };
+    const uint32_t all_modes[] = { 0x00, 0x01, 0x02, 0x06, 0x0a, 0x0e, 0x12, 0x16, 0x1a, 0x1e, 0x03, 0x07, 0x0b, 0x0f };
+    const uint32_t reserved_modes[] = { 0x13, 0x17, 0x1b, 0x1f };
+    uint32_t m, trial, i, c, e;
+    char detail[96];
+
+    for (m = 0; m < sizeof(single) / sizeof(single[0]); m++) {
+        uint32_t bits = single[m].endpoint_bits;
+        uint32_t low_bits = (bits > 10) ? 10 : bits;
+        bool same = true;
+        for (trial = 0; trial < 8; trial++) {
+            uint32_t endpoints[2][3];
+            uint32_t stored[2][3];
+            uint32_t index[16];
+            BlockWriter w;
+            w.Put(single[m].mode_bits, 5);
+            for (c = 0; c < 3; c++) {
+                endpoints[0][c] = Random(seed) & ((1u << bits) - 1);
+                stored[0][c] = endpoints[0][c];
+            }
+            for (c = 0; c < 3; c++) w.Put(stored[0][c], low_bits);
+            for (c = 0; c < 3; c++) {
+                if (single[m].delta_bits) {
+                    // a small signed offset from W, wrapping within the endpoint bits
+                    int32_t delta = static_cast<int32_t>(Random(seed) % (1u << single[m].delta_bits)) - static_cast<int32_t>(1u << (single[m].delta_bits - 1));
+                    stored[1][c] = static_cast<uint32_t>(delta) & ((1u << single[m].delta_bits) - 1);
+                    endpoints[1][c] = static_cast<uint32_t>(static_cast<int32_t>(endpoints[0][c]) + delta) & ((1u << bits) - 1);
+                } else {
+                    endpoints[1][c] = Random(seed) & ((1u << bits) - 1);
+                    stored[1][c] = endpoints[1][c];
+                }
+                uint32_t x_bits = (single[m].delta_bits) ? single[m].delta_bits : bits;
+                w.Put(stored[1][c], x_bits);
+                // mode 12 stores W's bit 10 after each X; mode 14 stores bits 15 down to 10
+                if (bits == 11) {
+                    w.Put(endpoints[0][c] >> 10, 1);
+                } else if (bits == 16) {
+                    uint32_t b;
+                    for (b = 15; b >= 10; b--) w.Put(endpoints[0][c] >> b, 1);
+                }
+            }
+            for (i = 0; i < 16; i++) {
+                uint32_t index_bits = (i == 0) ? 3 : 4;
+                index[i] = Random(seed) & ((1u << index_bits) - 1);
+                w.Put(index[i], index_bits);
+            }
+            k3BPTCBlock block = w.Block();
+            float decoded[64];
+            k3imageObj::ConvertToFloat4(k3fmt::BC6_UNORM, &block, decoded);
+
+            for (i = 0; i < 16; i++) {
+                for (c = 0; c < 3; c++) {
+                    uint32_t ends[2];
+                    for (e = 0; e < 2; e++) {
+                        uint32_t v = endpoints[e][c];
+                        if (bits >= 15) ends[e] = v;
+                        else if (v == 0) ends[e] = 0;
+                        else if (v == (1u << bits) - 1) ends[e] = 0xffff;
+                        else ends[e] = ((v << 16) + 0x8000) >> bits;
+                    }
+                    uint32_t blended = BPTCBlend(ends[0], ends[1], 4, index[i]);
+                    same = same && decoded[4 * i + c] == HalfToFloat((blended * 31) >> 6);
+                }
+                same = same && decoded[4 * i + 3] == 1.0f;
+            }
+        }
+        Check(same, "BC6H known block", single[m].name);
+    }
+
+    for (m = 0; m < sizeof(all_modes) / sizeof(all_modes[0]); m++) {
+        BlockWriter w;
+        w.Put(all_modes[m], (all_modes[m] < 2) ? 2 : 5);
+        k3BPTCBlock block = w.Block();
+        float decoded[64];
+        bool black = true;
+        k3imageObj::ConvertToFloat4(k3fmt::BC6_UNORM, &block, decoded);
+        for (i = 0; i < 16; i++) black = black && decoded[4 * i] == 0.0f && decoded[4 * i + 1] == 0.0f && decoded[4 * i + 2] == 0.0f && decoded[4 * i + 3] == 1.0f;
+        snprintf(detail, sizeof(detail), "zero fields in mode bits %02x", all_modes[m]);
+        Check(black, "BC6H known block", detail);
+    }
+    for (m = 0; m < sizeof(reserved_modes) / sizeof(reserved_modes[0]); m++) {
+        BlockWriter w;
+        w.Put(reserved_modes[m], 5);
+        w.Put(0xffffffff, 32);
+        k3BPTCBlock block = w.Block();
+        float decoded[64];
+        bool black = true;
+        k3imageObj::ConvertToFloat4(k3fmt::BC6_UNORM, &block, decoded);
+        for (i = 0; i < 16; i++) black = black && decoded[4 * i] == 0.0f && decoded[4 * i + 1] == 0.0f && decoded[4 * i + 2] == 0.0f;
+        snprintf(detail, sizeof(detail), "reserved mode bits %02x", reserved_modes[m]);
+        Check(black, "BC6H known block", detail);
+    }
+}
+
+// Peak signal to noise ratio of RGB, over the largest value in pixels, after decoding img to float
+static double FloatPSNR(k3image img, const std::vector<float>& pixels)
+{
+    k3image decoded = k3imageObj::Create();
+    k3imageObj::ReformatFromImage(decoded, img, 0, 0, 0, k3fmt::RGBA32_FLOAT);
+    uint32_t width = img->GetWidth(), height = img->GetHeight();
+    const uint8_t* p = static_cast<const uint8_t*>(decoded->MapForRead());
+    double sum = 0.0, peak = 0.0;
+    uint32_t x, y, c;
+    for (y = 0; p != NULL && y < height; y++) {
+        const float* row = reinterpret_cast<const float*>(p + y * decoded->GetPitch());
+        for (x = 0; x < width; x++) {
+            for (c = 0; c < 3; c++) {
+                double v = pixels[4 * (y * width + x) + c];
+                double diff = row[4 * x + c] - v;
+                sum += diff * diff;
+                if (v > peak) peak = v;
+            }
+        }
+    }
+    decoded->Unmap();
+    return 10.0 * log10(peak * peak * 3.0 * width * height / sum);
+}
+
+static void TestBPTCQuality()
+{
+    // floors sit a little under what each level reaches today, so a regression in any of them fails
+    const double bc7_floor[3] = { 33.0, 34.5, 35.7 };
+    const double bc6h_floor[3] = { 36.2, 36.9, 38.0 };
+    const uint32_t width = 64, height = 48;
+    // gradients under waves, with an alpha ramp; noise would hold every level to the same low PSNR
+    std::vector<uint8_t> pixels(4 * width * height);
+    uint32_t x, y, i, q;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            uint8_t* p = &pixels[4 * (y * width + x)];
+            p[0] = static_cast<uint8_t>(x * 4);
+            p[1] = static_cast<uint8_t>(y * 5);
+            p[2] = static_cast<uint8_t>(128.0 + 100.0 * sin(0.3 * x + 0.2 * y));
+            p[3] = static_cast<uint8_t>(255.0 - 60.0 * (1.0 + cos(0.25 * x - 0.15 * y)));
+        }
+    }
+    k3image src = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(src, width, height, 1, width * 4, width * height * 4, k3fmt::RGBA8_UNORM, pixels.data());
+    // high dynamic range: the same colors scaled by up to 8 across the image
+    std::vector<float> hdr(4 * width * height);
+    for (i = 0; i < width * height; i++) {
+        float scale = powf(2.0f, 3.0f * (i % width) / width);
+        hdr[4 * i + 0] = scale * pixels[4 * i + 0] / 255.0f;
+        hdr[4 * i + 1] = scale * pixels[4 * i + 1] / 255.0f;
+        hdr[4 * i + 2] = scale * pixels[4 * i + 2] / 255.0f;
+        hdr[4 * i + 3] = 1.0f;
+    }
+    k3image src_hdr = k3imageObj::Create();
+    k3imageObj::LoadFromMemory(src_hdr, width, height, 1, width * 16, width * height * 16, k3fmt::RGBA32_FLOAT, hdr.data());
+    k3compressQuality saved_quality = k3imageObj::GetCompressQuality();
+    char detail[96];
+
+    for (q = 0; q < 3; q++) {
+        k3imageObj::SetCompressQuality(static_cast<k3compressQuality>(q));
+        k3image bc7 = k3imageObj::Create();
+        k3imageObj::ReformatFromImage(bc7, src, 0, 0, 0, k3fmt::BC7_UNORM);
+        double bc7_psnr = 20.0 * log10(255.0 / RMSError(bc7, pixels, 4));
+        k3image bc6h = k3imageObj::Create();
+        k3imageObj::ReformatFromImage(bc6h, src_hdr, 0, 0, 0, k3fmt::BC6_UNORM);
+        double bc6h_psnr = FloatPSNR(bc6h, hdr);
+        snprintf(detail, sizeof(detail), "quality %u, %.2f dB, floor %.2f dB", q, bc7_psnr, bc7_floor[q]);
+        Check(bc7_psnr >= bc7_floor[q], "BC7 PSNR", detail);
+        snprintf(detail, sizeof(detail), "quality %u, %.2f dB, floor %.2f dB", q, bc6h_psnr, bc6h_floor[q]);
+        Check(bc6h_psnr >= bc6h_floor[q], "BC6H PSNR", detail);
+    }
+    k3imageObj::SetCompressQuality(saved_quality);
+}
+
+static void TestBPTC()
+{
+    uint32_t seed = 53;
+    TestBC7KnownBlocks(&seed);
+    TestBC6HKnownBlocks(&seed);
+    TestBPTCQuality();
+}
+
+// ------------------------------------------------------------
+// Image batch
+// A batch decodes each image into the destination it was given, or into a new image, and matches a
+// load on this thread; images that fail to decode come back with no format
+
+static void TestImageBatch()
+{
+    uint32_t seed = 53;
+    k3image png = MakeSubresources(37, 21, 1, k3fmt::RGBA8_UNORM, 1, 1, false, &seed);
+    png->SaveToFile("imagetest.png", k3imageObj::FILE_HANDLER_PNG);
+    k3image dds = MakeSubresources(16, 8, 1, k3fmt::BC1_UNORM, 3, 2, false, &seed);
+    dds->SaveToFile("imagetest.dds", k3imageObj::FILE_HANDLER_DDS);
+    std::vector<uint8_t> dds_file = ReadFile("imagetest.dds");
+    const uint8_t not_an_image[64] = { 0 };
+
+    const uint32_t NUM_IMAGES = 4;
+    k3image dest[NUM_IMAGES];
+    k3imageLoadDesc load_desc[NUM_IMAGES];
+    uint32_t i;
+    for (i = 0; i < NUM_IMAGES; i++) {
+        if (i) dest[i] = k3imageObj::Create();
+        load_desc[i].file_name = NULL;
+        load_desc[i].file_pos = 0;
+        load_desc[i].data = NULL;
+        load_desc[i].size = 0;
+        load_desc[i].dest = (i) ? &(*dest[i]) : NULL;
+    }
+    load_desc[0].file_name = "imagetest.png";
+    load_desc[1].file_name = "imagetest.png";
+    load_desc[2].data = dds_file.data();
+    load_desc[2].size = static_cast<uint32_t>(dds_file.size());
+    load_desc[3].data = not_an_image;
+    load_desc[3].size = sizeof(not_an_image);
+
+    k3image loaded[NUM_IMAGES];
+    bool in_order = true;
+    k3imageBatch batch = k3imageBatchObj::Create(NUM_IMAGES, load_desc);
+    k3image img;
+    while ((img = batch->WaitForNext(&i)) != NULL) {
+        in_order = in_order && (i < NUM_IMAGES && loaded[i] == NULL);
+        if (i < NUM_IMAGES) loaded[i] = img;
+    }
+    batch = NULL;
+    // the failed decode may or may not report, depending on the handlers
+    error_seen = false;
+    Check(in_order, "image batch returns each image once", "4 images");
+    Check(loaded[0] != NULL && loaded[0] != dest[1] && loaded[0] != dest[2] && SameImage(png, loaded[0]),
+        "image batch loads into a new image", "png file");
+    Check(loaded[1] == dest[1] && SameImage(png, loaded[1]), "image batch loads into its destination", "png file");
+    Check(loaded[2] == dest[2] && SameSubresources(dds, loaded[2]), "image batch loads into its destination", "dds blob with mips");
+    Check(loaded[3] == dest[3] && loaded[3]->GetFormat() == k3fmt::UNKNOWN, "image batch leaves a failed decode empty", "not an image");
+}
+
+// ------------------------------------------------------------
+// Encoded memory
+// An image file decoded from memory, on its own or part way into a pack of files, gives the same bytes
+// as loading the file, with or without a reformat on the way
+
+static void TestEncodedMemory()
+{
+    uint32_t seed = 59;
+    k3image png8 = MakeSubresources(45, 29, 1, k3fmt::RGBA8_UNORM, 1, 1, false, &seed);
+    png8->SaveToFile("imagetest_mem0.png", k3imageObj::FILE_HANDLER_PNG);
+    k3image png16 = MakeSubresources(31, 17, 1, k3fmt::RGBA16_UNORM, 1, 1, false, &seed);
+    png16->SaveToFile("imagetest_mem1.png", k3imageObj::FILE_HANDLER_PNG);
+    WriteJPG("imagetest_mem2.jpg", 203, 157, true);
+    WriteJPG("imagetest_mem3.jpg", 67, 45, false);
+    k3image dds_mips = MakeSubresources(20, 12, 1, k3fmt::RGBA8_UNORM, 5, 1, false, &seed);
+    dds_mips->SaveToFile("imagetest_mem4.dds", k3imageObj::FILE_HANDLER_DDS);
+    k3image dds_bc1 = MakeSubresources(32, 16, 1, k3fmt::BC1_UNORM, 6, 3, false, &seed);
+    dds_bc1->SaveToFile("imagetest_mem5.dds", k3imageObj::FILE_HANDLER_DDS);
+    const char* file_names[] = {
+        "imagetest_mem0.png", "imagetest_mem1.png", "imagetest_mem2.jpg",
+        "imagetest_mem3.jpg", "imagetest_mem4.dds", "imagetest_mem5.dds"
+    };
+    const uint32_t num_files = sizeof(file_names) / sizeof(file_names[0]);
+    // an odd offset, so nothing in the decoders counts on an aligned start
+    const uint32_t pack_offset = 13;
+    uint32_t f;
+
+    for (f = 0; f < num_files; f++) {
+        std::vector<uint8_t> file = ReadFile(file_names[f]);
+        uint32_t size = static_cast<uint32_t>(file.size());
+        k3image from_file = k3imageObj::Create();
+        k3imageObj::LoadFromFile(from_file, file_names[f]);
+        k3image from_memory = k3imageObj::Create();
+        k3imageObj::LoadFromEncodedMemory(from_memory, file.data(), size);
+        Check(from_file->GetFormat() != k3fmt::UNKNOWN && SameSubresources(from_file, from_memory),
+            "encoded memory load matches the file", file_names[f]);
+
+        // the same file packed between other bytes, read from a file handle and from memory
+        std::vector<uint8_t> pack(pack_offset + file.size() + 7, 0x5a);
+        memcpy(pack.data() + pack_offset, file.data(), file.size());
+        WriteFile("imagetest_pack.bin", pack);
+        k3image from_handle = k3imageObj::Create();
+        FILE* pack_handle = fopen("imagetest_pack.bin", "rb");
+        if (pack_handle) {
+            fseek(pack_handle, pack_offset, SEEK_SET);
+            k3imageObj::LoadFromFileHandle(from_handle, pack_handle);
+            fclose(pack_handle);
+        }
+        Check(from_handle->GetFormat() != k3fmt::UNKNOWN && SameSubresources(from_file, from_handle),
+            "file handle load part way into a pack matches the file", file_names[f]);
+        k3image from_pack = k3imageObj::Create();
+        k3imageObj::LoadFromEncodedMemory(from_pack, pack.data() + pack_offset, size);
+        Check(SameSubresources(from_file, from_pack), "encoded memory load part way into a pack matches the file", file_names[f]);
+
+        // a reformat to another size and format reads the source the same way
+        uint32_t width = from_file->GetWidth() / 2 + 1;
+        uint32_t height = from_file->GetHeight() / 3 + 1;
+        k3image reformat_file = k3imageObj::Create();
+        k3imageObj::ReformatFromFile(reformat_file, file_names[f], width, height, 1, k3fmt::BGRA8_UNORM);
+        k3image reformat_memory = k3imageObj::Create();
+        k3imageObj::ReformatFromEncodedMemory(reformat_memory, file.data(), size, width, height, 1, k3fmt::BGRA8_UNORM);
+        Check(reformat_file->GetWidth() == width && SameSubresources(reformat_file, reformat_memory),
+            "encoded memory reformat matches the file", file_names[f]);
+    }
+}
+
+// ------------------------------------------------------------
+// JPEG scaled decode
+// Loads to smaller sizes decode at the smallest of 1/2, 1/4 and 1/8 scale that still covers the target,
+// which libjpeg rounds up, and give the pixels of libjpeg's own decode at that scale
+
+// Decodes file_name with libjpeg at 1/denom scale to RGB
+static std::vector<uint8_t> DecodeJPGScaled(const char* file_name, uint32_t denom, uint32_t* width, uint32_t* height)
+{
+    std::vector<uint8_t> pixels;
+    FILE* file_handle = fopen(file_name, "rb");
+    if (file_handle == NULL) return pixels;
+    jpeg_decompress_struct dinfo;
+    jpeg_error_mgr jerr;
+    dinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&dinfo);
+    jpeg_stdio_src(&dinfo, file_handle);
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denom;
+    jpeg_start_decompress(&dinfo);
+    *width = dinfo.output_width;
+    *height = dinfo.output_height;
+    pixels.resize(dinfo.output_width * dinfo.output_height * 3);
+    while (dinfo.output_scanline < dinfo.output_height) {
+        JSAMPROW row = &pixels[dinfo.output_scanline * dinfo.output_width * 3];
+        jpeg_read_scanlines(&dinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+    fclose(file_handle);
+    return pixels;
+}
+
+static void TestJPGScaledSize()
+{
+    WriteJPG("imagetest_scaled.jpg", 203, 157, true);
+    // 203 x 157 is 102 x 79 at 1/2, 51 x 40 at 1/4 and 26 x 20 at 1/8
+    const struct {
+        uint32_t dest_width, dest_height;
+        uint32_t width, height;
+        uint32_t denom;
+    } cases[] = {
+        { 203, 157, 203, 157, 1 },
+        { 150, 100, 203, 157, 1 },
+        { 103, 20, 203, 157, 1 },
+        { 102, 79, 102, 79, 2 },
+        { 60, 79, 102, 79, 2 },
+        { 100, 41, 102, 79, 2 },
+        { 51, 40, 51, 40, 4 },
+        { 30, 21, 51, 40, 4 },
+        { 27, 1, 51, 40, 4 },
+        { 26, 20, 26, 20, 8 },
+        { 1, 1, 26, 20, 8 },
+    };
+    char detail[128];
+    uint32_t c;
+
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        snprintf(detail, sizeof(detail), "203x157 to %ux%u", cases[c].dest_width, cases[c].dest_height);
+        k3imageSource source("imagetest_scaled.jpg");
+        void* context = NULL;
+        uint32_t width = 0, height = 0, depth = 0;
+        k3fmt format = k3fmt::UNKNOWN;
+        k3JPGHandler.LoadHeaderInfo(&source, &context, &width, &height, &depth, &format);
+        if (context && (cases[c].dest_width < width || cases[c].dest_height < height)) {
+            k3JPGHandler.LoadScaledSize(&source, context, cases[c].dest_width, cases[c].dest_height, &width, &height);
+        }
+        if (context) k3JPGHandler.EndLoad(context);
+        Check(width == cases[c].width && height == cases[c].height, "jpg scaled size", detail);
+
+        // a load at the scaled size itself keeps every pixel of the scaled decode
+        if (cases[c].dest_width != cases[c].width || cases[c].dest_height != cases[c].height) continue;
+        uint32_t ref_width = 0, ref_height = 0;
+        std::vector<uint8_t> expected = DecodeJPGScaled("imagetest_scaled.jpg", cases[c].denom, &ref_width, &ref_height);
+        k3image img = k3imageObj::Create();
+        k3imageObj::ReformatFromFile(img, "imagetest_scaled.jpg", cases[c].width, cases[c].height, 1, k3fmt::RGBA8_UNORM);
+        const uint8_t* data = static_cast<const uint8_t*>(img->MapForRead());
+        bool same = (data != NULL && ref_width == cases[c].width && ref_height == cases[c].height &&
+            img->GetWidth() == ref_width && img->GetHeight() == ref_height);
+        uint32_t x, y;
+        for (y = 0; same && y < ref_height; y++) {
+            const uint8_t* row = data + y * img->GetPitch();
+            for (x = 0; same && x < ref_width; x++) {
+                same = (memcmp(row + 4 * x, &expected[3 * (y * ref_width + x)], 3) == 0 && row[4 * x + 3] == 0xff);
+            }
+        }
+        img->Unmap();
+        Check(same, "jpg scaled load matches libjpeg at that scale", detail);
+    }
+}
+
+int main()
+{
+    k3error::SetHandler(ErrorHandler);
+    TestPNGRoundTrip();
+    TestPNGDecode();
+    TestRegions();
+    TestDXTCompress();
+    TestParallelReformat();
+    TestRowConverters();
+    TestBlockCache();
+    TestGenerateMips();
+    TestDDSSubresources();
+    TestBPTC();
+    TestImageBatch();
+    TestEncodedMemory();
+    TestJPGScaledSize();
+    printf("%u checks, %u failed\n", num_checks, num_fails);
+    return (num_fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,1029 @@
+// k3 graphics test
+// math kernel checks: every entry of the simd dispatch table is run at each level the cpu supports and
+// compared bit for bit with its scalar reference, then with plain or brute force versions of the same
+// math; exits with 1 if any check fails
+
+#include "k3.h"
+#include "k3simd.h"
+#include "k3bvh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+static uint32_t num_checks = 0;
+static uint32_t num_fails = 0;
+static bool error_seen = false;
+
+static void K3CALLBACK ErrorHandler(const char* error_msg, const char* title)
+{
+    printf("  error from %s: %s\n", title, error_msg);
+    error_seen = true;
+}
+
+static void Check(bool ok, const char* what, const char* detail)
+{
+    num_checks++;
+    if (!ok || error_seen) {
+        printf("FAIL %s: %s\n", what, detail);
+        num_fails++;
+    }
+    error_seen = false;
+}
+
+static uint32_t Random(uint32_t* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static float RandomFloat(uint32_t* seed, float lo, float hi)
+{
+    return lo + (hi - lo) * static_cast<float>(Random(seed) & 0xffff) / 65535.0f;
+}
+
+// Random values in -4 to 4, with some zeros, negative zeros and repeats mixed in so compares see ties
+static std::vector<float> RandomFloats(uint32_t count, uint32_t* seed)
+{
+    std::vector<float> v(count);
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        switch (Random(seed) % 16) {
+        case 0: v[i] = 0.0f; break;
+        case 1: v[i] = -0.0f; break;
+        case 2: v[i] = (i > 0) ? v[i - 1] : 1.0f; break;
+        default: v[i] = RandomFloat(seed, -4.0f, 4.0f); break;
+        }
+    }
+    return v;
+}
+
+static bool SameBits(const float* a, const float* b, uint32_t count)
+{
+    return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+static const char* LevelName(k3simdLevel level)
+{
+    switch (level) {
+    case k3simdLevel::SSE41: return "SSE41";
+    case k3simdLevel::AVX2: return "AVX2";
+    case k3simdLevel::NEON: return "NEON";
+    default: return "NONE";
+    }
+}
+
+// Affine matrix of a random rotation, scale and translation; with shear the 3x3 part gets a random
+// off axis term as well, which a transpose based inverse would get wrong
+static void RandomAffine(float* d, uint32_t* seed, bool shear)
+{
+    float s3[3] = { RandomFloat(seed, 0.1f, 4.0f), RandomFloat(seed, 0.1f, 4.0f), RandomFloat(seed, 0.1f, 4.0f) };
+    float r3[3] = { RandomFloat(seed, -180.0f, 180.0f), RandomFloat(seed, -180.0f, 180.0f), RandomFloat(seed, -180.0f, 180.0f) };
+    float t3[3] = { RandomFloat(seed, -100.0f, 100.0f), RandomFloat(seed, -100.0f, 100.0f), RandomFloat(seed, -100.0f, 100.0f) };
+    k3m4_SetScaleRotAngleXlat(d, s3, r3, t3);
+    if (shear) d[1] += RandomFloat(seed, -1.0f, 1.0f);
+}
+
+// ------------------------------------------------------------
+// Vector and 4x4 matrix kernels
+
+static void TestVectorKernels(const char* level_name, uint32_t* seed)
+{
+    typedef float* (*binary_func)(uint32_t, float*, const float*, const float*);
+    typedef float* (*scalar_vec_func)(uint32_t, float*, const float, const float*);
+    struct {
+        binary_func simd;
+        binary_func scalar;
+        const char* name;
+    } binary[] = {
+        { k3math_funcs.v_Add, k3v_AddScalar, "v_Add" },
+        { k3math_funcs.v_Sub, k3v_SubScalar, "v_Sub" },
+        { k3math_funcs.v_Mul, k3v_MulScalar, "v_Mul" },
+        { k3math_funcs.v_Div, k3v_DivScalar, "v_Div" },
+        { k3math_funcs.v_Min, k3v_MinScalar, "v_Min" },
+        { k3math_funcs.v_Max, k3v_MaxScalar, "v_Max" },
+    };
+    struct {
+        scalar_vec_func simd;
+        scalar_vec_func scalar;
+        const char* name;
+    } scalar_vec[] = {
+        { k3math_funcs.sv_Add, k3sv_AddScalar, "sv_Add" },
+        { k3math_funcs.sv_Sub, k3sv_SubScalar, "sv_Sub" },
+        { k3math_funcs.sv_Mul, k3sv_MulScalar, "sv_Mul" },
+        { k3math_funcs.sv_Div, k3sv_DivScalar, "sv_Div" },
+    };
+    char detail[128];
+    uint32_t len, f, trial;
+
+    for (trial = 0; trial < 8; trial++) {
+        for (len = 1; len <= 37; len++) {
+            std::vector<float> s1 = RandomFloats(len, seed), s2 = RandomFloats(len, seed);
+            std::vector<float> d_simd(len + 1, 7.0f), d_scalar(len + 1, 7.0f);
+            snprintf(detail, sizeof(detail), "%s length %u", level_name, len);
+
+            for (f = 0; f < sizeof(binary) / sizeof(binary[0]); f++) {
+                binary[f].simd(len, d_simd.data(), s1.data(), s2.data());
+                binary[f].scalar(len, d_scalar.data(), s1.data(), s2.data());
+                // the extra float past the end must not be touched
+                Check(SameBits(d_simd.data(), d_scalar.data(), len + 1), binary[f].name, detail);
+            }
+            for (f = 0; f < sizeof(scalar_vec) / sizeof(scalar_vec[0]); f++) {
+                scalar_vec[f].simd(len, d_simd.data(), s1[0], s2.data());
+                scalar_vec[f].scalar(len, d_scalar.data(), s1[0], s2.data());
+                Check(SameBits(d_simd.data(), d_scalar.data(), len + 1), scalar_vec[f].name, detail);
+            }
+
+            d_simd.assign(s1.begin(), s1.end());
+            d_scalar.assign(s1.begin(), s1.end());
+            k3math_funcs.v_Negate(len, d_simd.data());
+            k3v_NegateScalar(len, d_scalar.data());
+            Check(SameBits(d_simd.data(), d_scalar.data(), len), "v_Negate", detail);
+
+            d_simd.assign(s1.begin(), s1.end());
+            d_scalar.assign(s1.begin(), s1.end());
+            k3math_funcs.v_Normalize(len, d_simd.data());
+            k3v_NormalizeScalar(len, d_scalar.data());
+            Check(SameBits(d_simd.data(), d_scalar.data(), len), "v_Normalize", detail);
+
+            float dot_simd = k3math_funcs.v_Dot(len, s1.data(), s2.data());
+            float dot_scalar = k3v_DotScalar(len, s1.data(), s2.data());
+            Check(SameBits(&dot_simd, &dot_scalar, 1), "v_Dot", detail);
+
+            Check(k3math_funcs.v_Equals(len, s1.data(), s2.data()) == k3v_EqualsScalar(len, s1.data(), s2.data()), "v_Equals", detail);
+            Check(k3math_funcs.v_Equals(len, s1.data(), s1.data()), "v_Equals of itself", detail);
+
+            if (len == 2 || len == 3) {
+                k3math_funcs.v_Cross(len, d_simd.data(), s1.data(), s2.data());
+                k3v_CrossScalar(len, d_scalar.data(), s1.data(), s2.data());
+                Check(SameBits(d_simd.data(), d_scalar.data(), (len == 2) ? 1 : 3), "v_Cross", detail);
+            }
+        }
+    }
+}
+
+static void TestMatrixKernels(const char* level_name, uint32_t* seed)
+{
+    float s1[16], s2[16], d_simd[16], d_scalar[16], product[16];
+    char detail[128];
+    uint32_t trial, i;
+
+    for (trial = 0; trial < 200; trial++) {
+        snprintf(detail, sizeof(detail), "%s trial %u", level_name, trial);
+        std::vector<float> r1 = RandomFloats(16, seed), r2 = RandomFloats(16, seed);
+        memcpy(s1, r1.data(), sizeof(s1));
+        memcpy(s2, r2.data(), sizeof(s2));
+
+        k3math_funcs.m4_Mul(d_simd, s1, s2);
+        k3m4_MulScalar(d_scalar, s1, s2);
+        Check(SameBits(d_simd, d_scalar, 16), "m4_Mul", detail);
+        k3math_funcs.mv4_Mul(d_simd, s1, s2);
+        k3mv4_MulScalar(d_scalar, s1, s2);
+        Check(SameBits(d_simd, d_scalar, 4), "mv4_Mul", detail);
+        k3math_funcs.vm4_Mul(d_simd, s1, s2);
+        k3vm4_MulScalar(d_scalar, s1, s2);
+        Check(SameBits(d_simd, d_scalar, 4), "vm4_Mul", detail);
+
+        memcpy(d_simd, s1, sizeof(s1));
+        memcpy(d_scalar, s1, sizeof(s1));
+        k3math_funcs.m4_Transpose(d_simd);
+        k3m4_TransposeScalar(d_scalar);
+        Check(SameBits(d_simd, d_scalar, 16), "m4_Transpose", detail);
+
+        memcpy(d_simd, s1, sizeof(s1));
+        memcpy(d_scalar, s1, sizeof(s1));
+        k3math_funcs.m4_Inverse(d_simd);
+        k3m4_InverseScalar(d_scalar);
+        Check(SameBits(d_simd, d_scalar, 16), "m4_Inverse", detail);
+
+        // affine matrices, with and without shear, then a general one that has to take the full inverse
+        for (i = 0; i < 3; i++) {
+            if (i < 2) RandomAffine(s2, seed, i == 1);
+            else memcpy(s2, s1, sizeof(s1));
+            memcpy(d_simd, s2, sizeof(s2));
+            memcpy(d_scalar, s2, sizeof(s2));
+            k3math_funcs.m4_InverseTransform(d_simd);
+            k3m4_InverseTransformScalar(d_scalar);
+            Check(SameBits(d_simd, d_scalar, 16), "m4_InverseTransform", detail);
+            if (i == 2) {
+                k3m4_InverseScalar(s2);
+                Check(SameBits(d_scalar, s2, 16), "m4_InverseTransform of a general matrix", detail);
+            } else {
+                k3m4_MulScalar(product, d_scalar, s2);
+                bool identity = true;
+                for (uint32_t e = 0; e < 16; e++) identity = identity && fabsf(product[e] - ((e % 5 == 0) ? 1.0f : 0.0f)) < 1.0e-4f;
+                Check(identity, "m4_InverseTransform times the transform", detail);
+            }
+        }
+    }
+
+    // a singular 3x3 part goes through the general inverse, which zeroes the result
+    memset(s1, 0, sizeof(s1));
+    s1[0] = 1.0f; s1[3] = 5.0f; s1[15] = 1.0f;
+    memcpy(d_simd, s1, sizeof(s1));
+    memcpy(d_scalar, s1, sizeof(s1));
+    k3math_funcs.m4_InverseTransform(d_simd);
+    k3m4_InverseScalar(d_scalar);
+    Check(SameBits(d_simd, d_scalar, 16), "m4_InverseTransform of a singular matrix", level_name);
+}
+
+// ------------------------------------------------------------
+// Batched matrix multiplies
+
+static void TestMulArrayKernels(const char* level_name, uint32_t* seed)
+{
+    typedef float* (*array_func)(uint32_t, float*, uint32_t, const float*, uint32_t, const float*, uint32_t);
+    struct {
+        array_func simd;
+        array_func scalar;
+        uint32_t s2_size;
+        const char* name;
+    } funcs[] = {
+        { k3math_funcs.m4_MulArray, k3m4_MulArrayScalar, 16, "m4_MulArray" },
+        { k3math_funcs.mv4_MulArray, k3mv4_MulArrayScalar, 4, "mv4_MulArray" },
+        { k3math_funcs.mp3_MulArray, k3mp3_MulArrayScalar, 3, "mp3_MulArray" },
+    };
+    char detail[128];
+    uint32_t f, count, pad, i;
+
+    for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+        const uint32_t size = funcs[f].s2_size;
+        for (count = 0; count <= 19; count++) {
+            // packed, padded, then each source reused through a stride of 0
+            for (pad = 0; pad < 4; pad++) {
+                uint32_t s1_stride = (pad == 2) ? 0 : 16 + pad;
+                uint32_t s2_stride = (pad == 3) ? 0 : size + pad;
+                uint32_t d_stride = size + pad;
+                std::vector<float> s1 = RandomFloats((16 + pad) * count + 16, seed);
+                std::vector<float> s2 = RandomFloats((size + pad) * count + 16, seed);
+                std::vector<float> d_simd(d_stride * count + 1, 7.0f), d_scalar(d_stride * count + 1, 7.0f);
+                snprintf(detail, sizeof(detail), "%s count %u strides %u %u %u", level_name, count, d_stride, s1_stride, s2_stride);
+
+                funcs[f].simd(count, d_simd.data(), d_stride, s1.data(), s1_stride, s2.data(), s2_stride);
+                funcs[f].scalar(count, d_scalar.data(), d_stride, s1.data(), s1_stride, s2.data(), s2_stride);
+                // padding between elements and the float past the end must not be touched
+                Check(SameBits(d_simd.data(), d_scalar.data(), d_stride * count + 1), funcs[f].name, detail);
+
+                // each element matches the single element multiply
+                bool same = true;
+                for (i = 0; i < count; i++) {
+                    float single[16], point[4];
+                    const float* m = s1.data() + i * s1_stride;
+                    const float* v = s2.data() + i * s2_stride;
+                    if (size == 16) {
+                        k3m4_MulScalar(single, m, v);
+                    } else if (size == 4) {
+                        k3mv4_MulScalar(single, m, v);
+                    } else {
+                        point[0] = v[0]; point[1] = v[1]; point[2] = v[2]; point[3] = 1.0f;
+                        k3mv4_MulScalar(single, m, point);
+                    }
+                    same = same && SameBits(single, d_scalar.data() + i * d_stride, size);
+                }
+                Check(same, funcs[f].name, "scalar reference differs from the single element multiply");
+
+                // in place over s2, whose stride matches d
+                if (s2_stride == d_stride) {
+                    std::vector<float> alias = s2;
+                    funcs[f].simd(count, alias.data(), d_stride, s1.data(), s1_stride, alias.data(), d_stride);
+                    same = true;
+                    for (i = 0; i < count; i++) same = same && SameBits(alias.data() + i * d_stride, d_scalar.data() + i * d_stride, size);
+                    Check(same, funcs[f].name, "d aliasing s2");
+                }
+                // in place over s1 for the 4x4 multiply
+                if (size == 16 && s1_stride == d_stride) {
+                    std::vector<float> alias = s1;
+                    funcs[f].simd(count, alias.data(), d_stride, alias.data(), d_stride, s2.data(), s2_stride);
+                    same = true;
+                    for (i = 0; i < count; i++) same = same && SameBits(alias.data() + i * d_stride, d_scalar.data() + i * d_stride, size);
+                    Check(same, funcs[f].name, "d aliasing s1");
+                }
+            }
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// General size matrices
+
+// Random matrix with a heavy diagonal, so the inverse is well conditioned at any size
+static std::vector<float> RandomInvertible(uint32_t rows, uint32_t* seed)
+{
+    std::vector<float> m = RandomFloats(rows * rows, seed);
+    uint32_t i;
+    for (i = 0; i < rows; i++) m[i * rows + i] += (m[i * rows + i] < 0.0f ? -4.0f : 4.0f) * static_cast<float>(rows);
+    return m;
+}
+
+static void TestGeneralMatrices(const char* level_name, uint32_t* seed)
+{
+    const uint32_t sizes[] = { 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 31, 33, 48, 64, 65 };
+    char detail[128];
+    uint32_t i, r, c, k;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const uint32_t rows = sizes[i];
+        std::vector<float> s = RandomInvertible(rows, seed);
+        std::vector<float> scratch(k3m_GetScratchSize(rows));
+        std::vector<float> inv = s, inv_scratch = s, product(rows * rows);
+        snprintf(detail, sizeof(detail), "%s %ux%u", level_name, rows, rows);
+
+        // the stack and caller scratch versions are the same code
+        k3m_Inverse(rows, inv.data());
+        k3m_InverseScratch(rows, inv_scratch.data(), scratch.data());
+        Check(SameBits(inv.data(), inv_scratch.data(), rows * rows), "k3m_InverseScratch", detail);
+        float det = k3m_Determinant(rows, s.data());
+        float det_scratch = k3m_DeterminantScratch(rows, s.data(), scratch.data());
+        Check(SameBits(&det, &det_scratch, 1), "k3m_DeterminantScratch", detail);
+
+        k3m_Mul(rows, rows, rows, product.data(), s.data(), inv.data());
+        bool identity = true;
+        for (k = 0; k < rows * rows; k++) identity = identity && fabsf(product[k] - ((k % (rows + 1) == 0) ? 1.0f : 0.0f)) < 1.0e-4f;
+        Check(identity, "k3m_Inverse times the matrix", detail);
+
+        // sums start at 0 and run in index order, so the blocked multiply matches the plain triple loop
+        std::vector<float> expect(rows * rows), d(rows * rows);
+        for (r = 0; r < rows; r++) {
+            for (c = 0; c < rows; c++) {
+                float sum = 0.0f;
+                for (k = 0; k < rows; k++) sum += s[r * rows + k] * inv[k * rows + c];
+                expect[r * rows + c] = sum;
+            }
+        }
+        if (rows != 4) Check(SameBits(product.data(), expect.data(), rows * rows), "k3m_Mul", detail);
+        k3m_MulScratch(rows, rows, rows, d.data(), s.data(), inv.data(), NULL);
+        Check(SameBits(d.data(), product.data(), rows * rows), "k3m_MulScratch", detail);
+        // d overlapping s1, with and without scratch
+        d = s;
+        k3m_MulScratch(rows, rows, rows, d.data(), d.data(), inv.data(), scratch.data());
+        Check(SameBits(d.data(), product.data(), rows * rows), "k3m_MulScratch in place", detail);
+        d = s;
+        k3m_MulScratch(rows, rows, rows, d.data(), d.data(), inv.data(), NULL);
+        Check(SameBits(d.data(), product.data(), rows * rows), "k3m_MulScratch in place without scratch", detail);
+
+        // a quarter turn through k3m_Swizzle: element (r, c) takes (c, rows - 1 - r)
+        std::vector<uint32_t> row_indices(rows * rows), col_indices(rows * rows);
+        for (k = 0; k < rows * rows; k++) {
+            row_indices[k] = k % rows;
+            col_indices[k] = rows - 1 - k / rows;
+        }
+        d = s;
+        k3m_Swizzle(rows, rows, d.data(), row_indices.data(), col_indices.data());
+        bool turned = true;
+        for (r = 0; r < rows; r++) {
+            for (c = 0; c < rows; c++) turned = turned && d[r * rows + c] == s[c * rows + rows - 1 - r];
+        }
+        Check(turned, "k3m_Swizzle", detail);
+
+        if (rows < 2) continue;
+
+        // upper triangular: the determinant is the product of the diagonal, and a row swap negates it
+        std::vector<float> tri = s;
+        float diagonal = 1.0f;
+        for (r = 0; r < rows; r++) {
+            for (c = 0; c < r; c++) tri[r * rows + c] = 0.0f;
+            tri[r * rows + r] = (r & 1) ? 0.5f : -2.0f;
+            diagonal *= tri[r * rows + r];
+        }
+        det = k3m_Determinant(rows, tri.data());
+        Check(fabsf(det - diagonal) <= 1.0e-5f * fabsf(diagonal), "k3m_Determinant of a triangular matrix", detail);
+        for (c = 0; c < rows; c++) {
+            float f = tri[c];
+            tri[c] = tri[rows + c];
+            tri[rows + c] = f;
+        }
+        det = k3m_DeterminantScratch(rows, tri.data(), scratch.data());
+        Check(fabsf(det + diagonal) <= 1.0e-5f * fabsf(diagonal), "k3m_Determinant after a row swap", detail);
+
+        // a zero row: singular, inverts to all zeros
+        std::vector<float> singular = s;
+        memset(singular.data() + rows * (rows - 1), 0, rows * sizeof(float));
+        Check(k3m_Determinant(rows, singular.data()) == 0.0f, "k3m_Determinant of a singular matrix", detail);
+        k3m_Inverse(rows, singular.data());
+        bool zero = true;
+        for (k = 0; k < rows * rows; k++) zero = zero && singular[k] == 0.0f;
+        Check(zero, "k3m_Inverse of a singular matrix", detail);
+    }
+}
+
+// ------------------------------------------------------------
+// Batched quaternion kernels
+
+// Unit quaternions; some are copies or negated copies of the one before, for the slerp near and far paths
+static std::vector<float> RandomQuats(uint32_t count, uint32_t stride, uint32_t* seed)
+{
+    std::vector<float> q = RandomFloats(stride * count + 4, seed);
+    uint32_t i, c;
+    for (i = 0; i < count; i++) {
+        float* qi = q.data() + i * stride;
+        const float* prev = (i > 0) ? qi - stride : qi;
+        switch (Random(seed) % 8) {
+        case 0: for (c = 0; c < 4; c++) qi[c] = prev[c]; break;
+        case 1: for (c = 0; c < 4; c++) qi[c] = -prev[c]; break;
+        default: break;
+        }
+        if (k3v4_Dot(qi, qi) == 0.0f) qi[3] = 1.0f;
+        k3v4_Normalize(qi);
+    }
+    return q;
+}
+
+static bool Near(const float* a, const float* b, uint32_t count, float tolerance)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        if (!(fabsf(a[i] - b[i]) <= tolerance)) return false;
+    }
+    return true;
+}
+
+static void TestQuatKernels(const char* level_name, uint32_t* seed)
+{
+    typedef float* (*blend_func)(uint32_t, float*, uint32_t, const float*, uint32_t, const float*, uint32_t, float);
+    struct {
+        blend_func simd;
+        blend_func scalar;
+        const char* name;
+    } blend[] = {
+        { k3math_funcs.quat_NlerpBatch, k3v4_QuatNlerpBatchScalar, "quat_NlerpBatch" },
+        { k3math_funcs.quat_SlerpBatch, k3v4_QuatSlerpBatchScalar, "quat_SlerpBatch" },
+    };
+    const float blend_t[] = { 0.0f, 0.25f, 0.5f, 0.9f, 1.0f };
+    char detail[128];
+    uint32_t f, count, pad, ti, i, cols;
+
+    for (count = 0; count <= 19; count++) {
+        for (pad = 0; pad < 2; pad++) {
+            const uint32_t stride = 4 + 4 * pad;
+            std::vector<float> s1 = RandomQuats(count, stride, seed), s2 = RandomQuats(count, stride, seed);
+            // the second source follows the first so the copies above land in s1[i], s2[i] pairs
+            for (i = 0; i < count; i++) {
+                if (Random(seed) % 4 == 0) {
+                    float sign = (Random(seed) & 1) ? -1.0f : 1.0f;
+                    k3sv_Mul(4, s2.data() + i * stride, sign, s1.data() + i * stride);
+                }
+            }
+            snprintf(detail, sizeof(detail), "%s count %u stride %u", level_name, count, stride);
+
+            for (f = 0; f < sizeof(blend) / sizeof(blend[0]); f++) {
+                for (ti = 0; ti < sizeof(blend_t) / sizeof(blend_t[0]); ti++) {
+                    std::vector<float> d_simd(stride * count + 1, 7.0f), d_scalar(stride * count + 1, 7.0f);
+                    blend[f].simd(count, d_simd.data(), stride, s1.data(), stride, s2.data(), stride, blend_t[ti]);
+                    blend[f].scalar(count, d_scalar.data(), stride, s1.data(), stride, s2.data(), stride, blend_t[ti]);
+                    Check(SameBits(d_simd.data(), d_scalar.data(), stride * count + 1), blend[f].name, detail);
+
+                    // unit length, and the ends of the blend land on s1 and on s2 or its negation
+                    bool ok = true;
+                    for (i = 0; i < count; i++) {
+                        const float* di = d_scalar.data() + i * stride;
+                        const float* a = s1.data() + i * stride;
+                        const float* b = s2.data() + i * stride;
+                        float nb[4] = { -b[0], -b[1], -b[2], -b[3] };
+                        ok = ok && fabsf(k3v4_Dot(di, di) - 1.0f) < 1.0e-5f;
+                        if (blend_t[ti] == 0.0f) ok = ok && Near(di, a, 4, 1.0e-5f);
+                        if (blend_t[ti] == 1.0f) ok = ok && (Near(di, b, 4, 1.0e-5f) || Near(di, nb, 4, 1.0e-5f));
+                    }
+                    Check(ok, blend[f].name, "result off the unit sphere or the blend end points");
+                }
+                // in place over s1
+                std::vector<float> alias = s1, d_scalar(stride * count + 1, 7.0f);
+                blend[f].simd(count, alias.data(), stride, alias.data(), stride, s2.data(), stride, 0.3f);
+                blend[f].scalar(count, d_scalar.data(), stride, s1.data(), stride, s2.data(), stride, 0.3f);
+                bool same = true;
+                for (i = 0; i < count; i++) same = same && SameBits(alias.data() + i * stride, d_scalar.data() + i * stride, 4);
+                Check(same, blend[f].name, "d aliasing s1");
+            }
+
+            for (cols = 3; cols <= 4; cols++) {
+                const uint32_t d_stride = cols * cols + pad;
+                std::vector<float> d_simd(d_stride * count + 1, 7.0f), d_scalar(d_stride * count + 1, 7.0f);
+                k3math_funcs.quat_ToMatBatch(count, cols, d_simd.data(), d_stride, s1.data(), stride);
+                k3m_QuatToMatBatchScalar(count, cols, d_scalar.data(), d_stride, s1.data(), stride);
+                Check(SameBits(d_simd.data(), d_scalar.data(), d_stride * count + 1), "quat_ToMatBatch", detail);
+                bool ok = true;
+                for (i = 0; i < count; i++) {
+                    float single[16];
+                    k3m_QuatToMat(cols, single, s1.data() + i * stride);
+                    ok = ok && Near(single, d_scalar.data() + i * d_stride, cols * cols, 1.0e-6f);
+                }
+                Check(ok, "quat_ToMatBatch", "differs from k3m_QuatToMat");
+            }
+
+            // translations ride along in their own strided array, and a stride of 0 reuses one
+            const uint32_t xlat_stride = (pad == 0) ? 3 : 0;
+            std::vector<float> xlat = RandomFloats(3 * count + 3, seed);
+            std::vector<float> dq_simd(8 * count + 1, 7.0f), dq_scalar(8 * count + 1, 7.0f);
+            k3math_funcs.quat_ToDualQuatBatch(count, dq_simd.data(), 8, s1.data(), stride, xlat.data(), xlat_stride);
+            k3v4_QuatToDualQuatBatchScalar(count, dq_scalar.data(), 8, s1.data(), stride, xlat.data(), xlat_stride);
+            Check(SameBits(dq_simd.data(), dq_scalar.data(), 8 * count + 1), "quat_ToDualQuatBatch", detail);
+
+            std::vector<float> m_simd(16 * count + 1, 7.0f), m_scalar(16 * count + 1, 7.0f);
+            k3math_funcs.dualQuat_ToMatBatch(count, m_simd.data(), 16, dq_scalar.data(), 8);
+            k3m4_DualQuatToMatBatchScalar(count, m_scalar.data(), 16, dq_scalar.data(), 8);
+            Check(SameBits(m_simd.data(), m_scalar.data(), 16 * count + 1), "dualQuat_ToMatBatch", detail);
+
+            // the round trip gives the rotation matrix with the translation in the last column
+            bool ok = true;
+            for (i = 0; i < count; i++) {
+                float expect[16];
+                const float* t = xlat.data() + i * xlat_stride;
+                k3m_QuatToMat(4, expect, s1.data() + i * stride);
+                expect[3] = t[0]; expect[7] = t[1]; expect[11] = t[2];
+                ok = ok && Near(expect, m_scalar.data() + i * 16, 16, 1.0e-5f);
+            }
+            Check(ok, "dualQuat_ToMatBatch", "round trip through a dual quaternion");
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Bounding box batches
+
+// Boxes on a coarse grid, so faces often touch exactly and the >= edges of the overlap rules get exercised
+static void RandomBox(k3AABB* d, uint32_t* seed)
+{
+    uint32_t axis;
+    for (axis = 0; axis < 3; axis++) {
+        float a = static_cast<float>(Random(seed) % 17) * 0.5f - 4.0f;
+        float b = a + static_cast<float>(Random(seed) % 9) * 0.5f;
+        d->min[axis] = a;
+        d->max[axis] = b;
+    }
+}
+
+static void TestAABBKernels(const char* level_name, uint32_t* seed)
+{
+    char detail[128];
+    uint32_t count, trial, i, axis;
+
+    for (count = 0; count <= 70; count++) {
+        for (trial = 0; trial < 4; trial++) {
+            const uint32_t words = (count + 31) / 32;
+            std::vector<float> coords(6 * count + 6);
+            k3AABBArray boxes;
+            k3AABB s1, box;
+            RandomBox(&s1, seed);
+            for (axis = 0; axis < 3; axis++) {
+                boxes.min[axis] = coords.data() + axis * count;
+                boxes.max[axis] = coords.data() + (axis + 3) * count;
+            }
+            for (i = 0; i < count; i++) {
+                RandomBox(&box, seed);
+                for (axis = 0; axis < 3; axis++) {
+                    boxes.min[axis][i] = box.min[axis];
+                    boxes.max[axis][i] = box.max[axis];
+                }
+            }
+            snprintf(detail, sizeof(detail), "%s count %u", level_name, count);
+
+            // mask words start dirty, and the kernel has to clear the bits past count itself
+            std::vector<uint32_t> mask_simd(words + 1, 0xdeadbeef), mask_scalar(words + 1, 0xdeadbeef);
+            std::vector<uint32_t> flags_simd(count + 1, 0xdeadbeef), flags_scalar(count + 1, 0xdeadbeef);
+            k3math_funcs.bvh_CheckCollisionBatch(&s1, &boxes, count, mask_simd.data(), flags_simd.data());
+            k3bvh_CheckCollisionBatchScalar(&s1, &boxes, count, mask_scalar.data(), flags_scalar.data());
+            Check(mask_simd == mask_scalar, "bvh_CheckCollisionBatch hit mask", detail);
+            Check(flags_simd == flags_scalar, "bvh_CheckCollisionBatch axis flags", detail);
+
+            // the mask alone, without axis flags
+            std::vector<uint32_t> mask_only(words + 1, 0xdeadbeef);
+            k3math_funcs.bvh_CheckCollisionBatch(&s1, &boxes, count, mask_only.data(), NULL);
+            Check(mask_only == mask_scalar, "bvh_CheckCollisionBatch without axis flags", detail);
+
+            // closed intervals overlap on every axis
+            bool ok = mask_scalar[words] == 0xdeadbeef && flags_scalar[count] == 0xdeadbeef;
+            for (i = 0; i < count; i++) {
+                bool hit = true;
+                for (axis = 0; axis < 3; axis++) hit = hit && s1.max[axis] >= boxes.min[axis][i] && boxes.max[axis][i] >= s1.min[axis];
+                ok = ok && ((mask_scalar[i / 32] >> (i % 32)) & 1) == (hit ? 1u : 0u);
+                ok = ok && (flags_scalar[i] != K3_AXIS_DIR_FLAG_NONE) == hit;
+            }
+            if (count % 32) ok = ok && (mask_scalar[count / 32] >> (count % 32)) == 0;
+            Check(ok, "bvh_CheckCollisionBatch", "hits differ from the interval overlap test");
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Frustum classification
+
+// Plane distance summed in the same order as k3bvh_ClassifyFrustumLane
+static float PlaneDistance(const float* plane, const float* p)
+{
+    return plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] + plane[3];
+}
+
+static void TestFrustumKernels(const char* level_name, uint32_t* seed)
+{
+    const float eye[3] = { 1.0f, 2.0f, -3.0f };
+    const float at[3] = { 0.0f, 0.5f, 4.0f };
+    const float up[3] = { 0.0f, 1.0f, 0.0f };
+    char detail[128];
+    uint32_t style, count, i, p, corner, axis;
+
+    for (style = 0; style < 8; style++) {
+        const bool dx_style = (style & 1) != 0;
+        const bool reverse_z = (style & 2) != 0;
+        const bool left_handed = (style & 4) != 0;
+        float view[16], proj[16], view_proj[16], planes[24];
+        k3m4_SetLookAt(view, eye, at, up, left_handed);
+        k3m4_SetPerspectiveFov(proj, 1.0f, 1.5f, 0.5f, 12.0f, left_handed, dx_style, reverse_z);
+        k3m4_MulScalar(view_proj, proj, view);
+        k3m4_GetFrustumPlanes(planes, view_proj, dx_style, reverse_z);
+        snprintf(detail, sizeof(detail), "%s dx %d reverse z %d left handed %d", level_name, dx_style, reverse_z, left_handed);
+
+        // the planes agree with the clip space bounds for points clearly inside or outside
+        // a gl style reverse z projection has a conservative far plane, so only its other bounds are checked
+        bool ok = true;
+        for (i = 0; i < 2000; i++) {
+            float pt[4] = { RandomFloat(seed, -12.0f, 12.0f), RandomFloat(seed, -12.0f, 12.0f), RandomFloat(seed, -12.0f, 12.0f), 1.0f };
+            float clip[4];
+            k3mv4_MulScalar(clip, view_proj, pt);
+            float w = clip[3];
+            float z_low = (dx_style) ? clip[2] : clip[2] + w;
+            float bounds[6] = { w + clip[0], w - clip[0], w + clip[1], w - clip[1], z_low, w - clip[2] };
+            if (reverse_z) {
+                float f = bounds[4];
+                bounds[4] = bounds[5];
+                bounds[5] = f;
+            }
+            for (p = 0; p < 6; p++) {
+                if (p == 5 && reverse_z && !dx_style) continue;
+                if (fabsf(bounds[p]) < 1.0e-3f) continue;
+                ok = ok && ((bounds[p] >= 0.0f) == (PlaneDistance(planes + 4 * p, pt) >= 0.0f));
+            }
+        }
+        Check(ok, "k3m4_GetFrustumPlanes", detail);
+
+        uint32_t classes[3] = { 0, 0, 0 };
+        for (count = 0; count <= 37; count++) {
+            std::vector<k3AABB> boxes(count);
+            for (i = 0; i < count; i++) {
+                for (axis = 0; axis < 3; axis++) {
+                    float center = RandomFloat(seed, -14.0f, 14.0f);
+                    float half = RandomFloat(seed, 0.0f, 3.0f);
+                    boxes[i].min[axis] = center - half;
+                    boxes[i].max[axis] = center + half;
+                }
+            }
+            std::vector<uint32_t> d_simd(count + 1, 0xdeadbeef), d_scalar(count + 1, 0xdeadbeef);
+            k3math_funcs.bvh_ClassifyFrustumBatch(d_simd.data(), planes, boxes.data(), count);
+            k3bvh_ClassifyFrustumBatchScalar(d_scalar.data(), planes, boxes.data(), count);
+            Check(d_simd == d_scalar, "bvh_ClassifyFrustumBatch", detail);
+
+            // brute force over all 8 corners: outside when every corner is behind one plane,
+            // inside when every corner is in front of every plane
+            ok = d_scalar[count] == 0xdeadbeef;
+            for (i = 0; i < count; i++) {
+                uint32_t expect = K3_FRUSTUM_INSIDE;
+                for (p = 0; p < 6; p++) {
+                    uint32_t behind = 0;
+                    for (corner = 0; corner < 8; corner++) {
+                        float pt[3];
+                        for (axis = 0; axis < 3; axis++) pt[axis] = ((corner >> axis) & 1) ? boxes[i].max[axis] : boxes[i].min[axis];
+                        if (PlaneDistance(planes + 4 * p, pt) < 0.0f) behind++;
+                    }
+                    if (behind == 8) expect = K3_FRUSTUM_OUTSIDE;
+                    else if (behind != 0 && expect == K3_FRUSTUM_INSIDE) expect = K3_FRUSTUM_INTERSECT;
+                    if (expect == K3_FRUSTUM_OUTSIDE) break;
+                }
+                ok = ok && d_scalar[i] == expect;
+                classes[expect]++;
+            }
+            Check(ok, "bvh_ClassifyFrustumBatch", "differs from the corner by corner test");
+        }
+        Check(classes[K3_FRUSTUM_OUTSIDE] && classes[K3_FRUSTUM_INTERSECT] && classes[K3_FRUSTUM_INSIDE], "bvh_ClassifyFrustumBatch", "boxes did not cover every class");
+    }
+}
+
+// ------------------------------------------------------------
+// Fast transcendentals
+
+// Float with a random sign, mantissa and an exponent in lo_exp to hi_exp
+static float RandomWideFloat(uint32_t* seed, int lo_exp, int hi_exp)
+{
+    float m = RandomFloat(seed, 1.0f, 2.0f);
+    int e = lo_exp + static_cast<int>(Random(seed) % static_cast<uint32_t>(hi_exp - lo_exp + 1));
+    return ((Random(seed) & 1) ? -1.0f : 1.0f) * ldexpf(m, e);
+}
+
+static void TestFastKernels(const char* level_name, uint32_t* seed)
+{
+    const uint32_t count = 4099;
+    const float specials[] = { 0.0f, -0.0f, 1.0f, -1.0f, 3.14159265f, -3.14159265f, 1.57079633f, 6.28318531f, 8192.0f, -8192.0f, 1.0e-30f };
+    const uint32_t num_specials = sizeof(specials) / sizeof(specials[0]);
+    char detail[128];
+    uint32_t i, j;
+
+    std::vector<float> angles(count), ys(count), xs(count), positives(count);
+    for (i = 0; i < count; i++) {
+        angles[i] = (i < num_specials) ? specials[i] : (i & 1) ? RandomFloat(seed, -8192.0f, 8192.0f) : RandomFloat(seed, -8.0f, 8.0f);
+        ys[i] = (i < num_specials) ? specials[i] : RandomWideFloat(seed, -20, 20);
+        xs[i] = (i < num_specials) ? specials[num_specials - 1 - i] : RandomWideFloat(seed, -20, 20);
+        positives[i] = fabsf(RandomWideFloat(seed, -126, 127));
+    }
+    // every combination of signed zeros and ones for atan2
+    for (i = 0; i < 16; i++) {
+        const float values[4] = { 0.0f, -0.0f, 1.0f, -1.0f };
+        ys[num_specials + i] = values[i / 4];
+        xs[num_specials + i] = values[i % 4];
+    }
+    snprintf(detail, sizeof(detail), "%s", level_name);
+
+    std::vector<float> sin_simd(count + 1, 7.0f), cos_simd(count + 1, 7.0f), sin_scalar(count + 1, 7.0f), cos_scalar(count + 1, 7.0f);
+    std::vector<float> atan_simd(count + 1, 7.0f), atan_scalar(count + 1, 7.0f), rsqrt_simd(count + 1, 7.0f), rsqrt_scalar(count + 1, 7.0f);
+    // every length up to 37 for the tails, then the whole batch
+    for (i = 1; i <= 38; i++) {
+        uint32_t len = (i == 38) ? count : i;
+        k3math_funcs.v_FastSinCos(len, sin_simd.data(), cos_simd.data(), angles.data());
+        k3v_FastSinCosScalar(len, sin_scalar.data(), cos_scalar.data(), angles.data());
+        Check(SameBits(sin_simd.data(), sin_scalar.data(), count + 1) && SameBits(cos_simd.data(), cos_scalar.data(), count + 1), "v_FastSinCos", detail);
+        k3math_funcs.v_FastAtan2(len, atan_simd.data(), ys.data(), xs.data());
+        k3v_FastAtan2Scalar(len, atan_scalar.data(), ys.data(), xs.data());
+        Check(SameBits(atan_simd.data(), atan_scalar.data(), count + 1), "v_FastAtan2", detail);
+        k3math_funcs.v_FastRsqrt(len, rsqrt_simd.data(), positives.data());
+        k3v_FastRsqrtScalar(len, rsqrt_scalar.data(), positives.data());
+        Check(SameBits(rsqrt_simd.data(), rsqrt_scalar.data(), count + 1), "v_FastRsqrt", detail);
+    }
+    Check(sin_scalar[count] == 7.0f && cos_scalar[count] == 7.0f && atan_scalar[count] == 7.0f && rsqrt_scalar[count] == 7.0f, "fast batches", "wrote past the end");
+
+    // the scalar functions match the batches, and the batches stay within the documented bounds
+    bool same = true, sin_ok = true, atan_ok = true, zeros_ok = true, rsqrt_ok = true;
+    float sin_err = 0.0f, atan_err = 0.0f, rsqrt_err = 0.0f;
+    for (j = 0; j < count; j++) {
+        float s, c;
+        k3s_FastSinCos(angles[j], &s, &c);
+        same = same && SameBits(&s, &sin_scalar[j], 1) && SameBits(&c, &cos_scalar[j], 1);
+        s = k3s_FastSin(angles[j]);
+        c = k3s_FastCos(angles[j]);
+        same = same && SameBits(&s, &sin_scalar[j], 1) && SameBits(&c, &cos_scalar[j], 1);
+        float a = k3s_FastAtan2(ys[j], xs[j]);
+        float r = k3s_FastRsqrt(positives[j]);
+        same = same && SameBits(&a, &atan_scalar[j], 1) && SameBits(&r, &rsqrt_scalar[j], 1);
+
+        float e = static_cast<float>(fmax(fabs(sin_scalar[j] - sin(static_cast<double>(angles[j]))), fabs(cos_scalar[j] - cos(static_cast<double>(angles[j])))));
+        sin_err = (e > sin_err) ? e : sin_err;
+        sin_ok = sin_ok && e <= 2.0e-7f;
+        e = static_cast<float>(fabs(atan_scalar[j] - atan2(static_cast<double>(ys[j]), static_cast<double>(xs[j]))));
+        atan_err = (e > atan_err) ? e : atan_err;
+        atan_ok = atan_ok && e <= 3.0e-7f;
+        if (ys[j] == 0.0f) zeros_ok = zeros_ok && signbit(atan_scalar[j]) == signbit(atan2f(ys[j], xs[j]));
+        e = static_cast<float>(fabs(rsqrt_scalar[j] * sqrt(static_cast<double>(positives[j])) - 1.0));
+        rsqrt_err = (e > rsqrt_err) ? e : rsqrt_err;
+        rsqrt_ok = rsqrt_ok && e <= 5.0e-6f;
+    }
+    Check(same, "k3s_Fast functions", "differ from the batch scalar references");
+    snprintf(detail, sizeof(detail), "%s max error %g", level_name, sin_err);
+    Check(sin_ok, "v_FastSinCos error bound", detail);
+    snprintf(detail, sizeof(detail), "%s max error %g", level_name, atan_err);
+    Check(atan_ok, "v_FastAtan2 error bound", detail);
+    Check(zeros_ok, "v_FastAtan2 signed zeros", level_name);
+    snprintf(detail, sizeof(detail), "%s max relative error %g", level_name, rsqrt_err);
+    Check(rsqrt_ok, "v_FastRsqrt error bound", detail);
+}
+
+// ------------------------------------------------------------
+// Ray casts
+
+// Closest hit over every triangle, with the Moller-Trumbore test summed in the same order as the bvh packets
+static bool BruteForceTrace(const float* verts, const uint32_t* indices, uint32_t prim_start, uint32_t num_prims,
+                            const float* origin, const float* dir, float* t, float* bary, uint32_t* prim)
+{
+    uint32_t i, k, axis;
+    bool hit = false;
+    for (i = 0; i < num_prims; i++) {
+        float v[3][3], e1[3], e2[3], p[3], s[3], q[3];
+        for (k = 0; k < 3; k++) {
+            uint32_t v_index = 3 * (prim_start + i) + k;
+            if (indices) v_index = indices[v_index];
+            for (axis = 0; axis < 3; axis++) v[k][axis] = verts[3 * v_index + axis];
+        }
+        for (axis = 0; axis < 3; axis++) {
+            e1[axis] = v[1][axis] - v[0][axis];
+            e2[axis] = v[2][axis] - v[0][axis];
+            s[axis] = origin[axis] - v[0][axis];
+        }
+        p[0] = dir[1] * e2[2] - dir[2] * e2[1];
+        p[1] = dir[2] * e2[0] - dir[0] * e2[2];
+        p[2] = dir[0] * e2[1] - dir[1] * e2[0];
+        float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        if (det == 0.0f) continue;
+        float inv_det = 1.0f / det;
+        float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+        q[0] = s[1] * e1[2] - s[2] * e1[1];
+        q[1] = s[2] * e1[0] - s[0] * e1[2];
+        q[2] = s[0] * e1[1] - s[1] * e1[0];
+        float v_bary = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) * inv_det;
+        float dist = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+        if (u < 0.0f || v_bary < 0.0f || u + v_bary > 1.0f || dist < 0.0f || dist >= *t) continue;
+        *t = dist;
+        bary[0] = u;
+        bary[1] = v_bary;
+        *prim = prim_start + i;
+        hit = true;
+    }
+    return hit;
+}
+
+struct RaySoup {
+    const char* name;
+    std::vector<float> verts;
+    std::vector<uint32_t> indices;
+    uint32_t prim_start;
+    uint32_t num_prims;
+};
+
+static void MakeRaySoups(std::vector<RaySoup>* soups, uint32_t* seed)
+{
+    const uint32_t random_counts[] = { 1, 2, 3, 4, 5, 7, 16, 100, 1000 };
+    uint32_t i, j, k, x, z;
+    for (i = 0; i < sizeof(random_counts) / sizeof(random_counts[0]); i++) {
+        RaySoup soup = { "random triangles", std::vector<float>(), std::vector<uint32_t>(), 0, random_counts[i] };
+        for (j = 0; j < random_counts[i]; j++) {
+            float c[3] = { RandomFloat(seed, -10.0f, 10.0f), RandomFloat(seed, -10.0f, 10.0f), RandomFloat(seed, -10.0f, 10.0f) };
+            for (k = 0; k < 9; k++) soup.verts.push_back(c[k % 3] + RandomFloat(seed, -2.0f, 2.0f));
+        }
+        soups->push_back(soup);
+    }
+
+    // a height field sharing its vertices through an index buffer, built from its second row of quads on
+    const uint32_t grid = 24;
+    RaySoup field = { "indexed height field", std::vector<float>(), std::vector<uint32_t>(), 2 * (grid - 1), 0 };
+    for (z = 0; z < grid; z++) {
+        for (x = 0; x < grid; x++) {
+            field.verts.push_back(static_cast<float>(x) - 12.0f);
+            field.verts.push_back(RandomFloat(seed, -1.0f, 1.0f));
+            field.verts.push_back(static_cast<float>(z) - 12.0f);
+        }
+    }
+    for (z = 0; z + 1 < grid; z++) {
+        for (x = 0; x + 1 < grid; x++) {
+            uint32_t v = z * grid + x;
+            uint32_t quad[6] = { v, v + grid, v + 1, v + 1, v + grid, v + grid + 1 };
+            field.indices.insert(field.indices.end(), quad, quad + 6);
+        }
+    }
+    field.num_prims = static_cast<uint32_t>(field.indices.size() / 3) - field.prim_start;
+    soups->push_back(field);
+
+    // many copies of one triangle, so the centroids have no extent to split, plus flat and point triangles
+    RaySoup stack = { "stacked and degenerate triangles", std::vector<float>(), std::vector<uint32_t>(), 0, 0 };
+    const float tri[9] = { -3.0f, -2.0f, 1.0f, 4.0f, -1.0f, 0.5f, 0.0f, 3.0f, -1.0f };
+    for (j = 0; j < 200; j++) {
+        for (k = 0; k < 9; k++) {
+            float value = tri[k];
+            if (j % 4 == 1 && k >= 6) value = tri[k - 3];  // last corner on the second: a line
+            if (j % 4 == 2) value = tri[k % 3];  // all corners on the first: a point
+            stack.verts.push_back(value);
+        }
+    }
+    stack.num_prims = 200;
+    soups->push_back(stack);
+}
+
+static void TestRayCast(const char* level_name, uint32_t* seed)
+{
+    std::vector<RaySoup> soups;
+    char detail[160];
+    uint32_t s, r, k, axis;
+    MakeRaySoups(&soups, seed);
+
+    for (s = 0; s < soups.size(); s++) {
+        const RaySoup& soup = soups[s];
+        const uint32_t* indices = (soup.indices.empty()) ? NULL : soup.indices.data();
+        k3meshBVH bvh;
+        k3bvh_Build(&bvh, soup.verts.data(), indices, soup.prim_start, soup.num_prims);
+        snprintf(detail, sizeof(detail), "%s, %s of %u", level_name, soup.name, soup.num_prims);
+        Check(bvh.nodes != NULL && bvh.num_packets <= soup.num_prims && bvh.num_nodes <= soup.num_prims + 1, "k3bvh_Build", detail);
+
+        uint32_t hits = 0;
+        bool same = true, limited = true;
+        for (r = 0; r < 400; r++) {
+            float origin[3], dir[3], target[3];
+            for (axis = 0; axis < 3; axis++) origin[axis] = RandomFloat(seed, -15.0f, 15.0f);
+            if (r % 2 == 0) {
+                // aim at a corner of a random triangle
+                uint32_t v_index = 3 * (soup.prim_start + Random(seed) % soup.num_prims) + Random(seed) % 3;
+                if (indices) v_index = indices[v_index];
+                for (axis = 0; axis < 3; axis++) target[axis] = soup.verts[3 * v_index + axis] + RandomFloat(seed, -0.5f, 0.5f);
+                k3v3_Sub(dir, target, origin);
+            } else {
+                for (axis = 0; axis < 3; axis++) dir[axis] = RandomFloat(seed, -1.0f, 1.0f);
+            }
+            // axis aligned rays have infinite inverse directions
+            if (r % 8 == 1) dir[Random(seed) % 3] = 0.0f;
+            if (r % 8 == 3) {
+                k = Random(seed) % 3;
+                dir[(k + 1) % 3] = 0.0f;
+                dir[(k + 2) % 3] = 0.0f;
+                if (dir[k] == 0.0f) dir[k] = 1.0f;
+            }
+
+            float t_bvh = INFINITY, t_brute = INFINITY;
+            float bary_bvh[2] = { 0.0f, 0.0f }, bary_brute[2] = { 0.0f, 0.0f };
+            uint32_t prim_bvh = ~0u, prim_brute = ~0u;
+            bool hit_bvh = k3bvh_Trace(&bvh, origin, dir, &t_bvh, bary_bvh, &prim_bvh);
+            bool hit_brute = BruteForceTrace(soup.verts.data(), indices, soup.prim_start, soup.num_prims, origin, dir, &t_brute, bary_brute, &prim_brute);
+            hits += (hit_brute) ? 1 : 0;
+            same = same && hit_bvh == hit_brute && SameBits(&t_bvh, &t_brute, 1);
+            if (hit_bvh && prim_bvh == prim_brute) same = same && SameBits(bary_bvh, bary_brute, 2);
+            if (hit_bvh && prim_bvh != prim_brute) {
+                // a tie; the bvh hit must be just as close
+                float t_tie = INFINITY, bary_tie[2];
+                uint32_t prim_tie;
+                same = same && prim_bvh >= soup.prim_start && prim_bvh < soup.prim_start + soup.num_prims;
+                same = same && BruteForceTrace(soup.verts.data(), indices, prim_bvh, 1, origin, dir, &t_tie, bary_tie, &prim_tie) && t_tie == t_brute;
+            }
+
+            // an incoming t at or before the closest hit leaves everything untouched
+            if (hit_brute) {
+                float t_limit = t_brute;
+                uint32_t prim_limit = 12345;
+                limited = limited && !k3bvh_Trace(&bvh, origin, dir, &t_limit, bary_bvh, &prim_limit) && t_limit == t_brute && prim_limit == 12345;
+            }
+        }
+        Check(same, "k3bvh_Trace against brute force", detail);
+        Check(limited, "k3bvh_Trace with a limiting t", detail);
+        Check(hits > 0, "k3bvh_Trace", "no ray hit anything");
+
+        // traced in model space through the inverse transform, as k3meshObj::rayCast does,
+        // with t matching the world space brute force without renormalizing the direction
+        float xform[16], inv_xform[16];
+        std::vector<float> world_verts(soup.verts.size());
+        RandomAffine(xform, seed, true);
+        for (k = 0; k < soup.verts.size(); k += 3) {
+            float v4[4] = { soup.verts[k], soup.verts[k + 1], soup.verts[k + 2], 1.0f }, w4[4];
+            k3mv4_Mul(w4, xform, v4);
+            memcpy(&world_verts[k], w4, 3 * sizeof(float));
+        }
+        memcpy(inv_xform, xform, sizeof(xform));
+        k3m4_InverseTransform(inv_xform);
+        bool close = true;
+        for (r = 0; r < 100; r++) {
+            // rays at the centers of triangles with some area hit well inside in both spaces
+            uint32_t p = soup.prim_start + Random(seed) % soup.num_prims;
+            float corner[3][3], e1[3], e2[3], normal[3];
+            float center[3] = { 0.0f, 0.0f, 0.0f }, origin[4], dir[4], local_origin[4], local_dir[4];
+            for (k = 0; k < 3; k++) {
+                uint32_t v_index = (indices) ? indices[3 * p + k] : 3 * p + k;
+                for (axis = 0; axis < 3; axis++) {
+                    corner[k][axis] = world_verts[3 * v_index + axis];
+                    center[axis] += corner[k][axis] / 3.0f;
+                }
+            }
+            k3v3_Sub(e1, corner[1], corner[0]);
+            k3v3_Sub(e2, corner[2], corner[0]);
+            k3v3_Cross(normal, e1, e2);
+            if (k3v3_Length(normal) < 1.0e-3f) continue;
+            for (axis = 0; axis < 3; axis++) origin[axis] = center[axis] + RandomFloat(seed, -50.0f, 50.0f);
+            k3v3_Sub(dir, center, origin);
+            origin[3] = 1.0f;
+            dir[3] = 0.0f;
+            k3mv4_Mul(local_origin, inv_xform, origin);
+            k3mv4_Mul(local_dir, inv_xform, dir);
+
+            float t_local = INFINITY, t_world = INFINITY, bary[2];
+            uint32_t prim_local, prim_world;
+            bool hit_local = k3bvh_Trace(&bvh, local_origin, local_dir, &t_local, bary, &prim_local);
+            bool hit_world = BruteForceTrace(world_verts.data(), indices, soup.prim_start, soup.num_prims, origin, dir, &t_world, bary, &prim_world);
+            close = close && hit_world && t_world <= 1.0f + 1.0e-4f;
+            close = close && hit_local && fabsf(t_local - t_world) <= 1.0e-3f;
+        }
+        Check(close, "k3bvh_Trace through an inverse transform", detail);
+
+        delete[] bvh.nodes;
+        delete[] bvh.packets;
+    }
+
+    // no triangles builds an empty bvh
+    k3meshBVH empty;
+    k3bvh_Build(&empty, NULL, NULL, 0, 0);
+    Check(empty.nodes == NULL && empty.packets == NULL, "k3bvh_Build", "no triangles");
+}
+
+int main()
+{
+    const k3simdLevel levels[] = { k3simdLevel::NONE, k3simdLevel::SSE41, k3simdLevel::AVX2, k3simdLevel::NEON };
+    k3simdLevel max_level = k3math_GetMaxSimdLevel();
+    uint32_t l;
+
+    k3error::SetHandler(ErrorHandler);
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        if (k3math_SetSimdLevel(levels[l]) != levels[l]) continue;
+        const char* level_name = LevelName(levels[l]);
+        printf("simd level %s\n", level_name);
+        uint32_t seed = 1;
+        TestVectorKernels(level_name, &seed);
+        TestMatrixKernels(level_name, &seed);
+        TestMulArrayKernels(level_name, &seed);
+        TestGeneralMatrices(level_name, &seed);
+        TestQuatKernels(level_name, &seed);
+        TestAABBKernels(level_name, &seed);
+        TestFrustumKernels(level_name, &seed);
+        TestFastKernels(level_name, &seed);
+        TestRayCast(level_name, &seed);
+    }
+    k3math_SetSimdLevel(max_level);
+    printf("%u checks, %u failed\n", num_checks, num_fails);
+    return (num_fails == 0) ? 0 : 1;
+}